@@ -43,6 +43,9 @@
 /* The basic structures of the ch10fs filesystem */
 #define CH10_BLOCK_SIZE    512
 
+/* Largest block size accepted for a volume */
+#define CH10_MAX_BLOCK_SIZE (64 * 1024)
+
 #define CH10_MAXFN 48
 
 
@@ -80,6 +83,13 @@ struct ch10_dir_block {
   struct ch10_dir_entry dirEntries[MAX_FILES_PER_DIR]; // all entries/files in the block
 };
 
+/*
+ * First reserved byte of an entry of a recording striped over several
+ * cartridges, see ch10tools/inc/ch10_fs.h. The driver does not mount a
+ * striped set.
+ */
+#define CH10_STRIPE_TAG 'S'
+
 #include <poppack.h>
 
 #endif
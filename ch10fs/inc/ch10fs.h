@@ -33,5 +33,5 @@ __u32 GetDirEntryIndex(struct ch10_dir_block dirblocks[], struct ch10_dir_entry
 
 __u32 FsdCh10GetFileCount(struct ch10_dir_block dirblocks[]);
 
-__u32 FsdCh10PartitionSize(struct ch10_dir_block *DirBlocks);
+__u64 FsdCh10PartitionSize(struct ch10_dir_block *DirBlocks);
 #endif
@@ -0,0 +1,121 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _CH10_IDX_
+#define _CH10_IDX_
+
+#include "ltypes.h"
+
+//
+// Index sidecar
+//
+// A file kept next to an image, or in the driver's index directory, that
+// holds what a reader would otherwise rebuild on every mount: the name
+// hash, per recording summaries and the packet tables. It is tied to one
+// state of the volume by a fingerprint, FNV-1a 64 over the directory
+// blocks in link order, which covers the volume name, every entry and
+// every recording size. All fields are stored little-endian and every
+// section starts on an 8 byte boundary, so the file can be mapped and
+// used in place.
+//
+
+#define CH10_INDEX_MAGIC            "CH10IDX"
+#define CH10_INDEX_VERSION          1
+#define CH10_INDEX_SUFFIX           ".ch10idx"
+#define CH10_INDEX_ALIGN            8
+#define CH10_INDEX_MAX_SECTIONS     8
+
+//
+// Section types, a reader skips types it does not know
+//
+#define CH10_INDEX_NAMES            1   // __u32 slots, see ch10_index_file
+#define CH10_INDEX_FILES            2   // struct ch10_index_file
+#define CH10_INDEX_PACKETS          3   // struct ch10_index_packet
+#define CH10_INDEX_TIMES            4   // struct ch10_index_time
+
+#define CH10_FNV64_BASIS            0xCBF29CE484222325ULL
+#define CH10_FNV64_PRIME            0x00000100000001B3ULL
+
+#include <pshpack1.h>
+
+struct ch10_index_section {
+  __u32 type;                // CH10_INDEX_XXX
+  __u32 checksum;            // CRC-32 of the section data
+  __u64 offset;              // from the start of the file
+  __u64 length;              // in bytes
+  __u64 count;               // number of records
+};
+
+struct ch10_index_header {
+  __u8 magic[8];             // CH10_INDEX_MAGIC, NUL padded
+  __u32 version;             // CH10_INDEX_VERSION
+  __u32 headerSize;          // size of this header
+  __u64 fingerprint;         // of the volume the index was built from
+  __u64 fileSize;            // size of the whole sidecar
+  __u32 bytesPerBlock;       // of the volume
+  __u32 fileCount;           // records in the FILES section
+  __u32 sectionCount;        // sections in use
+  __u32 headerChecksum;      // CRC-32 of the header with this field zero
+  struct ch10_index_section sections[CH10_INDEX_MAX_SECTIONS];
+};
+
+//
+// A recording. The NAMES section is an open addressed table with a power
+// of two number of slots, at most half used. Slots hold the number of a
+// record in this section plus one, zero marks an empty slot, and names
+// hash with FNV-1a 32 over the upper cased name, probing linearly.
+//
+struct ch10_index_file {
+  __u64 size;                // size from the directory entry
+  __u64 firstPacket;         // first record of the recording in PACKETS
+  __u64 packetCount;         // packets found in the recording
+  __u64 firstRtc;            // relative time of the first and last packet
+  __u64 lastRtc;
+  __u64 skippedBytes;        // bytes that are not part of a valid packet
+  __u32 dirEntry;            // position of the directory block in the chain
+                             // times MAX_FILES_PER_DIR plus the entry number
+  __u32 nameHash;            // FNV-1a 32 of the upper cased name
+};
+
+//
+// A packet with a valid header, in recording order
+//
+struct ch10_index_packet {
+  __u64 offset;              // from the start of the recording
+  __u64 rtc;                 // 48 bit relative time counter
+  __u32 packetLength;
+  __u16 channelId;
+  __u8 dataType;             // CH10_DATA_XXX
+  __u8 packetFlags;          // CH10_FLAG_XXX
+};
+
+//
+// A time packet, the anchors between relative and absolute time, sorted
+// by relative time over all recordings
+//
+struct ch10_index_time {
+  __u64 rtc;
+  __u64 packet;              // record in PACKETS
+  __u32 fileIndex;           // record in FILES
+  __u32 reserved;
+};
+
+#include <poppack.h>
+
+#endif
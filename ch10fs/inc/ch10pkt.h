@@ -0,0 +1,111 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _CH10_PKT_
+#define _CH10_PKT_
+
+#include "ltypes.h"
+
+//
+// Packet level structures of a Chapter 10 recording. Unlike the directory
+// everything inside a recording file is stored little-endian.
+//
+
+#define CH10_PACKET_SYNC            0xEB25
+
+#define CH10_PACKET_HEADER_SIZE     24
+#define CH10_SECONDARY_HEADER_SIZE  12
+#define CH10_PACKET_ALIGN           4
+
+//
+// Largest packet the standard allows (524288 bytes)
+//
+#define CH10_MAX_PACKET_SIZE        0x80000
+
+//
+// The relative time counter runs at 10 MHz
+//
+#define CH10_RTC_HZ                 10000000ULL
+
+//
+// Data types used by the driver
+//
+#define CH10_DATA_TMATS             0x01
+#define CH10_DATA_PCM_F1            0x09
+#define CH10_DATA_TIME_F1           0x11
+#define CH10_DATA_1553_F1           0x19
+#define CH10_DATA_ARINC429_F0       0x38
+#define CH10_DATA_ETHERNET_F0       0x68
+
+//
+// Packet flags
+//
+#define CH10_FLAG_SECONDARY_HEADER  0x80
+#define CH10_FLAG_IPTS_SOURCE       0x40
+#define CH10_FLAG_RTC_SYNC_ERROR    0x20
+#define CH10_FLAG_DATA_OVERFLOW     0x10
+#define CH10_FLAG_CHECKSUM_MASK     0x03
+
+#define CH10_CHECKSUM_NONE          0
+#define CH10_CHECKSUM_8             1
+#define CH10_CHECKSUM_16            2
+#define CH10_CHECKSUM_32            3
+
+#include <pshpack1.h>
+
+/*
+ * Ch10 Packet Header
+ */
+struct ch10_packet_header {
+  __u16 syncPattern;         // always CH10_PACKET_SYNC
+  __u16 channelId;           // channel the packet was recorded from
+  __u32 packetLength;        // length of the whole packet in bytes, a multiple of 4
+  __u32 dataLength;          // length of the packet body in bytes, without filler or checksum
+  __u8 dataTypeVersion;      // version of the data type definitions
+  __u8 sequenceNum;          // per channel sequence number, wraps at 255
+  __u8 packetFlags;          // CH10_FLAG_XXX
+  __u8 dataType;             // CH10_DATA_XXX
+  __u8 relativeTimeCounter[6]; // 48 bit, 10 MHz relative time counter
+  __u16 headerChecksum;      // 16 bit sum of the preceding header words
+};
+
+/*
+ * Time data format 1, day format, or day, month and year format when
+ * CH10_TIME_CSDW_DMY is set
+ */
+struct ch10_time_f1 {
+  __u32 csdw;                // channel specific data word
+  __u16 msec;                // BCD tens/hundreds of ms, seconds
+  __u16 minHour;             // BCD minutes and hours
+  __u16 day;                 // BCD day of year, or day and month
+  __u16 reserved;            // BCD year in the DMY format
+};
+
+#include <poppack.h>
+
+//
+// Channel specific data word of a time packet
+//
+#define CH10_TIME_CSDW_LEAP_YEAR        0x00000100
+#define CH10_TIME_CSDW_DMY              0x00000200
+
+#define CH10_TIME_CSDW_SRC(Csdw)        ((Csdw) & 0x0f)
+#define CH10_TIME_CSDW_FMT(Csdw)        (((Csdw) >> 4) & 0x0f)
+
+#endif
@@ -24,6 +24,8 @@
 #include <ntverp.h>
 
 #include "ch10_fs.h"
+#include "ch10idx.h"
+#include "ch10pkt.h"
 
 //
 // Name for the driver and it's main device
@@ -48,6 +50,115 @@
 #define IOCTL_PREPARE_TO_UNLOAD \
     CTL_CODE(FILE_DEVICE_UNKNOWN, 2048, METHOD_NEITHER, FILE_WRITE_ACCESS)
 
+//
+// Private FSCTL returning FSD_METACACHE_STATISTICS
+//
+#define FSCTL_CH10_QUERY_METACACHE_STATISTICS \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 2049, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Private FSCTL returning FSD_WORKER_STATISTICS
+//
+#define FSCTL_CH10_QUERY_WORKER_STATISTICS \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 2050, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Private FSCTL returning FSD_CACHE_STATISTICS
+//
+#define FSCTL_CH10_QUERY_CACHE_STATISTICS \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 2051, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Private FSCTL converting between relative and absolute time of a
+// recording, FSD_TIME_QUERY in and out
+//
+#define FSCTL_CH10_QUERY_TIME \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 2052, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Private FSCTL returning FSD_TIME_POINTS, the time correlation of a
+// recording, from the point given as a ULONG input on
+//
+#define FSCTL_CH10_QUERY_TIME_POINTS \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 2053, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Private FSCTL answering from the ARINC-429 label index of a recording,
+// FSD_ARINC_QUERY in and FSD_ARINC_LABELS or FSD_ARINC_PACKETS out
+//
+#define FSCTL_CH10_QUERY_ARINC \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 2054, METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+//
+// Private FSCTL reading the packets of a set of channels of a recording,
+// FSD_CHANNEL_READ in and FSD_CHANNEL_DATA out. The output buffer is
+// locked and the packets are read for it from the extents of the
+// recording that hold them and nothing else.
+//
+#define FSCTL_CH10_READ_CHANNELS \
+    CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 2055, METHOD_OUT_DIRECT, FILE_READ_DATA)
+
+//
+// Size of the reads used to walk the directory chain at mount
+//
+#define FSD_DIR_READ_AHEAD  (32 * 1024)
+
+//
+// Largest read sent to the device when it does not report a limit, and
+// how many pieces of a split read are sent down at the same time
+//
+#define FSD_DEFAULT_TRANSFER_LENGTH (64 * 1024)
+#define FSD_MAX_OUTSTANDING_READS   8
+
+//
+// Gap between two wanted packets that FSCTL_CH10_READ_CHANNELS reads
+// through instead of starting another extent, and the most it reads into
+// its buffer before copying the packets out
+//
+#define FSD_CHANNEL_READ_GAP        (4 * 1024)
+#define FSD_CHANNEL_READ_STAGE      (1024 * 1024)
+
+//
+// Read ahead granularity of cached files: opened for sequential access,
+// opened with no hint, and opened for random access. The first is the
+// size of a Cache Manager view, read ahead does not span views.
+//
+#define FSD_SEQUENTIAL_READ_AHEAD   (256 * 1024)
+#define FSD_DEFAULT_READ_AHEAD      (64 * 1024)
+#define FSD_RANDOM_READ_AHEAD       PAGE_SIZE
+
+//
+// Threads that run queued requests, how many of them work for one volume
+// at the same time and how many deferred closes one of them takes at once.
+// They run at the priority of the critical system work queue threads.
+//
+#define FSD_WORKER_THREADS          4
+#define FSD_WORKERS_PER_VOLUME      2
+#define FSD_CLOSE_BATCH             16
+#define FSD_WORKER_PRIORITY         (LOW_REALTIME_PRIORITY - 3)
+
+//
+// Index sidecars are looked for in this directory under the volume
+// fingerprint as 16 hex digits, and sections larger than this are not
+// loaded
+//
+#define FSD_INDEX_DIRECTORY         L"\\SystemRoot\\Ch10Index\\"
+#define FSD_INDEX_MAX_SECTION       (16 * 1024 * 1024)
+
+//
+// Vcb->IndexState, the sidecar is read outside the mount by the first
+// request that wants it
+//
+#define FSD_INDEX_NOT_LOADED        0
+#define FSD_INDEX_LOADING           1
+#define FSD_INDEX_LOADED            2
+
+//
+// Recordings are scanned for packets this many bytes at a time, it has to
+// hold the largest packet
+//
+#define FSD_SCAN_WINDOW             (1024 * 1024)
+
 #undef FlagOn
 
 #undef SetFlag
@@ -90,6 +201,507 @@ typedef struct _FSD_IDENTIFIER {
     ULONG                   Size;
 } FSD_IDENTIFIER, *PFSD_IDENTIFIER;
 
+//
+// FSD_PROBE_IDENTITY
+//
+// What a probed device is recognized by besides its device object, so a
+// device object freed and allocated again at the same address is not taken
+// for the one probed before
+//
+typedef struct _FSD_PROBE_IDENTITY {
+
+    // Media change count of the device
+    ULONG                       MediaChangeCount;
+
+    // Device and partition numbers and the extent of the partition, zero
+    // where the device does not report them
+    STORAGE_DEVICE_NUMBER       DeviceNumber;
+    LONGLONG                    StartingOffset;
+    LONGLONG                    PartitionLength;
+
+} FSD_PROBE_IDENTITY, *PFSD_PROBE_IDENTITY;
+
+//
+// FSD_PROBE_ENTRY
+//
+// A device that was recently probed and found not to hold a Ch10 volume
+//
+typedef struct _FSD_PROBE_ENTRY {
+
+    // The device probed, NULL for an unused entry
+    PDEVICE_OBJECT              DeviceObject;
+
+    // Identity of the device when it was probed
+    FSD_PROBE_IDENTITY          Identity;
+
+    // Interrupt time after which the entry is no longer used
+    ULONGLONG                   Expires;
+
+} FSD_PROBE_ENTRY, *PFSD_PROBE_ENTRY;
+
+//
+// Number of devices remembered and for how long, in 100 ns units
+//
+#define FSD_PROBE_CACHE_SIZE        16
+#define FSD_PROBE_CACHE_LIFETIME    (10 * 1000 * 1000 * 10)
+
+//
+// Size of the metadata block cache, the number of hash buckets must be a
+// power of two
+//
+#define FSD_METACACHE_SIZE          256
+#define FSD_METACACHE_BUCKETS       64
+#define FSD_METACACHE_DATA_SIZE     sizeof(struct ch10_dir_block)
+
+//
+// FSD_METACACHE_ENTRY
+//
+// A cached metadata block
+//
+typedef struct _FSD_METACACHE_ENTRY {
+
+    // Position in the LRU list, or in the free list when unused
+    LIST_ENTRY                  LruLink;
+
+    // Position in a hash bucket
+    LIST_ENTRY                  HashLink;
+
+    // The volume and block cached, Vcb is NULL for an unused entry
+    struct _FSD_VCB*            Vcb;
+    ULONGLONG                   BlockNumber;
+
+    // The entry is not evicted
+    BOOLEAN                     Pinned;
+
+    UCHAR                       Data[FSD_METACACHE_DATA_SIZE];
+
+} FSD_METACACHE_ENTRY, *PFSD_METACACHE_ENTRY;
+
+//
+// FSD_METACACHE
+//
+// LRU cache of metadata blocks for all volumes
+//
+typedef struct _FSD_METACACHE {
+
+    FAST_MUTEX                  Mutex;
+
+    // Most recently used first
+    LIST_ENTRY                  LruList;
+
+    LIST_ENTRY                  FreeList;
+
+    LIST_ENTRY                  HashTable[FSD_METACACHE_BUCKETS];
+
+    PFSD_METACACHE_ENTRY        Entries;
+
+    ULONG                       Capacity;
+    ULONG                       Used;
+    ULONG                       PinnedCount;
+
+    // Statistics
+    ULONGLONG                   Hits;
+    ULONGLONG                   Misses;
+    ULONGLONG                   Evictions;
+
+} FSD_METACACHE, *PFSD_METACACHE;
+
+//
+// Output of FSCTL_CH10_QUERY_METACACHE_STATISTICS
+//
+typedef struct _FSD_METACACHE_STATISTICS {
+    ULONGLONG                   Hits;
+    ULONGLONG                   Misses;
+    ULONGLONG                   Evictions;
+    ULONG                       Capacity;
+    ULONG                       Used;
+    ULONG                       Pinned;
+} FSD_METACACHE_STATISTICS, *PFSD_METACACHE_STATISTICS;
+
+//
+// FSD_WORK_QUEUE
+//
+// Requests queued for the worker threads on behalf of one volume, or of the
+// driver's own device object. It is allocated apart from the VCB since a
+// worker may still hold it when the last close frees the VCB.
+//
+typedef struct _FSD_WORK_QUEUE {
+
+    // Position in the ready list of the pool while there is work the
+    // workers may take
+    LIST_ENTRY                  ReadyLink;
+    BOOLEAN                     Ready;
+
+    // FSD_IRP_CONTEXTs linked through WorkLink
+    LIST_ENTRY                  Requests;
+    LIST_ENTRY                  Closes;
+
+    // Requests and closes queued, and requests being run
+    ULONG                       Depth;
+    ULONG                       Active;
+
+    // One for the VCB and one for each worker holding the queue
+    ULONG                       ReferenceCount;
+
+} FSD_WORK_QUEUE, *PFSD_WORK_QUEUE;
+
+//
+// FSD_WORKER_POOL
+//
+// The driver's worker threads. Queues with work are served round robin,
+// each worker takes one request or a batch of closes at a time.
+//
+typedef struct _FSD_WORKER_POOL {
+
+    KSPIN_LOCK                  Lock;
+
+    LIST_ENTRY                  ReadyList;
+
+    // Released once for every request or close queued
+    KSEMAPHORE                  WorkAvailable;
+
+    PKTHREAD                    Threads[FSD_WORKER_THREADS];
+    ULONG                       ThreadCount;
+
+    BOOLEAN                     Stopping;
+
+    // Requests sent to the driver's own device object
+    FSD_WORK_QUEUE              GlobalQueue;
+
+    // Statistics, times in 100 ns units
+    ULONG                       Depth;
+    ULONG                       MaxDepth;
+    ULONGLONG                   Queued;
+    ULONGLONG                   Dispatched;
+    ULONGLONG                   CloseBatches;
+    ULONGLONG                   TotalWaitTime;
+    ULONGLONG                   MaxWaitTime;
+
+} FSD_WORKER_POOL, *PFSD_WORKER_POOL;
+
+//
+// Output of FSCTL_CH10_QUERY_WORKER_STATISTICS. The volume fields are
+// for the volume the request is sent to, zero on the driver's device.
+//
+typedef struct _FSD_WORKER_STATISTICS {
+    ULONGLONG                   Queued;
+    ULONGLONG                   Dispatched;
+    ULONGLONG                   CloseBatches;
+    ULONGLONG                   TotalWaitTime;
+    ULONGLONG                   MaxWaitTime;
+    ULONG                       Threads;
+    ULONG                       Depth;
+    ULONG                       MaxDepth;
+    ULONG                       VolumeDepth;
+    ULONG                       VolumeActive;
+} FSD_WORKER_STATISTICS, *PFSD_WORKER_STATISTICS;
+
+//
+// FSD_CACHE_STATISTICS
+//
+// Cached reads sent through the Cache Manager and the time spent in
+// CcCopyRead and CcMdlRead for them, misses included, in performance
+// counter ticks. TicksPerMB gives the overhead per MB streamed.
+// Also the output of FSCTL_CH10_QUERY_CACHE_STATISTICS.
+//
+typedef struct _FSD_CACHE_STATISTICS {
+    LARGE_INTEGER               CacheMaps;
+    LARGE_INTEGER               Reads;
+    LARGE_INTEGER               Bytes;
+    LARGE_INTEGER               Ticks;
+    LARGE_INTEGER               Frequency;
+    LARGE_INTEGER               TicksPerMB;
+} FSD_CACHE_STATISTICS, *PFSD_CACHE_STATISTICS;
+
+//
+// FSD_INDEX
+//
+// The name table and recording summaries of the index sidecar that
+// matched a volume at mount time, both as stored in the sidecar, and
+// where its packet table is. The packets of a recording are read from it
+// when they are first asked for.
+//
+typedef struct _FSD_INDEX {
+
+    ULONGLONG                   Fingerprint;
+
+    // Open addressed, a slot holds a record in Files plus one
+    PULONG                      NameSlots;
+    ULONG                       NameMask;
+
+    struct ch10_index_file*     Files;
+    ULONG                       FileCount;
+
+    // The PACKETS section, PacketCount is 0 when there is none
+    ULONGLONG                   PacketsOffset;
+    ULONGLONG                   PacketCount;
+
+} FSD_INDEX, *PFSD_INDEX;
+
+//
+// FSD_TIME_TABLE
+//
+// Time correlation of a recording, one point per time packet with a valid
+// time, in recording order. Times are in units of the relative time
+// counter, from the start of the year for the day format and from 1970
+// when the FSD_TIME_YEAR flag is set. Built on first use and kept with
+// the FCB.
+//
+typedef struct _FSD_TIME_POINT {
+    ULONGLONG                   Rtc;
+    ULONGLONG                   Time;
+    ULONGLONG                   Offset;     // of the time packet
+    USHORT                      Flags;      // FSD_TIME_XXX
+    UCHAR                       Format;     // from the channel specific data word
+    UCHAR                       Source;
+    ULONG                       Reserved;
+} FSD_TIME_POINT, *PFSD_TIME_POINT;
+
+typedef struct _FSD_TIME_TABLE {
+    PFSD_TIME_POINT             Points;
+    ULONG                       Count;
+    ULONG                       JumpCount;
+    BOOLEAN                     RtcSorted;
+    BOOLEAN                     TimeSorted;
+} FSD_TIME_TABLE, *PFSD_TIME_TABLE;
+
+//
+// Flags for FSD_TIME_POINT
+//
+#define FSD_TIME_YEAR               0x0001  // time includes the year
+#define FSD_TIME_JUMP               0x0002  // time does not follow the point before
+
+//
+// Input and output of FSCTL_CH10_QUERY_TIME. FSD_TIME_FROM_RTC fills in
+// Time from Rtc and FSD_TIME_FROM_TIME fills in Rtc from Time, both give
+// the offset of the time packet a reader starts from and the flags of the
+// point the conversion used.
+//
+typedef struct _FSD_TIME_QUERY {
+    ULONG                       Mode;
+    ULONG                       Flags;
+    ULONGLONG                   Rtc;
+    ULONGLONG                   Time;
+    ULONGLONG                   Offset;
+    ULONG                       PointCount;
+    ULONG                       JumpCount;
+} FSD_TIME_QUERY, *PFSD_TIME_QUERY;
+
+#define FSD_TIME_FROM_RTC           1
+#define FSD_TIME_FROM_TIME          2
+
+//
+// FSD_PCAPNG
+//
+// The Ethernet frames of one channel of a recording seen as a pcapng
+// capture, opened as the stream <recording>:<channel>.pcapng. Only the
+// packets of the channel are listed, with the capture offset of their
+// first block, everything but the frames is generated on read. Built on
+// the first read of a stream of the channel and kept with the FCB of the
+// recording, so all streams of the channel share it.
+//
+#define FSD_PCAPNG_SUFFIX           L".pcapng"
+#define FSD_PCAPNG_HEADER_SIZE      60
+
+typedef struct _FSD_PCAPNG_PACKET {
+    ULONGLONG                   Offset;         // in the recording
+    ULONGLONG                   StreamOffset;   // of its first block
+    ULONG                       PacketLength;
+    ULONG                       FrameCount;
+} FSD_PCAPNG_PACKET, *PFSD_PCAPNG_PACKET;
+
+typedef struct _FSD_PCAPNG {
+    USHORT                      ChannelId;
+    PFSD_PCAPNG_PACKET          Packets;
+    ULONG                       Count;
+    ULONG                       Capacity;
+    ULONGLONG                   FrameCount;
+    ULONGLONG                   Size;
+    // Added to absolute times without a year
+    ULONGLONG                   Epoch;
+    UCHAR                       Header[FSD_PCAPNG_HEADER_SIZE];
+    // The next capture of the recording
+    struct _FSD_PCAPNG*         Next;
+} FSD_PCAPNG, *PFSD_PCAPNG;
+
+//
+// Output of FSCTL_CH10_QUERY_TIME_POINTS, as many points as fit
+//
+typedef struct _FSD_TIME_POINTS {
+    ULONG                       PointCount;
+    ULONG                       JumpCount;
+    ULONG                       Returned;
+    BOOLEAN                     RtcSorted;
+    BOOLEAN                     TimeSorted;
+    FSD_TIME_POINT              Points[1];
+} FSD_TIME_POINTS, *PFSD_TIME_POINTS;
+
+//
+// FSD_ARINC_INDEX
+//
+// Where the words of every ARINC-429 label of a recording are, from
+// channel, bus and label to the packets holding words with the label.
+// Labels are sorted by channel, bus and label and the packets of one
+// label follow each other in Packets in recording order. Built by one
+// scan of the recording on first use and kept with the FCB, the same
+// index Ch10BuildArincIndex of the portable tools builds.
+//
+typedef struct _FSD_ARINC_LABEL {
+    USHORT                      ChannelId;
+    UCHAR                       Bus;
+    UCHAR                       Label;
+    ULONG                       FirstPacket;    // in FSD_ARINC_INDEX.Packets
+    ULONG                       PacketCount;
+    ULONG                       Reserved;
+    ULONGLONG                   WordCount;
+} FSD_ARINC_LABEL, *PFSD_ARINC_LABEL;
+
+typedef struct _FSD_ARINC_PACKET {
+    ULONGLONG                   Offset;
+    ULONG                       PacketLength;
+    USHORT                      FirstWord;      // first word with the label
+    USHORT                      WordCount;      // words with the label
+} FSD_ARINC_PACKET, *PFSD_ARINC_PACKET;
+
+typedef struct _FSD_ARINC_INDEX {
+    PFSD_ARINC_LABEL            Labels;
+    ULONG                       LabelCount;
+    PFSD_ARINC_PACKET           Packets;
+    ULONG                       PacketCount;
+    ULONGLONG                   ArincPackets;
+    ULONGLONG                   WordCount;
+} FSD_ARINC_INDEX, *PFSD_ARINC_INDEX;
+
+//
+// Input of FSCTL_CH10_QUERY_ARINC. FSD_ARINC_QUERY_LABELS returns the
+// labels from First on, FSD_ARINC_QUERY_PACKETS the packets of the label
+// given from First on.
+//
+typedef struct _FSD_ARINC_QUERY {
+    ULONG                       Mode;
+    USHORT                      ChannelId;
+    UCHAR                       Bus;
+    UCHAR                       Label;
+    ULONG                       First;
+} FSD_ARINC_QUERY, *PFSD_ARINC_QUERY;
+
+#define FSD_ARINC_QUERY_LABELS      1
+#define FSD_ARINC_QUERY_PACKETS     2
+
+//
+// Outputs of FSCTL_CH10_QUERY_ARINC, as many labels or packets as fit
+//
+typedef struct _FSD_ARINC_LABELS {
+    ULONGLONG                   ArincPackets;
+    ULONGLONG                   WordCount;
+    ULONG                       LabelCount;
+    ULONG                       Returned;
+    FSD_ARINC_LABEL             Labels[1];
+} FSD_ARINC_LABELS, *PFSD_ARINC_LABELS;
+
+typedef struct _FSD_ARINC_PACKETS {
+    FSD_ARINC_LABEL             Label;
+    ULONG                       Returned;
+    ULONG                       Reserved;
+    FSD_ARINC_PACKET            Packets[1];
+} FSD_ARINC_PACKETS, *PFSD_ARINC_PACKETS;
+
+//
+// FSD_ARINC_STREAM
+//
+// The words of one label seen as fixed size records, opened as the stream
+// <recording>:<channel>-<bus>-<label>.a429 with the bus in decimal and the
+// label in octal. The record is CH10_ARINC_RECORD of the portable tools.
+// Built on the first read of the stream, Entry is NULL for a label the
+// recording has no words of.
+//
+#define FSD_ARINC_SUFFIX            L".a429"
+
+typedef struct _FSD_ARINC_RECORD {
+    ULONGLONG                   Rtc;
+    ULONGLONG                   Time;       // 100 ns units since 1970, 0 without time
+    ULONG                       Word;
+    UCHAR                       Bus;
+    UCHAR                       Flags;      // FSD_ARINC_RECORD_XXX
+    USHORT                      Reserved;
+} FSD_ARINC_RECORD, *PFSD_ARINC_RECORD;
+
+#define FSD_ARINC_RECORD_PARITY_ERROR   0x01
+#define FSD_ARINC_RECORD_FORMAT_ERROR   0x02
+#define FSD_ARINC_RECORD_HIGH_SPEED     0x04
+
+typedef struct _FSD_ARINC_STREAM {
+    USHORT                      ChannelId;
+    UCHAR                       Bus;
+    UCHAR                       Label;
+    // The label in the index of the FCB, and the records in front of
+    // each of its packets
+    PFSD_ARINC_LABEL            Entry;
+    PULONGLONG                  FirstRecord;
+    ULONGLONG                   RecordCount;
+    ULONGLONG                   Size;
+    ULONGLONG                   Epoch;
+} FSD_ARINC_STREAM, *PFSD_ARINC_STREAM;
+
+//
+// Streams FsdParseStreamName knows
+//
+#define FSD_STREAM_PCAPNG           1
+#define FSD_STREAM_ARINC            2
+
+//
+// FSD_PACKET_TABLE
+//
+// Where the packets of a recording are and which channel each is of, from
+// the sidecar when the volume has one and from a scan otherwise. Built on
+// first use and kept with the FCB.
+//
+typedef struct _FSD_PACKET_ENTRY {
+    ULONGLONG                   Offset;
+    ULONG                       PacketLength;
+    USHORT                      ChannelId;
+    UCHAR                       DataType;
+    UCHAR                       PacketFlags;
+} FSD_PACKET_ENTRY, *PFSD_PACKET_ENTRY;
+
+typedef struct _FSD_PACKET_TABLE {
+    PFSD_PACKET_ENTRY           Packets;
+    ULONG                       Count;
+    BOOLEAN                     FromIndex;
+} FSD_PACKET_TABLE, *PFSD_PACKET_TABLE;
+
+//
+// Input and output of FSCTL_CH10_READ_CHANNELS. The output is the header
+// followed by whole packets of the channels given, in recording order from
+// the first at or after Offset, as many as fit. NextOffset is where to go
+// on from, the size of the recording once all of them are read.
+//
+typedef struct _FSD_CHANNEL_READ {
+    ULONGLONG                   Offset;
+    ULONG                       ChannelCount;
+    USHORT                      Channels[1];
+} FSD_CHANNEL_READ, *PFSD_CHANNEL_READ;
+
+typedef struct _FSD_CHANNEL_DATA {
+    ULONGLONG                   NextOffset;
+    ULONG                       PacketCount;
+    ULONG                       DataLength;
+    ULONG                       ExtentCount;    // reads sent to the device
+    ULONG                       Reserved;
+    ULONGLONG                   DeviceBytes;    // bytes they moved
+    UCHAR                       Data[1];
+} FSD_CHANNEL_DATA, *PFSD_CHANNEL_DATA;
+
+//
+// A piece of a scattered device read: Length bytes at Offset on the device
+// into the buffer at BufferOffset, Offset and Length sector aligned
+//
+typedef struct _FSD_READ_EXTENT {
+    ULONGLONG                   Offset;
+    ULONG                       Length;
+    ULONG                       BufferOffset;
+} FSD_READ_EXTENT, *PFSD_READ_EXTENT;
+
 //
 // FSD_GLOBAL_DATA
 //
@@ -121,6 +733,21 @@ typedef struct _FSD_GLOBAL_DATA {
     // Global flags for the driver
     ULONG                       Flags;
 
+    // Devices recently found not to hold a Ch10 volume, so that repeated
+    // mount requests for them do not read the media again
+    FAST_MUTEX                  ProbeCacheMutex;
+    FSD_PROBE_ENTRY             ProbeCache[FSD_PROBE_CACHE_SIZE];
+    ULONG                       ProbeCacheNext;
+
+    // Metadata blocks of all volumes
+    FSD_METACACHE               MetaCache;
+
+    // Threads running queued requests
+    FSD_WORKER_POOL             WorkerPool;
+
+    // Cost of reads through the Cache Manager
+    FSD_CACHE_STATISTICS        CacheStatistics;
+
 } FSD_GLOBAL_DATA, *PFSD_GLOBAL_DATA;
 
 //
@@ -187,11 +814,32 @@ typedef struct _FSD_VCB {
     DISK_GEOMETRY               DiskGeometry;
     PARTITION_INFORMATION       PartitionInformation;
 
+    // Block size of the volume and sector size of the device, all offsets
+    // are translated and aligned with these
+    ULONG                       BytesPerBlock;
+    ULONG                       BytesPerSector;
+
+    // Largest read the device takes in one request
+    ULONG                       MaximumTransferLength;
+
     // Pointer to the root directory block
     struct ch10_dir_block*      root_dirblock;
 	
 	struct ch10_dir_block      	dirblocks[CH10_MAX_DIR_BLOCKS];
 
+    // Number of directory blocks read into dirblocks
+    ULONG                       DirBlockCount;
+
+    // Index sidecar, loaded by the first lookup after the mount and NULL
+    // until then or when there is none, see FsdGetIndex
+    PFSD_INDEX                  Index;
+
+    // FSD_INDEX_XXX, whether the sidecar has been looked for yet
+    LONG                        IndexState;
+
+    // Requests for this volume waiting for a worker thread
+    PFSD_WORK_QUEUE             WorkQueue;
+
     // Flags for the volume
     ULONG                       Flags;
 
@@ -255,13 +903,71 @@ typedef struct _FSD_FCB {
     // Pointer to the inode
     struct ch10_dir_entry*          ch10_direntry;
 
+    // Bytes of the volume given to the file, see FsdGetAllocatedLength
+    ULONGLONG                       AllocatedLength;
+
+    // Time correlation, NULL until first asked for
+    PFSD_TIME_TABLE                 TimeTable;
+
+    // The capture of a pcapng stream, with FCB_PCAPNG_STREAM, NULL until
+    // first read. The FCB of the recording owns it.
+    PFSD_PCAPNG                     Pcapng;
+
+    // The channel of a stream, and the bus << 8 | label of an ARINC-429
+    // stream
+    USHORT                          ChannelId;
+    ULONG                           Filter;
+
+    // The captures of the pcapng streams of a recording, one per channel
+    PFSD_PCAPNG                     Captures;
+
+    // ARINC-429 label index of a recording, NULL until first asked for,
+    // shared by its label streams
+    PFSD_ARINC_INDEX                ArincIndex;
+
+    // The label of an ARINC-429 stream, with FCB_ARINC_STREAM, NULL until
+    // first read
+    PFSD_ARINC_STREAM               Arinc;
+
+    // Packets by channel, NULL until first asked for
+    PFSD_PACKET_TABLE               PacketTable;
+
+    // The FCB of the recording of a stream
+    struct _FSD_FCB*                Recording;
+
+    // While streams of the recording are open, a file object of the
+    // driver's own through which they read the recording from the cache,
+    // and the number of stream FCBs using it
+    PFILE_OBJECT                    StreamFileObject;
+    ULONG                           StreamCount;
+
+    // Holds one packet of the recording for reads of a stream, allocated
+    // on the first read
+    PUCHAR                          PacketBuffer;
+    FAST_MUTEX                      PacketBufferMutex;
+
 } FSD_FCB, *PFSD_FCB;
 
+//
+// Bytes of the volume given to a recording. A recorder may preallocate
+// more blocks than it writes, and a recording larger than its blocks has
+// a hole at the end that reads as zeros. An entry without numBlocks is
+// taken to hold exactly its size.
+//
+#define FsdGetAllocatedLength(Vcb, DirEntry) \
+    ((DirEntry)->numBlocks ? \
+     be64_to_cpu((DirEntry)->numBlocks) * (Vcb)->BytesPerBlock : \
+     be64_to_cpu((DirEntry)->size))
+
 //
 // Flags for FSD_FCB
 //
 #define FCB_PAGE_FILE               0x00000001
 #define FCB_DELETE_PENDING          0x00000002
+#define FCB_PCAPNG_STREAM           0x00000004
+#define FCB_ARINC_STREAM            0x00000008
+// A stream whose sizes are not known until FsdBuildStream
+#define FCB_STREAM_PENDING          0x00000010
 
 //
 // FSD_CCB Context Control Block
@@ -309,12 +1015,14 @@ typedef struct _FSD_IRP_CONTEXT {
     // If the request is top level
     BOOLEAN             IsTopLevel;
 
+    // If the request has been handed to a worker thread
+    BOOLEAN             IsPosted;
+
     // Used if the request needs to be queued for later processing
-#if (VER_PRODUCTBUILD >= 2195)
-    PIO_WORKITEM        WorkQueueItem;
-#else
-    WORK_QUEUE_ITEM     WorkQueueItem;
-#endif
+    LIST_ENTRY          WorkLink;
+
+    // Interrupt time when the request was queued
+    ULONGLONG           QueueTime;
 
     // The exception code when an exception is in progress
     NTSTATUS            ExceptionCode;
@@ -398,6 +1106,58 @@ FsdFreeVcb (
     IN PFSD_VCB Vcb
     );
 
+//
+// Function prototypes from arinc.c
+//
+
+NTSTATUS
+FsdGetArincIndex (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_ARINC_INDEX*   ArincIndex
+    );
+
+VOID
+FsdFreeArincIndex (
+    IN PFSD_ARINC_INDEX     ArincIndex
+    );
+
+NTSTATUS
+FsdQueryArinc (
+    IN PFSD_IRP_CONTEXT     IrpContext
+    );
+
+NTSTATUS
+FsdOpenArincStream (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    IN USHORT               ChannelId,
+    IN ULONG                Filter
+    );
+
+NTSTATUS
+FsdBuildArincStream (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Recording,
+    IN USHORT               ChannelId,
+    IN ULONG                Filter,
+    OUT PFSD_ARINC_STREAM*  Result
+    );
+
+VOID
+FsdFreeArincStream (
+    IN PFSD_ARINC_STREAM    Arinc
+    );
+
+NTSTATUS
+FsdReadArinc (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    IN ULONGLONG            Offset,
+    IN ULONG                Length,
+    OUT PUCHAR              Buffer
+    );
+
 //
 // Function prototypes from blockdev.c
 //
@@ -448,6 +1208,26 @@ FsdReadBlockDeviceAtApcLevel (
     IN OUT PVOID        Buffer
     );
 
+NTSTATUS
+FsdReadBlockDeviceMdl (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PMDL             Mdl,
+    IN PLARGE_INTEGER   Offset,
+    IN ULONG            Length,
+    IN ULONG            MaximumTransferLength,
+    IN ULONG            IrpFlags
+    );
+
+NTSTATUS
+FsdReadBlockDeviceExtents (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PMDL             Mdl,
+    IN PFSD_READ_EXTENT Extents,
+    IN ULONG            ExtentCount,
+    IN ULONG            MaximumTransferLength,
+    IN ULONG            IrpFlags
+    );
+
 #ifndef FSD_RO
 
 NTSTATUS
@@ -460,6 +1240,27 @@ FsdWriteBlockDeviceAtApcLevel (
 
 #endif // !FSD_RO
 
+//
+// Function prototypes from channel.c
+//
+
+NTSTATUS
+FsdGetPacketTable (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_PACKET_TABLE*  Table
+    );
+
+VOID
+FsdFreePacketTable (
+    IN PFSD_PACKET_TABLE    Table
+    );
+
+NTSTATUS
+FsdReadChannels (
+    IN PFSD_IRP_CONTEXT     IrpContext
+    );
+
 //
 // Function prototypes from char.c
 //
@@ -503,10 +1304,7 @@ FsdQueueCloseRequest (
 
 VOID
 FsdDeQueueCloseRequest (
-#if (VER_PRODUCTBUILD >= 2195)
-    IN PDEVICE_OBJECT   DeviceObject,
-#endif
-    IN PVOID            Context
+    IN PFSD_IRP_CONTEXT IrpContext
     );
 
 //
@@ -535,6 +1333,23 @@ FsdReleaseFromReadAhead (
     IN PVOID Context
     );
 
+VOID
+FsdInitializeCacheMap (
+    IN PFILE_OBJECT FileObject,
+    IN PFSD_FCB     Fcb
+    );
+
+VOID
+FsdAddCacheStatistics (
+    IN LARGE_INTEGER    Start,
+    IN ULONG            Length
+    );
+
+NTSTATUS
+FsdQueryCacheStatistics (
+    IN PFSD_IRP_CONTEXT IrpContext
+    );
+
 //
 // Function prototypes from create.c
 //
@@ -795,11 +1610,26 @@ FsdIsVolumeMounted (
     IN PFSD_IRP_CONTEXT IrpContext
     );
 
+NTSTATUS
+FsdQueryAllocatedRanges (
+    IN PFSD_IRP_CONTEXT IrpContext
+    );
+
 NTSTATUS
 FsdMountVolume (
     IN PFSD_IRP_CONTEXT IrpContext
     );
 
+NTSTATUS
+FsdReadDirBlocks (
+    IN PFSD_VCB     Vcb
+    );
+
+NTSTATUS
+FsdRecoverDirBlocks (
+    IN PFSD_VCB     Vcb
+    );
+
 NTSTATUS
 FsdVerifyVolume (
     IN PFSD_IRP_CONTEXT IrpContext
@@ -846,10 +1676,7 @@ FsdQueueRequest (
 
 VOID
 FsdDeQueueRequest (
-#if (VER_PRODUCTBUILD >= 2195)
-    IN PDEVICE_OBJECT   DeviceObject,
-#endif
-    IN PVOID            Context
+    IN PFSD_IRP_CONTEXT IrpContext
     );
 
 NTSTATUS
@@ -882,8 +1709,8 @@ FsdGetUserBuffer (
 
 NTSTATUS
 FsdReadDirBlockByOffset (
-    IN PDEVICE_OBJECT           DeviceObject,
-    IN ULONG                    BlockOffset,
+    IN PFSD_VCB                 Vcb,
+    IN ULONGLONG                BlockNumber,
     IN OUT struct ch10_dir_block*  Inode
     );
 //
@@ -901,6 +1728,44 @@ DriverUnload (
     IN PDRIVER_OBJECT DriverObject
     );
 
+//
+// Function prototypes from index.c
+//
+
+ULONGLONG
+FsdVolumeFingerprint (
+    IN PFSD_VCB         Vcb
+    );
+
+NTSTATUS
+FsdLoadIndex (
+    IN PFSD_VCB         Vcb
+    );
+
+VOID
+FsdFreeIndex (
+    IN PFSD_VCB         Vcb
+    );
+
+PFSD_INDEX
+FsdGetIndex (
+    IN PFSD_VCB         Vcb
+    );
+
+NTSTATUS
+FsdIndexLookupFileName (
+    IN PFSD_VCB         Vcb,
+    IN PUNICODE_STRING  FileName,
+    OUT PULONG          Index
+    );
+
+NTSTATUS
+FsdReadIndexPackets (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_PACKET_TABLE*  Table
+    );
+
 //
 // Function prototypes from lockctl.c
 //
@@ -910,6 +1775,145 @@ FsdLockControl (
     IN PFSD_IRP_CONTEXT IrpContext
     );
 
+//
+// Function prototypes from metacache.c
+//
+
+VOID
+FsdMetaCacheInitialize (
+    VOID
+    );
+
+VOID
+FsdMetaCacheUninitialize (
+    VOID
+    );
+
+BOOLEAN
+FsdMetaCacheLookup (
+    IN PFSD_VCB     Vcb,
+    IN ULONGLONG    BlockNumber,
+    OUT PVOID       Buffer
+    );
+
+VOID
+FsdMetaCacheInsert (
+    IN PFSD_VCB     Vcb,
+    IN ULONGLONG    BlockNumber,
+    IN PVOID        Data,
+    IN BOOLEAN      Pinned
+    );
+
+VOID
+FsdMetaCachePurgeVolume (
+    IN PFSD_VCB     Vcb
+    );
+
+NTSTATUS
+FsdMetaCacheRead (
+    IN PFSD_VCB     Vcb,
+    IN ULONGLONG    BlockNumber,
+    OUT PVOID       Buffer
+    );
+
+NTSTATUS
+FsdQueryMetaCacheStatistics (
+    IN PFSD_IRP_CONTEXT IrpContext
+    );
+
+//
+// Function prototypes from packet.c
+//
+
+typedef NTSTATUS (*PFSD_PACKET_CALLBACK) (
+    IN PVOID                        Context,
+    IN ULONGLONG                    Offset,
+    IN struct ch10_packet_header*   Header
+    );
+
+__u64
+FsdGetRtc (
+    IN struct ch10_packet_header*   Header
+    );
+
+BOOLEAN
+FsdCheckPacketHeader (
+    IN struct ch10_packet_header*   Header
+    );
+
+BOOLEAN
+FsdCheckPacketData (
+    IN struct ch10_packet_header*   Header
+    );
+
+NTSTATUS
+FsdDecodeTime (
+    IN struct ch10_packet_header*   Header,
+    OUT PULONGLONG                  Time,
+    OUT PULONG                      Csdw
+    );
+
+NTSTATUS
+FsdScanPackets (
+    IN PFSD_VCB                     Vcb,
+    IN PFSD_FCB                     Fcb,
+    IN PFSD_PACKET_CALLBACK         Callback,
+    IN PVOID                        Context,
+    OUT PULONGLONG                  Skipped OPTIONAL
+    );
+
+NTSTATUS
+FsdFindPacketEnd (
+    IN PFSD_VCB                     Vcb,
+    IN ULONGLONG                    Base,
+    IN ULONGLONG                    Limit,
+    OUT PULONGLONG                  End
+    );
+
+//
+// Function prototypes from pcapng.c
+//
+
+NTSTATUS
+FsdParseStreamName (
+    IN PUNICODE_STRING      FileName,
+    OUT PUSHORT             ChannelId,
+    OUT PULONG              Filter,
+    OUT PULONG              Type
+    );
+
+NTSTATUS
+FsdOpenPcapngStream (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    IN USHORT               ChannelId
+    );
+
+NTSTATUS
+FsdBuildStream (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb
+    );
+
+VOID
+FsdFreePcapng (
+    IN PFSD_PCAPNG          Pcapng
+    );
+
+ULONGLONG
+FsdGetEpoch (
+    IN struct ch10_dir_entry*   DirEntry
+    );
+
+NTSTATUS
+FsdReadPcapng (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    IN ULONGLONG            Offset,
+    IN ULONG                Length,
+    OUT PUCHAR              Buffer
+    );
+
 //
 // Function prototypes from read.c
 //
@@ -931,11 +1935,21 @@ FsdReadComplete (
 
 NTSTATUS
 FsdReadFileData (
-    IN PDEVICE_OBJECT       DeviceObject,
-    IN ULONG                Index,
+    IN PFSD_VCB             Vcb,
+    IN ULONGLONG            Index,
     IN PLARGE_INTEGER       Offset,
     IN ULONG                Length,
-    IN OUT PVOID            Buffer
+    IN OUT PVOID            Buffer,
+    IN PMDL                 Mdl OPTIONAL,
+    IN ULONG                IrpFlags
+    );
+
+NTSTATUS
+FsdReadRecordingCached (
+    IN PFSD_FCB             Recording,
+    IN ULONGLONG            Offset,
+    IN ULONG                Length,
+    OUT PVOID               Buffer
     );
 
 //
@@ -944,7 +1958,32 @@ FsdReadFileData (
 
 NTSTATUS
 FsdIsDeviceCh10fs (
-    IN PDEVICE_OBJECT DeviceObject
+    IN PDEVICE_OBJECT               DeviceObject,
+    OUT struct ch10_dir_block*      DirBlock OPTIONAL
+    );
+
+BOOLEAN
+FsdIsValidRootDirBlock (
+    IN struct ch10_dir_block*       DirBlock,
+    IN ULONGLONG                    DeviceSize
+    );
+
+BOOLEAN
+FsdGetProbeIdentity (
+    IN PDEVICE_OBJECT       DeviceObject,
+    OUT PFSD_PROBE_IDENTITY Identity
+    );
+
+BOOLEAN
+FsdProbeCacheLookup (
+    IN PDEVICE_OBJECT       DeviceObject,
+    IN PFSD_PROBE_IDENTITY  Identity
+    );
+
+VOID
+FsdProbeCacheInsert (
+    IN PDEVICE_OBJECT       DeviceObject,
+    IN PFSD_PROBE_IDENTITY  Identity
     );
 
 NTSTATUS
@@ -964,6 +2003,48 @@ DWORD32 RtlIndexOfCharInUnicodeString(
 size_t ch10fs_strnlen(const char * s, size_t count);
 #define strnlen(s,n) ch10fs_strnlen(s,n)
 
+//
+// Function prototypes from time.c
+//
+
+NTSTATUS
+FsdGetTimeTable (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_TIME_TABLE*    Table
+    );
+
+VOID
+FsdFreeTimeTable (
+    IN PFSD_TIME_TABLE      Table
+    );
+
+NTSTATUS
+FsdRtcToTime (
+    IN PFSD_TIME_TABLE      Table,
+    IN ULONGLONG            Rtc,
+    OUT PULONGLONG          Time,
+    OUT PULONG              Point
+    );
+
+NTSTATUS
+FsdTimeToRtc (
+    IN PFSD_TIME_TABLE      Table,
+    IN ULONGLONG            Time,
+    OUT PULONGLONG          Rtc,
+    OUT PULONG              Point
+    );
+
+NTSTATUS
+FsdQueryTime (
+    IN PFSD_IRP_CONTEXT     IrpContext
+    );
+
+NTSTATUS
+FsdQueryTimePoints (
+    IN PFSD_IRP_CONTEXT     IrpContext
+    );
+
 //
 // Function prototypes from volinfo.c
 //
@@ -973,6 +2054,41 @@ FsdQueryVolumeInformation (
     IN PFSD_IRP_CONTEXT IrpContext
     );
 
+//
+// Function prototypes from worker.c
+//
+
+NTSTATUS
+FsdWorkerPoolInitialize (
+    VOID
+    );
+
+VOID
+FsdWorkerPoolUninitialize (
+    VOID
+    );
+
+PFSD_WORK_QUEUE
+FsdAllocateWorkQueue (
+    VOID
+    );
+
+VOID
+FsdDereferenceWorkQueue (
+    IN PFSD_WORK_QUEUE WorkQueue
+    );
+
+VOID
+FsdQueueWork (
+    IN PFSD_IRP_CONTEXT IrpContext,
+    IN BOOLEAN          Close
+    );
+
+NTSTATUS
+FsdQueryWorkerStatistics (
+    IN PFSD_IRP_CONTEXT IrpContext
+    );
+
 //
 // These declarations is missing in some versions of the DDK and ntifs.h
 //
@@ -137,6 +137,8 @@ FsdAllocateIrpContext (
 
     IrpContext->IsTopLevel = (IoGetTopLevelIrp() == Irp);
 
+    IrpContext->IsPosted = FALSE;
+
     return IrpContext;
 }
 
@@ -247,7 +249,7 @@ FsdAllocateFcb (
         SetFlag(Fcb->FileAttributes, FILE_ATTRIBUTE_READONLY);
     }
 
-    Fcb->IndexNumber.QuadPart = be64_to_cpu(ch10_inode->blockNum) * CH10_BLOCK_SIZE;
+    Fcb->IndexNumber.QuadPart = be64_to_cpu(ch10_inode->blockNum) * Vcb->BytesPerBlock;
 	
 	DbgPrint(DRIVER_NAME ": New file located at block %I64d\n", be64_to_cpu(ch10_inode->blockNum));
 	DbgPrint(DRIVER_NAME ": New file located at byte %I64d\n", Fcb->IndexNumber.QuadPart);
@@ -256,6 +258,39 @@ FsdAllocateFcb (
 
     Fcb->ch10_direntry = ch10_inode;
 
+    Fcb->AllocatedLength = FsdGetAllocatedLength(Vcb, ch10_inode);
+
+    if (Fcb->AllocatedLength < be64_to_cpu(ch10_inode->size))
+    {
+        SetFlag(Fcb->FileAttributes, FILE_ATTRIBUTE_SPARSE_FILE);
+    }
+
+    Fcb->TimeTable = NULL;
+
+    Fcb->Pcapng = NULL;
+
+    Fcb->ChannelId = 0;
+
+    Fcb->Filter = 0;
+
+    Fcb->Captures = NULL;
+
+    Fcb->ArincIndex = NULL;
+
+    Fcb->Arinc = NULL;
+
+    Fcb->PacketTable = NULL;
+
+    Fcb->Recording = NULL;
+
+    Fcb->StreamFileObject = NULL;
+
+    Fcb->StreamCount = 0;
+
+    Fcb->PacketBuffer = NULL;
+
+    ExInitializeFastMutex(&Fcb->PacketBufferMutex);
+
     RtlZeroMemory(&Fcb->CommonFCBHeader, sizeof(FSRTL_COMMON_FCB_HEADER));
 
     Fcb->CommonFCBHeader.NodeTypeCode = (USHORT) FCB;
@@ -263,7 +298,12 @@ FsdAllocateFcb (
     Fcb->CommonFCBHeader.IsFastIoPossible = FastIoIsNotPossible;
     Fcb->CommonFCBHeader.Resource = &(Fcb->MainResource);
     Fcb->CommonFCBHeader.PagingIoResource = &(Fcb->PagingIoResource);
-    Fcb->CommonFCBHeader.AllocationSize.QuadPart = be64_to_cpu(ch10_inode->size);
+    //
+    // The Cache Manager wants the allocation to cover the file, a sparse
+    // recording is reported with its real allocation by the queries
+    //
+    Fcb->CommonFCBHeader.AllocationSize.QuadPart =
+        max(Fcb->AllocatedLength, be64_to_cpu(ch10_inode->size));
     Fcb->CommonFCBHeader.FileSize.QuadPart = be64_to_cpu(ch10_inode->size);
     Fcb->CommonFCBHeader.ValidDataLength.QuadPart = be64_to_cpu(ch10_inode->size);
 
@@ -284,12 +324,18 @@ FsdFreeFcb (
     IN PFSD_FCB Fcb
     )
 {
+    PFSD_FCB        Recording;
+    PFILE_OBJECT    FileObject;
+    PFSD_PCAPNG     Pcapng;
+
 	PAGED_CODE();
     ASSERT(Fcb != NULL);
 
     ASSERT((Fcb->Identifier.Type == FCB) &&
            (Fcb->Identifier.Size == sizeof(FSD_FCB)));
 
+    Recording = Fcb->Recording;
+
     FsRtlUninitializeFileLock(&Fcb->FileLock);
 
     ExDeleteResourceLite(&Fcb->MainResource);
@@ -306,7 +352,54 @@ FsdFreeFcb (
 
     FsdFreePool(Fcb->ch10_direntry);
 
+    if (Fcb->TimeTable)
+    {
+        FsdFreeTimeTable(Fcb->TimeTable);
+    }
+
+    while (Fcb->Captures)
+    {
+        Pcapng = Fcb->Captures;
+        Fcb->Captures = Pcapng->Next;
+        FsdFreePcapng(Pcapng);
+    }
+
+    if (Fcb->ArincIndex)
+    {
+        FsdFreeArincIndex(Fcb->ArincIndex);
+    }
+
+    if (Fcb->Arinc)
+    {
+        FsdFreeArincStream(Fcb->Arinc);
+    }
+
+    if (Fcb->PacketTable)
+    {
+        FsdFreePacketTable(Fcb->PacketTable);
+    }
+
+    if (Fcb->PacketBuffer)
+    {
+        FsdFreePool(Fcb->PacketBuffer);
+    }
+
     FsdFreePool(Fcb);
+
+    //
+    // The last stream of a recording lets go of the file object caching
+    // the recording, its close releases the FCB of the recording
+    //
+    if (Recording && --Recording->StreamCount == 0)
+    {
+        FileObject = Recording->StreamFileObject;
+
+        Recording->StreamFileObject = NULL;
+
+        CcUninitializeCacheMap(FileObject, NULL, NULL);
+
+        ObDereferenceObject(FileObject);
+    }
 }
 
 PFSD_CCB
@@ -389,6 +482,12 @@ FsdFreeVcb (
 
     ExDeleteResourceLite(&Vcb->PagingIoResource);
 
+    FsdMetaCachePurgeVolume(Vcb);
+
+    FsdFreeIndex(Vcb);
+
+    FsdDereferenceWorkQueue(Vcb->WorkQueue);
+
     IoDeleteDevice(Vcb->DeviceObject);
 
     KdPrint((DRIVER_NAME ": Vcb deallocated\n"));
@@ -0,0 +1,1219 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ntifs.h"
+#include "fsd.h"
+#include "ch10_fs.h"
+#include "border.h"
+
+//
+// ARINC-429 words of a recording by label. A label is usually a small
+// part of a large recording, so the words of every channel, bus and label
+// are indexed in one scan of the recording: each packet adds an entry for
+// every label it holds words of, with the first of them and their number,
+// and a counting sort then puts the entries of a label together. The
+// index is built on a worker thread when it is first asked for and lives
+// as long as the FCB of the recording. FSCTL_CH10_QUERY_ARINC answers from
+// it, and every stream named <recording>:<channel>-<bus>-<label>.a429 of
+// the recording shares it and reads only the packets of its label, through
+// the cache of the recording, to give each of its words a fixed size
+// record.
+//
+
+//
+// ARINC-429 format 0 channel specific data word and intra-packet data
+// header
+//
+#define ARINC_WORD_SIZE             8
+#define ARINC_COUNT_MASK            0x0000ffff
+#define ARINC_GAP_MASK              0x000fffff
+#define ARINC_HIGH_SPEED            0x00200000
+#define ARINC_PARITY_ERROR          0x00400000
+#define ARINC_FORMAT_ERROR          0x00800000
+#define ARINC_BUS(IdWord)           ((IdWord) >> 24)
+#define ARINC_LABEL(Data)           ((Data) & 0xff)
+
+//
+// Bus and label of a word, with the channel above them the order labels
+// are sorted in
+//
+#define FSD_ARINC_KEY(Bus, Label)   ((ULONG) (Bus) << 8 | (Label))
+#define FSD_ARINC_KEYS              65536
+
+typedef struct _FSD_ARINC_RUN {
+    USHORT                      Key;
+    USHORT                      FirstWord;
+    USHORT                      WordCount;
+} FSD_ARINC_RUN, *PFSD_ARINC_RUN;
+
+typedef struct _FSD_ARINC_BUILDER {
+    PFSD_ARINC_INDEX            Index;
+    ULONG                       LabelCapacity;
+    ULONG                       PacketCapacity;
+    // Sort key of each entry of Index->Packets until they are sorted
+    PULONG                      Keys;
+    // Runs of the packet being added, Slot[Key] is the run of a bus and
+    // label when Stamp[Key] is the number of the packet
+    PFSD_ARINC_RUN              Runs;
+    PULONG                      Stamp;
+    PUSHORT                     Slot;
+} FSD_ARINC_BUILDER, *PFSD_ARINC_BUILDER;
+
+#pragma code_seg(FSD_PAGED_CODE)
+
+static ULONG
+FsdGetArincLe32 (
+    IN PUCHAR   Buffer
+    )
+{
+    PAGED_CODE();
+
+    return Buffer[0] | (Buffer[1] << 8) | (Buffer[2] << 16) | ((ULONG) Buffer[3] << 24);
+}
+
+static ULONG
+FsdArincLabelKey (
+    IN PFSD_ARINC_LABEL     Label
+    )
+{
+    PAGED_CODE();
+
+    return (ULONG) Label->ChannelId << 16 | FSD_ARINC_KEY(Label->Bus, Label->Label);
+}
+
+//
+// First label at or after Key
+//
+static ULONG
+FsdSearchArincLabel (
+    IN PFSD_ARINC_INDEX     ArincIndex,
+    IN ULONG                Key
+    )
+{
+    ULONG   Low = 0;
+    ULONG   High = ArincIndex->LabelCount;
+    ULONG   Middle;
+
+    PAGED_CODE();
+
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (FsdArincLabelKey(&ArincIndex->Labels[Middle]) < Key)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    return Low;
+}
+
+static PFSD_ARINC_LABEL
+FsdFindArincLabel (
+    IN PFSD_ARINC_INDEX     ArincIndex,
+    IN USHORT               ChannelId,
+    IN UCHAR                Bus,
+    IN UCHAR                Label
+    )
+{
+    ULONG   Key = (ULONG) ChannelId << 16 | FSD_ARINC_KEY(Bus, Label);
+    ULONG   Position;
+
+    PAGED_CODE();
+
+    Position = FsdSearchArincLabel(ArincIndex, Key);
+
+    if (Position == ArincIndex->LabelCount ||
+        FsdArincLabelKey(&ArincIndex->Labels[Position]) != Key)
+    {
+        return NULL;
+    }
+
+    return &ArincIndex->Labels[Position];
+}
+
+//
+// The words of an ARINC-429 packet, as many as the channel specific data
+// word gives and the packet holds
+//
+static ULONG
+FsdGetArincWords (
+    IN struct ch10_packet_header*   Header,
+    OUT PUCHAR*                     Words
+    )
+{
+    PUCHAR  Body = (PUCHAR) (Header + 1);
+    ULONG   DataLength = le32_to_cpu(Header->dataLength);
+    ULONG   Count;
+
+    PAGED_CODE();
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    if (DataLength < sizeof(ULONG))
+    {
+        return 0;
+    }
+
+    Count = min(
+        FsdGetArincLe32(Body) & ARINC_COUNT_MASK,
+        (DataLength - sizeof(ULONG)) / ARINC_WORD_SIZE
+        );
+
+    *Words = Body + sizeof(ULONG);
+
+    return Count;
+}
+
+//
+// Grows an array of the index to Capacity entries of Size bytes
+//
+static NTSTATUS
+FsdGrowArincArray (
+    IN OUT PVOID*   Array,
+    IN ULONG        Count,
+    IN ULONG        Capacity,
+    IN ULONG        Size
+    )
+{
+    PVOID Grown;
+
+    PAGED_CODE();
+
+    if (Capacity > MAXLONG / Size)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Grown = FsdAllocatePool(PagedPool, Capacity * Size, 'aAeR');
+
+    if (Grown == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    if (*Array)
+    {
+        RtlCopyMemory(Grown, *Array, Count * Size);
+        FsdFreePool(*Array);
+    }
+
+    *Array = Grown;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+FsdAddArincLabel (
+    IN PFSD_ARINC_BUILDER   Builder,
+    IN ULONG                Key,
+    IN PFSD_ARINC_RUN       Run
+    )
+{
+    PFSD_ARINC_INDEX    ArincIndex = Builder->Index;
+    PFSD_ARINC_LABEL    Label;
+    PFSD_ARINC_PACKET   Packet;
+    ULONG               Position;
+    ULONG               Capacity;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    Position = FsdSearchArincLabel(ArincIndex, Key);
+
+    if (Position == ArincIndex->LabelCount ||
+        FsdArincLabelKey(&ArincIndex->Labels[Position]) != Key)
+    {
+        if (ArincIndex->LabelCount == Builder->LabelCapacity)
+        {
+            Capacity = Builder->LabelCapacity ? Builder->LabelCapacity * 2 : 64;
+
+            Status = FsdGrowArincArray(
+                (PVOID*) &ArincIndex->Labels,
+                ArincIndex->LabelCount,
+                Capacity,
+                sizeof(FSD_ARINC_LABEL)
+                );
+
+            if (!NT_SUCCESS(Status))
+            {
+                return Status;
+            }
+
+            Builder->LabelCapacity = Capacity;
+        }
+
+        Label = &ArincIndex->Labels[Position];
+
+        RtlMoveMemory(
+            Label + 1,
+            Label,
+            (ArincIndex->LabelCount - Position) * sizeof(FSD_ARINC_LABEL)
+            );
+
+        RtlZeroMemory(Label, sizeof(FSD_ARINC_LABEL));
+
+        Label->ChannelId = (USHORT) (Key >> 16);
+        Label->Bus = (UCHAR) (Key >> 8);
+        Label->Label = (UCHAR) Key;
+
+        ArincIndex->LabelCount++;
+    }
+
+    if (ArincIndex->PacketCount == Builder->PacketCapacity)
+    {
+        Capacity = Builder->PacketCapacity ? Builder->PacketCapacity * 2 : 1024;
+
+        Status = FsdGrowArincArray(
+            (PVOID*) &ArincIndex->Packets,
+            ArincIndex->PacketCount,
+            Capacity,
+            sizeof(FSD_ARINC_PACKET)
+            );
+
+        if (NT_SUCCESS(Status))
+        {
+            Status = FsdGrowArincArray(
+                (PVOID*) &Builder->Keys,
+                ArincIndex->PacketCount,
+                Capacity,
+                sizeof(ULONG)
+                );
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        Builder->PacketCapacity = Capacity;
+    }
+
+    Label = &ArincIndex->Labels[Position];
+
+    Label->PacketCount++;
+    Label->WordCount += Run->WordCount;
+
+    Packet = &ArincIndex->Packets[ArincIndex->PacketCount];
+
+    Packet->FirstWord = Run->FirstWord;
+    Packet->WordCount = Run->WordCount;
+
+    Builder->Keys[ArincIndex->PacketCount++] = Key;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+FsdAddArincPacket (
+    IN PVOID                        Context,
+    IN ULONGLONG                    Offset,
+    IN struct ch10_packet_header*   Header
+    )
+{
+    PFSD_ARINC_BUILDER  Builder = (PFSD_ARINC_BUILDER) Context;
+    PFSD_ARINC_INDEX    ArincIndex = Builder->Index;
+    PFSD_ARINC_RUN      Run;
+    PUCHAR              Words;
+    ULONG               Count;
+    ULONG               Word;
+    ULONG               Key;
+    ULONG               Stamp;
+    ULONG               RunCount = 0;
+    ULONG               Number;
+    ULONG               First = ArincIndex->PacketCount;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    if (Header->dataType != CH10_DATA_ARINC429_F0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    Count = FsdGetArincWords(Header, &Words);
+
+    ArincIndex->ArincPackets++;
+    ArincIndex->WordCount += Count;
+
+    Stamp = (ULONG) ArincIndex->ArincPackets;
+
+    if (Stamp == 0)
+    {
+        RtlZeroMemory(Builder->Stamp, FSD_ARINC_KEYS * sizeof(ULONG));
+        Stamp = 1;
+    }
+
+    for (Word = 0; Word < Count; Word++)
+    {
+        Key = FSD_ARINC_KEY(
+            ARINC_BUS(FsdGetArincLe32(Words + Word * ARINC_WORD_SIZE)),
+            ARINC_LABEL(FsdGetArincLe32(Words + Word * ARINC_WORD_SIZE + 4))
+            );
+
+        if (Builder->Stamp[Key] != Stamp)
+        {
+            Builder->Stamp[Key] = Stamp;
+            Builder->Slot[Key] = (USHORT) RunCount;
+
+            Run = &Builder->Runs[RunCount++];
+
+            Run->Key = (USHORT) Key;
+            Run->FirstWord = (USHORT) Word;
+            Run->WordCount = 0;
+        }
+
+        Builder->Runs[Builder->Slot[Key]].WordCount++;
+    }
+
+    for (Number = 0; Number < RunCount; Number++)
+    {
+        Key = (ULONG) le16_to_cpu(Header->channelId) << 16 | Builder->Runs[Number].Key;
+
+        Status = FsdAddArincLabel(Builder, Key, &Builder->Runs[Number]);
+
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+    }
+
+    for (Number = First; Number < ArincIndex->PacketCount; Number++)
+    {
+        ArincIndex->Packets[Number].Offset = Offset;
+        ArincIndex->Packets[Number].PacketLength = le32_to_cpu(Header->packetLength);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Puts the entries of each label together, in recording order
+//
+static NTSTATUS
+FsdSortArincIndex (
+    IN PFSD_ARINC_BUILDER   Builder
+    )
+{
+    PFSD_ARINC_INDEX    ArincIndex = Builder->Index;
+    PFSD_ARINC_PACKET   Sorted;
+    PULONG              Fill;
+    ULONG               Position;
+    ULONG               Number;
+    ULONG               Total = 0;
+
+    PAGED_CODE();
+
+    if (ArincIndex->PacketCount == 0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    Sorted = (PFSD_ARINC_PACKET) FsdAllocatePool(
+        PagedPool,
+        ArincIndex->PacketCount * sizeof(FSD_ARINC_PACKET),
+        'aAeR'
+        );
+
+    Fill = (PULONG) FsdAllocatePool(
+        PagedPool,
+        ArincIndex->LabelCount * sizeof(ULONG),
+        'fAeR'
+        );
+
+    if (Sorted == NULL || Fill == NULL)
+    {
+        if (Sorted)
+        {
+            FsdFreePool(Sorted);
+        }
+
+        if (Fill)
+        {
+            FsdFreePool(Fill);
+        }
+
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Fill, ArincIndex->LabelCount * sizeof(ULONG));
+
+    for (Number = 0; Number < ArincIndex->LabelCount; Number++)
+    {
+        ArincIndex->Labels[Number].FirstPacket = Total;
+        Total += ArincIndex->Labels[Number].PacketCount;
+    }
+
+    for (Number = 0; Number < ArincIndex->PacketCount; Number++)
+    {
+        Position = FsdSearchArincLabel(ArincIndex, Builder->Keys[Number]);
+
+        Sorted[ArincIndex->Labels[Position].FirstPacket + Fill[Position]++] =
+            ArincIndex->Packets[Number];
+    }
+
+    FsdFreePool(Fill);
+    FsdFreePool(ArincIndex->Packets);
+
+    ArincIndex->Packets = Sorted;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+FsdBuildArincIndex (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_ARINC_INDEX*   ArincIndex
+    )
+{
+    PFSD_ARINC_INDEX    NewIndex;
+    FSD_ARINC_BUILDER   Builder;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    NewIndex = (PFSD_ARINC_INDEX) FsdAllocatePool(
+        PagedPool,
+        sizeof(FSD_ARINC_INDEX),
+        'iAeR'
+        );
+
+    if (NewIndex == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(NewIndex, sizeof(FSD_ARINC_INDEX));
+    RtlZeroMemory(&Builder, sizeof(Builder));
+
+    Builder.Index = NewIndex;
+
+    Builder.Runs = (PFSD_ARINC_RUN) FsdAllocatePool(
+        PagedPool,
+        FSD_ARINC_KEYS * sizeof(FSD_ARINC_RUN),
+        'rAeR'
+        );
+
+    Builder.Stamp = (PULONG) FsdAllocatePool(
+        PagedPool,
+        FSD_ARINC_KEYS * sizeof(ULONG),
+        'sAeR'
+        );
+
+    Builder.Slot = (PUSHORT) FsdAllocatePool(
+        PagedPool,
+        FSD_ARINC_KEYS * sizeof(USHORT),
+        'sAeR'
+        );
+
+    if (Builder.Runs == NULL || Builder.Stamp == NULL || Builder.Slot == NULL)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+    }
+    else
+    {
+        RtlZeroMemory(Builder.Stamp, FSD_ARINC_KEYS * sizeof(ULONG));
+
+        Status = FsdScanPackets(Vcb, Fcb, FsdAddArincPacket, &Builder, NULL);
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        Status = FsdSortArincIndex(&Builder);
+    }
+
+    if (Builder.Keys)
+    {
+        FsdFreePool(Builder.Keys);
+    }
+
+    if (Builder.Runs)
+    {
+        FsdFreePool(Builder.Runs);
+    }
+
+    if (Builder.Stamp)
+    {
+        FsdFreePool(Builder.Stamp);
+    }
+
+    if (Builder.Slot)
+    {
+        FsdFreePool(Builder.Slot);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        FsdFreeArincIndex(NewIndex);
+        return Status;
+    }
+
+    KdPrint((
+        DRIVER_NAME
+        ": FsdBuildArincIndex: %wZ Packets: %I64u Words: %I64u Labels: %u\n",
+        &Fcb->FileName,
+        NewIndex->ArincPackets,
+        NewIndex->WordCount,
+        NewIndex->LabelCount
+        ));
+
+    *ArincIndex = NewIndex;
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Returns the label index of a recording, building it on first use. Two
+// callers racing to build it both scan, the first to finish keeps its
+// index with the FCB.
+//
+NTSTATUS
+FsdGetArincIndex (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_ARINC_INDEX*   ArincIndex
+    )
+{
+    PFSD_ARINC_INDEX    NewIndex;
+    PFSD_ARINC_INDEX    OldIndex;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    if (Fcb->ArincIndex == NULL)
+    {
+        Status = FsdBuildArincIndex(Vcb, Fcb, &NewIndex);
+
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        OldIndex = (PFSD_ARINC_INDEX) InterlockedCompareExchangePointer(
+            (PVOID*) &Fcb->ArincIndex,
+            NewIndex,
+            NULL
+            );
+
+        if (OldIndex != NULL)
+        {
+            FsdFreeArincIndex(NewIndex);
+        }
+    }
+
+    *ArincIndex = Fcb->ArincIndex;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+FsdFreeArincIndex (
+    IN PFSD_ARINC_INDEX     ArincIndex
+    )
+{
+    PAGED_CODE();
+
+    if (ArincIndex->Labels)
+    {
+        FsdFreePool(ArincIndex->Labels);
+    }
+
+    if (ArincIndex->Packets)
+    {
+        FsdFreePool(ArincIndex->Packets);
+    }
+
+    FsdFreePool(ArincIndex);
+}
+
+static NTSTATUS
+FsdGetArincFcb (
+    IN PFSD_IRP_CONTEXT     IrpContext,
+    OUT PFSD_VCB*           Vcb,
+    OUT PFSD_FCB*           Fcb
+    )
+{
+    PAGED_CODE();
+
+    if (IrpContext->DeviceObject == FsdGlobalData.DeviceObject ||
+        IrpContext->FileObject == NULL)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    *Vcb = (PFSD_VCB) IrpContext->DeviceObject->DeviceExtension;
+    *Fcb = (PFSD_FCB) IrpContext->FileObject->FsContext;
+
+    if (*Fcb == NULL ||
+        (*Fcb)->Identifier.Type != FCB ||
+        FlagOn((*Fcb)->FileAttributes, FILE_ATTRIBUTE_DIRECTORY) ||
+        FlagOn((*Fcb)->Flags, FCB_PCAPNG_STREAM | FCB_ARINC_STREAM))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+FsdQueryArinc (
+    IN PFSD_IRP_CONTEXT IrpContext
+    )
+{
+    PIRP                Irp;
+    PIO_STACK_LOCATION  IrpSp;
+    PFSD_VCB            Vcb;
+    PFSD_FCB            Fcb;
+    PFSD_ARINC_INDEX    ArincIndex;
+    PFSD_ARINC_LABEL    Label;
+    PFSD_ARINC_LABELS   Labels;
+    PFSD_ARINC_PACKETS  Packets;
+    FSD_ARINC_QUERY     Query;
+    ULONG               OutputLength;
+    ULONG               Count;
+    ULONG               Returned;
+    NTSTATUS            Status = STATUS_UNSUCCESSFUL;
+
+    PAGED_CODE();
+
+    __try
+    {
+        ASSERT(IrpContext != NULL);
+
+        ASSERT((IrpContext->Identifier.Type == ICX) &&
+               (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+        Irp = IrpContext->Irp;
+
+        IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+        Irp->IoStatus.Information = 0;
+
+        Status = FsdGetArincFcb(IrpContext, &Vcb, &Fcb);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        OutputLength = IrpSp->Parameters.FileSystemControl.OutputBufferLength;
+
+        if (IrpSp->Parameters.FileSystemControl.InputBufferLength < sizeof(FSD_ARINC_QUERY) ||
+            OutputLength < max(FIELD_OFFSET(FSD_ARINC_LABELS, Labels),
+                               FIELD_OFFSET(FSD_ARINC_PACKETS, Packets)))
+        {
+            Status = STATUS_BUFFER_TOO_SMALL;
+            __leave;
+        }
+
+        //
+        // The output overwrites the input in the system buffer
+        //
+        Query = *(PFSD_ARINC_QUERY) Irp->AssociatedIrp.SystemBuffer;
+
+        if (Query.Mode != FSD_ARINC_QUERY_LABELS && Query.Mode != FSD_ARINC_QUERY_PACKETS)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            __leave;
+        }
+
+        //
+        // Building the index reads the whole recording, the request goes
+        // to a worker thread for it and completes from there
+        //
+        if (Fcb->ArincIndex == NULL && !IrpContext->IsPosted)
+        {
+            Status = STATUS_PENDING;
+            __leave;
+        }
+
+        Status = FsdGetArincIndex(Vcb, Fcb, &ArincIndex);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        if (Query.Mode == FSD_ARINC_QUERY_LABELS)
+        {
+            Labels = (PFSD_ARINC_LABELS) Irp->AssociatedIrp.SystemBuffer;
+
+            Returned = Query.First < ArincIndex->LabelCount ?
+                ArincIndex->LabelCount - Query.First : 0;
+
+            Returned = min(
+                Returned,
+                (OutputLength - FIELD_OFFSET(FSD_ARINC_LABELS, Labels)) / sizeof(FSD_ARINC_LABEL)
+                );
+
+            Labels->ArincPackets = ArincIndex->ArincPackets;
+            Labels->WordCount = ArincIndex->WordCount;
+            Labels->LabelCount = ArincIndex->LabelCount;
+            Labels->Returned = Returned;
+
+            if (Returned)
+            {
+                RtlCopyMemory(
+                    Labels->Labels,
+                    &ArincIndex->Labels[Query.First],
+                    Returned * sizeof(FSD_ARINC_LABEL)
+                    );
+            }
+
+            Irp->IoStatus.Information =
+                FIELD_OFFSET(FSD_ARINC_LABELS, Labels) + Returned * sizeof(FSD_ARINC_LABEL);
+
+            Count = ArincIndex->LabelCount;
+        }
+        else
+        {
+            Label = FsdFindArincLabel(ArincIndex, Query.ChannelId, Query.Bus, Query.Label);
+
+            if (Label == NULL)
+            {
+                Status = STATUS_NOT_FOUND;
+                __leave;
+            }
+
+            Packets = (PFSD_ARINC_PACKETS) Irp->AssociatedIrp.SystemBuffer;
+
+            Returned = Query.First < Label->PacketCount ? Label->PacketCount - Query.First : 0;
+
+            Returned = min(
+                Returned,
+                (OutputLength - FIELD_OFFSET(FSD_ARINC_PACKETS, Packets)) / sizeof(FSD_ARINC_PACKET)
+                );
+
+            Packets->Label = *Label;
+            Packets->Returned = Returned;
+            Packets->Reserved = 0;
+
+            if (Returned)
+            {
+                RtlCopyMemory(
+                    Packets->Packets,
+                    &ArincIndex->Packets[Label->FirstPacket + Query.First],
+                    Returned * sizeof(FSD_ARINC_PACKET)
+                    );
+            }
+
+            Irp->IoStatus.Information =
+                FIELD_OFFSET(FSD_ARINC_PACKETS, Packets) + Returned * sizeof(FSD_ARINC_PACKET);
+
+            Count = Label->PacketCount;
+        }
+
+        Status = Query.First + Returned < Count ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS;
+    }
+    __finally
+    {
+        if (!AbnormalTermination())
+        {
+            if (Status == STATUS_PENDING)
+            {
+                Status = FsdQueueRequest(IrpContext);
+            }
+            else
+            {
+                IrpContext->Irp->IoStatus.Status = Status;
+
+                FsdCompleteRequest(IrpContext->Irp, IO_NO_INCREMENT);
+
+                FsdFreeIrpContext(IrpContext);
+            }
+        }
+    }
+
+    return Status;
+}
+
+//
+// Makes a newly allocated stream FCB the stream of a label. Nothing is
+// read here, the records are counted on the first read of the stream or
+// the first query of its sizes, see FsdBuildStream.
+//
+NTSTATUS
+FsdOpenArincStream (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    IN USHORT               ChannelId,
+    IN ULONG                Filter
+    )
+{
+    PAGED_CODE();
+
+    ASSERT(Fcb->Arinc == NULL);
+    ASSERT(Fcb->Recording != NULL);
+
+    Fcb->ChannelId = ChannelId;
+    Fcb->Filter = Filter;
+
+    SetFlag(Fcb->Flags, FCB_ARINC_STREAM | FCB_STREAM_PENDING);
+    ClearFlag(Fcb->FileAttributes, FILE_ATTRIBUTE_SPARSE_FILE);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Finds a label in the index of a recording, built on a worker thread the
+// first time any of its streams or FSCTL_CH10_QUERY_ARINC needs it, and
+// counts the records in front of each of its packets
+//
+NTSTATUS
+FsdBuildArincStream (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Recording,
+    IN USHORT               ChannelId,
+    IN ULONG                Filter,
+    OUT PFSD_ARINC_STREAM*  Result
+    )
+{
+    PFSD_ARINC_STREAM   Arinc;
+    PFSD_ARINC_INDEX    ArincIndex;
+    PFSD_TIME_TABLE     TimeTable;
+    ULONGLONG           Records = 0;
+    ULONG               Packet;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    Arinc = (PFSD_ARINC_STREAM) FsdAllocatePool(PagedPool, sizeof(FSD_ARINC_STREAM), 'tAeR');
+
+    if (Arinc == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Arinc, sizeof(FSD_ARINC_STREAM));
+
+    Arinc->ChannelId = ChannelId;
+    Arinc->Bus = (UCHAR) (Filter >> 8);
+    Arinc->Label = (UCHAR) Filter;
+
+    //
+    // The time correlation is built first, the recording keeps both
+    //
+    Status = FsdGetTimeTable(Vcb, Recording, &TimeTable);
+
+    if (NT_SUCCESS(Status))
+    {
+        Status = FsdGetArincIndex(Vcb, Recording, &ArincIndex);
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        Arinc->Entry = FsdFindArincLabel(ArincIndex, ChannelId, Arinc->Bus, Arinc->Label);
+    }
+
+    if (NT_SUCCESS(Status) && Arinc->Entry)
+    {
+        Arinc->FirstRecord = (PULONGLONG) FsdAllocatePool(
+            PagedPool,
+            Arinc->Entry->PacketCount * sizeof(ULONGLONG),
+            'fAeR'
+            );
+
+        if (Arinc->FirstRecord == NULL)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        FsdFreeArincStream(Arinc);
+        return Status;
+    }
+
+    //
+    // A label the recording has no words of has no records
+    //
+    for (Packet = 0; Arinc->Entry && Packet < Arinc->Entry->PacketCount; Packet++)
+    {
+        Arinc->FirstRecord[Packet] = Records;
+        Records += ArincIndex->Packets[Arinc->Entry->FirstPacket + Packet].WordCount;
+    }
+
+    Arinc->RecordCount = Records;
+    Arinc->Size = Records * sizeof(FSD_ARINC_RECORD);
+
+    if (TimeTable->Count && !FlagOn(TimeTable->Points[0].Flags, FSD_TIME_YEAR))
+    {
+        Arinc->Epoch = FsdGetEpoch(Recording->ch10_direntry);
+    }
+
+    KdPrint((
+        DRIVER_NAME
+        ": FsdBuildArincStream: %wZ Label: %u-%u-%o Packets: %u of %I64u Records: %I64u\n",
+        &Recording->FileName,
+        ChannelId,
+        Arinc->Bus,
+        Arinc->Label,
+        Arinc->Entry ? Arinc->Entry->PacketCount : 0,
+        ArincIndex->ArincPackets,
+        Arinc->RecordCount
+        ));
+
+    *Result = Arinc;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+FsdFreeArincStream (
+    IN PFSD_ARINC_STREAM    Arinc
+    )
+{
+    PAGED_CODE();
+
+    if (Arinc->FirstRecord)
+    {
+        FsdFreePool(Arinc->FirstRecord);
+    }
+
+    FsdFreePool(Arinc);
+}
+
+//
+// Generates the records of one packet of the label that fall into the
+// range, Number is the record of its first word with the label
+//
+static VOID
+FsdCopyArincRecords (
+    IN PFSD_ARINC_STREAM            Arinc,
+    IN PFSD_TIME_TABLE              TimeTable,
+    IN PFSD_ARINC_PACKET            Packet,
+    IN struct ch10_packet_header*   Header,
+    IN ULONGLONG                    Number,
+    OUT PUCHAR                      Buffer,
+    IN ULONGLONG                    Offset,
+    IN ULONG                        Length
+    )
+{
+    FSD_ARINC_RECORD    Record;
+    PUCHAR              Words;
+    ULONGLONG           Rtc;
+    ULONGLONG           Position;
+    ULONGLONG           Start;
+    ULONGLONG           End;
+    ULONG               Count;
+    ULONG               Word;
+    ULONG               IdWord;
+    ULONG               Data;
+    ULONG               Point;
+
+    PAGED_CODE();
+
+    Count = FsdGetArincWords(Header, &Words);
+
+    //
+    // Gap times run from the word before on any bus, the first from the
+    // time of the packet
+    //
+    Rtc = FsdGetRtc(Header);
+
+    for (Word = 0;
+         Word < Count && Number * sizeof(FSD_ARINC_RECORD) < Offset + Length;
+         Word++)
+    {
+        IdWord = FsdGetArincLe32(Words + Word * ARINC_WORD_SIZE);
+        Data = FsdGetArincLe32(Words + Word * ARINC_WORD_SIZE + 4);
+
+        Rtc += IdWord & ARINC_GAP_MASK;
+
+        if (Word < Packet->FirstWord ||
+            ARINC_BUS(IdWord) != Arinc->Bus ||
+            ARINC_LABEL(Data) != Arinc->Label)
+        {
+            continue;
+        }
+
+        Position = Number * sizeof(FSD_ARINC_RECORD);
+
+        if (Position + sizeof(FSD_ARINC_RECORD) > Offset)
+        {
+            RtlZeroMemory(&Record, sizeof(Record));
+
+            Record.Rtc = Rtc;
+
+            if (NT_SUCCESS(FsdRtcToTime(TimeTable, Rtc, &Record.Time, &Point)))
+            {
+                Record.Time += Arinc->Epoch;
+            }
+            else
+            {
+                Record.Time = 0;
+            }
+
+            Record.Word = Data;
+            Record.Bus = Arinc->Bus;
+
+            if (IdWord & ARINC_PARITY_ERROR)
+            {
+                SetFlag(Record.Flags, FSD_ARINC_RECORD_PARITY_ERROR);
+            }
+
+            if (IdWord & ARINC_FORMAT_ERROR)
+            {
+                SetFlag(Record.Flags, FSD_ARINC_RECORD_FORMAT_ERROR);
+            }
+
+            if (IdWord & ARINC_HIGH_SPEED)
+            {
+                SetFlag(Record.Flags, FSD_ARINC_RECORD_HIGH_SPEED);
+            }
+
+            Start = max(Position, Offset);
+            End = min(Position + sizeof(FSD_ARINC_RECORD), Offset + Length);
+
+            RtlCopyMemory(
+                Buffer + (Start - Offset),
+                (PUCHAR) &Record + (Start - Position),
+                (ULONG) (End - Start)
+                );
+        }
+
+        Number++;
+    }
+}
+
+//
+// Fills Buffer with Length bytes of the records at Offset, the caller has
+// clipped the range to the stream. The packets come from the cache of the
+// recording, one at a time into the packet buffer of the stream.
+//
+NTSTATUS
+FsdReadArinc (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    IN ULONGLONG            Offset,
+    IN ULONG                Length,
+    OUT PUCHAR              Buffer
+    )
+{
+    PFSD_ARINC_STREAM   Arinc = Fcb->Arinc;
+    PFSD_ARINC_PACKET   Packet;
+    PFSD_TIME_TABLE     TimeTable;
+    ULONGLONG           First = Offset / sizeof(FSD_ARINC_RECORD);
+    ULONG               Low = 0;
+    ULONG               High = Arinc->Entry->PacketCount;
+    ULONG               Middle;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    ASSERT(FlagOn(Fcb->Flags, FCB_ARINC_STREAM));
+    ASSERT(Offset + Length <= Arinc->Size);
+
+    Status = FsdGetTimeTable(Vcb, Fcb->Recording, &TimeTable);
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    //
+    // Last packet whose records start at or before Offset
+    //
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (Arinc->FirstRecord[Middle] <= First)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    KeEnterCriticalRegion();
+
+    ExAcquireFastMutexUnsafe(&Fcb->PacketBufferMutex);
+
+    __try
+    {
+        for (Low = Low ? Low - 1 : 0;
+             Low < Arinc->Entry->PacketCount &&
+             Arinc->FirstRecord[Low] * sizeof(FSD_ARINC_RECORD) < Offset + Length;
+             Low++)
+        {
+            Packet = &Fcb->Recording->ArincIndex->Packets[Arinc->Entry->FirstPacket + Low];
+
+            if (Fcb->PacketBuffer == NULL)
+            {
+                Fcb->PacketBuffer = (PUCHAR) FsdAllocatePool(
+                    PagedPool,
+                    CH10_MAX_PACKET_SIZE,
+                    'bAeR'
+                    );
+
+                if (Fcb->PacketBuffer == NULL)
+                {
+                    Status = STATUS_INSUFFICIENT_RESOURCES;
+                    __leave;
+                }
+            }
+
+            Status = FsdReadRecordingCached(
+                Fcb->Recording,
+                Packet->Offset,
+                Packet->PacketLength,
+                Fcb->PacketBuffer
+                );
+
+            if (!NT_SUCCESS(Status))
+            {
+                __leave;
+            }
+
+            FsdCopyArincRecords(
+                Arinc,
+                TimeTable,
+                Packet,
+                (struct ch10_packet_header*) Fcb->PacketBuffer,
+                Arinc->FirstRecord[Low],
+                Buffer,
+                Offset,
+                Length
+                );
+        }
+    }
+    __finally
+    {
+        ExReleaseFastMutexUnsafe(&Fcb->PacketBufferMutex);
+
+        KeLeaveCriticalRegion();
+    }
+
+    return Status;
+}
+
+#pragma code_seg() // end FSD_PAGED_CODE
@@ -27,6 +27,49 @@ FsdReadWriteBlockDeviceAtApcLevelCompletion (
     IN PVOID            Context
     );
 
+NTSTATUS
+FsdReadBlockDeviceMdlCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    );
+
+//
+// FSD_MULTIPLE_IO_CONTEXT
+//
+// Tracks the sub-requests of a read split by FsdReadBlockDeviceExtents
+//
+typedef struct _FSD_MULTIPLE_IO_CONTEXT {
+
+    // Signaled when the last sub-request completes
+    KEVENT                      Event;
+
+    // Limits the number of sub-requests outstanding at the same time
+    KSEMAPHORE                  Slots;
+
+    // Number of sub-requests outstanding, plus one while issuing them
+    LONG                        Outstanding;
+
+    // Status of the first sub-request that failed
+    NTSTATUS                    Status;
+
+} FSD_MULTIPLE_IO_CONTEXT, *PFSD_MULTIPLE_IO_CONTEXT;
+
+//
+// FSD_IO_PIECE_CONTEXT
+//
+// The context of one sub-request sent by FsdReadBlockDeviceExtents
+//
+typedef struct _FSD_IO_PIECE_CONTEXT {
+
+    // The read the sub-request belongs to
+    PFSD_MULTIPLE_IO_CONTEXT    MultipleIoContext;
+
+    // Number of bytes the sub-request has to return
+    ULONG                       Length;
+
+} FSD_IO_PIECE_CONTEXT, *PFSD_IO_PIECE_CONTEXT;
+
 #pragma code_seg(FSD_PAGED_CODE)
 
 NTSTATUS 
@@ -389,6 +432,249 @@ FsdWriteBlockDeviceAtApcLevel (
 
 #endif // !FSD_RO
 
+//
+// Reads Length bytes at Offset straight into the pages described by Mdl,
+// without mapping or copying them. The read is split at the maximum
+// transfer length of the device and the pieces are sent down at the same
+// time, each with a partial MDL over its part of the buffer. Offset and
+// Length must be aligned to the sector size. IrpFlags are the flags of
+// the request the read is made for, see FsdReadBlockDeviceExtents.
+//
+NTSTATUS
+FsdReadBlockDeviceMdl (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PMDL             Mdl,
+    IN PLARGE_INTEGER   Offset,
+    IN ULONG            Length,
+    IN ULONG            MaximumTransferLength,
+    IN ULONG            IrpFlags
+    )
+{
+    FSD_READ_EXTENT Extent;
+
+    ASSERT(Offset != NULL);
+
+    Extent.Offset = Offset->QuadPart;
+    Extent.Length = Length;
+    Extent.BufferOffset = 0;
+
+    return FsdReadBlockDeviceExtents(
+        DeviceObject,
+        Mdl,
+        &Extent,
+        1,
+        MaximumTransferLength,
+        IrpFlags
+        );
+}
+
+//
+// Reads scattered extents of the device into the pages described by Mdl,
+// each at its offset in the buffer, as one batch: the extents are split at
+// the maximum transfer length of the device and all the pieces are sent
+// down FSD_MAX_OUTSTANDING_READS at a time, each with a partial MDL over
+// its part of the buffer. The IRP_PAGING_IO and IRP_NOCACHE flags of
+// IrpFlags, the flags of the request the read is made for, are carried
+// over to the pieces, which are always noncached.
+//
+NTSTATUS
+FsdReadBlockDeviceExtents (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PMDL             Mdl,
+    IN PFSD_READ_EXTENT Extents,
+    IN ULONG            ExtentCount,
+    IN ULONG            MaximumTransferLength,
+    IN ULONG            IrpFlags
+    )
+{
+    FSD_MULTIPLE_IO_CONTEXT Context;
+    PUCHAR                  VirtualAddress;
+    PFSD_READ_EXTENT        Extent;
+    ULONG                   Done;
+    ULONG                   Part;
+    PIRP                    Irp;
+    PFSD_IO_PIECE_CONTEXT   PieceContext;
+    PMDL                    PartialMdl;
+    PIO_STACK_LOCATION      IoStackLocation;
+
+    ASSERT(DeviceObject != NULL);
+    ASSERT(Mdl != NULL);
+    ASSERT(Extents != NULL);
+    ASSERT(MaximumTransferLength != 0);
+
+    KeInitializeEvent(&Context.Event, NotificationEvent, FALSE);
+
+    KeInitializeSemaphore(
+        &Context.Slots,
+        FSD_MAX_OUTSTANDING_READS,
+        FSD_MAX_OUTSTANDING_READS
+        );
+
+    Context.Outstanding = 1;
+
+    Context.Status = STATUS_SUCCESS;
+
+    VirtualAddress = (PUCHAR) MmGetMdlVirtualAddress(Mdl);
+
+    for (Extent = Extents;
+         Extent < Extents + ExtentCount && NT_SUCCESS(Context.Status);
+         Extent++)
+    {
+        for (Done = 0; Done < Extent->Length; Done += Part)
+        {
+            Part = min(Extent->Length - Done, MaximumTransferLength);
+
+            KeWaitForSingleObject(
+                &Context.Slots,
+                Executive,
+                KernelMode,
+                FALSE,
+                NULL
+                );
+
+            if (!NT_SUCCESS(Context.Status))
+            {
+                KeReleaseSemaphore(&Context.Slots, IO_NO_INCREMENT, 1, FALSE);
+                break;
+            }
+
+            Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+
+            PieceContext = Irp ?
+                (PFSD_IO_PIECE_CONTEXT) FsdAllocatePool(
+                    NonPagedPool,
+                    sizeof(FSD_IO_PIECE_CONTEXT),
+                    'cPbR'
+                    ) :
+                NULL;
+
+            PartialMdl = PieceContext ?
+                IoAllocateMdl(VirtualAddress + Extent->BufferOffset + Done, Part, FALSE, FALSE, NULL) :
+                NULL;
+
+            if (!PartialMdl)
+            {
+                if (PieceContext)
+                {
+                    FsdFreePool(PieceContext);
+                }
+
+                if (Irp)
+                {
+                    IoFreeIrp(Irp);
+                }
+
+                InterlockedCompareExchange(
+                    &Context.Status,
+                    STATUS_INSUFFICIENT_RESOURCES,
+                    STATUS_SUCCESS
+                    );
+
+                KeReleaseSemaphore(&Context.Slots, IO_NO_INCREMENT, 1, FALSE);
+                break;
+            }
+
+            IoBuildPartialMdl(Mdl, PartialMdl, VirtualAddress + Extent->BufferOffset + Done, Part);
+
+            PieceContext->MultipleIoContext = &Context;
+            PieceContext->Length = Part;
+
+            Irp->MdlAddress = PartialMdl;
+
+            Irp->Flags = IRP_NOCACHE | FlagOn(IrpFlags, IRP_PAGING_IO | IRP_NOCACHE);
+
+            Irp->Tail.Overlay.Thread = PsGetCurrentThread();
+
+            IoStackLocation = IoGetNextIrpStackLocation(Irp);
+
+            IoStackLocation->MajorFunction = IRP_MJ_READ;
+            IoStackLocation->Parameters.Read.Length = Part;
+            IoStackLocation->Parameters.Read.ByteOffset.QuadPart =
+                Extent->Offset + Done;
+
+            IoSetCompletionRoutine(
+                Irp,
+                FsdReadBlockDeviceMdlCompletion,
+                PieceContext,
+                TRUE,
+                TRUE,
+                TRUE
+                );
+
+            InterlockedIncrement(&Context.Outstanding);
+
+            IoCallDriver(DeviceObject, Irp);
+        }
+    }
+
+    if (InterlockedDecrement(&Context.Outstanding) != 0)
+    {
+        KeWaitForSingleObject(
+            &Context.Event,
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL
+            );
+    }
+
+    return Context.Status;
+}
+
+NTSTATUS
+FsdReadBlockDeviceMdlCompletion (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN PIRP             Irp,
+    IN PVOID            Context
+    )
+{
+    PFSD_IO_PIECE_CONTEXT       PieceContext;
+    PFSD_MULTIPLE_IO_CONTEXT    MultipleIoContext;
+
+    ASSERT(Irp != NULL);
+    ASSERT(Context != NULL);
+
+    PieceContext = (PFSD_IO_PIECE_CONTEXT) Context;
+
+    MultipleIoContext = PieceContext->MultipleIoContext;
+
+    if (!NT_SUCCESS(Irp->IoStatus.Status))
+    {
+        InterlockedCompareExchange(
+            &MultipleIoContext->Status,
+            Irp->IoStatus.Status,
+            STATUS_SUCCESS
+            );
+    }
+    else if (Irp->IoStatus.Information != PieceContext->Length)
+    {
+        //
+        // A short read, at the end of the partition for instance, leaves
+        // part of the buffer as it was
+        //
+        InterlockedCompareExchange(
+            &MultipleIoContext->Status,
+            STATUS_UNEXPECTED_IO_ERROR,
+            STATUS_SUCCESS
+            );
+    }
+
+    FsdFreePool(PieceContext);
+
+    IoFreeMdl(Irp->MdlAddress);
+
+    IoFreeIrp(Irp);
+
+    KeReleaseSemaphore(&MultipleIoContext->Slots, IO_NO_INCREMENT, 1, FALSE);
+
+    if (InterlockedDecrement(&MultipleIoContext->Outstanding) == 0)
+    {
+        KeSetEvent(&MultipleIoContext->Event, IO_NO_INCREMENT, FALSE);
+    }
+
+    return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
 NTSTATUS
 FsdReadWriteBlockDeviceAtApcLevelCompletion (
     IN PDEVICE_OBJECT   DeviceObject,
@@ -65,14 +65,14 @@ __u32 FsdCh10GetFileCount(struct ch10_dir_block dirblocks[]) {
 	return count;
 }
 
-__u32 FsdCh10PartitionSize(struct ch10_dir_block dirblocks[]) {
+__u64 FsdCh10PartitionSize(struct ch10_dir_block dirblocks[]) {
 	int dirIndex, entryIndex;
-	__u32 size = 0;
+	__u64 size = 0;
 	for(dirIndex = 0; dirIndex < CH10_MAX_DIR_BLOCKS; dirIndex++) {
 		struct ch10_dir_block *dir_block = &dirblocks[dirIndex];
-		for(entryIndex = 0; entryIndex < MAX_FILES_PER_DIR; entryIndex++) {
+		for(entryIndex = 0; entryIndex < MAX_FILES_PER_DIR && entryIndex < be16_to_cpu(dir_block->numEntries); entryIndex++) {
 			struct ch10_dir_entry *dir_entry = &dir_block->dirEntries[entryIndex];
-			size += (__u32)dir_entry->size;
+			size += be64_to_cpu(dir_entry->size);
 		}
 	}
 	return size;
@@ -25,54 +25,361 @@
 
 #pragma code_seg(FSD_PAGED_CODE)
 
+//
+// Returns the media change count of a removable device together with its
+// device number and partition. Devices that do not report a media change
+// count are not remembered in the probe cache.
+//
+BOOLEAN
+FsdGetProbeIdentity (
+    IN PDEVICE_OBJECT       DeviceObject,
+    OUT PFSD_PROBE_IDENTITY Identity
+    )
+{
+    PARTITION_INFORMATION_EX    PartitionInformation;
+    ULONG                       OutputBufferSize;
+    NTSTATUS                    Status;
+
+    PAGED_CODE();
+
+    RtlZeroMemory(Identity, sizeof(FSD_PROBE_IDENTITY));
+
+    OutputBufferSize = sizeof(ULONG);
+
+    Status = FsdBlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_CHECK_VERIFY,
+        NULL,
+        0,
+        &Identity->MediaChangeCount,
+        &OutputBufferSize
+        );
+
+    if (!NT_SUCCESS(Status) || OutputBufferSize != sizeof(ULONG))
+    {
+        return FALSE;
+    }
+
+    OutputBufferSize = sizeof(STORAGE_DEVICE_NUMBER);
+
+    Status = FsdBlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_STORAGE_GET_DEVICE_NUMBER,
+        NULL,
+        0,
+        &Identity->DeviceNumber,
+        &OutputBufferSize
+        );
+
+    if (!NT_SUCCESS(Status))
+    {
+        RtlZeroMemory(&Identity->DeviceNumber, sizeof(STORAGE_DEVICE_NUMBER));
+    }
+
+    OutputBufferSize = sizeof(PARTITION_INFORMATION_EX);
+
+    Status = FsdBlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_GET_PARTITION_INFO_EX,
+        NULL,
+        0,
+        &PartitionInformation,
+        &OutputBufferSize
+        );
+
+    if (NT_SUCCESS(Status))
+    {
+        Identity->StartingOffset = PartitionInformation.StartingOffset.QuadPart;
+        Identity->PartitionLength = PartitionInformation.PartitionLength.QuadPart;
+    }
+
+    return TRUE;
+}
+
+//
+// Returns TRUE if the device was found not to hold a Ch10 volume a short
+// while ago and neither the media nor the device behind the device object
+// has changed since
+//
+BOOLEAN
+FsdProbeCacheLookup (
+    IN PDEVICE_OBJECT       DeviceObject,
+    IN PFSD_PROBE_IDENTITY  Identity
+    )
+{
+    PFSD_PROBE_ENTRY    Entry;
+    ULONGLONG           Now;
+    BOOLEAN             Found = FALSE;
+    ULONG               i;
+
+    PAGED_CODE();
+
+    Now = KeQueryInterruptTime();
+
+    ExAcquireFastMutex(&FsdGlobalData.ProbeCacheMutex);
+
+    for (i = 0; i < FSD_PROBE_CACHE_SIZE; i++)
+    {
+        Entry = &FsdGlobalData.ProbeCache[i];
+
+        if (Entry->DeviceObject != DeviceObject)
+        {
+            continue;
+        }
+
+        if (RtlEqualMemory(&Entry->Identity, Identity, sizeof(FSD_PROBE_IDENTITY)) &&
+            Entry->Expires > Now)
+        {
+            Found = TRUE;
+        }
+        else
+        {
+            Entry->DeviceObject = NULL;
+        }
+
+        break;
+    }
+
+    ExReleaseFastMutex(&FsdGlobalData.ProbeCacheMutex);
+
+    return Found;
+}
+
+VOID
+FsdProbeCacheInsert (
+    IN PDEVICE_OBJECT       DeviceObject,
+    IN PFSD_PROBE_IDENTITY  Identity
+    )
+{
+    PFSD_PROBE_ENTRY    Entry = NULL;
+    ULONGLONG           Now;
+    ULONG               i;
+
+    PAGED_CODE();
+
+    Now = KeQueryInterruptTime();
+
+    ExAcquireFastMutex(&FsdGlobalData.ProbeCacheMutex);
+
+    //
+    // Reuse the entry for the same device, else a free or expired one, else
+    // the oldest one
+    //
+    for (i = 0; i < FSD_PROBE_CACHE_SIZE; i++)
+    {
+        if (FsdGlobalData.ProbeCache[i].DeviceObject == DeviceObject)
+        {
+            Entry = &FsdGlobalData.ProbeCache[i];
+            break;
+        }
+
+        if (Entry == NULL &&
+            (FsdGlobalData.ProbeCache[i].DeviceObject == NULL ||
+             FsdGlobalData.ProbeCache[i].Expires <= Now))
+        {
+            Entry = &FsdGlobalData.ProbeCache[i];
+        }
+    }
+
+    if (Entry == NULL)
+    {
+        Entry = &FsdGlobalData.ProbeCache[FsdGlobalData.ProbeCacheNext];
+
+        FsdGlobalData.ProbeCacheNext =
+            (FsdGlobalData.ProbeCacheNext + 1) % FSD_PROBE_CACHE_SIZE;
+    }
+
+    Entry->DeviceObject = DeviceObject;
+    Entry->Identity = *Identity;
+    Entry->Expires = Now + FSD_PROBE_CACHE_LIFETIME;
+
+    ExReleaseFastMutex(&FsdGlobalData.ProbeCacheMutex);
+}
+
+//
+// Checks that a root directory block is plausible, not only that it starts
+// with the magic. DeviceSize is zero when the size of the device is unknown.
+//
+BOOLEAN
+FsdIsValidRootDirBlock (
+    IN struct ch10_dir_block*   DirBlock,
+    IN ULONGLONG                DeviceSize
+    )
+{
+    ULONG       BytesPerBlock;
+    ULONGLONG   ForwardLink;
+
+    if (RtlCompareMemory(DirBlock->magicNumAscii, CH10_MAGIC, sizeof(CH10_MAGIC) - 1) !=
+        (sizeof(CH10_MAGIC) - 1))
+    {
+        return FALSE;
+    }
+
+    if (DirBlock->revNum == 0 || DirBlock->revNum == 0xff)
+    {
+        return FALSE;
+    }
+
+    if (be16_to_cpu(DirBlock->numEntries) > MAX_FILES_PER_DIR)
+    {
+        return FALSE;
+    }
+
+    BytesPerBlock = be32_to_cpu(DirBlock->bytesPerBlock);
+
+    if (BytesPerBlock < SECTOR_SIZE ||
+        BytesPerBlock > CH10_MAX_BLOCK_SIZE ||
+        (BytesPerBlock & (BytesPerBlock - 1)) != 0)
+    {
+        return FALSE;
+    }
+
+    //
+    // The root is block 1 and is the first block of the directory chain
+    //
+    if (be64_to_cpu(DirBlock->reverseLink) != 1)
+    {
+        return FALSE;
+    }
+
+    ForwardLink = be64_to_cpu(DirBlock->forwardLink);
+
+    if (ForwardLink == 0 ||
+        (DeviceSize != 0 && ForwardLink >= DeviceSize / BytesPerBlock))
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+//
+// Reads the start of the device in one request and checks the root
+// directory block of each block size in it. If DirBlock is given the root
+// directory block is returned in it, so that the caller does not have to
+// read it again.
+//
 NTSTATUS
 FsdIsDeviceCh10fs (
-    IN PDEVICE_OBJECT DeviceObject
+    IN PDEVICE_OBJECT               DeviceObject,
+    OUT struct ch10_dir_block*      DirBlock OPTIONAL
     )
 {
+    DISK_GEOMETRY   DiskGeometry;
+    ULONG           OutputBufferSize;
+    ULONG           BytesPerSector = SECTOR_SIZE;
+    ULONGLONG       DeviceSize = 0;
+    FSD_PROBE_IDENTITY Identity;
+    BOOLEAN         Cacheable;
     PUCHAR          Buffer;
+    ULONG           BlockOffset;
+    ULONG           ProbeLength;
     LARGE_INTEGER   Offset;
+    struct ch10_dir_block* RootBlock;
+    NTSTATUS        ReadStatus;
     NTSTATUS        Status;
-	int i;
 
-	PAGED_CODE();
+    PAGED_CODE();
 
     ASSERT(DeviceObject != NULL);
 
-    Buffer = FsdAllocatePool(NonPagedPool, SECTOR_SIZE, '1ceR');
+    Cacheable = FsdGetProbeIdentity(DeviceObject, &Identity);
+
+    if (Cacheable && FsdProbeCacheLookup(DeviceObject, &Identity))
+    {
+        return STATUS_UNRECOGNIZED_VOLUME;
+    }
+
+    OutputBufferSize = sizeof(DISK_GEOMETRY);
+
+    Status = FsdBlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_GET_DRIVE_GEOMETRY,
+        NULL,
+        0,
+        &DiskGeometry,
+        &OutputBufferSize
+        );
+
+    if (NT_SUCCESS(Status))
+    {
+        if (DiskGeometry.BytesPerSector >= SECTOR_SIZE &&
+            (DiskGeometry.BytesPerSector & (DiskGeometry.BytesPerSector - 1)) == 0)
+        {
+            BytesPerSector = DiskGeometry.BytesPerSector;
+        }
+
+        DeviceSize =
+            DiskGeometry.Cylinders.QuadPart *
+            DiskGeometry.TracksPerCylinder *
+            DiskGeometry.SectorsPerTrack *
+            DiskGeometry.BytesPerSector;
+    }
+
+    //
+    // The root directory block is block 1, so where it is depends on the
+    // block size. One read from the start of the device to past block 1 of
+    // the largest block size holds it for every block size, and is cut
+    // short on a device too small for that.
+    //
+    ProbeLength = (CH10_MAX_BLOCK_SIZE + sizeof(struct ch10_dir_block) + BytesPerSector - 1) &
+        ~(BytesPerSector - 1);
+
+    if (DeviceSize != 0 && DeviceSize < ProbeLength)
+    {
+        ProbeLength = (ULONG) DeviceSize & ~(BytesPerSector - 1);
+    }
+
+    if (ProbeLength < CH10_MAGIC_OFFSET + sizeof(struct ch10_dir_block))
+    {
+        return STATUS_UNRECOGNIZED_VOLUME;
+    }
+
+    Buffer = FsdAllocatePool(NonPagedPoolCacheAligned, ProbeLength, '1ceR');
 
     if (!Buffer)
     {
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
+    Status = STATUS_UNRECOGNIZED_VOLUME;
+
+    Offset.QuadPart = 0;
+
+    ReadStatus = FsdReadBlockDeviceOverrideVerify(
+        DeviceObject,
+        &Offset,
+        ProbeLength,
+        Buffer
+        );
 
-	Offset.QuadPart = CH10_MAGIC_OFFSET;
-
-	Status = FsdReadBlockDeviceOverrideVerify(
-		DeviceObject,
-		&Offset,
-		SECTOR_SIZE,
-		Buffer
-		);
-
-	//DbgPrint(DRIVER_NAME ": First Disk sector\n");
-	//DbgPrintMem((char *)Buffer, SECTOR_SIZE);
-	//DbgPrint("\n");
-		
-	///DbgPrint((DRIVER_NAME ": Magic buffer in memory\n"));
-	//DbgPrint((DRIVER_NAME ": %s\n", CH10_MAGIC));
-	
-	//DbgPrint((DRIVER_NAME ": Magic buffer on disk\n"));
-	//DbgPrint((DRIVER_NAME ": %s\n", Buffer));
-	
-	//DbgPrint(DRIVER_NAME ": Magic word size %d\n", sizeof(CH10_MAGIC) - 1);
-	
-    if (!NT_SUCCESS(Status) ||
-        RtlCompareMemory(Buffer, CH10_MAGIC, sizeof(CH10_MAGIC) - 1) != (sizeof(CH10_MAGIC) - 1)
-        )
-    {
-        Status = STATUS_UNRECOGNIZED_VOLUME;
+    for (BlockOffset = CH10_MAGIC_OFFSET;
+         NT_SUCCESS(ReadStatus) &&
+         BlockOffset <= CH10_MAX_BLOCK_SIZE &&
+         BlockOffset + sizeof(struct ch10_dir_block) <= ProbeLength;
+         BlockOffset *= 2)
+    {
+        RootBlock = (struct ch10_dir_block*) (Buffer + BlockOffset);
+
+        if (be32_to_cpu(RootBlock->bytesPerBlock) == BlockOffset &&
+            FsdIsValidRootDirBlock(RootBlock, DeviceSize))
+        {
+            if (DirBlock)
+            {
+                RtlCopyMemory(DirBlock, RootBlock, sizeof(struct ch10_dir_block));
+            }
+
+            Status = STATUS_SUCCESS;
+            break;
+        }
+    }
+
+    //
+    // Only a device that could be read is known not to hold a volume
+    //
+    if (!NT_SUCCESS(Status) && NT_SUCCESS(ReadStatus) && Cacheable)
+    {
+        FsdProbeCacheInsert(DeviceObject, &Identity);
     }
 
     FsdFreePool(Buffer);
@@ -0,0 +1,607 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ntifs.h"
+#include "fsd.h"
+#include "ch10_fs.h"
+#include "border.h"
+
+//
+// Reads of a few channels of a recording. Packets of all channels are
+// interleaved, so even a demultiplexer that knows where every packet is
+// reads most of the recording when it reads it in regions. Here the packet
+// table of the recording picks out the packets of the channels asked for,
+// neighbours closer than FSD_CHANNEL_READ_GAP are joined into one extent,
+// and the extents are read from the device as one scattered batch. Only
+// the sectors around wanted packets are moved off the media.
+//
+
+typedef struct _FSD_PACKET_BUILDER {
+    PFSD_PACKET_TABLE           Table;
+    ULONG                       Capacity;
+} FSD_PACKET_BUILDER, *PFSD_PACKET_BUILDER;
+
+#pragma code_seg(FSD_PAGED_CODE)
+
+static NTSTATUS
+FsdAddPacketEntry (
+    IN PVOID                        Context,
+    IN ULONGLONG                    Offset,
+    IN struct ch10_packet_header*   Header
+    )
+{
+    PFSD_PACKET_BUILDER Builder = (PFSD_PACKET_BUILDER) Context;
+    PFSD_PACKET_TABLE   Table = Builder->Table;
+    PFSD_PACKET_ENTRY   Packets;
+    PFSD_PACKET_ENTRY   Entry;
+    ULONG               Capacity;
+
+    PAGED_CODE();
+
+    if (Table->Count == Builder->Capacity)
+    {
+        if (Builder->Capacity > MAXLONG / sizeof(FSD_PACKET_ENTRY) / 2)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        Capacity = Builder->Capacity ? Builder->Capacity * 2 : 4096;
+
+        Packets = (PFSD_PACKET_ENTRY) FsdAllocatePool(
+            PagedPool,
+            Capacity * sizeof(FSD_PACKET_ENTRY),
+            'pPcR'
+            );
+
+        if (Packets == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if (Table->Packets)
+        {
+            RtlCopyMemory(Packets, Table->Packets, Table->Count * sizeof(FSD_PACKET_ENTRY));
+            FsdFreePool(Table->Packets);
+        }
+
+        Table->Packets = Packets;
+        Builder->Capacity = Capacity;
+    }
+
+    Entry = &Table->Packets[Table->Count++];
+
+    Entry->Offset = Offset;
+    Entry->PacketLength = le32_to_cpu(Header->packetLength);
+    Entry->ChannelId = le16_to_cpu(Header->channelId);
+    Entry->DataType = Header->dataType;
+    Entry->PacketFlags = Header->packetFlags;
+
+    return STATUS_SUCCESS;
+}
+
+static NTSTATUS
+FsdBuildPacketTable (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_PACKET_TABLE*  Table
+    )
+{
+    FSD_PACKET_BUILDER  Builder;
+    PFSD_PACKET_TABLE   NewTable;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    //
+    // The sidecar has the table already, a recording it does not cover or
+    // no longer fits is scanned
+    //
+    Status = FsdReadIndexPackets(Vcb, Fcb, Table);
+
+    if (NT_SUCCESS(Status) || Status == STATUS_INSUFFICIENT_RESOURCES)
+    {
+        return Status;
+    }
+
+    NewTable = (PFSD_PACKET_TABLE) FsdAllocatePool(
+        PagedPool,
+        sizeof(FSD_PACKET_TABLE),
+        'tPcR'
+        );
+
+    if (NewTable == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(NewTable, sizeof(FSD_PACKET_TABLE));
+
+    Builder.Table = NewTable;
+    Builder.Capacity = 0;
+
+    Status = FsdScanPackets(Vcb, Fcb, FsdAddPacketEntry, &Builder, NULL);
+
+    if (!NT_SUCCESS(Status))
+    {
+        FsdFreePacketTable(NewTable);
+        return Status;
+    }
+
+    *Table = NewTable;
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Returns the packet table of a recording, building it on first use. Two
+// callers racing to build it both build one, the first to finish keeps
+// its table with the FCB.
+//
+NTSTATUS
+FsdGetPacketTable (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_PACKET_TABLE*  Table
+    )
+{
+    PFSD_PACKET_TABLE   NewTable;
+    PFSD_PACKET_TABLE   OldTable;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    if (Fcb->PacketTable == NULL)
+    {
+        Status = FsdBuildPacketTable(Vcb, Fcb, &NewTable);
+
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        KdPrint((
+            DRIVER_NAME
+            ": FsdGetPacketTable: %wZ Packets: %u From index: %u\n",
+            &Fcb->FileName,
+            NewTable->Count,
+            NewTable->FromIndex
+            ));
+
+        OldTable = (PFSD_PACKET_TABLE) InterlockedCompareExchangePointer(
+            (PVOID*) &Fcb->PacketTable,
+            NewTable,
+            NULL
+            );
+
+        if (OldTable != NULL)
+        {
+            FsdFreePacketTable(NewTable);
+        }
+    }
+
+    *Table = Fcb->PacketTable;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+FsdFreePacketTable (
+    IN PFSD_PACKET_TABLE    Table
+    )
+{
+    PAGED_CODE();
+
+    if (Table->Packets)
+    {
+        FsdFreePool(Table->Packets);
+    }
+
+    FsdFreePool(Table);
+}
+
+static NTSTATUS
+FsdGetChannelFcb (
+    IN PFSD_IRP_CONTEXT     IrpContext,
+    OUT PFSD_VCB*           Vcb,
+    OUT PFSD_FCB*           Fcb
+    )
+{
+    PAGED_CODE();
+
+    if (IrpContext->DeviceObject == FsdGlobalData.DeviceObject ||
+        IrpContext->FileObject == NULL)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    *Vcb = (PFSD_VCB) IrpContext->DeviceObject->DeviceExtension;
+    *Fcb = (PFSD_FCB) IrpContext->FileObject->FsContext;
+
+    if (*Fcb == NULL ||
+        (*Fcb)->Identifier.Type != FCB ||
+        FlagOn((*Fcb)->FileAttributes, FILE_ATTRIBUTE_DIRECTORY) ||
+        FlagOn((*Fcb)->Flags, FCB_PCAPNG_STREAM | FCB_ARINC_STREAM))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//
+// First packet at or after Offset
+//
+static ULONG
+FsdFindChannelPacket (
+    IN PFSD_PACKET_TABLE    Table,
+    IN ULONGLONG            Offset
+    )
+{
+    ULONG   Low = 0;
+    ULONG   High = Table->Count;
+    ULONG   Middle;
+
+    PAGED_CODE();
+
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (Table->Packets[Middle].Offset < Offset)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    return Low;
+}
+
+NTSTATUS
+FsdReadChannels (
+    IN PFSD_IRP_CONTEXT IrpContext
+    )
+{
+    PIRP                Irp;
+    PIO_STACK_LOCATION  IrpSp;
+    PFSD_VCB            Vcb;
+    PFSD_FCB            Fcb;
+    PFSD_PACKET_TABLE   Table;
+    PFSD_PACKET_ENTRY   Entry;
+    PFSD_CHANNEL_READ   Query;
+    PFSD_CHANNEL_DATA   Output;
+    PFSD_READ_EXTENT    Extents = NULL;
+    PFSD_READ_EXTENT    Extent;
+    PUCHAR              Stage = NULL;
+    PMDL                StageMdl = NULL;
+    PULONG              BitmapBuffer = NULL;
+    RTL_BITMAP          Channels;
+    struct ch10_packet_header* Header;
+    ULONGLONG           SectorMask;
+    ULONGLONG           Start;
+    ULONGLONG           End;
+    ULONG               InputLength;
+    ULONG               Space;
+    ULONG               MaximumExtents;
+    ULONG               ExtentCount;
+    ULONG               Staged;
+    ULONG               Copied;
+    ULONG               First;
+    ULONG               Packet = 0;
+    ULONG               i;
+    BOOLEAN             Full = FALSE;
+    NTSTATUS            Status = STATUS_UNSUCCESSFUL;
+
+    PAGED_CODE();
+
+    __try
+    {
+        ASSERT(IrpContext != NULL);
+
+        ASSERT((IrpContext->Identifier.Type == ICX) &&
+               (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+        Irp = IrpContext->Irp;
+
+        IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+        Irp->IoStatus.Information = 0;
+
+        Status = FsdGetChannelFcb(IrpContext, &Vcb, &Fcb);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        Query = (PFSD_CHANNEL_READ) Irp->AssociatedIrp.SystemBuffer;
+        InputLength = IrpSp->Parameters.FileSystemControl.InputBufferLength;
+
+        if (InputLength < FIELD_OFFSET(FSD_CHANNEL_READ, Channels) ||
+            Query->ChannelCount == 0 ||
+            Query->ChannelCount > (InputLength - FIELD_OFFSET(FSD_CHANNEL_READ, Channels)) / sizeof(USHORT))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            __leave;
+        }
+
+        if (Irp->MdlAddress == NULL ||
+            IrpSp->Parameters.FileSystemControl.OutputBufferLength < FIELD_OFFSET(FSD_CHANNEL_DATA, Data))
+        {
+            Status = STATUS_BUFFER_TOO_SMALL;
+            __leave;
+        }
+
+        //
+        // Building the table may read the whole recording, a caller that
+        // did not open it for synchronous I/O does not wait for that
+        //
+        if (Fcb->PacketTable == NULL &&
+            !IrpContext->IsPosted &&
+            !IoIsOperationSynchronous(Irp))
+        {
+            Status = STATUS_PENDING;
+            __leave;
+        }
+
+        Output = (PFSD_CHANNEL_DATA) FsdGetUserBuffer(Irp);
+
+        if (Output == NULL)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        Status = FsdGetPacketTable(Vcb, Fcb, &Table);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        BitmapBuffer = (PULONG) FsdAllocatePool(PagedPool, 65536 / 8, 'bCcR');
+
+        MaximumExtents = FSD_CHANNEL_READ_STAGE / Vcb->BytesPerSector;
+
+        Extents = (PFSD_READ_EXTENT) FsdAllocatePool(
+            PagedPool,
+            MaximumExtents * sizeof(FSD_READ_EXTENT),
+            'eCcR'
+            );
+
+        //
+        // The sectors of one round of reads, a packet never spans more
+        //
+        Stage = (PUCHAR) FsdAllocatePool(
+            NonPagedPoolCacheAligned,
+            FSD_CHANNEL_READ_STAGE,
+            'sCcR'
+            );
+
+        StageMdl = Stage ? IoAllocateMdl(Stage, FSD_CHANNEL_READ_STAGE, FALSE, FALSE, NULL) : NULL;
+
+        if (!BitmapBuffer || !Extents || !StageMdl)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        MmBuildMdlForNonPagedPool(StageMdl);
+
+        RtlInitializeBitMap(&Channels, BitmapBuffer, 65536);
+        RtlClearAllBits(&Channels);
+
+        for (i = 0; i < Query->ChannelCount; i++)
+        {
+            RtlSetBits(&Channels, Query->Channels[i], 1);
+        }
+
+        Space = IrpSp->Parameters.FileSystemControl.OutputBufferLength - FIELD_OFFSET(FSD_CHANNEL_DATA, Data);
+        SectorMask = Vcb->BytesPerSector - 1;
+
+        Packet = FsdFindChannelPacket(Table, Query->Offset);
+
+        RtlZeroMemory(Output, FIELD_OFFSET(FSD_CHANNEL_DATA, Data));
+
+        while (!Full && Packet < Table->Count)
+        {
+            //
+            // Extents of the device for as many wanted packets as the
+            // stage and the output take
+            //
+            First = Packet;
+            Copied = Output->DataLength;
+            ExtentCount = 0;
+            Staged = 0;
+
+            for (; Packet < Table->Count; Packet++)
+            {
+                Entry = &Table->Packets[Packet];
+
+                if (!RtlCheckBit(&Channels, Entry->ChannelId))
+                {
+                    continue;
+                }
+
+                if (Entry->PacketLength > Space - Output->DataLength)
+                {
+                    Full = TRUE;
+                    break;
+                }
+
+                Start = (Fcb->IndexNumber.QuadPart + Entry->Offset) & ~SectorMask;
+                End = (Fcb->IndexNumber.QuadPart + Entry->Offset + Entry->PacketLength + SectorMask) & ~SectorMask;
+
+                if (End - Start > FSD_CHANNEL_READ_STAGE)
+                {
+                    Status = STATUS_FILE_CORRUPT_ERROR;
+                    __leave;
+                }
+
+                Extent = ExtentCount ? &Extents[ExtentCount - 1] : NULL;
+
+                if (Extent &&
+                    Start <= Extent->Offset + Extent->Length + FSD_CHANNEL_READ_GAP &&
+                    Extent->BufferOffset + (End - Extent->Offset) <= FSD_CHANNEL_READ_STAGE)
+                {
+                    Staged = Extent->BufferOffset + (ULONG) (max(End, Extent->Offset + Extent->Length) - Extent->Offset);
+                    Extent->Length = Staged - Extent->BufferOffset;
+                }
+                else if (ExtentCount < MaximumExtents &&
+                         Staged + (End - Start) <= FSD_CHANNEL_READ_STAGE)
+                {
+                    Extent = &Extents[ExtentCount++];
+
+                    Extent->Offset = Start;
+                    Extent->Length = (ULONG) (End - Start);
+                    Extent->BufferOffset = Staged;
+
+                    Staged += Extent->Length;
+                }
+                else
+                {
+                    break;
+                }
+
+                Output->DataLength += Entry->PacketLength;
+            }
+
+            if (ExtentCount == 0)
+            {
+                break;
+            }
+
+            Status = FsdReadBlockDeviceExtents(
+                Vcb->TargetDeviceObject,
+                StageMdl,
+                Extents,
+                ExtentCount,
+                Vcb->MaximumTransferLength,
+                0
+                );
+
+            if (!NT_SUCCESS(Status))
+            {
+                __leave;
+            }
+
+            Output->ExtentCount += ExtentCount;
+            Output->DeviceBytes += Staged;
+
+            //
+            // The packets planned above are copied out in the same order,
+            // each from the extent holding it
+            //
+            Extent = Extents;
+
+            for (i = First; i < Packet; i++)
+            {
+                Entry = &Table->Packets[i];
+
+                if (!RtlCheckBit(&Channels, Entry->ChannelId))
+                {
+                    continue;
+                }
+
+                Start = Fcb->IndexNumber.QuadPart + Entry->Offset;
+
+                while (Start >= Extent->Offset + Extent->Length)
+                {
+                    Extent++;
+                }
+
+                Header = (struct ch10_packet_header*) (Stage + Extent->BufferOffset + (Start - Extent->Offset));
+
+                //
+                // A sidecar that no longer matches the recording
+                //
+                if (!FsdCheckPacketHeader(Header) ||
+                    le32_to_cpu(Header->packetLength) != Entry->PacketLength)
+                {
+                    Status = STATUS_FILE_CORRUPT_ERROR;
+                    __leave;
+                }
+
+                RtlCopyMemory(Output->Data + Copied, Header, Entry->PacketLength);
+
+                Copied += Entry->PacketLength;
+                Output->PacketCount++;
+            }
+        }
+
+        Output->NextOffset = Packet < Table->Count ?
+            Table->Packets[Packet].Offset : Fcb->CommonFCBHeader.FileSize.QuadPart;
+
+        Irp->IoStatus.Information = FIELD_OFFSET(FSD_CHANNEL_DATA, Data) + Output->DataLength;
+
+        if (Packet < Table->Count)
+        {
+            Status = Output->PacketCount ? STATUS_BUFFER_OVERFLOW : STATUS_BUFFER_TOO_SMALL;
+        }
+        else
+        {
+            Status = STATUS_SUCCESS;
+        }
+    }
+    __finally
+    {
+        if (StageMdl)
+        {
+            IoFreeMdl(StageMdl);
+        }
+
+        if (Stage)
+        {
+            FsdFreePool(Stage);
+        }
+
+        if (Extents)
+        {
+            FsdFreePool(Extents);
+        }
+
+        if (BitmapBuffer)
+        {
+            FsdFreePool(BitmapBuffer);
+        }
+
+        if (!AbnormalTermination())
+        {
+            if (Status == STATUS_PENDING)
+            {
+                Status = FsdQueueRequest(IrpContext);
+            }
+            else
+            {
+                IrpContext->Irp->IoStatus.Status = Status;
+
+                FsdCompleteRequest(IrpContext->Irp, IO_NO_INCREMENT);
+
+                FsdFreeIrpContext(IrpContext);
+            }
+        }
+    }
+
+    return Status;
+}
+
+#pragma code_seg() // end FSD_PAGED_CODE
@@ -118,12 +118,15 @@ FsdClose (
             FcbResourceAcquired = TRUE;
         }
 
+        //
+        // The file object a recording is cached through for its streams
+        // has no CCB
+        //
         Ccb = (PFSD_CCB) FileObject->FsContext2;
 
-        ASSERT(Ccb != NULL);
-
-        ASSERT((Ccb->Identifier.Type == CCB) &&
-               (Ccb->Identifier.Size == sizeof(FSD_CCB)));
+        ASSERT(Ccb == NULL ||
+               ((Ccb->Identifier.Type == CCB) &&
+                (Ccb->Identifier.Size == sizeof(FSD_CCB))));
 
         Fcb->ReferenceCount--;
 
@@ -141,7 +144,10 @@ FsdClose (
             Fcb->AnsiFileName.Buffer
             ));
 
-        FsdFreeCcb(Ccb);
+        if (Ccb)
+        {
+            FsdFreeCcb(Ccb);
+        }
 
         if (!Fcb->ReferenceCount)
         {
@@ -243,53 +249,21 @@ FsdQueueCloseRequest (
     // IsSynchronous means we can block (so we don't requeue it)
     IrpContext->IsSynchronous = TRUE;
 
-#if (VER_PRODUCTBUILD >= 2195)
-
-    IrpContext->WorkQueueItem = IoAllocateWorkItem(IrpContext->DeviceObject);
-
-    IoQueueWorkItem(
-        IrpContext->WorkQueueItem,
-        FsdDeQueueCloseRequest,
-        CriticalWorkQueue,
-        IrpContext
-        );
-
-#else
-
-    ExInitializeWorkItem(
-        &IrpContext->WorkQueueItem,
-        FsdDeQueueCloseRequest,
-        IrpContext
-        );
-
-    ExQueueWorkItem(&IrpContext->WorkQueueItem, CriticalWorkQueue);
-
-#endif
+    FsdQueueWork(IrpContext, TRUE);
 }
 
 VOID
 FsdDeQueueCloseRequest (
-#if (VER_PRODUCTBUILD >= 2195)
-    IN PDEVICE_OBJECT   DeviceObject,
-#endif
-    IN PVOID            Context
+    IN PFSD_IRP_CONTEXT IrpContext
     )
 {
-    PFSD_IRP_CONTEXT IrpContext;
-
 	PAGED_CODE();
 
-    IrpContext = (PFSD_IRP_CONTEXT) Context;
-
     ASSERT(IrpContext);
 
     ASSERT((IrpContext->Identifier.Type == ICX) &&
            (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
 
-#if (VER_PRODUCTBUILD >= 2195)
-    IoFreeWorkItem(IrpContext->WorkQueueItem);
-#endif
-
     __try
     {
         __try
@@ -26,11 +26,21 @@ FsdAcquireForLazyWrite (
     IN BOOLEAN  Wait
     )
 {
+#ifdef FSD_RO
+
     //
     // On a readonly filesystem this function still has to exist but it
-    // doesn't need to do anything.
+    // doesn't need to do anything, write behind is disabled on every
+    // cache map so the lazy writer has nothing to write.
     //
 
+    UNREFERENCED_PARAMETER(Context);
+    UNREFERENCED_PARAMETER(Wait);
+
+    return TRUE;
+
+#else
+
     PFSD_FCB Fcb;
 
     Fcb = (PFSD_FCB) Context;
@@ -47,19 +57,12 @@ FsdAcquireForLazyWrite (
         Fcb->AnsiFileName.Buffer
         ));
 
-#ifdef FSD_RO
-
-    return TRUE;
-
-#else
-
     return ExAcquireResourceExclusiveLite(
         &Fcb->MainResource,
         Wait
         );
 
 #endif
-
 }
 
 VOID
@@ -67,10 +70,11 @@ FsdReleaseFromLazyWrite (
     IN PVOID Context
     )
 {
-    //
-    // On a readonly filesystem this function still has to exist but it
-    // doesn't need to do anything.
-    //
+#ifdef FSD_RO
+
+    UNREFERENCED_PARAMETER(Context);
+
+#else
 
     PFSD_FCB Fcb;
 
@@ -88,15 +92,12 @@ FsdReleaseFromLazyWrite (
         Fcb->AnsiFileName.Buffer
         ));
 
-#ifndef FSD_RO
-
     ExReleaseResourceForThreadLite(
         &Fcb->MainResource,
         ExGetCurrentResourceThread()
         );
 
 #endif
-
 }
 
 BOOLEAN
@@ -157,3 +158,125 @@ FsdReleaseFromReadAhead (
 
 	//KeLeaveCriticalRegion();
 }
+
+//
+// The cache map of a volume that is never written: no pin access, write
+// behind disabled and read ahead sized from how the file was opened. The
+// read ahead granularity belongs to the file object, the attributes to the
+// shared cache map of the file.
+//
+VOID
+FsdInitializeCacheMap (
+    IN PFILE_OBJECT FileObject,
+    IN PFSD_FCB     Fcb
+    )
+{
+    ULONG Granularity;
+
+    ASSERT(Fcb != NULL);
+
+    ASSERT((Fcb->Identifier.Type == FCB) &&
+           (Fcb->Identifier.Size == sizeof(FSD_FCB)));
+
+    CcInitializeCacheMap(
+        FileObject,
+        (PCC_FILE_SIZES)(&Fcb->CommonFCBHeader.AllocationSize),
+        FALSE,
+        &FsdGlobalData.CacheManagerCallbacks,
+        Fcb
+        );
+
+    CcSetAdditionalCacheAttributes(FileObject, FALSE, TRUE);
+
+    if (FlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
+    {
+        Granularity = FSD_SEQUENTIAL_READ_AHEAD;
+    }
+    else if (FlagOn(FileObject->Flags, FO_RANDOM_ACCESS))
+    {
+        Granularity = FSD_RANDOM_READ_AHEAD;
+    }
+    else
+    {
+        Granularity = FSD_DEFAULT_READ_AHEAD;
+    }
+
+    CcSetReadAheadGranularity(FileObject, Granularity);
+
+    ExInterlockedAddLargeStatistic(&FsdGlobalData.CacheStatistics.CacheMaps, 1);
+}
+
+VOID
+FsdAddCacheStatistics (
+    IN LARGE_INTEGER    Start,
+    IN ULONG            Length
+    )
+{
+    LARGE_INTEGER Now;
+
+    Now = KeQueryPerformanceCounter(NULL);
+
+    ExInterlockedAddLargeStatistic(&FsdGlobalData.CacheStatistics.Reads, 1);
+
+    ExInterlockedAddLargeStatistic(&FsdGlobalData.CacheStatistics.Bytes, Length);
+
+    ExInterlockedAddLargeStatistic(
+        &FsdGlobalData.CacheStatistics.Ticks,
+        (ULONG) (Now.QuadPart - Start.QuadPart)
+        );
+}
+
+NTSTATUS
+FsdQueryCacheStatistics (
+    IN PFSD_IRP_CONTEXT IrpContext
+    )
+{
+    PIRP                        Irp;
+    PIO_STACK_LOCATION          IrpSp;
+    PFSD_CACHE_STATISTICS       Statistics;
+    NTSTATUS                    Status;
+
+    ASSERT(IrpContext != NULL);
+
+    ASSERT((IrpContext->Identifier.Type == ICX) &&
+           (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+    Irp = IrpContext->Irp;
+
+    IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+    if (IrpSp->Parameters.FileSystemControl.OutputBufferLength <
+        sizeof(FSD_CACHE_STATISTICS))
+    {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        Irp->IoStatus.Information = 0;
+    }
+    else
+    {
+        Statistics = (PFSD_CACHE_STATISTICS) Irp->AssociatedIrp.SystemBuffer;
+
+        *Statistics = FsdGlobalData.CacheStatistics;
+
+        KeQueryPerformanceCounter(&Statistics->Frequency);
+
+        Statistics->TicksPerMB.QuadPart = 0;
+
+        if (Statistics->Bytes.QuadPart >= 1024 * 1024)
+        {
+            Statistics->TicksPerMB.QuadPart =
+                Statistics->Ticks.QuadPart /
+                (Statistics->Bytes.QuadPart / (1024 * 1024));
+        }
+
+        Status = STATUS_SUCCESS;
+        Irp->IoStatus.Information = sizeof(FSD_CACHE_STATISTICS);
+    }
+
+    Irp->IoStatus.Status = Status;
+
+    FsdCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    FsdFreeIrpContext(IrpContext);
+
+    return Status;
+}
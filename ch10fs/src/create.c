@@ -127,6 +127,91 @@ IN PFSD_IRP_CONTEXT IrpContext
 	return STATUS_SUCCESS;
 }
 
+//
+// Gives a new stream FCB the FCB of its recording, allocated here when the
+// recording is not open. The first stream of a recording also gets it a
+// file object of the driver's own, which holds a reference on the FCB of
+// the recording and through which all its streams read it from the cache.
+// The last stream freed lets go of the file object, see FsdFreeFcb.
+//
+static NTSTATUS
+FsdOpenRecording (
+    IN PFSD_VCB         Vcb,
+    IN PFSD_FCB         Fcb,
+    IN ULONG            IndexNumber
+    )
+{
+    UNICODE_STRING          FileName;
+    PFSD_FCB                Recording;
+    struct ch10_dir_entry*  Inode;
+    PFILE_OBJECT            FileObject;
+
+    PAGED_CODE();
+
+    FileName = Fcb->FileName;
+
+    for (FileName.Length = 0;
+         FileName.Length < Fcb->FileName.Length &&
+         FileName.Buffer[FileName.Length / sizeof(WCHAR)] != L':';
+         FileName.Length += sizeof(WCHAR))
+        ;
+
+    FileName.MaximumLength = FileName.Length;
+
+    Recording = FsdLookupFcbByFileName(Vcb, &FileName);
+
+    if (Recording == NULL)
+    {
+        //
+        // The stream FCB still has the directory entry of the recording
+        //
+        Inode = FsdAllocatePool(
+            NonPagedPool,
+            sizeof(struct ch10_dir_entry),
+            '3cFR'
+            );
+
+        if (Inode == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlCopyMemory(Inode, Fcb->ch10_direntry, sizeof(struct ch10_dir_entry));
+
+        Recording = FsdAllocateFcb(Vcb, &FileName, IndexNumber, Inode);
+
+        if (Recording == NULL)
+        {
+            FsdFreePool(Inode);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    if (Recording->StreamFileObject == NULL)
+    {
+        FileObject = IoCreateStreamFileObjectLite(NULL, Vcb->Vpb->RealDevice);
+
+        FileObject->SectionObjectPointer = &Recording->SectionObject;
+        FileObject->FsContext = Recording;
+        FileObject->FsContext2 = NULL;
+        FileObject->Vpb = Vcb->Vpb;
+        FileObject->ReadAccess = TRUE;
+
+        Recording->ReferenceCount++;
+        Vcb->ReferenceCount++;
+
+        Recording->StreamFileObject = FileObject;
+
+        FsdInitializeCacheMap(FileObject, Recording);
+    }
+
+    Recording->StreamCount++;
+
+    Fcb->Recording = Recording;
+
+    return STATUS_SUCCESS;
+}
+
 NTSTATUS
 FsdCreateFile (
 IN PFSD_IRP_CONTEXT IrpContext
@@ -142,6 +227,10 @@ IN PFSD_IRP_CONTEXT IrpContext
 	ULONG               	found_index = 0;
 	struct ch10_dir_entry* 	Inode = NULL;
 	BOOLEAN            	 	VcbResourceAcquired = FALSE;
+	NTSTATUS            	StreamStatus;
+	USHORT              	ChannelId = 0;
+	ULONG               	Filter = 0;
+	ULONG               	StreamType = 0;
 
 	PAGED_CODE();
 	
@@ -170,6 +259,23 @@ IN PFSD_IRP_CONTEXT IrpContext
 		
 		if (!Fcb)
 		{
+			//
+			// <recording>:<channel>.pcapng and
+			// <recording>:<channel>-<bus>-<label>.a429 are the streams there are
+			//
+			StreamStatus = FsdParseStreamName(
+			&IrpSp->FileObject->FileName,
+			&ChannelId,
+			&Filter,
+			&StreamType
+			);
+
+			if (StreamStatus != STATUS_SUCCESS && StreamStatus != STATUS_NOT_FOUND)
+			{
+				Status = StreamStatus;
+				__leave;
+			}
+
 			Inode = FsdAllocatePool(
 			NonPagedPool,
 			sizeof(struct ch10_dir_entry),
@@ -213,6 +319,33 @@ IN PFSD_IRP_CONTEXT IrpContext
 				Status = STATUS_INSUFFICIENT_RESOURCES;
 				__leave;
 			}
+
+			if (StreamStatus == STATUS_SUCCESS)
+			{
+				Status = FsdOpenRecording(Vcb, Fcb, found_index);
+
+				if (NT_SUCCESS(Status))
+				{
+					if (StreamType == FSD_STREAM_ARINC)
+					{
+						Status = FsdOpenArincStream(Vcb, Fcb, ChannelId, Filter);
+					}
+					else
+					{
+						Status = FsdOpenPcapngStream(Vcb, Fcb, ChannelId);
+					}
+				}
+
+				if (!NT_SUCCESS(Status))
+				{
+					//
+					// The FCB owns the directory entry now
+					//
+					FsdFreeFcb(Fcb);
+					Inode = NULL;
+					__leave;
+				}
+			}
 			
 			KdPrint((
 			DRIVER_NAME ": Allocated a new FCB for %s\n",
@@ -347,13 +480,19 @@ IN OUT struct ch10_dir_entry*  	Inode
 	
 	DbgPrint(DRIVER_NAME ": Looking for file %wZ\n", FullFileName);
 	FileName = *FullFileName;
+	InodeFileName.Buffer = NULL;
 
-	//colonIndex = RtlIndexOfCharInUnicodeString(&FileName, ':');
-	//if(colonIndex > 0) {
-	////	DbgPrint(DRIVER_NAME ": Setting colon index to %d\n", colonIndex);
-	//	FileName.Length = colonIndex * 2;
-	//	DbgPrint(DRIVER_NAME ": filname string is now %wZ\n", &FileName);
-	//}
+	//
+	// A stream is looked up by the name of its recording
+	//
+	for (colonIndex = 0; colonIndex < FileName.Length / sizeof(WCHAR); colonIndex++)
+	{
+		if (FileName.Buffer[colonIndex] == L':')
+		{
+			FileName.Length = (USHORT) (colonIndex * sizeof(WCHAR));
+			break;
+		}
+	}
 
     FileName.Buffer++;
     FileName.Length -= sizeof(WCHAR);
@@ -384,6 +523,28 @@ IN OUT struct ch10_dir_entry*  	Inode
 	
 	__try
 	{
+		//
+		// The sidecar name table answers for any name it can, found or not
+		//
+		Status = FsdIndexLookupFileName(Vcb, &FileName, Index);
+
+		if (Status == STATUS_SUCCESS)
+		{
+			RtlCopyMemory(
+				Inode,
+				GetDirEntryAtIndex(Vcb->dirblocks, *Index),
+				sizeof(struct ch10_dir_entry)
+			);
+			__leave;
+		}
+
+		if (Status == STATUS_OBJECT_NAME_NOT_FOUND)
+		{
+			*Index = 0;
+			Status = STATUS_NO_SUCH_FILE;
+			__leave;
+		}
+
 		FileCount = FsdCh10GetFileCount(Vcb->dirblocks);
 		
 		//DbgPrint(DRIVER_NAME ": File Count %u\n", FileCount);
@@ -473,7 +473,7 @@ IN PFSD_IRP_CONTEXT IrpContext
 
 						Buffer->EndOfFile.QuadPart = be64_to_cpu(CurrentDirEntry->size);
 
-						Buffer->AllocationSize.QuadPart = be64_to_cpu(CurrentDirEntry->size);
+						Buffer->AllocationSize.QuadPart = FsdGetAllocatedLength(Vcb, CurrentDirEntry);
 
 						Buffer->FileAttributes = FILE_ATTRIBUTE_NORMAL;
 
@@ -482,6 +482,11 @@ IN PFSD_IRP_CONTEXT IrpContext
 						FILE_ATTRIBUTE_READONLY
 						);
 
+						if (Buffer->AllocationSize.QuadPart < Buffer->EndOfFile.QuadPart)
+						{
+							SetFlag(Buffer->FileAttributes, FILE_ATTRIBUTE_SPARSE_FILE);
+						}
+
 						Buffer->FileNameLength = sizeof(WCHAR) * ch10fs_strnlen(CurrentDirEntry->name, CH10_MAXFN);
 						
 						FsdCharToWchar(
@@ -536,7 +541,7 @@ IN PFSD_IRP_CONTEXT IrpContext
 
 						Buffer->EndOfFile.QuadPart = be64_to_cpu(CurrentDirEntry->size);
 
-						Buffer->AllocationSize.QuadPart = be64_to_cpu(CurrentDirEntry->size);
+						Buffer->AllocationSize.QuadPart = FsdGetAllocatedLength(Vcb, CurrentDirEntry);
 
 						Buffer->FileAttributes = FILE_ATTRIBUTE_NORMAL;
 
@@ -545,6 +550,11 @@ IN PFSD_IRP_CONTEXT IrpContext
 						FILE_ATTRIBUTE_READONLY
 						);
 
+						if (Buffer->AllocationSize.QuadPart < Buffer->EndOfFile.QuadPart)
+						{
+							SetFlag(Buffer->FileAttributes, FILE_ATTRIBUTE_SPARSE_FILE);
+						}
+
 						Buffer->EaSize = 0;
 						
 
@@ -599,7 +609,7 @@ IN PFSD_IRP_CONTEXT IrpContext
 
 						Buffer->EndOfFile.QuadPart = be64_to_cpu(CurrentDirEntry->size);
 
-						Buffer->AllocationSize.QuadPart = be64_to_cpu(CurrentDirEntry->size);
+						Buffer->AllocationSize.QuadPart = FsdGetAllocatedLength(Vcb, CurrentDirEntry);
 
 						Buffer->FileAttributes = FILE_ATTRIBUTE_NORMAL;
 
@@ -608,6 +618,11 @@ IN PFSD_IRP_CONTEXT IrpContext
 						FILE_ATTRIBUTE_READONLY
 						);
 
+						if (Buffer->AllocationSize.QuadPart < Buffer->EndOfFile.QuadPart)
+						{
+							SetFlag(Buffer->FileAttributes, FILE_ATTRIBUTE_SPARSE_FILE);
+						}
+
 						Buffer->FileNameLength = 2 * InodeFileNameLength;
 						
 						FsdCharToWchar(
@@ -703,7 +718,7 @@ IN PFSD_IRP_CONTEXT IrpContext
 
 						Buffer->EndOfFile.QuadPart = be64_to_cpu(CurrentDirEntry->size);
 
-						Buffer->AllocationSize.QuadPart = be64_to_cpu(CurrentDirEntry->size);
+						Buffer->AllocationSize.QuadPart = FsdGetAllocatedLength(Vcb, CurrentDirEntry);
 
 						Buffer->FileAttributes = FILE_ATTRIBUTE_NORMAL;
 
@@ -713,6 +728,11 @@ IN PFSD_IRP_CONTEXT IrpContext
 						FILE_ATTRIBUTE_READONLY
 						);
 
+						if (Buffer->AllocationSize.QuadPart < Buffer->EndOfFile.QuadPart)
+						{
+							SetFlag(Buffer->FileAttributes, FILE_ATTRIBUTE_SPARSE_FILE);
+						}
+
 						Buffer->FileNameLength = sizeof(WCHAR) * ch10fs_strnlen(CurrentDirEntry->name, CH10_MAXFN);
 						
 						FsdCharToWchar(
@@ -768,7 +788,7 @@ IN PFSD_IRP_CONTEXT IrpContext
 
 						Buffer->EndOfFile.QuadPart = be64_to_cpu(CurrentDirEntry->size);
 
-						Buffer->AllocationSize.QuadPart = be64_to_cpu(CurrentDirEntry->size);
+						Buffer->AllocationSize.QuadPart = FsdGetAllocatedLength(Vcb, CurrentDirEntry);
 
 						Buffer->FileAttributes = FILE_ATTRIBUTE_NORMAL;
 
@@ -776,6 +796,11 @@ IN PFSD_IRP_CONTEXT IrpContext
 						Buffer->FileAttributes,
 						FILE_ATTRIBUTE_READONLY
 						);
+
+						if (Buffer->AllocationSize.QuadPart < Buffer->EndOfFile.QuadPart)
+						{
+							SetFlag(Buffer->FileAttributes, FILE_ATTRIBUTE_SPARSE_FILE);
+						}
 						
 						Buffer->FileNameLength = 2 * InodeFileNameLength;
 						
@@ -389,6 +389,16 @@ FsdFastIoQueryStandardInfo (
                 Fcb->AnsiFileName.Buffer
                 ));
 
+            //
+            // A stream has no sizes until its view of the recording is
+            // built, which takes the IRP path
+            //
+            if (FlagOn(Fcb->Flags, FCB_STREAM_PENDING))
+            {
+                Status = FALSE;
+                __leave;
+            }
+
             if (!ExAcquireResourceSharedLite(
                     &Fcb->MainResource,
                     Wait
@@ -413,7 +423,7 @@ FsdFastIoQueryStandardInfo (
 */
 
             Buffer->AllocationSize.QuadPart =
-                be64_to_cpu(Fcb->ch10_direntry->size);
+                Fcb->AllocatedLength;
 
             Buffer->EndOfFile.QuadPart =
                 be64_to_cpu(Fcb->ch10_direntry->size);
@@ -967,6 +977,16 @@ FsdFastIoQueryNetworkOpenInfo (
                 Fcb->AnsiFileName.Buffer
                 ));
 
+            //
+            // A stream has no sizes until its view of the recording is
+            // built, which takes the IRP path
+            //
+            if (FlagOn(Fcb->Flags, FCB_STREAM_PENDING))
+            {
+                Status = FALSE;
+                __leave;
+            }
+
             if (!ExAcquireResourceSharedLite(
                     &Fcb->MainResource,
                     Wait
@@ -1001,7 +1021,7 @@ FsdFastIoQueryNetworkOpenInfo (
             Buffer->ChangeTime.QuadPart = 0;
 
             Buffer->AllocationSize.QuadPart =
-                be64_to_cpu(Fcb->ch10_direntry->size);
+                Fcb->AllocatedLength;
 
             Buffer->EndOfFile.QuadPart =
                 be64_to_cpu(Fcb->ch10_direntry->size);
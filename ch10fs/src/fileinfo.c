@@ -71,6 +71,38 @@ FsdQueryInformation (
         ASSERT((Fcb->Identifier.Type == FCB) &&
                (Fcb->Identifier.Size == sizeof(FSD_FCB)));
 
+        Irp = IrpContext->Irp;
+
+        IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+        FileInformationClass = IrpSp->Parameters.QueryFile.FileInformationClass;
+
+        //
+        // The sizes of a stream are known once its view of the recording
+        // is built, on a worker thread
+        //
+        if (FlagOn(Fcb->Flags, FCB_STREAM_PENDING) &&
+            (FileInformationClass == FileStandardInformation ||
+             FileInformationClass == FileAllInformation ||
+             FileInformationClass == FileNetworkOpenInformation))
+        {
+            if (!IrpContext->IsPosted)
+            {
+                Status = STATUS_PENDING;
+                __leave;
+            }
+
+            Status = FsdBuildStream(
+                (PFSD_VCB) DeviceObject->DeviceExtension,
+                Fcb
+                );
+
+            if (!NT_SUCCESS(Status))
+            {
+                __leave;
+            }
+        }
+
 #ifndef FSD_RO
         if (!FlagOn(Fcb->Flags, FCB_PAGE_FILE))
 #endif
@@ -94,12 +126,6 @@ FsdQueryInformation (
         ASSERT((Ccb->Identifier.Type == CCB) &&
                (Ccb->Identifier.Size == sizeof(FSD_CCB)));
 
-        Irp = IrpContext->Irp;
-
-        IrpSp = IoGetCurrentIrpStackLocation(Irp);
-
-        FileInformationClass = IrpSp->Parameters.QueryFile.FileInformationClass;
-
         Length = IrpSp->Parameters.QueryFile.Length;
 
         SystemBuffer = Irp->AssociatedIrp.SystemBuffer;
@@ -168,7 +194,7 @@ FsdQueryInformation (
 */
 
                 Buffer->AllocationSize.QuadPart =
-                    be64_to_cpu(Fcb->ch10_direntry->size);
+                    Fcb->AllocatedLength;
 
                 Buffer->EndOfFile.QuadPart =
                     be64_to_cpu(Fcb->ch10_direntry->size);
@@ -360,7 +386,7 @@ FsdQueryInformation (
                 FileBasicInformation->FileAttributes = Fcb->FileAttributes;
 
                 FileStandardInformation->AllocationSize.QuadPart =
-                    be64_to_cpu(Fcb->ch10_direntry->size);
+                    Fcb->AllocatedLength;
 
                 FileStandardInformation->EndOfFile.QuadPart =
                     be64_to_cpu(Fcb->ch10_direntry->size);
@@ -441,10 +467,10 @@ FsdQueryInformation (
                 Buffer->ChangeTime.QuadPart = 0;
 
                 Buffer->AllocationSize.QuadPart =
-                    be32_to_cpu((__u32)Fcb->ch10_direntry->size);
+                    Fcb->AllocatedLength;
 
                 Buffer->EndOfFile.QuadPart =
-                    be32_to_cpu((__u32)Fcb->ch10_direntry->size);
+                    be64_to_cpu(Fcb->ch10_direntry->size);
 
                 Buffer->FileAttributes = Fcb->FileAttributes;
 
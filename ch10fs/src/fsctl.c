@@ -107,6 +107,38 @@ FsdUserFsRequest (
         Status = FsdIsVolumeMounted(IrpContext);
         break;
 
+    case FSCTL_QUERY_ALLOCATED_RANGES:
+        Status = FsdQueryAllocatedRanges(IrpContext);
+        break;
+
+    case FSCTL_CH10_QUERY_METACACHE_STATISTICS:
+        Status = FsdQueryMetaCacheStatistics(IrpContext);
+        break;
+
+    case FSCTL_CH10_QUERY_WORKER_STATISTICS:
+        Status = FsdQueryWorkerStatistics(IrpContext);
+        break;
+
+    case FSCTL_CH10_QUERY_CACHE_STATISTICS:
+        Status = FsdQueryCacheStatistics(IrpContext);
+        break;
+
+    case FSCTL_CH10_QUERY_TIME:
+        Status = FsdQueryTime(IrpContext);
+        break;
+
+    case FSCTL_CH10_QUERY_TIME_POINTS:
+        Status = FsdQueryTimePoints(IrpContext);
+        break;
+
+    case FSCTL_CH10_QUERY_ARINC:
+        Status = FsdQueryArinc(IrpContext);
+        break;
+
+    case FSCTL_CH10_READ_CHANNELS:
+        Status = FsdReadChannels(IrpContext);
+        break;
+
     default:
         Status = STATUS_INVALID_DEVICE_REQUEST;
         IrpContext->Irp->IoStatus.Status = Status;
@@ -484,6 +516,126 @@ FsdIsVolumeMounted (
 
 #pragma code_seg(FSD_PAGED_CODE)
 
+//
+// Returns the parts of the requested range that are backed by blocks of
+// the volume. A recording is allocated from its start so there is at most
+// one range, the part in front of the hole of a sparse recording. As with
+// NTFS, as many ranges as fit are returned, with STATUS_BUFFER_OVERFLOW
+// when more remain and STATUS_BUFFER_TOO_SMALL when not even one fits.
+//
+NTSTATUS
+FsdQueryAllocatedRanges (
+    IN PFSD_IRP_CONTEXT IrpContext
+    )
+{
+    PIRP                            Irp;
+    PIO_STACK_LOCATION              IrpSp;
+    PFSD_FCB                        Fcb;
+    PFILE_ALLOCATED_RANGE_BUFFER    InputBuffer;
+    PFILE_ALLOCATED_RANGE_BUFFER    OutputBuffer;
+    ULONG                           InputLength;
+    ULONG                           OutputLength;
+    LONGLONG                        Start;
+    LONGLONG                        End;
+    ULONG                           RangeCount;
+    ULONG                           Range;
+    NTSTATUS                        Status = STATUS_UNSUCCESSFUL;
+
+    PAGED_CODE();
+
+    __try
+    {
+        ASSERT(IrpContext != NULL);
+
+        ASSERT((IrpContext->Identifier.Type == ICX) &&
+               (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+        Irp = IrpContext->Irp;
+
+        IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+        Irp->IoStatus.Information = 0;
+
+        Fcb = (PFSD_FCB) IrpContext->FileObject->FsContext;
+
+        if (Fcb == NULL ||
+            Fcb->Identifier.Type != FCB ||
+            FlagOn(Fcb->FileAttributes, FILE_ATTRIBUTE_DIRECTORY))
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            __leave;
+        }
+
+        InputLength = IrpSp->Parameters.FileSystemControl.InputBufferLength;
+        OutputLength = IrpSp->Parameters.FileSystemControl.OutputBufferLength;
+
+        InputBuffer = (PFILE_ALLOCATED_RANGE_BUFFER)
+            IrpSp->Parameters.FileSystemControl.Type3InputBuffer;
+        OutputBuffer = (PFILE_ALLOCATED_RANGE_BUFFER) Irp->UserBuffer;
+
+        if (InputLength < sizeof(FILE_ALLOCATED_RANGE_BUFFER) ||
+            InputBuffer == NULL)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            __leave;
+        }
+
+        if (Irp->RequestorMode != KernelMode)
+        {
+            ProbeForRead(InputBuffer, InputLength, sizeof(ULONG));
+
+            if (OutputLength)
+            {
+                ProbeForWrite(OutputBuffer, OutputLength, sizeof(ULONG));
+            }
+        }
+
+        Start = InputBuffer->FileOffset.QuadPart;
+        End = InputBuffer->Length.QuadPart;
+
+        if (Start < 0 || End < 0 || End > MAXLONGLONG - Start)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            __leave;
+        }
+
+        End = min(Start + End, Fcb->CommonFCBHeader.FileSize.QuadPart);
+        End = min(End, (LONGLONG) Fcb->AllocatedLength);
+
+        RangeCount = Start < End ? 1 : 0;
+
+        Status = STATUS_SUCCESS;
+
+        for (Range = 0; Range < RangeCount; Range++)
+        {
+            if (OutputBuffer == NULL ||
+                OutputLength / sizeof(FILE_ALLOCATED_RANGE_BUFFER) <= Range)
+            {
+                Status = Range ? STATUS_BUFFER_OVERFLOW : STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            OutputBuffer[Range].FileOffset.QuadPart = Start;
+            OutputBuffer[Range].Length.QuadPart = End - Start;
+
+            Irp->IoStatus.Information += sizeof(FILE_ALLOCATED_RANGE_BUFFER);
+        }
+    }
+    __finally
+    {
+        if (!AbnormalTermination())
+        {
+            IrpContext->Irp->IoStatus.Status = Status;
+
+            FsdCompleteRequest(IrpContext->Irp, IO_NO_INCREMENT);
+
+            FsdFreeIrpContext(IrpContext);
+        }
+    }
+
+    return Status;
+}
+
 NTSTATUS
 FsdMountVolume (
     IN PFSD_IRP_CONTEXT IrpContext
@@ -500,8 +652,10 @@ FsdMountVolume (
     BOOLEAN                     VcbResourceInitialized = FALSE;
     BOOLEAN                     NotifySyncInitialized = FALSE;
     USHORT                      VolumeLabelLength;
-    LARGE_INTEGER               Offset;
     ULONG                       IoctlSize;
+    STORAGE_PROPERTY_QUERY      PropertyQuery;
+    STORAGE_ADAPTER_DESCRIPTOR  AdapterDescriptor;
+    struct ch10_dir_block*      RootBlock = NULL;
 
 	PAGED_CODE();
 
@@ -541,7 +695,19 @@ FsdMountVolume (
 
         TargetDeviceObject = IrpSp->Parameters.MountVolume.DeviceObject;
 
-        Status = FsdIsDeviceCh10fs(TargetDeviceObject);
+        RootBlock = FsdAllocatePool(
+            NonPagedPool,
+            sizeof(struct ch10_dir_block),
+            '2ceR'
+            );
+
+        if (!RootBlock)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        Status = FsdIsDeviceCh10fs(TargetDeviceObject, RootBlock);
 
         if (!NT_SUCCESS(Status))
         {
@@ -602,20 +768,24 @@ FsdMountVolume (
 
         Vcb->Flags = 0;
 
-        Offset.QuadPart = CH10_MAGIC_OFFSET;
+        Vcb->WorkQueue = FsdAllocateWorkQueue();
 
-        Status = FsdReadBlockDevice(
-            TargetDeviceObject,
-            &Offset,
-            sizeof(struct ch10_dir_block) * CH10_MAX_DIR_BLOCKS,
-            &Vcb->dirblocks
-            );
-
-        if (!NT_SUCCESS(Status))
+        if (Vcb->WorkQueue == NULL)
         {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
             __leave;
         }
 
+        //
+        // The root directory block was read by the probe, the rest of the
+        // chain is read once the sector size of the device is known
+        //
+        RtlCopyMemory(&Vcb->dirblocks[0], RootBlock, sizeof(struct ch10_dir_block));
+
+        Vcb->BytesPerBlock = be32_to_cpu(RootBlock->bytesPerBlock);
+
+        FsdMetaCacheInsert(Vcb, 1, RootBlock, TRUE);
+
         VolumeLabelLength = (USHORT) strnlen(
             Vcb->dirblocks[0].volName, 32);
 
@@ -674,10 +844,91 @@ FsdMountVolume (
             Status = STATUS_SUCCESS;
         }
 
+        if (Vcb->DiskGeometry.BytesPerSector >= SECTOR_SIZE &&
+            (Vcb->DiskGeometry.BytesPerSector &
+             (Vcb->DiskGeometry.BytesPerSector - 1)) == 0)
+        {
+            Vcb->BytesPerSector = Vcb->DiskGeometry.BytesPerSector;
+        }
+        else
+        {
+            Vcb->BytesPerSector = SECTOR_SIZE;
+        }
+
+        //
+        // Large reads are split at what the adapter takes in one request,
+        // one page is kept for a buffer that does not start on a page
+        //
+        Vcb->MaximumTransferLength = FSD_DEFAULT_TRANSFER_LENGTH;
+
+        RtlZeroMemory(&PropertyQuery, sizeof(STORAGE_PROPERTY_QUERY));
+
+        PropertyQuery.PropertyId = StorageAdapterProperty;
+        PropertyQuery.QueryType = PropertyStandardQuery;
+
+        IoctlSize = sizeof(STORAGE_ADAPTER_DESCRIPTOR);
+
+        if (NT_SUCCESS(FsdBlockDeviceIoControl(
+                TargetDeviceObject,
+                IOCTL_STORAGE_QUERY_PROPERTY,
+                &PropertyQuery,
+                sizeof(STORAGE_PROPERTY_QUERY),
+                &AdapterDescriptor,
+                &IoctlSize
+                )) &&
+            IoctlSize >= FIELD_OFFSET(STORAGE_ADAPTER_DESCRIPTOR, AlignmentMask))
+        {
+            Vcb->MaximumTransferLength = AdapterDescriptor.MaximumTransferLength;
+
+            if (AdapterDescriptor.MaximumPhysicalPages > 1 &&
+                AdapterDescriptor.MaximumPhysicalPages < MAXULONG / PAGE_SIZE)
+            {
+                Vcb->MaximumTransferLength = min(
+                    Vcb->MaximumTransferLength,
+                    (AdapterDescriptor.MaximumPhysicalPages - 1) * PAGE_SIZE
+                    );
+            }
+        }
+
+        Vcb->MaximumTransferLength &= ~(Vcb->BytesPerSector - 1);
+
+        if (Vcb->MaximumTransferLength == 0)
+        {
+            Vcb->MaximumTransferLength = FSD_DEFAULT_TRANSFER_LENGTH;
+        }
+
+        Vcb->DirBlockCount = 1;
+
+        if (be64_to_cpu(RootBlock->forwardLink) != 1)
+        {
+            Status = FsdReadDirBlocks(Vcb);
+
+            if (!NT_SUCCESS(Status))
+            {
+                __leave;
+            }
+        }
+
+        //
+        // Before the sidecar is looked for, its fingerprint covers the
+        // recovered sizes. The first lookup loads it, see FsdGetIndex.
+        //
+        Status = FsdRecoverDirBlocks(Vcb);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
         InsertTailList(&FsdGlobalData.VcbList, &Vcb->Next);
     }
     __finally
     {
+        if (RootBlock)
+        {
+            FsdFreePool(RootBlock);
+        }
+
         if (GlobalDataResourceAcquired)
         {
             ExReleaseResourceForThreadLite(
@@ -699,6 +950,13 @@ FsdMountVolume (
             {
                 ExDeleteResourceLite(&Vcb->MainResource);
                 ExDeleteResourceLite(&Vcb->PagingIoResource);
+
+                FsdMetaCachePurgeVolume(Vcb);
+
+                if (Vcb->WorkQueue)
+                {
+                    FsdDereferenceWorkQueue(Vcb->WorkQueue);
+                }
             }
 
             if (VolumeDeviceObject)
@@ -729,6 +987,263 @@ FsdMountVolume (
     return Status;
 }
 
+//
+// Reads the directory blocks following the root by their forward links.
+// A directory block starts on a block boundary and is no larger than a
+// sector, so it is always within one sector. The chain is usually laid
+// out in consecutive blocks and is read ahead a window at a time. A link
+// off the device or back into the chain, a block without the magic or one
+// that cannot be read ends the chain, and the volume mounts with the
+// blocks before it. Only running out of pool fails.
+//
+NTSTATUS
+FsdReadDirBlocks (
+    IN PFSD_VCB     Vcb
+    )
+{
+    PUCHAR          Window;
+    ULONG           WindowSize;
+    LONGLONG        WindowStart = 0;
+    ULONG           WindowLength = 0;
+    LARGE_INTEGER   Offset;
+    LONGLONG        BlockOffset;
+    ULONGLONG       Block = 1;
+    ULONGLONG       Next;
+    ULONGLONG       Visited[CH10_MAX_DIR_BLOCKS];
+    ULONG           Index;
+    ULONG           Seen;
+    NTSTATUS        Status;
+
+    PAGED_CODE();
+
+    Visited[0] = Block;
+
+    WindowSize = max(FSD_DIR_READ_AHEAD, Vcb->BytesPerSector);
+
+    Window = FsdAllocatePool(NonPagedPoolCacheAligned, WindowSize, '3ceR');
+
+    if (!Window)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    for (Index = 1; Index < CH10_MAX_DIR_BLOCKS; Index++)
+    {
+        Next = be64_to_cpu(Vcb->dirblocks[Index - 1].forwardLink);
+
+        //
+        // The last block in the chain links to itself
+        //
+        if (Next == Block)
+        {
+            break;
+        }
+
+        for (Seen = 0; Seen < Index && Visited[Seen] != Next; Seen++)
+        {
+        }
+
+        if (Seen < Index)
+        {
+            KdPrint((DRIVER_NAME ": FsdReadDirBlocks: Block %I64u links back to %I64u\n", Block, Next));
+            break;
+        }
+
+        Block = Next;
+
+        BlockOffset = Block * Vcb->BytesPerBlock;
+
+        if (Block == 0 ||
+            BlockOffset + sizeof(struct ch10_dir_block) >
+            (ULONGLONG) Vcb->PartitionInformation.PartitionLength.QuadPart)
+        {
+            KdPrint((DRIVER_NAME ": FsdReadDirBlocks: Link to block %I64u is off the device\n", Block));
+            break;
+        }
+
+        if (BlockOffset < WindowStart ||
+            BlockOffset + sizeof(struct ch10_dir_block) > WindowStart + WindowLength)
+        {
+            Offset.QuadPart = BlockOffset & ~((LONGLONG) Vcb->BytesPerSector - 1);
+
+            WindowLength = WindowSize;
+
+            if (Offset.QuadPart + WindowLength >
+                Vcb->PartitionInformation.PartitionLength.QuadPart)
+            {
+                WindowLength = (ULONG) (
+                    Vcb->PartitionInformation.PartitionLength.QuadPart -
+                    Offset.QuadPart + Vcb->BytesPerSector - 1) &
+                    ~(Vcb->BytesPerSector - 1);
+            }
+
+            Status = FsdReadBlockDevice(
+                Vcb->TargetDeviceObject,
+                &Offset,
+                WindowLength,
+                Window
+                );
+
+            if (!NT_SUCCESS(Status))
+            {
+                KdPrint((DRIVER_NAME ": FsdReadDirBlocks: Block %I64u: Status: %#x\n", Block, Status));
+                break;
+            }
+
+            WindowStart = Offset.QuadPart;
+        }
+
+        RtlCopyMemory(
+            &Vcb->dirblocks[Index],
+            Window + (BlockOffset - WindowStart),
+            sizeof(struct ch10_dir_block)
+            );
+
+        if (RtlCompareMemory(
+                Vcb->dirblocks[Index].magicNumAscii,
+                CH10_MAGIC,
+                sizeof(CH10_MAGIC) - 1
+                ) != (sizeof(CH10_MAGIC) - 1))
+        {
+            RtlZeroMemory(&Vcb->dirblocks[Index], sizeof(struct ch10_dir_block));
+            KdPrint((DRIVER_NAME ": FsdReadDirBlocks: Block %I64u is not a directory block\n", Block));
+            break;
+        }
+
+        FsdMetaCacheInsert(Vcb, Block, &Vcb->dirblocks[Index], TRUE);
+
+        Visited[Index] = Block;
+
+        Vcb->DirBlockCount = Index + 1;
+    }
+
+    FsdFreePool(Window);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// A directory block with the shutdown flag set was being written when the
+// recorder stopped, and the size of its last entry cannot be trusted. The
+// size is taken from the packets of the recording instead, bounded by its
+// blocks or, without them, by the next recording. Only the copy in memory
+// changes, the volume is not written. Recovery is best effort: an entry
+// whose packets cannot be read keeps the size in its directory entry, and
+// only running out of pool fails the mount.
+//
+NTSTATUS
+FsdRecoverDirBlocks (
+    IN PFSD_VCB     Vcb
+    )
+{
+    struct ch10_dir_block*  DirBlock;
+    struct ch10_dir_entry*  DirEntry;
+    struct ch10_dir_entry*  Other;
+    ULONGLONG               Block = 1;
+    ULONGLONG               Start;
+    ULONGLONG               NextStart;
+    ULONGLONG               Limit;
+    ULONGLONG               Size;
+    ULONG                   Index;
+    ULONG                   OtherIndex;
+    ULONG                   NumEntries;
+    NTSTATUS                Status;
+
+    PAGED_CODE();
+
+    for (Index = 0; Index < Vcb->DirBlockCount; Index++)
+    {
+        DirBlock = &Vcb->dirblocks[Index];
+        NumEntries = be16_to_cpu(DirBlock->numEntries);
+
+        if (Index)
+        {
+            Block = be64_to_cpu(Vcb->dirblocks[Index - 1].forwardLink);
+        }
+
+        if (!DirBlock->shutdown || NumEntries == 0 || NumEntries > MAX_FILES_PER_DIR)
+        {
+            continue;
+        }
+
+        DirEntry = &DirBlock->dirEntries[NumEntries - 1];
+
+        //
+        // A member of a striped set holds only part of the recording
+        //
+        if (DirEntry->reserved[0] == CH10_STRIPE_TAG)
+        {
+            continue;
+        }
+
+        Start = be64_to_cpu(DirEntry->blockNum) * Vcb->BytesPerBlock;
+        NextStart = Vcb->PartitionInformation.PartitionLength.QuadPart;
+
+        if (Start >= NextStart)
+        {
+            continue;
+        }
+
+        for (OtherIndex = 0; OtherIndex < Vcb->DirBlockCount * MAX_FILES_PER_DIR; OtherIndex++)
+        {
+            if (OtherIndex % MAX_FILES_PER_DIR >=
+                be16_to_cpu(Vcb->dirblocks[OtherIndex / MAX_FILES_PER_DIR].numEntries))
+            {
+                continue;
+            }
+
+            Other = GetDirEntryAtIndex(Vcb->dirblocks, OtherIndex);
+
+            if (be64_to_cpu(Other->blockNum) * Vcb->BytesPerBlock > Start &&
+                be64_to_cpu(Other->blockNum) * Vcb->BytesPerBlock < NextStart)
+            {
+                NextStart = be64_to_cpu(Other->blockNum) * Vcb->BytesPerBlock;
+            }
+        }
+
+        Limit = NextStart - Start;
+
+        if (DirEntry->numBlocks &&
+            be64_to_cpu(DirEntry->numBlocks) < Limit / Vcb->BytesPerBlock)
+        {
+            Limit = be64_to_cpu(DirEntry->numBlocks) * Vcb->BytesPerBlock;
+        }
+
+        Status = FsdFindPacketEnd(Vcb, Start, Limit, &Size);
+
+        if (Status == STATUS_INSUFFICIENT_RESOURCES)
+        {
+            return Status;
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            KdPrint((
+                DRIVER_NAME ": FsdRecoverDirBlocks: Block: %I64u Entry: %u Status: %#x, size kept\n",
+                Block,
+                NumEntries - 1,
+                Status
+                ));
+
+            continue;
+        }
+
+        KdPrint((
+            DRIVER_NAME ": FsdRecoverDirBlocks: Block: %I64u Entry: %u Size: %I64u Recovered: %I64u\n",
+            Block,
+            NumEntries - 1,
+            be64_to_cpu(DirEntry->size),
+            Size
+            ));
+
+        DirEntry->size = cpu_to_be64(Size);
+
+        FsdMetaCacheInsert(Vcb, Block, DirBlock, TRUE);
+    }
+
+    return STATUS_SUCCESS;
+}
+
 #pragma code_seg() // end FSD_PAGED_CODE
 
 NTSTATUS
@@ -779,6 +1294,11 @@ FsdVerifyVolume (
             __leave;
         }
 
+        //
+        // The media may have changed, cached blocks are read again
+        //
+        FsdMetaCachePurgeVolume(Vcb);
+
         Irp = IrpContext->Irp;
 
 		
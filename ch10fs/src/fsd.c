@@ -99,55 +99,25 @@ FsdQueueRequest (
     // IsSynchronous means we can block (so we don't requeue it)
     IrpContext->IsSynchronous = TRUE;
 
-    IoMarkIrpPending(IrpContext->Irp);
-
-#if (VER_PRODUCTBUILD >= 2195)
-
-    IrpContext->WorkQueueItem = IoAllocateWorkItem(IrpContext->DeviceObject);
-
-    IoQueueWorkItem(
-        IrpContext->WorkQueueItem,
-        FsdDeQueueRequest,
-        CriticalWorkQueue,
-        IrpContext
-        );
-
-#else
+    IrpContext->IsPosted = TRUE;
 
-    ExInitializeWorkItem(
-        &IrpContext->WorkQueueItem,
-        FsdDeQueueRequest,
-        IrpContext
-        );
-
-    ExQueueWorkItem(&IrpContext->WorkQueueItem, CriticalWorkQueue);
+    IoMarkIrpPending(IrpContext->Irp);
 
-#endif
+    FsdQueueWork(IrpContext, FALSE);
 
     return STATUS_PENDING;
 }
 
 VOID
 FsdDeQueueRequest (
-#if (VER_PRODUCTBUILD >= 2195)
-    IN PDEVICE_OBJECT   DeviceObject,
-#endif
-    IN PVOID            Context
+    IN PFSD_IRP_CONTEXT IrpContext
     )
 {
-    PFSD_IRP_CONTEXT IrpContext;
-
-    IrpContext = (PFSD_IRP_CONTEXT) Context;
-
     ASSERT(IrpContext);
 
     ASSERT((IrpContext->Identifier.Type == ICX) &&
            (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
 
-#if (VER_PRODUCTBUILD >= 2195)
-    IoFreeWorkItem(IrpContext->WorkQueueItem);
-#endif
-
     __try
     {
         __try
@@ -393,39 +363,28 @@ FsdGetUserBuffer (
 #pragma code_seg(FSD_PAGED_CODE)
 
 
+//
+// Reads the directory block at block BlockNumber of the volume. Directory
+// blocks are read through the metadata cache.
+//
 NTSTATUS
 FsdReadDirBlockByOffset (
-    IN PDEVICE_OBJECT           DeviceObject,
-    IN ULONG                    BlockOffset,
+    IN PFSD_VCB                 Vcb,
+    IN ULONGLONG                BlockNumber,
     IN OUT struct ch10_dir_block*  Inode
     )
 {
-    PUCHAR          Buffer;
-    LARGE_INTEGER   Offset;
     NTSTATUS        Status;
     PDEVICE_OBJECT  DeviceToVerify;
 
-    ASSERT(DeviceObject != NULL);
-    ASSERT(Inode != NULL);
-
-    Buffer = (PUCHAR) FsdAllocatePool(NonPagedPool, 1024, '2mTR');
+    PAGED_CODE();
 
-    if (Buffer == NULL)
-    {
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
-
-    KdPrint((DRIVER_NAME ": FsdReadInodeByIndex: Index: %#x\n", BlockOffset));
+    ASSERT(Vcb != NULL);
+    ASSERT(Inode != NULL);
 
-    // Sector align the offset
-    Offset.QuadPart = BlockOffset * 512;
+    KdPrint((DRIVER_NAME ": FsdReadDirBlockByOffset: Block: %I64u\n", BlockNumber));
 
-    Status = FsdReadBlockDevice(
-        DeviceObject,
-        &Offset,
-        1024,
-        Buffer
-        );
+    Status = FsdMetaCacheRead(Vcb, BlockNumber, Inode);
 
     if (Status == STATUS_VERIFY_REQUIRED)
     {
@@ -437,23 +396,10 @@ FsdReadDirBlockByOffset (
 
         if (NT_SUCCESS(Status))
         {
-            Status = FsdReadBlockDevice(
-                DeviceObject,
-                &Offset,
-                1024,
-                Buffer
-                );
+            Status = FsdMetaCacheRead(Vcb, BlockNumber, Inode);
         }
     }
 
-    RtlCopyMemory(
-        Inode,
-        Buffer,
-        sizeof(struct ch10_dir_block)
-        );
-
-    FsdFreePool(Buffer);
-
     return Status;
 }
 
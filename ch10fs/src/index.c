@@ -0,0 +1,799 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ntifs.h"
+#include "fsd.h"
+#include "ch10_fs.h"
+#include "ch10fs.h"
+#include "border.h"
+
+//
+// Index sidecars are built by ch10index in ch10tools and copied into
+// FSD_INDEX_DIRECTORY under the fingerprint of the volume. A sidecar whose
+// fingerprint matches the directory chain read at mount time replaces the
+// scan of the directory in FsdLookupFileName. Only the NAMES and FILES
+// sections are loaded, the packet and time sections are left on disk and
+// the packets of a recording are read from there when they are wanted.
+//
+
+#pragma code_seg(FSD_PAGED_CODE)
+
+//
+// CRC-32 as in the sidecar, bit by bit since only small sections are
+// checked here
+//
+static ULONG
+FsdCrc32 (
+    IN ULONG    Crc,
+    IN PVOID    Buffer,
+    IN ULONG    Length
+    )
+{
+    PUCHAR  Bytes = (PUCHAR) Buffer;
+    ULONG   Bit;
+
+    Crc = ~Crc;
+
+    while (Length--)
+    {
+        Crc ^= *Bytes++;
+
+        for (Bit = 0; Bit < 8; Bit++)
+        {
+            Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
+        }
+    }
+
+    return ~Crc;
+}
+
+//
+// FNV-1a 64 over the directory blocks in link order, as
+// Ch10VolumeFingerprint in ch10tools
+//
+ULONGLONG
+FsdVolumeFingerprint (
+    IN PFSD_VCB Vcb
+    )
+{
+    PUCHAR      Bytes = (PUCHAR) Vcb->dirblocks;
+    ULONG       Length = Vcb->DirBlockCount * sizeof(struct ch10_dir_block);
+    ULONGLONG   Hash = CH10_FNV64_BASIS;
+
+    PAGED_CODE();
+
+    while (Length--)
+    {
+        Hash ^= *Bytes++;
+        Hash *= CH10_FNV64_PRIME;
+    }
+
+    return Hash;
+}
+
+static NTSTATUS
+FsdReadIndexFile (
+    IN HANDLE       FileHandle,
+    IN ULONGLONG    Offset,
+    IN ULONG        Length,
+    OUT PVOID       Buffer
+    )
+{
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER   ByteOffset;
+    NTSTATUS        Status;
+
+    ByteOffset.QuadPart = Offset;
+
+    Status = ZwReadFile(
+        FileHandle,
+        NULL,
+        NULL,
+        NULL,
+        &IoStatus,
+        Buffer,
+        Length,
+        &ByteOffset,
+        NULL
+        );
+
+    if (NT_SUCCESS(Status) && IoStatus.Information != Length)
+    {
+        Status = STATUS_END_OF_FILE;
+    }
+
+    return Status;
+}
+
+//
+// Opens the sidecar of the volume with this fingerprint for reading
+//
+static NTSTATUS
+FsdOpenIndexFile (
+    IN ULONGLONG    Fingerprint,
+    OUT PHANDLE     FileHandle
+    )
+{
+    WCHAR               NameBuffer[sizeof(FSD_INDEX_DIRECTORY) / sizeof(WCHAR) + 16 + sizeof(CH10_INDEX_SUFFIX)];
+    UNICODE_STRING      FileName;
+    OBJECT_ATTRIBUTES   ObjectAttributes;
+    IO_STATUS_BLOCK     IoStatus;
+    ULONG               Position;
+    ULONG               i;
+
+    PAGED_CODE();
+
+    //
+    // FSD_INDEX_DIRECTORY, the fingerprint in hex and CH10_INDEX_SUFFIX
+    //
+    Position = sizeof(FSD_INDEX_DIRECTORY) / sizeof(WCHAR) - 1;
+
+    RtlCopyMemory(NameBuffer, FSD_INDEX_DIRECTORY, Position * sizeof(WCHAR));
+
+    for (i = 0; i < 16; i++)
+    {
+        NameBuffer[Position++] = L"0123456789abcdef"[(Fingerprint >> (60 - i * 4)) & 0xf];
+    }
+
+    for (i = 0; i < sizeof(CH10_INDEX_SUFFIX); i++)
+    {
+        NameBuffer[Position++] = (WCHAR) CH10_INDEX_SUFFIX[i];
+    }
+
+    RtlInitUnicodeString(&FileName, NameBuffer);
+
+    InitializeObjectAttributes(
+        &ObjectAttributes,
+        &FileName,
+        OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+        NULL,
+        NULL
+        );
+
+    return ZwCreateFile(
+        FileHandle,
+        GENERIC_READ | SYNCHRONIZE,
+        &ObjectAttributes,
+        &IoStatus,
+        NULL,
+        FILE_ATTRIBUTE_NORMAL,
+        FILE_SHARE_READ,
+        FILE_OPEN,
+        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+        NULL,
+        0
+        );
+}
+
+//
+// Checks a section of the sidecar against its size and the record size
+//
+static BOOLEAN
+FsdIsValidIndexSection (
+    IN struct ch10_index_section*   Section,
+    IN ULONGLONG                    FileSize,
+    IN ULONG                        RecordSize
+    )
+{
+    ULONGLONG Offset = le64_to_cpu(Section->offset);
+    ULONGLONG Length = le64_to_cpu(Section->length);
+    ULONGLONG Count = le64_to_cpu(Section->count);
+
+    return (BOOLEAN) (
+        (Offset & (CH10_INDEX_ALIGN - 1)) == 0 &&
+        Offset >= sizeof(struct ch10_index_header) &&
+        Offset <= FileSize &&
+        Length <= FileSize - Offset &&
+        Length <= FSD_INDEX_MAX_SECTION &&
+        Count <= Length &&
+        Length == Count * RecordSize
+        );
+}
+
+//
+// Looks for the sidecar of the volume and loads it into Vcb->Index. The
+// volume works the same without one, so every failure only means the
+// directory is scanned as before.
+//
+NTSTATUS
+FsdLoadIndex (
+    IN PFSD_VCB Vcb
+    )
+{
+    IO_STATUS_BLOCK             IoStatus;
+    FILE_STANDARD_INFORMATION   StandardInformation;
+    HANDLE                      FileHandle = NULL;
+    struct ch10_index_header    Header;
+    struct ch10_index_section*  Names = NULL;
+    struct ch10_index_section*  Files = NULL;
+    struct ch10_index_section*  Packets = NULL;
+    struct ch10_dir_entry*      DirEntry;
+    PFSD_INDEX                  Index = NULL;
+    ULONGLONG                   Fingerprint;
+    ULONGLONG                   FileSize;
+    ULONG                       NamesLength;
+    ULONG                       FilesLength;
+    ULONG                       FileCount;
+    ULONG                       Checksum;
+    ULONG                       Used = 0;
+    ULONG                       Position;
+    ULONG                       i;
+    NTSTATUS                    Status;
+
+    PAGED_CODE();
+
+    Fingerprint = FsdVolumeFingerprint(Vcb);
+
+    __try
+    {
+        Status = FsdOpenIndexFile(Fingerprint, &FileHandle);
+
+        if (!NT_SUCCESS(Status))
+        {
+            FileHandle = NULL;
+            __leave;
+        }
+
+        Status = ZwQueryInformationFile(
+            FileHandle,
+            &IoStatus,
+            &StandardInformation,
+            sizeof(FILE_STANDARD_INFORMATION),
+            FileStandardInformation
+            );
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        FileSize = StandardInformation.EndOfFile.QuadPart;
+
+        Status = FsdReadIndexFile(FileHandle, 0, sizeof(Header), &Header);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        Checksum = le32_to_cpu(Header.headerChecksum);
+        Header.headerChecksum = 0;
+
+        if (RtlCompareMemory(Header.magic, CH10_INDEX_MAGIC, sizeof(CH10_INDEX_MAGIC)) !=
+                sizeof(CH10_INDEX_MAGIC) ||
+            le32_to_cpu(Header.version) != CH10_INDEX_VERSION ||
+            le32_to_cpu(Header.headerSize) != sizeof(Header) ||
+            FsdCrc32(0, &Header, sizeof(Header)) != Checksum ||
+            le64_to_cpu(Header.fileSize) != FileSize ||
+            le32_to_cpu(Header.sectionCount) > CH10_INDEX_MAX_SECTIONS)
+        {
+            Status = STATUS_FILE_CORRUPT_ERROR;
+            __leave;
+        }
+
+        FileCount = le32_to_cpu(Header.fileCount);
+
+        //
+        // A sidecar of another volume, or of this one before it was
+        // written to
+        //
+        if (le64_to_cpu(Header.fingerprint) != Fingerprint ||
+            le32_to_cpu(Header.bytesPerBlock) != Vcb->BytesPerBlock ||
+            FileCount > Vcb->DirBlockCount * MAX_FILES_PER_DIR)
+        {
+            Status = STATUS_FILE_INVALID;
+            __leave;
+        }
+
+        for (i = 0; i < le32_to_cpu(Header.sectionCount); i++)
+        {
+            if (le32_to_cpu(Header.sections[i].type) == CH10_INDEX_NAMES && !Names)
+            {
+                Names = &Header.sections[i];
+            }
+            else if (le32_to_cpu(Header.sections[i].type) == CH10_INDEX_FILES && !Files)
+            {
+                Files = &Header.sections[i];
+            }
+            else if (le32_to_cpu(Header.sections[i].type) == CH10_INDEX_PACKETS && !Packets)
+            {
+                Packets = &Header.sections[i];
+            }
+        }
+
+        //
+        // A power of two number of slots with at least one of them empty,
+        // so a lookup always ends
+        //
+        if (!Names || !Files ||
+            !FsdIsValidIndexSection(Names, FileSize, sizeof(ULONG)) ||
+            !FsdIsValidIndexSection(Files, FileSize, sizeof(struct ch10_index_file)) ||
+            le64_to_cpu(Files->count) != FileCount ||
+            le64_to_cpu(Names->count) <= FileCount ||
+            (le64_to_cpu(Names->count) & (le64_to_cpu(Names->count) - 1)))
+        {
+            Status = STATUS_FILE_CORRUPT_ERROR;
+            __leave;
+        }
+
+        NamesLength = (ULONG) le64_to_cpu(Names->length);
+        FilesLength = (ULONG) le64_to_cpu(Files->length);
+
+        Index = FsdAllocatePool(
+            PagedPool,
+            sizeof(FSD_INDEX) + NamesLength + FilesLength,
+            'xdIR'
+            );
+
+        if (!Index)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        Index->Fingerprint = Fingerprint;
+        Index->NameSlots = (PULONG) (Index + 1);
+        Index->NameMask = (ULONG) le64_to_cpu(Names->count) - 1;
+        Index->Files = (struct ch10_index_file*) ((PUCHAR) Index->NameSlots + NamesLength);
+        Index->FileCount = FileCount;
+
+        //
+        // The packet table is larger than the sections loaded here, it is
+        // only checked against the size of the sidecar. A sidecar without
+        // one still answers lookups.
+        //
+        if (Packets &&
+            (le64_to_cpu(Packets->offset) & (CH10_INDEX_ALIGN - 1)) == 0 &&
+            le64_to_cpu(Packets->offset) >= sizeof(Header) &&
+            le64_to_cpu(Packets->offset) <= FileSize &&
+            le64_to_cpu(Packets->length) <= FileSize - le64_to_cpu(Packets->offset) &&
+            le64_to_cpu(Packets->length) ==
+                le64_to_cpu(Packets->count) * sizeof(struct ch10_index_packet))
+        {
+            Index->PacketsOffset = le64_to_cpu(Packets->offset);
+            Index->PacketCount = le64_to_cpu(Packets->count);
+        }
+        else
+        {
+            Index->PacketsOffset = 0;
+            Index->PacketCount = 0;
+        }
+
+        Status = FsdReadIndexFile(
+            FileHandle,
+            le64_to_cpu(Names->offset),
+            NamesLength,
+            Index->NameSlots
+            );
+
+        if (NT_SUCCESS(Status))
+        {
+            Status = FsdReadIndexFile(
+                FileHandle,
+                le64_to_cpu(Files->offset),
+                FilesLength,
+                Index->Files
+                );
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        if (FsdCrc32(0, Index->NameSlots, NamesLength) != le32_to_cpu(Names->checksum) ||
+            FsdCrc32(0, Index->Files, FilesLength) != le32_to_cpu(Files->checksum))
+        {
+            Status = STATUS_FILE_CORRUPT_ERROR;
+            __leave;
+        }
+
+        for (i = 0; i <= Index->NameMask; i++)
+        {
+            if (le32_to_cpu(Index->NameSlots[i]) > FileCount)
+            {
+                Status = STATUS_FILE_CORRUPT_ERROR;
+                __leave;
+            }
+
+            Used += Index->NameSlots[i] != 0;
+        }
+
+        if (Used > FileCount)
+        {
+            Status = STATUS_FILE_CORRUPT_ERROR;
+            __leave;
+        }
+
+        //
+        // Every record must point at a used directory entry of the same
+        // size
+        //
+        for (i = 0; i < FileCount; i++)
+        {
+            Position = le32_to_cpu(Index->Files[i].dirEntry);
+
+            if (Position >= Vcb->DirBlockCount * MAX_FILES_PER_DIR ||
+                Position % MAX_FILES_PER_DIR >=
+                    be16_to_cpu(Vcb->dirblocks[Position / MAX_FILES_PER_DIR].numEntries))
+            {
+                Status = STATUS_FILE_CORRUPT_ERROR;
+                __leave;
+            }
+
+            DirEntry = GetDirEntryAtIndex(Vcb->dirblocks, Position);
+
+            if (be64_to_cpu(DirEntry->size) != le64_to_cpu(Index->Files[i].size))
+            {
+                Status = STATUS_FILE_CORRUPT_ERROR;
+                __leave;
+            }
+        }
+
+        Vcb->Index = Index;
+        Index = NULL;
+
+        KdPrint((DRIVER_NAME ": Using index %016I64x\n", Fingerprint));
+    }
+    __finally
+    {
+        if (FileHandle)
+        {
+            ZwClose(FileHandle);
+        }
+
+        if (Index)
+        {
+            FsdFreePool(Index);
+        }
+    }
+
+    return Status;
+}
+
+//
+// Returns the sidecar of the volume, loading it on the first call. The
+// mount does not read it, that would hold the global resource across I/O
+// to another file system. Callers that find it still loading, or missing,
+// get NULL and scan the directory as without a sidecar.
+//
+PFSD_INDEX
+FsdGetIndex (
+    IN PFSD_VCB Vcb
+    )
+{
+    PIRP TopLevelIrp;
+
+    PAGED_CODE();
+
+    if (Vcb->IndexState == FSD_INDEX_LOADED)
+    {
+        return Vcb->Index;
+    }
+
+    if (InterlockedCompareExchange(
+            &Vcb->IndexState,
+            FSD_INDEX_LOADING,
+            FSD_INDEX_NOT_LOADED
+            ) != FSD_INDEX_NOT_LOADED)
+    {
+        return NULL;
+    }
+
+    //
+    // The sidecar is opened on another file system, which must not take
+    // the request of this one for its own
+    //
+    TopLevelIrp = IoGetTopLevelIrp();
+
+    IoSetTopLevelIrp(NULL);
+
+    FsdLoadIndex(Vcb);
+
+    IoSetTopLevelIrp(TopLevelIrp);
+
+    InterlockedExchange(&Vcb->IndexState, FSD_INDEX_LOADED);
+
+    return Vcb->Index;
+}
+
+VOID
+FsdFreeIndex (
+    IN PFSD_VCB Vcb
+    )
+{
+    PAGED_CODE();
+
+    if (Vcb->Index)
+    {
+        FsdFreePool(Vcb->Index);
+        Vcb->Index = NULL;
+    }
+}
+
+//
+// ASCII upper case, as toupper in the C locale ch10tools hashes with
+//
+#define FsdIndexUpcase(c) ((c) >= L'a' && (c) <= L'z' ? (c) - (L'a' - L'A') : (c))
+
+//
+// Looks up a name, without the leading backslash, through the name table
+// of the sidecar and returns the position of its directory entry. Returns
+// STATUS_NOT_SUPPORTED when the table cannot answer for the name and the
+// directory has to be scanned.
+//
+NTSTATUS
+FsdIndexLookupFileName (
+    IN PFSD_VCB         Vcb,
+    IN PUNICODE_STRING  FileName,
+    OUT PULONG          Index
+    )
+{
+    PFSD_INDEX                  FsdIndex = FsdGetIndex(Vcb);
+    struct ch10_index_file*     File;
+    struct ch10_dir_entry*      DirEntry;
+    ULONG                       Length = FileName->Length / sizeof(WCHAR);
+    ULONG                       Hash = 2166136261U;
+    ULONG                       Slot;
+    ULONG                       Entry;
+    ULONG                       i;
+
+    PAGED_CODE();
+
+    if (!FsdIndex)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (Length == 0 || Length > CH10_MAXFN)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    //
+    // Outside ASCII the case rules of the hash and of
+    // RtlCompareUnicodeString part
+    //
+    for (i = 0; i < Length; i++)
+    {
+        if (FileName->Buffer[i] == 0 || FileName->Buffer[i] > 0x7f)
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        Hash ^= (UCHAR) FsdIndexUpcase(FileName->Buffer[i]);
+        Hash *= 16777619U;
+    }
+
+    for (Slot = Hash & FsdIndex->NameMask;
+         (Entry = le32_to_cpu(FsdIndex->NameSlots[Slot])) != 0;
+         Slot = (Slot + 1) & FsdIndex->NameMask)
+    {
+        File = &FsdIndex->Files[Entry - 1];
+
+        if (le32_to_cpu(File->nameHash) != Hash)
+        {
+            continue;
+        }
+
+        DirEntry = GetDirEntryAtIndex(Vcb->dirblocks, le32_to_cpu(File->dirEntry));
+
+        if (ch10fs_strnlen(DirEntry->name, CH10_MAXFN) != Length)
+        {
+            continue;
+        }
+
+        for (i = 0; i < Length; i++)
+        {
+            if (FsdIndexUpcase((WCHAR) (UCHAR) DirEntry->name[i]) !=
+                FsdIndexUpcase(FileName->Buffer[i]))
+            {
+                break;
+            }
+        }
+
+        if (i == Length)
+        {
+            *Index = le32_to_cpu(File->dirEntry);
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+//
+// Reads the packets of a recording from the packet table of the sidecar.
+// Returns STATUS_NOT_SUPPORTED when the sidecar has no packets for the
+// recording, and STATUS_FILE_CORRUPT_ERROR when they do not fit it, the
+// caller then scans the recording instead.
+//
+NTSTATUS
+FsdReadIndexPackets (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_PACKET_TABLE*  Table
+    )
+{
+    PFSD_INDEX                  FsdIndex = FsdGetIndex(Vcb);
+    struct ch10_index_file*     File = NULL;
+    struct ch10_index_packet*   Records = NULL;
+    struct ch10_dir_entry*      DirEntry;
+    PFSD_PACKET_TABLE           NewTable = NULL;
+    PFSD_PACKET_ENTRY           Entry;
+    HANDLE                      FileHandle = NULL;
+    ULONGLONG                   FirstPacket;
+    ULONGLONG                   PacketCount;
+    ULONGLONG                   Size;
+    ULONGLONG                   End = 0;
+    ULONG                       Chunk;
+    ULONG                       Done;
+    ULONG                       i;
+    NTSTATUS                    Status;
+
+    PAGED_CODE();
+
+    if (!FsdIndex || FsdIndex->PacketCount == 0)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    for (i = 0; i < FsdIndex->FileCount; i++)
+    {
+        DirEntry = GetDirEntryAtIndex(Vcb->dirblocks, le32_to_cpu(FsdIndex->Files[i].dirEntry));
+
+        if (DirEntry->blockNum == Fcb->ch10_direntry->blockNum &&
+            RtlCompareMemory(DirEntry->name, Fcb->ch10_direntry->name, sizeof(DirEntry->name)) ==
+                sizeof(DirEntry->name))
+        {
+            File = &FsdIndex->Files[i];
+            break;
+        }
+    }
+
+    if (!File)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    FirstPacket = le64_to_cpu(File->firstPacket);
+    PacketCount = le64_to_cpu(File->packetCount);
+    Size = le64_to_cpu(File->size);
+
+    if (FirstPacket > FsdIndex->PacketCount ||
+        PacketCount > FsdIndex->PacketCount - FirstPacket ||
+        PacketCount > MAXLONG / sizeof(FSD_PACKET_ENTRY))
+    {
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    __try
+    {
+        NewTable = (PFSD_PACKET_TABLE) FsdAllocatePool(
+            PagedPool,
+            sizeof(FSD_PACKET_TABLE),
+            'tPcR'
+            );
+
+        Records = (struct ch10_index_packet*) FsdAllocatePool(
+            PagedPool,
+            PAGE_SIZE * sizeof(struct ch10_index_packet),
+            'rPcR'
+            );
+
+        if (!NewTable || !Records)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        RtlZeroMemory(NewTable, sizeof(FSD_PACKET_TABLE));
+
+        NewTable->Count = (ULONG) PacketCount;
+        NewTable->FromIndex = TRUE;
+
+        if (PacketCount)
+        {
+            NewTable->Packets = (PFSD_PACKET_ENTRY) FsdAllocatePool(
+                PagedPool,
+                (ULONG) PacketCount * sizeof(FSD_PACKET_ENTRY),
+                'pPcR'
+                );
+
+            if (!NewTable->Packets)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
+        }
+
+        Status = FsdOpenIndexFile(FsdIndex->Fingerprint, &FileHandle);
+
+        if (!NT_SUCCESS(Status))
+        {
+            FileHandle = NULL;
+            __leave;
+        }
+
+        //
+        // Packets in recording order, each within the recording
+        //
+        for (Done = 0; Done < NewTable->Count; Done += Chunk)
+        {
+            Chunk = min(NewTable->Count - Done, PAGE_SIZE);
+
+            Status = FsdReadIndexFile(
+                FileHandle,
+                FsdIndex->PacketsOffset + (FirstPacket + Done) * sizeof(struct ch10_index_packet),
+                Chunk * sizeof(struct ch10_index_packet),
+                Records
+                );
+
+            if (!NT_SUCCESS(Status))
+            {
+                __leave;
+            }
+
+            for (i = 0; i < Chunk; i++)
+            {
+                Entry = &NewTable->Packets[Done + i];
+
+                Entry->Offset = le64_to_cpu(Records[i].offset);
+                Entry->PacketLength = le32_to_cpu(Records[i].packetLength);
+                Entry->ChannelId = le16_to_cpu(Records[i].channelId);
+                Entry->DataType = Records[i].dataType;
+                Entry->PacketFlags = Records[i].packetFlags;
+
+                if (Entry->Offset < End ||
+                    Entry->PacketLength > CH10_MAX_PACKET_SIZE ||
+                    Entry->Offset + Entry->PacketLength > Size)
+                {
+                    Status = STATUS_FILE_CORRUPT_ERROR;
+                    __leave;
+                }
+
+                End = Entry->Offset + Entry->PacketLength;
+            }
+        }
+
+        *Table = NewTable;
+        NewTable = NULL;
+    }
+    __finally
+    {
+        if (FileHandle)
+        {
+            ZwClose(FileHandle);
+        }
+
+        if (Records)
+        {
+            FsdFreePool(Records);
+        }
+
+        if (NewTable)
+        {
+            FsdFreePacketTable(NewTable);
+        }
+    }
+
+    return Status;
+}
+
+#pragma code_seg() // end FSD_PAGED_CODE
@@ -70,6 +70,10 @@ DriverEntry (
 
     InitializeListHead(&FsdGlobalData.VcbList);
 
+    ExInitializeFastMutex(&FsdGlobalData.ProbeCacheMutex);
+
+    FsdMetaCacheInitialize();
+
     //
     // Initialize the dispatch entry points
     //
@@ -136,6 +140,21 @@ DriverEntry (
         &FsdGlobalData.DeviceObject
         );
 
+    if (NT_SUCCESS(Status))
+    {
+        Status = FsdWorkerPoolInitialize();
+
+        if (!NT_SUCCESS(Status))
+        {
+            IoDeleteDevice(FsdGlobalData.DeviceObject);
+        }
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        FsdMetaCacheUninitialize();
+    }
+
     if (NT_SUCCESS(Status))
     {
         ExInitializeResourceLite(&FsdGlobalData.Resource);
@@ -176,8 +195,12 @@ DriverUnload (
 
     IoDeleteSymbolicLink(&DosDeviceName);
 
+    FsdWorkerPoolUninitialize();
+
     ExDeleteResourceLite(&FsdGlobalData.Resource);
 
+    FsdMetaCacheUninitialize();
+
 #if (VER_PRODUCTBUILD < 2600)
     IoDeleteDevice(FsdGlobalData.DeviceObject);
 #endif
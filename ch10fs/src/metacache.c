@@ -0,0 +1,456 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ntifs.h"
+#include "fsd.h"
+#include "ch10_fs.h"
+#include "border.h"
+
+//
+// A small LRU cache of metadata blocks shared by all volumes. An entry
+// holds the first sizeof(struct ch10_dir_block) bytes of a volume block,
+// which is all of a directory block. Entries are found through a hash on
+// the volume and block number and are evicted from the tail of the LRU
+// list. Pinned entries are never evicted, they are only dropped when their
+// volume is purged.
+//
+
+#pragma code_seg(FSD_INIT_CODE)
+
+VOID
+FsdMetaCacheInitialize (
+    VOID
+    )
+{
+    PFSD_METACACHE  MetaCache = &FsdGlobalData.MetaCache;
+    ULONG           i;
+
+    ExInitializeFastMutex(&MetaCache->Mutex);
+
+    InitializeListHead(&MetaCache->LruList);
+    InitializeListHead(&MetaCache->FreeList);
+
+    for (i = 0; i < FSD_METACACHE_BUCKETS; i++)
+    {
+        InitializeListHead(&MetaCache->HashTable[i]);
+    }
+
+    //
+    // Without memory for the entries every read goes to the device
+    //
+    MetaCache->Entries = (PFSD_METACACHE_ENTRY) FsdAllocatePool(
+        NonPagedPool,
+        sizeof(FSD_METACACHE_ENTRY) * FSD_METACACHE_SIZE,
+        'cMeR'
+        );
+
+    if (!MetaCache->Entries)
+    {
+        return;
+    }
+
+    RtlZeroMemory(
+        MetaCache->Entries,
+        sizeof(FSD_METACACHE_ENTRY) * FSD_METACACHE_SIZE
+        );
+
+    for (i = 0; i < FSD_METACACHE_SIZE; i++)
+    {
+        InsertTailList(&MetaCache->FreeList, &MetaCache->Entries[i].LruLink);
+    }
+
+    MetaCache->Capacity = FSD_METACACHE_SIZE;
+}
+
+#pragma code_seg(FSD_PAGED_CODE)
+
+VOID
+FsdMetaCacheUninitialize (
+    VOID
+    )
+{
+    PFSD_METACACHE MetaCache = &FsdGlobalData.MetaCache;
+
+    PAGED_CODE();
+
+    if (MetaCache->Entries)
+    {
+        FsdFreePool(MetaCache->Entries);
+        MetaCache->Entries = NULL;
+    }
+
+    MetaCache->Capacity = 0;
+}
+
+static ULONG
+FsdMetaCacheHash (
+    IN PFSD_VCB     Vcb,
+    IN ULONGLONG    BlockNumber
+    )
+{
+    ULONG_PTR Key = (ULONG_PTR) Vcb >> 4;
+
+    Key ^= (ULONG_PTR) BlockNumber ^ (ULONG_PTR) (BlockNumber >> 32);
+
+    Key ^= Key >> 8;
+
+    return (ULONG) (Key & (FSD_METACACHE_BUCKETS - 1));
+}
+
+//
+// Must be called with the cache mutex held
+//
+static PFSD_METACACHE_ENTRY
+FsdMetaCacheFind (
+    IN PFSD_VCB     Vcb,
+    IN ULONGLONG    BlockNumber
+    )
+{
+    PFSD_METACACHE          MetaCache = &FsdGlobalData.MetaCache;
+    PLIST_ENTRY             Bucket;
+    PLIST_ENTRY             ListEntry;
+    PFSD_METACACHE_ENTRY    Entry;
+
+    Bucket = &MetaCache->HashTable[FsdMetaCacheHash(Vcb, BlockNumber)];
+
+    for (ListEntry = Bucket->Flink; ListEntry != Bucket; ListEntry = ListEntry->Flink)
+    {
+        Entry = CONTAINING_RECORD(ListEntry, FSD_METACACHE_ENTRY, HashLink);
+
+        if (Entry->Vcb == Vcb && Entry->BlockNumber == BlockNumber)
+        {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Must be called with the cache mutex held
+//
+static VOID
+FsdMetaCacheRemove (
+    IN PFSD_METACACHE_ENTRY Entry
+    )
+{
+    PFSD_METACACHE MetaCache = &FsdGlobalData.MetaCache;
+
+    RemoveEntryList(&Entry->HashLink);
+    RemoveEntryList(&Entry->LruLink);
+
+    if (Entry->Pinned)
+    {
+        MetaCache->PinnedCount--;
+    }
+
+    Entry->Vcb = NULL;
+    Entry->Pinned = FALSE;
+
+    InsertHeadList(&MetaCache->FreeList, &Entry->LruLink);
+
+    MetaCache->Used--;
+}
+
+//
+// Copies a block from the cache to Buffer. Returns FALSE if it is not in
+// the cache.
+//
+BOOLEAN
+FsdMetaCacheLookup (
+    IN PFSD_VCB     Vcb,
+    IN ULONGLONG    BlockNumber,
+    OUT PVOID       Buffer
+    )
+{
+    PFSD_METACACHE          MetaCache = &FsdGlobalData.MetaCache;
+    PFSD_METACACHE_ENTRY    Entry;
+
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&MetaCache->Mutex);
+
+    Entry = FsdMetaCacheFind(Vcb, BlockNumber);
+
+    if (Entry)
+    {
+        RtlCopyMemory(Buffer, Entry->Data, FSD_METACACHE_DATA_SIZE);
+
+        RemoveEntryList(&Entry->LruLink);
+        InsertHeadList(&MetaCache->LruList, &Entry->LruLink);
+
+        MetaCache->Hits++;
+    }
+    else
+    {
+        MetaCache->Misses++;
+    }
+
+    ExReleaseFastMutex(&MetaCache->Mutex);
+
+    return Entry != NULL;
+}
+
+//
+// Adds a block to the cache, or replaces the data of a block already in
+// it. A pinned block stays until its volume is purged, at most half of the
+// cache is pinned and further blocks are added unpinned.
+//
+VOID
+FsdMetaCacheInsert (
+    IN PFSD_VCB     Vcb,
+    IN ULONGLONG    BlockNumber,
+    IN PVOID        Data,
+    IN BOOLEAN      Pinned
+    )
+{
+    PFSD_METACACHE          MetaCache = &FsdGlobalData.MetaCache;
+    PFSD_METACACHE_ENTRY    Entry;
+    PLIST_ENTRY             ListEntry;
+
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&MetaCache->Mutex);
+
+    Entry = FsdMetaCacheFind(Vcb, BlockNumber);
+
+    if (!Entry)
+    {
+        if (!IsListEmpty(&MetaCache->FreeList))
+        {
+            ListEntry = RemoveHeadList(&MetaCache->FreeList);
+
+            Entry = CONTAINING_RECORD(ListEntry, FSD_METACACHE_ENTRY, LruLink);
+        }
+        else
+        {
+            for (ListEntry = MetaCache->LruList.Blink;
+                 ListEntry != &MetaCache->LruList;
+                 ListEntry = ListEntry->Blink)
+            {
+                Entry = CONTAINING_RECORD(ListEntry, FSD_METACACHE_ENTRY, LruLink);
+
+                if (!Entry->Pinned)
+                {
+                    break;
+                }
+            }
+
+            if (ListEntry == &MetaCache->LruList)
+            {
+                ExReleaseFastMutex(&MetaCache->Mutex);
+                return;
+            }
+
+            FsdMetaCacheRemove(Entry);
+
+            RemoveEntryList(&Entry->LruLink);
+
+            MetaCache->Evictions++;
+        }
+
+        Entry->Vcb = Vcb;
+        Entry->BlockNumber = BlockNumber;
+
+        InsertHeadList(
+            &MetaCache->HashTable[FsdMetaCacheHash(Vcb, BlockNumber)],
+            &Entry->HashLink
+            );
+
+        MetaCache->Used++;
+    }
+    else
+    {
+        RemoveEntryList(&Entry->LruLink);
+    }
+
+    InsertHeadList(&MetaCache->LruList, &Entry->LruLink);
+
+    RtlCopyMemory(Entry->Data, Data, FSD_METACACHE_DATA_SIZE);
+
+    if (Pinned && !Entry->Pinned && MetaCache->PinnedCount < MetaCache->Capacity / 2)
+    {
+        Entry->Pinned = TRUE;
+        MetaCache->PinnedCount++;
+    }
+
+    ExReleaseFastMutex(&MetaCache->Mutex);
+}
+
+//
+// Drops all blocks of a volume, pinned or not. Called when the volume goes
+// away and when its media may have changed.
+//
+VOID
+FsdMetaCachePurgeVolume (
+    IN PFSD_VCB     Vcb
+    )
+{
+    PFSD_METACACHE          MetaCache = &FsdGlobalData.MetaCache;
+    PFSD_METACACHE_ENTRY    Entry;
+    PLIST_ENTRY             ListEntry;
+    PLIST_ENTRY             NextListEntry;
+
+    PAGED_CODE();
+
+    ExAcquireFastMutex(&MetaCache->Mutex);
+
+    for (ListEntry = MetaCache->LruList.Flink;
+         ListEntry != &MetaCache->LruList;
+         ListEntry = NextListEntry)
+    {
+        NextListEntry = ListEntry->Flink;
+
+        Entry = CONTAINING_RECORD(ListEntry, FSD_METACACHE_ENTRY, LruLink);
+
+        if (Entry->Vcb == Vcb)
+        {
+            FsdMetaCacheRemove(Entry);
+        }
+    }
+
+    ExReleaseFastMutex(&MetaCache->Mutex);
+}
+
+//
+// Reads the metadata block BlockNumber of a volume through the cache. On a
+// miss the sector holding the block is read from the device and the block
+// is added to the cache.
+//
+NTSTATUS
+FsdMetaCacheRead (
+    IN PFSD_VCB     Vcb,
+    IN ULONGLONG    BlockNumber,
+    OUT PVOID       Buffer
+    )
+{
+    PUCHAR          SectorBuffer;
+    LARGE_INTEGER   Offset;
+    ULONG           Lead;
+    NTSTATUS        Status;
+
+    PAGED_CODE();
+
+    ASSERT(Vcb != NULL);
+    ASSERT(Buffer != NULL);
+
+    if (FsdMetaCacheLookup(Vcb, BlockNumber, Buffer))
+    {
+        return STATUS_SUCCESS;
+    }
+
+    Offset.QuadPart = BlockNumber * Vcb->BytesPerBlock;
+
+    if (Offset.QuadPart + FSD_METACACHE_DATA_SIZE >
+        Vcb->PartitionInformation.PartitionLength.QuadPart)
+    {
+        return STATUS_DISK_CORRUPT_ERROR;
+    }
+
+    Lead = (ULONG) (Offset.QuadPart & (Vcb->BytesPerSector - 1));
+
+    Offset.QuadPart -= Lead;
+
+    SectorBuffer = (PUCHAR) FsdAllocatePool(
+        NonPagedPoolCacheAligned,
+        Vcb->BytesPerSector,
+        'bMeR'
+        );
+
+    if (!SectorBuffer)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Status = FsdReadBlockDevice(
+        Vcb->TargetDeviceObject,
+        &Offset,
+        Vcb->BytesPerSector,
+        SectorBuffer
+        );
+
+    if (NT_SUCCESS(Status))
+    {
+        RtlCopyMemory(Buffer, SectorBuffer + Lead, FSD_METACACHE_DATA_SIZE);
+
+        FsdMetaCacheInsert(Vcb, BlockNumber, Buffer, FALSE);
+    }
+
+    FsdFreePool(SectorBuffer);
+
+    return Status;
+}
+
+NTSTATUS
+FsdQueryMetaCacheStatistics (
+    IN PFSD_IRP_CONTEXT IrpContext
+    )
+{
+    PFSD_METACACHE                  MetaCache = &FsdGlobalData.MetaCache;
+    PIRP                            Irp;
+    PIO_STACK_LOCATION              IrpSp;
+    PFSD_METACACHE_STATISTICS       Statistics;
+    NTSTATUS                        Status;
+
+    PAGED_CODE();
+
+    ASSERT(IrpContext != NULL);
+
+    ASSERT((IrpContext->Identifier.Type == ICX) &&
+           (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+    Irp = IrpContext->Irp;
+
+    IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+    if (IrpSp->Parameters.FileSystemControl.OutputBufferLength <
+        sizeof(FSD_METACACHE_STATISTICS))
+    {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        Irp->IoStatus.Information = 0;
+    }
+    else
+    {
+        Statistics = (PFSD_METACACHE_STATISTICS) Irp->AssociatedIrp.SystemBuffer;
+
+        ExAcquireFastMutex(&MetaCache->Mutex);
+
+        Statistics->Hits = MetaCache->Hits;
+        Statistics->Misses = MetaCache->Misses;
+        Statistics->Evictions = MetaCache->Evictions;
+        Statistics->Capacity = MetaCache->Capacity;
+        Statistics->Used = MetaCache->Used;
+        Statistics->Pinned = MetaCache->PinnedCount;
+
+        ExReleaseFastMutex(&MetaCache->Mutex);
+
+        Status = STATUS_SUCCESS;
+        Irp->IoStatus.Information = sizeof(FSD_METACACHE_STATISTICS);
+    }
+
+    Irp->IoStatus.Status = Status;
+
+    FsdCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    FsdFreeIrpContext(IrpContext);
+
+    return Status;
+}
+
+#pragma code_seg() // end FSD_PAGED_CODE
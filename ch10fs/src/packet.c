@@ -0,0 +1,580 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ntifs.h"
+#include "fsd.h"
+#include "ch10_fs.h"
+#include "border.h"
+
+//
+// Packet level helpers and the streaming scan of a recording that the
+// time correlation is built from
+//
+
+#pragma code_seg(FSD_PAGED_CODE)
+
+static __u16
+FsdHeaderChecksum (
+    IN struct ch10_packet_header*   Header
+    )
+{
+    PUCHAR  Bytes = (PUCHAR) Header;
+    __u16   Sum = 0;
+    ULONG   i;
+
+    PAGED_CODE();
+
+    //
+    // Sum of all 16 bit words of the header except the checksum itself
+    //
+    for (i = 0; i < CH10_PACKET_HEADER_SIZE - 2; i += 2)
+    {
+        Sum += (__u16) (Bytes[i] | (Bytes[i + 1] << 8));
+    }
+
+    return Sum;
+}
+
+__u64
+FsdGetRtc (
+    IN struct ch10_packet_header*   Header
+    )
+{
+    __u64   Rtc = 0;
+    LONG    i;
+
+    PAGED_CODE();
+
+    for (i = 5; i >= 0; i--)
+    {
+        Rtc = (Rtc << 8) | Header->relativeTimeCounter[i];
+    }
+
+    return Rtc;
+}
+
+//
+// Returns TRUE if the header could start a valid packet
+//
+BOOLEAN
+FsdCheckPacketHeader (
+    IN struct ch10_packet_header*   Header
+    )
+{
+    ULONG   PacketLength;
+    ULONG   DataLength;
+    ULONG   Overhead;
+
+    PAGED_CODE();
+
+    if (le16_to_cpu(Header->syncPattern) != CH10_PACKET_SYNC ||
+        le16_to_cpu(Header->headerChecksum) != FsdHeaderChecksum(Header))
+    {
+        return FALSE;
+    }
+
+    PacketLength = le32_to_cpu(Header->packetLength);
+    DataLength = le32_to_cpu(Header->dataLength);
+
+    Overhead = CH10_PACKET_HEADER_SIZE;
+
+    switch (Header->packetFlags & CH10_FLAG_CHECKSUM_MASK)
+    {
+    case CH10_CHECKSUM_8:
+        Overhead += 1;
+        break;
+    case CH10_CHECKSUM_16:
+        Overhead += 2;
+        break;
+    case CH10_CHECKSUM_32:
+        Overhead += 4;
+        break;
+    }
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Overhead += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    return !(PacketLength & (CH10_PACKET_ALIGN - 1) ||
+             PacketLength > CH10_MAX_PACKET_SIZE ||
+             PacketLength < Overhead ||
+             DataLength > PacketLength - Overhead);
+}
+
+//
+// Returns TRUE if the data checksum of a packet whose header passed
+// FsdCheckPacketHeader matches, or the packet has none. The checksum is
+// the last item of the packet and covers the body after any secondary
+// header.
+//
+BOOLEAN
+FsdCheckPacketData (
+    IN struct ch10_packet_header*   Header
+    )
+{
+    PUCHAR  Packet = (PUCHAR) Header;
+    ULONG   PacketLength = le32_to_cpu(Header->packetLength);
+    ULONG   Start = CH10_PACKET_HEADER_SIZE;
+    ULONG   ChecksumSize;
+    ULONG   Stored = 0;
+    ULONG   Sum = 0;
+    ULONG   End;
+    ULONG   i;
+
+    PAGED_CODE();
+
+    switch (Header->packetFlags & CH10_FLAG_CHECKSUM_MASK)
+    {
+    case CH10_CHECKSUM_8:
+        ChecksumSize = 1;
+        break;
+    case CH10_CHECKSUM_16:
+        ChecksumSize = 2;
+        break;
+    case CH10_CHECKSUM_32:
+        ChecksumSize = 4;
+        break;
+    default:
+        return TRUE;
+    }
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Start += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    End = PacketLength - ChecksumSize;
+
+    for (i = 0; i < ChecksumSize; i++)
+    {
+        Stored |= (ULONG) Packet[End + i] << (i * 8);
+    }
+
+    for (i = Start; i + ChecksumSize <= End; i += ChecksumSize)
+    {
+        switch (ChecksumSize)
+        {
+        case 1:
+            Sum += Packet[i];
+            break;
+        case 2:
+            Sum += Packet[i] | (Packet[i + 1] << 8);
+            break;
+        default:
+            Sum += Packet[i] | (Packet[i + 1] << 8) | (Packet[i + 2] << 16) | ((ULONG) Packet[i + 3] << 24);
+            break;
+        }
+    }
+
+    if (ChecksumSize < 4)
+    {
+        Sum &= (1 << (ChecksumSize * 8)) - 1;
+    }
+
+    return Sum == Stored;
+}
+
+//
+// Value of a BCD number, -1 when a digit is not decimal
+//
+static LONG
+FsdDecodeBcd (
+    IN ULONG    Value
+    )
+{
+    LONG        Result = 0;
+    LONG        Scale = 1;
+
+    PAGED_CODE();
+
+    for (; Value; Value >>= 4, Scale *= 10)
+    {
+        if ((Value & 0xf) > 9)
+        {
+            return -1;
+        }
+
+        Result += (LONG) (Value & 0xf) * Scale;
+    }
+
+    return Result;
+}
+
+//
+// Days from 1970-01-01 to a date of the Gregorian calendar
+//
+static ULONGLONG
+FsdDaysFromCivil (
+    IN ULONG    Year,
+    IN ULONG    Month,
+    IN ULONG    Day
+    )
+{
+    ULONG       Era;
+    ULONG       YearOfEra;
+    ULONG       DayOfYear;
+
+    PAGED_CODE();
+
+    Year -= Month <= 2;
+    Era = Year / 400;
+    YearOfEra = Year - Era * 400;
+    DayOfYear = (153 * (Month > 2 ? Month - 3 : Month + 9) + 2) / 5 + Day - 1;
+
+    return (ULONGLONG) Era * 146097 +
+        YearOfEra * 365 + YearOfEra / 4 - YearOfEra / 100 + DayOfYear - 719468;
+}
+
+//
+// Decodes the absolute time a time data format 1 packet carries, in units
+// of the relative time counter, and its channel specific data word. The
+// whole packet must be in memory. Same rules as Ch10DecodeTime of the
+// portable tools.
+//
+NTSTATUS
+FsdDecodeTime (
+    IN struct ch10_packet_header*   Header,
+    OUT PULONGLONG                  Time,
+    OUT PULONG                      Csdw
+    )
+{
+    PUCHAR              Body = (PUCHAR) (Header + 1);
+    ULONG               DataLength = le32_to_cpu(Header->dataLength);
+    struct ch10_time_f1 Data;
+    ULONGLONG           Days;
+    LONG                Hundredths;
+    LONG                Seconds;
+    LONG                Minutes;
+    LONG                Hours;
+    LONG                Day;
+    LONG                Month;
+    LONG                Year;
+
+    PAGED_CODE();
+
+    if (Header->dataType != CH10_DATA_TIME_F1)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    RtlZeroMemory(&Data, sizeof(Data));
+    RtlCopyMemory(&Data, Body, min(DataLength, sizeof(Data)));
+
+    *Csdw = le32_to_cpu(Data.csdw);
+
+    Hundredths = FsdDecodeBcd(le16_to_cpu(Data.msec) & 0xff);
+    Seconds = FsdDecodeBcd((le16_to_cpu(Data.msec) >> 8) & 0x7f);
+    Minutes = FsdDecodeBcd(le16_to_cpu(Data.minHour) & 0x7f);
+    Hours = FsdDecodeBcd((le16_to_cpu(Data.minHour) >> 8) & 0x3f);
+
+    if (DataLength < FIELD_OFFSET(struct ch10_time_f1, reserved) ||
+        Hundredths < 0 || Seconds < 0 || Seconds > 60 ||
+        Minutes < 0 || Minutes > 59 || Hours < 0 || Hours > 23)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (*Csdw & CH10_TIME_CSDW_DMY)
+    {
+        Day = FsdDecodeBcd(le16_to_cpu(Data.day) & 0xff);
+        Month = FsdDecodeBcd((le16_to_cpu(Data.day) >> 8) & 0x1f);
+        Year = FsdDecodeBcd(le16_to_cpu(Data.reserved) & 0x3fff);
+
+        if (DataLength < sizeof(Data) ||
+            Day < 1 || Day > 31 || Month < 1 || Month > 12 || Year < 1970)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        Days = FsdDaysFromCivil((ULONG) Year, (ULONG) Month, (ULONG) Day);
+    }
+    else
+    {
+        Day = FsdDecodeBcd(le16_to_cpu(Data.day) & 0x3ff);
+
+        if (Day < 1 || Day > 366)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        Days = (ULONGLONG) Day - 1;
+    }
+
+    *Time = (((Days * 24 + Hours) * 60 + Minutes) * 60 + Seconds) *
+        CH10_RTC_HZ + (ULONGLONG) Hundredths * (CH10_RTC_HZ / 100);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Walks a recording packet by packet in one streaming pass, FSD_SCAN_WINDOW
+// bytes at a time, and calls Callback for every packet with a valid header.
+// After damage the scan resynchronizes on the next valid header, the bytes
+// in between are added to *Skipped. Only the allocated part of the
+// recording is read, a hole holds no packets. A callback returning an
+// error stops the scan with that status.
+//
+NTSTATUS
+FsdScanPackets (
+    IN PFSD_VCB                     Vcb,
+    IN PFSD_FCB                     Fcb,
+    IN PFSD_PACKET_CALLBACK         Callback,
+    IN PVOID                        Context,
+    OUT PULONGLONG                  Skipped OPTIONAL
+    )
+{
+    struct ch10_packet_header*  Header = NULL;
+    PUCHAR                      Buffer;
+    ULONGLONG                   SectorMask;
+    ULONGLONG                   FileSize;
+    ULONGLONG                   DataEnd;
+    ULONGLONG                   WindowOffset = 0;
+    ULONGLONG                   Lost = 0;
+    LARGE_INTEGER               ReadOffset;
+    ULONG                       ReadLength;
+    ULONG                       WindowLength;
+    ULONG                       Offset;
+    ULONG                       Start;
+    BOOLEAN                     Found;
+    NTSTATUS                    Status = STATUS_SUCCESS;
+
+    PAGED_CODE();
+
+    ASSERT(Vcb != NULL);
+    ASSERT(Fcb != NULL);
+
+    //
+    // Streams are built from the FCB of their recording
+    //
+    ASSERT(!FlagOn(Fcb->Flags, FCB_PCAPNG_STREAM | FCB_ARINC_STREAM));
+
+    SectorMask = Vcb->BytesPerSector - 1;
+
+    FileSize = Fcb->CommonFCBHeader.FileSize.QuadPart;
+    DataEnd = min(FileSize, Fcb->AllocatedLength);
+
+    Buffer = (PUCHAR) FsdAllocatePool(PagedPoolCacheAligned, FSD_SCAN_WINDOW, 'ncSR');
+
+    if (Buffer == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    while (WindowOffset < DataEnd)
+    {
+        //
+        // Reads start on a sector, the window starts in its first sector
+        //
+        ReadOffset.QuadPart = WindowOffset & ~SectorMask;
+        Start = (ULONG) (WindowOffset - ReadOffset.QuadPart);
+
+        ReadLength = (ULONG) min(
+            FSD_SCAN_WINDOW,
+            (DataEnd - ReadOffset.QuadPart + SectorMask) & ~SectorMask
+            );
+
+        Status = FsdReadFileData(
+            Vcb,
+            Fcb->IndexNumber.QuadPart,
+            &ReadOffset,
+            ReadLength,
+            Buffer,
+            NULL,
+            0
+            );
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        WindowLength = (ULONG) min(ReadLength, DataEnd - ReadOffset.QuadPart);
+
+        for (Offset = Start;;)
+        {
+            //
+            // Next header at the packet alignment whose packet is in the
+            // window
+            //
+            for (Found = FALSE;
+                 WindowLength - Offset >= CH10_PACKET_HEADER_SIZE;
+                 Offset += CH10_PACKET_ALIGN, Lost += CH10_PACKET_ALIGN)
+            {
+                Header = (struct ch10_packet_header*) (Buffer + Offset);
+
+                if (Buffer[Offset] == (CH10_PACKET_SYNC & 0xff) &&
+                    Buffer[Offset + 1] == (CH10_PACKET_SYNC >> 8) &&
+                    FsdCheckPacketHeader(Header))
+                {
+                    Found = le32_to_cpu(Header->packetLength) <= WindowLength - Offset;
+                    break;
+                }
+            }
+
+            if (!Found)
+            {
+                break;
+            }
+
+            Status = Callback(Context, ReadOffset.QuadPart + Offset, Header);
+
+            if (!NT_SUCCESS(Status))
+            {
+                FsdFreePool(Buffer);
+                return Status;
+            }
+
+            Offset += le32_to_cpu(Header->packetLength);
+        }
+
+        //
+        // A packet cut by the end of the window is read again at the start
+        // of the next one, unless nothing fit or the recording ends here
+        //
+        if (Offset == Start || ReadOffset.QuadPart + WindowLength >= DataEnd)
+        {
+            Lost += WindowLength - Offset;
+            Offset = WindowLength;
+        }
+
+        WindowOffset = ReadOffset.QuadPart + Offset;
+    }
+
+    FsdFreePool(Buffer);
+
+    if (Skipped)
+    {
+        *Skipped = Lost + (FileSize - DataEnd);
+    }
+
+    return Status;
+}
+
+//
+// Follows the packet lengths of a recording starting at byte Base of the
+// volume for as long as the headers are valid and the packets fit in
+// Limit bytes, and returns where the last one ends. Unlike a scan nothing
+// is resynchronized, and the last packet is also checked to its data
+// checksum as it is the one a recorder stopped writing in the middle of.
+//
+NTSTATUS
+FsdFindPacketEnd (
+    IN PFSD_VCB         Vcb,
+    IN ULONGLONG        Base,
+    IN ULONGLONG        Limit,
+    OUT PULONGLONG      End
+    )
+{
+    struct ch10_packet_header*  Header;
+    PUCHAR                      Buffer;
+    ULONGLONG                   SectorMask;
+    ULONGLONG                   Offset = 0;
+    ULONGLONG                   Previous = MAXULONGLONG;
+    LARGE_INTEGER               ReadOffset;
+    ULONG                       ReadLength;
+    ULONG                       WindowLength = 0;
+    ULONG                       PacketLength;
+    NTSTATUS                    Status = STATUS_SUCCESS;
+
+    PAGED_CODE();
+
+    SectorMask = Vcb->BytesPerSector - 1;
+
+    ReadOffset.QuadPart = 0;
+
+    Buffer = (PUCHAR) FsdAllocatePool(PagedPoolCacheAligned, FSD_SCAN_WINDOW, 'neRR');
+
+    if (Buffer == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    while (Limit - Offset >= CH10_PACKET_HEADER_SIZE)
+    {
+        if (Offset + CH10_PACKET_HEADER_SIZE > (ULONGLONG) ReadOffset.QuadPart + WindowLength)
+        {
+            ReadOffset.QuadPart = Offset & ~SectorMask;
+
+            ReadLength = (ULONG) min(
+                FSD_SCAN_WINDOW,
+                (Limit - ReadOffset.QuadPart + SectorMask) & ~SectorMask
+                );
+
+            Status = FsdReadFileData(Vcb, Base, &ReadOffset, ReadLength, Buffer, NULL, 0);
+
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+
+            WindowLength = (ULONG) min(ReadLength, Limit - ReadOffset.QuadPart);
+        }
+
+        Header = (struct ch10_packet_header*) (Buffer + (Offset - ReadOffset.QuadPart));
+
+        if (!FsdCheckPacketHeader(Header))
+        {
+            break;
+        }
+
+        PacketLength = le32_to_cpu(Header->packetLength);
+
+        if (PacketLength > Limit - Offset)
+        {
+            break;
+        }
+
+        Previous = Offset;
+        Offset += PacketLength;
+    }
+
+    //
+    // The largest packet and a sector on either side fit in the window
+    //
+    if (NT_SUCCESS(Status) && Previous != MAXULONGLONG)
+    {
+        ReadOffset.QuadPart = Previous & ~SectorMask;
+        ReadLength = (ULONG) (((Offset + SectorMask) & ~SectorMask) - ReadOffset.QuadPart);
+
+        Status = FsdReadFileData(Vcb, Base, &ReadOffset, ReadLength, Buffer, NULL, 0);
+
+        if (NT_SUCCESS(Status) &&
+            !FsdCheckPacketData((struct ch10_packet_header*) (Buffer + (Previous - ReadOffset.QuadPart))))
+        {
+            Offset = Previous;
+        }
+    }
+
+    FsdFreePool(Buffer);
+
+    if (NT_SUCCESS(Status))
+    {
+        *End = Offset;
+    }
+
+    return Status;
+}
+
+#pragma code_seg() // end FSD_PAGED_CODE
@@ -0,0 +1,956 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ntifs.h"
+#include "fsd.h"
+#include "ch10_fs.h"
+#include "border.h"
+
+//
+// Ethernet channels of a recording as pcapng captures, the same view
+// Ch10OpenPcapng of the portable tools gives. A stream named
+// <recording>:<channel>.pcapng gets its own FCB whose sizes are those of
+// the capture. The first read of it lists the packets of the channel from
+// the packet table of the recording, the sidecar's when there is one, and
+// the recording keeps the list for all streams of the channel. Reads of
+// the stream generate the section header, the interface description and
+// the framing of every Enhanced Packet Block and copy the frames from the
+// cache of the recording, so a packet spanning several reads of the
+// stream comes from the device once. The Cache Manager caches the capture
+// like any other file.
+//
+
+#define PCAPNG_SECTION_HEADER       0x0A0D0D0A
+#define PCAPNG_INTERFACE            0x00000001
+#define PCAPNG_ENHANCED_PACKET      0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC     0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHERNET    1
+#define PCAPNG_IF_TSRESOL           9
+
+#define PCAPNG_SECTION_HEADER_SIZE  28
+#define PCAPNG_INTERFACE_SIZE       32
+#define PCAPNG_EPB_HEADER_SIZE      28
+#define PCAPNG_EPB_SIZE(Length)     (PCAPNG_EPB_HEADER_SIZE + (((Length) + 3) & ~3) + 4)
+
+//
+// Ethernet format 0 intra-packet header: time stamp and frame length
+//
+#define ETHERNET_IPH_SIZE           12
+#define ETHERNET_LENGTH_MASK        0x3fff
+
+#pragma code_seg(FSD_PAGED_CODE)
+
+static VOID
+FsdPutLe16 (
+    IN PUCHAR   Buffer,
+    IN USHORT   Value
+    )
+{
+    PAGED_CODE();
+
+    Buffer[0] = (UCHAR) Value;
+    Buffer[1] = (UCHAR) (Value >> 8);
+}
+
+static VOID
+FsdPutLe32 (
+    IN PUCHAR   Buffer,
+    IN ULONG    Value
+    )
+{
+    PAGED_CODE();
+
+    FsdPutLe16(Buffer, (USHORT) Value);
+    FsdPutLe16(Buffer + 2, (USHORT) (Value >> 16));
+}
+
+static ULONG
+FsdGetLe32 (
+    IN PUCHAR   Buffer
+    )
+{
+    PAGED_CODE();
+
+    return Buffer[0] | (Buffer[1] << 8) | (Buffer[2] << 16) | ((ULONG) Buffer[3] << 24);
+}
+
+//
+// Finds the stream part of a file name and gives its FSD_STREAM_XXX type.
+// An ARINC-429 label stream has -<bus>-<label> after the channel, the bus
+// in decimal and the label in octal, given in *Filter as bus << 8 | label.
+// Returns STATUS_SUCCESS for the name of a stream, STATUS_NOT_FOUND for a
+// name without a stream and STATUS_OBJECT_NAME_NOT_FOUND for any other
+// stream.
+//
+NTSTATUS
+FsdParseStreamName (
+    IN PUNICODE_STRING  FileName,
+    OUT PUSHORT         ChannelId,
+    OUT PULONG          Filter,
+    OUT PULONG          Type
+    )
+{
+    UNICODE_STRING  Suffix;
+    UNICODE_STRING  Tail;
+    ULONG           Count = FileName->Length / sizeof(WCHAR);
+    ULONG           Colon;
+    ULONG           i;
+    ULONG           Start;
+    ULONG           Channel = 0;
+    ULONG           Bus = 0;
+    ULONG           Label = 0;
+    BOOLEAN         Labelled = FALSE;
+
+    PAGED_CODE();
+
+    for (Colon = 0; Colon < Count && FileName->Buffer[Colon] != L':'; Colon++)
+        ;
+
+    if (Colon == Count)
+    {
+        return STATUS_NOT_FOUND;
+    }
+
+    for (i = Colon + 1; i < Count && FileName->Buffer[i] >= L'0' && FileName->Buffer[i] <= L'9'; i++)
+    {
+        Channel = Channel * 10 + (FileName->Buffer[i] - L'0');
+
+        if (Channel > 0xffff)
+        {
+            return STATUS_OBJECT_NAME_NOT_FOUND;
+        }
+    }
+
+    if (i == Colon + 1)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    if (i < Count && FileName->Buffer[i] == L'-')
+    {
+        for (Start = ++i; i < Count && FileName->Buffer[i] >= L'0' && FileName->Buffer[i] <= L'9'; i++)
+        {
+            Bus = Bus * 10 + (FileName->Buffer[i] - L'0');
+
+            if (Bus > 0xff)
+            {
+                return STATUS_OBJECT_NAME_NOT_FOUND;
+            }
+        }
+
+        if (i == Start || i == Count || FileName->Buffer[i] != L'-')
+        {
+            return STATUS_OBJECT_NAME_NOT_FOUND;
+        }
+
+        for (Start = ++i; i < Count && FileName->Buffer[i] >= L'0' && FileName->Buffer[i] <= L'7'; i++)
+        {
+            Label = Label * 8 + (FileName->Buffer[i] - L'0');
+
+            if (Label > 0xff)
+            {
+                return STATUS_OBJECT_NAME_NOT_FOUND;
+            }
+        }
+
+        if (i == Start)
+        {
+            return STATUS_OBJECT_NAME_NOT_FOUND;
+        }
+
+        Labelled = TRUE;
+    }
+
+    RtlInitUnicodeString(&Suffix, Labelled ? FSD_ARINC_SUFFIX : FSD_PCAPNG_SUFFIX);
+
+    Tail.Buffer = FileName->Buffer + i;
+    Tail.Length = Tail.MaximumLength = (USHORT) ((Count - i) * sizeof(WCHAR));
+
+    if (RtlCompareUnicodeString(&Tail, &Suffix, TRUE))
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    *ChannelId = (USHORT) Channel;
+    *Filter = Bus << 8 | Label;
+    *Type = Labelled ? FSD_STREAM_ARINC : FSD_STREAM_PCAPNG;
+
+    return STATUS_SUCCESS;
+}
+
+//
+// The body of an Ethernet packet and the number of frames its channel
+// specific data word gives
+//
+static PUCHAR
+FsdGetEthernetBody (
+    IN struct ch10_packet_header*   Header,
+    OUT PULONG                      Length,
+    OUT PULONG                      Frames
+    )
+{
+    PUCHAR Body = (PUCHAR) (Header + 1);
+
+    PAGED_CODE();
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    *Length = le32_to_cpu(Header->dataLength);
+    *Frames = *Length < 4 ? 0 : FsdGetLe32(Body) & 0xffff;
+
+    return Body;
+}
+
+//
+// Steps to the next frame of an Ethernet packet body, FALSE when the body
+// holds no further whole frame
+//
+static BOOLEAN
+FsdNextFrame (
+    IN PUCHAR       Body,
+    IN ULONG        Length,
+    IN ULONG        Position,
+    OUT PULONG      FrameLength
+    )
+{
+    PAGED_CODE();
+
+    if (Position > Length || Length - Position < ETHERNET_IPH_SIZE)
+    {
+        return FALSE;
+    }
+
+    *FrameLength = FsdGetLe32(Body + Position + 8) & ETHERNET_LENGTH_MASK;
+
+    return *FrameLength <= Length - Position - ETHERNET_IPH_SIZE;
+}
+
+static NTSTATUS
+FsdAddPcapngPacket (
+    IN PVOID                        Context,
+    IN ULONGLONG                    Offset,
+    IN struct ch10_packet_header*   Header
+    )
+{
+    PFSD_PCAPNG         Pcapng = (PFSD_PCAPNG) Context;
+    PFSD_PCAPNG_PACKET  Packets;
+    PFSD_PCAPNG_PACKET  Packet;
+    PUCHAR              Body;
+    ULONG               Length;
+    ULONG               Frames;
+    ULONG               Frame;
+    ULONG               FrameLength;
+    ULONG               Position = 4;
+    ULONG               Capacity;
+    ULONGLONG           Size = 0;
+
+    PAGED_CODE();
+
+    if (Header->dataType != CH10_DATA_ETHERNET_F0 ||
+        le16_to_cpu(Header->channelId) != Pcapng->ChannelId)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    Body = FsdGetEthernetBody(Header, &Length, &Frames);
+
+    for (Frame = 0;
+         Frame < Frames && FsdNextFrame(Body, Length, Position, &FrameLength);
+         Frame++)
+    {
+        Size += PCAPNG_EPB_SIZE(FrameLength);
+        Position += ETHERNET_IPH_SIZE + ((FrameLength + 1) & ~1);
+    }
+
+    if (Frame == 0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    if (Pcapng->Count == Pcapng->Capacity)
+    {
+        if (Pcapng->Capacity > MAXLONG / sizeof(FSD_PCAPNG_PACKET))
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        Capacity = Pcapng->Capacity ? Pcapng->Capacity * 2 : 256;
+
+        Packets = (PFSD_PCAPNG_PACKET) FsdAllocatePool(
+            PagedPool,
+            Capacity * sizeof(FSD_PCAPNG_PACKET),
+            'pPeR'
+            );
+
+        if (Packets == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if (Pcapng->Packets)
+        {
+            RtlCopyMemory(Packets, Pcapng->Packets, Pcapng->Count * sizeof(FSD_PCAPNG_PACKET));
+            FsdFreePool(Pcapng->Packets);
+        }
+
+        Pcapng->Packets = Packets;
+        Pcapng->Capacity = Capacity;
+    }
+
+    Packet = &Pcapng->Packets[Pcapng->Count++];
+
+    Packet->Offset = Offset;
+    Packet->StreamOffset = Pcapng->Size;
+    Packet->PacketLength = le32_to_cpu(Header->packetLength);
+    Packet->FrameCount = Frame;
+
+    Pcapng->Size += Size;
+    Pcapng->FrameCount += Frame;
+
+    return STATUS_SUCCESS;
+}
+
+//
+// 100 ns units from 1970 to the start of the year a directory entry was
+// created in, given as DDMMYYYY
+//
+ULONGLONG
+FsdGetEpoch (
+    IN struct ch10_dir_entry*   DirEntry
+    )
+{
+    ULONGLONG   Days;
+    ULONG       Year = 0;
+    ULONG       i;
+
+    PAGED_CODE();
+
+    for (i = 4; i < 8; i++)
+    {
+        if (DirEntry->createDate[i] < '0' || DirEntry->createDate[i] > '9')
+        {
+            return 0;
+        }
+
+        Year = Year * 10 + (DirEntry->createDate[i] - '0');
+    }
+
+    if (Year < 1970)
+    {
+        return 0;
+    }
+
+    Days = (ULONGLONG) (Year - 1970) * 365 +
+        (Year - 1969) / 4 - (Year - 1901) / 100 + (Year - 1601) / 400;
+
+    return Days * 86400 * CH10_RTC_HZ;
+}
+
+//
+// Builds the capture of one channel of a recording from its packet table,
+// reading only the packets of the channel through the cache of the
+// recording
+//
+static NTSTATUS
+FsdBuildPcapng (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Recording,
+    IN USHORT               ChannelId,
+    OUT PFSD_PCAPNG*        Result
+    )
+{
+    PFSD_PCAPNG         Pcapng;
+    PFSD_TIME_TABLE     TimeTable;
+    PFSD_PACKET_TABLE   Table;
+    PFSD_PACKET_ENTRY   Entry;
+    PUCHAR              Buffer = NULL;
+    PUCHAR              Header;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    Pcapng = (PFSD_PCAPNG) FsdAllocatePool(PagedPool, sizeof(FSD_PCAPNG), 'cPeR');
+
+    if (Pcapng == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Pcapng, sizeof(FSD_PCAPNG));
+
+    Pcapng->ChannelId = ChannelId;
+    Pcapng->Size = FSD_PCAPNG_HEADER_SIZE;
+
+    //
+    // The time correlation is built first, the recording keeps it
+    //
+    Status = FsdGetTimeTable(Vcb, Recording, &TimeTable);
+
+    if (NT_SUCCESS(Status))
+    {
+        Status = FsdGetPacketTable(Vcb, Recording, &Table);
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        Buffer = (PUCHAR) FsdAllocatePool(PagedPool, CH10_MAX_PACKET_SIZE, 'bPeR');
+
+        if (Buffer == NULL)
+        {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        for (Entry = Table->Packets; Entry < Table->Packets + Table->Count; Entry++)
+        {
+            if (Entry->DataType != CH10_DATA_ETHERNET_F0 || Entry->ChannelId != ChannelId)
+            {
+                continue;
+            }
+
+            if (Entry->PacketLength > CH10_MAX_PACKET_SIZE)
+            {
+                Status = STATUS_FILE_CORRUPT_ERROR;
+                break;
+            }
+
+            Status = FsdReadRecordingCached(Recording, Entry->Offset, Entry->PacketLength, Buffer);
+
+            if (NT_SUCCESS(Status))
+            {
+                Status = FsdAddPcapngPacket(Pcapng, Entry->Offset, (struct ch10_packet_header*) Buffer);
+            }
+
+            if (!NT_SUCCESS(Status))
+            {
+                break;
+            }
+        }
+    }
+
+    if (Buffer)
+    {
+        FsdFreePool(Buffer);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        FsdFreePcapng(Pcapng);
+        return Status;
+    }
+
+    if (TimeTable->Count && !FlagOn(TimeTable->Points[0].Flags, FSD_TIME_YEAR))
+    {
+        Pcapng->Epoch = FsdGetEpoch(Recording->ch10_direntry);
+    }
+
+    //
+    // Section header with an unknown section length, and the one interface
+    // with timestamps in units of 10^-7 seconds
+    //
+    Header = Pcapng->Header;
+
+    FsdPutLe32(Header, PCAPNG_SECTION_HEADER);
+    FsdPutLe32(Header + 4, PCAPNG_SECTION_HEADER_SIZE);
+    FsdPutLe32(Header + 8, PCAPNG_BYTE_ORDER_MAGIC);
+    FsdPutLe16(Header + 12, 1);
+    FsdPutLe16(Header + 14, 0);
+    RtlFillMemory(Header + 16, 8, 0xff);
+    FsdPutLe32(Header + 24, PCAPNG_SECTION_HEADER_SIZE);
+
+    Header += PCAPNG_SECTION_HEADER_SIZE;
+
+    FsdPutLe32(Header, PCAPNG_INTERFACE);
+    FsdPutLe32(Header + 4, PCAPNG_INTERFACE_SIZE);
+    FsdPutLe16(Header + 8, PCAPNG_LINKTYPE_ETHERNET);
+    FsdPutLe16(Header + 16, PCAPNG_IF_TSRESOL);
+    FsdPutLe16(Header + 18, 1);
+    Header[20] = 7;
+    FsdPutLe32(Header + 28, PCAPNG_INTERFACE_SIZE);
+
+    KdPrint((
+        DRIVER_NAME
+        ": FsdBuildPcapng: %wZ Channel: %u Packets: %u Frames: %I64u Size: %I64u\n",
+        &Recording->FileName,
+        ChannelId,
+        Pcapng->Count,
+        Pcapng->FrameCount,
+        Pcapng->Size
+        ));
+
+    *Result = Pcapng;
+
+    return STATUS_SUCCESS;
+}
+
+static PFSD_PCAPNG
+FsdFindPcapng (
+    IN PFSD_PCAPNG          Pcapng,
+    IN USHORT               ChannelId
+    )
+{
+    PAGED_CODE();
+
+    while (Pcapng && Pcapng->ChannelId != ChannelId)
+    {
+        Pcapng = Pcapng->Next;
+    }
+
+    return Pcapng;
+}
+
+//
+// Returns the capture of a channel of a recording, building it on first
+// use. Captures are only ever added to the front of the list of the
+// recording, two callers racing to build one both build it and the first
+// to finish keeps its capture with the FCB.
+//
+static NTSTATUS
+FsdGetPcapng (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Recording,
+    IN USHORT               ChannelId,
+    OUT PFSD_PCAPNG*        Result
+    )
+{
+    PFSD_PCAPNG NewPcapng;
+    PFSD_PCAPNG First;
+    PFSD_PCAPNG Pcapng;
+    NTSTATUS    Status;
+
+    PAGED_CODE();
+
+    Pcapng = FsdFindPcapng(Recording->Captures, ChannelId);
+
+    if (Pcapng == NULL)
+    {
+        Status = FsdBuildPcapng(Vcb, Recording, ChannelId, &NewPcapng);
+
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        do
+        {
+            First = Recording->Captures;
+
+            Pcapng = FsdFindPcapng(First, ChannelId);
+
+            if (Pcapng)
+            {
+                FsdFreePcapng(NewPcapng);
+                break;
+            }
+
+            NewPcapng->Next = First;
+
+        } while (InterlockedCompareExchangePointer(
+                     (PVOID*) &Recording->Captures,
+                     NewPcapng,
+                     First
+                     ) != First);
+
+        if (Pcapng == NULL)
+        {
+            Pcapng = NewPcapng;
+        }
+    }
+
+    *Result = Pcapng;
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Makes a newly allocated stream FCB a pcapng stream of a channel. Nothing
+// is read here, the capture is built on the first read of the stream or
+// the first query of its sizes, see FsdBuildStream.
+//
+NTSTATUS
+FsdOpenPcapngStream (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    IN USHORT               ChannelId
+    )
+{
+    PAGED_CODE();
+
+    ASSERT(Fcb->Pcapng == NULL);
+    ASSERT(Fcb->Recording != NULL);
+
+    Fcb->ChannelId = ChannelId;
+
+    SetFlag(Fcb->Flags, FCB_PCAPNG_STREAM | FCB_STREAM_PENDING);
+    ClearFlag(Fcb->FileAttributes, FILE_ATTRIBUTE_SPARSE_FILE);
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Builds the view of the recording a stream FCB is, off the create path
+// and without the VCB resource, and gives the FCB its sizes. The caller
+// holds no resource of the FCB, and is a worker thread unless it cannot
+// be posted.
+//
+NTSTATUS
+FsdBuildStream (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb
+    )
+{
+    PFSD_PCAPNG         Pcapng = NULL;
+    PFSD_ARINC_STREAM   Arinc = NULL;
+    ULONGLONG           Size;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    ASSERT(FlagOn(Fcb->Flags, FCB_PCAPNG_STREAM | FCB_ARINC_STREAM));
+
+    if (FlagOn(Fcb->Flags, FCB_ARINC_STREAM))
+    {
+        Status = FsdBuildArincStream(Vcb, Fcb->Recording, Fcb->ChannelId, Fcb->Filter, &Arinc);
+    }
+    else
+    {
+        Status = FsdGetPcapng(Vcb, Fcb->Recording, Fcb->ChannelId, &Pcapng);
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    Size = Arinc ? Arinc->Size : Pcapng->Size;
+
+    ExAcquireResourceExclusiveLite(&Fcb->MainResource, TRUE);
+
+    ExAcquireResourceExclusiveLite(&Fcb->PagingIoResource, TRUE);
+
+    //
+    // From here on the FCB describes the stream, which has no holes
+    //
+    if (FlagOn(Fcb->Flags, FCB_STREAM_PENDING))
+    {
+        Fcb->Pcapng = Pcapng;
+        Fcb->Arinc = Arinc;
+        Arinc = NULL;
+
+        Fcb->ch10_direntry->size = cpu_to_be64(Size);
+        Fcb->ch10_direntry->numBlocks = 0;
+
+        Fcb->AllocatedLength = Size;
+        Fcb->CommonFCBHeader.AllocationSize.QuadPart = Size;
+        Fcb->CommonFCBHeader.FileSize.QuadPart = Size;
+        Fcb->CommonFCBHeader.ValidDataLength.QuadPart = Size;
+
+        ClearFlag(Fcb->Flags, FCB_STREAM_PENDING);
+    }
+
+    ExReleaseResourceForThreadLite(
+        &Fcb->PagingIoResource,
+        ExGetCurrentResourceThread()
+        );
+
+    ExReleaseResourceForThreadLite(
+        &Fcb->MainResource,
+        ExGetCurrentResourceThread()
+        );
+
+    //
+    // Another read of the stream got there first
+    //
+    if (Arinc)
+    {
+        FsdFreeArincStream(Arinc);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+FsdFreePcapng (
+    IN PFSD_PCAPNG          Pcapng
+    )
+{
+    PAGED_CODE();
+
+    if (Pcapng->Packets)
+    {
+        FsdFreePool(Pcapng->Packets);
+    }
+
+    FsdFreePool(Pcapng);
+}
+
+//
+// Copies the part of a piece of the capture at Position that falls into
+// the range being read, zeros when Piece is NULL
+//
+static VOID
+FsdCopyPiece (
+    OUT PUCHAR      Buffer,
+    IN ULONGLONG    Offset,
+    IN ULONG        Length,
+    IN ULONGLONG    Position,
+    IN PVOID        Piece,
+    IN ULONG        PieceLength
+    )
+{
+    ULONGLONG Start = max(Position, Offset);
+    ULONGLONG End = min(Position + PieceLength, Offset + Length);
+
+    PAGED_CODE();
+
+    if (Start < End)
+    {
+        if (Piece)
+        {
+            RtlCopyMemory(
+                Buffer + (Start - Offset),
+                (PUCHAR) Piece + (Start - Position),
+                (ULONG) (End - Start)
+                );
+        }
+        else
+        {
+            RtlZeroMemory(Buffer + (Start - Offset), (ULONG) (End - Start));
+        }
+    }
+}
+
+//
+// Generates the blocks of one Ethernet packet that fall into the range
+//
+static VOID
+FsdCopyPacketBlocks (
+    IN PFSD_PCAPNG                  Pcapng,
+    IN PFSD_TIME_TABLE              TimeTable,
+    IN PFSD_PCAPNG_PACKET           Packet,
+    IN struct ch10_packet_header*   Header,
+    OUT PUCHAR                      Buffer,
+    IN ULONGLONG                    Offset,
+    IN ULONG                        Length
+    )
+{
+    UCHAR       Block[PCAPNG_EPB_HEADER_SIZE];
+    UCHAR       Trailer[4];
+    PUCHAR      Body;
+    ULONGLONG   Position = Packet->StreamOffset;
+    ULONGLONG   Rtc;
+    ULONGLONG   Time;
+    ULONG       BodyLength;
+    ULONG       BodyPosition = 4;
+    ULONG       Frames;
+    ULONG       Frame;
+    ULONG       FrameLength;
+    ULONG       Size;
+    ULONG       Number;
+
+    PAGED_CODE();
+
+    Body = FsdGetEthernetBody(Header, &BodyLength, &Frames);
+
+    for (Frame = 0;
+         Frame < Packet->FrameCount && Position < Offset + Length &&
+         FsdNextFrame(Body, BodyLength, BodyPosition, &FrameLength);
+         Frame++)
+    {
+        Size = PCAPNG_EPB_SIZE(FrameLength);
+
+        if (Position + Size > Offset)
+        {
+            //
+            // Intra-packet time stamps are relative time unless the packet
+            // says they are in the secondary header format
+            //
+            if (Header->packetFlags & CH10_FLAG_IPTS_SOURCE)
+            {
+                Rtc = FsdGetRtc(Header);
+            }
+            else
+            {
+                Rtc = FsdGetLe32(Body + BodyPosition) |
+                    ((ULONGLONG) (FsdGetLe32(Body + BodyPosition + 4) & 0xffff) << 32);
+            }
+
+            if (NT_SUCCESS(FsdRtcToTime(TimeTable, Rtc, &Time, &Number)))
+            {
+                Time += Pcapng->Epoch;
+            }
+            else
+            {
+                Time = Rtc;
+            }
+
+            FsdPutLe32(Block, PCAPNG_ENHANCED_PACKET);
+            FsdPutLe32(Block + 4, Size);
+            FsdPutLe32(Block + 8, 0);
+            FsdPutLe32(Block + 12, (ULONG) (Time >> 32));
+            FsdPutLe32(Block + 16, (ULONG) Time);
+            FsdPutLe32(Block + 20, FrameLength);
+            FsdPutLe32(Block + 24, FrameLength);
+            FsdPutLe32(Trailer, Size);
+
+            FsdCopyPiece(Buffer, Offset, Length, Position, Block, sizeof(Block));
+
+            FsdCopyPiece(
+                Buffer,
+                Offset,
+                Length,
+                Position + PCAPNG_EPB_HEADER_SIZE,
+                Body + BodyPosition + ETHERNET_IPH_SIZE,
+                FrameLength
+                );
+
+            FsdCopyPiece(
+                Buffer,
+                Offset,
+                Length,
+                Position + PCAPNG_EPB_HEADER_SIZE + FrameLength,
+                NULL,
+                Size - PCAPNG_EPB_HEADER_SIZE - FrameLength - sizeof(Trailer)
+                );
+
+            FsdCopyPiece(Buffer, Offset, Length, Position + Size - sizeof(Trailer), Trailer, sizeof(Trailer));
+        }
+
+        Position += Size;
+        BodyPosition += ETHERNET_IPH_SIZE + ((FrameLength + 1) & ~1);
+    }
+}
+
+//
+// Fills Buffer with Length bytes of the capture at Offset, the caller has
+// clipped the range to the capture. The packets come from the cache of the
+// recording, one at a time into the packet buffer of the stream.
+//
+NTSTATUS
+FsdReadPcapng (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    IN ULONGLONG            Offset,
+    IN ULONG                Length,
+    OUT PUCHAR              Buffer
+    )
+{
+    PFSD_PCAPNG         Pcapng = Fcb->Pcapng;
+    PFSD_PCAPNG_PACKET  Packet;
+    PFSD_TIME_TABLE     TimeTable;
+    ULONG               Low = 0;
+    ULONG               High = Pcapng->Count;
+    ULONG               Middle;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    ASSERT(FlagOn(Fcb->Flags, FCB_PCAPNG_STREAM));
+    ASSERT(Offset + Length <= Pcapng->Size);
+
+    Status = FsdGetTimeTable(Vcb, Fcb->Recording, &TimeTable);
+
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    FsdCopyPiece(Buffer, Offset, Length, 0, Pcapng->Header, FSD_PCAPNG_HEADER_SIZE);
+
+    //
+    // Last packet whose blocks start at or before Offset
+    //
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (Pcapng->Packets[Middle].StreamOffset <= Offset)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    KeEnterCriticalRegion();
+
+    ExAcquireFastMutexUnsafe(&Fcb->PacketBufferMutex);
+
+    __try
+    {
+        for (Packet = Pcapng->Packets + (Low ? Low - 1 : 0);
+             Packet < Pcapng->Packets + Pcapng->Count && Packet->StreamOffset < Offset + Length;
+             Packet++)
+        {
+            if (Fcb->PacketBuffer == NULL)
+            {
+                Fcb->PacketBuffer = (PUCHAR) FsdAllocatePool(
+                    PagedPool,
+                    CH10_MAX_PACKET_SIZE,
+                    'bPeR'
+                    );
+
+                if (Fcb->PacketBuffer == NULL)
+                {
+                    Status = STATUS_INSUFFICIENT_RESOURCES;
+                    __leave;
+                }
+            }
+
+            Status = FsdReadRecordingCached(
+                Fcb->Recording,
+                Packet->Offset,
+                Packet->PacketLength,
+                Fcb->PacketBuffer
+                );
+
+            if (!NT_SUCCESS(Status))
+            {
+                __leave;
+            }
+
+            FsdCopyPacketBlocks(
+                Pcapng,
+                TimeTable,
+                Packet,
+                (struct ch10_packet_header*) Fcb->PacketBuffer,
+                Buffer,
+                Offset,
+                Length
+                );
+        }
+    }
+    __finally
+    {
+        ExReleaseFastMutexUnsafe(&Fcb->PacketBufferMutex);
+
+        KeLeaveCriticalRegion();
+    }
+
+    return Status;
+}
+
+#pragma code_seg() // end FSD_PAGED_CODE
@@ -62,6 +62,8 @@ FsdReadNormal (
     PIO_STACK_LOCATION  IrpSp;
     ULONG               Length;
     ULONG               ReturnedLength;
+    ULONG               DataLength;
+    ULONG               HoleStart;
     LARGE_INTEGER       ByteOffset;
     BOOLEAN             PagingIo;
     BOOLEAN             Nocache;
@@ -70,7 +72,9 @@ FsdReadNormal (
     BOOLEAN             FcbMainResourceAcquired = FALSE;
     BOOLEAN             FcbPagingIoResourceAcquired = FALSE;
     PUCHAR              UserBuffer;
+    PMDL                Mdl;
     PDEVICE_OBJECT      DeviceToVerify;
+    LARGE_INTEGER       CacheStart;
 
     __try
     {
@@ -123,8 +127,8 @@ FsdReadNormal (
             }
 
             if (!Nocache ||
-                ByteOffset.LowPart & (SECTOR_SIZE - 1) ||
-                Length & (SECTOR_SIZE - 1))
+                ByteOffset.LowPart & (Vcb->BytesPerSector - 1) ||
+                Length & (Vcb->BytesPerSector - 1))
             {
                 Status = STATUS_INVALID_PARAMETER;
                 __leave;
@@ -141,53 +145,52 @@ FsdReadNormal (
 
             VcbResourceAcquired = TRUE;
 
+            //
+            // A volume open reads the whole partition, not only the files
+            //
             if (ByteOffset.QuadPart >=
-
-#ifndef FSD_RO
-                Vcb->PartitionInformation.PartitionLength.QuadPart
-#else
-				FsdCh10PartitionSize(Vcb->dirblocks)
-#endif
-                )
+                Vcb->PartitionInformation.PartitionLength.QuadPart)
             {
                 Irp->IoStatus.Information = 0;
                 Status = STATUS_END_OF_FILE;
                 __leave;
             }
 
-            if ((ByteOffset.QuadPart + Length) >
-
-#ifndef FSD_RO
-                 Vcb->PartitionInformation.PartitionLength.QuadPart
-#else
-                 FsdCh10PartitionSize(Vcb->dirblocks)
-#endif
-                 )
+            if ((ULONGLONG) ByteOffset.QuadPart + Length >
+                (ULONGLONG) Vcb->PartitionInformation.PartitionLength.QuadPart)
             {
                 Length = (ULONG) (
-#ifndef FSD_RO
-                Vcb->PartitionInformation.PartitionLength.QuadPart -
-#else
-                FsdCh10PartitionSize(Vcb->dirblocks) -
-#endif
-                ByteOffset.QuadPart);
-
-                Length &= ~(SECTOR_SIZE - 1);
+                    Vcb->PartitionInformation.PartitionLength.QuadPart -
+                    ByteOffset.QuadPart);
+
+                Length &= ~(Vcb->BytesPerSector - 1);
+
+                if (Length == 0)
+                {
+                    Irp->IoStatus.Information = 0;
+                    Status = STATUS_END_OF_FILE;
+                    __leave;
+                }
             }
 
-            UserBuffer = FsdGetUserBuffer(Irp);
+            //
+            // The caller's buffer is locked once and the device reads into
+            // it directly, split at the maximum transfer length
+            //
+            Status = FsdLockUserBuffer(Irp, Length, IoWriteAccess);
 
-            if (UserBuffer == NULL)
+            if (!NT_SUCCESS(Status))
             {
-                Status = STATUS_INVALID_USER_BUFFER;
                 __leave;
             }
 
-            Status = FsdReadBlockDevice(
+            Status = FsdReadBlockDeviceMdl(
                 Vcb->TargetDeviceObject,
+                Irp->MdlAddress,
                 &ByteOffset,
                 Length,
-                UserBuffer
+                Vcb->MaximumTransferLength,
+                Irp->Flags
                 );
 
             if (Status == STATUS_VERIFY_REQUIRED)
@@ -196,11 +199,13 @@ FsdReadNormal (
 
                 if (NT_SUCCESS(Status))
                 {
-                    Status = FsdReadBlockDevice(
+                    Status = FsdReadBlockDeviceMdl(
                         Vcb->TargetDeviceObject,
+                        Irp->MdlAddress,
                         &ByteOffset,
                         Length,
-                        UserBuffer
+                        Vcb->MaximumTransferLength,
+                        Irp->Flags
                         );
                 }
             }
@@ -222,12 +227,15 @@ FsdReadNormal (
             __leave;
         }
 
+        //
+        // Paging reads through the file object a recording is cached
+        // through for its streams come without a CCB
+        //
         Ccb = (PFSD_CCB) FileObject->FsContext2;
 
-        ASSERT(Ccb);
-
-        ASSERT((Ccb->Identifier.Type == CCB) &&
-               (Ccb->Identifier.Size == sizeof(FSD_CCB)));
+        ASSERT(Ccb == NULL ||
+               ((Ccb->Identifier.Type == CCB) &&
+                (Ccb->Identifier.Size == sizeof(FSD_CCB))));
 
         Irp = IrpContext->Irp;
 
@@ -255,8 +263,8 @@ FsdReadNormal (
         }
 
         if (Nocache &&
-           (ByteOffset.LowPart & (SECTOR_SIZE - 1) ||
-            Length & (SECTOR_SIZE - 1)))
+           (ByteOffset.LowPart & (Vcb->BytesPerSector - 1) ||
+            Length & (Vcb->BytesPerSector - 1)))
         {
             Status = STATUS_INVALID_PARAMETER;
             __leave;
@@ -269,6 +277,27 @@ FsdReadNormal (
             __leave;
         }
 
+        //
+        // The first read of a stream builds its view of the recording on a
+        // worker thread, before the stream has sizes to check the read
+        // against
+        //
+        if (FlagOn(Fcb->Flags, FCB_STREAM_PENDING))
+        {
+            if (!IrpContext->IsPosted && !PagingIo)
+            {
+                Status = STATUS_PENDING;
+                __leave;
+            }
+
+            Status = FsdBuildStream(Vcb, Fcb);
+
+            if (!NT_SUCCESS(Status))
+            {
+                __leave;
+            }
+        }
+
         if (!PagingIo)
         {
             if (!ExAcquireResourceSharedLite(
@@ -320,21 +349,17 @@ FsdReadNormal (
             if ((ByteOffset.QuadPart + Length) >
                  be64_to_cpu(Fcb->ch10_direntry->size))
             {
-                Length =
-                    be64_to_cpu(Fcb->ch10_direntry->size) - ByteOffset.LowPart;
+                Length = (ULONG) (
+                    be64_to_cpu(Fcb->ch10_direntry->size) - ByteOffset.QuadPart);
             }
 
             if (FileObject->PrivateCacheMap == NULL)
             {
-                CcInitializeCacheMap(
-                    FileObject,
-                    (PCC_FILE_SIZES)(&Fcb->CommonFCBHeader.AllocationSize),
-                    FALSE,
-                    &FsdGlobalData.CacheManagerCallbacks,
-                    Fcb
-                    );
+                FsdInitializeCacheMap(FileObject, Fcb);
             }
 
+            CacheStart = KeQueryPerformanceCounter(NULL);
+
             if (FlagOn(IrpContext->MinorFunction, IRP_MN_MDL))
             {
                 CcMdlRead(
@@ -346,6 +371,8 @@ FsdReadNormal (
                     );
 
                 Status = Irp->IoStatus.Status;
+
+                FsdAddCacheStatistics(CacheStart, (ULONG) Irp->IoStatus.Information);
             }
             else
             {
@@ -371,6 +398,8 @@ FsdReadNormal (
                 }
 
                 Status = Irp->IoStatus.Status;
+
+                FsdAddCacheStatistics(CacheStart, (ULONG) Irp->IoStatus.Information);
             }
         }
         else
@@ -380,27 +409,121 @@ FsdReadNormal (
             if ((ByteOffset.QuadPart + Length) >
                  be64_to_cpu(Fcb->ch10_direntry->size))
             {
-                ReturnedLength =
-                    be64_to_cpu(Fcb->ch10_direntry->size) - ByteOffset.LowPart;
+                ReturnedLength = (ULONG) (
+                    be64_to_cpu(Fcb->ch10_direntry->size) - ByteOffset.QuadPart);
 
-                Length = (ReturnedLength & ~(SECTOR_SIZE - 1)) + SECTOR_SIZE;
+                Length = (ReturnedLength + Vcb->BytesPerSector - 1) &
+                    ~(Vcb->BytesPerSector - 1);
             }
 
-            UserBuffer = FsdGetUserBuffer(Irp);
-
-            if (UserBuffer == NULL)
+            //
+            // A pcapng stream is generated from the packets of its channel
+            // and an ARINC-429 stream from the packets of its label
+            //
+            if (FlagOn(Fcb->Flags, FCB_PCAPNG_STREAM | FCB_ARINC_STREAM))
             {
-                Status = STATUS_INVALID_USER_BUFFER;
+                UserBuffer = FsdGetUserBuffer(Irp);
+
+                if (UserBuffer == NULL)
+                {
+                    Status = STATUS_INVALID_USER_BUFFER;
+                    __leave;
+                }
+
+                if (FlagOn(Fcb->Flags, FCB_ARINC_STREAM))
+                {
+                    Status = FsdReadArinc(
+                        Vcb,
+                        Fcb,
+                        ByteOffset.QuadPart,
+                        ReturnedLength,
+                        UserBuffer
+                        );
+                }
+                else
+                {
+                    Status = FsdReadPcapng(
+                        Vcb,
+                        Fcb,
+                        ByteOffset.QuadPart,
+                        ReturnedLength,
+                        UserBuffer
+                        );
+                }
+
+                if (NT_SUCCESS(Status))
+                {
+                    RtlZeroMemory(UserBuffer + ReturnedLength, Length - ReturnedLength);
+
+                    Irp->IoStatus.Information = ReturnedLength;
+                }
+
                 __leave;
             }
 
-            Status = FsdReadFileData(
-                Vcb->TargetDeviceObject,
-                (ULONG) Fcb->IndexNumber.QuadPart,
-                &ByteOffset,
-                Length,
-                UserBuffer
-                );
+            //
+            // Past the blocks of a sparse recording the file reads as zeros,
+            // only the part in front of the hole comes from the device
+            //
+            HoleStart = Length;
+
+            if ((ULONGLONG) ByteOffset.QuadPart + Length > Fcb->AllocatedLength)
+            {
+                HoleStart = ((ULONGLONG) ByteOffset.QuadPart < Fcb->AllocatedLength) ?
+                    (ULONG) (Fcb->AllocatedLength - ByteOffset.QuadPart) : 0;
+            }
+
+            DataLength = min(Length,
+                (HoleStart + Vcb->BytesPerSector - 1) &
+                ~(Vcb->BytesPerSector - 1));
+
+            //
+            // A read that is sector aligned on the device goes straight
+            // into the caller's pages, paging I/O already comes with an MDL.
+            // Only a volume with blocks smaller than the sectors of the
+            // device needs the buffered path.
+            //
+            if (!((Fcb->IndexNumber.QuadPart + ByteOffset.QuadPart) &
+                  (Vcb->BytesPerSector - 1)))
+            {
+                Status = FsdLockUserBuffer(Irp, Length, IoWriteAccess);
+
+                if (!NT_SUCCESS(Status))
+                {
+                    __leave;
+                }
+
+                UserBuffer = NULL;
+
+                Mdl = Irp->MdlAddress;
+            }
+            else
+            {
+                UserBuffer = FsdGetUserBuffer(Irp);
+
+                if (UserBuffer == NULL)
+                {
+                    Status = STATUS_INVALID_USER_BUFFER;
+                    __leave;
+                }
+
+                Mdl = NULL;
+            }
+
+            Status = STATUS_SUCCESS;
+
+            if (DataLength)
+            {
+                Status = FsdReadFileData(
+                    Vcb,
+                    Fcb->IndexNumber.QuadPart,
+                    &ByteOffset,
+                    DataLength,
+                    UserBuffer,
+                    Mdl,
+                    Irp->Flags
+                    );
+            }
 
             if (Status == STATUS_VERIFY_REQUIRED)
             {
@@ -413,15 +536,33 @@ FsdReadNormal (
                 if (NT_SUCCESS(Status))
                 {
                     Status = FsdReadFileData(
-                        Vcb->TargetDeviceObject,
-                        (ULONG) Fcb->IndexNumber.QuadPart,
+                        Vcb,
+                        Fcb->IndexNumber.QuadPart,
                         &ByteOffset,
-                        Length,
-                        UserBuffer
+                        DataLength,
+                        UserBuffer,
+                        Mdl,
+                        Irp->Flags
                         );
                 }
             }
 
+            if (NT_SUCCESS(Status) && HoleStart < Length)
+            {
+                if (Mdl)
+                {
+                    UserBuffer = FsdGetUserBuffer(Irp);
+
+                    if (UserBuffer == NULL)
+                    {
+                        Status = STATUS_INSUFFICIENT_RESOURCES;
+                        __leave;
+                    }
+                }
+
+                RtlZeroMemory(UserBuffer + HoleStart, Length - HoleStart);
+            }
+
             if (NT_SUCCESS(Status))
             {
                 Irp->IoStatus.Information = ReturnedLength;
@@ -551,41 +692,69 @@ FsdReadComplete (
     return Status;
 }
 
+//
+// Reads file data at byte Offset in a file starting at byte Index on the
+// volume. With Mdl the data is read straight into the pages it describes
+// and Buffer is not used, the read must then be sector aligned, and the
+// paging and nocache flags of IrpFlags go down with it. Otherwise
+// a read that is not aligned to the sector size of the device goes through
+// a buffer of whole sectors.
+//
 NTSTATUS
 FsdReadFileData (
-    IN PDEVICE_OBJECT       	DeviceObject,
-    IN ULONG                	Index,
+    IN PFSD_VCB             	Vcb,
+    IN ULONGLONG            	Index,
     IN PLARGE_INTEGER       	Offset,
     IN ULONG                	Length,
-    IN OUT PVOID            	Buffer
+    IN OUT PVOID            	Buffer,
+    IN PMDL                 	Mdl OPTIONAL,
+    IN ULONG                	IrpFlags
     )
 {
+    ULONGLONG       SectorMask;
+    ULONGLONG       Start;
     LARGE_INTEGER   PhysicalOffset;
     ULONG           PhysicalLength;
     PUCHAR          PhysicalBuffer;
     NTSTATUS        Status;
 
-    ASSERT(DeviceObject != NULL);
+    ASSERT(Vcb != NULL);
     ASSERT(Offset != NULL);
-    ASSERT(Buffer != NULL);
+    ASSERT(Buffer != NULL || Mdl != NULL);
 
     KdPrint((
         DRIVER_NAME
-        ": FsdReadFileData: Index: %#x Offset: %I64u Length: %u\n",
+        ": FsdReadFileData: Index: %I64u Offset: %I64u Length: %u\n",
         Index,
         Offset->QuadPart,
         Length
         ));
 
-    if (!((Index + Offset->QuadPart) &
-        (SECTOR_SIZE - 1))
-        )
+    SectorMask = Vcb->BytesPerSector - 1;
+
+    Start = Index + Offset->QuadPart;
+
+    if (Mdl)
+    {
+        ASSERT(!((Start | Length) & SectorMask));
+
+        PhysicalOffset.QuadPart = Start;
+
+        Status = FsdReadBlockDeviceMdl(
+            Vcb->TargetDeviceObject,
+            Mdl,
+            &PhysicalOffset,
+            Length,
+            Vcb->MaximumTransferLength,
+            IrpFlags
+            );
+    }
+    else if (!((Start | Length) & SectorMask))
     {
-        PhysicalOffset.QuadPart =
-            Index + Offset->QuadPart;
+        PhysicalOffset.QuadPart = Start;
 
         Status = FsdReadBlockDeviceAtApcLevel(
-            DeviceObject,
+            Vcb->TargetDeviceObject,
             &PhysicalOffset,
             Length,
             Buffer
@@ -593,14 +762,14 @@ FsdReadFileData (
     }
     else
     {
-        PhysicalOffset.QuadPart =
-            (Index + Offset->QuadPart) &
-            ~(SECTOR_SIZE - 1);
+        PhysicalOffset.QuadPart = Start & ~SectorMask;
 
-        PhysicalLength = Length + SECTOR_SIZE;
+        PhysicalLength = (ULONG) (
+            ((Start + Length + SectorMask) & ~SectorMask) -
+            PhysicalOffset.QuadPart);
 
         PhysicalBuffer = (PUCHAR) FsdAllocatePool(
-            NonPagedPool,
+            NonPagedPoolCacheAligned,
             PhysicalLength,
             '3mTR'
             );
@@ -611,22 +780,72 @@ FsdReadFileData (
         }
 
         Status = FsdReadBlockDeviceAtApcLevel(
-            DeviceObject,
+            Vcb->TargetDeviceObject,
             &PhysicalOffset,
             PhysicalLength,
             PhysicalBuffer
             );
 
-        RtlCopyMemory(
-            Buffer,
-            PhysicalBuffer +
-            ((Index + Offset->QuadPart) &
-            (SECTOR_SIZE - 1)),
-            Length
-            );
+        if (NT_SUCCESS(Status))
+        {
+            RtlCopyMemory(
+                Buffer,
+                PhysicalBuffer + (Start & SectorMask),
+                Length
+                );
+        }
 
         FsdFreePool(PhysicalBuffer);
     }
 
     return Status;
 }
+
+//
+// Copies Length bytes of a recording at Offset from the cache, through the
+// file object the streams of the recording share. The packets streams are
+// made of are read once from the device and then served from the cache
+// for every read of any stream that overlaps them.
+//
+NTSTATUS
+FsdReadRecordingCached (
+    IN PFSD_FCB             Recording,
+    IN ULONGLONG            Offset,
+    IN ULONG                Length,
+    OUT PVOID               Buffer
+    )
+{
+    LARGE_INTEGER   FileOffset;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER   CacheStart;
+
+    ASSERT(Recording != NULL);
+    ASSERT(Recording->StreamFileObject != NULL);
+
+    if (Offset + Length > (ULONGLONG) Recording->CommonFCBHeader.FileSize.QuadPart)
+    {
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    FileOffset.QuadPart = Offset;
+
+    CacheStart = KeQueryPerformanceCounter(NULL);
+
+    CcCopyRead(
+        Recording->StreamFileObject,
+        &FileOffset,
+        Length,
+        TRUE,
+        Buffer,
+        &IoStatus
+        );
+
+    FsdAddCacheStatistics(CacheStart, (ULONG) IoStatus.Information);
+
+    if (NT_SUCCESS(IoStatus.Status) && IoStatus.Information != Length)
+    {
+        return STATUS_UNEXPECTED_IO_ERROR;
+    }
+
+    return IoStatus.Status;
+}
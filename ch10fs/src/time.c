@@ -0,0 +1,797 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ntifs.h"
+#include "fsd.h"
+#include "ch10_fs.h"
+#include "border.h"
+
+//
+// Time correlation of a recording. Packet headers only carry the relative
+// time counter, absolute time comes from the time packets. The table of a
+// recording is built in one scan on the first request that needs it and
+// lives as long as the FCB. Conversions find the neighbouring points with
+// a binary search and interpolate between them in integer arithmetic, the
+// same as Ch10RtcToTime and Ch10TimeToRtc of the portable tools.
+//
+
+//
+// Points are a jump when their time and counter disagree by more than
+// FSD_TIME_JUMP_TOLERANCE plus FSD_TIME_JUMP_PPM of the time elapsed
+//
+#define FSD_TIME_JUMP_TOLERANCE     100000
+#define FSD_TIME_JUMP_PPM           1000
+
+//
+// Points further apart than this are not interpolated between, the
+// counter rate is used instead. It keeps the products of the
+// interpolation within 64 bits.
+//
+#define FSD_TIME_MAX_SEGMENT        (3600 * CH10_RTC_HZ)
+
+typedef struct _FSD_TIME_BUILDER {
+    PFSD_TIME_TABLE             Table;
+    ULONG                       Capacity;
+} FSD_TIME_BUILDER, *PFSD_TIME_BUILDER;
+
+#pragma code_seg(FSD_PAGED_CODE)
+
+static NTSTATUS
+FsdAddTimePoint (
+    IN PVOID                        Context,
+    IN ULONGLONG                    Offset,
+    IN struct ch10_packet_header*   Header
+    )
+{
+    PFSD_TIME_BUILDER   Builder = (PFSD_TIME_BUILDER) Context;
+    PFSD_TIME_TABLE     Table = Builder->Table;
+    PFSD_TIME_POINT     Points;
+    PFSD_TIME_POINT     Point;
+    ULONGLONG           Time;
+    ULONG               Capacity;
+    ULONG               Csdw;
+
+    PAGED_CODE();
+
+    //
+    // A time packet without a valid time is left out
+    //
+    if (Header->dataType != CH10_DATA_TIME_F1 ||
+        !NT_SUCCESS(FsdDecodeTime(Header, &Time, &Csdw)))
+    {
+        return STATUS_SUCCESS;
+    }
+
+    if (Table->Count == Builder->Capacity)
+    {
+        if (Builder->Capacity > MAXLONG / sizeof(FSD_TIME_POINT))
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        Capacity = Builder->Capacity ? Builder->Capacity * 2 : 256;
+
+        Points = (PFSD_TIME_POINT) FsdAllocatePool(
+            PagedPool,
+            Capacity * sizeof(FSD_TIME_POINT),
+            'pTiR'
+            );
+
+        if (Points == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if (Table->Points)
+        {
+            RtlCopyMemory(Points, Table->Points, Table->Count * sizeof(FSD_TIME_POINT));
+            FsdFreePool(Table->Points);
+        }
+
+        Table->Points = Points;
+        Builder->Capacity = Capacity;
+    }
+
+    Point = &Table->Points[Table->Count++];
+
+    RtlZeroMemory(Point, sizeof(FSD_TIME_POINT));
+
+    Point->Rtc = FsdGetRtc(Header);
+    Point->Time = Time;
+    Point->Offset = Offset;
+    Point->Format = (UCHAR) CH10_TIME_CSDW_FMT(Csdw);
+    Point->Source = (UCHAR) CH10_TIME_CSDW_SRC(Csdw);
+
+    if (Csdw & CH10_TIME_CSDW_DMY)
+    {
+        SetFlag(Point->Flags, FSD_TIME_YEAR);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static BOOLEAN
+FsdIsTimeJump (
+    IN PFSD_TIME_POINT  Before,
+    IN PFSD_TIME_POINT  After
+    )
+{
+    ULONGLONG   Elapsed;
+    ULONGLONG   Gap;
+    ULONGLONG   Error;
+
+    PAGED_CODE();
+
+    if (After->Rtc <= Before->Rtc ||
+        After->Time < Before->Time ||
+        ((Before->Flags ^ After->Flags) & FSD_TIME_YEAR))
+    {
+        return TRUE;
+    }
+
+    Elapsed = After->Rtc - Before->Rtc;
+    Gap = After->Time - Before->Time;
+    Error = Gap > Elapsed ? Gap - Elapsed : Elapsed - Gap;
+
+    return Error > FSD_TIME_JUMP_TOLERANCE + Elapsed / 1000000 * FSD_TIME_JUMP_PPM;
+}
+
+//
+// Builds the time correlation of a recording in one pass
+//
+static NTSTATUS
+FsdBuildTimeTable (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_TIME_TABLE*    Table
+    )
+{
+    FSD_TIME_BUILDER    Builder;
+    PFSD_TIME_TABLE     NewTable;
+    PFSD_TIME_POINT     Point;
+    ULONG               i;
+    NTSTATUS            Status;
+
+    PAGED_CODE();
+
+    NewTable = (PFSD_TIME_TABLE) FsdAllocatePool(
+        PagedPool,
+        sizeof(FSD_TIME_TABLE),
+        'mTiR'
+        );
+
+    if (NewTable == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(NewTable, sizeof(FSD_TIME_TABLE));
+
+    Builder.Table = NewTable;
+    Builder.Capacity = 0;
+
+    Status = FsdScanPackets(Vcb, Fcb, FsdAddTimePoint, &Builder, NULL);
+
+    if (!NT_SUCCESS(Status))
+    {
+        FsdFreeTimeTable(NewTable);
+        return Status;
+    }
+
+    NewTable->RtcSorted = TRUE;
+    NewTable->TimeSorted = TRUE;
+
+    for (i = 1; i < NewTable->Count; i++)
+    {
+        Point = &NewTable->Points[i];
+
+        if (FsdIsTimeJump(Point - 1, Point))
+        {
+            SetFlag(Point->Flags, FSD_TIME_JUMP);
+            NewTable->JumpCount++;
+        }
+
+        if (Point->Rtc <= Point[-1].Rtc)
+        {
+            NewTable->RtcSorted = FALSE;
+        }
+
+        if (Point->Time < Point[-1].Time)
+        {
+            NewTable->TimeSorted = FALSE;
+        }
+    }
+
+    KdPrint((
+        DRIVER_NAME
+        ": FsdBuildTimeTable: %wZ Points: %u Jumps: %u\n",
+        &Fcb->FileName,
+        NewTable->Count,
+        NewTable->JumpCount
+        ));
+
+    *Table = NewTable;
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Returns the time correlation of a recording, building it on first use.
+// Two callers racing to build it both scan, the first to finish keeps its
+// table with the FCB.
+//
+NTSTATUS
+FsdGetTimeTable (
+    IN PFSD_VCB             Vcb,
+    IN PFSD_FCB             Fcb,
+    OUT PFSD_TIME_TABLE*    Table
+    )
+{
+    PFSD_TIME_TABLE NewTable;
+    PFSD_TIME_TABLE OldTable;
+    NTSTATUS        Status;
+
+    PAGED_CODE();
+
+    if (Fcb->TimeTable == NULL)
+    {
+        Status = FsdBuildTimeTable(Vcb, Fcb, &NewTable);
+
+        if (!NT_SUCCESS(Status))
+        {
+            return Status;
+        }
+
+        OldTable = (PFSD_TIME_TABLE) InterlockedCompareExchangePointer(
+            (PVOID*) &Fcb->TimeTable,
+            NewTable,
+            NULL
+            );
+
+        if (OldTable != NULL)
+        {
+            FsdFreeTimeTable(NewTable);
+        }
+    }
+
+    *Table = Fcb->TimeTable;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+FsdFreeTimeTable (
+    IN PFSD_TIME_TABLE      Table
+    )
+{
+    PAGED_CODE();
+
+    if (Table->Points)
+    {
+        FsdFreePool(Table->Points);
+    }
+
+    FsdFreePool(Table);
+}
+
+//
+// Delta * Numerator / Denominator, for a ratio close to one and Delta at
+// most Denominator
+//
+static ULONGLONG
+FsdScaleTime (
+    IN ULONGLONG    Delta,
+    IN ULONGLONG    Numerator,
+    IN ULONGLONG    Denominator
+    )
+{
+    LONGLONG Drift = (LONGLONG) (Numerator - Denominator);
+
+    PAGED_CODE();
+
+    return Delta + (ULONGLONG) ((LONGLONG) Delta * Drift / (LONGLONG) Denominator);
+}
+
+//
+// Interpolation is done between a point and the next one when the next
+// one does not jump and is close enough
+//
+static PFSD_TIME_POINT
+FsdGetSegmentEnd (
+    IN PFSD_TIME_TABLE  Table,
+    IN ULONG            Number
+    )
+{
+    PFSD_TIME_POINT Point = &Table->Points[Number];
+
+    PAGED_CODE();
+
+    if (Number + 1 >= Table->Count ||
+        FlagOn(Point[1].Flags, FSD_TIME_JUMP) ||
+        Point[1].Rtc - Point->Rtc > FSD_TIME_MAX_SEGMENT ||
+        Point[1].Time - Point->Time > FSD_TIME_MAX_SEGMENT)
+    {
+        return NULL;
+    }
+
+    return Point + 1;
+}
+
+//
+// Number of the last point at or before Rtc plus one, 0 when there is none
+//
+static ULONG
+FsdFindRtcPoint (
+    IN PFSD_TIME_TABLE  Table,
+    IN ULONGLONG        Rtc
+    )
+{
+    ULONG Low = 0;
+    ULONG High = Table->Count;
+    ULONG Middle;
+    ULONG Best = 0;
+
+    PAGED_CODE();
+
+    if (Table->RtcSorted)
+    {
+        while (Low < High)
+        {
+            Middle = Low + (High - Low) / 2;
+
+            if (Table->Points[Middle].Rtc <= Rtc)
+            {
+                Low = Middle + 1;
+            }
+            else
+            {
+                High = Middle;
+            }
+        }
+
+        return Low;
+    }
+
+    //
+    // The counter was reset, take the closest point below Rtc
+    //
+    for (Middle = 0; Middle < Table->Count; Middle++)
+    {
+        if (Table->Points[Middle].Rtc <= Rtc &&
+            (Best == 0 || Table->Points[Middle].Rtc >= Table->Points[Best - 1].Rtc))
+        {
+            Best = Middle + 1;
+        }
+    }
+
+    return Best;
+}
+
+//
+// Number of the point that starts the segment holding Time plus one, 0
+// when Time is before all points
+//
+static ULONG
+FsdFindTimePoint (
+    IN PFSD_TIME_TABLE  Table,
+    IN ULONGLONG        Time
+    )
+{
+    PFSD_TIME_POINT End;
+    ULONG           Low = 0;
+    ULONG           High = Table->Count;
+    ULONG           Middle;
+
+    PAGED_CODE();
+
+    if (Table->TimeSorted)
+    {
+        while (Low < High)
+        {
+            Middle = Low + (High - Low) / 2;
+
+            if (Table->Points[Middle].Time <= Time)
+            {
+                Low = Middle + 1;
+            }
+            else
+            {
+                High = Middle;
+            }
+        }
+
+        return Low;
+    }
+
+    //
+    // Time went back, the first segment in recording order that holds
+    // Time wins
+    //
+    for (Middle = 0; Middle < Table->Count; Middle++)
+    {
+        End = Middle + 1 < Table->Count ? &Table->Points[Middle + 1] : NULL;
+
+        if (Table->Points[Middle].Time <= Time &&
+            (End == NULL || FlagOn(End->Flags, FSD_TIME_JUMP) || End->Time > Time))
+        {
+            return Middle + 1;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Converts relative time to absolute time. *Point is the number of the
+// point the conversion started from plus one, 0 when Rtc is before all
+// points.
+//
+NTSTATUS
+FsdRtcToTime (
+    IN PFSD_TIME_TABLE      Table,
+    IN ULONGLONG            Rtc,
+    OUT PULONGLONG          Time,
+    OUT PULONG              Point
+    )
+{
+    PFSD_TIME_POINT Start;
+    PFSD_TIME_POINT End;
+    ULONG           Number;
+
+    PAGED_CODE();
+
+    if (Table->Count == 0)
+    {
+        return STATUS_NOT_FOUND;
+    }
+
+    Number = FsdFindRtcPoint(Table, Rtc);
+
+    *Point = Number;
+
+    if (Number == 0)
+    {
+        Start = &Table->Points[0];
+
+        if (Start->Rtc - Rtc > Start->Time)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        *Time = Start->Time - (Start->Rtc - Rtc);
+        return STATUS_SUCCESS;
+    }
+
+    Start = &Table->Points[Number - 1];
+    End = FsdGetSegmentEnd(Table, Number - 1);
+
+    if (End && Rtc < End->Rtc)
+    {
+        *Time = Start->Time + FsdScaleTime(
+            Rtc - Start->Rtc,
+            End->Time - Start->Time,
+            End->Rtc - Start->Rtc
+            );
+    }
+    else
+    {
+        *Time = Start->Time + (Rtc - Start->Rtc);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//
+// Converts absolute time to relative time, *Point as for FsdRtcToTime
+//
+NTSTATUS
+FsdTimeToRtc (
+    IN PFSD_TIME_TABLE      Table,
+    IN ULONGLONG            Time,
+    OUT PULONGLONG          Rtc,
+    OUT PULONG              Point
+    )
+{
+    PFSD_TIME_POINT Start;
+    PFSD_TIME_POINT End;
+    ULONG           Number;
+
+    PAGED_CODE();
+
+    if (Table->Count == 0)
+    {
+        return STATUS_NOT_FOUND;
+    }
+
+    Number = FsdFindTimePoint(Table, Time);
+
+    *Point = Number;
+
+    if (Number == 0)
+    {
+        Start = &Table->Points[0];
+
+        if (Start->Time - Time > Start->Rtc)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        *Rtc = Start->Rtc - (Start->Time - Time);
+        return STATUS_SUCCESS;
+    }
+
+    Start = &Table->Points[Number - 1];
+    End = FsdGetSegmentEnd(Table, Number - 1);
+
+    if (End && Time < End->Time)
+    {
+        *Rtc = Start->Rtc + FsdScaleTime(
+            Time - Start->Time,
+            End->Rtc - Start->Rtc,
+            End->Time - Start->Time
+            );
+    }
+    else
+    {
+        *Rtc = Start->Rtc + (Time - Start->Time);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+//
+// The recording a time FSCTL was sent to
+//
+static NTSTATUS
+FsdGetTimeFcb (
+    IN PFSD_IRP_CONTEXT IrpContext,
+    OUT PFSD_VCB*       Vcb,
+    OUT PFSD_FCB*       Fcb
+    )
+{
+    PAGED_CODE();
+
+    if (IrpContext->DeviceObject == FsdGlobalData.DeviceObject ||
+        IrpContext->FileObject == NULL)
+    {
+        return STATUS_INVALID_DEVICE_REQUEST;
+    }
+
+    *Vcb = (PFSD_VCB) IrpContext->DeviceObject->DeviceExtension;
+    *Fcb = (PFSD_FCB) IrpContext->FileObject->FsContext;
+
+    if (*Fcb == NULL ||
+        (*Fcb)->Identifier.Type != FCB ||
+        FlagOn((*Fcb)->FileAttributes, FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    //
+    // A stream answers with the time of its recording
+    //
+    if ((*Fcb)->Recording)
+    {
+        *Fcb = (*Fcb)->Recording;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+FsdQueryTime (
+    IN PFSD_IRP_CONTEXT IrpContext
+    )
+{
+    PIRP                Irp;
+    PIO_STACK_LOCATION  IrpSp;
+    PFSD_VCB            Vcb;
+    PFSD_FCB            Fcb;
+    PFSD_TIME_TABLE     Table;
+    PFSD_TIME_QUERY     Query;
+    ULONG               Number;
+    NTSTATUS            Status = STATUS_UNSUCCESSFUL;
+
+    PAGED_CODE();
+
+    __try
+    {
+        ASSERT(IrpContext != NULL);
+
+        ASSERT((IrpContext->Identifier.Type == ICX) &&
+               (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+        Irp = IrpContext->Irp;
+
+        IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+        Irp->IoStatus.Information = 0;
+
+        Status = FsdGetTimeFcb(IrpContext, &Vcb, &Fcb);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        if (IrpSp->Parameters.FileSystemControl.InputBufferLength < sizeof(FSD_TIME_QUERY) ||
+            IrpSp->Parameters.FileSystemControl.OutputBufferLength < sizeof(FSD_TIME_QUERY))
+        {
+            Status = STATUS_BUFFER_TOO_SMALL;
+            __leave;
+        }
+
+        Query = (PFSD_TIME_QUERY) Irp->AssociatedIrp.SystemBuffer;
+
+        if (Query->Mode != FSD_TIME_FROM_RTC && Query->Mode != FSD_TIME_FROM_TIME)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            __leave;
+        }
+
+        Status = FsdGetTimeTable(Vcb, Fcb, &Table);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        if (Query->Mode == FSD_TIME_FROM_RTC)
+        {
+            Status = FsdRtcToTime(Table, Query->Rtc, &Query->Time, &Number);
+        }
+        else
+        {
+            Status = FsdTimeToRtc(Table, Query->Time, &Query->Rtc, &Number);
+        }
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        //
+        // A reader seeking to the time starts from the time packet the
+        // conversion used, or from the start before the first one
+        //
+        Query->Flags = Number ? Table->Points[Number - 1].Flags : 0;
+        Query->Offset = Number ? Table->Points[Number - 1].Offset : 0;
+        Query->PointCount = Table->Count;
+        Query->JumpCount = Table->JumpCount;
+
+        Irp->IoStatus.Information = sizeof(FSD_TIME_QUERY);
+    }
+    __finally
+    {
+        if (!AbnormalTermination())
+        {
+            IrpContext->Irp->IoStatus.Status = Status;
+
+            FsdCompleteRequest(IrpContext->Irp, IO_NO_INCREMENT);
+
+            FsdFreeIrpContext(IrpContext);
+        }
+    }
+
+    return Status;
+}
+
+NTSTATUS
+FsdQueryTimePoints (
+    IN PFSD_IRP_CONTEXT IrpContext
+    )
+{
+    PIRP                Irp;
+    PIO_STACK_LOCATION  IrpSp;
+    PFSD_VCB            Vcb;
+    PFSD_FCB            Fcb;
+    PFSD_TIME_TABLE     Table;
+    PFSD_TIME_POINTS    Output;
+    ULONG               OutputLength;
+    ULONG               First = 0;
+    ULONG               Returned;
+    NTSTATUS            Status = STATUS_UNSUCCESSFUL;
+
+    PAGED_CODE();
+
+    __try
+    {
+        ASSERT(IrpContext != NULL);
+
+        ASSERT((IrpContext->Identifier.Type == ICX) &&
+               (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+        Irp = IrpContext->Irp;
+
+        IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+        Irp->IoStatus.Information = 0;
+
+        Status = FsdGetTimeFcb(IrpContext, &Vcb, &Fcb);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        OutputLength = IrpSp->Parameters.FileSystemControl.OutputBufferLength;
+
+        if (OutputLength < FIELD_OFFSET(FSD_TIME_POINTS, Points))
+        {
+            Status = STATUS_BUFFER_TOO_SMALL;
+            __leave;
+        }
+
+        Output = (PFSD_TIME_POINTS) Irp->AssociatedIrp.SystemBuffer;
+
+        if (IrpSp->Parameters.FileSystemControl.InputBufferLength >= sizeof(ULONG))
+        {
+            First = *(PULONG) Output;
+        }
+
+        Status = FsdGetTimeTable(Vcb, Fcb, &Table);
+
+        if (!NT_SUCCESS(Status))
+        {
+            __leave;
+        }
+
+        Returned = First < Table->Count ? Table->Count - First : 0;
+
+        Returned = min(
+            Returned,
+            (OutputLength - FIELD_OFFSET(FSD_TIME_POINTS, Points)) / sizeof(FSD_TIME_POINT)
+            );
+
+        Output->PointCount = Table->Count;
+        Output->JumpCount = Table->JumpCount;
+        Output->Returned = Returned;
+        Output->RtcSorted = Table->RtcSorted;
+        Output->TimeSorted = Table->TimeSorted;
+
+        if (Returned)
+        {
+            RtlCopyMemory(
+                Output->Points,
+                &Table->Points[First],
+                Returned * sizeof(FSD_TIME_POINT)
+                );
+        }
+
+        Irp->IoStatus.Information =
+            FIELD_OFFSET(FSD_TIME_POINTS, Points) + Returned * sizeof(FSD_TIME_POINT);
+
+        Status = First + Returned < Table->Count ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS;
+    }
+    __finally
+    {
+        if (!AbnormalTermination())
+        {
+            IrpContext->Irp->IoStatus.Status = Status;
+
+            FsdCompleteRequest(IrpContext->Irp, IO_NO_INCREMENT);
+
+            FsdFreeIrpContext(IrpContext);
+        }
+    }
+
+    return Status;
+}
+
+#pragma code_seg() // end FSD_PAGED_CODE
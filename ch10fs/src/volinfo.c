@@ -174,11 +174,11 @@ FsdQueryVolumeInformation (
                 {
                     Buffer->TotalAllocationUnits.QuadPart =
                         Vcb->PartitionInformation.PartitionLength.QuadPart /
-                        CH10_BLOCK_SIZE;
+                        Vcb->BytesPerBlock;
 
                     Buffer->AvailableAllocationUnits.QuadPart =
                         (Vcb->PartitionInformation.PartitionLength.QuadPart -
-                        FsdCh10PartitionSize(&Vcb->dirblocks[0]) / CH10_BLOCK_SIZE;
+                        FsdCh10PartitionSize(&Vcb->dirblocks[0])) / Vcb->BytesPerBlock;
                 }
                 else
 #endif // !FSD_RO
@@ -187,16 +187,16 @@ FsdQueryVolumeInformation (
                     // contents and available size is zero
 
                     Buffer->TotalAllocationUnits.QuadPart =
-                        FsdCh10PartitionSize(&Vcb->dirblocks[0]) / CH10_BLOCK_SIZE;
+                        FsdCh10PartitionSize(&Vcb->dirblocks[0]) / Vcb->BytesPerBlock;
 
                     Buffer->AvailableAllocationUnits.QuadPart =
                         0;
                 }
 
                 Buffer->SectorsPerAllocationUnit =
-                    CH10_BLOCK_SIZE / Vcb->DiskGeometry.BytesPerSector;
+                    max(Vcb->BytesPerBlock / Vcb->BytesPerSector, 1);
 
-                Buffer->BytesPerSector = Vcb->DiskGeometry.BytesPerSector;
+                Buffer->BytesPerSector = Vcb->BytesPerSector;
 
                 Irp->IoStatus.Information = sizeof(FILE_FS_SIZE_INFORMATION);
                 Status = STATUS_SUCCESS;
@@ -322,12 +322,12 @@ FsdQueryVolumeInformation (
                 {
                     Buffer->TotalAllocationUnits.QuadPart =
                         Vcb->PartitionInformation.PartitionLength.QuadPart /
-                        CH10_BLOCK_SIZE;
+                        Vcb->BytesPerBlock;
 
                     Buffer->CallerAvailableAllocationUnits.QuadPart =
                     Buffer->ActualAvailableAllocationUnits.QuadPart =
                         (Vcb->PartitionInformation.PartitionLength.QuadPart -
-                        FsdCh10PartitionSize(&Vcb->dirblocks[0])) / CH10_BLOCK_SIZE;
+                        FsdCh10PartitionSize(&Vcb->dirblocks[0])) / Vcb->BytesPerBlock;
                 }
                 else
 #endif // !FSD_RO
@@ -336,7 +336,7 @@ FsdQueryVolumeInformation (
                     // contents and available size is zero
 
                     Buffer->TotalAllocationUnits.QuadPart =
-                        FsdCh10PartitionSize(&Vcb->dirblocks[0]) / CH10_BLOCK_SIZE;
+                        FsdCh10PartitionSize(&Vcb->dirblocks[0]) / Vcb->BytesPerBlock;
 
                     Buffer->CallerAvailableAllocationUnits.QuadPart =
                     Buffer->ActualAvailableAllocationUnits.QuadPart =
@@ -344,9 +344,9 @@ FsdQueryVolumeInformation (
                 }
 
                 Buffer->SectorsPerAllocationUnit =
-                    CH10_BLOCK_SIZE / Vcb->DiskGeometry.BytesPerSector;
+                    max(Vcb->BytesPerBlock / Vcb->BytesPerSector, 1);
 
-                Buffer->BytesPerSector = Vcb->DiskGeometry.BytesPerSector;
+                Buffer->BytesPerSector = Vcb->BytesPerSector;
 
                 Irp->IoStatus.Information = sizeof(FILE_FS_FULL_SIZE_INFORMATION);
                 Status = STATUS_SUCCESS;
@@ -0,0 +1,556 @@
+/*
+    This is a IRIG 106 Chapter 10 file system driver for Windows XP/7.
+	Copyright (C) 2014 Arthur Walton.
+
+	Heavily derived from the RomFS filesystem driver 
+    Copyright (C) 1999, 2000, 2001, 2002 Bo Brantn.
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "ntifs.h"
+#include "fsd.h"
+#include "ch10_fs.h"
+#include "border.h"
+
+
+//
+// The worker threads that run requests which could not be completed in the
+// thread that sent them. Every volume has its own queue and at most
+// FSD_WORKERS_PER_VOLUME of the threads run requests for one volume, so a
+// slow device does not hold up the others. Deferred closes are kept apart
+// and run in batches, they only free memory and do not count against the
+// limit of the volume.
+//
+
+static VOID
+FsdWorkerThread (
+    IN PVOID Context
+    );
+
+#pragma code_seg(FSD_INIT_CODE)
+
+NTSTATUS
+FsdWorkerPoolInitialize (
+    VOID
+    )
+{
+    PFSD_WORKER_POOL    Pool = &FsdGlobalData.WorkerPool;
+    HANDLE              ThreadHandle;
+    NTSTATUS            Status = STATUS_SUCCESS;
+    ULONG               i;
+
+    KeInitializeSpinLock(&Pool->Lock);
+
+    InitializeListHead(&Pool->ReadyList);
+
+    KeInitializeSemaphore(&Pool->WorkAvailable, 0, MAXLONG);
+
+    InitializeListHead(&Pool->GlobalQueue.Requests);
+    InitializeListHead(&Pool->GlobalQueue.Closes);
+
+    // Never freed
+    Pool->GlobalQueue.ReferenceCount = 1;
+
+    for (i = 0; i < FSD_WORKER_THREADS; i++)
+    {
+        Status = PsCreateSystemThread(
+            &ThreadHandle,
+            THREAD_ALL_ACCESS,
+            NULL,
+            NULL,
+            NULL,
+            FsdWorkerThread,
+            NULL
+            );
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Status = ObReferenceObjectByHandle(
+            ThreadHandle,
+            THREAD_ALL_ACCESS,
+            NULL,
+            KernelMode,
+            (PVOID*) &Pool->Threads[i],
+            NULL
+            );
+
+        ZwClose(ThreadHandle);
+
+        if (!NT_SUCCESS(Status))
+        {
+            break;
+        }
+
+        Pool->ThreadCount++;
+    }
+
+    //
+    // Fewer threads will do, none will not
+    //
+    if (Pool->ThreadCount == 0)
+    {
+        return Status;
+    }
+
+    KdPrint((DRIVER_NAME ": %u worker threads\n", Pool->ThreadCount));
+
+    return STATUS_SUCCESS;
+}
+
+#pragma code_seg(FSD_PAGED_CODE)
+
+VOID
+FsdWorkerPoolUninitialize (
+    VOID
+    )
+{
+    PFSD_WORKER_POOL    Pool = &FsdGlobalData.WorkerPool;
+    ULONG               i;
+
+    PAGED_CODE();
+
+    Pool->Stopping = TRUE;
+
+    if (Pool->ThreadCount == 0)
+    {
+        return;
+    }
+
+    KeReleaseSemaphore(
+        &Pool->WorkAvailable,
+        IO_NO_INCREMENT,
+        Pool->ThreadCount,
+        FALSE
+        );
+
+    for (i = 0; i < Pool->ThreadCount; i++)
+    {
+        KeWaitForSingleObject(
+            Pool->Threads[i],
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL
+            );
+
+        ObDereferenceObject(Pool->Threads[i]);
+    }
+
+    Pool->ThreadCount = 0;
+}
+
+PFSD_WORK_QUEUE
+FsdAllocateWorkQueue (
+    VOID
+    )
+{
+    PFSD_WORK_QUEUE WorkQueue;
+
+    PAGED_CODE();
+
+    WorkQueue = (PFSD_WORK_QUEUE) FsdAllocatePool(
+        NonPagedPool,
+        sizeof(FSD_WORK_QUEUE),
+        'qWeR'
+        );
+
+    if (WorkQueue == NULL)
+    {
+        return NULL;
+    }
+
+    RtlZeroMemory(WorkQueue, sizeof(FSD_WORK_QUEUE));
+
+    InitializeListHead(&WorkQueue->Requests);
+    InitializeListHead(&WorkQueue->Closes);
+
+    WorkQueue->ReferenceCount = 1;
+
+    return WorkQueue;
+}
+
+#pragma code_seg() // end FSD_PAGED_CODE
+
+//
+// Put a queue on the ready list if a worker may take something from it,
+// called with the pool lock held
+//
+static VOID
+FsdReadyWorkQueue (
+    IN PFSD_WORKER_POOL Pool,
+    IN PFSD_WORK_QUEUE  WorkQueue
+    )
+{
+    if (WorkQueue->Ready)
+    {
+        return;
+    }
+
+    if (!IsListEmpty(&WorkQueue->Closes) ||
+        (!IsListEmpty(&WorkQueue->Requests) &&
+         WorkQueue->Active < FSD_WORKERS_PER_VOLUME))
+    {
+        InsertTailList(&Pool->ReadyList, &WorkQueue->ReadyLink);
+
+        WorkQueue->Ready = TRUE;
+    }
+}
+
+//
+// Take a request off a queue, called with the pool lock held
+//
+static PFSD_IRP_CONTEXT
+FsdRemoveWork (
+    IN PFSD_WORKER_POOL Pool,
+    IN PFSD_WORK_QUEUE  WorkQueue,
+    IN PLIST_ENTRY      List,
+    IN ULONGLONG        Now
+    )
+{
+    PFSD_IRP_CONTEXT    IrpContext;
+    ULONGLONG           WaitTime;
+
+    IrpContext = CONTAINING_RECORD(
+        RemoveHeadList(List),
+        FSD_IRP_CONTEXT,
+        WorkLink
+        );
+
+    WorkQueue->Depth--;
+
+    Pool->Depth--;
+
+    Pool->Dispatched++;
+
+    WaitTime = Now - IrpContext->QueueTime;
+
+    Pool->TotalWaitTime += WaitTime;
+
+    if (WaitTime > Pool->MaxWaitTime)
+    {
+        Pool->MaxWaitTime = WaitTime;
+    }
+
+    return IrpContext;
+}
+
+//
+// Take the next piece of work from the queue at the head of the ready
+// list, either one request or a batch of closes. The queue is referenced
+// until FsdCompleteWork.
+//
+static PFSD_WORK_QUEUE
+FsdGetWork (
+    OUT PLIST_ENTRY WorkList,
+    OUT PBOOLEAN    Close
+    )
+{
+    PFSD_WORKER_POOL    Pool = &FsdGlobalData.WorkerPool;
+    PFSD_WORK_QUEUE     WorkQueue;
+    PFSD_IRP_CONTEXT    IrpContext;
+    ULONGLONG           Now;
+    ULONG               Count;
+    KIRQL               Irql;
+
+    InitializeListHead(WorkList);
+
+    KeAcquireSpinLock(&Pool->Lock, &Irql);
+
+    if (IsListEmpty(&Pool->ReadyList))
+    {
+        KeReleaseSpinLock(&Pool->Lock, Irql);
+
+        return NULL;
+    }
+
+    WorkQueue = CONTAINING_RECORD(
+        RemoveHeadList(&Pool->ReadyList),
+        FSD_WORK_QUEUE,
+        ReadyLink
+        );
+
+    WorkQueue->Ready = FALSE;
+
+    Now = KeQueryInterruptTime();
+
+    if (!IsListEmpty(&WorkQueue->Closes))
+    {
+        *Close = TRUE;
+
+        for (Count = 0;
+             Count < FSD_CLOSE_BATCH && !IsListEmpty(&WorkQueue->Closes);
+             Count++)
+        {
+            IrpContext = FsdRemoveWork(Pool, WorkQueue, &WorkQueue->Closes, Now);
+
+            InsertTailList(WorkList, &IrpContext->WorkLink);
+        }
+
+        Pool->CloseBatches++;
+    }
+    else
+    {
+        *Close = FALSE;
+
+        IrpContext = FsdRemoveWork(Pool, WorkQueue, &WorkQueue->Requests, Now);
+
+        InsertTailList(WorkList, &IrpContext->WorkLink);
+
+        WorkQueue->Active++;
+    }
+
+    WorkQueue->ReferenceCount++;
+
+    //
+    // Whatever is left waits behind the other ready queues
+    //
+    FsdReadyWorkQueue(Pool, WorkQueue);
+
+    KeReleaseSpinLock(&Pool->Lock, Irql);
+
+    return WorkQueue;
+}
+
+static VOID
+FsdCompleteWork (
+    IN PFSD_WORK_QUEUE  WorkQueue,
+    IN BOOLEAN          Close
+    )
+{
+    PFSD_WORKER_POOL    Pool = &FsdGlobalData.WorkerPool;
+    KIRQL               Irql;
+
+    KeAcquireSpinLock(&Pool->Lock, &Irql);
+
+    if (!Close)
+    {
+        WorkQueue->Active--;
+    }
+
+    FsdReadyWorkQueue(Pool, WorkQueue);
+
+    KeReleaseSpinLock(&Pool->Lock, Irql);
+
+    FsdDereferenceWorkQueue(WorkQueue);
+}
+
+static VOID
+FsdWorkerThread (
+    IN PVOID Context
+    )
+{
+    PFSD_WORKER_POOL    Pool = &FsdGlobalData.WorkerPool;
+    PFSD_WORK_QUEUE     WorkQueue;
+    PFSD_IRP_CONTEXT    IrpContext;
+    LIST_ENTRY          WorkList;
+    BOOLEAN             Close;
+
+    KeSetPriorityThread(KeGetCurrentThread(), FSD_WORKER_PRIORITY);
+
+    for (;;)
+    {
+        KeWaitForSingleObject(
+            &Pool->WorkAvailable,
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL
+            );
+
+        if (Pool->Stopping)
+        {
+            break;
+        }
+
+        //
+        // The semaphore is only a hint, a request queued behind a busy
+        // volume is picked up by a worker of that volume when it is done
+        //
+        while ((WorkQueue = FsdGetWork(&WorkList, &Close)) != NULL)
+        {
+            while (!IsListEmpty(&WorkList))
+            {
+                IrpContext = CONTAINING_RECORD(
+                    RemoveHeadList(&WorkList),
+                    FSD_IRP_CONTEXT,
+                    WorkLink
+                    );
+
+                if (Close)
+                {
+                    FsdDeQueueCloseRequest(IrpContext);
+                }
+                else
+                {
+                    FsdDeQueueRequest(IrpContext);
+                }
+            }
+
+            FsdCompleteWork(WorkQueue, Close);
+        }
+    }
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+VOID
+FsdDereferenceWorkQueue (
+    IN PFSD_WORK_QUEUE WorkQueue
+    )
+{
+    PFSD_WORKER_POOL    Pool = &FsdGlobalData.WorkerPool;
+    BOOLEAN             FreeWorkQueue;
+    KIRQL               Irql;
+
+    KeAcquireSpinLock(&Pool->Lock, &Irql);
+
+    ASSERT(WorkQueue->ReferenceCount > 0);
+
+    FreeWorkQueue = (--WorkQueue->ReferenceCount == 0);
+
+    KeReleaseSpinLock(&Pool->Lock, Irql);
+
+    if (FreeWorkQueue)
+    {
+        ASSERT(!WorkQueue->Ready && WorkQueue->Depth == 0);
+
+        FsdFreePool(WorkQueue);
+    }
+}
+
+VOID
+FsdQueueWork (
+    IN PFSD_IRP_CONTEXT IrpContext,
+    IN BOOLEAN          Close
+    )
+{
+    PFSD_WORKER_POOL    Pool = &FsdGlobalData.WorkerPool;
+    PFSD_WORK_QUEUE     WorkQueue;
+    KIRQL               Irql;
+
+    ASSERT(IrpContext);
+
+    ASSERT((IrpContext->Identifier.Type == ICX) &&
+           (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+    if (IrpContext->DeviceObject == FsdGlobalData.DeviceObject)
+    {
+        WorkQueue = &Pool->GlobalQueue;
+    }
+    else
+    {
+        WorkQueue = ((PFSD_VCB) IrpContext->DeviceObject->DeviceExtension)->WorkQueue;
+    }
+
+    ASSERT(WorkQueue != NULL);
+
+    IrpContext->QueueTime = KeQueryInterruptTime();
+
+    KeAcquireSpinLock(&Pool->Lock, &Irql);
+
+    InsertTailList(
+        Close ? &WorkQueue->Closes : &WorkQueue->Requests,
+        &IrpContext->WorkLink
+        );
+
+    WorkQueue->Depth++;
+
+    Pool->Depth++;
+
+    if (Pool->Depth > Pool->MaxDepth)
+    {
+        Pool->MaxDepth = Pool->Depth;
+    }
+
+    Pool->Queued++;
+
+    FsdReadyWorkQueue(Pool, WorkQueue);
+
+    KeReleaseSpinLock(&Pool->Lock, Irql);
+
+    KeReleaseSemaphore(&Pool->WorkAvailable, IO_NO_INCREMENT, 1, FALSE);
+}
+
+NTSTATUS
+FsdQueryWorkerStatistics (
+    IN PFSD_IRP_CONTEXT IrpContext
+    )
+{
+    PFSD_WORKER_POOL            Pool = &FsdGlobalData.WorkerPool;
+    PIRP                        Irp;
+    PIO_STACK_LOCATION          IrpSp;
+    PFSD_WORKER_STATISTICS      Statistics;
+    PFSD_WORK_QUEUE             WorkQueue = NULL;
+    NTSTATUS                    Status;
+    KIRQL                       Irql;
+
+    ASSERT(IrpContext != NULL);
+
+    ASSERT((IrpContext->Identifier.Type == ICX) &&
+           (IrpContext->Identifier.Size == sizeof(FSD_IRP_CONTEXT)));
+
+    Irp = IrpContext->Irp;
+
+    IrpSp = IoGetCurrentIrpStackLocation(Irp);
+
+    if (IrpContext->DeviceObject != FsdGlobalData.DeviceObject)
+    {
+        WorkQueue = ((PFSD_VCB) IrpContext->DeviceObject->DeviceExtension)->WorkQueue;
+    }
+
+    if (IrpSp->Parameters.FileSystemControl.OutputBufferLength <
+        sizeof(FSD_WORKER_STATISTICS))
+    {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        Irp->IoStatus.Information = 0;
+    }
+    else
+    {
+        Statistics = (PFSD_WORKER_STATISTICS) Irp->AssociatedIrp.SystemBuffer;
+
+        RtlZeroMemory(Statistics, sizeof(FSD_WORKER_STATISTICS));
+
+        KeAcquireSpinLock(&Pool->Lock, &Irql);
+
+        Statistics->Queued = Pool->Queued;
+        Statistics->Dispatched = Pool->Dispatched;
+        Statistics->CloseBatches = Pool->CloseBatches;
+        Statistics->TotalWaitTime = Pool->TotalWaitTime;
+        Statistics->MaxWaitTime = Pool->MaxWaitTime;
+        Statistics->Threads = Pool->ThreadCount;
+        Statistics->Depth = Pool->Depth;
+        Statistics->MaxDepth = Pool->MaxDepth;
+
+        if (WorkQueue != NULL)
+        {
+            Statistics->VolumeDepth = WorkQueue->Depth;
+            Statistics->VolumeActive = WorkQueue->Active;
+        }
+
+        KeReleaseSpinLock(&Pool->Lock, Irql);
+
+        Status = STATUS_SUCCESS;
+        Irp->IoStatus.Information = sizeof(FSD_WORKER_STATISTICS);
+    }
+
+    Irp->IoStatus.Status = Status;
+
+    FsdCompleteRequest(Irp, IO_NO_INCREMENT);
+
+    FsdFreeIrpContext(IrpContext);
+
+    return Status;
+}
@@ -44,6 +44,9 @@
 /* The basic structures of the ch10fs filesystem */
 #define CH10_BLOCK_SIZE    512
 
+/* Largest block size accepted for a volume */
+#define CH10_MAX_BLOCK_SIZE (64 * 1024)
+
 #define CH10_MAXFN 48
 
 
@@ -20,6 +20,9 @@
 #ifndef _FSREC_
 #define _FSREC_
 
+#include <ntdddisk.h>
+#include <ntddstor.h>
+
 //
 // Name for the driver and it's device
 //
@@ -42,10 +45,53 @@
 #define FSR_INIT_CODE   "init"
 #define FSR_PAGED_CODE  "page"
 
+//
+// Devices recently found not to hold a Ch10 volume. The driver image is
+// pageable so the cache is allocated from nonpaged pool in DriverEntry.
+//
+#define FSR_PROBE_CACHE_SIZE        16
+#define FSR_PROBE_CACHE_LIFETIME    (10 * 1000 * 1000 * 10)
+
+//
+// Besides its device object a device is recognized by its media change
+// count, device and partition numbers and partition extent, so a device
+// object allocated again at the address of a removed one is probed afresh
+//
+typedef struct _FSR_PROBE_IDENTITY {
+    ULONG                   MediaChangeCount;
+    STORAGE_DEVICE_NUMBER   DeviceNumber;
+    LONGLONG                StartingOffset;
+    LONGLONG                PartitionLength;
+} FSR_PROBE_IDENTITY, *PFSR_PROBE_IDENTITY;
+
+typedef struct _FSR_PROBE_ENTRY {
+    PDEVICE_OBJECT      DeviceObject;
+    FSR_PROBE_IDENTITY  Identity;
+    ULONGLONG           Expires;
+} FSR_PROBE_ENTRY, *PFSR_PROBE_ENTRY;
+
+typedef struct _FSR_PROBE_CACHE {
+    FAST_MUTEX      Mutex;
+    FSR_PROBE_ENTRY Entries[FSR_PROBE_CACHE_SIZE];
+    ULONG           Next;
+} FSR_PROBE_CACHE, *PFSR_PROBE_CACHE;
+
+extern PFSR_PROBE_CACHE FsrProbeCache;
+
 //
 // Function prototypes from blockdev.c
 //
 
+NTSTATUS
+FsrBlockDeviceIoControl (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            IoctlCode,
+    IN PVOID            InputBuffer,
+    IN ULONG            InputBufferSize,
+    IN OUT PVOID        OutputBuffer,
+    IN OUT PULONG       OutputBufferSize
+    );
+
 NTSTATUS
 FsrReadBlockDevice (
     IN PDEVICE_OBJECT   DeviceObject,
@@ -84,4 +130,22 @@ FsrIsDeviceCh10fs (
     IN PDEVICE_OBJECT   DeviceObject
     );
 
+BOOLEAN
+FsrGetProbeIdentity (
+    IN PDEVICE_OBJECT       DeviceObject,
+    OUT PFSR_PROBE_IDENTITY Identity
+    );
+
+BOOLEAN
+FsrProbeCacheLookup (
+    IN PDEVICE_OBJECT       DeviceObject,
+    IN PFSR_PROBE_IDENTITY  Identity
+    );
+
+VOID
+FsrProbeCacheInsert (
+    IN PDEVICE_OBJECT       DeviceObject,
+    IN PFSR_PROBE_IDENTITY  Identity
+    );
+
 #endif
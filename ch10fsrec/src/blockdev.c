@@ -22,6 +22,72 @@
 
 #pragma code_seg(FSR_PAGED_CODE)
 
+NTSTATUS
+FsrBlockDeviceIoControl (
+    IN PDEVICE_OBJECT   DeviceObject,
+    IN ULONG            IoctlCode,
+    IN PVOID            InputBuffer,
+    IN ULONG            InputBufferSize,
+    IN OUT PVOID        OutputBuffer,
+    IN OUT PULONG       OutputBufferSize
+    )
+{
+    ULONG           OutputBufferSize2 = 0;
+    KEVENT          Event;
+    PIRP            Irp;
+    IO_STATUS_BLOCK IoStatus;
+    NTSTATUS        Status;
+
+    PAGED_CODE();
+
+    ASSERT(DeviceObject != NULL);
+
+    if (OutputBufferSize)
+    {
+        OutputBufferSize2 = *OutputBufferSize;
+    }
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+
+    Irp = IoBuildDeviceIoControlRequest(
+        IoctlCode,
+        DeviceObject,
+        InputBuffer,
+        InputBufferSize,
+        OutputBuffer,
+        OutputBufferSize2,
+        FALSE,
+        &Event,
+        &IoStatus
+        );
+
+    if (!Irp)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Status = IoCallDriver(DeviceObject, Irp);
+
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(
+            &Event,
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL
+            );
+        Status = IoStatus.Status;
+    }
+
+    if (OutputBufferSize)
+    {
+        *OutputBufferSize = (ULONG) IoStatus.Information;
+    }
+
+    return Status;
+}
+
 NTSTATUS
 FsrReadBlockDevice (
     IN PDEVICE_OBJECT   DeviceObject,
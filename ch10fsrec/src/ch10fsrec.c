@@ -20,43 +20,349 @@
 #include "ntifs.h"
 #include "fsrec.h"
 #include "ch10_fs.h"
+#include "border.h"
 
-#pragma code_seg(FSD_PAGED_CODE)
+#pragma code_seg(FSR_PAGED_CODE)
 
+//
+// Same as FsdGetProbeIdentity in the FSD
+//
+BOOLEAN
+FsrGetProbeIdentity (
+    IN PDEVICE_OBJECT       DeviceObject,
+    OUT PFSR_PROBE_IDENTITY Identity
+    )
+{
+    PARTITION_INFORMATION_EX    PartitionInformation;
+    ULONG                       OutputBufferSize;
+    NTSTATUS                    Status;
+
+    PAGED_CODE();
+
+    RtlZeroMemory(Identity, sizeof(FSR_PROBE_IDENTITY));
+
+    OutputBufferSize = sizeof(ULONG);
+
+    Status = FsrBlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_CHECK_VERIFY,
+        NULL,
+        0,
+        &Identity->MediaChangeCount,
+        &OutputBufferSize
+        );
+
+    if (!NT_SUCCESS(Status) || OutputBufferSize != sizeof(ULONG))
+    {
+        return FALSE;
+    }
+
+    OutputBufferSize = sizeof(STORAGE_DEVICE_NUMBER);
+
+    Status = FsrBlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_STORAGE_GET_DEVICE_NUMBER,
+        NULL,
+        0,
+        &Identity->DeviceNumber,
+        &OutputBufferSize
+        );
+
+    if (!NT_SUCCESS(Status))
+    {
+        RtlZeroMemory(&Identity->DeviceNumber, sizeof(STORAGE_DEVICE_NUMBER));
+    }
+
+    OutputBufferSize = sizeof(PARTITION_INFORMATION_EX);
+
+    Status = FsrBlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_GET_PARTITION_INFO_EX,
+        NULL,
+        0,
+        &PartitionInformation,
+        &OutputBufferSize
+        );
+
+    if (NT_SUCCESS(Status))
+    {
+        Identity->StartingOffset = PartitionInformation.StartingOffset.QuadPart;
+        Identity->PartitionLength = PartitionInformation.PartitionLength.QuadPart;
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+FsrProbeCacheLookup (
+    IN PDEVICE_OBJECT       DeviceObject,
+    IN PFSR_PROBE_IDENTITY  Identity
+    )
+{
+    PFSR_PROBE_ENTRY    Entry;
+    ULONGLONG           Now;
+    BOOLEAN             Found = FALSE;
+    ULONG               i;
+
+    PAGED_CODE();
+
+    if (!FsrProbeCache)
+    {
+        return FALSE;
+    }
+
+    Now = KeQueryInterruptTime();
+
+    ExAcquireFastMutex(&FsrProbeCache->Mutex);
+
+    for (i = 0; i < FSR_PROBE_CACHE_SIZE; i++)
+    {
+        Entry = &FsrProbeCache->Entries[i];
+
+        if (Entry->DeviceObject != DeviceObject)
+        {
+            continue;
+        }
+
+        if (RtlEqualMemory(&Entry->Identity, Identity, sizeof(FSR_PROBE_IDENTITY)) &&
+            Entry->Expires > Now)
+        {
+            Found = TRUE;
+        }
+        else
+        {
+            Entry->DeviceObject = NULL;
+        }
+
+        break;
+    }
+
+    ExReleaseFastMutex(&FsrProbeCache->Mutex);
+
+    return Found;
+}
+
+VOID
+FsrProbeCacheInsert (
+    IN PDEVICE_OBJECT       DeviceObject,
+    IN PFSR_PROBE_IDENTITY  Identity
+    )
+{
+    PFSR_PROBE_ENTRY    Entry = NULL;
+    ULONGLONG           Now;
+    ULONG               i;
+
+    PAGED_CODE();
+
+    if (!FsrProbeCache)
+    {
+        return;
+    }
+
+    Now = KeQueryInterruptTime();
+
+    ExAcquireFastMutex(&FsrProbeCache->Mutex);
+
+    for (i = 0; i < FSR_PROBE_CACHE_SIZE; i++)
+    {
+        if (FsrProbeCache->Entries[i].DeviceObject == DeviceObject)
+        {
+            Entry = &FsrProbeCache->Entries[i];
+            break;
+        }
+
+        if (Entry == NULL &&
+            (FsrProbeCache->Entries[i].DeviceObject == NULL ||
+             FsrProbeCache->Entries[i].Expires <= Now))
+        {
+            Entry = &FsrProbeCache->Entries[i];
+        }
+    }
+
+    if (Entry == NULL)
+    {
+        Entry = &FsrProbeCache->Entries[FsrProbeCache->Next];
+        FsrProbeCache->Next = (FsrProbeCache->Next + 1) % FSR_PROBE_CACHE_SIZE;
+    }
+
+    Entry->DeviceObject = DeviceObject;
+    Entry->Identity = *Identity;
+    Entry->Expires = Now + FSR_PROBE_CACHE_LIFETIME;
+
+    ExReleaseFastMutex(&FsrProbeCache->Mutex);
+}
+
+//
+// Same checks as FsdIsValidRootDirBlock in the FSD
+//
+static BOOLEAN
+FsrIsValidRootDirBlock (
+    IN struct ch10_dir_block*   DirBlock,
+    IN ULONGLONG                DeviceSize
+    )
+{
+    ULONG       BytesPerBlock;
+    ULONGLONG   ForwardLink;
+
+    if (RtlCompareMemory(DirBlock->magicNumAscii, CH10_MAGIC, sizeof(CH10_MAGIC) - 1) !=
+        (sizeof(CH10_MAGIC) - 1))
+    {
+        return FALSE;
+    }
+
+    if (DirBlock->revNum == 0 || DirBlock->revNum == 0xff)
+    {
+        return FALSE;
+    }
+
+    if (be16_to_cpu(DirBlock->numEntries) > MAX_FILES_PER_DIR)
+    {
+        return FALSE;
+    }
+
+    BytesPerBlock = be32_to_cpu(DirBlock->bytesPerBlock);
+
+    if (BytesPerBlock < SECTOR_SIZE ||
+        BytesPerBlock > CH10_MAX_BLOCK_SIZE ||
+        (BytesPerBlock & (BytesPerBlock - 1)) != 0)
+    {
+        return FALSE;
+    }
+
+    if (be64_to_cpu(DirBlock->reverseLink) != 1)
+    {
+        return FALSE;
+    }
+
+    ForwardLink = be64_to_cpu(DirBlock->forwardLink);
+
+    if (ForwardLink == 0 ||
+        (DeviceSize != 0 && ForwardLink >= DeviceSize / BytesPerBlock))
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+//
+// Reads the start of the device in one request and checks the root
+// directory block of each block size in it. A device that was found not
+// to hold a Ch10 volume is not read again until its media changes or the
+// cache entry expires.
+//
 NTSTATUS
 FsrIsDeviceCh10fs (
     IN PDEVICE_OBJECT DeviceObject
     )
 {
+    DISK_GEOMETRY   DiskGeometry;
+    ULONG           OutputBufferSize;
+    ULONG           BytesPerSector = SECTOR_SIZE;
+    ULONGLONG       DeviceSize = 0;
+    FSR_PROBE_IDENTITY Identity;
+    BOOLEAN         Cacheable;
     PUCHAR          Buffer;
+    ULONG           BlockOffset;
+    ULONG           ProbeLength;
     LARGE_INTEGER   Offset;
+    struct ch10_dir_block* RootBlock;
+    NTSTATUS        ReadStatus;
     NTSTATUS        Status;
-	int i;
+
+    PAGED_CODE();
 
     ASSERT(DeviceObject != NULL);
 
-    Buffer = ExAllocatePool(NonPagedPoolCacheAligned, SECTOR_SIZE);
+    Cacheable = FsrGetProbeIdentity(DeviceObject, &Identity);
+
+    if (Cacheable && FsrProbeCacheLookup(DeviceObject, &Identity))
+    {
+        return STATUS_UNRECOGNIZED_VOLUME;
+    }
+
+    OutputBufferSize = sizeof(DISK_GEOMETRY);
+
+    Status = FsrBlockDeviceIoControl(
+        DeviceObject,
+        IOCTL_DISK_GET_DRIVE_GEOMETRY,
+        NULL,
+        0,
+        &DiskGeometry,
+        &OutputBufferSize
+        );
+
+    if (NT_SUCCESS(Status))
+    {
+        if (DiskGeometry.BytesPerSector >= SECTOR_SIZE &&
+            (DiskGeometry.BytesPerSector & (DiskGeometry.BytesPerSector - 1)) == 0)
+        {
+            BytesPerSector = DiskGeometry.BytesPerSector;
+        }
+
+        DeviceSize =
+            DiskGeometry.Cylinders.QuadPart *
+            DiskGeometry.TracksPerCylinder *
+            DiskGeometry.SectorsPerTrack *
+            DiskGeometry.BytesPerSector;
+    }
+
+    //
+    // The root directory block is block 1, so where it is depends on the
+    // block size. One read from the start of the device to past block 1 of
+    // the largest block size holds it for every block size, and is cut
+    // short on a device too small for that.
+    //
+    ProbeLength = (CH10_MAX_BLOCK_SIZE + sizeof(struct ch10_dir_block) + BytesPerSector - 1) &
+        ~(BytesPerSector - 1);
+
+    if (DeviceSize != 0 && DeviceSize < ProbeLength)
+    {
+        ProbeLength = (ULONG) DeviceSize & ~(BytesPerSector - 1);
+    }
+
+    if (ProbeLength < CH10_MAGIC_OFFSET + sizeof(struct ch10_dir_block))
+    {
+        return STATUS_UNRECOGNIZED_VOLUME;
+    }
+
+    Buffer = ExAllocatePool(NonPagedPoolCacheAligned, ProbeLength);
 
     if (!Buffer)
     {
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
+    Status = STATUS_UNRECOGNIZED_VOLUME;
+
+    Offset.QuadPart = 0;
+
+    ReadStatus = FsrReadBlockDevice(
+        DeviceObject,
+        &Offset,
+        ProbeLength,
+        Buffer
+        );
 
-	Offset.QuadPart = CH10_MAGIC_OFFSET;
+    for (BlockOffset = CH10_MAGIC_OFFSET;
+         NT_SUCCESS(ReadStatus) &&
+         BlockOffset <= CH10_MAX_BLOCK_SIZE &&
+         BlockOffset + sizeof(struct ch10_dir_block) <= ProbeLength;
+         BlockOffset *= 2)
+    {
+        RootBlock = (struct ch10_dir_block*) (Buffer + BlockOffset);
+
+        if (be32_to_cpu(RootBlock->bytesPerBlock) == BlockOffset &&
+            FsrIsValidRootDirBlock(RootBlock, DeviceSize))
+        {
+            Status = STATUS_SUCCESS;
+            break;
+        }
+    }
 
-	Status = FsrReadBlockDevice(
-		DeviceObject,
-		&Offset,
-		SECTOR_SIZE,
-		Buffer
-		);
-	
-    if (!NT_SUCCESS(Status) ||
-        RtlCompareMemory(Buffer, CH10_MAGIC, sizeof(CH10_MAGIC) - 1) != (sizeof(CH10_MAGIC) - 1)
-        )
+    if (!NT_SUCCESS(Status) && NT_SUCCESS(ReadStatus) && Cacheable)
     {
-        Status = STATUS_UNRECOGNIZED_VOLUME;
+        FsrProbeCacheInsert(DeviceObject, &Identity);
     }
 
     ExFreePool(Buffer);
@@ -73,4 +379,4 @@ FsdIsDeviceSameCh10fs (
 	return STATUS_SUCCESS;
 }
 
-#pragma code_seg() // end FSD_PAGED_CODE
+#pragma code_seg() // end FSR_PAGED_CODE
@@ -20,6 +20,8 @@
 #include "ntifs.h"
 #include "fsrec.h"
 
+PFSR_PROBE_CACHE FsrProbeCache = NULL;
+
 #pragma code_seg(FSR_INIT_CODE)
 
 NTSTATUS
@@ -37,6 +39,17 @@ DriverEntry (
     DriverObject->MajorFunction[IRP_MJ_FILE_SYSTEM_CONTROL] =
         FsrFileSystemControl;
 
+    //
+    // Without the cache every mount request is probed
+    //
+    FsrProbeCache = ExAllocatePool(NonPagedPool, sizeof(FSR_PROBE_CACHE));
+
+    if (FsrProbeCache)
+    {
+        RtlZeroMemory(FsrProbeCache, sizeof(FSR_PROBE_CACHE));
+        ExInitializeFastMutex(&FsrProbeCache->Mutex);
+    }
+
     RtlInitUnicodeString(&DeviceName, DEVICE_NAME);
 
     Status = IoCreateDevice(
@@ -67,6 +80,12 @@ DriverUnload (
     )
 {
     KdPrint((DRIVER_NAME ": Unloading driver\n"));
+
+    if (FsrProbeCache)
+    {
+        ExFreePool(FsrProbeCache);
+        FsrProbeCache = NULL;
+    }
 }
 
 NTSTATUS
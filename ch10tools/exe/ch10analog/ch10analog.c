@@ -0,0 +1,446 @@
+/*
+    Program to plot Chapter 10 analog channels from the index sidecar.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Without a channel lists the analog subchannels of a recording that the
+// index sidecar has min/max pyramids for. With one it answers a plot query
+// for a range of relative time at a width in points from the pyramid and
+// prints the level used, the time taken and, with -p, the points. With -v
+// it also reads every sample of the range from the recording and checks
+// the points against them, timing both. Output is a JSON document.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+#define MAX_WIDTH           65536
+
+typedef struct _VERIFY_POINT {
+    __s32   Min;
+    __s32   Max;
+    __u64   Samples;
+} VERIFY_POINT;
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10analog [options] <image> <recording>\n"
+        "  -c <channel>    channel to plot, without it lists the channels\n"
+        "  -u <number>     subchannel, from 0 (0)\n"
+        "  -w <points>     width of the plot (1920)\n"
+        "  -r <first>,<last>  range of relative time (all)\n"
+        "  -p              print the points\n"
+        "  -v              check the points against every sample of the range\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image\n"
+        );
+}
+
+static int
+ListChannels (
+    CH10_VOLUME *Volume,
+    const char  *Image,
+    __u32       FileIndex
+    )
+{
+    const struct ch10_index_analog  *Analog;
+    __u64                           Number;
+    __u64                           Span;
+    int                             First = 1;
+
+    printf(
+        "{\"image\": \"%s\", \"recording\": \"%s\", \"channels\": [",
+        Image,
+        Volume->Files[FileIndex].Name
+        );
+
+    for (Number = 0; Number < Volume->Index->AnalogCount; Number++)
+    {
+        Analog = &Volume->Index->Analog[Number];
+
+        if (le32_to_cpu(Analog->fileIndex) != FileIndex)
+        {
+            continue;
+        }
+
+        Span = le64_to_cpu(Analog->lastRtc) - le64_to_cpu(Analog->firstRtc);
+
+        printf(
+            "%s\n  {\"channel\": %u, \"subchannel\": %u, \"samples\": %llu, \"levels\": %u, "
+            "\"baseShift\": %u, \"firstRtc\": %llu, \"lastRtc\": %llu, \"sampleRate\": %.1f}",
+            First ? "" : ",",
+            le16_to_cpu(Analog->channelId),
+            Analog->subchannel,
+            (unsigned long long) le64_to_cpu(Analog->sampleCount),
+            Analog->levelCount,
+            Analog->baseShift,
+            (unsigned long long) le64_to_cpu(Analog->firstRtc),
+            (unsigned long long) le64_to_cpu(Analog->lastRtc),
+            Span ? (double) le64_to_cpu(Analog->lastSample) * CH10_RTC_HZ / Span : 0.0
+            );
+
+        First = 0;
+    }
+
+    printf("]}\n");
+
+    return 0;
+}
+
+//
+// Reads every analog packet of the channel and sums up the samples that
+// fall on each point. Returns the number of samples read.
+//
+static __s64
+ReadSamples (
+    CH10_VOLUME                     *Volume,
+    __u32                           FileIndex,
+    const struct ch10_index_analog  *Analog,
+    const CH10_ANALOG_POINT         *Points,
+    __u32                           Count,
+    VERIFY_POINT                    *Verify
+    )
+{
+    const struct ch10_index_packet  *Packets;
+    const struct ch10_packet_header *Header;
+    ssize_t                         PacketCount;
+    ssize_t                         Packet;
+    ssize_t                         Result;
+    __s16                           *Samples;
+    __u8                            *Buffer;
+    __u64                           Sample = 0;
+    __u64                           Last = Points[Count - 1].Sample + Points[Count - 1].Samples;
+    __u64                           Read = 0;
+    __u32                           Subchannels;
+    __u32                           Point = 0;
+    int                             Decoded;
+    int                             Index;
+
+    PacketCount = Ch10GetFilePackets(Volume, FileIndex, &Packets);
+
+    if (PacketCount < 0)
+    {
+        return PacketCount;
+    }
+
+    Buffer = malloc(CH10_MAX_PACKET_SIZE);
+    Samples = malloc(CH10_MAX_PACKET_SIZE);
+
+    if (Buffer == NULL || Samples == NULL)
+    {
+        free(Buffer);
+        free(Samples);
+        return -ENOMEM;
+    }
+
+    for (Point = 0; Point < Count; Point++)
+    {
+        Verify[Point].Min = 0x7fffffff;
+        Verify[Point].Max = -0x7fffffff - 1;
+        Verify[Point].Samples = 0;
+    }
+
+    Point = 0;
+
+    for (Packet = 0; Packet < PacketCount && Sample < Last; Packet++)
+    {
+        if (Packets[Packet].dataType != CH10_DATA_ANALOG_F1 ||
+            Packets[Packet].channelId != Analog->channelId)
+        {
+            continue;
+        }
+
+        Result = Ch10ReadFileData(
+            Volume,
+            FileIndex,
+            le64_to_cpu(Packets[Packet].offset),
+            le32_to_cpu(Packets[Packet].packetLength),
+            Buffer
+            );
+
+        if (Result < (ssize_t) le32_to_cpu(Packets[Packet].packetLength))
+        {
+            free(Buffer);
+            free(Samples);
+            return Result < 0 ? Result : -EIO;
+        }
+
+        Header = (const struct ch10_packet_header *) Buffer;
+
+        Decoded = Ch10DecodeAnalog(Header, Samples, CH10_MAX_PACKET_SIZE / sizeof(__s16), &Subchannels);
+
+        for (Index = Analog->subchannel; Index < Decoded; Index += (int) Subchannels, Sample++)
+        {
+            while (Point < Count && Sample >= Points[Point].Sample + Points[Point].Samples)
+            {
+                Point++;
+            }
+
+            if (Point == Count || Sample < Points[Point].Sample)
+            {
+                continue;
+            }
+
+            if (Samples[Index] < Verify[Point].Min)
+            {
+                Verify[Point].Min = Samples[Index];
+            }
+
+            if (Samples[Index] > Verify[Point].Max)
+            {
+                Verify[Point].Max = Samples[Index];
+            }
+
+            Verify[Point].Samples++;
+            Read++;
+        }
+    }
+
+    free(Buffer);
+    free(Samples);
+
+    return (__s64) Read;
+}
+
+int main(int argc, char* argv[])
+{
+    const struct ch10_index_analog  *Analog;
+    CH10_VOLUME                     *Volume;
+    CH10_ANALOG_POINT               *Points;
+    VERIFY_POINT                    *Verify = NULL;
+    char                            *End;
+    __u64                           FirstRtc = 0;
+    __u64                           LastRtc = ~0ULL;
+    __u32                           Width = 1920;
+    __u32                           Subchannel = 0;
+    __u32                           FileIndex;
+    __u32                           Level;
+    __u32                           Point;
+    __u32                           Contained = 0;
+    __u32                           Exact = 0;
+    __s64                           Read = 0;
+    long                            Channel = -1;
+    int                             Flags = CH10_OPEN_DIRECT | CH10_OPEN_INDEX;
+    int                             Print = 0;
+    int                             Check = 0;
+    int                             Option;
+    int                             Count;
+    double                          Start;
+    double                          QuerySeconds;
+    double                          ReadSeconds = 0;
+    int                             Status;
+
+    while ((Option = getopt(argc, argv, "c:u:w:r:pvBmh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'c': Channel = strtol(optarg, NULL, 0); break;
+        case 'u': Subchannel = (__u32) strtoul(optarg, NULL, 0); break;
+        case 'w': Width = (__u32) strtoul(optarg, NULL, 0); break;
+        case 'p': Print = 1; break;
+        case 'v': Check = 1; break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP | CH10_OPEN_INDEX; break;
+        case 'r':
+            FirstRtc = strtoull(optarg, &End, 0);
+
+            if (*End != ',')
+            {
+                Usage();
+                return -1;
+            }
+
+            LastRtc = strtoull(End + 1, NULL, 0);
+            break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind + 2 != argc || Width == 0 || Width > MAX_WIDTH || Channel > 0xffff)
+    {
+        Usage();
+        return -1;
+    }
+
+    Status = Ch10MountVolume(argv[optind], Flags, &Volume);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10analog: %s: %s\n", argv[optind], strerror(-Status));
+        return -1;
+    }
+
+    Status = Ch10LookupFileName(Volume, argv[optind + 1], &FileIndex);
+
+    if (!Status && (Volume->Index == NULL || Volume->Index->Analog == NULL))
+    {
+        fprintf(stderr, "ch10analog: %s: no analog pyramids, run ch10index\n", argv[optind]);
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10analog: %s: %s\n", argv[optind + 1], strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    if (Channel < 0)
+    {
+        ListChannels(Volume, argv[optind], FileIndex);
+        Ch10DismountVolume(Volume);
+        return 0;
+    }
+
+    Points = calloc(Width, sizeof(CH10_ANALOG_POINT));
+
+    if (Check)
+    {
+        Verify = calloc(Width, sizeof(VERIFY_POINT));
+    }
+
+    Status = Points == NULL || (Check && Verify == NULL) ? -ENOMEM :
+        Ch10FindAnalog(Volume, FileIndex, (__u16) Channel, Subchannel, &Analog);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10analog: %s: %s\n", argv[optind + 1], strerror(-Status));
+        free(Points);
+        free(Verify);
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Start = Now();
+
+    Count = Ch10QueryAnalog(Volume, Analog, FirstRtc, LastRtc, Width, Points, &Level);
+
+    QuerySeconds = Now() - Start;
+
+    if (Check && Count > 0)
+    {
+        Start = Now();
+
+        Read = ReadSamples(Volume, FileIndex, Analog, Points, (__u32) Count, Verify);
+
+        ReadSeconds = Now() - Start;
+
+        if (Read < 0)
+        {
+            fprintf(stderr, "ch10analog: %s: %s\n", argv[optind + 1], strerror((int) -Read));
+            free(Points);
+            free(Verify);
+            Ch10DismountVolume(Volume);
+            return -1;
+        }
+
+        //
+        // A point sums up whole records, so it holds the samples that fall
+        // on it and is exact when its edges are those of records
+        //
+        for (Point = 0; Point < (__u32) Count; Point++)
+        {
+            if (Verify[Point].Samples == Points[Point].Samples &&
+                Points[Point].Min <= Verify[Point].Min &&
+                Points[Point].Max >= Verify[Point].Max)
+            {
+                Contained++;
+                Exact += Points[Point].Min == Verify[Point].Min && Points[Point].Max == Verify[Point].Max;
+            }
+        }
+    }
+
+    printf(
+        "{\"image\": \"%s\", \"recording\": \"%s\", \"channel\": %ld, \"subchannel\": %u, "
+        "\"samples\": %llu, \"levels\": %u, \"level\": %u, \"points\": %d, \"querySeconds\": %.6f",
+        argv[optind],
+        argv[optind + 1],
+        Channel,
+        Subchannel,
+        (unsigned long long) le64_to_cpu(Analog->sampleCount),
+        Analog->levelCount,
+        Level,
+        Count,
+        QuerySeconds
+        );
+
+    if (Check)
+    {
+        printf(
+            ", \"verify\": {\"samples\": %lld, \"contained\": %u, \"exact\": %u, \"readSeconds\": %.3f}",
+            (long long) Read,
+            Contained,
+            Exact,
+            ReadSeconds
+            );
+    }
+
+    if (Print)
+    {
+        printf(", \"plot\": [");
+
+        for (Point = 0; Point < (__u32) (Count > 0 ? Count : 0); Point++)
+        {
+            printf(
+                "%s\n  {\"rtc\": %llu, \"samples\": %llu, \"min\": %d, \"max\": %d, \"mean\": %d}",
+                Point ? "," : "",
+                (unsigned long long) Points[Point].Rtc,
+                (unsigned long long) Points[Point].Samples,
+                Points[Point].Min,
+                Points[Point].Max,
+                Points[Point].Mean
+                );
+        }
+
+        printf("]");
+    }
+
+    printf("}\n");
+
+    free(Points);
+    free(Verify);
+    Ch10DismountVolume(Volume);
+
+    return Check && Contained != (__u32) Count ? -1 : 0;
+}
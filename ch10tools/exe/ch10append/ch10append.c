@@ -0,0 +1,217 @@
+/*
+    Program to append a recording to a Chapter 10 volume.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+//
+// Copies a Chapter 10 stream, from a file or standard input, onto the end
+// of a volume as a new recording. The blocks for it are reserved before
+// the copy starts: as many as the source file holds, what -r says, or the
+// rest of the device. Output is a JSON document with the write rate.
+// -x stops after that many bytes without closing the recording, which
+// leaves the volume as a recorder losing power would.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ch10lib.h"
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10append [options] <image> <name> [<source>]\n"
+        "  -r <bytes>      bytes to reserve (size of the source, or the rest of the device)\n"
+        "  -s <bytes>      size of the reads of the source (8M)\n"
+        "  -x <bytes>      abandon the recording after this many bytes\n"
+        "  -B              write through the page cache instead of direct I/O\n"
+        );
+}
+
+int main(int argc, char* argv[])
+{
+    CH10_APPEND Append;
+    const char  *SourcePath = NULL;
+    char        *Buffer;
+    struct stat Stat;
+    size_t      ReadSize = CH10_APPEND_BUFFER_SIZE;
+    __u64       Reserve = 0;
+    __u64       Abandon = 0;
+    __u64       Copied = 0;
+    int         Flags = CH10_OPEN_DIRECT;
+    int         Source = STDIN_FILENO;
+    int         Option;
+    ssize_t     Result = 0;
+    double      Start;
+    double      Seconds;
+    int         Status;
+
+    while ((Option = getopt(argc, argv, "r:s:x:Bh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'r': Reserve = strtoull(optarg, NULL, 0); break;
+        case 's': ReadSize = strtoul(optarg, NULL, 0); break;
+        case 'x': Abandon = strtoull(optarg, NULL, 0); break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind + 2 > argc || optind + 3 < argc || ReadSize == 0)
+    {
+        Usage();
+        return -1;
+    }
+
+    if (optind + 3 == argc)
+    {
+        SourcePath = argv[optind + 2];
+
+        Source = open(SourcePath, O_RDONLY);
+
+        if (Source < 0)
+        {
+            fprintf(stderr, "ch10append: %s: %s\n", SourcePath, strerror(errno));
+            return -1;
+        }
+    }
+
+    if (Reserve == 0 && fstat(Source, &Stat) == 0 && S_ISREG(Stat.st_mode))
+    {
+        Reserve = (__u64) Stat.st_size;
+    }
+
+    Buffer = malloc(ReadSize);
+
+    if (Buffer == NULL)
+    {
+        fprintf(stderr, "ch10append: %s\n", strerror(ENOMEM));
+        return -1;
+    }
+
+    Status = Ch10OpenAppend(argv[optind], argv[optind + 1], Reserve, Flags, &Append);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10append: %s: %s\n", argv[optind], strerror(-Status));
+        free(Buffer);
+        return -1;
+    }
+
+    Start = Now();
+
+    for (;;)
+    {
+        Result = read(Source, Buffer, ReadSize);
+
+        if (Result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (Result <= 0)
+        {
+            Result = Result ? -errno : 0;
+            break;
+        }
+
+        if (Abandon && (__u64) Result > Abandon - Copied)
+        {
+            Result = (ssize_t) (Abandon - Copied);
+        }
+
+        Result = Ch10Append(&Append, Buffer, (size_t) Result);
+
+        if (Result < 0)
+        {
+            break;
+        }
+
+        Copied += (__u64) Result;
+
+        if (Abandon && Copied == Abandon)
+        {
+            fprintf(stderr, "ch10append: abandoned after %llu bytes\n", (unsigned long long) Copied);
+            _exit(1);
+        }
+    }
+
+    Status = Ch10CloseAppend(&Append);
+
+    Seconds = Now() - Start;
+
+    if (Result < 0 || Status)
+    {
+        fprintf(
+            stderr,
+            "ch10append: %s: %s\n",
+            Result < 0 ? (SourcePath ? SourcePath : "stdin") : argv[optind],
+            strerror(Result < 0 ? (int) -Result : -Status)
+            );
+    }
+    else
+    {
+        printf(
+            "{\"image\": \"%s\", \"recording\": \"%s\", \"size\": %llu, \"blockNum\": %llu, "
+            "\"reservedBlocks\": %llu, \"writes\": %llu, \"deviceBytes\": %llu, \"direct\": %s, "
+            "\"seconds\": %.3f, \"mbPerSecond\": %.1f}\n",
+            argv[optind],
+            argv[optind + 1],
+            (unsigned long long) Append.Size,
+            (unsigned long long) Append.BlockNum,
+            (unsigned long long) Append.ReservedBlocks,
+            (unsigned long long) Append.Writes,
+            (unsigned long long) Append.DeviceBytes,
+            Append.Flags & CH10_OPEN_DIRECT ? "true" : "false",
+            Seconds,
+            Seconds > 0 ? Copied / Seconds / 1e6 : 0.0
+            );
+    }
+
+    if (Source != STDIN_FILENO)
+    {
+        close(Source);
+    }
+
+    free(Buffer);
+
+    return Result < 0 || Status ? -1 : 0;
+}
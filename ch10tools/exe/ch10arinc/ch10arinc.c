@@ -0,0 +1,302 @@
+/*
+    Program to extract Chapter 10 ARINC-429 words by label.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Without a stream name builds the label index of a recording and lists
+// every channel, bus and label it found with the packets and words it is
+// in. Given <recording>:<channel>-<bus>-<label>.a429 it opens the same
+// view ch10fuse serves, reads it from start to end in pieces of the read
+// size and writes it to the output file when there is one. Output is a
+// JSON document with the time taken and the packets read.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10arinc [options] <image> <recording>[:<channel>-<bus>-<label>.a429]\n"
+        "  -o <file>       write the records to a file\n"
+        "  -s <bytes>      size of the reads of the stream (1M)\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image\n"
+        );
+}
+
+static int
+ListLabels (
+    CH10_VOLUME *Volume,
+    const char  *Image,
+    __u32       FileIndex
+    )
+{
+    CH10_ARINC_INDEX        ArincIndex;
+    const CH10_ARINC_LABEL  *Label;
+    __u32                   Number;
+    double                  Start;
+    double                  BuildSeconds;
+    int                     Status;
+
+    Start = Now();
+
+    Status = Ch10BuildArincIndex(Volume, FileIndex, &ArincIndex);
+
+    BuildSeconds = Now() - Start;
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    printf(
+        "{\"image\": \"%s\", \"recording\": \"%s\", \"indexed\": %s, \"arincPackets\": %llu, "
+        "\"words\": %llu, \"buildSeconds\": %.3f, \"labels\": [",
+        Image,
+        Volume->Files[FileIndex].Name,
+        Volume->Index && Volume->Index->Packets ? "true" : "false",
+        (unsigned long long) ArincIndex.ArincPackets,
+        (unsigned long long) ArincIndex.WordCount,
+        BuildSeconds
+        );
+
+    for (Number = 0; Number < ArincIndex.LabelCount; Number++)
+    {
+        Label = &ArincIndex.Labels[Number];
+
+        printf(
+            "%s\n  {\"channel\": %u, \"bus\": %u, \"label\": \"%03o\", \"stream\": \"%s%c%u-%u-%03o%s\", "
+            "\"packets\": %u, \"words\": %llu}",
+            Number ? "," : "",
+            Label->ChannelId,
+            Label->Bus,
+            Label->Label,
+            Volume->Files[FileIndex].Name,
+            CH10_STREAM_SEPARATOR,
+            Label->ChannelId,
+            Label->Bus,
+            Label->Label,
+            CH10_ARINC_SUFFIX,
+            Label->PacketCount,
+            (unsigned long long) Label->WordCount
+            );
+    }
+
+    printf("]}\n");
+
+    Ch10FreeArincIndex(&ArincIndex);
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    CH10_VOLUME *Volume;
+    CH10_ARINC  *View;
+    const char  *OutputPath = NULL;
+    char        *Buffer;
+    char        Name[CH10_MAXFN + 1];
+    size_t      ReadSize = 1024 * 1024;
+    int         Flags = CH10_OPEN_DIRECT | CH10_OPEN_INDEX;
+    int         Output = -1;
+    int         Option;
+    int         Length;
+    int         Type;
+    __u16       ChannelId;
+    __u32       Filter;
+    __u32       FileIndex;
+    __u64       Offset;
+    ssize_t     Result = 0;
+    double      Start;
+    double      OpenSeconds;
+    double      ReadSeconds;
+    int         Status;
+
+    while ((Option = getopt(argc, argv, "o:s:Bmh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'o': OutputPath = optarg; break;
+        case 's': ReadSize = strtoul(optarg, NULL, 0); break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP | CH10_OPEN_INDEX; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind + 2 != argc || ReadSize == 0)
+    {
+        Usage();
+        return -1;
+    }
+
+    Status = Ch10MountVolume(argv[optind], Flags, &Volume);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10arinc: %s: %s\n", argv[optind], strerror(-Status));
+        return -1;
+    }
+
+    Length = Ch10ParseStreamName(argv[optind + 1], &ChannelId, &Filter, &Type);
+
+    if (Length >= 0 && Type != CH10_STREAM_ARINC)
+    {
+        Length = -ENOENT;
+    }
+
+    snprintf(
+        Name,
+        sizeof(Name),
+        "%.*s",
+        Length < 0 ? (int) strlen(argv[optind + 1]) : Length,
+        argv[optind + 1]
+        );
+
+    Status = Ch10LookupFileName(Volume, Name, &FileIndex);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10arinc: %s: %s\n", Name, strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    if (Length < 0)
+    {
+        Status = ListLabels(Volume, argv[optind], FileIndex);
+
+        if (Status)
+        {
+            fprintf(stderr, "ch10arinc: %s: %s\n", Name, strerror(-Status));
+        }
+
+        Ch10DismountVolume(Volume);
+        return Status ? -1 : 0;
+    }
+
+    Start = Now();
+
+    Status = Ch10OpenArinc(Volume, FileIndex, ChannelId, Filter, &View);
+
+    OpenSeconds = Now() - Start;
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10arinc: %s: %s\n", argv[optind + 1], strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Buffer = malloc(ReadSize);
+
+    if (OutputPath)
+    {
+        Output = open(OutputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (Buffer == NULL || (OutputPath && Output < 0))
+    {
+        fprintf(stderr, "ch10arinc: %s\n", strerror(Buffer ? errno : ENOMEM));
+        free(Buffer);
+        Ch10CloseArinc(View);
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Start = Now();
+
+    for (Offset = 0; Offset < View->Size; Offset += (__u64) Result)
+    {
+        Result = Ch10ReadArinc(View, Offset, ReadSize, Buffer);
+
+        if (Result <= 0)
+        {
+            Result = Result ? Result : -EIO;
+            break;
+        }
+
+        if (Output >= 0 && write(Output, Buffer, (size_t) Result) != Result)
+        {
+            Result = -errno;
+            break;
+        }
+    }
+
+    ReadSeconds = Now() - Start;
+
+    if (Result < 0)
+    {
+        fprintf(stderr, "ch10arinc: %s: %s\n", argv[optind + 1], strerror((int) -Result));
+    }
+    else
+    {
+        printf(
+            "{\"image\": \"%s\", \"stream\": \"%s\", \"indexed\": %s, \"records\": %llu, "
+            "\"size\": %llu, \"labelPackets\": %u, \"arincPackets\": %llu, \"packetReads\": %llu, "
+            "\"openSeconds\": %.3f, \"readSeconds\": %.3f}\n",
+            argv[optind],
+            argv[optind + 1],
+            Volume->Index && Volume->Index->Packets ? "true" : "false",
+            (unsigned long long) View->RecordCount,
+            (unsigned long long) View->Size,
+            View->Entry->PacketCount,
+            (unsigned long long) View->Index.ArincPackets,
+            (unsigned long long) View->PacketReads,
+            OpenSeconds,
+            ReadSeconds
+            );
+    }
+
+    if (Output >= 0)
+    {
+        close(Output);
+    }
+
+    free(Buffer);
+    Ch10CloseArinc(View);
+    Ch10DismountVolume(Volume);
+
+    return Result < 0 ? -1 : 0;
+}
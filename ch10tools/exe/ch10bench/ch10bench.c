@@ -0,0 +1,874 @@
+/*
+    Program to benchmark the Chapter 10 parsing and read paths.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Every test runs against a mounted CH10_VOLUME, so the numbers cover the
+// directory parsing and Ch10ReadFileData paths the other tools use. The
+// results are written to stdout as one JSON document.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+#define BENCH_VERSION       1
+
+#define MAX_THREADS         64
+
+#define SCAN_WINDOW_SIZE    (8 * 1024 * 1024)
+
+typedef struct _BENCH_CONFIG {
+    int     Flags;          // CH10_OPEN_XXX
+    int     Cold;           // drop the image from the page cache before reads
+    double  MinSeconds;     // minimum run time of each timed loop
+    __u64   ReadBytes;      // bytes read by each throughput test
+    int     MaxThreads;
+    __u64   Seed;
+} BENCH_CONFIG;
+
+typedef struct _BENCH_THREAD {
+    pthread_t   Thread;
+    CH10_VOLUME *Volume;
+    __u32       FileIndex;
+    __u64       Start;
+    __u64       Length;
+    size_t      ChunkSize;
+    __u64       Bytes;
+    int         Status;
+} BENCH_THREAD;
+
+static BENCH_CONFIG Config = {
+    0,
+    1,
+    0.5,
+    256ULL * 1024 * 1024,
+    8,
+    1
+};
+
+static __u64 RandomState;
+
+static __u64
+Random (
+    void
+    )
+{
+    // xorshift64*
+    RandomState ^= RandomState >> 12;
+    RandomState ^= RandomState << 25;
+    RandomState ^= RandomState >> 27;
+    return RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+//
+// Drops the image, or every member of a striped set, from the page cache
+// and tells the kernel how the next test is going to read it
+//
+static void
+PrepareCache (
+    CH10_VOLUME *Volume,
+    int         Advice
+    )
+{
+    __u32 Member;
+
+    for (Member = 0; Member < Volume->MemberCount; Member++)
+    {
+        if (Config.Cold)
+        {
+            Ch10AdviseBlockDevice(&Volume->Members[Member]->Device, 0, 0, CH10_ADVISE_DONTNEED);
+        }
+
+        Ch10AdviseBlockDevice(&Volume->Members[Member]->Device, 0, 0, Advice);
+    }
+}
+
+static __u32
+LargestFile (
+    CH10_VOLUME *Volume
+    )
+{
+    __u32 Index;
+    __u32 Largest = 0;
+
+    for (Index = 1; Index < Volume->FileCount; Index++)
+    {
+        if (Volume->Files[Index].Size > Volume->Files[Largest].Size)
+        {
+            Largest = Index;
+        }
+    }
+
+    return Largest;
+}
+
+static int
+BenchMount (
+    const char *Path
+    )
+{
+    CH10_VOLUME *Volume;
+    double      Start;
+    double      Elapsed;
+    double      Begin;
+    double      Min = 1e9;
+    double      Total = 0;
+    __u64       Iterations = 0;
+    int         Status;
+
+    Begin = Now();
+
+    do
+    {
+        Start = Now();
+
+        Status = Ch10MountVolume(Path, Config.Flags, &Volume);
+
+        Elapsed = Now() - Start;
+
+        if (Status)
+        {
+            return Status;
+        }
+
+        Ch10DismountVolume(Volume);
+
+        Total += Elapsed;
+        Min = Elapsed < Min ? Elapsed : Min;
+        Iterations++;
+
+    } while (Now() - Begin < Config.MinSeconds);
+
+    printf(
+        "\"mount\": {\"iterations\": %llu, \"meanNs\": %.0f, \"minNs\": %.0f}",
+        (unsigned long long) Iterations,
+        Total / Iterations * 1e9,
+        Min * 1e9
+        );
+
+    return 0;
+}
+
+static int
+BenchLookup (
+    CH10_VOLUME *Volume
+    )
+{
+    double  Start;
+    double  Elapsed;
+    double  MissNs;
+    __u64   Iterations = 0;
+    __u64   Misses = 0;
+    __u32   Index;
+    int     Status;
+
+    if (Volume->FileCount == 0)
+    {
+        return 0;
+    }
+
+    Start = Now();
+
+    do
+    {
+        Status = Ch10LookupFileName(
+            Volume,
+            Volume->Files[Random() % Volume->FileCount].Name,
+            &Index
+            );
+
+        if (Status)
+        {
+            return Status;
+        }
+
+        Iterations++;
+
+    } while ((Iterations & 1023) || Now() - Start < Config.MinSeconds);
+
+    Elapsed = Now() - Start;
+
+    Start = Now();
+
+    do
+    {
+        Ch10LookupFileName(Volume, "no such recording", &Index);
+        Misses++;
+
+    } while ((Misses & 1023) || Now() - Start < Config.MinSeconds / 4);
+
+    MissNs = (Now() - Start) / Misses * 1e9;
+
+    printf(
+        ", \"lookup\": {\"iterations\": %llu, \"hitNs\": %.1f, \"missNs\": %.1f}",
+        (unsigned long long) Iterations,
+        Elapsed / Iterations * 1e9,
+        MissNs
+        );
+
+    return 0;
+}
+
+static void
+BenchList (
+    CH10_VOLUME *Volume
+    )
+{
+    double  Start;
+    double  Elapsed;
+    __u64   Entries = 0;
+    __u64   Check = 0;
+    __u32   Index;
+
+    Start = Now();
+
+    //
+    // A listing touches the name and the sizes of every entry
+    //
+    do
+    {
+        for (Index = 0; Index < Volume->FileCount; Index++)
+        {
+            Check += strlen(Volume->Files[Index].Name);
+            Check += Volume->Files[Index].Size + Volume->Files[Index].NumBlocks;
+        }
+
+        Entries += Volume->FileCount ? Volume->FileCount : 1;
+
+    } while (Now() - Start < Config.MinSeconds);
+
+    Elapsed = Now() - Start;
+
+    printf(
+        ", \"list\": {\"entries\": %llu, \"entriesPerSecond\": %.0f, \"check\": %llu}",
+        (unsigned long long) Entries,
+        Entries / Elapsed,
+        (unsigned long long) (Check & 0xffff)
+        );
+}
+
+static int
+BenchSequential (
+    CH10_VOLUME *Volume,
+    __u32       FileIndex,
+    size_t      ChunkSize,
+    __u32       Align,
+    int         First
+    )
+{
+    CH10_FILE   *File = &Volume->Files[FileIndex];
+    char        *Buffer;
+    __u64       Offset = Align;
+    __u64       Bytes = 0;
+    double      Start;
+    double      Elapsed;
+    ssize_t     Result;
+
+    Buffer = Ch10AllocateAligned(ChunkSize + 4096);
+
+    if (Buffer == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    PrepareCache(Volume, CH10_ADVISE_SEQUENTIAL);
+
+    Start = Now();
+
+    while (Bytes < Config.ReadBytes)
+    {
+        if (Offset >= File->Size)
+        {
+            Offset = Align;
+        }
+
+        Result = Ch10ReadFileData(Volume, FileIndex, Offset, ChunkSize, Buffer + (Align & 4095));
+
+        if (Result < 0)
+        {
+            free(Buffer);
+            return (int) Result;
+        }
+
+        if (Result == 0)
+        {
+            break;
+        }
+
+        Offset += Result;
+        Bytes += Result;
+    }
+
+    Elapsed = Now() - Start;
+
+    free(Buffer);
+
+    printf(
+        "%s{\"chunk\": %zu, \"align\": %u, \"bytes\": %llu, \"seconds\": %.6f, \"mbPerSecond\": %.1f}",
+        First ? "" : ", ",
+        ChunkSize,
+        Align,
+        (unsigned long long) Bytes,
+        Elapsed,
+        Bytes / Elapsed / 1e6
+        );
+
+    return 0;
+}
+
+static int
+BenchRandom (
+    CH10_VOLUME *Volume,
+    __u32       FileIndex,
+    size_t      ChunkSize,
+    __u32       Align,
+    int         First
+    )
+{
+    CH10_FILE   *File = &Volume->Files[FileIndex];
+    char        *Buffer;
+    __u64       Bytes = 0;
+    __u64       Reads = 0;
+    __u64       Slots;
+    __u64       Offset;
+    double      Start;
+    double      Elapsed;
+    ssize_t     Result;
+
+    if (File->Size < ChunkSize + Align)
+    {
+        return 0;
+    }
+
+    Slots = (File->Size - Align) / ChunkSize;
+
+    Buffer = Ch10AllocateAligned(ChunkSize + 4096);
+
+    if (Buffer == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    PrepareCache(Volume, CH10_ADVISE_RANDOM);
+
+    Start = Now();
+
+    do
+    {
+        Offset = (Random() % Slots) * ChunkSize + Align;
+
+        Result = Ch10ReadFileData(Volume, FileIndex, Offset, ChunkSize, Buffer + (Align & 4095));
+
+        if (Result < 0)
+        {
+            free(Buffer);
+            return (int) Result;
+        }
+
+        Bytes += Result;
+        Reads++;
+
+    } while (Bytes < Config.ReadBytes / 4 && Now() - Start < Config.MinSeconds * 4);
+
+    Elapsed = Now() - Start;
+
+    free(Buffer);
+
+    printf(
+        "%s{\"chunk\": %zu, \"align\": %u, \"reads\": %llu, \"seconds\": %.6f, "
+        "\"iops\": %.0f, \"mbPerSecond\": %.1f}",
+        First ? "" : ", ",
+        ChunkSize,
+        Align,
+        (unsigned long long) Reads,
+        Elapsed,
+        Reads / Elapsed,
+        Bytes / Elapsed / 1e6
+        );
+
+    return 0;
+}
+
+//
+// Walks every packet of a recording and checks its header and data
+// checksums. A mapped image is walked in place, otherwise the recording
+// is read a window at a time.
+//
+static int
+BenchScan (
+    CH10_VOLUME *Volume,
+    __u32       FileIndex
+    )
+{
+    CH10_FILE   *File = &Volume->Files[FileIndex];
+    const __u8  *Window = NULL;
+    __u8        *Buffer = NULL;
+    __u64       WindowOffset = 0;
+    __u64       Packets = 0;
+    __u64       BadPackets = 0;
+    __u64       Skipped = 0;
+    size_t      WindowLength;
+    size_t      Offset;
+    size_t      Found;
+    double      Start;
+    double      Elapsed;
+    ssize_t     Result;
+    int         Status = 0;
+
+    PrepareCache(Volume, CH10_ADVISE_SEQUENTIAL);
+
+    Start = Now();
+
+    if (Volume->Device.Map == NULL)
+    {
+        Buffer = Ch10AllocateAligned(SCAN_WINDOW_SIZE);
+
+        if (Buffer == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    while (WindowOffset < File->Size)
+    {
+        if (Buffer)
+        {
+            Result = Ch10ReadFileData(Volume, FileIndex, WindowOffset, SCAN_WINDOW_SIZE, Buffer);
+            Window = Buffer;
+        }
+        else
+        {
+            Result = Ch10MapFileData(
+                Volume,
+                FileIndex,
+                WindowOffset,
+                (size_t) (File->Size - WindowOffset),
+                (const void **) &Window
+                );
+        }
+
+        if (Result <= 0)
+        {
+            Status = Result ? (int) Result : -EIO;
+            break;
+        }
+
+        WindowLength = (size_t) Result;
+
+        for (Offset = 0;;)
+        {
+            Found = Offset;
+            Status = Ch10FindPacket(Window, WindowLength, &Found);
+
+            Skipped += Found - Offset;
+            Offset = Found;
+
+            if (Status)
+            {
+                break;
+            }
+
+            if (Ch10CheckPacketData((const struct ch10_packet_header *) (Window + Offset)))
+            {
+                BadPackets++;
+            }
+
+            Packets++;
+            Offset += le32_to_cpu(((const struct ch10_packet_header *) (Window + Offset))->packetLength);
+        }
+
+        Status = 0;
+
+        //
+        // Continue with the packet the window ended in, or past the
+        // trailing bytes at the end of the recording
+        //
+        if (Offset == 0 || WindowOffset + WindowLength >= File->Size)
+        {
+            Skipped += WindowLength - Offset;
+            Offset = WindowLength;
+        }
+
+        WindowOffset += Offset;
+    }
+
+    Elapsed = Now() - Start;
+
+    free(Buffer);
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    printf(
+        ", \"scan\": {\"mapped\": %s, \"packets\": %llu, \"badPackets\": %llu, "
+        "\"skippedBytes\": %llu, \"seconds\": %.6f, \"mbPerSecond\": %.1f}",
+        Volume->Device.Map ? "true" : "false",
+        (unsigned long long) Packets,
+        (unsigned long long) BadPackets,
+        (unsigned long long) Skipped,
+        Elapsed,
+        File->Size / Elapsed / 1e6
+        );
+
+    return 0;
+}
+
+static void *
+BenchThread (
+    void *Context
+    )
+{
+    BENCH_THREAD    *Thread = (BENCH_THREAD *) Context;
+    char            *Buffer;
+    __u64           Offset = Thread->Start;
+    ssize_t         Result;
+
+    Buffer = Ch10AllocateAligned(Thread->ChunkSize);
+
+    if (Buffer == NULL)
+    {
+        Thread->Status = -ENOMEM;
+        return NULL;
+    }
+
+    while (Offset < Thread->Start + Thread->Length)
+    {
+        Result = Ch10ReadFileData(
+            Thread->Volume,
+            Thread->FileIndex,
+            Offset,
+            Thread->ChunkSize,
+            Buffer
+            );
+
+        if (Result <= 0)
+        {
+            Thread->Status = (int) Result;
+            break;
+        }
+
+        Offset += Result;
+        Thread->Bytes += Result;
+    }
+
+    free(Buffer);
+
+    return NULL;
+}
+
+//
+// Each thread streams its own recording, or its own slice of a recording
+// when there are fewer recordings than threads
+//
+static int
+BenchThreads (
+    CH10_VOLUME *Volume,
+    int         ThreadCount,
+    int         First
+    )
+{
+    BENCH_THREAD    Threads[MAX_THREADS];
+    __u64           PerThread = Config.ReadBytes / ThreadCount;
+    __u64           Bytes = 0;
+    __u32           FileIndex;
+    __u64           Slice;
+    double          Start;
+    double          Elapsed;
+    int             Index;
+    int             Status = 0;
+
+    PrepareCache(Volume, CH10_ADVISE_SEQUENTIAL);
+
+    for (Index = 0; Index < ThreadCount; Index++)
+    {
+        memset(&Threads[Index], 0, sizeof(BENCH_THREAD));
+
+        Threads[Index].Volume = Volume;
+        Threads[Index].ChunkSize = 1024 * 1024;
+
+        if ((__u32) ThreadCount <= Volume->FileCount)
+        {
+            FileIndex = Index;
+            Threads[Index].Start = 0;
+        }
+        else
+        {
+            FileIndex = Index % Volume->FileCount;
+            Slice = Volume->Files[FileIndex].Size /
+                ((ThreadCount + Volume->FileCount - 1) / Volume->FileCount);
+            Threads[Index].Start = (Index / Volume->FileCount) * Slice;
+            Threads[Index].Start &= ~(__u64) 4095;
+        }
+
+        Threads[Index].FileIndex = FileIndex;
+        Threads[Index].Length = PerThread;
+
+        if (Threads[Index].Start + PerThread > Volume->Files[FileIndex].Size)
+        {
+            Threads[Index].Length = Volume->Files[FileIndex].Size - Threads[Index].Start;
+        }
+    }
+
+    Start = Now();
+
+    for (Index = 0; Index < ThreadCount; Index++)
+    {
+        pthread_create(&Threads[Index].Thread, NULL, BenchThread, &Threads[Index]);
+    }
+
+    for (Index = 0; Index < ThreadCount; Index++)
+    {
+        pthread_join(Threads[Index].Thread, NULL);
+
+        Bytes += Threads[Index].Bytes;
+
+        if (Threads[Index].Status < 0)
+        {
+            Status = Threads[Index].Status;
+        }
+    }
+
+    Elapsed = Now() - Start;
+
+    printf(
+        "%s{\"threads\": %d, \"bytes\": %llu, \"seconds\": %.6f, \"mbPerSecond\": %.1f}",
+        First ? "" : ", ",
+        ThreadCount,
+        (unsigned long long) Bytes,
+        Elapsed,
+        Bytes / Elapsed / 1e6
+        );
+
+    return Status;
+}
+
+static int
+BenchImage (
+    const char  *Path,
+    int         First
+    )
+{
+    static const size_t SequentialChunks[] = { 4096, 65536, 1024 * 1024, 8 * 1024 * 1024 };
+    static const size_t RandomChunks[] = { 4096, 65536 };
+    static const __u32  Alignments[] = { 0, 1, 512 };
+    CH10_VOLUME         *Volume;
+    __u32               FileIndex;
+    unsigned            Chunk;
+    unsigned            Align;
+    int                 Threads;
+    int                 Count;
+    int                 Status;
+
+    RandomState = Config.Seed;
+
+    Status = Ch10MountVolume(Path, Config.Flags, &Volume);
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    printf(
+        "%s\n    {\"image\": \"%s\", \"members\": %u, \"bytesPerBlock\": %u, \"dirBlocks\": %u, \"files\": %u, ",
+        First ? "" : ",",
+        Path,
+        Volume->MemberCount,
+        Volume->BytesPerBlock,
+        Volume->DirBlockCount,
+        Volume->FileCount
+        );
+
+    Status = BenchMount(Path);
+
+    if (!Status)
+    {
+        Status = BenchLookup(Volume);
+    }
+
+    if (!Status)
+    {
+        BenchList(Volume);
+    }
+
+    if (!Status && Volume->FileCount)
+    {
+        FileIndex = LargestFile(Volume);
+
+        printf(", \"sequential\": [");
+
+        for (Count = 0, Chunk = 0; !Status && Chunk < sizeof(SequentialChunks) / sizeof(size_t); Chunk++)
+        {
+            for (Align = 0; !Status && Align < sizeof(Alignments) / sizeof(__u32); Align++)
+            {
+                Status = BenchSequential(
+                    Volume,
+                    FileIndex,
+                    SequentialChunks[Chunk],
+                    Alignments[Align],
+                    !Count++
+                    );
+            }
+        }
+
+        printf("], \"random\": [");
+
+        for (Count = 0, Chunk = 0; !Status && Chunk < sizeof(RandomChunks) / sizeof(size_t); Chunk++)
+        {
+            for (Align = 0; !Status && Align < sizeof(Alignments) / sizeof(__u32); Align++)
+            {
+                Status = BenchRandom(
+                    Volume,
+                    FileIndex,
+                    RandomChunks[Chunk],
+                    Alignments[Align],
+                    !Count++
+                    );
+            }
+        }
+
+        printf("]");
+
+        if (!Status)
+        {
+            Status = BenchScan(Volume, FileIndex);
+        }
+
+        printf(", \"scaling\": [");
+
+        for (Threads = 1; !Status && Threads <= Config.MaxThreads; Threads *= 2)
+        {
+            Status = BenchThreads(Volume, Threads, Threads == 1);
+        }
+
+        printf("]");
+    }
+
+    printf("}");
+
+    Ch10DismountVolume(Volume);
+
+    return Status;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10bench [options] <image>...\n"
+        "  -d              use direct I/O\n"
+        "  -m              map the images instead of reading them\n"
+        "  -i              mount with the index sidecar where there is one\n"
+        "  -w              keep the page cache warm between tests\n"
+        "  -t <seconds>    minimum time of each timed loop (0.5)\n"
+        "  -b <MB>         bytes read by each throughput test (256)\n"
+        "  -j <threads>    largest thread count of the scaling test (8)\n"
+        "  -s <seed>       random seed (1)\n"
+        );
+}
+
+int main(int argc, char* argv[])
+{
+    int Option;
+    int Index;
+    int Status = 0;
+
+    while ((Option = getopt(argc, argv, "dmiwt:b:j:s:h")) != -1)
+    {
+        switch (Option)
+        {
+        case 'd': Config.Flags |= CH10_OPEN_DIRECT; break;
+        case 'm': Config.Flags |= CH10_OPEN_MMAP; break;
+        case 'i': Config.Flags |= CH10_OPEN_INDEX; break;
+        case 'w': Config.Cold = 0; break;
+        case 't': Config.MinSeconds = atof(optarg); break;
+        case 'b': Config.ReadBytes = strtoull(optarg, NULL, 0) * 1024 * 1024; break;
+        case 'j': Config.MaxThreads = atoi(optarg); break;
+        case 's': Config.Seed = strtoull(optarg, NULL, 0) | 1; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind == argc ||
+        Config.MaxThreads < 1 || Config.MaxThreads > MAX_THREADS ||
+        Config.ReadBytes == 0)
+    {
+        Usage();
+        return -1;
+    }
+
+    printf(
+        "{\"tool\": \"ch10bench\", \"version\": %d, \"timestamp\": %lld,\n"
+        "  \"config\": {\"direct\": %s, \"mmap\": %s, \"index\": %s, \"cold\": %s, \"minSeconds\": %g, "
+        "\"readBytes\": %llu, \"maxThreads\": %d, \"seed\": %llu, \"cpus\": %ld},\n"
+        "  \"images\": [",
+        BENCH_VERSION,
+        (long long) time(NULL),
+        Config.Flags & CH10_OPEN_DIRECT ? "true" : "false",
+        Config.Flags & CH10_OPEN_MMAP ? "true" : "false",
+        Config.Flags & CH10_OPEN_INDEX ? "true" : "false",
+        Config.Cold ? "true" : "false",
+        Config.MinSeconds,
+        (unsigned long long) Config.ReadBytes,
+        Config.MaxThreads,
+        (unsigned long long) Config.Seed,
+        sysconf(_SC_NPROCESSORS_ONLN)
+        );
+
+    for (Index = optind; Index < argc; Index++)
+    {
+        Status = BenchImage(argv[Index], Index == optind);
+
+        if (Status)
+        {
+            fflush(stdout);
+            fprintf(stderr, "ch10bench: %s: %s\n", argv[Index], strerror(-Status));
+            break;
+        }
+    }
+
+    printf("\n  ]}\n");
+
+    return Status ? -1 : 0;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+#
+# Generates a fixed set of images and benchmarks them with ch10bench. The
+# images only depend on the seed, so runs on different builds or machines
+# are comparable. Extra arguments are passed to ch10bench.
+#
+#   exe/ch10bench/run.sh [-d] [-j 16] > results.json
+#
+# Images are written to $CH10BENCH_DIR, /tmp/ch10bench by default.
+#
+
+set -e
+
+TOOLS=$(cd "$(dirname "$0")/../.." && pwd)
+DIR=${CH10BENCH_DIR:-/tmp/ch10bench}
+
+mkdir -p "$DIR"
+
+image()
+{
+    name=$1
+    shift
+    if [ ! -f "$DIR/$name.img" ]; then
+        "$TOOLS/exe/mkch10img/mkch10img" -s 1 "$@" "$DIR/$name.img" > /dev/null
+    fi
+    IMAGES="$IMAGES $DIR/$name.img"
+}
+
+IMAGES=
+
+# Directory scaling, short recordings
+image dir4     -f 4    -d 1  -c time:1,pcm:1@256K
+image dir64    -f 64   -d 1  -c time:1,pcm:1@256K
+image dir256   -f 256  -d 1  -c time:1,pcm:1@256K
+image dir1024  -f 1024 -d 1  -c time:1,pcm:1@256K  -D 256
+image dir4096  -f 4096 -d 1  -c time:1,arinc:1   -D 1024
+
+# Read throughput, long recordings with 512 and 4096 byte blocks
+image seq512   -f 8    -d 30 -c time:1,pcm:2@2M,eth:1,arinc:2
+image seq4096  -f 8    -d 30 -c time:1,pcm:2@2M,eth:1,arinc:2 -b 4096
+
+exec "$TOOLS/exe/ch10bench/ch10bench" "$@" $IMAGES
@@ -0,0 +1,316 @@
+/*
+    Program to read the packets of some Chapter 10 channels.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Reads the packets of the channels given with -c from a recording through
+// Ch10ReadChannels, which reads only the extents holding them, and writes
+// them to the output file when there is one. -f also picks the same
+// packets out of a scan of the whole recording and compares the two. Output
+// is a JSON document with the bytes each way moved off the device.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+typedef struct _SCAN_CONTEXT {
+    const __u8  *ChannelSet;
+    __u64       Packets;
+    __u64       Bytes;
+    __u64       Hash;
+} SCAN_CONTEXT;
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10demux [options] -c <channel>[,<channel>...] <image> <recording>\n"
+        "  -c <channels>   channels to read\n"
+        "  -o <file>       write the packets to a file\n"
+        "  -s <bytes>      size of the buffer of each read (1M)\n"
+        "  -f              also scan the whole recording and compare\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image\n"
+        );
+}
+
+//
+// FNV-1a 64 over the packets, in order
+//
+static __u64
+HashBytes (
+    __u64       Hash,
+    const void  *Buffer,
+    size_t      Length
+    )
+{
+    const __u8  *Bytes = (const __u8 *) Buffer;
+
+    while (Length--)
+    {
+        Hash ^= *Bytes++;
+        Hash *= 0x100000001b3ULL;
+    }
+
+    return Hash;
+}
+
+static int
+ScanPacket (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    SCAN_CONTEXT *Scan = (SCAN_CONTEXT *) Context;
+
+    (void) Offset;
+
+    if (Ch10HasChannel(Scan->ChannelSet, le16_to_cpu(Header->channelId)))
+    {
+        Scan->Packets++;
+        Scan->Bytes += le32_to_cpu(Header->packetLength);
+        Scan->Hash = HashBytes(Scan->Hash, Header, le32_to_cpu(Header->packetLength));
+    }
+
+    return 0;
+}
+
+static int
+ParseChannels (
+    char    *List,
+    __u8    *ChannelSet
+    )
+{
+    char            *Next;
+    unsigned long   Channel;
+
+    for (;;)
+    {
+        Channel = strtoul(List, &Next, 0);
+
+        if (Next == List || Channel > 0xffff || (*Next && *Next != ','))
+        {
+            return -EINVAL;
+        }
+
+        Ch10AddChannel(ChannelSet, Channel);
+
+        if (*Next == 0)
+        {
+            return 0;
+        }
+
+        List = Next + 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    CH10_VOLUME         *Volume;
+    CH10_CHANNEL_READ   Read;
+    SCAN_CONTEXT        Scan;
+    const char          *OutputPath = NULL;
+    char                *Channels = NULL;
+    char                *Buffer;
+    __u8                ChannelSet[CH10_CHANNEL_SET_SIZE];
+    size_t              ReadSize = 1024 * 1024;
+    int                 Flags = CH10_OPEN_DIRECT | CH10_OPEN_INDEX;
+    int                 Full = 0;
+    int                 Output = -1;
+    int                 Option;
+    __u32               FileIndex;
+    __u64               Offset = 0;
+    __u64               Packets = 0;
+    __u64               Bytes = 0;
+    __u64               Reads = 0;
+    __u64               DeviceBytes = 0;
+    __u64               Hash = 0xcbf29ce484222325ULL;
+    __u64               Skipped = 0;
+    double              Start;
+    double              Seconds;
+    double              ScanSeconds = 0;
+    int                 Status;
+
+    memset(ChannelSet, 0, sizeof(ChannelSet));
+
+    while ((Option = getopt(argc, argv, "c:o:s:fBmh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'c': Channels = optarg; break;
+        case 'o': OutputPath = optarg; break;
+        case 's': ReadSize = strtoul(optarg, NULL, 0); break;
+        case 'f': Full = 1; break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP | CH10_OPEN_INDEX; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind + 2 != argc || ReadSize == 0 || Channels == NULL ||
+        ParseChannels(Channels, ChannelSet))
+    {
+        Usage();
+        return -1;
+    }
+
+    Status = Ch10MountVolume(argv[optind], Flags, &Volume);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10demux: %s: %s\n", argv[optind], strerror(-Status));
+        return -1;
+    }
+
+    Status = Ch10LookupFileName(Volume, argv[optind + 1], &FileIndex);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10demux: %s: %s\n", argv[optind + 1], strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Buffer = malloc(ReadSize);
+
+    if (OutputPath)
+    {
+        Output = open(OutputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (Buffer == NULL || (OutputPath && Output < 0))
+    {
+        fprintf(stderr, "ch10demux: %s\n", strerror(Buffer ? errno : ENOMEM));
+        free(Buffer);
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Start = Now();
+
+    while (Offset < Volume->Files[FileIndex].Size)
+    {
+        Status = Ch10ReadChannels(Volume, FileIndex, ChannelSet, Offset, Buffer, ReadSize, &Read);
+
+        if (Status)
+        {
+            break;
+        }
+
+        if (Output >= 0 && write(Output, Buffer, Read.Length) != (ssize_t) Read.Length)
+        {
+            Status = -errno;
+            break;
+        }
+
+        Packets += Read.PacketCount;
+        Bytes += Read.Length;
+        Reads += Read.ExtentCount;
+        DeviceBytes += Read.DeviceBytes;
+        Hash = HashBytes(Hash, Buffer, Read.Length);
+        Offset = Read.NextOffset;
+    }
+
+    Seconds = Now() - Start;
+
+    if (!Status && Full)
+    {
+        memset(&Scan, 0, sizeof(Scan));
+
+        Scan.ChannelSet = ChannelSet;
+        Scan.Hash = 0xcbf29ce484222325ULL;
+
+        Start = Now();
+
+        Status = Ch10ScanFile(Volume, FileIndex, ScanPacket, &Scan, &Skipped);
+
+        ScanSeconds = Now() - Start;
+    }
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10demux: %s: %s\n", argv[optind + 1], strerror(-Status));
+    }
+    else
+    {
+        printf(
+            "{\"image\": \"%s\", \"recording\": \"%s\", \"channels\": \"%s\", \"size\": %llu, "
+            "\"packets\": %llu, \"bytes\": %llu, \"reads\": %llu, \"deviceBytes\": %llu, "
+            "\"seconds\": %.3f",
+            argv[optind],
+            argv[optind + 1],
+            Channels,
+            (unsigned long long) Volume->Files[FileIndex].Size,
+            (unsigned long long) Packets,
+            (unsigned long long) Bytes,
+            (unsigned long long) Reads,
+            (unsigned long long) DeviceBytes,
+            Seconds
+            );
+
+        if (Full)
+        {
+            printf(
+                ", \"scan\": {\"packets\": %llu, \"bytes\": %llu, \"deviceBytes\": %llu, "
+                "\"seconds\": %.3f, \"same\": %s}",
+                (unsigned long long) Scan.Packets,
+                (unsigned long long) Scan.Bytes,
+                (unsigned long long) Volume->Files[FileIndex].Size,
+                ScanSeconds,
+                Scan.Packets == Packets && Scan.Hash == Hash ? "true" : "false"
+                );
+        }
+
+        printf("}\n");
+    }
+
+    if (Output >= 0)
+    {
+        close(Output);
+    }
+
+    free(Buffer);
+    Ch10DismountVolume(Volume);
+
+    return Status ? -1 : 0;
+}
@@ -0,0 +1,721 @@
+/*
+    Program to copy recordings off a Chapter 10 volume.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Reader threads each take a whole recording and read it front to back in
+// large sector aligned chunks, direct from the device unless -B is given.
+// Filled buffers are queued to writer threads, which write them to the
+// destination at their offset while the reader goes on with the next
+// chunk. A fixed pool of buffers bounds the data in flight: a reader that
+// finds the pool empty waits for a writer to hand one back. With -m the
+// image is mapped and the writers write straight from the mapping. Only
+// the data of a sparse recording is copied, the hole at its end is left
+// a hole in the destination.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ch10lib.h"
+
+#define MAX_THREADS         64
+
+typedef struct _EXT_FILE {
+    __u32           Index;          // index into the volume file table
+    int             Fd;             // destination
+    __u32           Pending;        // chunks queued or being written
+    int             ReadDone;       // the reader queued the last chunk
+    int             Status;         // first error on this file
+} EXT_FILE;
+
+typedef struct _EXT_BUFFER {
+    struct _EXT_BUFFER  *Next;
+    EXT_FILE            *File;
+    char                *Memory;    // sector aligned, NULL for a mapped image
+    const char          *Data;      // first byte of file data
+    size_t              Length;
+    __u64               Offset;     // offset of Data in the recording
+} EXT_BUFFER;
+
+typedef struct _EXT_CONTEXT {
+    CH10_VOLUME     *Volume;
+    const char      *OutputDir;
+    size_t          ChunkSize;
+
+    EXT_FILE        *Files;
+    __u32           FileCount;
+    __u32           NextFile;
+
+    pthread_mutex_t Lock;
+    pthread_cond_t  FreeAvailable;
+    pthread_cond_t  WriteAvailable;
+
+    EXT_BUFFER      *FreeList;
+    EXT_BUFFER      *WriteHead;
+    EXT_BUFFER      *WriteTail;
+    int             ReadersDone;
+
+    __u64           BytesRead;
+    __u64           BytesWritten;
+    __u64           HoleBytes;
+    __u32           FilesFailed;
+} EXT_CONTEXT;
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static EXT_BUFFER *
+GetFreeBuffer (
+    EXT_CONTEXT *Context
+    )
+{
+    EXT_BUFFER *Buffer;
+
+    pthread_mutex_lock(&Context->Lock);
+
+    while (Context->FreeList == NULL)
+    {
+        pthread_cond_wait(&Context->FreeAvailable, &Context->Lock);
+    }
+
+    Buffer = Context->FreeList;
+    Context->FreeList = Buffer->Next;
+
+    pthread_mutex_unlock(&Context->Lock);
+
+    return Buffer;
+}
+
+//
+// Called with the lock held. The destination is closed once its reader
+// is done and the last chunk has been written.
+//
+static void
+ReleaseFile (
+    EXT_CONTEXT *Context,
+    EXT_FILE    *File
+    )
+{
+    if (File->ReadDone && File->Pending == 0 && File->Fd >= 0)
+    {
+        if (close(File->Fd) && !File->Status)
+        {
+            File->Status = -errno;
+        }
+
+        File->Fd = -1;
+
+        if (File->Status)
+        {
+            Context->FilesFailed++;
+
+            fprintf(
+                stderr,
+                "ch10extract: %s: %s\n",
+                Context->Volume->Files[File->Index].Name,
+                strerror(-File->Status)
+                );
+        }
+    }
+}
+
+//
+// Bytes of a recording that are backed by its blocks, from its start
+//
+static __u64
+GetDataLength (
+    CH10_FILE   *File
+    )
+{
+    return File->Allocated < File->Size ? File->Allocated : File->Size;
+}
+
+static int
+OpenDestination (
+    EXT_CONTEXT *Context,
+    EXT_FILE    *File
+    )
+{
+    CH10_FILE   *VolumeFile = &Context->Volume->Files[File->Index];
+    char        Path[4096];
+    char        Name[CH10_MAXFN + 1];
+    char        *Char;
+
+    //
+    // Directory entries are flat, a separator in a name is not a path
+    //
+    strcpy(Name, VolumeFile->Name);
+
+    for (Char = Name; *Char; Char++)
+    {
+        if (*Char == '/' || *Char == '\\')
+        {
+            *Char = '_';
+        }
+    }
+
+    if (!strcmp(Name, ".") || !strcmp(Name, ".."))
+    {
+        Name[0] = '_';
+    }
+
+    snprintf(Path, sizeof(Path), "%s/%s", Context->OutputDir, Name);
+
+    File->Fd = open(Path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (File->Fd < 0)
+    {
+        return -errno;
+    }
+
+    //
+    // Reserve the space for the data up front so the concurrent writes do
+    // not fragment the destination, not every file system supports this.
+    // Setting the size leaves the rest a hole.
+    //
+    if (GetDataLength(VolumeFile))
+    {
+        posix_fallocate(File->Fd, 0, (off_t) GetDataLength(VolumeFile));
+    }
+
+    if (ftruncate(File->Fd, (off_t) VolumeFile->Size))
+    {
+        return -errno;
+    }
+
+    return 0;
+}
+
+static void
+ReadFile (
+    EXT_CONTEXT *Context,
+    EXT_FILE    *File
+    )
+{
+    CH10_VOLUME *Volume = Context->Volume;
+    CH10_FILE   *VolumeFile = &Volume->Files[File->Index];
+    __u64       Mask = Volume->Device.SectorSize - 1;
+    __u64       Offset = 0;
+    __u64       DataLength = GetDataLength(VolumeFile);
+    __u64       DeviceOffset;
+    __u32       Lead;
+    size_t      Length;
+    EXT_BUFFER  *Buffer;
+    const void  *Mapped = NULL;
+    ssize_t     Result;
+    int         Status;
+
+    Status = OpenDestination(Context, File);
+
+    if (!Status && Volume->Device.Map)
+    {
+        Ch10AdviseBlockDevice(
+            &Volume->Device,
+            VolumeFile->Offset,
+            DataLength,
+            CH10_ADVISE_SEQUENTIAL
+            );
+    }
+
+    while (!Status && Offset < DataLength)
+    {
+        Buffer = GetFreeBuffer(Context);
+
+        //
+        // Recordings start on a block boundary, which need not be a sector
+        // boundary of the device. Read from the sector below and skip the
+        // lead in, so every read stays aligned and no bounce buffer is used.
+        //
+        DeviceOffset = VolumeFile->Offset + Offset;
+        Lead = (__u32) (DeviceOffset & Mask);
+
+        Length = Context->ChunkSize;
+
+        if (Length > DataLength - Offset)
+        {
+            Length = (size_t) (DataLength - Offset);
+        }
+
+        //
+        // A striped recording is read from all members by the library,
+        // which also refuses the part of one on a member mounted alone
+        //
+        if (VolumeFile->StripeCount ||
+            VolumeFile->DirEntry->reserved[0] == CH10_STRIPE_TAG)
+        {
+            Lead = 0;
+
+            Result = Ch10ReadFileData(
+                Volume,
+                File->Index,
+                Offset,
+                Length,
+                Buffer->Memory
+                );
+        }
+        else if (Volume->Device.Map)
+        {
+            Lead = 0;
+
+            Result = Ch10MapFileData(
+                Volume,
+                File->Index,
+                Offset,
+                Length,
+                &Mapped
+                );
+        }
+        else
+        {
+            Result = Ch10ReadBlockDevice(
+                &Volume->Device,
+                DeviceOffset - Lead,
+                (Lead + Length + Mask) & ~Mask,
+                Buffer->Memory
+                );
+        }
+
+        if (Result >= 0 && (size_t) Result < Lead + Length)
+        {
+            Result = -EIO;
+        }
+
+        pthread_mutex_lock(&Context->Lock);
+
+        if (Result < 0)
+        {
+            Status = (int) Result;
+
+            Buffer->Next = Context->FreeList;
+            Context->FreeList = Buffer;
+            pthread_cond_signal(&Context->FreeAvailable);
+        }
+        else
+        {
+            Buffer->File = File;
+            Buffer->Data = Mapped ? (const char *) Mapped : Buffer->Memory + Lead;
+            Buffer->Length = Length;
+            Buffer->Offset = Offset;
+            Buffer->Next = NULL;
+
+            if (Context->WriteTail)
+            {
+                Context->WriteTail->Next = Buffer;
+            }
+            else
+            {
+                Context->WriteHead = Buffer;
+            }
+
+            Context->WriteTail = Buffer;
+            File->Pending++;
+            Context->BytesRead += Length;
+
+            pthread_cond_signal(&Context->WriteAvailable);
+        }
+
+        pthread_mutex_unlock(&Context->Lock);
+
+        Offset += Length;
+    }
+
+    pthread_mutex_lock(&Context->Lock);
+
+    if (Status && !File->Status)
+    {
+        File->Status = Status;
+    }
+
+    File->ReadDone = 1;
+
+    if (!Status)
+    {
+        Context->HoleBytes += VolumeFile->Size - DataLength;
+    }
+
+    if (File->Fd < 0 && File->Status)
+    {
+        Context->FilesFailed++;
+
+        fprintf(
+            stderr,
+            "ch10extract: %s: %s\n",
+            VolumeFile->Name,
+            strerror(-File->Status)
+            );
+    }
+
+    ReleaseFile(Context, File);
+
+    pthread_mutex_unlock(&Context->Lock);
+}
+
+static void *
+ReaderThread (
+    void *Parameter
+    )
+{
+    EXT_CONTEXT *Context = (EXT_CONTEXT *) Parameter;
+    __u32       Index;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&Context->Lock);
+        Index = Context->NextFile++;
+        pthread_mutex_unlock(&Context->Lock);
+
+        if (Index >= Context->FileCount)
+        {
+            break;
+        }
+
+        ReadFile(Context, &Context->Files[Index]);
+    }
+
+    return NULL;
+}
+
+static void *
+WriterThread (
+    void *Parameter
+    )
+{
+    EXT_CONTEXT *Context = (EXT_CONTEXT *) Parameter;
+    EXT_BUFFER  *Buffer;
+    EXT_FILE    *File;
+    size_t      Done;
+    ssize_t     Result;
+    int         Status;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&Context->Lock);
+
+        while (Context->WriteHead == NULL && !Context->ReadersDone)
+        {
+            pthread_cond_wait(&Context->WriteAvailable, &Context->Lock);
+        }
+
+        Buffer = Context->WriteHead;
+
+        if (Buffer == NULL)
+        {
+            pthread_mutex_unlock(&Context->Lock);
+            break;
+        }
+
+        Context->WriteHead = Buffer->Next;
+
+        if (Context->WriteHead == NULL)
+        {
+            Context->WriteTail = NULL;
+        }
+
+        File = Buffer->File;
+        Status = File->Status;
+
+        pthread_mutex_unlock(&Context->Lock);
+
+        for (Done = 0; !Status && Done < Buffer->Length; Done += Result)
+        {
+            Result = pwrite(
+                File->Fd,
+                Buffer->Data + Done,
+                Buffer->Length - Done,
+                (off_t) (Buffer->Offset + Done)
+                );
+
+            if (Result < 0 && errno != EINTR)
+            {
+                Status = -errno;
+            }
+            else if (Result < 0)
+            {
+                Result = 0;
+            }
+        }
+
+        pthread_mutex_lock(&Context->Lock);
+
+        if (Status && !File->Status)
+        {
+            File->Status = Status;
+        }
+
+        if (!Status)
+        {
+            Context->BytesWritten += Buffer->Length;
+        }
+
+        File->Pending--;
+        ReleaseFile(Context, File);
+
+        Buffer->Next = Context->FreeList;
+        Context->FreeList = Buffer;
+        pthread_cond_signal(&Context->FreeAvailable);
+
+        pthread_mutex_unlock(&Context->Lock);
+    }
+
+    return NULL;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10extract [options] <image> [<recording>...]\n"
+        "  -o <dir>        destination directory (.)\n"
+        "  -j <threads>    reader threads, recordings read at once (4)\n"
+        "  -w <threads>    writer threads (4)\n"
+        "  -c <KB>         read size (4096)\n"
+        "  -q <buffers>    buffers in flight (2 per thread)\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image and write from the mapping\n"
+        "  -l              list the recordings and exit\n"
+        );
+}
+
+int main(int argc, char* argv[])
+{
+    EXT_CONTEXT Context;
+    EXT_BUFFER  *Buffers = NULL;
+    pthread_t   Readers[MAX_THREADS];
+    pthread_t   Writers[MAX_THREADS];
+    int         ReaderCount = 4;
+    int         WriterCount = 4;
+    int         BufferCount = 0;
+    int         Flags = CH10_OPEN_DIRECT | CH10_OPEN_INDEX;
+    int         List = 0;
+    int         Option;
+    int         Index;
+    __u32       FileIndex;
+    double      Start;
+    double      Elapsed;
+    int         Status;
+
+    memset(&Context, 0, sizeof(Context));
+
+    Context.OutputDir = ".";
+    Context.ChunkSize = 4 * 1024 * 1024;
+
+    while ((Option = getopt(argc, argv, "o:j:w:c:q:Bmlh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'o': Context.OutputDir = optarg; break;
+        case 'j': ReaderCount = atoi(optarg); break;
+        case 'w': WriterCount = atoi(optarg); break;
+        case 'c': Context.ChunkSize = strtoul(optarg, NULL, 0) * 1024; break;
+        case 'q': BufferCount = atoi(optarg); break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP | CH10_OPEN_INDEX; break;
+        case 'l': List = 1; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (BufferCount == 0)
+    {
+        BufferCount = 2 * (ReaderCount + WriterCount);
+    }
+
+    if (optind == argc ||
+        ReaderCount < 1 || ReaderCount > MAX_THREADS ||
+        WriterCount < 1 || WriterCount > MAX_THREADS ||
+        BufferCount < ReaderCount ||
+        Context.ChunkSize < 4096 || (Context.ChunkSize & 4095))
+    {
+        Usage();
+        return -1;
+    }
+
+    Status = Ch10MountVolume(argv[optind], Flags, &Context.Volume);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10extract: %s: %s\n", argv[optind], strerror(-Status));
+        return -1;
+    }
+
+    if (List)
+    {
+        for (FileIndex = 0; FileIndex < Context.Volume->FileCount; FileIndex++)
+        {
+            printf(
+                "%-48s %14llu\n",
+                Context.Volume->Files[FileIndex].Name,
+                (unsigned long long) Context.Volume->Files[FileIndex].Size
+                );
+        }
+
+        Ch10DismountVolume(Context.Volume);
+        return 0;
+    }
+
+    Context.Files = calloc(Context.Volume->FileCount + 1, sizeof(EXT_FILE));
+    Buffers = calloc(BufferCount, sizeof(EXT_BUFFER));
+
+    if (Context.Files == NULL || Buffers == NULL)
+    {
+        fprintf(stderr, "ch10extract: %s\n", strerror(ENOMEM));
+        return -1;
+    }
+
+    //
+    // All recordings, or the ones named on the command line
+    //
+    if (optind + 1 == argc)
+    {
+        for (FileIndex = 0; FileIndex < Context.Volume->FileCount; FileIndex++)
+        {
+            Context.Files[Context.FileCount++].Index = FileIndex;
+        }
+    }
+    else
+    {
+        for (Index = optind + 1; Index < argc; Index++)
+        {
+            Status = Ch10LookupFileName(Context.Volume, argv[Index], &FileIndex);
+
+            if (Status)
+            {
+                fprintf(stderr, "ch10extract: %s: %s\n", argv[Index], strerror(-Status));
+                return -1;
+            }
+
+            if (Context.FileCount < Context.Volume->FileCount)
+            {
+                Context.Files[Context.FileCount++].Index = FileIndex;
+            }
+        }
+    }
+
+    for (FileIndex = 0; FileIndex < Context.FileCount; FileIndex++)
+    {
+        Context.Files[FileIndex].Fd = -1;
+    }
+
+    //
+    // A chunk is read from the sector below the start of the data, so
+    // each buffer has room for one extra sector
+    //
+    for (Index = 0; Index < BufferCount; Index++)
+    {
+        if (Context.Volume->Device.Map == NULL)
+        {
+            Buffers[Index].Memory = Ch10AllocateAligned(
+                Context.ChunkSize + Context.Volume->Device.SectorSize
+                );
+        }
+
+        if (Context.Volume->Device.Map == NULL && Buffers[Index].Memory == NULL)
+        {
+            fprintf(stderr, "ch10extract: %s\n", strerror(ENOMEM));
+            return -1;
+        }
+
+        Buffers[Index].Next = Context.FreeList;
+        Context.FreeList = &Buffers[Index];
+    }
+
+    pthread_mutex_init(&Context.Lock, NULL);
+    pthread_cond_init(&Context.FreeAvailable, NULL);
+    pthread_cond_init(&Context.WriteAvailable, NULL);
+
+    Start = Now();
+
+    for (Index = 0; Index < WriterCount; Index++)
+    {
+        pthread_create(&Writers[Index], NULL, WriterThread, &Context);
+    }
+
+    for (Index = 0; Index < ReaderCount; Index++)
+    {
+        pthread_create(&Readers[Index], NULL, ReaderThread, &Context);
+    }
+
+    for (Index = 0; Index < ReaderCount; Index++)
+    {
+        pthread_join(Readers[Index], NULL);
+    }
+
+    pthread_mutex_lock(&Context.Lock);
+    Context.ReadersDone = 1;
+    pthread_cond_broadcast(&Context.WriteAvailable);
+    pthread_mutex_unlock(&Context.Lock);
+
+    for (Index = 0; Index < WriterCount; Index++)
+    {
+        pthread_join(Writers[Index], NULL);
+    }
+
+    Elapsed = Now() - Start;
+
+    printf(
+        "{\"image\": \"%s\", \"files\": %u, \"failed\": %u, \"bytes\": %llu, "
+        "\"holeBytes\": %llu, "
+        "\"seconds\": %.3f, \"mbPerSecond\": %.1f, \"direct\": %s, \"mapped\": %s, "
+        "\"readers\": %d, \"writers\": %d, \"chunk\": %zu, \"buffers\": %d}\n",
+        argv[optind],
+        Context.FileCount,
+        Context.FilesFailed,
+        (unsigned long long) Context.BytesWritten,
+        (unsigned long long) Context.HoleBytes,
+        Elapsed,
+        Context.BytesWritten / (Elapsed > 0 ? Elapsed : 1) / 1e6,
+        Context.Volume->Device.Flags & CH10_OPEN_DIRECT ? "true" : "false",
+        Context.Volume->Device.Map ? "true" : "false",
+        ReaderCount,
+        WriterCount,
+        Context.ChunkSize,
+        BufferCount
+        );
+
+    for (Index = 0; Index < BufferCount; Index++)
+    {
+        free(Buffers[Index].Memory);
+    }
+
+    free(Buffers);
+    free(Context.Files);
+
+    Ch10DismountVolume(Context.Volume);
+
+    return Context.FilesFailed ? -1 : 0;
+}
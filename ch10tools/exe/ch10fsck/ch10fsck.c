@@ -0,0 +1,892 @@
+/*
+    Program to check the consistency of a Chapter 10 volume.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+//
+// Checks the structure of a volume from the raw directory chain, without
+// trusting it the way a mount does: the chain has to be made of directory
+// blocks of one block size and end without a cycle, and the recordings
+// have to lie on the device, clear of the directory and of each other,
+// with a size their blocks agree with. Every recording then has to start
+// with a valid packet, and with -p every packet of it is read and its
+// data checksum checked, several recordings at once. Output is a JSON
+// document listing each problem found with its severity, and the exit
+// status is 1 when there was an error.
+//
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+#define FSCK_MAX_DIR_BLOCKS     4096
+
+typedef struct _FSCK_PROBLEM {
+    const char  *Severity;          // "error" or "warning"
+    const char  *Check;
+    char        Detail[192];        // more JSON members, each led by ", "
+} FSCK_PROBLEM;
+
+//
+// A directory entry as found in the chain
+//
+typedef struct _FSCK_ENTRY {
+    char                    Name[CH10_MAXFN + 1];
+    __u64                   Start;          // first block
+    __u64                   Blocks;         // blocks it covers
+    int                     Striped;
+    int                     Unclosed;       // last entry of a flagged block
+} FSCK_ENTRY;
+
+typedef struct _FSCK_FILE {
+    int                     HeaderStatus;   // of the first packet
+    int                     ScanStatus;
+    __u64                   Packets;
+    __u64                   BadData;
+    __u64                   Skipped;
+    __u64                   Bytes;
+} FSCK_FILE;
+
+typedef struct _FSCK_CONTEXT {
+    FSCK_PROBLEM            *Problems;
+    __u32                   ProblemCount;
+    __u32                   ProblemCapacity;
+    __u32                   Errors;
+    __u32                   Warnings;
+
+    __u32                   DirBlocks;
+    __u32                   Entries;
+
+    CH10_VOLUME             *Volume;
+    FSCK_FILE               *Files;
+    int                     CheckPackets;
+    __u32                   NextFile;
+    pthread_mutex_t         Lock;
+} FSCK_CONTEXT;
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10fsck [options] <image>[,<image>...]\n"
+        "  -p              read every packet and check its data checksum\n"
+        "  -j <threads>    threads to check with (processors)\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image\n"
+        );
+}
+
+static void
+Report (
+    FSCK_CONTEXT    *Context,
+    const char      *Severity,
+    const char      *Check,
+    const char      *Format,
+    ...
+    )
+{
+    FSCK_PROBLEM    *Problems;
+    FSCK_PROBLEM    *Problem;
+    va_list         Arguments;
+
+    if (Severity[0] == 'e')
+    {
+        Context->Errors++;
+    }
+    else
+    {
+        Context->Warnings++;
+    }
+
+    if (Context->ProblemCount == Context->ProblemCapacity)
+    {
+        Context->ProblemCapacity = Context->ProblemCapacity ? Context->ProblemCapacity * 2 : 64;
+
+        Problems = realloc(Context->Problems, Context->ProblemCapacity * sizeof(FSCK_PROBLEM));
+
+        if (Problems == NULL)
+        {
+            Context->ProblemCapacity = Context->ProblemCount;
+            return;
+        }
+
+        Context->Problems = Problems;
+    }
+
+    Problem = &Context->Problems[Context->ProblemCount++];
+
+    Problem->Severity = Severity;
+    Problem->Check = Check;
+
+    va_start(Arguments, Format);
+    vsnprintf(Problem->Detail, sizeof(Problem->Detail), Format, Arguments);
+    va_end(Arguments);
+}
+
+//
+// Names go into the report as JSON strings
+//
+static const char *
+Quote (
+    const char  *Name,
+    char        *Buffer
+    )
+{
+    char *Out = Buffer;
+
+    for (; *Name; Name++)
+    {
+        if (*Name == '"' || *Name == '\\')
+        {
+            *Out++ = '\\';
+            *Out++ = *Name;
+        }
+        else
+        {
+            *Out++ = (__u8) *Name < 0x20 ? '?' : *Name;
+        }
+    }
+
+    *Out = 0;
+
+    return Buffer;
+}
+
+//
+// Reads the directory block at an offset with a read of the sector around
+// it, returns it or NULL when it is not one
+//
+static struct ch10_dir_block *
+ReadDirBlock (
+    CH10_BLOCKDEV   *Device,
+    __u64           Offset,
+    __u8            *Buffer
+    )
+{
+    struct ch10_dir_block   *DirBlock;
+    __u64                   Start = Offset & ~((__u64) Device->SectorSize - 1);
+    ssize_t                 Result;
+
+    Result = Ch10ReadBlockDevice(Device, Start, Device->SectorSize, Buffer);
+
+    if (Result < (ssize_t) (Offset - Start + sizeof(struct ch10_dir_block)))
+    {
+        return NULL;
+    }
+
+    DirBlock = (struct ch10_dir_block *) (Buffer + (Offset - Start));
+
+    if (memcmp(DirBlock->magicNumAscii, CH10_MAGIC, sizeof(CH10_MAGIC) - 1))
+    {
+        return NULL;
+    }
+
+    return DirBlock;
+}
+
+static int
+CompareEntries (
+    const void *A,
+    const void *B
+    )
+{
+    const FSCK_ENTRY *EntryA = *(const FSCK_ENTRY * const *) A;
+    const FSCK_ENTRY *EntryB = *(const FSCK_ENTRY * const *) B;
+
+    return EntryA->Start < EntryB->Start ? -1 : EntryA->Start > EntryB->Start;
+}
+
+//
+// Checks the entries of one device against the device, the directory and
+// each other
+//
+static void
+CheckEntries (
+    FSCK_CONTEXT    *Context,
+    const char      *Path,
+    __u64           DeviceSize,
+    __u32           BytesPerBlock,
+    const __u64     *DirBlockNumbers,
+    __u32           DirBlockCount,
+    FSCK_ENTRY      *Entries,
+    __u32           EntryCount
+    )
+{
+    FSCK_ENTRY      **Sorted;
+    FSCK_ENTRY      *Entry;
+    FSCK_ENTRY      *Last = NULL;
+    char            Name[2 * CH10_MAXFN + 1];
+    char            Other[2 * CH10_MAXFN + 1];
+    __u32           Index;
+    __u32           Number;
+
+    for (Index = 0; Index < EntryCount; Index++)
+    {
+        Entry = &Entries[Index];
+
+        Quote(Entry->Name, Name);
+
+        if (Entry->Name[0] == 0)
+        {
+            Report(Context, "warning", "emptyName", ", \"device\": \"%s\", \"entry\": %u", Path, Index);
+            continue;
+        }
+
+        for (Number = 0; Number < Index; Number++)
+        {
+            if (!strcasecmp(Entries[Number].Name, Entry->Name))
+            {
+                Report(Context, "error", "duplicateName", ", \"file\": \"%s\"", Name);
+                break;
+            }
+        }
+
+        if (Entry->Blocks == 0)
+        {
+            continue;
+        }
+
+        if (Entry->Start == 0 ||
+            Entry->Start > DeviceSize / BytesPerBlock ||
+            Entry->Blocks > DeviceSize / BytesPerBlock - Entry->Start)
+        {
+            Report(
+                Context,
+                "error",
+                "beyondDevice",
+                ", \"file\": \"%s\", \"blockNum\": %llu, \"blocks\": %llu, \"deviceBlocks\": %llu",
+                Name,
+                (unsigned long long) Entry->Start,
+                (unsigned long long) Entry->Blocks,
+                (unsigned long long) (DeviceSize / BytesPerBlock)
+                );
+        }
+
+        for (Number = 0; Number < DirBlockCount; Number++)
+        {
+            if (DirBlockNumbers[Number] >= Entry->Start &&
+                DirBlockNumbers[Number] - Entry->Start < Entry->Blocks)
+            {
+                Report(
+                    Context,
+                    "error",
+                    "overlapsDirectory",
+                    ", \"file\": \"%s\", \"dirBlock\": %llu",
+                    Name,
+                    (unsigned long long) DirBlockNumbers[Number]
+                    );
+                break;
+            }
+        }
+    }
+
+    //
+    // Sorted by first block, a recording overlaps another when it starts
+    // before the furthest end seen so far
+    //
+    Sorted = malloc((EntryCount ? EntryCount : 1) * sizeof(FSCK_ENTRY *));
+
+    if (Sorted == NULL)
+    {
+        return;
+    }
+
+    for (Index = 0, Number = 0; Index < EntryCount; Index++)
+    {
+        if (Entries[Index].Blocks && Entries[Index].Name[0])
+        {
+            Sorted[Number++] = &Entries[Index];
+        }
+    }
+
+    qsort(Sorted, Number, sizeof(FSCK_ENTRY *), CompareEntries);
+
+    for (Index = 0; Index < Number; Index++)
+    {
+        if (Last && Sorted[Index]->Start < Last->Start + Last->Blocks)
+        {
+            Report(
+                Context,
+                "error",
+                "overlap",
+                ", \"file\": \"%s\", \"other\": \"%s\", \"blockNum\": %llu, \"otherEnd\": %llu",
+                Quote(Sorted[Index]->Name, Name),
+                Quote(Last->Name, Other),
+                (unsigned long long) Sorted[Index]->Start,
+                (unsigned long long) (Last->Start + Last->Blocks)
+                );
+        }
+
+        if (Last == NULL || Sorted[Index]->Start + Sorted[Index]->Blocks > Last->Start + Last->Blocks)
+        {
+            Last = Sorted[Index];
+        }
+    }
+
+    free(Sorted);
+}
+
+//
+// Walks the directory chain of one device block by block, the way the
+// driver does, and checks every block and entry in it
+//
+static int
+CheckDirectory (
+    FSCK_CONTEXT    *Context,
+    const char      *Path,
+    int             Flags
+    )
+{
+    CH10_BLOCKDEV           Device;
+    struct ch10_dir_block   *DirBlock;
+    struct ch10_dir_entry   *DirEntry;
+    __u8                    *Buffer;
+    struct ch10_stripe      *Stripe;
+    FSCK_ENTRY              *Entries = NULL;
+    FSCK_ENTRY              *Entry;
+    __u64                   *Numbers;
+    __u64                   Block = 1;
+    __u64                   Previous = 1;
+    __u64                   Next;
+    __u64                   Size;
+    __u32                   BytesPerBlock = 0;
+    __u32                   Count = 0;
+    __u32                   EntryCount = 0;
+    __u32                   NumEntries;
+    __u32                   Offset;
+    __u32                   Index;
+    char                    Name[2 * CH10_MAXFN + 1];
+    int                     Status;
+
+    Status = Ch10OpenBlockDevice(Path, Flags & CH10_OPEN_DIRECT, &Device);
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    Buffer = Ch10AllocateAligned(Device.SectorSize);
+    Numbers = malloc(FSCK_MAX_DIR_BLOCKS * sizeof(__u64));
+    Entries = malloc(FSCK_MAX_DIR_BLOCKS * MAX_FILES_PER_DIR * sizeof(FSCK_ENTRY));
+
+    if (Buffer == NULL || Numbers == NULL || Entries == NULL)
+    {
+        Status = -ENOMEM;
+        goto Done;
+    }
+
+    //
+    // The root directory block is block 1, in whatever block size puts a
+    // directory block there
+    //
+    for (Offset = CH10_MAGIC_OFFSET; Offset <= CH10_MAX_BLOCK_SIZE; Offset *= 2)
+    {
+        DirBlock = ReadDirBlock(&Device, Offset, Buffer);
+
+        if (DirBlock && be32_to_cpu(DirBlock->bytesPerBlock) == Offset)
+        {
+            BytesPerBlock = Offset;
+            break;
+        }
+    }
+
+    if (BytesPerBlock == 0)
+    {
+        Report(Context, "error", "noRootBlock", ", \"device\": \"%s\"", Path);
+        goto Done;
+    }
+
+    for (;;)
+    {
+        DirBlock = ReadDirBlock(&Device, Block * BytesPerBlock, Buffer);
+
+        if (DirBlock == NULL)
+        {
+            Report(Context, "error", "badMagic", ", \"device\": \"%s\", \"dirBlock\": %llu",
+                Path, (unsigned long long) Block);
+            break;
+        }
+
+        Numbers[Count++] = Block;
+
+        if (be32_to_cpu(DirBlock->bytesPerBlock) != BytesPerBlock)
+        {
+            Report(Context, "error", "blockSize", ", \"device\": \"%s\", \"dirBlock\": %llu, \"bytesPerBlock\": %u",
+                Path, (unsigned long long) Block, be32_to_cpu(DirBlock->bytesPerBlock));
+        }
+
+        if (be64_to_cpu(DirBlock->reverseLink) != Previous)
+        {
+            Report(Context, "warning", "reverseLink", ", \"device\": \"%s\", \"dirBlock\": %llu, \"reverseLink\": %llu",
+                Path, (unsigned long long) Block, (unsigned long long) be64_to_cpu(DirBlock->reverseLink));
+        }
+
+        NumEntries = be16_to_cpu(DirBlock->numEntries);
+
+        if (NumEntries > MAX_FILES_PER_DIR)
+        {
+            Report(Context, "error", "numEntries", ", \"device\": \"%s\", \"dirBlock\": %llu, \"numEntries\": %u",
+                Path, (unsigned long long) Block, NumEntries);
+
+            NumEntries = MAX_FILES_PER_DIR;
+        }
+
+        for (Index = 0; Index < NumEntries; Index++)
+        {
+            DirEntry = &DirBlock->dirEntries[Index];
+            Entry = &Entries[EntryCount++];
+            Stripe = (struct ch10_stripe *) DirEntry->reserved;
+
+            memcpy(Entry->Name, DirEntry->name, CH10_MAXFN);
+            Entry->Name[strnlen(Entry->Name, CH10_MAXFN)] = 0;
+
+            Size = be64_to_cpu(DirEntry->size);
+
+            Entry->Start = be64_to_cpu(DirEntry->blockNum);
+            Entry->Blocks = be64_to_cpu(DirEntry->numBlocks);
+            Entry->Striped = Stripe->tag == CH10_STRIPE_TAG;
+            Entry->Unclosed = DirBlock->shutdown && Index == NumEntries - 1;
+
+            //
+            // A striped member holds only its stripe units of the whole
+            // size, and an entry without blocks is taken to hold its size
+            //
+            if (Entry->Blocks == 0)
+            {
+                Entry->Blocks = (Size + BytesPerBlock - 1) / BytesPerBlock;
+            }
+            else if (!Entry->Striped && !Entry->Unclosed && Size > Entry->Blocks * BytesPerBlock)
+            {
+                Report(
+                    Context,
+                    "warning",
+                    "sizeExceedsBlocks",
+                    ", \"file\": \"%s\", \"size\": %llu, \"numBlocks\": %llu, \"holeBytes\": %llu",
+                    Quote(Entry->Name, Name),
+                    (unsigned long long) Size,
+                    (unsigned long long) Entry->Blocks,
+                    (unsigned long long) (Size - Entry->Blocks * BytesPerBlock)
+                    );
+            }
+        }
+
+        if (DirBlock->shutdown)
+        {
+            Report(
+                Context,
+                "warning",
+                "shutdown",
+                ", \"device\": \"%s\", \"dirBlock\": %llu, \"file\": \"%s\"",
+                Path,
+                (unsigned long long) Block,
+                NumEntries ? Quote(Entries[EntryCount - 1].Name, Name) : ""
+                );
+        }
+
+        //
+        // The last block in the chain links forward to itself
+        //
+        Next = be64_to_cpu(DirBlock->forwardLink);
+
+        if (Next == Block || Next == 0)
+        {
+            break;
+        }
+
+        if (Next >= Device.Size / BytesPerBlock)
+        {
+            Report(Context, "error", "linkOutOfRange", ", \"device\": \"%s\", \"dirBlock\": %llu, \"forwardLink\": %llu",
+                Path, (unsigned long long) Block, (unsigned long long) Next);
+            break;
+        }
+
+        for (Index = 0; Index < Count && Numbers[Index] != Next; Index++)
+        {
+        }
+
+        if (Index < Count)
+        {
+            Report(Context, "error", "linkCycle", ", \"device\": \"%s\", \"dirBlock\": %llu, \"forwardLink\": %llu",
+                Path, (unsigned long long) Block, (unsigned long long) Next);
+            break;
+        }
+
+        if (Count == FSCK_MAX_DIR_BLOCKS)
+        {
+            Report(Context, "error", "dirTooLong", ", \"device\": \"%s\", \"dirBlocks\": %u", Path, Count);
+            break;
+        }
+
+        Previous = Block;
+        Block = Next;
+    }
+
+    if (Count > CH10_MAX_DIR_BLOCKS)
+    {
+        Report(Context, "warning", "dirBeyondDriver", ", \"device\": \"%s\", \"dirBlocks\": %u, \"driverDirBlocks\": %u",
+            Path, Count, CH10_MAX_DIR_BLOCKS);
+    }
+
+    CheckEntries(Context, Path, Device.Size, BytesPerBlock, Numbers, Count, Entries, EntryCount);
+
+    Context->DirBlocks += Count;
+    Context->Entries += EntryCount;
+
+Done:
+    free(Entries);
+    free(Numbers);
+    free(Buffer);
+    Ch10CloseBlockDevice(&Device);
+
+    return Status;
+}
+
+static int
+CountPacket (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    FSCK_FILE *File = Context;
+
+    (void) Offset;
+
+    File->Packets++;
+    File->Bytes += le32_to_cpu(Header->packetLength);
+
+    if (Ch10CheckPacketData(Header))
+    {
+        File->BadData++;
+    }
+
+    return 0;
+}
+
+//
+// Worker thread, takes the next recording until there are none left
+//
+static void *
+CheckFiles (
+    void *Parameter
+    )
+{
+    FSCK_CONTEXT                *Context = Parameter;
+    CH10_VOLUME                 *Volume = Context->Volume;
+    struct ch10_packet_header   Header;
+    FSCK_FILE                   *File;
+    __u32                       Index;
+    ssize_t                     Result;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&Context->Lock);
+        Index = Context->NextFile++;
+        pthread_mutex_unlock(&Context->Lock);
+
+        if (Index >= Volume->FileCount)
+        {
+            break;
+        }
+
+        File = &Context->Files[Index];
+
+        if (Volume->Files[Index].Size == 0)
+        {
+            continue;
+        }
+
+        Result = Ch10ReadFileData(Volume, Index, 0, sizeof(Header), &Header);
+
+        if (Result < 0)
+        {
+            File->HeaderStatus = (int) Result;
+        }
+        else if (Result < (ssize_t) sizeof(Header) || Ch10CheckPacketHeader(&Header))
+        {
+            File->HeaderStatus = -EBADMSG;
+        }
+
+        if (Context->CheckPackets)
+        {
+            File->ScanStatus = Ch10ScanFile(Volume, Index, CountPacket, File, &File->Skipped);
+        }
+    }
+
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    FSCK_CONTEXT    Context;
+    CH10_VOLUME     *Volume = NULL;
+    CH10_FILE       *VolumeFile;
+    FSCK_FILE       *File;
+    FSCK_PROBLEM    *Problem;
+    pthread_t       *Threads;
+    char            *Members;
+    char            *Member;
+    char            *Save;
+    char            Name[2 * CH10_MAXFN + 1];
+    long            ThreadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    long            Workers = 0;
+    int             Flags = CH10_OPEN_DIRECT;
+    int             Option;
+    __u64           Hole;
+    __u64           Packets = 0;
+    __u64           Bytes = 0;
+    __u64           BadData = 0;
+    __u64           Skipped = 0;
+    __u32           Index;
+    double          Start;
+    double          Seconds;
+    int             Status = 0;
+
+    memset(&Context, 0, sizeof(Context));
+
+    while ((Option = getopt(argc, argv, "pj:Bmh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'p': Context.CheckPackets = 1; break;
+        case 'j': ThreadCount = strtol(optarg, NULL, 0); break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind + 1 != argc || ThreadCount < 1)
+    {
+        Usage();
+        return -1;
+    }
+
+    Start = Now();
+
+    //
+    // Each member of a striped set carries a directory of its own
+    //
+    Members = strdup(argv[optind]);
+
+    if (Members == NULL)
+    {
+        fprintf(stderr, "ch10fsck: %s\n", strerror(ENOMEM));
+        return -1;
+    }
+
+    for (Member = strtok_r(Members, ",", &Save); Member; Member = strtok_r(NULL, ",", &Save))
+    {
+        Status = CheckDirectory(&Context, Member, Flags);
+
+        if (Status)
+        {
+            fprintf(stderr, "ch10fsck: %s: %s\n", Member, strerror(-Status));
+            free(Members);
+            return -1;
+        }
+    }
+
+    free(Members);
+
+    //
+    // What a mount makes of the volume, with the size of an unclosed
+    // recording recovered, is what the packets are checked against
+    //
+    if (Context.Errors == 0)
+    {
+        Status = Ch10MountVolume(argv[optind], Flags, &Volume);
+
+        if (Status)
+        {
+            Report(&Context, "error", "mount", ", \"status\": \"%s\"", strerror(-Status));
+        }
+    }
+
+    if (Volume)
+    {
+        Context.Volume = Volume;
+        Context.Files = calloc(Volume->FileCount ? Volume->FileCount : 1, sizeof(FSCK_FILE));
+        Threads = calloc((size_t) ThreadCount, sizeof(pthread_t));
+
+        if (Context.Files == NULL || Threads == NULL)
+        {
+            fprintf(stderr, "ch10fsck: %s\n", strerror(ENOMEM));
+            return -1;
+        }
+
+        //
+        // Threads not needed for a recording each split the recordings
+        //
+        Workers = ThreadCount < (long) Volume->FileCount ? ThreadCount : (long) Volume->FileCount;
+        Volume->ScanThreads = Workers ? (__u32) (ThreadCount / Workers) : 1;
+
+        pthread_mutex_init(&Context.Lock, NULL);
+
+        for (Index = 0; Index < (__u32) Workers; Index++)
+        {
+            if (pthread_create(&Threads[Index], NULL, CheckFiles, &Context))
+            {
+                break;
+            }
+        }
+
+        //
+        // Whatever threads could not be started, this one stands in for
+        //
+        if (Index < (__u32) Workers)
+        {
+            CheckFiles(&Context);
+        }
+
+        Workers = Index;
+
+        for (Index = 0; Index < (__u32) Workers; Index++)
+        {
+            pthread_join(Threads[Index], NULL);
+        }
+
+        pthread_mutex_destroy(&Context.Lock);
+        free(Threads);
+
+        for (Index = 0; Index < Volume->FileCount; Index++)
+        {
+            VolumeFile = &Volume->Files[Index];
+            File = &Context.Files[Index];
+
+            Quote(VolumeFile->Name, Name);
+
+            if (File->HeaderStatus)
+            {
+                Report(&Context, "error", "firstPacket", ", \"file\": \"%s\", \"status\": \"%s\"",
+                    Name, strerror(-File->HeaderStatus));
+            }
+
+            if (!Context.CheckPackets)
+            {
+                continue;
+            }
+
+            if (File->ScanStatus)
+            {
+                Report(&Context, "error", "read", ", \"file\": \"%s\", \"status\": \"%s\"",
+                    Name, strerror(-File->ScanStatus));
+                continue;
+            }
+
+            //
+            // The hole of a sparse recording is reported with its entry
+            //
+            Hole = VolumeFile->Allocated < VolumeFile->Size ? VolumeFile->Size - VolumeFile->Allocated : 0;
+
+            File->Skipped -= File->Skipped < Hole ? File->Skipped : Hole;
+
+            if (File->BadData || File->Skipped)
+            {
+                Report(
+                    &Context,
+                    "error",
+                    "packets",
+                    ", \"file\": \"%s\", \"packets\": %llu, \"badDataChecksums\": %llu, \"skippedBytes\": %llu",
+                    Name,
+                    (unsigned long long) File->Packets,
+                    (unsigned long long) File->BadData,
+                    (unsigned long long) File->Skipped
+                    );
+            }
+
+            Packets += File->Packets;
+            Bytes += File->Bytes;
+            BadData += File->BadData;
+            Skipped += File->Skipped;
+        }
+    }
+
+    Seconds = Now() - Start;
+
+    printf(
+        "{\"image\": \"%s\", \"dirBlocks\": %u, \"entries\": %u, \"files\": %u, \"recovered\": %u, "
+        "\"packetCheck\": %s, \"packets\": %llu, \"badDataChecksums\": %llu, \"skippedBytes\": %llu, "
+        "\"threads\": %ld, \"seconds\": %.3f, \"mbPerSecond\": %.1f, \"errors\": %u, \"warnings\": %u, "
+        "\"problems\": [",
+        argv[optind],
+        Context.DirBlocks,
+        Context.Entries,
+        Volume ? Volume->FileCount : 0,
+        Volume ? Volume->RecoveredCount : 0,
+        Context.CheckPackets ? "true" : "false",
+        (unsigned long long) Packets,
+        (unsigned long long) BadData,
+        (unsigned long long) Skipped,
+        Workers * (long) (Volume && Volume->ScanThreads ? Volume->ScanThreads : 1),
+        Seconds,
+        Seconds > 0 ? (Bytes + Skipped) / Seconds / 1e6 : 0.0,
+        Context.Errors,
+        Context.Warnings
+        );
+
+    for (Index = 0; Index < Context.ProblemCount; Index++)
+    {
+        Problem = &Context.Problems[Index];
+
+        printf(
+            "%s\n  {\"severity\": \"%s\", \"check\": \"%s\"%s}",
+            Index ? "," : "",
+            Problem->Severity,
+            Problem->Check,
+            Problem->Detail
+            );
+    }
+
+    printf("]}\n");
+
+    if (Volume)
+    {
+        Ch10DismountVolume(Volume);
+    }
+
+    free(Context.Files);
+    free(Context.Problems);
+
+    return Context.Errors ? 1 : 0;
+}
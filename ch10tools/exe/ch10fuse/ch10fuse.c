@@ -0,0 +1,832 @@
+/*
+    FUSE file system for Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Presents the recordings of a volume as read only files in a flat root
+// directory, like the driver does. The volume is parsed once at start up,
+// so lookups are served from the name index and attributes never change:
+// the kernel is allowed to cache entries, attributes and data for as long
+// as the file system is mounted.
+//
+// Reads are answered with read_buf. Unless --direct is given the reply
+// refers to the device itself and libfuse splices the data from it to the
+// kernel without copying it through this process.
+//
+// Every Ethernet channel of a recording can also be opened as the pcapng
+// capture <recording>:<channel>.pcapng, every PCM channel as its decoded
+// minor frames <recording>:<channel>.pcm with the layout TMATS gives, and
+// the words of one ARINC-429 label as <recording>:<channel>-<bus>-<label>.a429.
+// These streams are not listed, the view of one is built on its first
+// lookup and kept until unmount.
+//
+
+#define FUSE_USE_VERSION 31
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <fuse.h>
+
+#include "ch10lib.h"
+
+//
+// Read only media, the attributes are valid until unmount
+//
+#define CH10FS_TIMEOUT      (365.0 * 24 * 60 * 60)
+
+#define CH10FS_MAX_READ     (1024 * 1024)
+
+#define CH10FS_ROOT_INO     1
+
+//
+// Streams that can be open at the same time, and the file handle bit that
+// marks one
+//
+#define CH10FS_MAX_STREAMS  256
+#define CH10FS_STREAM_FH    (1ULL << 63)
+
+typedef struct _CH10FS_OPTIONS {
+    const char  *Image;
+    int         Direct;
+    int         Help;
+} CH10FS_OPTIONS;
+
+typedef struct _CH10FS_STREAM {
+    int         Type;       // CH10_STREAM_XXX
+    __u32       FileIndex;
+    __u16       ChannelId;
+    __u32       Filter;     // bus and label of an ARINC-429 stream
+    __u64       Size;
+    union {
+        CH10_PCAPNG *Pcapng;
+        CH10_PCM    *Pcm;
+        CH10_ARINC  *Arinc;
+    };
+} CH10FS_STREAM;
+
+typedef struct _CH10FS {
+    CH10_VOLUME *Volume;
+    struct stat ImageStat;
+    int         Direct;
+
+    // Views of the streams looked up so far, only ever added to
+    CH10FS_STREAM   Streams[CH10FS_MAX_STREAMS];
+    __u32           StreamCount;
+    pthread_mutex_t StreamLock;
+} CH10FS;
+
+static const struct fuse_opt Ch10fsOptions[] = {
+    { "--direct", offsetof(CH10FS_OPTIONS, Direct), 1 },
+    { "-h", offsetof(CH10FS_OPTIONS, Help), 1 },
+    { "--help", offsetof(CH10FS_OPTIONS, Help), 1 },
+    FUSE_OPT_END
+};
+
+static CH10FS *
+Ch10fsGetContext (
+    void
+    )
+{
+    return (CH10FS *) fuse_get_context()->private_data;
+}
+
+static void
+Ch10fsFillStat (
+    CH10FS      *Fs,
+    __u32       Index,
+    struct stat *Stat
+    )
+{
+    CH10_FILE *File = &Fs->Volume->Files[Index];
+
+    memset(Stat, 0, sizeof(struct stat));
+
+    Stat->st_ino = CH10FS_ROOT_INO + 1 + Index;
+    Stat->st_mode = S_IFREG | 0444;
+    Stat->st_nlink = 1;
+    Stat->st_uid = Fs->ImageStat.st_uid;
+    Stat->st_gid = Fs->ImageStat.st_gid;
+    Stat->st_size = (off_t) File->Size;
+    Stat->st_blksize = CH10FS_MAX_READ;
+    Stat->st_blocks = (blkcnt_t) (File->Allocated / 512);
+    Stat->st_atim = Fs->ImageStat.st_mtim;
+    Stat->st_mtim = Fs->ImageStat.st_mtim;
+    Stat->st_ctim = Fs->ImageStat.st_mtim;
+}
+
+static void
+Ch10fsFillStreamStat (
+    CH10FS      *Fs,
+    __u32       Stream,
+    struct stat *Stat
+    )
+{
+    Ch10fsFillStat(Fs, Fs->Streams[Stream].FileIndex, Stat);
+
+    Stat->st_ino = CH10FS_ROOT_INO + 1 + Fs->Volume->FileCount + Stream;
+    Stat->st_size = (off_t) Fs->Streams[Stream].Size;
+    Stat->st_blocks = (blkcnt_t) ((Fs->Streams[Stream].Size + 511) / 512);
+}
+
+static ssize_t
+Ch10fsReadStream (
+    CH10FS_STREAM   *Stream,
+    __u64           Offset,
+    size_t          Length,
+    void            *Buffer
+    )
+{
+    if (Stream->Type == CH10_STREAM_PCM)
+    {
+        return Ch10ReadPcm(Stream->Pcm, Offset, Length, Buffer);
+    }
+
+    if (Stream->Type == CH10_STREAM_ARINC)
+    {
+        return Ch10ReadArinc(Stream->Arinc, Offset, Length, Buffer);
+    }
+
+    return Ch10ReadPcapng(Stream->Pcapng, Offset, Length, Buffer);
+}
+
+//
+// Finds the stream a path names and builds its view the first time.
+// Returns -ENOENT when the path is not the name of a stream.
+//
+static int
+Ch10fsLookupStream (
+    CH10FS      *Fs,
+    const char  *Path,
+    __u32       *Stream
+    )
+{
+    CH10FS_STREAM   *View;
+    char            Name[CH10_MAXFN + 1];
+    __u16           ChannelId;
+    __u32           Filter;
+    __u32           Index;
+    __u32           Number;
+    int             Length;
+    int             Type;
+    int             Status;
+
+    if (strchr(Path + 1, '/'))
+    {
+        return -ENOENT;
+    }
+
+    Length = Ch10ParseStreamName(Path + 1, &ChannelId, &Filter, &Type);
+
+    if (Length < 0 || Length > CH10_MAXFN)
+    {
+        return -ENOENT;
+    }
+
+    memcpy(Name, Path + 1, (size_t) Length);
+    Name[Length] = 0;
+
+    Status = Ch10LookupFileName(Fs->Volume, Name, &Index);
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    pthread_mutex_lock(&Fs->StreamLock);
+
+    for (Number = 0; Number < Fs->StreamCount; Number++)
+    {
+        if (Fs->Streams[Number].Type == Type &&
+            Fs->Streams[Number].FileIndex == Index &&
+            Fs->Streams[Number].ChannelId == ChannelId &&
+            Fs->Streams[Number].Filter == Filter)
+        {
+            *Stream = Number;
+            pthread_mutex_unlock(&Fs->StreamLock);
+            return 0;
+        }
+    }
+
+    View = &Fs->Streams[Fs->StreamCount];
+
+    if (Fs->StreamCount == CH10FS_MAX_STREAMS)
+    {
+        Status = -ENFILE;
+    }
+    else if (Type == CH10_STREAM_PCM)
+    {
+        Status = Ch10OpenPcm(Fs->Volume, Index, ChannelId, NULL, &View->Pcm);
+
+        if (!Status)
+        {
+            View->Size = View->Pcm->Size;
+        }
+    }
+    else if (Type == CH10_STREAM_ARINC)
+    {
+        Status = Ch10OpenArinc(Fs->Volume, Index, ChannelId, Filter, &View->Arinc);
+
+        if (!Status)
+        {
+            View->Size = View->Arinc->Size;
+        }
+    }
+    else
+    {
+        Status = Ch10OpenPcapng(Fs->Volume, Index, ChannelId, &View->Pcapng);
+
+        if (!Status)
+        {
+            View->Size = View->Pcapng->Size;
+        }
+    }
+
+    if (!Status)
+    {
+        View->Type = Type;
+        View->FileIndex = Index;
+        View->ChannelId = ChannelId;
+        View->Filter = Filter;
+
+        *Stream = Fs->StreamCount++;
+    }
+
+    pthread_mutex_unlock(&Fs->StreamLock);
+
+    return Status;
+}
+
+static int
+Ch10fsLookup (
+    CH10FS      *Fs,
+    const char  *Path,
+    __u32       *Index
+    )
+{
+    //
+    // The root is the only directory
+    //
+    if (strchr(Path + 1, '/'))
+    {
+        return -ENOENT;
+    }
+
+    return Ch10LookupFileName(Fs->Volume, Path, Index);
+}
+
+static void *
+Ch10fsInit (
+    struct fuse_conn_info   *Conn,
+    struct fuse_config      *Config
+    )
+{
+    CH10FS *Fs = Ch10fsGetContext();
+
+    Config->kernel_cache = 1;
+    Config->use_ino = 1;
+    Config->attr_timeout = CH10FS_TIMEOUT;
+    Config->entry_timeout = CH10FS_TIMEOUT;
+    Config->negative_timeout = CH10FS_TIMEOUT;
+
+    Conn->max_readahead = CH10FS_MAX_READ;
+
+    if (!Fs->Direct)
+    {
+        Conn->want |= Conn->capable & (FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE);
+    }
+
+    Conn->want |= Conn->capable & FUSE_CAP_ASYNC_READ;
+
+    return Fs;
+}
+
+static int
+Ch10fsGetattr (
+    const char              *Path,
+    struct stat             *Stat,
+    struct fuse_file_info   *FileInfo
+    )
+{
+    CH10FS  *Fs = Ch10fsGetContext();
+    __u32   Index;
+    int     Status;
+
+    if (!strcmp(Path, "/"))
+    {
+        memset(Stat, 0, sizeof(struct stat));
+
+        Stat->st_ino = CH10FS_ROOT_INO;
+        Stat->st_mode = S_IFDIR | 0555;
+        Stat->st_nlink = 2;
+        Stat->st_uid = Fs->ImageStat.st_uid;
+        Stat->st_gid = Fs->ImageStat.st_gid;
+        Stat->st_size = Fs->Volume->DirBlockCount * Fs->Volume->BytesPerBlock;
+        Stat->st_atim = Fs->ImageStat.st_mtim;
+        Stat->st_mtim = Fs->ImageStat.st_mtim;
+        Stat->st_ctim = Fs->ImageStat.st_mtim;
+
+        return 0;
+    }
+
+    if (FileInfo)
+    {
+        if (FileInfo->fh & CH10FS_STREAM_FH)
+        {
+            Ch10fsFillStreamStat(Fs, (__u32) FileInfo->fh, Stat);
+        }
+        else
+        {
+            Ch10fsFillStat(Fs, (__u32) FileInfo->fh, Stat);
+        }
+
+        return 0;
+    }
+
+    Status = Ch10fsLookupStream(Fs, Path, &Index);
+
+    if (!Status)
+    {
+        Ch10fsFillStreamStat(Fs, Index, Stat);
+        return 0;
+    }
+
+    if (Status != -ENOENT)
+    {
+        return Status;
+    }
+
+    Status = Ch10fsLookup(Fs, Path, &Index);
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    Ch10fsFillStat(Fs, Index, Stat);
+
+    return 0;
+}
+
+static int
+Ch10fsReaddir (
+    const char                  *Path,
+    void                        *Buffer,
+    fuse_fill_dir_t             Filler,
+    off_t                       Offset,
+    struct fuse_file_info       *FileInfo,
+    enum fuse_readdir_flags     Flags
+    )
+{
+    CH10FS      *Fs = Ch10fsGetContext();
+    struct stat Stat;
+    __u32       Index;
+
+    if (strcmp(Path, "/"))
+    {
+        return -ENOTDIR;
+    }
+
+    Filler(Buffer, ".", NULL, 0, 0);
+    Filler(Buffer, "..", NULL, 0, 0);
+
+    //
+    // The whole directory is returned in one go, with the attributes when
+    // the kernel asks for them so it does not have to look up every name
+    //
+    for (Index = 0; Index < Fs->Volume->FileCount; Index++)
+    {
+        Ch10fsFillStat(Fs, Index, &Stat);
+
+        if (Filler(
+            Buffer,
+            Fs->Volume->Files[Index].Name,
+            &Stat,
+            0,
+            Flags & FUSE_READDIR_PLUS ? FUSE_FILL_DIR_PLUS : 0
+            ))
+        {
+            return -ENOMEM;
+        }
+    }
+
+    return 0;
+}
+
+static int
+Ch10fsOpen (
+    const char              *Path,
+    struct fuse_file_info   *FileInfo
+    )
+{
+    CH10FS  *Fs = Ch10fsGetContext();
+    __u32   Index;
+    int     Status;
+
+    if ((FileInfo->flags & O_ACCMODE) != O_RDONLY)
+    {
+        return -EROFS;
+    }
+
+    Status = Ch10fsLookupStream(Fs, Path, &Index);
+
+    if (!Status)
+    {
+        FileInfo->fh = CH10FS_STREAM_FH | Index;
+    }
+    else if (Status == -ENOENT && !(Status = Ch10fsLookup(Fs, Path, &Index)))
+    {
+        FileInfo->fh = Index;
+    }
+    else
+    {
+        return Status;
+    }
+
+    FileInfo->keep_cache = 1;
+    FileInfo->noflush = 1;
+
+    return 0;
+}
+
+static int
+Ch10fsRead (
+    const char              *Path,
+    char                    *Buffer,
+    size_t                  Length,
+    off_t                   Offset,
+    struct fuse_file_info   *FileInfo
+    )
+{
+    CH10FS *Fs = Ch10fsGetContext();
+
+    if (FileInfo->fh & CH10FS_STREAM_FH)
+    {
+        return (int) Ch10fsReadStream(
+            &Fs->Streams[(__u32) FileInfo->fh],
+            (__u64) Offset,
+            Length,
+            Buffer
+            );
+    }
+
+    return (int) Ch10ReadFileData(
+        Fs->Volume,
+        (__u32) FileInfo->fh,
+        (__u64) Offset,
+        Length,
+        Buffer
+        );
+}
+
+static int
+Ch10fsReadBuf (
+    const char              *Path,
+    struct fuse_bufvec      **BufferVector,
+    size_t                  Length,
+    off_t                   Offset,
+    struct fuse_file_info   *FileInfo
+    )
+{
+    CH10FS              *Fs = Ch10fsGetContext();
+    CH10_FILE           *File;
+    CH10FS_STREAM       *View = NULL;
+    struct fuse_bufvec  *Vector;
+    __u64               Size;
+    ssize_t             Result;
+
+    if (FileInfo->fh & CH10FS_STREAM_FH)
+    {
+        View = &Fs->Streams[(__u32) FileInfo->fh];
+        File = &Fs->Volume->Files[View->FileIndex];
+        Size = View->Size;
+    }
+    else
+    {
+        File = &Fs->Volume->Files[FileInfo->fh];
+        Size = File->Size;
+    }
+
+    Vector = malloc(sizeof(struct fuse_bufvec));
+
+    if (Vector == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    *Vector = FUSE_BUFVEC_INIT(0);
+
+    if ((__u64) Offset < Size)
+    {
+        if (Length > Size - Offset)
+        {
+            Length = (size_t) (Size - Offset);
+        }
+
+        if (View == NULL &&
+            !Fs->Direct &&
+            (__u64) Offset + Length <= File->Allocated &&
+            File->StripeCount == 0 &&
+            File->DirEntry->reserved[0] != CH10_STRIPE_TAG)
+        {
+            //
+            // Let libfuse move the data straight from the device
+            //
+            Vector->buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK | FUSE_BUF_FD_RETRY;
+            Vector->buf[0].fd = Fs->Volume->Device.Fd;
+            Vector->buf[0].pos = (off_t) (File->Offset + Offset);
+            Vector->buf[0].size = Length;
+        }
+        else
+        {
+            Vector->buf[0].mem = malloc(Length);
+
+            if (Vector->buf[0].mem == NULL)
+            {
+                free(Vector);
+                return -ENOMEM;
+            }
+
+            if (View)
+            {
+                Result = Ch10fsReadStream(View, (__u64) Offset, Length, Vector->buf[0].mem);
+            }
+            else
+            {
+                Result = Ch10ReadFileData(
+                    Fs->Volume,
+                    (__u32) FileInfo->fh,
+                    (__u64) Offset,
+                    Length,
+                    Vector->buf[0].mem
+                    );
+            }
+
+            if (Result < 0)
+            {
+                free(Vector->buf[0].mem);
+                free(Vector);
+                return (int) Result;
+            }
+
+            Vector->buf[0].size = (size_t) Result;
+        }
+    }
+
+    *BufferVector = Vector;
+
+    return 0;
+}
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+
+//
+// SEEK_DATA and SEEK_HOLE, so copies skip the hole of a sparse recording
+//
+static off_t
+Ch10fsLseek (
+    const char              *Path,
+    off_t                   Offset,
+    int                     Whence,
+    struct fuse_file_info   *FileInfo
+    )
+{
+    CH10FS          *Fs = Ch10fsGetContext();
+    CH10FS_STREAM   *View;
+
+    if (Offset < 0)
+    {
+        return -EINVAL;
+    }
+
+    //
+    // A stream has no holes
+    //
+    if (FileInfo->fh & CH10FS_STREAM_FH)
+    {
+        View = &Fs->Streams[(__u32) FileInfo->fh];
+
+        if ((__u64) Offset >= View->Size)
+        {
+            return -ENXIO;
+        }
+
+        return Whence == SEEK_HOLE ? (off_t) View->Size : Offset;
+    }
+
+    return (off_t) Ch10SeekFileData(
+        Fs->Volume,
+        (__u32) FileInfo->fh,
+        (__u64) Offset,
+        Whence
+        );
+}
+
+#endif
+
+static int
+Ch10fsStatfs (
+    const char      *Path,
+    struct statvfs  *Stat
+    )
+{
+    CH10FS *Fs = Ch10fsGetContext();
+
+    memset(Stat, 0, sizeof(struct statvfs));
+
+    Stat->f_bsize = Fs->Volume->BytesPerBlock;
+    Stat->f_frsize = Fs->Volume->BytesPerBlock;
+    Stat->f_blocks = Fs->Volume->Device.Size / Fs->Volume->BytesPerBlock;
+    Stat->f_files = Fs->Volume->FileCount;
+    Stat->f_namemax = CH10_MAXFN;
+    Stat->f_flag = ST_RDONLY;
+
+    return 0;
+}
+
+static void
+Ch10fsDestroy (
+    void *PrivateData
+    )
+{
+    CH10FS *Fs = (CH10FS *) PrivateData;
+    __u32  Number;
+
+    for (Number = 0; Number < Fs->StreamCount; Number++)
+    {
+        if (Fs->Streams[Number].Type == CH10_STREAM_PCM)
+        {
+            Ch10ClosePcm(Fs->Streams[Number].Pcm);
+        }
+        else if (Fs->Streams[Number].Type == CH10_STREAM_ARINC)
+        {
+            Ch10CloseArinc(Fs->Streams[Number].Arinc);
+        }
+        else
+        {
+            Ch10ClosePcapng(Fs->Streams[Number].Pcapng);
+        }
+    }
+
+    Fs->StreamCount = 0;
+
+    Ch10DismountVolume(Fs->Volume);
+    Fs->Volume = NULL;
+}
+
+static const struct fuse_operations Ch10fsOperations = {
+    .init       = Ch10fsInit,
+    .destroy    = Ch10fsDestroy,
+    .getattr    = Ch10fsGetattr,
+    .readdir    = Ch10fsReaddir,
+    .open       = Ch10fsOpen,
+    .read       = Ch10fsRead,
+    .read_buf   = Ch10fsReadBuf,
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+    .lseek      = Ch10fsLseek,
+#endif
+    .statfs     = Ch10fsStatfs,
+};
+
+//
+// The first argument that is not an option is the image, the second one
+// is the mount point and is left for fuse_main
+//
+static int
+Ch10fsProcessOption (
+    void                *Data,
+    const char          *Argument,
+    int                 Key,
+    struct fuse_args    *OutArgs
+    )
+{
+    CH10FS_OPTIONS *Options = (CH10FS_OPTIONS *) Data;
+
+    if (Key == FUSE_OPT_KEY_NONOPT && Options->Image == NULL)
+    {
+        Options->Image = Argument;
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    struct fuse_args    Args = FUSE_ARGS_INIT(argc, argv);
+    CH10FS_OPTIONS      Options;
+    CH10FS              Fs;
+    char                Option[2 * 4096 + 64];
+    const char          *Name;
+    size_t              Length;
+    int                 Status;
+
+    memset(&Options, 0, sizeof(Options));
+    memset(&Fs, 0, sizeof(Fs));
+
+    pthread_mutex_init(&Fs.StreamLock, NULL);
+
+    if (fuse_opt_parse(&Args, &Options, Ch10fsOptions, Ch10fsProcessOption))
+    {
+        return 1;
+    }
+
+    if (Options.Help || Options.Image == NULL)
+    {
+        fprintf(
+            stderr,
+            "syntax: ch10fuse [options] <image> <mountpoint>\n"
+            "  --direct        read the image with direct I/O instead of splicing\n"
+            "                  from the page cache\n"
+            "  -s              single threaded\n"
+            "  -f              stay in the foreground\n"
+            "  -o <options>    FUSE mount options\n"
+            );
+
+        if (Options.Help)
+        {
+            fuse_opt_add_arg(&Args, "--help");
+            fuse_main(Args.argc, Args.argv, &Ch10fsOperations, NULL);
+        }
+
+        fuse_opt_free_args(&Args);
+        return 1;
+    }
+
+    Fs.Direct = Options.Direct;
+
+    Status = Ch10MountVolume(
+        Options.Image,
+        (Options.Direct ? CH10_OPEN_DIRECT : 0) | CH10_OPEN_INDEX,
+        &Fs.Volume
+        );
+
+    if (!Status && fstat(Fs.Volume->Device.Fd, &Fs.ImageStat))
+    {
+        Status = -errno;
+    }
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10fuse: %s: %s\n", Options.Image, strerror(-Status));
+        fuse_opt_free_args(&Args);
+        return 1;
+    }
+
+    Length = (size_t) snprintf(
+        Option,
+        sizeof(Option),
+        "-oro,subtype=ch10,max_read=%u,fsname=",
+        CH10FS_MAX_READ
+        );
+
+    //
+    // The members of a striped set are separated by commas, which have to
+    // be escaped in an option list
+    //
+    for (Name = Options.Image; *Name && Length + 3 < sizeof(Option); Name++)
+    {
+        if (*Name == ',' || *Name == '\\')
+        {
+            Option[Length++] = '\\';
+        }
+
+        Option[Length++] = *Name;
+    }
+
+    Option[Length] = 0;
+
+    fuse_opt_add_arg(&Args, Option);
+
+    Status = fuse_main(Args.argc, Args.argv, &Ch10fsOperations, &Fs);
+
+    //
+    // destroy is not called when the mount failed
+    //
+    if (Fs.Volume)
+    {
+        Ch10DismountVolume(Fs.Volume);
+    }
+
+    fuse_opt_free_args(&Args);
+
+    return Status;
+}
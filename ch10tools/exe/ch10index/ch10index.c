@@ -0,0 +1,210 @@
+/*
+    Program to build and check index sidecars for Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Scans every recording of a volume once and writes the sidecar that
+// Ch10MountVolume with CH10_OPEN_INDEX, and the driver, load instead of
+// rebuilding their tables. The driver looks for the sidecar under its
+// fingerprint, which is printed with the summary. Each recording is
+// scanned by as many threads as there are processors unless -j says
+// otherwise.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "border.h"
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+//
+// Every recording must be found through the name table of the sidecar
+//
+static int
+CheckLookups (
+    CH10_VOLUME *Volume
+    )
+{
+    __u32   FileIndex;
+    __u32   Found;
+
+    for (FileIndex = 0; FileIndex < Volume->FileCount; FileIndex++)
+    {
+        if (Ch10LookupFileName(Volume, Volume->Files[FileIndex].Name, &Found) ||
+            strcasecmp(Volume->Files[Found].Name, Volume->Files[FileIndex].Name))
+        {
+            return -EBADMSG;
+        }
+    }
+
+    return 0;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10index [options] <image>\n"
+        "  -o <path>       sidecar to write or check (<image>" CH10_INDEX_SUFFIX ")\n"
+        "  -c              check the sidecar instead of writing it\n"
+        "  -j <threads>    threads to scan a recording with (processors)\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image\n"
+        );
+}
+
+int main(int argc, char* argv[])
+{
+    CH10_VOLUME *Volume;
+    const char  *IndexPath = NULL;
+    char        *DefaultPath = NULL;
+    int         Flags = CH10_OPEN_DIRECT;
+    int         Check = 0;
+    long        Threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int         Option;
+    __u64       Skipped = 0;
+    __u32       FileIndex;
+    double      Start;
+    double      Elapsed;
+    int         Status;
+
+    while ((Option = getopt(argc, argv, "o:cj:Bmh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'o': IndexPath = optarg; break;
+        case 'c': Check = 1; break;
+        case 'j': Threads = strtol(optarg, NULL, 0); break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind + 1 != argc || Threads < 1)
+    {
+        Usage();
+        return -1;
+    }
+
+    if (IndexPath == NULL)
+    {
+        DefaultPath = Ch10GetIndexPath(argv[optind]);
+
+        if (DefaultPath == NULL)
+        {
+            fprintf(stderr, "ch10index: %s\n", strerror(ENOMEM));
+            return -1;
+        }
+
+        IndexPath = DefaultPath;
+    }
+
+    Status = Ch10MountVolume(argv[optind], Flags, &Volume);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10index: %s: %s\n", argv[optind], strerror(-Status));
+        return -1;
+    }
+
+    Volume->ScanThreads = (__u32) Threads;
+
+    Start = Now();
+
+    if (!Check)
+    {
+        Status = Ch10WriteIndex(Volume, IndexPath);
+    }
+
+    if (!Status)
+    {
+        Status = Ch10OpenIndex(Volume, IndexPath);
+    }
+
+    if (!Status)
+    {
+        Status = Ch10CheckIndex(Volume);
+    }
+
+    if (!Status)
+    {
+        Status = CheckLookups(Volume);
+    }
+
+    Elapsed = Now() - Start;
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10index: %s: %s\n", IndexPath, strerror(-Status));
+        Ch10DismountVolume(Volume);
+        free(DefaultPath);
+        return -1;
+    }
+
+    for (FileIndex = 0; FileIndex < Volume->FileCount; FileIndex++)
+    {
+        Skipped += le64_to_cpu(Volume->Index->Files[FileIndex].skippedBytes);
+    }
+
+    printf(
+        "{\"image\": \"%s\", \"index\": \"%s\", \"fingerprint\": \"%016llx\", "
+        "\"files\": %u, \"recoveredFiles\": %u, \"packets\": %llu, \"timePackets\": %llu, "
+        "\"analogChannels\": %llu, \"summaries\": %llu, "
+        "\"skippedBytes\": %llu, \"indexBytes\": %llu, \"scanThreads\": %u, \"%s\": %.3f}\n",
+        argv[optind],
+        IndexPath,
+        (unsigned long long) Ch10VolumeFingerprint(Volume),
+        Volume->FileCount,
+        Volume->RecoveredCount,
+        (unsigned long long) Volume->Index->PacketCount,
+        (unsigned long long) Volume->Index->TimeCount,
+        (unsigned long long) Volume->Index->AnalogCount,
+        (unsigned long long) Volume->Index->SummaryCount,
+        (unsigned long long) Skipped,
+        (unsigned long long) Volume->Index->Length,
+        Volume->ScanThreads,
+        Check ? "checkSeconds" : "buildSeconds",
+        Elapsed
+        );
+
+    Ch10DismountVolume(Volume);
+    free(DefaultPath);
+
+    return 0;
+}
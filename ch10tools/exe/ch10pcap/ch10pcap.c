@@ -0,0 +1,344 @@
+/*
+    Program to present Chapter 10 Ethernet channels as pcapng captures.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Without a stream name lists the Ethernet channels of a recording. Given
+// <recording>:<channel>.pcapng it opens the same view ch10fuse serves,
+// reads it from start to end in pieces of the read size and writes it to
+// the output file when there is one. Output is a JSON document with the
+// time taken to open the view and to read it.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+#define MAX_CHANNELS        65536
+
+typedef struct _CHANNEL_LIST {
+    __u64   Packets[MAX_CHANNELS];
+    __u64   Bytes[MAX_CHANNELS];
+} CHANNEL_LIST;
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10pcap [options] <image> <recording>[:<channel>.pcapng]\n"
+        "  -o <file>       write the capture to a file\n"
+        "  -s <bytes>      size of the reads of the capture (1M)\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image\n"
+        );
+}
+
+static int
+CountPacket (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    CHANNEL_LIST *List = (CHANNEL_LIST *) Context;
+
+    (void) Offset;
+
+    if (Header->dataType == CH10_DATA_ETHERNET_F0)
+    {
+        List->Packets[le16_to_cpu(Header->channelId)]++;
+        List->Bytes[le16_to_cpu(Header->channelId)] += le32_to_cpu(Header->dataLength);
+    }
+
+    return 0;
+}
+
+static int
+ListChannels (
+    CH10_VOLUME *Volume,
+    const char  *Image,
+    __u32       FileIndex
+    )
+{
+    const struct ch10_index_packet  *Packets;
+    CHANNEL_LIST                    *List;
+    ssize_t                         Count;
+    ssize_t                         Packet;
+    __u64                           Skipped = 0;
+    int                             Channel;
+    int                             First;
+    int                             Status = 0;
+
+    List = calloc(1, sizeof(CHANNEL_LIST));
+
+    if (List == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    Count = Ch10GetFilePackets(Volume, FileIndex, &Packets);
+
+    if (Count >= 0)
+    {
+        for (Packet = 0; Packet < Count; Packet++)
+        {
+            if (Packets[Packet].dataType == CH10_DATA_ETHERNET_F0)
+            {
+                List->Packets[le16_to_cpu(Packets[Packet].channelId)]++;
+                List->Bytes[le16_to_cpu(Packets[Packet].channelId)] +=
+                    le32_to_cpu(Packets[Packet].packetLength);
+            }
+        }
+    }
+    else
+    {
+        Status = Ch10ScanFile(Volume, FileIndex, CountPacket, List, &Skipped);
+    }
+
+    if (Status)
+    {
+        free(List);
+        return Status;
+    }
+
+    printf(
+        "{\"image\": \"%s\", \"recording\": \"%s\", \"indexed\": %s, \"channels\": [",
+        Image,
+        Volume->Files[FileIndex].Name,
+        Count >= 0 ? "true" : "false"
+        );
+
+    for (Channel = 0, First = 1; Channel < MAX_CHANNELS; Channel++)
+    {
+        if (List->Packets[Channel])
+        {
+            printf(
+                "%s\n  {\"channel\": %d, \"stream\": \"%s%c%d%s\", \"packets\": %llu, \"bytes\": %llu}",
+                First ? "" : ",",
+                Channel,
+                Volume->Files[FileIndex].Name,
+                CH10_STREAM_SEPARATOR,
+                Channel,
+                CH10_PCAPNG_SUFFIX,
+                (unsigned long long) List->Packets[Channel],
+                (unsigned long long) List->Bytes[Channel]
+                );
+
+            First = 0;
+        }
+    }
+
+    printf("]}\n");
+
+    free(List);
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    CH10_VOLUME *Volume;
+    CH10_PCAPNG *View;
+    const char  *OutputPath = NULL;
+    char        *Buffer;
+    char        Name[CH10_MAXFN + 1];
+    size_t      ReadSize = 1024 * 1024;
+    int         Flags = CH10_OPEN_DIRECT | CH10_OPEN_INDEX;
+    int         Output = -1;
+    int         Option;
+    int         Length;
+    int         Type;
+    __u16       ChannelId;
+    __u32       Filter;
+    __u32       FileIndex;
+    __u64       Offset;
+    ssize_t     Result = 0;
+    double      Start;
+    double      OpenSeconds;
+    double      ReadSeconds;
+    int         Status;
+
+    while ((Option = getopt(argc, argv, "o:s:Bmh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'o': OutputPath = optarg; break;
+        case 's': ReadSize = strtoul(optarg, NULL, 0); break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP | CH10_OPEN_INDEX; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind + 2 != argc || ReadSize == 0)
+    {
+        Usage();
+        return -1;
+    }
+
+    Status = Ch10MountVolume(argv[optind], Flags, &Volume);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10pcap: %s: %s\n", argv[optind], strerror(-Status));
+        return -1;
+    }
+
+    Length = Ch10ParseStreamName(argv[optind + 1], &ChannelId, &Filter, &Type);
+
+    if (Length >= 0 && Type != CH10_STREAM_PCAPNG)
+    {
+        Length = -ENOENT;
+    }
+
+    snprintf(
+        Name,
+        sizeof(Name),
+        "%.*s",
+        Length < 0 ? (int) strlen(argv[optind + 1]) : Length,
+        argv[optind + 1]
+        );
+
+    Status = Ch10LookupFileName(Volume, Name, &FileIndex);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10pcap: %s: %s\n", Name, strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    if (Length < 0)
+    {
+        Status = ListChannels(Volume, argv[optind], FileIndex);
+
+        if (Status)
+        {
+            fprintf(stderr, "ch10pcap: %s: %s\n", Name, strerror(-Status));
+        }
+
+        Ch10DismountVolume(Volume);
+        return Status ? -1 : 0;
+    }
+
+    Start = Now();
+
+    Status = Ch10OpenPcapng(Volume, FileIndex, ChannelId, &View);
+
+    OpenSeconds = Now() - Start;
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10pcap: %s: %s\n", argv[optind + 1], strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Buffer = malloc(ReadSize);
+
+    if (OutputPath)
+    {
+        Output = open(OutputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (Buffer == NULL || (OutputPath && Output < 0))
+    {
+        fprintf(stderr, "ch10pcap: %s\n", strerror(Buffer ? errno : ENOMEM));
+        free(Buffer);
+        Ch10ClosePcapng(View);
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Start = Now();
+
+    for (Offset = 0; Offset < View->Size; Offset += (__u64) Result)
+    {
+        Result = Ch10ReadPcapng(View, Offset, ReadSize, Buffer);
+
+        if (Result <= 0)
+        {
+            Result = Result ? Result : -EIO;
+            break;
+        }
+
+        if (Output >= 0 && write(Output, Buffer, (size_t) Result) != Result)
+        {
+            Result = -errno;
+            break;
+        }
+    }
+
+    ReadSeconds = Now() - Start;
+
+    if (Result < 0)
+    {
+        fprintf(stderr, "ch10pcap: %s: %s\n", argv[optind + 1], strerror((int) -Result));
+    }
+    else
+    {
+        printf(
+            "{\"image\": \"%s\", \"stream\": \"%s\", \"indexed\": %s, \"packets\": %u, "
+            "\"frames\": %llu, \"size\": %llu, \"openSeconds\": %.3f, \"readSeconds\": %.3f, "
+            "\"mbPerSecond\": %.1f}\n",
+            argv[optind],
+            argv[optind + 1],
+            Volume->Index && Volume->Index->Packets ? "true" : "false",
+            View->Count,
+            (unsigned long long) View->FrameCount,
+            (unsigned long long) View->Size,
+            OpenSeconds,
+            ReadSeconds,
+            ReadSeconds > 0 ? View->Size / ReadSeconds / (1024 * 1024) : 0.0
+            );
+    }
+
+    if (Output >= 0)
+    {
+        close(Output);
+    }
+
+    free(Buffer);
+    Ch10ClosePcapng(View);
+    Ch10DismountVolume(Volume);
+
+    return Result < 0 ? -1 : 0;
+}
@@ -0,0 +1,670 @@
+/*
+    Program to decode the minor frames of Chapter 10 PCM channels.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Without a stream name lists the PCM channels of a recording with the
+// layout TMATS gives them. Given <recording>:<channel>.pcm it opens the
+// same view ch10fuse serves, reads it from start to end in pieces of the
+// read size and writes the records to the output file when there is one.
+// With -b it times the sync search and the decoder on a generated bit
+// stream with bit slips and sync errors instead, the bit by bit search
+// against the vector one. Output is a JSON document.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+#define MAX_CHANNELS        65536
+
+//
+// Layout of the generated stream, the one mkch10img writes
+//
+#define BENCH_SYNC_PATTERN  0xFE6B2840ULL
+#define BENCH_SYNC_BITS     32
+#define BENCH_WORD_BITS     16
+#define BENCH_WORD_COUNT    63
+#define BENCH_MINOR_FRAMES  16
+
+//
+// One frame in BENCH_SLIP_RATE slips, one in BENCH_ERROR_RATE has a sync
+// pattern with a bit error and one in BENCH_LOSS_RATE loses it
+//
+#define BENCH_SLIP_RATE     5000
+#define BENCH_ERROR_RATE    500
+#define BENCH_LOSS_RATE     2000
+
+typedef struct _CHANNEL_LIST {
+    __u64   Packets[MAX_CHANNELS];
+    __u64   Bytes[MAX_CHANNELS];
+} CHANNEL_LIST;
+
+typedef struct _BENCH_COUNT {
+    __u64   Frames;
+    __u64   Locks;
+    __u64   Flywheel;
+    __u64   SfidErrors;
+    __u64   Sum;
+} BENCH_COUNT;
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10pcm [options] <image> <recording>[:<channel>.pcm]\n"
+        "        ch10pcm -b [-n <MB>]\n"
+        "  -o <file>       write the records to a file\n"
+        "  -f <layout>     change the TMATS layout, key=value,... with the keys\n"
+        "                  sync, syncbits, word, words, frame, minor, sfid,\n"
+        "                  sfidbit, sfidbits, sfidfirst, rate, errors, flywheel\n"
+        "  -s <bytes>      size of the reads of the records (1M)\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image\n"
+        "  -b              time the sync search and the decoder on generated data\n"
+        "  -n <MB>         size of the generated stream (256)\n"
+        );
+}
+
+static int
+CountPacket (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    CHANNEL_LIST *List = (CHANNEL_LIST *) Context;
+
+    (void) Offset;
+
+    if (Header->dataType == CH10_DATA_PCM_F1)
+    {
+        List->Packets[le16_to_cpu(Header->channelId)]++;
+        List->Bytes[le16_to_cpu(Header->channelId)] += le32_to_cpu(Header->dataLength);
+    }
+
+    return 0;
+}
+
+static int
+ListChannels (
+    CH10_VOLUME *Volume,
+    const char  *Image,
+    __u32       FileIndex
+    )
+{
+    const struct ch10_index_packet  *Packets;
+    CHANNEL_LIST                    *List;
+    CH10_PCM_LAYOUT                 Layout;
+    ssize_t                         Count;
+    ssize_t                         Packet;
+    __u64                           Skipped = 0;
+    int                             Channel;
+    int                             First;
+    int                             Status = 0;
+
+    List = calloc(1, sizeof(CHANNEL_LIST));
+
+    if (List == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    Count = Ch10GetFilePackets(Volume, FileIndex, &Packets);
+
+    if (Count >= 0)
+    {
+        for (Packet = 0; Packet < Count; Packet++)
+        {
+            if (Packets[Packet].dataType == CH10_DATA_PCM_F1)
+            {
+                List->Packets[le16_to_cpu(Packets[Packet].channelId)]++;
+                List->Bytes[le16_to_cpu(Packets[Packet].channelId)] +=
+                    le32_to_cpu(Packets[Packet].packetLength);
+            }
+        }
+    }
+    else
+    {
+        Status = Ch10ScanFile(Volume, FileIndex, CountPacket, List, &Skipped);
+    }
+
+    if (Status)
+    {
+        free(List);
+        return Status;
+    }
+
+    printf(
+        "{\"image\": \"%s\", \"recording\": \"%s\", \"indexed\": %s, \"channels\": [",
+        Image,
+        Volume->Files[FileIndex].Name,
+        Count >= 0 ? "true" : "false"
+        );
+
+    for (Channel = 0, First = 1; Channel < MAX_CHANNELS; Channel++)
+    {
+        if (!List->Packets[Channel])
+        {
+            continue;
+        }
+
+        printf(
+            "%s\n  {\"channel\": %d, \"stream\": \"%s%c%d%s\", \"packets\": %llu, \"bytes\": %llu",
+            First ? "" : ",",
+            Channel,
+            Volume->Files[FileIndex].Name,
+            CH10_STREAM_SEPARATOR,
+            Channel,
+            CH10_PCM_SUFFIX,
+            (unsigned long long) List->Packets[Channel],
+            (unsigned long long) List->Bytes[Channel]
+            );
+
+        if (!Ch10GetPcmLayout(Volume, FileIndex, (__u16) Channel, &Layout))
+        {
+            printf(
+                ", \"layout\": {\"syncPattern\": \"0x%llx\", \"syncBits\": %u, \"wordBits\": %u, "
+                "\"words\": %u, \"frameBits\": %u, \"minorFrames\": %u, \"sfidWord\": %u, "
+                "\"bitRate\": %u}",
+                (unsigned long long) Layout.SyncPattern,
+                Layout.SyncBits,
+                Layout.WordBits,
+                Layout.WordCount,
+                Layout.FrameBits,
+                Layout.MinorFrames,
+                Layout.SfidWord,
+                Layout.BitRate
+                );
+        }
+
+        printf("}");
+
+        First = 0;
+    }
+
+    printf("]}\n");
+
+    free(List);
+
+    return 0;
+}
+
+//
+// xorshift64, the generated stream only has to be the same every run
+//
+static __u64
+Random (
+    __u64   *Seed
+    )
+{
+    *Seed ^= *Seed << 13;
+    *Seed ^= *Seed >> 7;
+    *Seed ^= *Seed << 17;
+
+    return *Seed;
+}
+
+static void
+PutBits (
+    __u8    *Buffer,
+    __u64   *Bit,
+    __u64   Value,
+    __u32   Bits
+    )
+{
+    while (Bits--)
+    {
+        if ((Value >> Bits) & 1)
+        {
+            Buffer[*Bit >> 3] |= (__u8) (0x80 >> (*Bit & 7));
+        }
+
+        (*Bit)++;
+    }
+}
+
+static int
+CountFrame (
+    void                    *Context,
+    CH10_PCM_DECODER        *Decoder,
+    const CH10_PCM_FRAME    *Frame
+    )
+{
+    BENCH_COUNT *Count = (BENCH_COUNT *) Context;
+
+    (void) Decoder;
+
+    Count->Frames++;
+    Count->Locks += (Frame->Flags & CH10_PCM_FRAME_LOCKED) != 0;
+    Count->Flywheel += (Frame->Flags & CH10_PCM_FRAME_FLYWHEEL) != 0;
+    Count->SfidErrors += (Frame->Flags & CH10_PCM_FRAME_SFID_ERROR) != 0;
+    Count->Sum += Frame->Position;
+
+    return 0;
+}
+
+static int
+Benchmark (
+    __u64   Megabytes
+    )
+{
+    CH10_PCM_LAYOUT     Layout;
+    CH10_PCM_DECODER    Decoder;
+    BENCH_COUNT         Count;
+    __u8                *Buffer;
+    __u64               Bytes = Megabytes * 1024 * 1024;
+    __u64               End = Bytes * 8;
+    __u64               Seed = 0x9E3779B97F4A7C15ULL;
+    __u64               Bit = 0;
+    __u64               Frame;
+    __u64               Sync;
+    __u64               Found[2];
+    __u64               Sum[2];
+    __u64               Piece;
+    __s64               Position;
+    double              Seconds[3];
+    double              Start;
+    __u32               Word;
+    int                 Pass;
+    int                 Status;
+
+    memset(&Layout, 0, sizeof(Layout));
+
+    Layout.SyncPattern = BENCH_SYNC_PATTERN;
+    Layout.SyncBits = BENCH_SYNC_BITS;
+    Layout.WordBits = BENCH_WORD_BITS;
+    Layout.WordCount = BENCH_WORD_COUNT;
+    Layout.MinorFrames = BENCH_MINOR_FRAMES;
+    Layout.SfidWord = 2;
+    Layout.SyncErrors = 1;
+    Layout.Flywheel = CH10_PCM_FLYWHEEL;
+
+    Status = Ch10InitPcmDecoder(&Decoder, &Layout);
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    //
+    // The search reads up to two vectors past the end
+    //
+    Buffer = calloc(1, (size_t) Bytes + 128);
+
+    if (Buffer == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    for (Frame = 0;
+         Bit + 8 + BENCH_SYNC_BITS + (BENCH_WORD_COUNT - 1) * BENCH_WORD_BITS <= End;
+         Frame++)
+    {
+        if (Random(&Seed) % BENCH_SLIP_RATE == 0)
+        {
+            Bit += 1 + Random(&Seed) % 7;
+        }
+
+        Sync = BENCH_SYNC_PATTERN;
+
+        if (Random(&Seed) % BENCH_ERROR_RATE == 0)
+        {
+            Sync ^= 1ULL << (Random(&Seed) % BENCH_SYNC_BITS);
+        }
+
+        if (Random(&Seed) % BENCH_LOSS_RATE == 0)
+        {
+            Sync = Random(&Seed);
+        }
+
+        PutBits(Buffer, &Bit, Sync, BENCH_SYNC_BITS);
+        PutBits(Buffer, &Bit, Frame % BENCH_MINOR_FRAMES, BENCH_WORD_BITS);
+
+        for (Word = 2; Word < BENCH_WORD_COUNT; Word++)
+        {
+            PutBits(Buffer, &Bit, Random(&Seed), BENCH_WORD_BITS);
+        }
+    }
+
+    End = Bit;
+
+    //
+    // Every position of the exact pattern, bit by bit and vector
+    //
+    for (Pass = 0; Pass < 2; Pass++)
+    {
+        Found[Pass] = 0;
+        Sum[Pass] = 0;
+        Start = Now();
+
+        for (Position = 0; Position >= 0; Position++)
+        {
+            Position = Pass ?
+                Ch10FindPcmSync(&Decoder.Search, Buffer, (__u64) Position, End) :
+                Ch10FindPcmSyncSerial(&Decoder.Search, Buffer, (__u64) Position, End);
+
+            if (Position < 0)
+            {
+                break;
+            }
+
+            Found[Pass]++;
+            Sum[Pass] += (__u64) Position;
+        }
+
+        Seconds[Pass] = Now() - Start;
+    }
+
+    //
+    // The whole decoder, fed in packet sized pieces
+    //
+    memset(&Count, 0, sizeof(Count));
+    Ch10ResetPcmDecoder(&Decoder, NULL, 0);
+
+    Start = Now();
+
+    for (Bit = 0; Bit < End && !Status; Bit += Piece)
+    {
+        Piece = End - Bit < 64 * 1024 * 8 ? End - Bit : 64 * 1024 * 8;
+
+        Status = Ch10AppendPcmBits(&Decoder, Buffer + (Bit >> 3), Piece, CH10_PCM_MSB_FIRST);
+
+        if (!Status)
+        {
+            Status = Ch10DecodePcm(&Decoder, CountFrame, &Count);
+        }
+    }
+
+    Seconds[2] = Now() - Start;
+
+    Ch10FreePcmDecoder(&Decoder);
+    free(Buffer);
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    printf(
+        "{\"megabytes\": %llu, \"frames\": %llu, "
+        "\"serialSearch\": {\"syncs\": %llu, \"seconds\": %.3f, \"mbPerSecond\": %.1f}, "
+        "\"vectorSearch\": {\"syncs\": %llu, \"seconds\": %.3f, \"mbPerSecond\": %.1f, \"same\": %s}, "
+        "\"decode\": {\"frames\": %llu, \"locks\": %llu, \"flywheel\": %llu, \"sfidErrors\": %llu, "
+        "\"seconds\": %.3f, \"mbPerSecond\": %.1f}}\n",
+        (unsigned long long) Megabytes,
+        (unsigned long long) Frame,
+        (unsigned long long) Found[0],
+        Seconds[0],
+        Seconds[0] > 0 ? End / 8 / Seconds[0] / (1024 * 1024) : 0.0,
+        (unsigned long long) Found[1],
+        Seconds[1],
+        Seconds[1] > 0 ? End / 8 / Seconds[1] / (1024 * 1024) : 0.0,
+        Found[0] == Found[1] && Sum[0] == Sum[1] ? "true" : "false",
+        (unsigned long long) Count.Frames,
+        (unsigned long long) Count.Locks,
+        (unsigned long long) Count.Flywheel,
+        (unsigned long long) Count.SfidErrors,
+        Seconds[2],
+        Seconds[2] > 0 ? End / 8 / Seconds[2] / (1024 * 1024) : 0.0
+        );
+
+    return Found[0] == Found[1] && Sum[0] == Sum[1] ? 0 : -EIO;
+}
+
+int main(int argc, char* argv[])
+{
+    CH10_VOLUME     *Volume;
+    CH10_PCM        *View;
+    CH10_PCM_LAYOUT Layout;
+    const char      *OutputPath = NULL;
+    const char      *LayoutSpec = NULL;
+    char            *Buffer;
+    char            Name[CH10_MAXFN + 1];
+    size_t          ReadSize = 1024 * 1024;
+    __u64           Megabytes = 256;
+    int             Flags = CH10_OPEN_DIRECT | CH10_OPEN_INDEX;
+    int             Bench = 0;
+    int             Output = -1;
+    int             Option;
+    int             Length;
+    int             Type;
+    __u16           ChannelId;
+    __u32           Filter;
+    __u32           FileIndex;
+    __u64           Offset;
+    ssize_t         Result = 0;
+    double          Start;
+    double          OpenSeconds;
+    double          ReadSeconds;
+    int             Status;
+
+    while ((Option = getopt(argc, argv, "o:f:s:Bmbn:h")) != -1)
+    {
+        switch (Option)
+        {
+        case 'o': OutputPath = optarg; break;
+        case 'f': LayoutSpec = optarg; break;
+        case 's': ReadSize = strtoul(optarg, NULL, 0); break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP | CH10_OPEN_INDEX; break;
+        case 'b': Bench = 1; break;
+        case 'n': Megabytes = strtoull(optarg, NULL, 0); break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (Bench)
+    {
+        if (optind != argc || Megabytes == 0)
+        {
+            Usage();
+            return -1;
+        }
+
+        Status = Benchmark(Megabytes);
+
+        if (Status)
+        {
+            fprintf(stderr, "ch10pcm: %s\n", strerror(-Status));
+        }
+
+        return Status ? -1 : 0;
+    }
+
+    if (optind + 2 != argc || ReadSize == 0)
+    {
+        Usage();
+        return -1;
+    }
+
+    Status = Ch10MountVolume(argv[optind], Flags, &Volume);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10pcm: %s: %s\n", argv[optind], strerror(-Status));
+        return -1;
+    }
+
+    Length = Ch10ParseStreamName(argv[optind + 1], &ChannelId, &Filter, &Type);
+
+    if (Length >= 0 && Type != CH10_STREAM_PCM)
+    {
+        Length = -ENOENT;
+    }
+
+    snprintf(
+        Name,
+        sizeof(Name),
+        "%.*s",
+        Length < 0 ? (int) strlen(argv[optind + 1]) : Length,
+        argv[optind + 1]
+        );
+
+    Status = Ch10LookupFileName(Volume, Name, &FileIndex);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10pcm: %s: %s\n", Name, strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    if (Length < 0)
+    {
+        Status = ListChannels(Volume, argv[optind], FileIndex);
+
+        if (Status)
+        {
+            fprintf(stderr, "ch10pcm: %s: %s\n", Name, strerror(-Status));
+        }
+
+        Ch10DismountVolume(Volume);
+        return Status ? -1 : 0;
+    }
+
+    //
+    // A layout given in full needs no TMATS
+    //
+    if (LayoutSpec)
+    {
+        if (Ch10GetPcmLayout(Volume, FileIndex, ChannelId, &Layout))
+        {
+            memset(&Layout, 0, sizeof(Layout));
+            Layout.Flywheel = CH10_PCM_FLYWHEEL;
+        }
+
+        if (Ch10ParsePcmLayout(LayoutSpec, &Layout))
+        {
+            fprintf(stderr, "ch10pcm: %s: %s\n", LayoutSpec, strerror(EINVAL));
+            Ch10DismountVolume(Volume);
+            return -1;
+        }
+    }
+
+    Start = Now();
+
+    Status = Ch10OpenPcm(Volume, FileIndex, ChannelId, LayoutSpec ? &Layout : NULL, &View);
+
+    OpenSeconds = Now() - Start;
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10pcm: %s: %s\n", argv[optind + 1], strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Buffer = malloc(ReadSize);
+
+    if (OutputPath)
+    {
+        Output = open(OutputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (Buffer == NULL || (OutputPath && Output < 0))
+    {
+        fprintf(stderr, "ch10pcm: %s\n", strerror(Buffer ? errno : ENOMEM));
+        free(Buffer);
+        Ch10ClosePcm(View);
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Start = Now();
+
+    for (Offset = 0; Offset < View->Size; Offset += (__u64) Result)
+    {
+        Result = Ch10ReadPcm(View, Offset, ReadSize, Buffer);
+
+        if (Result <= 0)
+        {
+            Result = Result ? Result : -EIO;
+            break;
+        }
+
+        if (Output >= 0 && write(Output, Buffer, (size_t) Result) != Result)
+        {
+            Result = -errno;
+            break;
+        }
+    }
+
+    ReadSeconds = Now() - Start;
+
+    if (Result < 0)
+    {
+        fprintf(stderr, "ch10pcm: %s: %s\n", argv[optind + 1], strerror((int) -Result));
+    }
+    else
+    {
+        printf(
+            "{\"image\": \"%s\", \"stream\": \"%s\", \"indexed\": %s, \"packets\": %u, "
+            "\"records\": %llu, \"recordSize\": %u, \"locks\": %llu, \"flywheel\": %llu, "
+            "\"bitRate\": %u, \"size\": %llu, \"openSeconds\": %.3f, \"readSeconds\": %.3f, "
+            "\"mbPerSecond\": %.1f}\n",
+            argv[optind],
+            argv[optind + 1],
+            Volume->Index && Volume->Index->Packets ? "true" : "false",
+            View->Count,
+            (unsigned long long) View->RecordCount,
+            View->RecordSize,
+            (unsigned long long) View->LockCount,
+            (unsigned long long) View->FlywheelCount,
+            View->BitRate,
+            (unsigned long long) View->Size,
+            OpenSeconds,
+            ReadSeconds,
+            ReadSeconds > 0 ? View->Bits / 8 / ReadSeconds / (1024 * 1024) : 0.0
+            );
+    }
+
+    if (Output >= 0)
+    {
+        close(Output);
+    }
+
+    free(Buffer);
+    Ch10ClosePcm(View);
+    Ch10DismountVolume(Volume);
+
+    return Result < 0 ? -1 : 0;
+}
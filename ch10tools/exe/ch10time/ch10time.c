@@ -0,0 +1,354 @@
+/*
+    Program to correlate relative and absolute time in Chapter 10 recordings.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Builds the time correlation of a recording, from the index sidecar when
+// there is one and by scanning the recording otherwise, and prints it as
+// JSON together with the time jumps found and any conversions asked for.
+// Absolute times are given as ddd:hh:mm:ss.fffffff, day of year first, or
+// as a count of 100 ns units.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+
+#define MAX_CONVERSIONS     64
+
+static double
+Now (
+    void
+    )
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+
+    return Time.tv_sec + Time.tv_nsec * 1e-9;
+}
+
+//
+// Day of year format, or the date for a point with CH10_TIME_YEAR
+//
+static void
+FormatTime (
+    char        *Text,
+    size_t      Length,
+    __u64       Time,
+    __u32       Flags
+    )
+{
+    __u64       Seconds = Time / CH10_RTC_HZ;
+    unsigned    Fraction = (unsigned) (Time % CH10_RTC_HZ);
+    time_t      Unix;
+    struct tm   Date;
+
+    if (Flags & CH10_TIME_YEAR)
+    {
+        Unix = (time_t) Seconds;
+        gmtime_r(&Unix, &Date);
+
+        snprintf(
+            Text,
+            Length,
+            "%04d-%02d-%02dT%02d:%02d:%02d.%07u",
+            Date.tm_year + 1900,
+            Date.tm_mon + 1,
+            Date.tm_mday,
+            Date.tm_hour,
+            Date.tm_min,
+            Date.tm_sec,
+            Fraction
+            );
+    }
+    else
+    {
+        snprintf(
+            Text,
+            Length,
+            "%03u:%02u:%02u:%02u.%07u",
+            (unsigned) (Seconds / 86400 + 1),
+            (unsigned) (Seconds / 3600 % 24),
+            (unsigned) (Seconds / 60 % 60),
+            (unsigned) (Seconds % 60),
+            Fraction
+            );
+    }
+}
+
+static int
+ParseTime (
+    const char  *Text,
+    __u64       *Time
+    )
+{
+    unsigned    Day;
+    unsigned    Hour;
+    unsigned    Minute;
+    double      Second;
+    char        *End;
+
+    if (sscanf(Text, "%u:%u:%u:%lf", &Day, &Hour, &Minute, &Second) == 4)
+    {
+        if (Day < 1 || Hour > 23 || Minute > 59 || Second < 0 || Second >= 61)
+        {
+            return -EINVAL;
+        }
+
+        *Time = ((((__u64) Day - 1) * 24 + Hour) * 60 + Minute) * 60 * CH10_RTC_HZ +
+            (__u64) (Second * CH10_RTC_HZ + 0.5);
+        return 0;
+    }
+
+    *Time = strtoull(Text, &End, 0);
+
+    return *End ? -EINVAL : 0;
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: ch10time [options] <image> <recording>\n"
+        "  -r <rtc>        convert a relative time to absolute time\n"
+        "  -t <time>       convert an absolute time to relative time and seek\n"
+        "  -p              list every time packet, not only the jumps\n"
+        "  -B              read through the page cache instead of direct I/O\n"
+        "  -m              map the image\n"
+        );
+}
+
+int main(int argc, char* argv[])
+{
+    CH10_VOLUME     *Volume;
+    CH10_TIME_TABLE Table;
+    CH10_TIME_POINT *Point;
+    __u64           Rtcs[MAX_CONVERSIONS];
+    __u64           Times[MAX_CONVERSIONS];
+    int             RtcCount = 0;
+    int             TimeCount = 0;
+    int             Flags = CH10_OPEN_DIRECT | CH10_OPEN_INDEX;
+    int             All = 0;
+    int             Option;
+    int             Index;
+    int             First;
+    __u32           FileIndex;
+    __u32           Number;
+    __u64           Value;
+    __u64           Offset;
+    char            Text[64];
+    double          Start;
+    double          Elapsed;
+    int             Status;
+
+    while ((Option = getopt(argc, argv, "r:t:pBmh")) != -1)
+    {
+        switch (Option)
+        {
+        case 'r':
+            if (RtcCount == MAX_CONVERSIONS)
+            {
+                Usage();
+                return -1;
+            }
+            Rtcs[RtcCount++] = strtoull(optarg, NULL, 0);
+            break;
+        case 't':
+            if (TimeCount == MAX_CONVERSIONS || ParseTime(optarg, &Times[TimeCount]))
+            {
+                Usage();
+                return -1;
+            }
+            TimeCount++;
+            break;
+        case 'p': All = 1; break;
+        case 'B': Flags &= ~CH10_OPEN_DIRECT; break;
+        case 'm': Flags = CH10_OPEN_MMAP | CH10_OPEN_INDEX; break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (optind + 2 != argc)
+    {
+        Usage();
+        return -1;
+    }
+
+    Status = Ch10MountVolume(argv[optind], Flags, &Volume);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10time: %s: %s\n", argv[optind], strerror(-Status));
+        return -1;
+    }
+
+    Status = Ch10LookupFileName(Volume, argv[optind + 1], &FileIndex);
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10time: %s: %s\n", argv[optind + 1], strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    Start = Now();
+
+    Status = Ch10BuildTimeTable(Volume, FileIndex, &Table);
+
+    Elapsed = Now() - Start;
+
+    if (Status)
+    {
+        fprintf(stderr, "ch10time: %s: %s\n", argv[optind + 1], strerror(-Status));
+        Ch10DismountVolume(Volume);
+        return -1;
+    }
+
+    printf(
+        "{\"image\": \"%s\", \"recording\": \"%s\", \"indexed\": %s, "
+        "\"timePackets\": %u, \"jumps\": %u, \"rtcSorted\": %s, \"timeSorted\": %s, "
+        "\"buildSeconds\": %.3f",
+        argv[optind],
+        Volume->Files[FileIndex].Name,
+        Volume->Index && Volume->Index->Packets ? "true" : "false",
+        Table.Count,
+        Table.JumpCount,
+        Table.RtcSorted ? "true" : "false",
+        Table.TimeSorted ? "true" : "false",
+        Elapsed
+        );
+
+    printf(", \"%s\": [", All ? "points" : "jumpPoints");
+
+    for (Number = 0, First = 1; Number < Table.Count; Number++)
+    {
+        Point = &Table.Points[Number];
+
+        if (!All && !(Point->Flags & CH10_TIME_JUMP))
+        {
+            continue;
+        }
+
+        FormatTime(Text, sizeof(Text), Point->Time, Point->Flags);
+
+        printf(
+            "%s\n  {\"offset\": %llu, \"rtc\": %llu, \"time\": \"%s\", "
+            "\"format\": %u, \"source\": %u, \"jump\": %s}",
+            First ? "" : ",",
+            (unsigned long long) Point->Offset,
+            (unsigned long long) Point->Rtc,
+            Text,
+            Point->Format,
+            Point->Source,
+            Point->Flags & CH10_TIME_JUMP ? "true" : "false"
+            );
+
+        First = 0;
+    }
+
+    printf("]");
+
+    if (RtcCount)
+    {
+        printf(", \"fromRtc\": [");
+
+        for (Index = 0; Index < RtcCount; Index++)
+        {
+            Status = Ch10RtcToTime(&Table, Rtcs[Index], &Value);
+
+            if (Status)
+            {
+                printf(
+                    "%s\n  {\"rtc\": %llu, \"error\": \"%s\"}",
+                    Index ? "," : "",
+                    (unsigned long long) Rtcs[Index],
+                    strerror(-Status)
+                    );
+            }
+            else
+            {
+                FormatTime(Text, sizeof(Text), Value, Table.Count ? Table.Points[0].Flags : 0);
+
+                printf(
+                    "%s\n  {\"rtc\": %llu, \"time\": \"%s\"}",
+                    Index ? "," : "",
+                    (unsigned long long) Rtcs[Index],
+                    Text
+                    );
+            }
+        }
+
+        printf("]");
+    }
+
+    if (TimeCount)
+    {
+        printf(", \"fromTime\": [");
+
+        for (Index = 0; Index < TimeCount; Index++)
+        {
+            Status = Ch10TimeToRtc(&Table, Times[Index], &Value);
+
+            if (!Status)
+            {
+                Status = Ch10SeekTime(&Table, Times[Index], &Offset);
+            }
+
+            FormatTime(Text, sizeof(Text), Times[Index], 0);
+
+            if (Status)
+            {
+                printf(
+                    "%s\n  {\"time\": \"%s\", \"error\": \"%s\"}",
+                    Index ? "," : "",
+                    Text,
+                    strerror(-Status)
+                    );
+            }
+            else
+            {
+                printf(
+                    "%s\n  {\"time\": \"%s\", \"rtc\": %llu, \"seekOffset\": %llu}",
+                    Index ? "," : "",
+                    Text,
+                    (unsigned long long) Value,
+                    (unsigned long long) Offset
+                    );
+            }
+        }
+
+        printf("]");
+    }
+
+    printf("}\n");
+
+    Ch10FreeTimeTable(&Table);
+    Ch10DismountVolume(Volume);
+
+    return 0;
+}
@@ -0,0 +1,1384 @@
+/*
+    Program to generate synthetic Chapter 10 volume images.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// The image layout follows what a recorder writes: block 0 is left
+// unused, the directory chain starts at block 1 and the recordings follow
+// the space reserved for the directory. Block 0, unused directory blocks
+// and preallocated slack are never written, so the image stays sparse.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ch10_fs.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+#define WRITE_BUFFER_SIZE   (8 * 1024 * 1024)
+
+#define MAX_CHANNELS        256
+
+//
+// PCM minor frame layout of the generated throughput mode streams
+//
+#define PCM_SYNC_PATTERN    0xFE6B2840
+#define PCM_SYNC_BITS       32
+#define PCM_WORD_BITS       16
+#define PCM_FRAME_WORDS     64
+#define PCM_MINOR_FRAMES    16
+#define PCM_SFID_BITS       4
+
+//
+// ARINC-429 label put in one packet of every RARE_LABEL_PERIOD, once a
+// second with the default packet period
+//
+#define RARE_LABEL          0270
+#define RARE_LABEL_PERIOD   10
+
+typedef struct _GEN_CHANNEL {
+    int     DataType;
+    __u16   ChannelId;
+    __u8    SequenceNum;
+    __u32   Rate;           // bytes per second
+
+    // PCM bit stream state
+    __u32   BitSlip;
+    __u64   StreamPosition;
+    __u32   FrameCount;
+
+    // Analog signal state
+    double  Phase;
+    double  Step;
+} GEN_CHANNEL;
+
+typedef struct _GEN_CORRUPTION {
+    double  Sync;
+    double  HeaderChecksum;
+    double  DataChecksum;
+    double  Length;
+    double  Truncate;
+    double  TimeJump;
+} GEN_CORRUPTION;
+
+typedef struct _GEN_STATS {
+    __u64   Packets;
+    __u64   Bytes;
+    __u64   Corrupted;
+    __u64   Truncated;
+    __u64   TimeJumps;
+} GEN_STATS;
+
+//
+// Writes a recording, to one image or round robin in stripe units to the
+// members of a striped set. Every member holds its part of the recording
+// from the same block on.
+//
+typedef struct _GEN_WRITER {
+    int     Fds[CH10_STRIPE_MAX_MEMBERS];
+    __u32   Members;
+    __u64   StripeUnit; // bytes
+    __u64   Base;       // image offset of the recording on every member
+    __u8    *Buffer;
+    size_t  Length;
+    __u64   Offset;     // recording offset of Buffer[0]
+} GEN_WRITER;
+
+static GEN_CHANNEL      Channels[MAX_CHANNELS];
+static int              ChannelCount;
+static GEN_CORRUPTION   Corruption;
+static GEN_STATS        Stats;
+static __u64            RandomState = 1;
+static int              ChecksumType = CH10_CHECKSUM_32;
+
+static __u64
+Random (
+    void
+    )
+{
+    // xorshift64*
+    RandomState ^= RandomState >> 12;
+    RandomState ^= RandomState << 25;
+    RandomState ^= RandomState >> 27;
+    return RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+static double
+RandomUnit (
+    void
+    )
+{
+    return (Random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int
+WriterFlush (
+    GEN_WRITER *Writer
+    )
+{
+    size_t  Done = 0;
+    size_t  Chunk;
+    __u64   Position;
+    __u64   Unit;
+    ssize_t Result;
+
+    while (Done < Writer->Length)
+    {
+        Position = Writer->Offset + Done;
+        Unit = Position / Writer->StripeUnit;
+
+        Chunk = (size_t) (Writer->StripeUnit - Position % Writer->StripeUnit);
+
+        if (Chunk > Writer->Length - Done)
+        {
+            Chunk = Writer->Length - Done;
+        }
+
+        Result = pwrite(
+            Writer->Fds[Unit % Writer->Members],
+            Writer->Buffer + Done,
+            Chunk,
+            Writer->Base + Unit / Writer->Members * Writer->StripeUnit +
+                Position % Writer->StripeUnit
+            );
+
+        if (Result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        Done += Result;
+    }
+
+    Writer->Offset += Writer->Length;
+    Writer->Length = 0;
+
+    return 0;
+}
+
+static int
+WriterAppend (
+    GEN_WRITER  *Writer,
+    const void  *Data,
+    size_t      Length
+    )
+{
+    int Status;
+
+    if (Writer->Length + Length > WRITE_BUFFER_SIZE)
+    {
+        Status = WriterFlush(Writer);
+        if (Status)
+        {
+            return Status;
+        }
+    }
+
+    memcpy(Writer->Buffer + Writer->Length, Data, Length);
+    Writer->Length += Length;
+
+    return 0;
+}
+
+static __u64
+WriterPosition (
+    GEN_WRITER *Writer
+    )
+{
+    return Writer->Offset + Writer->Length;
+}
+
+static void
+WriterSeek (
+    GEN_WRITER  *Writer,
+    __u64       Offset
+    )
+{
+    Writer->Offset = Offset;
+    Writer->Length = 0;
+}
+
+static __u32
+ParseSize (
+    const char *String
+    )
+{
+    char    *End;
+    double  Value;
+
+    Value = strtod(String, &End);
+
+    switch (*End)
+    {
+    case 'k': case 'K':
+        Value *= 1000;
+        break;
+    case 'm': case 'M':
+        Value *= 1000 * 1000;
+        break;
+    case 'g': case 'G':
+        Value *= 1000 * 1000 * 1000;
+        break;
+    }
+
+    return (__u32) Value;
+}
+
+static int
+ParseChannelMix (
+    char *Spec
+    )
+{
+    char        *Item;
+    char        *Save;
+    char        *Count;
+    char        *Rate;
+    int         DataType;
+    __u32       DefaultRate;
+    int         Number;
+    int         Index;
+    GEN_CHANNEL *Channel;
+
+    //
+    // Channel 0 always carries the TMATS setup record
+    //
+    ChannelCount = 0;
+
+    for (Item = strtok_r(Spec, ",", &Save);
+         Item != NULL;
+         Item = strtok_r(NULL, ",", &Save))
+    {
+        Rate = strchr(Item, '@');
+        if (Rate)
+        {
+            *Rate++ = 0;
+        }
+
+        Count = strchr(Item, ':');
+        if (Count)
+        {
+            *Count++ = 0;
+        }
+
+        if (!strcmp(Item, "time"))
+        {
+            DataType = CH10_DATA_TIME_F1;
+            DefaultRate = 0;
+        }
+        else if (!strcmp(Item, "pcm"))
+        {
+            DataType = CH10_DATA_PCM_F1;
+            DefaultRate = 1000 * 1000;
+        }
+        else if (!strcmp(Item, "analog"))
+        {
+            DataType = CH10_DATA_ANALOG_F1;
+            DefaultRate = 64 * 1000;
+        }
+        else if (!strcmp(Item, "arinc"))
+        {
+            DataType = CH10_DATA_ARINC429_F0;
+            DefaultRate = 8 * 1000;
+        }
+        else if (!strcmp(Item, "eth"))
+        {
+            DataType = CH10_DATA_ETHERNET_F0;
+            DefaultRate = 2 * 1000 * 1000;
+        }
+        else if (!strcmp(Item, "1553"))
+        {
+            DataType = CH10_DATA_1553_F1;
+            DefaultRate = 100 * 1000;
+        }
+        else
+        {
+            fprintf(stderr, "mkch10img: unknown channel type '%s'\n", Item);
+            return -EINVAL;
+        }
+
+        Number = Count ? atoi(Count) : 1;
+
+        for (Index = 0; Index < Number; Index++)
+        {
+            if (ChannelCount == MAX_CHANNELS - 1)
+            {
+                fprintf(stderr, "mkch10img: too many channels\n");
+                return -EINVAL;
+            }
+
+            Channel = &Channels[ChannelCount];
+
+            memset(Channel, 0, sizeof(GEN_CHANNEL));
+
+            Channel->DataType = DataType;
+            Channel->ChannelId = (__u16) (ChannelCount + 1);
+            Channel->Rate = Rate ? ParseSize(Rate) : DefaultRate;
+            Channel->BitSlip = (__u32) (Random() % 8);
+            Channel->Step = 0.001 + 0.01 * RandomUnit();
+
+            ChannelCount++;
+        }
+    }
+
+    return 0;
+}
+
+static int
+ParseCorruption (
+    char *Spec
+    )
+{
+    char    *Item;
+    char    *Save;
+    char    *Value;
+    double  Rate;
+
+    for (Item = strtok_r(Spec, ",", &Save);
+         Item != NULL;
+         Item = strtok_r(NULL, ",", &Save))
+    {
+        Value = strchr(Item, ':');
+        if (Value)
+        {
+            *Value++ = 0;
+        }
+
+        Rate = Value ? atof(Value) : 1.0;
+
+        if (!strcmp(Item, "sync"))
+        {
+            Corruption.Sync = Rate;
+        }
+        else if (!strcmp(Item, "hdrsum"))
+        {
+            Corruption.HeaderChecksum = Rate;
+        }
+        else if (!strcmp(Item, "datasum"))
+        {
+            Corruption.DataChecksum = Rate;
+        }
+        else if (!strcmp(Item, "len"))
+        {
+            Corruption.Length = Rate;
+        }
+        else if (!strcmp(Item, "trunc"))
+        {
+            Corruption.Truncate = Rate;
+        }
+        else if (!strcmp(Item, "tjump"))
+        {
+            Corruption.TimeJump = Rate;
+        }
+        else
+        {
+            fprintf(stderr, "mkch10img: unknown corruption '%s'\n", Item);
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+static void
+PutLe16 (
+    __u8    *Buffer,
+    __u16   Value
+    )
+{
+    Buffer[0] = (__u8) Value;
+    Buffer[1] = (__u8) (Value >> 8);
+}
+
+static void
+PutLe32 (
+    __u8    *Buffer,
+    __u32   Value
+    )
+{
+    PutLe16(Buffer, (__u16) Value);
+    PutLe16(Buffer + 2, (__u16) (Value >> 16));
+}
+
+static __u16
+Bcd (
+    unsigned Value
+    )
+{
+    return (__u16) (((Value / 100) % 10) << 8 | ((Value / 10) % 10) << 4 | (Value % 10));
+}
+
+static __u32
+BuildTmats (
+    __u8 *Body
+    )
+{
+    char    *Text = (char *) Body + 4;
+    int     Length;
+    int     Index;
+    int     Pcm = 0;
+    int     Bit;
+    const char *Type;
+
+    PutLe32(Body, 0);
+
+    Length = sprintf(Text, "G\\106:07;\r\nG\\DSI\\N:1;\r\nR-1\\ID:CH10GEN;\r\n");
+    Length += sprintf(Text + Length, "R-1\\N:%d;\r\n", ChannelCount);
+
+    for (Index = 0; Index < ChannelCount; Index++)
+    {
+        switch (Channels[Index].DataType)
+        {
+        case CH10_DATA_TIME_F1:     Type = "TIMEIN"; break;
+        case CH10_DATA_PCM_F1:      Type = "PCMIN"; break;
+        case CH10_DATA_ANALOG_F1:   Type = "ANAIN"; break;
+        case CH10_DATA_ARINC429_F0: Type = "429IN"; break;
+        case CH10_DATA_ETHERNET_F0: Type = "ETHIN"; break;
+        default:                    Type = "1553IN"; break;
+        }
+
+        Length += sprintf(
+            Text + Length,
+            "R-1\\TK1-%d:%u;\r\nR-1\\CDT-%d:%s;\r\nR-1\\DSI-%d:CH%u;\r\n",
+            Index + 1, Channels[Index].ChannelId,
+            Index + 1, Type,
+            Index + 1, Channels[Index].ChannelId
+            );
+
+        if (Channels[Index].DataType == CH10_DATA_PCM_F1)
+        {
+            Pcm++;
+            Length += sprintf(
+                Text + Length,
+                "R-1\\PDLN-%d:PCM%d;\r\nP-%d\\DLN:PCM%d;\r\nP-%d\\D1:NRZ-L;\r\n"
+                "P-%d\\D2:%u;\r\nP-%d\\F1:%d;\r\nP-%d\\F2:M;\r\n"
+                "P-%d\\MF\\N:%d;\r\nP-%d\\MF1:%d;\r\nP-%d\\MF2:%d;\r\n"
+                "P-%d\\MF3:FPT;\r\nP-%d\\MF4:%d;\r\n",
+                Index + 1, Pcm, Pcm, Pcm, Pcm,
+                Pcm, Channels[Index].Rate * 8,
+                Pcm, PCM_WORD_BITS,
+                Pcm,
+                Pcm, PCM_MINOR_FRAMES,
+                Pcm, PCM_FRAME_WORDS - PCM_SYNC_BITS / PCM_WORD_BITS + 1,
+                Pcm, PCM_FRAME_WORDS * PCM_WORD_BITS,
+                Pcm,
+                Pcm, PCM_SYNC_BITS
+                );
+
+            //
+            // The subframe ID is the low bits of the frame counter
+            //
+            Length += sprintf(
+                Text + Length,
+                "P-%d\\ISF\\N:1;\r\nP-%d\\IDC1-1:2;\r\nP-%d\\IDC3-1:%d;\r\n"
+                "P-%d\\IDC4-1:%d;\r\nP-%d\\IDC6-1:0;\r\nP-%d\\MF5:",
+                Pcm, Pcm,
+                Pcm, PCM_WORD_BITS - PCM_SFID_BITS + 1,
+                Pcm, PCM_SFID_BITS,
+                Pcm, Pcm
+                );
+
+            for (Bit = PCM_SYNC_BITS - 1; Bit >= 0; Bit--)
+            {
+                Text[Length++] = (PCM_SYNC_PATTERN >> Bit) & 1 ? '1' : '0';
+            }
+
+            Length += sprintf(Text + Length, ";\r\n");
+        }
+    }
+
+    return 4 + Length;
+}
+
+static __u32
+BuildTime (
+    __u8    *Body,
+    __u64   Seconds
+    )
+{
+    unsigned Day = (unsigned) (100 + Seconds / 86400);
+    unsigned Hour = (unsigned) ((12 + Seconds / 3600) % 24);
+    unsigned Minute = (unsigned) ((Seconds / 60) % 60);
+    unsigned Second = (unsigned) (Seconds % 60);
+
+    PutLe32(Body, CH10_TIME_CSDW_SRC_INTERNAL | CH10_TIME_CSDW_FMT_IRIGB);
+    PutLe16(Body + 4, (__u16) (Bcd(Second) << 8));
+    PutLe16(Body + 6, (__u16) (Bcd(Hour) << 8 | Bcd(Minute)));
+    PutLe16(Body + 8, Bcd(Day));
+    PutLe16(Body + 10, 0);
+
+    return sizeof(struct ch10_time_f1);
+}
+
+static __u8
+PcmStreamByte (
+    __u64 Position
+    )
+{
+    __u32 Frame = (__u32) (Position / (PCM_FRAME_WORDS * PCM_WORD_BITS / 8));
+    __u32 Byte = (__u32) (Position % (PCM_FRAME_WORDS * PCM_WORD_BITS / 8));
+    __u32 Word;
+
+    if (Byte < PCM_SYNC_BITS / 8)
+    {
+        return (__u8) (PCM_SYNC_PATTERN >> (PCM_SYNC_BITS - 8 - Byte * 8));
+    }
+
+    Word = (Byte - PCM_SYNC_BITS / 8) / 2;
+
+    //
+    // First data word is the minor frame counter, the rest ramps
+    //
+    Word = Word == 0 ? Frame & 0xffff : (Frame * 7 + Word * 0x0101) & 0xffff;
+
+    return (__u8) (Byte & 1 ? Word : Word >> 8);
+}
+
+static __u32
+BuildPcm (
+    GEN_CHANNEL *Channel,
+    __u8        *Body,
+    __u32       Payload
+    )
+{
+    __u32   Index;
+    __u32   Slip = Channel->BitSlip;
+    __u8    Current;
+    __u8    Next;
+
+    PutLe32(Body, CH10_PCM_CSDW_THROUGHPUT);
+
+    Payload &= ~1;
+
+    //
+    // The bit stream is packed MSB first into little-endian 16 bit words.
+    // The stream starts BitSlip bits into a frame so that consumers can't
+    // rely on byte aligned sync words.
+    //
+    Next = PcmStreamByte(Channel->StreamPosition);
+
+    for (Index = 0; Index < Payload; Index++)
+    {
+        Current = Next;
+        Next = PcmStreamByte(++Channel->StreamPosition);
+
+        Body[4 + (Index ^ 1)] = (__u8) (Slip ? Current << Slip | Next >> (8 - Slip) : Current);
+    }
+
+    return 4 + Payload;
+}
+
+static __u32
+BuildAnalog (
+    GEN_CHANNEL *Channel,
+    __u8        *Body,
+    __u32       Payload
+    )
+{
+    __u32   Index;
+    double  Sample;
+
+    PutLe32(Body, CH10_ANALOG_CSDW(16, 1));
+
+    Payload &= ~1;
+
+    for (Index = 0; Index < Payload; Index += 2)
+    {
+        Sample = 20000.0 * sin(Channel->Phase) + 500.0 * (RandomUnit() - 0.5);
+        Channel->Phase += Channel->Step;
+        PutLe16(Body + 4 + Index, (__u16) (__s16) Sample);
+    }
+
+    return 4 + Payload;
+}
+
+static __u32
+BuildArinc (
+    GEN_CHANNEL *Channel,
+    __u8        *Body,
+    __u32       Payload,
+    __u32       PeriodRtc
+    )
+{
+    static const __u8 Labels[] = { 0203, 0204, 0205, 0206, 0310, 0311, 0312, 0324 };
+    __u32   Count = Payload / sizeof(struct ch10_arinc429_msg);
+    __u32   Gap;
+    __u32   Index;
+    __u32   Bus;
+    __u32   Data;
+
+    if (Count == 0)
+    {
+        Count = 1;
+    }
+
+    if (Count > 0xffff)
+    {
+        Count = 0xffff;
+    }
+
+    PutLe32(Body, Count);
+
+    Gap = PeriodRtc / Count;
+    if (Gap > 0xfffff)
+    {
+        Gap = 0xfffff;
+    }
+
+    for (Index = 0; Index < Count; Index++)
+    {
+        Bus = Index % 4;
+        Data = Labels[(Channel->FrameCount + Index / 4) % sizeof(Labels)] |
+               (((Channel->FrameCount + Index) & 0x7ffff) << 10);
+
+        //
+        // One packet in RARE_LABEL_PERIOD also carries a label seen nowhere
+        // else, for finding words without reading every packet
+        //
+        if (Index == 0 && Channel->FrameCount % RARE_LABEL_PERIOD == 0)
+        {
+            Data = (Data & ~0xffu) | RARE_LABEL;
+        }
+
+        PutLe32(Body + 4 + Index * 8, (Index ? Gap : 0) | Bus << 24);
+        PutLe32(Body + 8 + Index * 8, Data);
+    }
+
+    Channel->FrameCount++;
+
+    return 4 + Count * 8;
+}
+
+static __u32
+BuildEthernet (
+    GEN_CHANNEL *Channel,
+    __u8        *Body,
+    __u32       Payload,
+    __u64       Rtc
+    )
+{
+    __u32   Offset = 4;
+    __u32   Frames = 0;
+    __u32   Length;
+    __u32   Sum;
+    __u8    *Frame;
+    int     Index;
+
+    do
+    {
+        Length = (__u32) (64 + (Random() % 1455)) & ~1;
+
+        if (Offset + 12 + Length > 4 + Payload && Frames)
+        {
+            break;
+        }
+
+        PutLe32(Body + Offset, (__u32) Rtc);
+        PutLe32(Body + Offset + 4, (__u32) (Rtc >> 32));
+        PutLe32(Body + Offset + 8, Length & CH10_ETHERNET_LENGTH_MASK);
+
+        Frame = Body + Offset + 12;
+
+        //
+        // Ethernet II, IPv4, UDP from 10.0.0.<ch> to 10.0.1.1 port 5000
+        //
+        memcpy(Frame, "\x01\x00\x5e\x00\x01\x01\x02\x00\x00\x00\x00", 11);
+        Frame[11] = (__u8) Channel->ChannelId;
+        Frame[12] = 0x08;
+        Frame[13] = 0x00;
+
+        memset(Frame + 14, 0, 20);
+        Frame[14] = 0x45;
+        Frame[16] = (__u8) ((Length - 14) >> 8);
+        Frame[17] = (__u8) (Length - 14);
+        Frame[18] = (__u8) (Channel->FrameCount >> 8);
+        Frame[19] = (__u8) Channel->FrameCount;
+        Frame[22] = 64;
+        Frame[23] = 17;
+        memcpy(Frame + 26, "\x0a\x00\x00", 3);
+        Frame[29] = (__u8) Channel->ChannelId;
+        memcpy(Frame + 30, "\x0a\x00\x01\x01", 4);
+
+        for (Sum = 0, Index = 0; Index < 20; Index += 2)
+        {
+            Sum += Frame[14 + Index] << 8 | Frame[15 + Index];
+        }
+        Sum = (Sum & 0xffff) + (Sum >> 16);
+        Sum = ~((Sum & 0xffff) + (Sum >> 16));
+        Frame[24] = (__u8) (Sum >> 8);
+        Frame[25] = (__u8) Sum;
+
+        Frame[34] = 0x13;
+        Frame[35] = 0x88;
+        Frame[36] = 0x13;
+        Frame[37] = 0x88;
+        Frame[38] = (__u8) ((Length - 34) >> 8);
+        Frame[39] = (__u8) (Length - 34);
+        Frame[40] = 0;
+        Frame[41] = 0;
+
+        for (Index = 42; Index < (int) Length; Index++)
+        {
+            Frame[Index] = (__u8) (Index + Channel->FrameCount);
+        }
+
+        Channel->FrameCount++;
+        Offset += 12 + Length;
+        Frames++;
+
+    } while (Offset < 4 + Payload);
+
+    PutLe32(Body, Frames);
+
+    return Offset;
+}
+
+static __u32
+Build1553 (
+    GEN_CHANNEL *Channel,
+    __u8        *Body,
+    __u32       Payload,
+    __u64       Rtc
+    )
+{
+    __u32   Offset = 4;
+    __u32   Messages = 0;
+    __u32   Words;
+    __u32   Index;
+    __u32   Rt;
+    __u8    *Message;
+
+    do
+    {
+        Words = 1 + (__u32) (Random() % 32);
+        Rt = 1 + (Channel->FrameCount % 30);
+
+        if (Offset + 14 + (Words + 2) * 2 > 4 + Payload && Messages)
+        {
+            break;
+        }
+
+        PutLe32(Body + Offset, (__u32) Rtc);
+        PutLe32(Body + Offset + 4, (__u32) (Rtc >> 32));
+        PutLe16(Body + Offset + 8, 0);
+        PutLe16(Body + Offset + 10, 4);
+        PutLe16(Body + Offset + 12, (__u16) ((Words + 2) * 2));
+
+        Message = Body + Offset + 14;
+
+        // BC to RT, command word, data words, status word
+        PutLe16(Message, (__u16) (Rt << 11 | ((Channel->FrameCount & 0x1f) << 5) | (Words & 0x1f)));
+
+        for (Index = 0; Index < Words; Index++)
+        {
+            PutLe16(Message + 2 + Index * 2, (__u16) (Channel->FrameCount + Index));
+        }
+
+        PutLe16(Message + 2 + Words * 2, (__u16) (Rt << 11));
+
+        Channel->FrameCount++;
+        Offset += 14 + (Words + 2) * 2;
+        Messages++;
+
+    } while (Offset < 4 + Payload);
+
+    PutLe32(Body, Messages | CH10_1553_CSDW_TTB_FIRST_BIT);
+
+    return Offset;
+}
+
+static int
+EmitPacket (
+    GEN_WRITER  *Writer,
+    __u8        *Packet,
+    __u16       ChannelId,
+    __u8        *SequenceNum,
+    int         DataType,
+    __u32       DataLength,
+    __u64       Rtc
+    )
+{
+    struct ch10_packet_header *Header = (struct ch10_packet_header *) Packet;
+    __u32   ChecksumSize = Ch10ChecksumSize(ChecksumType);
+    __u32   BodyLength;
+    __u32   Checksum;
+    int     Corrupted = 0;
+
+    //
+    // Filler is zero and goes in front of the checksum, which is the last
+    // item of the packet and covers the data and the filler
+    //
+    BodyLength = (DataLength + ChecksumSize + CH10_PACKET_ALIGN - 1) & ~(CH10_PACKET_ALIGN - 1);
+
+    memset(Packet + CH10_PACKET_HEADER_SIZE + DataLength, 0, BodyLength - DataLength);
+
+    Checksum = Ch10DataChecksum(
+        Packet + CH10_PACKET_HEADER_SIZE,
+        BodyLength - ChecksumSize,
+        ChecksumType
+        );
+
+    switch (ChecksumSize)
+    {
+    case 1:
+        Packet[CH10_PACKET_HEADER_SIZE + BodyLength - 1] = (__u8) Checksum;
+        break;
+    case 2:
+        PutLe16(Packet + CH10_PACKET_HEADER_SIZE + BodyLength - 2, (__u16) Checksum);
+        break;
+    case 4:
+        PutLe32(Packet + CH10_PACKET_HEADER_SIZE + BodyLength - 4, Checksum);
+        break;
+    }
+
+    Header->syncPattern = cpu_to_le16(CH10_PACKET_SYNC);
+    Header->channelId = cpu_to_le16(ChannelId);
+    Header->packetLength = cpu_to_le32(CH10_PACKET_HEADER_SIZE + BodyLength);
+    Header->dataLength = cpu_to_le32(DataLength);
+    Header->dataTypeVersion = 0x06;
+    Header->sequenceNum = (*SequenceNum)++;
+    Header->packetFlags = (__u8) ChecksumType;
+    Header->dataType = (__u8) DataType;
+    Ch10SetRtc(Header, Rtc);
+
+    if (Corruption.Length && RandomUnit() < Corruption.Length)
+    {
+        Header->packetLength = cpu_to_le32((__u32) (Random() & 0x7fffc));
+        Corrupted = 1;
+    }
+
+    Header->headerChecksum = cpu_to_le16(Ch10HeaderChecksum(Header));
+
+    if (Corruption.Sync && RandomUnit() < Corruption.Sync)
+    {
+        Header->syncPattern ^= cpu_to_le16(1 << (Random() % 16));
+        Corrupted = 1;
+    }
+
+    if (Corruption.HeaderChecksum && RandomUnit() < Corruption.HeaderChecksum)
+    {
+        Header->headerChecksum ^= cpu_to_le16(0x5a5a);
+        Corrupted = 1;
+    }
+
+    if (Corruption.DataChecksum && DataLength &&
+        RandomUnit() < Corruption.DataChecksum)
+    {
+        Packet[CH10_PACKET_HEADER_SIZE + Random() % DataLength] ^= 0x10;
+        Corrupted = 1;
+    }
+
+    Stats.Packets++;
+    Stats.Bytes += CH10_PACKET_HEADER_SIZE + BodyLength;
+    Stats.Corrupted += Corrupted;
+
+    return WriterAppend(Writer, Packet, CH10_PACKET_HEADER_SIZE + BodyLength);
+}
+
+static int
+GenerateFile (
+    GEN_WRITER  *Writer,
+    __u8        *Packet,
+    __u32       FileIndex,
+    __u32       Duration,
+    __u32       PeriodMs,
+    __u64       *Size
+    )
+{
+    __u8    *Body = Packet + CH10_PACKET_HEADER_SIZE;
+    __u64   Start = WriterPosition(Writer);
+    __u64   RtcBase = Random() & 0x0000ffffffffffffULL;
+    __u32   PeriodRtc = (__u32) (PeriodMs * (CH10_RTC_HZ / 1000));
+    __u32   Ticks = Duration * 1000 / PeriodMs;
+    __u32   MaxPayload = CH10_MAX_PACKET_SIZE - CH10_PACKET_HEADER_SIZE - 4096;
+    __u32   Tick;
+    __u32   Remaining;
+    __u32   Payload;
+    __u32   DataLength;
+    __u64   Rtc;
+    __u64   TimeShift = 0;
+    __u8    TmatsSequence = 0;
+    int     Index;
+    int     Status;
+    GEN_CHANNEL *Channel;
+
+    for (Index = 0; Index < ChannelCount; Index++)
+    {
+        Channels[Index].SequenceNum = 0;
+    }
+
+    Status = EmitPacket(
+        Writer,
+        Packet,
+        0,
+        &TmatsSequence,
+        CH10_DATA_TMATS,
+        BuildTmats(Body),
+        RtcBase
+        );
+
+    for (Tick = 0; Tick < Ticks && !Status; Tick++)
+    {
+        Rtc = (RtcBase + (__u64) Tick * PeriodRtc) & 0x0000ffffffffffffULL;
+
+        for (Index = 0; Index < ChannelCount && !Status; Index++)
+        {
+            Channel = &Channels[Index];
+
+            if (Channel->DataType == CH10_DATA_TIME_F1)
+            {
+                if ((Tick * PeriodMs) % 1000 < PeriodMs)
+                {
+                    //
+                    // The time source is resynchronized and time steps
+                    // forward from here on
+                    //
+                    if (Corruption.TimeJump && RandomUnit() < Corruption.TimeJump)
+                    {
+                        TimeShift += 1 + Random() % 3600;
+                        Stats.TimeJumps++;
+                    }
+
+                    Status = EmitPacket(
+                        Writer,
+                        Packet,
+                        Channel->ChannelId,
+                        &Channel->SequenceNum,
+                        Channel->DataType,
+                        BuildTime(Body, (__u64) FileIndex * Duration + Tick * PeriodMs / 1000 + TimeShift),
+                        Rtc
+                        );
+                }
+                continue;
+            }
+
+            Remaining = (__u32) ((__u64) Channel->Rate * PeriodMs / 1000);
+
+            do
+            {
+                Payload = Remaining > MaxPayload ? MaxPayload : Remaining;
+                Remaining -= Payload;
+
+                switch (Channel->DataType)
+                {
+                case CH10_DATA_PCM_F1:
+                    DataLength = BuildPcm(Channel, Body, Payload);
+                    break;
+                case CH10_DATA_ANALOG_F1:
+                    DataLength = BuildAnalog(Channel, Body, Payload);
+                    break;
+                case CH10_DATA_ARINC429_F0:
+                    DataLength = BuildArinc(Channel, Body, Payload, PeriodRtc);
+                    break;
+                case CH10_DATA_ETHERNET_F0:
+                    DataLength = BuildEthernet(Channel, Body, Payload, Rtc);
+                    break;
+                default:
+                    DataLength = Build1553(Channel, Body, Payload, Rtc);
+                    break;
+                }
+
+                Status = EmitPacket(
+                    Writer,
+                    Packet,
+                    Channel->ChannelId,
+                    &Channel->SequenceNum,
+                    Channel->DataType,
+                    DataLength,
+                    Rtc
+                    );
+
+            } while (Remaining && !Status);
+        }
+    }
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    *Size = WriterPosition(Writer) - Start;
+
+    //
+    // An interrupted recording ends in the middle of its last packet
+    //
+    if (Corruption.Truncate && RandomUnit() < Corruption.Truncate && *Size > 64)
+    {
+        *Size -= 1 + Random() % 60;
+        Stats.Truncated++;
+    }
+
+    return WriterFlush(Writer);
+}
+
+static void
+FormatDate (
+    __u8        *Date,
+    __u8        *Time,
+    __u32       Seconds
+    )
+{
+    char Buffer[16];
+
+    snprintf(Buffer, sizeof(Buffer), "%02u%02u%04u", 10 + (Seconds / 86400) % 18, 4, 2014);
+    memcpy(Date, Buffer, 8);
+
+    snprintf(
+        Buffer,
+        sizeof(Buffer),
+        "%02u%02u%02u%02u",
+        (12 + Seconds / 3600) % 24,
+        (Seconds / 60) % 60,
+        Seconds % 60,
+        0
+        );
+    memcpy(Time, Buffer, 8);
+}
+
+static void
+Usage (
+    void
+    )
+{
+    fprintf(
+        stderr,
+        "syntax: mkch10img [options] <image> [<image>...]\n"
+        "  -f <files>        number of recordings (4)\n"
+        "  -b <bytes>        bytes per block (512)\n"
+        "  -n <name>         volume name (CH10GEN)\n"
+        "  -d <seconds>      duration of each recording (10)\n"
+        "  -c <mix>          channels, type[:count][@rate],...\n"
+        "                    types: time pcm analog arinc eth 1553\n"
+        "                    (time:1,pcm:1,analog:2,arinc:1,eth:1,1553:1)\n"
+        "  -p <ms>           packet period per channel (100)\n"
+        "  -k <0|8|16|32>    data checksum width (32)\n"
+        "  -x <spec>         corruption, kind[:rate],...\n"
+        "                    kinds: sync hdrsum datasum len trunc tjump\n"
+        "  -S <percent>      preallocated slack beyond each recording (0)\n"
+        "  -D <blocks>       blocks reserved for the directory (64)\n"
+        "  -s <seed>         random seed (1)\n"
+        "  -m <members>      stripe the recordings over this many images (1)\n"
+        "  -u <blocks>       stripe unit in blocks (1 MB)\n"
+        );
+}
+
+int main(int argc, char* argv[])
+{
+    char                    DefaultMix[] = "time:1,pcm:1,analog:2,arinc:1,eth:1,1553:1";
+    char                    *Mix = DefaultMix;
+    char                    *CorruptionSpec = NULL;
+    const char              *VolumeName = "CH10GEN";
+    const char              *ImagePath;
+    __u32                   Members = 1;
+    __u32                   StripeBlocks = 0;
+    __u32                   UnitShift;
+    __u32                   SetId = 0;
+    __u32                   Member;
+    __u32                   DirIndex;
+    __u64                   Units;
+    __u64                   MemberBlocks;
+    struct ch10_stripe      *Stripe;
+    __u32                   FileCount = 4;
+    __u32                   BytesPerBlock = CH10_BLOCK_SIZE;
+    __u32                   Duration = 10;
+    __u32                   PeriodMs = 100;
+    __u32                   Slack = 0;
+    __u32                   ReservedBlocks = CH10_MAX_DIR_BLOCKS;
+    __u32                   DirBlockCount;
+    __u64                   NextBlock;
+    __u64                   Size;
+    __u64                   NumBlocks;
+    struct ch10_dir_block   *DirBlocks;
+    struct ch10_dir_block   *DirBlock;
+    struct ch10_dir_entry   *DirEntry;
+    GEN_WRITER              Writer;
+    __u8                    *Packet;
+    __u8                    *Block;
+    __u32                   Index;
+    int                     Option;
+    int                     Status;
+    int                     Result = -1;
+
+    while ((Option = getopt(argc, argv, "f:b:n:d:c:p:k:x:S:D:s:m:u:h")) != -1)
+    {
+        switch (Option)
+        {
+        case 'f': FileCount = (__u32) atoi(optarg); break;
+        case 'b': BytesPerBlock = ParseSize(optarg); break;
+        case 'n': VolumeName = optarg; break;
+        case 'd': Duration = (__u32) atoi(optarg); break;
+        case 'c': Mix = optarg; break;
+        case 'p': PeriodMs = (__u32) atoi(optarg); break;
+        case 'x': CorruptionSpec = optarg; break;
+        case 'S': Slack = (__u32) atoi(optarg); break;
+        case 'D': ReservedBlocks = (__u32) atoi(optarg); break;
+        case 's': RandomState = strtoull(optarg, NULL, 0) | 1; break;
+        case 'm': Members = (__u32) atoi(optarg); break;
+        case 'u': StripeBlocks = (__u32) atoi(optarg); break;
+        case 'k':
+            switch (atoi(optarg))
+            {
+            case 0:  ChecksumType = CH10_CHECKSUM_NONE; break;
+            case 8:  ChecksumType = CH10_CHECKSUM_8; break;
+            case 16: ChecksumType = CH10_CHECKSUM_16; break;
+            default: ChecksumType = CH10_CHECKSUM_32; break;
+            }
+            break;
+        default:
+            Usage();
+            return -1;
+        }
+    }
+
+    if (Members < 1 || Members > CH10_STRIPE_MAX_MEMBERS ||
+        optind != argc - (int) Members)
+    {
+        Usage();
+        return -1;
+    }
+
+    ImagePath = argv[optind];
+
+    if (StripeBlocks == 0)
+    {
+        StripeBlocks = BytesPerBlock < 1024 * 1024 ? 1024 * 1024 / BytesPerBlock : 1;
+    }
+
+    if (BytesPerBlock < SECTOR_SIZE ||
+        BytesPerBlock & (BytesPerBlock - 1) ||
+        StripeBlocks & (StripeBlocks - 1) ||
+        (__u64) StripeBlocks * BytesPerBlock > CH10_STRIPE_MAX_UNIT ||
+        PeriodMs == 0 || PeriodMs > 1000)
+    {
+        Usage();
+        return -1;
+    }
+
+    for (UnitShift = 0; (1U << UnitShift) < StripeBlocks; UnitShift++)
+    {
+    }
+
+    if (ParseChannelMix(Mix) ||
+        (CorruptionSpec && ParseCorruption(CorruptionSpec)))
+    {
+        return -1;
+    }
+
+    DirBlockCount = FileCount ? (FileCount + MAX_FILES_PER_DIR - 1) / MAX_FILES_PER_DIR : 1;
+
+    //
+    // The driver reads a fixed window of CH10_MAX_DIR_BLOCKS, keep the
+    // unused part of it zero (a hole) unless told otherwise
+    //
+    if (ReservedBlocks < DirBlockCount)
+    {
+        ReservedBlocks = DirBlockCount;
+    }
+
+    DirBlocks = calloc(DirBlockCount * Members, sizeof(struct ch10_dir_block));
+    Packet = malloc(CH10_MAX_PACKET_SIZE + 64);
+    Block = calloc(1, BytesPerBlock);
+    Writer.Buffer = malloc(WRITE_BUFFER_SIZE);
+
+    for (Member = 0; Member < Members; Member++)
+    {
+        Writer.Fds[Member] = -1;
+    }
+
+    if (!DirBlocks || !Packet || !Block || !Writer.Buffer)
+    {
+        fprintf(stderr, "mkch10img: out of memory\n");
+        goto Done;
+    }
+
+    for (Member = 0; Member < Members; Member++)
+    {
+        Writer.Fds[Member] = open(argv[optind + Member], O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+        if (Writer.Fds[Member] < 0)
+        {
+            perror(argv[optind + Member]);
+            goto Done;
+        }
+    }
+
+    Writer.Members = Members;
+    Writer.StripeUnit = Members > 1 ?
+        (__u64) StripeBlocks * BytesPerBlock : WRITE_BUFFER_SIZE;
+
+    //
+    // Taken from the seed without drawing from it, so a striped set holds
+    // the same recordings as a single image made with the same options
+    //
+    if (Members > 1)
+    {
+        SetId = (__u32) ((RandomState * 0x9E3779B97F4A7C15ULL) >> 40);
+    }
+
+    NextBlock = 1 + ReservedBlocks;
+
+    for (Index = 0; Index < FileCount; Index++)
+    {
+        Writer.Base = NextBlock * BytesPerBlock;
+
+        WriterSeek(&Writer, 0);
+
+        Status = GenerateFile(&Writer, Packet, Index, Duration, PeriodMs, &Size);
+
+        if (Status)
+        {
+            fprintf(stderr, "mkch10img: %s: %s\n", ImagePath, strerror(-Status));
+            goto Done;
+        }
+
+        Units = (Size + Writer.StripeUnit - 1) / Writer.StripeUnit;
+        NumBlocks = 0;
+
+        //
+        // A member holds whole stripe units, the first one the most
+        //
+        for (Member = 0; Member < Members; Member++)
+        {
+            if (Members > 1)
+            {
+                MemberBlocks = (Units + Members - 1 - Member) / Members * StripeBlocks;
+            }
+            else
+            {
+                MemberBlocks = (Size + BytesPerBlock - 1) / BytesPerBlock;
+            }
+
+            MemberBlocks += MemberBlocks * Slack / 100;
+
+            if (NumBlocks < MemberBlocks)
+            {
+                NumBlocks = MemberBlocks;
+            }
+
+            DirEntry = &DirBlocks[Member * DirBlockCount + Index / MAX_FILES_PER_DIR].
+                dirEntries[Index % MAX_FILES_PER_DIR];
+
+            snprintf((char *) DirEntry->name, CH10_MAXFN, "rec%04u.ch10", Index);
+            DirEntry->blockNum = cpu_to_be64(NextBlock);
+            DirEntry->numBlocks = cpu_to_be64(MemberBlocks);
+            DirEntry->size = cpu_to_be64(Size);
+            FormatDate(DirEntry->createDate, DirEntry->createTime, Index * Duration);
+            FormatDate(DirEntry->createDate, DirEntry->closeTime, (Index + 1) * Duration);
+            DirEntry->timeType = 0;
+
+            if (Members > 1)
+            {
+                Stripe = (struct ch10_stripe *) DirEntry->reserved;
+
+                Stripe->tag = CH10_STRIPE_TAG;
+                Stripe->memberCount = (__u8) Members;
+                Stripe->memberIndex = (__u8) Member;
+                Stripe->unitShift = (__u8) UnitShift;
+                Stripe->setId[0] = (__u8) (SetId >> 16);
+                Stripe->setId[1] = (__u8) (SetId >> 8);
+                Stripe->setId[2] = (__u8) SetId;
+            }
+        }
+
+        NextBlock += NumBlocks;
+    }
+
+    for (Index = 0; Index < DirBlockCount * Members; Index++)
+    {
+        DirBlock = &DirBlocks[Index];
+        Member = Index / DirBlockCount;
+        DirIndex = Index % DirBlockCount;
+
+        memcpy(DirBlock->magicNumAscii, CH10_MAGIC, sizeof(DirBlock->magicNumAscii));
+        DirBlock->revNum = 0x07;
+        DirBlock->shutdown = 0;
+        DirBlock->numEntries = cpu_to_be16((__u16) (
+            DirIndex == DirBlockCount - 1 && FileCount % MAX_FILES_PER_DIR ?
+            FileCount % MAX_FILES_PER_DIR :
+            (FileCount ? MAX_FILES_PER_DIR : 0)));
+        DirBlock->bytesPerBlock = cpu_to_be32(BytesPerBlock);
+        strncpy((char *) DirBlock->volName, VolumeName, sizeof(DirBlock->volName));
+
+        // The last block links forward to itself, the first back to itself
+        DirBlock->forwardLink = cpu_to_be64(1 + (DirIndex + 1 < DirBlockCount ? DirIndex + 1 : DirIndex));
+        DirBlock->reverseLink = cpu_to_be64(1 + (DirIndex ? DirIndex - 1 : 0));
+
+        memcpy(Block, DirBlock, sizeof(struct ch10_dir_block));
+
+        if (pwrite(Writer.Fds[Member], Block, BytesPerBlock, (__u64) (1 + DirIndex) * BytesPerBlock) !=
+            (ssize_t) BytesPerBlock)
+        {
+            perror(argv[optind + Member]);
+            goto Done;
+        }
+    }
+
+    for (Member = 0; Member < Members; Member++)
+    {
+        if (ftruncate(Writer.Fds[Member], NextBlock * BytesPerBlock))
+        {
+            perror(argv[optind + Member]);
+            goto Done;
+        }
+    }
+
+    printf(
+        "{\"image\": \"%s\", \"files\": %u, \"bytesPerBlock\": %u, "
+        "\"dirBlocks\": %u, \"channels\": %d, \"imageBytes\": %llu, "
+        "\"packets\": %llu, \"packetBytes\": %llu, \"corruptedPackets\": %llu, "
+        "\"truncatedFiles\": %llu, \"timeJumps\": %llu, \"members\": %u, \"stripeUnit\": %llu}\n",
+        ImagePath,
+        FileCount,
+        BytesPerBlock,
+        DirBlockCount,
+        ChannelCount,
+        (unsigned long long) (NextBlock * BytesPerBlock),
+        (unsigned long long) Stats.Packets,
+        (unsigned long long) Stats.Bytes,
+        (unsigned long long) Stats.Corrupted,
+        (unsigned long long) Stats.Truncated,
+        (unsigned long long) Stats.TimeJumps,
+        Members,
+        (unsigned long long) (Members > 1 ? Writer.StripeUnit : 0)
+        );
+
+    Result = 0;
+
+Done:
+    for (Member = 0; Member < Members; Member++)
+    {
+        if (Writer.Fds[Member] >= 0)
+        {
+            close(Writer.Fds[Member]);
+        }
+    }
+
+    free(Writer.Buffer);
+    free(Block);
+    free(Packet);
+    free(DirBlocks);
+
+    return Result;
+}
@@ -0,0 +1,1276 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _CH10_LIB_
+#define _CH10_LIB_
+
+#include <sys/types.h>
+
+#include "ch10_fs.h"
+#include "ch10idx.h"
+
+//
+// All functions return 0 or a byte count on success and a negative errno
+// value on failure.
+//
+
+//
+// CH10_BLOCKDEV
+//
+// A raw device or an image file holding a Chapter 10 volume
+//
+typedef struct _CH10_BLOCKDEV {
+
+    // File descriptor of the device or image
+    int                         Fd;
+
+    // CH10_OPEN_XXX flags the device was opened with
+    int                         Flags;
+
+    // Size of the device in bytes
+    __u64                       Size;
+
+    // Logical sector size, the unit of direct I/O
+    __u32                       SectorSize;
+
+    // Read only mapping of the whole device with CH10_OPEN_MMAP, NULL when
+    // the device is read with pread
+    const __u8*                 Map;
+
+} CH10_BLOCKDEV;
+
+//
+// Flags for Ch10OpenBlockDevice and Ch10MountVolume
+//
+#define CH10_OPEN_DIRECT        0x00000001
+#define CH10_OPEN_MMAP          0x00000002
+#define CH10_OPEN_INDEX         0x00000004
+
+//
+// Separates the member paths of a striped set given to Ch10MountVolume
+//
+#define CH10_MEMBER_SEPARATOR   ','
+
+//
+// Access pattern hints for Ch10AdviseBlockDevice
+//
+#define CH10_ADVISE_NORMAL      0
+#define CH10_ADVISE_SEQUENTIAL  1
+#define CH10_ADVISE_RANDOM      2
+#define CH10_ADVISE_WILLNEED    3
+#define CH10_ADVISE_DONTNEED    4
+
+//
+// Recordings are scanned for packets this many bytes at a time when the
+// device is not mapped
+//
+#define CH10_SCAN_WINDOW        (4 * 1024 * 1024)
+
+//
+// A scan split over several threads hands them ranges of this many bytes
+//
+#define CH10_SCAN_SPLIT         (8 * 1024 * 1024)
+
+//
+// Called by Ch10ScanFile for every packet with a valid header, Offset is
+// from the start of the recording and the whole packet is at Header
+//
+struct ch10_packet_header;
+
+typedef int (*CH10_PACKET_CALLBACK) (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    );
+
+//
+// CH10_FILE
+//
+// A recording as described by its directory entry
+//
+typedef struct _CH10_FILE {
+
+    // NUL terminated name of the recording
+    char                        Name[CH10_MAXFN + 1];
+
+    // Byte offset of the recording on the device
+    __u64                       Offset;
+
+    // Length of the recording in bytes
+    __u64                       Size;
+
+    // Blocks allocated to the recording
+    __u64                       NumBlocks;
+
+    // Bytes backed by those blocks. A recording larger than its blocks has
+    // a hole at the end that reads as zeros, an entry without numBlocks is
+    // taken to hold exactly its size.
+    __u64                       Allocated;
+
+    // Pointer to the entry in the directory block
+    struct ch10_dir_entry*      DirEntry;
+
+    // Position of the entry in the directory, as ch10_index_file dirEntry
+    __u32                       DirEntryIndex;
+
+    // Members of the set a striped recording is spread over, zero for a
+    // recording on one device, the stripe unit in bytes and the byte offset
+    // of the recording on every member
+    __u32                       StripeCount;
+    __u32                       StripeUnit;
+    __u64                       StripeOffsets[CH10_STRIPE_MAX_MEMBERS];
+
+} CH10_FILE;
+
+//
+// CH10_INDEX
+//
+// An index sidecar mapped read only. The NAMES and FILES sections are
+// checked when it is opened, the larger ones by Ch10CheckIndex.
+//
+typedef struct _CH10_INDEX {
+
+    // The whole sidecar
+    const __u8*                 Map;
+    size_t                      Length;
+
+    const struct ch10_index_header* Header;
+
+    // One record per recording, in volume file table order
+    const struct ch10_index_file*   Files;
+
+    // Packets of all recordings, NULL when the section is missing
+    const struct ch10_index_packet* Packets;
+    __u64                       PacketCount;
+
+    // Time packets sorted by relative time, NULL when missing
+    const struct ch10_index_time*   Times;
+    __u64                       TimeCount;
+
+    // Analog subchannels and their pyramids, NULL when missing
+    const struct ch10_index_analog* Analog;
+    __u64                       AnalogCount;
+    const struct ch10_index_summary* Summaries;
+    __u64                       SummaryCount;
+
+} CH10_INDEX;
+
+//
+// CH10_ANALOG_POINT
+//
+// The samples of an analog subchannel that fall on one point of a plot,
+// as a query of the pyramid in the sidecar gives them
+//
+typedef struct _CH10_ANALOG_POINT {
+
+    // Relative time and number of the first sample, and the number of
+    // samples
+    __u64                       Rtc;
+    __u64                       Sample;
+    __u64                       Samples;
+
+    __s16                       Min;
+    __s16                       Max;
+    __s16                       Mean;
+
+} CH10_ANALOG_POINT;
+
+//
+// CH10_VOLUME
+//
+// A mounted volume
+//
+typedef struct _CH10_VOLUME {
+
+    // The device the volume lives on
+    CH10_BLOCKDEV               Device;
+
+    // The directory blocks in link order
+    struct ch10_dir_block*      DirBlocks;
+    __u32                       DirBlockCount;
+
+    // Block numbers of the directory blocks
+    __u64*                      DirBlockNumbers;
+
+    // Block size used for all block addresses of the volume
+    __u32                       BytesPerBlock;
+
+    // NUL terminated name from the root directory block
+    char                        VolumeName[33];
+
+    // The recordings in directory order
+    CH10_FILE*                  Files;
+    __u32                       FileCount;
+
+    // Open addressed hash of the file names, slots hold a file index plus
+    // one and zero marks an empty slot
+    __u32*                      NameIndex;
+    __u32                       NameIndexMask;
+
+    // Index sidecar in use, NULL if there is none. The name index then
+    // points into its mapping.
+    CH10_INDEX*                 Index;
+
+    // The volumes of a striped set by member index, mounted from a list of
+    // paths. The first is this volume, which is also the only one of a
+    // volume on a single device.
+    struct _CH10_VOLUME*        Members[CH10_STRIPE_MAX_MEMBERS];
+    __u32                       MemberCount;
+
+    // Threads Ch10ScanFile splits a recording over, 0 or 1 for one pass
+    __u32                       ScanThreads;
+
+    // Recordings whose size was recovered from their packets at mount,
+    // the last entry of each directory block with the shutdown flag set
+    __u32                       RecoveredCount;
+
+} CH10_VOLUME;
+
+//
+// CH10_TIME_POINT
+//
+// A time packet of a recording, the relative time it was taken at and the
+// absolute time it carries, both in units of the relative time counter
+//
+typedef struct _CH10_TIME_POINT {
+
+    __u64                       Rtc;
+    __u64                       Time;
+
+    // Offset of the time packet in the recording
+    __u64                       Offset;
+
+    // CH10_TIME_XXX
+    __u32                       Flags;
+
+    // Time format and source from the channel specific data word
+    __u8                        Format;
+    __u8                        Source;
+    __u16                       Reserved;
+
+} CH10_TIME_POINT;
+
+//
+// Flags for CH10_TIME_POINT. A point with CH10_TIME_YEAR counts from 1970,
+// one without it from the start of a year the time packet does not give.
+// A point with CH10_TIME_JUMP does not follow from the one before it, by
+// more than CH10_TIME_JUMP_TOLERANCE plus CH10_TIME_JUMP_PPM of the time
+// between them.
+//
+#define CH10_TIME_YEAR              0x0001
+#define CH10_TIME_JUMP              0x0002
+
+#define CH10_TIME_JUMP_TOLERANCE    100000      // 10 ms
+#define CH10_TIME_JUMP_PPM          1000
+
+//
+// CH10_TIME_TABLE
+//
+// The time correlation of a recording. Between two points without a jump
+// relative time converts to absolute time on the line through them, before
+// the first point, after the last one and up to a jump at the rate of the
+// relative time counter.
+//
+typedef struct _CH10_TIME_TABLE {
+
+    // Points in recording order
+    CH10_TIME_POINT*            Points;
+    __u32                       Count;
+
+    // Points with CH10_TIME_JUMP
+    __u32                       JumpCount;
+
+    // Relative and absolute time never go back, conversions then search
+    // the points in O(log n) rather than walk them
+    int                         RtcSorted;
+    int                         TimeSorted;
+
+} CH10_TIME_TABLE;
+
+//
+// CH10_PCAPNG
+//
+// The Ethernet frames of one channel of a recording presented as a pcapng
+// capture, opened as the stream <recording>:<channel>.pcapng. Only the
+// packets of the channel are listed, with the capture offset of their
+// first block. Everything but the frames themselves is generated on read.
+//
+#define CH10_STREAM_SEPARATOR       ':'
+#define CH10_PCAPNG_SUFFIX          ".pcapng"
+
+//
+// Section header and interface description at the start of the capture
+//
+#define CH10_PCAPNG_HEADER_SIZE     60
+
+typedef struct _CH10_PCAPNG_PACKET {
+
+    // Offset of the Ethernet packet in the recording and of its first
+    // Enhanced Packet Block in the capture
+    __u64                       Offset;
+    __u64                       StreamOffset;
+
+    __u32                       PacketLength;
+
+    // Frames taken from the packet
+    __u32                       FrameCount;
+
+} CH10_PCAPNG_PACKET;
+
+typedef struct _CH10_PCAPNG {
+
+    CH10_VOLUME*                Volume;
+    __u32                       FileIndex;
+    __u16                       ChannelId;
+
+    // Packets of the channel in recording order
+    CH10_PCAPNG_PACKET*         Packets;
+    __u32                       Count;
+
+    __u64                       FrameCount;
+
+    // Length of the whole capture
+    __u64                       Size;
+
+    // Time correlation for the timestamps, and the start of the year the
+    // recording was made in for times without a year
+    CH10_TIME_TABLE             Time;
+    __u64                       Epoch;
+
+    __u8                        Header[CH10_PCAPNG_HEADER_SIZE];
+
+} CH10_PCAPNG;
+
+//
+// Views of a channel that can be opened as <recording>:<channel><suffix>
+//
+#define CH10_STREAM_PCAPNG          1   // CH10_PCAPNG_SUFFIX
+#define CH10_STREAM_PCM             2   // CH10_PCM_SUFFIX
+#define CH10_STREAM_ARINC           3   // CH10_ARINC_SUFFIX
+
+//
+// CH10_PCM_LAYOUT
+//
+// Minor frame layout of a PCM channel as the P group of TMATS gives it.
+// Words are sent MSB first and every minor frame starts with the sync
+// pattern, which is counted as its first word. The subframe ID counter,
+// when there is one, numbers the minor frames of a major frame.
+//
+#define CH10_PCM_MAX_SYNC_BITS      57
+#define CH10_PCM_MAX_WORD_BITS      32
+#define CH10_PCM_MAX_FRAME_BITS     (1024 * 1024)
+
+//
+// Syncs a locked decoder may miss in a row unless the layout says
+//
+#define CH10_PCM_FLYWHEEL           3
+
+typedef struct _CH10_PCM_LAYOUT {
+
+    // Sync pattern in the low SyncBits bits, Mask clears don't care bits
+    __u64                       SyncPattern;
+    __u64                       SyncMask;
+    __u32                       SyncBits;
+
+    // Common word length, words and bits of a minor frame with the sync
+    __u32                       WordBits;
+    __u32                       WordCount;
+    __u32                       FrameBits;
+
+    // Minor frames in a major frame, 1 without major frames
+    __u32                       MinorFrames;
+
+    // Subframe ID counter: word number counting the sync as 1, first bit
+    // from the MSB of the word, length and the value of minor frame 0.
+    // SfidWord is 0 when there is no counter.
+    __u32                       SfidWord;
+    __u32                       SfidBit;
+    __u32                       SfidBits;
+    __u32                       SfidFirst;
+
+    // Bits per second, 0 when unknown
+    __u32                       BitRate;
+
+    // Bit errors a sync pattern may have once the decoder is locked, and
+    // the syncs in a row it may miss before it searches again
+    __u32                       SyncErrors;
+    __u32                       Flywheel;
+
+} CH10_PCM_LAYOUT;
+
+//
+// CH10_PCM_SEARCH
+//
+// Sync pattern search. A candidate for each of the 8 bit offsets of the
+// pattern in a byte is found by comparing the one or two whole bytes it
+// then covers, 32 byte positions at a time, and only the candidates are
+// compared bit by bit.
+//
+typedef struct _CH10_PCM_SEARCH {
+
+    __u64                       Pattern;
+    __u64                       Mask;
+    __u32                       Bits;
+
+    // Whole bytes compared, 0 for a pattern too short to cover one at
+    // every offset. Key[Lead] are the bytes when Lead bits of the pattern
+    // come before them.
+    __u32                       KeyBytes;
+    __u8                        Key[8][2];
+    __u8                        KeyMask[8][2];
+
+} CH10_PCM_SEARCH;
+
+//
+// Decoder states
+//
+#define CH10_PCM_SEARCHING          0
+#define CH10_PCM_CHECKING           1
+#define CH10_PCM_LOCKED             2
+
+//
+// CH10_PCM_STATE
+//
+// Where a decoder stands in the bit stream, everything it needs to go on
+// from there given the bits from Keep on
+//
+typedef struct _CH10_PCM_STATE {
+
+    // Bit the search goes on from, candidate frame or next frame
+    __u64                       Next;
+
+    // First bit still needed
+    __u64                       Keep;
+
+    // Frames delivered
+    __u64                       Frames;
+
+    __u32                       State;
+    __u32                       Misses;
+
+    // Minor frame number expected next
+    __u32                       Minor;
+
+    // Delivered frames since the last lock
+    __u32                       Locked;
+
+} CH10_PCM_STATE;
+
+//
+// CH10_PCM_FRAME
+//
+// A minor frame the decoder delivers
+//
+typedef struct _CH10_PCM_FRAME {
+
+    // Bit of the stream the frame starts at
+    __u64                       Position;
+
+    // Minor frame number in its major frame
+    __u32                       Minor;
+
+    // CH10_PCM_FRAME_XXX
+    __u32                       Flags;
+
+} CH10_PCM_FRAME;
+
+#define CH10_PCM_FRAME_SYNC_ERRORS  0x0001  // sync pattern with bit errors
+#define CH10_PCM_FRAME_FLYWHEEL     0x0002  // no sync pattern, frame kept by flywheel
+#define CH10_PCM_FRAME_LOCKED       0x0004  // first frame after the decoder locked
+#define CH10_PCM_FRAME_SFID_ERROR   0x0008  // subframe ID out of sequence
+
+struct _CH10_PCM_DECODER;
+
+typedef int (*CH10_PCM_CALLBACK) (
+    void                            *Context,
+    struct _CH10_PCM_DECODER        *Decoder,
+    const CH10_PCM_FRAME            *Frame
+    );
+
+//
+// CH10_PCM_DECODER
+//
+// Frame synchronizer over a bit stream that is appended piece by piece.
+// Bits are held MSB first, bit 7 of Buffer[0] is bit Base of the stream.
+//
+typedef struct _CH10_PCM_DECODER {
+
+    CH10_PCM_LAYOUT             Layout;
+    CH10_PCM_SEARCH             Search;
+    CH10_PCM_STATE              State;
+
+    __u8*                       Buffer;
+    size_t                      Capacity;
+    __u64                       Base;
+    __u64                       End;
+
+} CH10_PCM_DECODER;
+
+//
+// Bit order of the data appended to a decoder
+//
+#define CH10_PCM_MSB_FIRST          0
+#define CH10_PCM_SWAP_16            1   // little-endian 16 bit words
+
+//
+// CH10_PCM_RECORD
+//
+// A decoded minor frame in the stream <recording>:<channel>.pcm, followed
+// by the words after the sync pattern, right aligned in 16 bits or 32
+// bits when words are longer, and padded to 8 bytes. All fields are
+// little-endian.
+//
+typedef struct _CH10_PCM_RECORD {
+
+    // Relative time of the first bit of the frame, and the absolute time
+    // in 100 ns units since 1970, 0 when the recording has no time
+    __u64                       Rtc;
+    __u64                       Time;
+
+    __u32                       Minor;
+    __u32                       Flags;
+
+} CH10_PCM_RECORD;
+
+typedef struct _CH10_PCM_PACKET {
+
+    __u64                       Offset;
+    __u64                       Rtc;
+    __u32                       PacketLength;
+    __u32                       Reserved;
+
+    // Bit of the channel's stream the packet data starts at
+    __u64                       Position;
+
+    // Decoder before the packet was appended
+    CH10_PCM_STATE              State;
+
+} CH10_PCM_PACKET;
+
+//
+// CH10_PCM
+//
+// The decoded minor frames of one PCM channel of a recording, as fixed
+// size records. Opening the view decodes the channel once and keeps the
+// state of the decoder in front of every packet, a read starts over from
+// the packet before the first record it wants.
+//
+#define CH10_PCM_SUFFIX             ".pcm"
+
+typedef struct _CH10_PCM {
+
+    CH10_VOLUME*                Volume;
+    __u32                       FileIndex;
+    __u16                       ChannelId;
+
+    CH10_PCM_LAYOUT             Layout;
+
+    // Packets of the channel in recording order
+    CH10_PCM_PACKET*            Packets;
+    __u32                       Count;
+
+    // Bits in the stream, and its rate from TMATS or the packet times
+    __u64                       Bits;
+    __u32                       BitRate;
+
+    // Data words in a record and their size
+    __u32                       DataWords;
+    __u32                       WordBytes;
+    __u32                       RecordSize;
+    __u64                       RecordCount;
+
+    // Length of the whole stream
+    __u64                       Size;
+
+    // Frames lost to resynchronisation or delivered by flywheel
+    __u64                       LockCount;
+    __u64                       FlywheelCount;
+
+    CH10_TIME_TABLE             Time;
+    __u64                       Epoch;
+
+} CH10_PCM;
+
+//
+// CH10_ARINC_INDEX
+//
+// Where the words of every ARINC-429 label of a recording are, an inverted
+// index from channel, bus and label to the packets holding words with that
+// label. Labels are sorted by channel, bus and label and the packets of
+// one label follow each other in Packets in recording order. Building it
+// reads the ARINC-429 packets once, from then on the words of one label
+// cost a read of each packet they are in.
+//
+typedef struct _CH10_ARINC_LABEL {
+
+    __u16                       ChannelId;
+    __u8                        Bus;
+    __u8                        Label;
+
+    // Its packets in CH10_ARINC_INDEX.Packets
+    __u32                       FirstPacket;
+    __u32                       PacketCount;
+    __u32                       Reserved;
+
+    __u64                       WordCount;
+
+} CH10_ARINC_LABEL;
+
+typedef struct _CH10_ARINC_PACKET {
+
+    __u64                       Offset;
+    __u32                       PacketLength;
+
+    // First word of the packet with the label, counting from 0, and the
+    // words with it
+    __u16                       FirstWord;
+    __u16                       WordCount;
+
+} CH10_ARINC_PACKET;
+
+typedef struct _CH10_ARINC_INDEX {
+
+    CH10_ARINC_LABEL*           Labels;
+    __u32                       LabelCount;
+
+    CH10_ARINC_PACKET*          Packets;
+    __u32                       PacketCount;
+
+    // ARINC-429 packets and words of the recording
+    __u64                       ArincPackets;
+    __u64                       WordCount;
+
+} CH10_ARINC_INDEX;
+
+//
+// CH10_ARINC_RECORD
+//
+// A word of one label in the stream <recording>:<channel>-<bus>-<label>.a429,
+// with the bus in decimal and the label in octal. All fields are
+// little-endian.
+//
+typedef struct _CH10_ARINC_RECORD {
+
+    // Relative time of the word, and the absolute time in 100 ns units
+    // since 1970, 0 when the recording has no time
+    __u64                       Rtc;
+    __u64                       Time;
+
+    // The word as received, label in the low 8 bits
+    __u32                       Word;
+
+    __u8                        Bus;
+
+    // CH10_ARINC_RECORD_XXX
+    __u8                        Flags;
+
+    __u16                       Reserved;
+
+} CH10_ARINC_RECORD;
+
+#define CH10_ARINC_RECORD_PARITY_ERROR  0x01
+#define CH10_ARINC_RECORD_FORMAT_ERROR  0x02
+#define CH10_ARINC_RECORD_HIGH_SPEED    0x04
+
+//
+// CH10_ARINC
+//
+// The words of one label of an ARINC-429 channel as fixed size records.
+// Opening the view builds the label index of the recording, a read only
+// reads the packets of the label its records come from.
+//
+#define CH10_ARINC_SUFFIX           ".a429"
+
+typedef struct _CH10_ARINC {
+
+    CH10_VOLUME*                Volume;
+    __u32                       FileIndex;
+    __u16                       ChannelId;
+    __u8                        Bus;
+    __u8                        Label;
+
+    CH10_ARINC_INDEX            Index;
+
+    // The label in the index, and the records in front of each of its
+    // packets
+    const CH10_ARINC_LABEL*     Entry;
+    __u64*                      FirstRecord;
+
+    __u64                       RecordCount;
+
+    // Length of the whole stream
+    __u64                       Size;
+
+    // Packets read by Ch10ReadArinc
+    __u64                       PacketReads;
+
+    CH10_TIME_TABLE             Time;
+    __u64                       Epoch;
+
+} CH10_ARINC;
+
+//
+// CH10_CHANNEL_READ
+//
+// Outcome of Ch10ReadChannels. The packets of the channels asked for are
+// read as extents of the recording that hold one or more of them, with
+// gaps of up to CH10_CHANNEL_READ_GAP bytes read through rather than
+// split into another read.
+//
+#define CH10_CHANNEL_SET_SIZE       (65536 / 8)
+#define CH10_CHANNEL_READ_GAP       4096
+
+#define Ch10AddChannel(Set, ChannelId) \
+    ((Set)[(ChannelId) >> 3] |= (__u8) (1 << ((ChannelId) & 7)))
+
+#define Ch10HasChannel(Set, ChannelId) \
+    ((Set)[(ChannelId) >> 3] & (1 << ((ChannelId) & 7)))
+
+typedef struct _CH10_CHANNEL_READ {
+
+    // Offset to go on from, of the first packet not returned or the end
+    // of the recording
+    __u64                       NextOffset;
+
+    // Packets and bytes put into the buffer
+    __u32                       PacketCount;
+    size_t                      Length;
+
+    // Reads sent to the device and the bytes they moved
+    __u32                       ExtentCount;
+    __u64                       DeviceBytes;
+
+} CH10_CHANNEL_READ;
+
+//
+// CH10_APPEND
+//
+// A recording being written to the end of a volume. The data goes into a
+// contiguous run of blocks reserved when the recording is created, in
+// writes of CH10_APPEND_BUFFER_SIZE bytes of which CH10_APPEND_DEPTH are
+// in flight at once. The directory is written twice: when the recording
+// is created, with the blocks reserved, no size and the shutdown flag set,
+// and when it is closed, with the size and the flag clear.
+//
+#define CH10_APPEND_BUFFER_SIZE     (8 * 1024 * 1024)
+#define CH10_APPEND_DEPTH           4
+
+//
+// Recordings are placed on this boundary, so every write of the data is
+// aligned for direct I/O
+//
+#define CH10_APPEND_ALIGNMENT       4096
+
+struct _CH10_APPEND_QUEUE;
+
+typedef struct _CH10_APPEND {
+
+    // Data, with direct I/O when opened with CH10_OPEN_DIRECT
+    int                         Fd;
+
+    // CH10_OPEN_DIRECT when the data is written with direct I/O, the
+    // volume may have fallen back to the page cache from what was asked
+    int                         Flags;
+
+    // Directory blocks, through the page cache
+    int                         DirFd;
+
+    // Block size of the volume
+    __u32                       BytesPerBlock;
+
+    // The directory block holding the entry and where it lives
+    struct ch10_dir_block       DirBlock;
+    __u64                       DirBlockNumber;
+    __u32                       EntryIndex;
+
+    // First block of the recording and the blocks reserved for it
+    __u64                       BlockNum;
+    __u64                       ReservedBlocks;
+
+    // Bytes appended so far
+    __u64                       Size;
+
+    // Writes sent to the device and the bytes they moved, the tail padded
+    // to the alignment included
+    __u64                       Writes;
+    __u64                       DeviceBytes;
+
+    // Buffers and writer threads
+    struct _CH10_APPEND_QUEUE*  Queue;
+
+} CH10_APPEND;
+
+//
+// Function prototypes from blockdev.c
+//
+
+int
+Ch10OpenBlockDevice (
+    const char      *Path,
+    int             Flags,
+    CH10_BLOCKDEV   *Device
+    );
+
+void
+Ch10CloseBlockDevice (
+    CH10_BLOCKDEV   *Device
+    );
+
+ssize_t
+Ch10ReadBlockDevice (
+    CH10_BLOCKDEV   *Device,
+    __u64           Offset,
+    size_t          Length,
+    void            *Buffer
+    );
+
+ssize_t
+Ch10MapBlockDevice (
+    CH10_BLOCKDEV   *Device,
+    __u64           Offset,
+    size_t          Length,
+    const void      **Address
+    );
+
+int
+Ch10AdviseBlockDevice (
+    CH10_BLOCKDEV   *Device,
+    __u64           Offset,
+    __u64           Length,
+    int             Advice
+    );
+
+void *
+Ch10AllocateAligned (
+    size_t          Length
+    );
+
+//
+// Function prototypes from volume.c
+//
+
+int
+Ch10MountVolume (
+    const char      *Path,
+    int             Flags,
+    CH10_VOLUME     **Volume
+    );
+
+void
+Ch10DismountVolume (
+    CH10_VOLUME     *Volume
+    );
+
+int
+Ch10LookupFileName (
+    CH10_VOLUME     *Volume,
+    const char      *FileName,
+    __u32           *Index
+    );
+
+ssize_t
+Ch10ReadFileData (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u64           Offset,
+    size_t          Length,
+    void            *Buffer
+    );
+
+ssize_t
+Ch10MapFileData (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u64           Offset,
+    size_t          Length,
+    const void      **Address
+    );
+
+__s64
+Ch10SeekFileData (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u64           Offset,
+    int             Whence
+    );
+
+__u32
+Ch10HashFileName (
+    const char      *FileName
+    );
+
+//
+// Function prototypes from scan.c
+//
+
+int
+Ch10ScanFile (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    CH10_PACKET_CALLBACK    Callback,
+    void                    *Context,
+    __u64                   *Skipped
+    );
+
+//
+// Function prototypes from time.c
+//
+
+int
+Ch10BuildTimeTable (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    CH10_TIME_TABLE         *Table
+    );
+
+void
+Ch10FreeTimeTable (
+    CH10_TIME_TABLE         *Table
+    );
+
+int
+Ch10RtcToTime (
+    const CH10_TIME_TABLE   *Table,
+    __u64                   Rtc,
+    __u64                   *Time
+    );
+
+int
+Ch10TimeToRtc (
+    const CH10_TIME_TABLE   *Table,
+    __u64                   Time,
+    __u64                   *Rtc
+    );
+
+int
+Ch10SeekTime (
+    const CH10_TIME_TABLE   *Table,
+    __u64                   Time,
+    __u64                   *Offset
+    );
+
+//
+// Function prototypes from pcapng.c
+//
+
+int
+Ch10OpenPcapng (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    __u16                   ChannelId,
+    CH10_PCAPNG             **View
+    );
+
+void
+Ch10ClosePcapng (
+    CH10_PCAPNG             *View
+    );
+
+ssize_t
+Ch10ReadPcapng (
+    CH10_PCAPNG             *View,
+    __u64                   Offset,
+    size_t                  Length,
+    void                    *Buffer
+    );
+
+int
+Ch10ParseStreamName (
+    const char              *Name,
+    __u16                   *ChannelId,
+    __u32                   *Filter,
+    int                     *Type
+    );
+
+__u64
+Ch10GetEpoch (
+    const struct ch10_dir_entry *DirEntry
+    );
+
+//
+// Function prototypes from pcm.c
+//
+
+int
+Ch10InitPcmSearch (
+    CH10_PCM_SEARCH         *Search,
+    __u64                   Pattern,
+    __u64                   Mask,
+    __u32                   Bits
+    );
+
+__s64
+Ch10FindPcmSync (
+    const CH10_PCM_SEARCH   *Search,
+    const __u8              *Buffer,
+    __u64                   From,
+    __u64                   End
+    );
+
+__s64
+Ch10FindPcmSyncSerial (
+    const CH10_PCM_SEARCH   *Search,
+    const __u8              *Buffer,
+    __u64                   From,
+    __u64                   End
+    );
+
+int
+Ch10InitPcmDecoder (
+    CH10_PCM_DECODER        *Decoder,
+    const CH10_PCM_LAYOUT   *Layout
+    );
+
+void
+Ch10FreePcmDecoder (
+    CH10_PCM_DECODER        *Decoder
+    );
+
+void
+Ch10ResetPcmDecoder (
+    CH10_PCM_DECODER        *Decoder,
+    const CH10_PCM_STATE    *State,
+    __u64                   Base
+    );
+
+int
+Ch10AppendPcmBits (
+    CH10_PCM_DECODER        *Decoder,
+    const void              *Data,
+    __u64                   Bits,
+    int                     Order
+    );
+
+int
+Ch10DecodePcm (
+    CH10_PCM_DECODER        *Decoder,
+    CH10_PCM_CALLBACK       Callback,
+    void                    *Context
+    );
+
+__u32
+Ch10GetPcmBits (
+    const CH10_PCM_DECODER  *Decoder,
+    __u64                   Position,
+    __u32                   Bits
+    );
+
+int
+Ch10ParsePcmLayout (
+    const char              *Spec,
+    CH10_PCM_LAYOUT         *Layout
+    );
+
+int
+Ch10CheckPcmLayout (
+    CH10_PCM_LAYOUT         *Layout
+    );
+
+int
+Ch10GetPcmLayout (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    __u16                   ChannelId,
+    CH10_PCM_LAYOUT         *Layout
+    );
+
+int
+Ch10OpenPcm (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    __u16                   ChannelId,
+    const CH10_PCM_LAYOUT   *Layout,
+    CH10_PCM                **View
+    );
+
+void
+Ch10ClosePcm (
+    CH10_PCM                *View
+    );
+
+ssize_t
+Ch10ReadPcm (
+    CH10_PCM                *View,
+    __u64                   Offset,
+    size_t                  Length,
+    void                    *Buffer
+    );
+
+//
+// Function prototypes from arinc.c
+//
+
+int
+Ch10BuildArincIndex (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    CH10_ARINC_INDEX        *ArincIndex
+    );
+
+void
+Ch10FreeArincIndex (
+    CH10_ARINC_INDEX        *ArincIndex
+    );
+
+const CH10_ARINC_LABEL *
+Ch10FindArincLabel (
+    const CH10_ARINC_INDEX  *ArincIndex,
+    __u16                   ChannelId,
+    __u8                    Bus,
+    __u8                    Label
+    );
+
+int
+Ch10OpenArinc (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    __u16                   ChannelId,
+    __u32                   Filter,
+    CH10_ARINC              **View
+    );
+
+void
+Ch10CloseArinc (
+    CH10_ARINC              *View
+    );
+
+ssize_t
+Ch10ReadArinc (
+    CH10_ARINC              *View,
+    __u64                   Offset,
+    size_t                  Length,
+    void                    *Buffer
+    );
+
+//
+// Function prototypes from channel.c
+//
+
+int
+Ch10ReadChannels (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    const __u8              *ChannelSet,
+    __u64                   Offset,
+    void                    *Buffer,
+    size_t                  Length,
+    CH10_CHANNEL_READ       *Result
+    );
+
+//
+// Function prototypes from append.c
+//
+
+int
+Ch10OpenAppend (
+    const char      *Path,
+    const char      *FileName,
+    __u64           Reserve,
+    int             Flags,
+    CH10_APPEND     *Append
+    );
+
+ssize_t
+Ch10Append (
+    CH10_APPEND     *Append,
+    const void      *Data,
+    size_t          Length
+    );
+
+int
+Ch10CloseAppend (
+    CH10_APPEND     *Append
+    );
+
+//
+// Function prototypes from index.c
+//
+
+__u32
+Ch10Crc32 (
+    __u32           Crc,
+    const void      *Buffer,
+    size_t          Length
+    );
+
+__u64
+Ch10VolumeFingerprint (
+    CH10_VOLUME     *Volume
+    );
+
+char *
+Ch10GetIndexPath (
+    const char      *Path
+    );
+
+int
+Ch10WriteIndex (
+    CH10_VOLUME     *Volume,
+    const char      *Path
+    );
+
+int
+Ch10OpenIndex (
+    CH10_VOLUME     *Volume,
+    const char      *Path
+    );
+
+void
+Ch10CloseIndex (
+    CH10_VOLUME     *Volume
+    );
+
+int
+Ch10CheckIndex (
+    CH10_VOLUME     *Volume
+    );
+
+ssize_t
+Ch10GetFilePackets (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    const struct ch10_index_packet **Packets
+    );
+
+int
+Ch10FindTimePacket (
+    CH10_VOLUME     *Volume,
+    __u64           Rtc,
+    const struct ch10_index_time **Time
+    );
+
+int
+Ch10FindAnalog (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u16           ChannelId,
+    __u32           Subchannel,
+    const struct ch10_index_analog **Analog
+    );
+
+int
+Ch10QueryAnalog (
+    CH10_VOLUME     *Volume,
+    const struct ch10_index_analog *Analog,
+    __u64           FirstRtc,
+    __u64           LastRtc,
+    __u32           Width,
+    CH10_ANALOG_POINT *Points,
+    __u32           *Level
+    );
+
+#endif
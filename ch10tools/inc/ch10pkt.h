@@ -0,0 +1,260 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _CH10_PKT_
+#define _CH10_PKT_
+
+#include <stddef.h>
+
+#include "ltypes.h"
+
+//
+// Packet level structures of a Chapter 10 recording. Unlike the directory
+// everything inside a recording file is stored little-endian.
+//
+
+#define CH10_PACKET_SYNC            0xEB25
+
+#define CH10_PACKET_HEADER_SIZE     24
+#define CH10_SECONDARY_HEADER_SIZE  12
+#define CH10_PACKET_ALIGN           4
+
+//
+// Largest packet the standard allows (524288 bytes)
+//
+#define CH10_MAX_PACKET_SIZE        0x80000
+
+//
+// The relative time counter runs at 10 MHz
+//
+#define CH10_RTC_HZ                 10000000ULL
+
+//
+// Data types used by the tools
+//
+#define CH10_DATA_COMPUTER_F0       0x00
+#define CH10_DATA_TMATS             0x01
+#define CH10_DATA_EVENT             0x02
+#define CH10_DATA_PCM_F1            0x09
+#define CH10_DATA_TIME_F1           0x11
+#define CH10_DATA_1553_F1           0x19
+#define CH10_DATA_ANALOG_F1         0x21
+#define CH10_DATA_ARINC429_F0       0x38
+#define CH10_DATA_ETHERNET_F0       0x68
+
+//
+// Packet flags
+//
+#define CH10_FLAG_SECONDARY_HEADER  0x80
+#define CH10_FLAG_IPTS_SOURCE       0x40
+#define CH10_FLAG_RTC_SYNC_ERROR    0x20
+#define CH10_FLAG_DATA_OVERFLOW     0x10
+#define CH10_FLAG_CHECKSUM_MASK     0x03
+
+#define CH10_CHECKSUM_NONE          0
+#define CH10_CHECKSUM_8             1
+#define CH10_CHECKSUM_16            2
+#define CH10_CHECKSUM_32            3
+
+#pragma pack(push, 1)
+
+/*
+ * Ch10 Packet Header
+ */
+struct ch10_packet_header {
+  __u16 syncPattern;         // always CH10_PACKET_SYNC
+  __u16 channelId;           // channel the packet was recorded from
+  __u32 packetLength;        // length of the whole packet in bytes, a multiple of 4
+  __u32 dataLength;          // length of the packet body in bytes, without filler or checksum
+  __u8 dataTypeVersion;      // version of the data type definitions
+  __u8 sequenceNum;          // per channel sequence number, wraps at 255
+  __u8 packetFlags;          // CH10_FLAG_XXX
+  __u8 dataType;             // CH10_DATA_XXX
+  __u8 relativeTimeCounter[6]; // 48 bit, 10 MHz relative time counter
+  __u16 headerChecksum;      // 16 bit sum of the preceding header words
+};
+
+/*
+ * Time data format 1, day format, or day, month and year format when
+ * CH10_TIME_CSDW_DMY is set
+ */
+struct ch10_time_f1 {
+  __u32 csdw;                // channel specific data word
+  __u16 msec;                // BCD tens/hundreds of ms, seconds
+  __u16 minHour;             // BCD minutes and hours
+  __u16 day;                 // BCD day of year, or day and month
+  __u16 reserved;            // BCD year in the DMY format
+};
+
+/*
+ * ARINC-429 format 0 intra-packet data header and word
+ */
+struct ch10_arinc429_msg {
+  __u32 idWord;              // gap time, bus speed, error flags and bus number
+  __u32 data;                // label in the low 8 bits
+};
+
+/*
+ * Ethernet format 0 and MIL-STD-1553 format 1 intra-packet headers
+ */
+struct ch10_ethernet_iph {
+  __u8 timeStamp[8];
+  __u32 idWord;              // frame length in the low 14 bits
+};
+
+struct ch10_1553_iph {
+  __u8 timeStamp[8];
+  __u16 blockStatus;
+  __u16 gapTimes;
+  __u16 length;              // length of the message in bytes
+};
+
+#pragma pack(pop)
+
+//
+// Channel specific data word and intra-packet header fields
+//
+#define CH10_TIME_CSDW_SRC_INTERNAL     0x00000000
+#define CH10_TIME_CSDW_FMT_IRIGB        0x00000000
+#define CH10_TIME_CSDW_LEAP_YEAR        0x00000100
+#define CH10_TIME_CSDW_DMY              0x00000200
+
+#define CH10_TIME_CSDW_SRC(Csdw)        ((Csdw) & 0x0f)
+#define CH10_TIME_CSDW_FMT(Csdw)        (((Csdw) >> 4) & 0x0f)
+
+//
+// Time formats in CH10_TIME_CSDW_FMT
+//
+#define CH10_TIME_FMT_IRIGB             0
+#define CH10_TIME_FMT_IRIGA             1
+#define CH10_TIME_FMT_IRIGG             2
+#define CH10_TIME_FMT_RTC               3
+#define CH10_TIME_FMT_UTC               4   // UTC from GPS
+#define CH10_TIME_FMT_GPS               5   // native GPS time
+
+#define CH10_PCM_CSDW_SYNC_OFFSET_MASK  0x0003ffff
+#define CH10_PCM_CSDW_UNPACKED          0x00040000
+#define CH10_PCM_CSDW_PACKED            0x00080000
+#define CH10_PCM_CSDW_THROUGHPUT        0x00100000
+#define CH10_PCM_CSDW_ALIGN_32          0x00200000
+#define CH10_PCM_CSDW_IPH               0x40000000
+
+//
+// PCM intra-packet header of the packed and unpacked modes, a time stamp
+// and a data header word as wide as the alignment
+//
+#define CH10_PCM_IPH_SIZE(Csdw) \
+    (8 + ((Csdw) & CH10_PCM_CSDW_ALIGN_32 ? 4 : 2))
+
+#define CH10_ANALOG_CSDW(Length, TotChan) \
+    ((((__u32)(TotChan) & 0xff) << 16) | (((__u32)(Length) & 0x3f) << 2))
+
+#define CH10_ANALOG_CSDW_MODE_MASK      0x00000003
+#define CH10_ANALOG_CSDW_PACKED         0x00000000
+#define CH10_ANALOG_CSDW_LSB_PADDED     0x00000001  // unpacked, sample in the MSBs
+#define CH10_ANALOG_CSDW_MSB_PADDED     0x00000003  // unpacked, sample in the LSBs
+#define CH10_ANALOG_CSDW_SAME           0x10000000
+
+//
+// Bits per sample and subchannels, a field of 0 stands for 64 and 256
+//
+#define CH10_ANALOG_LENGTH(Csdw)        (((((Csdw) >> 2) & 0x3f) + 63) % 64 + 1)
+#define CH10_ANALOG_TOTCHAN(Csdw)       (((((Csdw) >> 16) & 0xff) + 255) % 256 + 1)
+
+#define CH10_ARINC429_CSDW_COUNT(Csdw)  ((Csdw) & 0xffff)
+
+#define CH10_ARINC429_GAP(IdWord)       ((IdWord) & 0x000fffff)
+#define CH10_ARINC429_HIGH_SPEED        0x00200000
+#define CH10_ARINC429_PARITY_ERROR      0x00400000
+#define CH10_ARINC429_FORMAT_ERROR      0x00800000
+#define CH10_ARINC429_BUS(IdWord)       ((IdWord) >> 24)
+#define CH10_ARINC429_LABEL(Data)       ((Data) & 0xff)
+
+#define CH10_ETHERNET_LENGTH_MASK       0x3fff
+
+#define CH10_1553_CSDW_TTB_FIRST_BIT    0x00000000
+
+//
+// Function prototypes from packet.c
+//
+
+__u16
+Ch10HeaderChecksum (
+    const struct ch10_packet_header *Header
+    );
+
+__u32
+Ch10DataChecksum (
+    const void  *Body,
+    __u32       Length,
+    int         Type
+    );
+
+__u32
+Ch10ChecksumSize (
+    int Type
+    );
+
+__u64
+Ch10GetRtc (
+    const struct ch10_packet_header *Header
+    );
+
+void
+Ch10SetRtc (
+    struct ch10_packet_header   *Header,
+    __u64                       Rtc
+    );
+
+int
+Ch10CheckPacketHeader (
+    const struct ch10_packet_header *Header
+    );
+
+int
+Ch10CheckPacketData (
+    const struct ch10_packet_header *Header
+    );
+
+int
+Ch10FindPacket (
+    const void  *Buffer,
+    size_t      Length,
+    size_t      *Offset
+    );
+
+int
+Ch10DecodeTime (
+    const struct ch10_packet_header *Header,
+    __u64                           *Time,
+    __u32                           *Csdw
+    );
+
+int
+Ch10DecodeAnalog (
+    const struct ch10_packet_header *Header,
+    __s16                           *Samples,
+    __u32                           MaxSamples,
+    __u32                           *Subchannels
+    );
+
+const char *
+Ch10DataTypeName (
+    int DataType
+    );
+
+#endif
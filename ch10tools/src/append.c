@@ -0,0 +1,786 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Writes a new recording at the end of a volume, the way a recorder does:
+// the blocks are reserved and the entry is in the directory with the
+// shutdown flag set before the first byte of data is written, the data
+// goes to the device in large aligned writes, and only once it is all on
+// the media does the directory get the size and lose the flag. A volume
+// whose writer died is left with a flagged directory block and an entry
+// without a size, which a mount can recover from the packets.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ch10lib.h"
+#include "border.h"
+
+typedef struct _CH10_APPEND_BUFFER {
+    struct _CH10_APPEND_BUFFER  *Next;
+    __u8                        *Memory;
+    size_t                      Length;
+    __u64                       Offset;     // on the device
+} CH10_APPEND_BUFFER;
+
+typedef struct _CH10_APPEND_QUEUE {
+
+    // One buffer more than there are writes in flight, the one filled
+    CH10_APPEND_BUFFER  Buffers[CH10_APPEND_DEPTH + 1];
+    CH10_APPEND_BUFFER  *Current;
+
+    pthread_t           Threads[CH10_APPEND_DEPTH];
+    __u32               ThreadCount;
+
+    pthread_mutex_t     Lock;
+    pthread_cond_t      FreeAvailable;
+    pthread_cond_t      WriteAvailable;
+
+    CH10_APPEND_BUFFER  *FreeList;
+    CH10_APPEND_BUFFER  *WriteHead;
+    CH10_APPEND_BUFFER  *WriteTail;
+    int                 Stop;
+
+    // First write error
+    int                 Status;
+
+} CH10_APPEND_QUEUE;
+
+static int
+Ch10WriteFully (
+    int         Fd,
+    __u64       Offset,
+    size_t      Length,
+    const void  *Buffer
+    )
+{
+    size_t  Done = 0;
+    ssize_t Result;
+
+    while (Done < Length)
+    {
+        Result = pwrite(Fd, (const char *) Buffer + Done, Length - Done, Offset + Done);
+
+        if (Result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        if (Result == 0)
+        {
+            return -EIO;
+        }
+
+        Done += Result;
+    }
+
+    return 0;
+}
+
+//
+// Directory blocks are written on their own and made durable before the
+// call returns, so the order of directory updates on the media is the
+// order they are made in
+//
+static int
+Ch10WriteDirBlock (
+    CH10_APPEND                 *Append,
+    const struct ch10_dir_block *DirBlock,
+    __u64                       Block
+    )
+{
+    int Status;
+
+    Status = Ch10WriteFully(
+        Append->DirFd,
+        Block * Append->BytesPerBlock,
+        sizeof(struct ch10_dir_block),
+        DirBlock
+        );
+
+    if (Status == 0 && fdatasync(Append->DirFd))
+    {
+        Status = -errno;
+    }
+
+    return Status;
+}
+
+//
+// Date as DDMMYYYY and time as HHMMSSmm in hundredths, the form of the
+// createDate, createTime and closeTime fields
+//
+static void
+Ch10FormatDate (
+    __u8    *Date,
+    __u8    *Time
+    )
+{
+    struct timespec Now;
+    struct tm       Local;
+    char            Buffer[32];
+
+    clock_gettime(CLOCK_REALTIME, &Now);
+    localtime_r(&Now.tv_sec, &Local);
+
+    if (Date)
+    {
+        snprintf(Buffer, sizeof(Buffer), "%02d%02d%04d",
+            Local.tm_mday, Local.tm_mon + 1, Local.tm_year + 1900);
+        memcpy(Date, Buffer, 8);
+    }
+
+    snprintf(Buffer, sizeof(Buffer), "%02d%02d%02d%02d",
+        Local.tm_hour, Local.tm_min, Local.tm_sec, (int) (Now.tv_nsec / 10000000));
+    memcpy(Time, Buffer, 8);
+}
+
+static void *
+Ch10AppendThread (
+    void *Context
+    )
+{
+    CH10_APPEND         *Append = Context;
+    CH10_APPEND_QUEUE   *Queue = Append->Queue;
+    CH10_APPEND_BUFFER  *Buffer;
+    int                 Status;
+
+    pthread_mutex_lock(&Queue->Lock);
+
+    for (;;)
+    {
+        while (Queue->WriteHead == NULL && !Queue->Stop)
+        {
+            pthread_cond_wait(&Queue->WriteAvailable, &Queue->Lock);
+        }
+
+        //
+        // Stopping only once everything queued has been written
+        //
+        Buffer = Queue->WriteHead;
+
+        if (Buffer == NULL)
+        {
+            break;
+        }
+
+        Queue->WriteHead = Buffer->Next;
+
+        if (Queue->WriteHead == NULL)
+        {
+            Queue->WriteTail = NULL;
+        }
+
+        pthread_mutex_unlock(&Queue->Lock);
+
+        Status = Ch10WriteFully(Append->Fd, Buffer->Offset, Buffer->Length, Buffer->Memory);
+
+        pthread_mutex_lock(&Queue->Lock);
+
+        if (Status && !Queue->Status)
+        {
+            Queue->Status = Status;
+        }
+
+        Buffer->Next = Queue->FreeList;
+        Queue->FreeList = Buffer;
+
+        pthread_cond_signal(&Queue->FreeAvailable);
+    }
+
+    pthread_mutex_unlock(&Queue->Lock);
+
+    return NULL;
+}
+
+static int
+Ch10QueueBuffer (
+    CH10_APPEND *Append
+    )
+{
+    CH10_APPEND_QUEUE   *Queue = Append->Queue;
+    CH10_APPEND_BUFFER  *Buffer = Queue->Current;
+    int                 Status;
+
+    Queue->Current = NULL;
+
+    Append->Writes++;
+    Append->DeviceBytes += Buffer->Length;
+
+    pthread_mutex_lock(&Queue->Lock);
+
+    Buffer->Next = NULL;
+
+    if (Queue->WriteTail)
+    {
+        Queue->WriteTail->Next = Buffer;
+    }
+    else
+    {
+        Queue->WriteHead = Buffer;
+    }
+
+    Queue->WriteTail = Buffer;
+
+    pthread_cond_signal(&Queue->WriteAvailable);
+
+    Status = Queue->Status;
+
+    pthread_mutex_unlock(&Queue->Lock);
+
+    return Status;
+}
+
+static int
+Ch10StartAppendQueue (
+    CH10_APPEND *Append
+    )
+{
+    CH10_APPEND_QUEUE   *Queue;
+    __u32               Index;
+
+    Queue = calloc(1, sizeof(CH10_APPEND_QUEUE));
+
+    if (Queue == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    Append->Queue = Queue;
+
+    pthread_mutex_init(&Queue->Lock, NULL);
+    pthread_cond_init(&Queue->FreeAvailable, NULL);
+    pthread_cond_init(&Queue->WriteAvailable, NULL);
+
+    for (Index = 0; Index < CH10_APPEND_DEPTH + 1; Index++)
+    {
+        Queue->Buffers[Index].Memory = Ch10AllocateAligned(CH10_APPEND_BUFFER_SIZE);
+
+        if (Queue->Buffers[Index].Memory == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        Queue->Buffers[Index].Next = Queue->FreeList;
+        Queue->FreeList = &Queue->Buffers[Index];
+    }
+
+    for (Index = 0; Index < CH10_APPEND_DEPTH; Index++)
+    {
+        if (pthread_create(&Queue->Threads[Index], NULL, Ch10AppendThread, Append))
+        {
+            return -EAGAIN;
+        }
+
+        Queue->ThreadCount++;
+    }
+
+    return 0;
+}
+
+//
+// Waits for the queued writes and releases the queue and the device
+//
+static int
+Ch10StopAppend (
+    CH10_APPEND *Append
+    )
+{
+    CH10_APPEND_QUEUE   *Queue = Append->Queue;
+    __u32               Index;
+    int                 Status = 0;
+
+    if (Queue)
+    {
+        pthread_mutex_lock(&Queue->Lock);
+        Queue->Stop = 1;
+        pthread_cond_broadcast(&Queue->WriteAvailable);
+        pthread_mutex_unlock(&Queue->Lock);
+
+        for (Index = 0; Index < Queue->ThreadCount; Index++)
+        {
+            pthread_join(Queue->Threads[Index], NULL);
+        }
+
+        Status = Queue->Status;
+
+        for (Index = 0; Index < CH10_APPEND_DEPTH + 1; Index++)
+        {
+            free(Queue->Buffers[Index].Memory);
+        }
+
+        pthread_cond_destroy(&Queue->WriteAvailable);
+        pthread_cond_destroy(&Queue->FreeAvailable);
+        pthread_mutex_destroy(&Queue->Lock);
+
+        free(Queue);
+
+        Append->Queue = NULL;
+    }
+
+    if (Append->Fd >= 0)
+    {
+        close(Append->Fd);
+        Append->Fd = -1;
+    }
+
+    if (Append->DirFd >= 0)
+    {
+        close(Append->DirFd);
+        Append->DirFd = -1;
+    }
+
+    return Status;
+}
+
+//
+// Finds where the new recording goes: after every block a directory entry
+// claims, whether the recording was closed or not, and after the space
+// kept for the directory
+//
+static __u64
+Ch10FindFreeBlock (
+    CH10_VOLUME *Volume,
+    __u64       *FirstDataBlock
+    )
+{
+    struct ch10_dir_block   *DirBlock;
+    struct ch10_dir_entry   *DirEntry;
+    __u64                   End = 1 + CH10_MAX_DIR_BLOCKS;
+    __u64                   BlockNum;
+    __u64                   NumBlocks;
+    __u32                   DirIndex;
+    __u32                   EntryIndex;
+    __u32                   NumEntries;
+
+    *FirstDataBlock = ~0ULL;
+
+    for (DirIndex = 0; DirIndex < Volume->DirBlockCount; DirIndex++)
+    {
+        DirBlock = &Volume->DirBlocks[DirIndex];
+        NumEntries = be16_to_cpu(DirBlock->numEntries);
+
+        if (End <= Volume->DirBlockNumbers[DirIndex])
+        {
+            End = Volume->DirBlockNumbers[DirIndex] + 1;
+        }
+
+        for (EntryIndex = 0;
+             EntryIndex < NumEntries && EntryIndex < MAX_FILES_PER_DIR;
+             EntryIndex++)
+        {
+            DirEntry = &DirBlock->dirEntries[EntryIndex];
+
+            BlockNum = be64_to_cpu(DirEntry->blockNum);
+            NumBlocks = be64_to_cpu(DirEntry->numBlocks);
+
+            if (NumBlocks == 0)
+            {
+                NumBlocks = (be64_to_cpu(DirEntry->size) + Volume->BytesPerBlock - 1) /
+                    Volume->BytesPerBlock;
+            }
+
+            if (NumBlocks == 0)
+            {
+                continue;
+            }
+
+            if (*FirstDataBlock > BlockNum)
+            {
+                *FirstDataBlock = BlockNum;
+            }
+
+            if (End < BlockNum + NumBlocks)
+            {
+                End = BlockNum + NumBlocks;
+            }
+        }
+    }
+
+    return End;
+}
+
+int
+Ch10OpenAppend (
+    const char      *Path,
+    const char      *FileName,
+    __u64           Reserve,
+    int             Flags,
+    CH10_APPEND     *Append
+    )
+{
+    CH10_VOLUME             *Volume;
+    CH10_APPEND             *NewAppend = Append;
+    struct ch10_dir_block   LastDirBlock;
+    struct ch10_dir_entry   *DirEntry;
+    struct stat             Stat;
+    __u64                   LastDirBlockNumber;
+    __u64                   FirstDataBlock;
+    __u64                   DeviceSize;
+    __u64                   Unit;
+    __u32                   FileIndex;
+    __u32                   Index;
+    int                     NewDirBlock;
+    int                     Status;
+
+    if (FileName[0] == 0 || strlen(FileName) > CH10_MAXFN)
+    {
+        return -EINVAL;
+    }
+
+    Status = Ch10MountVolume(Path, Flags & CH10_OPEN_DIRECT, &Volume);
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    if (Volume->MemberCount > 1)
+    {
+        Ch10DismountVolume(Volume);
+        return -EOPNOTSUPP;
+    }
+
+    if (Ch10LookupFileName(Volume, FileName, &FileIndex) == 0)
+    {
+        Ch10DismountVolume(Volume);
+        return -EEXIST;
+    }
+
+    memset(NewAppend, 0, sizeof(CH10_APPEND));
+
+    NewAppend->Fd = -1;
+    NewAppend->DirFd = -1;
+    NewAppend->Flags = Volume->Device.Flags & CH10_OPEN_DIRECT;
+    NewAppend->BytesPerBlock = Volume->BytesPerBlock;
+
+    Unit = Volume->BytesPerBlock > CH10_APPEND_ALIGNMENT ?
+        Volume->BytesPerBlock : CH10_APPEND_ALIGNMENT;
+
+    NewAppend->BlockNum = Ch10FindFreeBlock(Volume, &FirstDataBlock);
+    NewAppend->BlockNum = (NewAppend->BlockNum * Volume->BytesPerBlock + Unit - 1) /
+        Unit * Unit / Volume->BytesPerBlock;
+
+    DeviceSize = Volume->Device.Size;
+
+    LastDirBlock = Volume->DirBlocks[Volume->DirBlockCount - 1];
+    LastDirBlockNumber = Volume->DirBlockNumbers[Volume->DirBlockCount - 1];
+
+    //
+    // A full directory block gets a successor in the next block, which has
+    // to be inside the space kept for the directory and free
+    //
+    NewDirBlock = be16_to_cpu(LastDirBlock.numEntries) >= MAX_FILES_PER_DIR;
+
+    if (NewDirBlock)
+    {
+        NewAppend->DirBlockNumber = LastDirBlockNumber + 1;
+
+        Status = NewAppend->DirBlockNumber > CH10_MAX_DIR_BLOCKS ||
+            NewAppend->DirBlockNumber >= FirstDataBlock ? -ENOSPC : 0;
+
+        for (Index = 0; Index < Volume->DirBlockCount; Index++)
+        {
+            if (Volume->DirBlockNumbers[Index] == NewAppend->DirBlockNumber)
+            {
+                Status = -ENOSPC;
+            }
+        }
+
+        memset(&NewAppend->DirBlock, 0, sizeof(struct ch10_dir_block));
+
+        memcpy(NewAppend->DirBlock.magicNumAscii, LastDirBlock.magicNumAscii, sizeof(LastDirBlock.magicNumAscii));
+        memcpy(NewAppend->DirBlock.volName, LastDirBlock.volName, sizeof(LastDirBlock.volName));
+        NewAppend->DirBlock.revNum = LastDirBlock.revNum;
+        NewAppend->DirBlock.bytesPerBlock = LastDirBlock.bytesPerBlock;
+        NewAppend->DirBlock.forwardLink = cpu_to_be64(NewAppend->DirBlockNumber);
+        NewAppend->DirBlock.reverseLink = cpu_to_be64(LastDirBlockNumber);
+    }
+    else
+    {
+        NewAppend->DirBlock = LastDirBlock;
+        NewAppend->DirBlockNumber = LastDirBlockNumber;
+    }
+
+    Ch10DismountVolume(Volume);
+
+    if (Status)
+    {
+        Ch10StopAppend(NewAppend);
+        return Status;
+    }
+
+    //
+    // Without a size the recording takes the rest of the device
+    //
+    if (Reserve == 0)
+    {
+        Reserve = DeviceSize > NewAppend->BlockNum * NewAppend->BytesPerBlock ?
+            DeviceSize - NewAppend->BlockNum * NewAppend->BytesPerBlock : 0;
+    }
+
+    Reserve = (Reserve + Unit - 1) / Unit * Unit;
+
+    NewAppend->ReservedBlocks = Reserve / NewAppend->BytesPerBlock;
+
+    NewAppend->Fd = open(Path, O_RDWR | (NewAppend->Flags & CH10_OPEN_DIRECT ? O_DIRECT : 0));
+    NewAppend->DirFd = open(Path, O_RDWR);
+
+    if (NewAppend->Fd < 0 || NewAppend->DirFd < 0 || fstat(NewAppend->DirFd, &Stat))
+    {
+        Status = -errno;
+        Ch10StopAppend(NewAppend);
+        return Status;
+    }
+
+    //
+    // An image grows to hold the reservation, allocated up front so the
+    // recording is laid out in few extents. A device has to be large
+    // enough already.
+    //
+    if (S_ISREG(Stat.st_mode))
+    {
+        Status = -posix_fallocate(
+            NewAppend->DirFd,
+            (off_t) (NewAppend->BlockNum * NewAppend->BytesPerBlock),
+            (off_t) Reserve
+            );
+
+        if ((Status == -EOPNOTSUPP || Status == -EINVAL) &&
+            (__u64) Stat.st_size < NewAppend->BlockNum * NewAppend->BytesPerBlock + Reserve)
+        {
+            Status = ftruncate(
+                NewAppend->DirFd,
+                (off_t) (NewAppend->BlockNum * NewAppend->BytesPerBlock + Reserve)
+                ) ? -errno : 0;
+        }
+        else if (Status == -EOPNOTSUPP || Status == -EINVAL)
+        {
+            Status = 0;
+        }
+    }
+    else if (Reserve == 0 ||
+             NewAppend->BlockNum * NewAppend->BytesPerBlock + Reserve > DeviceSize)
+    {
+        Status = -ENOSPC;
+    }
+
+    if (Status == 0 && Reserve == 0)
+    {
+        Status = -ENOSPC;
+    }
+
+    if (Status == 0)
+    {
+        Status = Ch10StartAppendQueue(NewAppend);
+    }
+
+    if (Status)
+    {
+        Ch10StopAppend(NewAppend);
+        return Status;
+    }
+
+    NewAppend->EntryIndex = be16_to_cpu(NewAppend->DirBlock.numEntries);
+
+    DirEntry = &NewAppend->DirBlock.dirEntries[NewAppend->EntryIndex];
+
+    memset(DirEntry, 0, sizeof(struct ch10_dir_entry));
+    memcpy(DirEntry->name, FileName, strlen(FileName));
+    DirEntry->blockNum = cpu_to_be64(NewAppend->BlockNum);
+    DirEntry->numBlocks = cpu_to_be64(NewAppend->ReservedBlocks);
+    DirEntry->size = 0;
+    Ch10FormatDate(DirEntry->createDate, DirEntry->createTime);
+
+    NewAppend->DirBlock.numEntries = cpu_to_be16((__u16) (NewAppend->EntryIndex + 1));
+    NewAppend->DirBlock.shutdown = 1;
+
+    //
+    // A new directory block is on the media before the chain links to it,
+    // a crash in between leaves it unlinked and the volume as it was
+    //
+    Status = Ch10WriteDirBlock(NewAppend, &NewAppend->DirBlock, NewAppend->DirBlockNumber);
+
+    if (Status == 0 && NewDirBlock)
+    {
+        LastDirBlock.forwardLink = cpu_to_be64(NewAppend->DirBlockNumber);
+
+        Status = Ch10WriteDirBlock(NewAppend, &LastDirBlock, LastDirBlockNumber);
+    }
+
+    if (Status)
+    {
+        Ch10StopAppend(NewAppend);
+    }
+
+    return Status;
+}
+
+//
+// Appends all of Data or nothing, -ENOSPC when it does not fit in the
+// reservation. A failed write is reported by the next call or by
+// Ch10CloseAppend.
+//
+ssize_t
+Ch10Append (
+    CH10_APPEND     *Append,
+    const void      *Data,
+    size_t          Length
+    )
+{
+    CH10_APPEND_QUEUE   *Queue = Append->Queue;
+    CH10_APPEND_BUFFER  *Buffer;
+    size_t              Done = 0;
+    size_t              Chunk;
+    int                 Status = 0;
+
+    if (Length > Append->ReservedBlocks * Append->BytesPerBlock - Append->Size)
+    {
+        return -ENOSPC;
+    }
+
+    while (Done < Length)
+    {
+        if (Queue->Current == NULL)
+        {
+            pthread_mutex_lock(&Queue->Lock);
+
+            while (Queue->FreeList == NULL)
+            {
+                pthread_cond_wait(&Queue->FreeAvailable, &Queue->Lock);
+            }
+
+            Buffer = Queue->FreeList;
+            Queue->FreeList = Buffer->Next;
+
+            Status = Queue->Status;
+
+            pthread_mutex_unlock(&Queue->Lock);
+
+            Buffer->Length = 0;
+            Buffer->Offset = Append->BlockNum * Append->BytesPerBlock + Append->Size;
+
+            Queue->Current = Buffer;
+        }
+
+        Buffer = Queue->Current;
+
+        Chunk = CH10_APPEND_BUFFER_SIZE - Buffer->Length;
+
+        if (Chunk > Length - Done)
+        {
+            Chunk = Length - Done;
+        }
+
+        memcpy(Buffer->Memory + Buffer->Length, (const __u8 *) Data + Done, Chunk);
+
+        Buffer->Length += Chunk;
+        Append->Size += Chunk;
+        Done += Chunk;
+
+        if (Buffer->Length == CH10_APPEND_BUFFER_SIZE)
+        {
+            Status = Ch10QueueBuffer(Append);
+        }
+
+        if (Status)
+        {
+            return Status;
+        }
+    }
+
+    return (ssize_t) Length;
+}
+
+//
+// Writes the rest of the data, waits for it to reach the media and then
+// completes the entry and clears the shutdown flag. The blocks beyond the
+// data are given back. After a failed write the directory is left as it
+// was at open, flagged, and the error returned.
+//
+int
+Ch10CloseAppend (
+    CH10_APPEND     *Append
+    )
+{
+    CH10_APPEND_QUEUE       *Queue = Append->Queue;
+    CH10_APPEND_BUFFER      *Buffer = Queue->Current;
+    struct ch10_dir_entry   *DirEntry;
+    size_t                  Length;
+    int                     Status = 0;
+
+    //
+    // The tail is padded with zeros to a whole aligned write
+    //
+    if (Buffer && Buffer->Length)
+    {
+        Length = (Buffer->Length + CH10_APPEND_ALIGNMENT - 1) & ~(size_t) (CH10_APPEND_ALIGNMENT - 1);
+
+        memset(Buffer->Memory + Buffer->Length, 0, Length - Buffer->Length);
+
+        Buffer->Length = Length;
+
+        Ch10QueueBuffer(Append);
+    }
+
+    pthread_mutex_lock(&Queue->Lock);
+    Queue->Stop = 1;
+    pthread_cond_broadcast(&Queue->WriteAvailable);
+    pthread_mutex_unlock(&Queue->Lock);
+
+    while (Queue->ThreadCount)
+    {
+        pthread_join(Queue->Threads[--Queue->ThreadCount], NULL);
+    }
+
+    Status = Queue->Status;
+
+    if (Status == 0 && fdatasync(Append->Fd))
+    {
+        Status = -errno;
+    }
+
+    if (Status == 0)
+    {
+        DirEntry = &Append->DirBlock.dirEntries[Append->EntryIndex];
+
+        DirEntry->size = cpu_to_be64(Append->Size);
+        DirEntry->numBlocks = cpu_to_be64(
+            (Append->Size + Append->BytesPerBlock - 1) / Append->BytesPerBlock);
+        Ch10FormatDate(NULL, DirEntry->closeTime);
+
+        Append->DirBlock.shutdown = 0;
+
+        Status = Ch10WriteDirBlock(Append, &Append->DirBlock, Append->DirBlockNumber);
+    }
+
+    Ch10StopAppend(Append);
+
+    return Status;
+}
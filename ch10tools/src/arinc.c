@@ -0,0 +1,784 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// ARINC-429 words of a recording by label. The label index is built in
+// one pass over the ARINC-429 packets, through the packet table of the
+// index sidecar when there is one and by a scan otherwise. Every packet
+// adds an entry for each channel, bus and label it holds words of, with
+// the first of those words and their number, and a counting sort then
+// puts the entries of a label together. A label view only reads the
+// packets of its label and gives each of its words a fixed size record
+// with the time of the word.
+//
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+//
+// Bus and label of a word, with the channel above them the order labels
+// are sorted in
+//
+#define CH10_ARINC_KEY(Bus, Label)  ((__u32) (Bus) << 8 | (Label))
+#define CH10_ARINC_KEYS             65536
+
+typedef struct _CH10_ARINC_RUN {
+    __u16                       Key;
+    __u16                       FirstWord;
+    __u16                       WordCount;
+} CH10_ARINC_RUN;
+
+typedef struct _CH10_ARINC_BUILDER {
+
+    CH10_ARINC_INDEX*           Index;
+    __u32                       LabelCapacity;
+    __u32                       PacketCapacity;
+
+    // Sort key of each entry of Index->Packets, which are in recording
+    // order until the index is sorted
+    __u32*                      Keys;
+
+    // Runs of the packet being added. Slot[Key] is the run of a bus and
+    // label when Stamp[Key] is the number of the packet.
+    CH10_ARINC_RUN*             Runs;
+    __u32*                      Stamp;
+    __u16*                      Slot;
+
+} CH10_ARINC_BUILDER;
+
+static __u32
+Ch10ArincLabelKey (
+    const CH10_ARINC_LABEL  *Label
+    )
+{
+    return (__u32) Label->ChannelId << 16 | CH10_ARINC_KEY(Label->Bus, Label->Label);
+}
+
+//
+// First label at or after Key
+//
+static __u32
+Ch10SearchArincLabel (
+    const CH10_ARINC_INDEX  *ArincIndex,
+    __u32                   Key
+    )
+{
+    __u32   Low = 0;
+    __u32   High = ArincIndex->LabelCount;
+    __u32   Middle;
+
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (Ch10ArincLabelKey(&ArincIndex->Labels[Middle]) < Key)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    return Low;
+}
+
+//
+// The words of an ARINC-429 packet, as many as the channel specific data
+// word gives and the packet holds
+//
+static __u32
+Ch10GetArincWords (
+    const struct ch10_packet_header *Header,
+    const __u8                      **Words
+    )
+{
+    const __u8  *Body = (const __u8 *) (Header + 1);
+    __u32       DataLength = le32_to_cpu(Header->dataLength);
+    __u32       Csdw;
+    __u32       Count;
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    if (DataLength < sizeof(Csdw))
+    {
+        return 0;
+    }
+
+    memcpy(&Csdw, Body, sizeof(Csdw));
+
+    Count = CH10_ARINC429_CSDW_COUNT(le32_to_cpu(Csdw));
+
+    if (Count > (DataLength - sizeof(Csdw)) / sizeof(struct ch10_arinc429_msg))
+    {
+        Count = (DataLength - sizeof(Csdw)) / sizeof(struct ch10_arinc429_msg);
+    }
+
+    *Words = Body + sizeof(Csdw);
+
+    return Count;
+}
+
+static void
+Ch10GetArincWord (
+    const __u8  *Words,
+    __u32       Word,
+    __u32       *IdWord,
+    __u32       *Data
+    )
+{
+    struct ch10_arinc429_msg Message;
+
+    memcpy(&Message, Words + Word * sizeof(Message), sizeof(Message));
+
+    *IdWord = le32_to_cpu(Message.idWord);
+    *Data = le32_to_cpu(Message.data);
+}
+
+//
+// Gives a packet of the recording in place when the device is mapped and
+// read into *Buffer otherwise
+//
+static int
+Ch10GetArincPacket (
+    CH10_VOLUME                     *Volume,
+    __u32                           Index,
+    __u64                           Offset,
+    __u32                           PacketLength,
+    __u8                            **Buffer,
+    const struct ch10_packet_header **Header
+    )
+{
+    ssize_t Result;
+
+    Result = Ch10MapFileData(Volume, Index, Offset, PacketLength, (const void **) Header);
+
+    if (Result < (ssize_t) PacketLength)
+    {
+        if (*Buffer == NULL && (*Buffer = malloc(CH10_MAX_PACKET_SIZE)) == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        Result = Ch10ReadFileData(Volume, Index, Offset, PacketLength, *Buffer);
+
+        *Header = (const struct ch10_packet_header *) *Buffer;
+    }
+
+    if (Result < (ssize_t) PacketLength)
+    {
+        return Result < 0 ? (int) Result : -EIO;
+    }
+
+    return 0;
+}
+
+static int
+Ch10AddArincLabel (
+    CH10_ARINC_BUILDER  *Builder,
+    __u32               Key,
+    const CH10_ARINC_RUN *Run
+    )
+{
+    CH10_ARINC_INDEX    *ArincIndex = Builder->Index;
+    CH10_ARINC_LABEL    *Label;
+    CH10_ARINC_PACKET   *Packet;
+    void                *Grown;
+    __u32               Position;
+    __u32               Capacity;
+
+    Position = Ch10SearchArincLabel(ArincIndex, Key);
+
+    if (Position == ArincIndex->LabelCount ||
+        Ch10ArincLabelKey(&ArincIndex->Labels[Position]) != Key)
+    {
+        if (ArincIndex->LabelCount == Builder->LabelCapacity)
+        {
+            Capacity = Builder->LabelCapacity ? Builder->LabelCapacity * 2 : 64;
+
+            Grown = realloc(ArincIndex->Labels, Capacity * sizeof(CH10_ARINC_LABEL));
+
+            if (Grown == NULL)
+            {
+                return -ENOMEM;
+            }
+
+            ArincIndex->Labels = (CH10_ARINC_LABEL *) Grown;
+            Builder->LabelCapacity = Capacity;
+        }
+
+        Label = &ArincIndex->Labels[Position];
+
+        memmove(Label + 1, Label, (ArincIndex->LabelCount - Position) * sizeof(CH10_ARINC_LABEL));
+        memset(Label, 0, sizeof(CH10_ARINC_LABEL));
+
+        Label->ChannelId = (__u16) (Key >> 16);
+        Label->Bus = (__u8) (Key >> 8);
+        Label->Label = (__u8) Key;
+
+        ArincIndex->LabelCount++;
+    }
+
+    if (ArincIndex->PacketCount == Builder->PacketCapacity)
+    {
+        if (Builder->PacketCapacity >= 0x80000000)
+        {
+            return -EFBIG;
+        }
+
+        Capacity = Builder->PacketCapacity ? Builder->PacketCapacity * 2 : 1024;
+
+        Grown = realloc(ArincIndex->Packets, Capacity * sizeof(CH10_ARINC_PACKET));
+
+        if (Grown == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        ArincIndex->Packets = (CH10_ARINC_PACKET *) Grown;
+
+        Grown = realloc(Builder->Keys, Capacity * sizeof(__u32));
+
+        if (Grown == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        Builder->Keys = (__u32 *) Grown;
+        Builder->PacketCapacity = Capacity;
+    }
+
+    Label = &ArincIndex->Labels[Position];
+
+    Label->PacketCount++;
+    Label->WordCount += Run->WordCount;
+
+    Packet = &ArincIndex->Packets[ArincIndex->PacketCount];
+
+    Packet->FirstWord = Run->FirstWord;
+    Packet->WordCount = Run->WordCount;
+
+    Builder->Keys[ArincIndex->PacketCount++] = Key;
+
+    return 0;
+}
+
+static int
+Ch10AddArincPacket (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    CH10_ARINC_BUILDER  *Builder = (CH10_ARINC_BUILDER *) Context;
+    CH10_ARINC_INDEX    *ArincIndex = Builder->Index;
+    CH10_ARINC_RUN      *Run;
+    const __u8          *Words;
+    __u32               Count;
+    __u32               Word;
+    __u32               IdWord;
+    __u32               Data;
+    __u32               Key;
+    __u32               Stamp;
+    __u32               RunCount = 0;
+    __u32               Number;
+    __u32               First = ArincIndex->PacketCount;
+    int                 Status;
+
+    if (Header->dataType != CH10_DATA_ARINC429_F0)
+    {
+        return 0;
+    }
+
+    Count = Ch10GetArincWords(Header, &Words);
+
+    ArincIndex->ArincPackets++;
+    ArincIndex->WordCount += Count;
+
+    Stamp = (__u32) ArincIndex->ArincPackets;
+
+    if (Stamp == 0)
+    {
+        memset(Builder->Stamp, 0, CH10_ARINC_KEYS * sizeof(__u32));
+        Stamp = 1;
+    }
+
+    for (Word = 0; Word < Count; Word++)
+    {
+        Ch10GetArincWord(Words, Word, &IdWord, &Data);
+
+        Key = CH10_ARINC_KEY(CH10_ARINC429_BUS(IdWord), CH10_ARINC429_LABEL(Data));
+
+        if (Builder->Stamp[Key] != Stamp)
+        {
+            Builder->Stamp[Key] = Stamp;
+            Builder->Slot[Key] = (__u16) RunCount;
+
+            Run = &Builder->Runs[RunCount++];
+
+            Run->Key = (__u16) Key;
+            Run->FirstWord = (__u16) Word;
+            Run->WordCount = 0;
+        }
+
+        Builder->Runs[Builder->Slot[Key]].WordCount++;
+    }
+
+    for (Number = 0; Number < RunCount; Number++)
+    {
+        Key = (__u32) le16_to_cpu(Header->channelId) << 16 | Builder->Runs[Number].Key;
+
+        Status = Ch10AddArincLabel(Builder, Key, &Builder->Runs[Number]);
+
+        if (Status)
+        {
+            return Status;
+        }
+    }
+
+    for (Number = First; Number < ArincIndex->PacketCount; Number++)
+    {
+        ArincIndex->Packets[Number].Offset = Offset;
+        ArincIndex->Packets[Number].PacketLength = le32_to_cpu(Header->packetLength);
+    }
+
+    return 0;
+}
+
+//
+// Puts the entries of each label together, in recording order
+//
+static int
+Ch10SortArincIndex (
+    CH10_ARINC_BUILDER  *Builder
+    )
+{
+    CH10_ARINC_INDEX    *ArincIndex = Builder->Index;
+    CH10_ARINC_PACKET   *Sorted;
+    __u32               *Fill;
+    __u32               Position;
+    __u32               Number;
+    __u32               Total = 0;
+
+    if (ArincIndex->PacketCount == 0)
+    {
+        return 0;
+    }
+
+    Sorted = malloc(ArincIndex->PacketCount * sizeof(CH10_ARINC_PACKET));
+    Fill = calloc(ArincIndex->LabelCount, sizeof(__u32));
+
+    if (Sorted == NULL || Fill == NULL)
+    {
+        free(Sorted);
+        free(Fill);
+        return -ENOMEM;
+    }
+
+    for (Number = 0; Number < ArincIndex->LabelCount; Number++)
+    {
+        ArincIndex->Labels[Number].FirstPacket = Total;
+        Total += ArincIndex->Labels[Number].PacketCount;
+    }
+
+    for (Number = 0; Number < ArincIndex->PacketCount; Number++)
+    {
+        Position = Ch10SearchArincLabel(ArincIndex, Builder->Keys[Number]);
+
+        Sorted[ArincIndex->Labels[Position].FirstPacket + Fill[Position]++] =
+            ArincIndex->Packets[Number];
+    }
+
+    free(Fill);
+    free(ArincIndex->Packets);
+
+    ArincIndex->Packets = Sorted;
+
+    return 0;
+}
+
+//
+// Builds the label index of a recording
+//
+int
+Ch10BuildArincIndex (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    CH10_ARINC_INDEX        *ArincIndex
+    )
+{
+    CH10_ARINC_BUILDER              Builder;
+    const struct ch10_index_packet  *Packets;
+    const struct ch10_packet_header *Header;
+    ssize_t                         Count;
+    ssize_t                         Packet;
+    __u8                            *Buffer = NULL;
+    __u64                           Skipped = 0;
+    int                             Status = 0;
+
+    if (Index >= Volume->FileCount)
+    {
+        return -EINVAL;
+    }
+
+    memset(ArincIndex, 0, sizeof(CH10_ARINC_INDEX));
+    memset(&Builder, 0, sizeof(Builder));
+
+    Builder.Index = ArincIndex;
+    Builder.Runs = malloc(CH10_ARINC_KEYS * sizeof(CH10_ARINC_RUN));
+    Builder.Stamp = calloc(CH10_ARINC_KEYS, sizeof(__u32));
+    Builder.Slot = malloc(CH10_ARINC_KEYS * sizeof(__u16));
+
+    if (Builder.Runs == NULL || Builder.Stamp == NULL || Builder.Slot == NULL)
+    {
+        Status = -ENOMEM;
+    }
+
+    Count = Status ? 0 : Ch10GetFilePackets(Volume, Index, &Packets);
+
+    if (Count >= 0)
+    {
+        for (Packet = 0; Packet < Count && !Status; Packet++)
+        {
+            if (Packets[Packet].dataType != CH10_DATA_ARINC429_F0)
+            {
+                continue;
+            }
+
+            Status = Ch10GetArincPacket(
+                Volume,
+                Index,
+                le64_to_cpu(Packets[Packet].offset),
+                le32_to_cpu(Packets[Packet].packetLength),
+                &Buffer,
+                &Header
+                );
+
+            if (!Status)
+            {
+                Status = Ch10AddArincPacket(&Builder, le64_to_cpu(Packets[Packet].offset), Header);
+            }
+        }
+    }
+    else
+    {
+        Status = Ch10ScanFile(Volume, Index, Ch10AddArincPacket, &Builder, &Skipped);
+    }
+
+    if (!Status)
+    {
+        Status = Ch10SortArincIndex(&Builder);
+    }
+
+    free(Buffer);
+    free(Builder.Keys);
+    free(Builder.Runs);
+    free(Builder.Stamp);
+    free(Builder.Slot);
+
+    if (Status)
+    {
+        Ch10FreeArincIndex(ArincIndex);
+    }
+
+    return Status;
+}
+
+void
+Ch10FreeArincIndex (
+    CH10_ARINC_INDEX        *ArincIndex
+    )
+{
+    free(ArincIndex->Labels);
+    free(ArincIndex->Packets);
+
+    memset(ArincIndex, 0, sizeof(*ArincIndex));
+}
+
+const CH10_ARINC_LABEL *
+Ch10FindArincLabel (
+    const CH10_ARINC_INDEX  *ArincIndex,
+    __u16                   ChannelId,
+    __u8                    Bus,
+    __u8                    Label
+    )
+{
+    __u32   Key = (__u32) ChannelId << 16 | CH10_ARINC_KEY(Bus, Label);
+    __u32   Position = Ch10SearchArincLabel(ArincIndex, Key);
+
+    if (Position == ArincIndex->LabelCount ||
+        Ch10ArincLabelKey(&ArincIndex->Labels[Position]) != Key)
+    {
+        return NULL;
+    }
+
+    return &ArincIndex->Labels[Position];
+}
+
+//
+// Opens the words of one label, Filter is bus << 8 | label as
+// Ch10ParseStreamName gives it
+//
+int
+Ch10OpenArinc (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    __u16                   ChannelId,
+    __u32                   Filter,
+    CH10_ARINC              **Result
+    )
+{
+    CH10_ARINC  *View;
+    __u64       Records = 0;
+    __u32       Packet;
+    int         Status;
+
+    if (Index >= Volume->FileCount || Filter > 0xffff)
+    {
+        return -EINVAL;
+    }
+
+    View = calloc(1, sizeof(CH10_ARINC));
+
+    if (View == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    View->Volume = Volume;
+    View->FileIndex = Index;
+    View->ChannelId = ChannelId;
+    View->Bus = (__u8) (Filter >> 8);
+    View->Label = (__u8) Filter;
+
+    Status = Ch10BuildArincIndex(Volume, Index, &View->Index);
+
+    if (!Status)
+    {
+        View->Entry = Ch10FindArincLabel(&View->Index, ChannelId, View->Bus, View->Label);
+
+        if (View->Entry == NULL)
+        {
+            Status = -ENOENT;
+        }
+    }
+
+    if (!Status)
+    {
+        View->FirstRecord = malloc(View->Entry->PacketCount * sizeof(__u64));
+
+        if (View->FirstRecord == NULL)
+        {
+            Status = -ENOMEM;
+        }
+    }
+
+    if (!Status)
+    {
+        Status = Ch10BuildTimeTable(Volume, Index, &View->Time);
+    }
+
+    if (Status)
+    {
+        Ch10CloseArinc(View);
+        return Status;
+    }
+
+    for (Packet = 0; Packet < View->Entry->PacketCount; Packet++)
+    {
+        View->FirstRecord[Packet] = Records;
+        Records += View->Index.Packets[View->Entry->FirstPacket + Packet].WordCount;
+    }
+
+    View->RecordCount = Records;
+    View->Size = Records * sizeof(CH10_ARINC_RECORD);
+
+    if (View->Time.Count && !(View->Time.Points[0].Flags & CH10_TIME_YEAR))
+    {
+        View->Epoch = Ch10GetEpoch(Volume->Files[Index].DirEntry);
+    }
+
+    *Result = View;
+
+    return 0;
+}
+
+void
+Ch10CloseArinc (
+    CH10_ARINC  *View
+    )
+{
+    Ch10FreeTimeTable(&View->Time);
+    Ch10FreeArincIndex(&View->Index);
+    free(View->FirstRecord);
+    free(View);
+}
+
+//
+// Reads the records, the whole range up to the end of the stream
+//
+ssize_t
+Ch10ReadArinc (
+    CH10_ARINC  *View,
+    __u64       Offset,
+    size_t      Length,
+    void        *Buffer
+    )
+{
+    const struct ch10_packet_header *Header;
+    const CH10_ARINC_PACKET         *Packet;
+    CH10_ARINC_RECORD               Record;
+    const __u8                      *Words;
+    __u8                            *PacketBuffer = NULL;
+    __u64                           First;
+    __u64                           Last;
+    __u64                           Number;
+    __u64                           Position;
+    __u64                           Start;
+    __u64                           End;
+    __u64                           Rtc;
+    __u64                           Time;
+    __u32                           Low = 0;
+    __u32                           High = View->Entry->PacketCount;
+    __u32                           Middle;
+    __u32                           Count;
+    __u32                           Word;
+    __u32                           IdWord;
+    __u32                           Data;
+    int                             Status;
+
+    if (Offset >= View->Size || Length == 0)
+    {
+        return 0;
+    }
+
+    if (Length > View->Size - Offset)
+    {
+        Length = (size_t) (View->Size - Offset);
+    }
+
+    First = Offset / sizeof(CH10_ARINC_RECORD);
+    Last = (Offset + Length - 1) / sizeof(CH10_ARINC_RECORD);
+
+    //
+    // Last packet whose records start at or before the first one wanted
+    //
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (View->FirstRecord[Middle] <= First)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    for (Low = Low ? Low - 1 : 0;
+         Low < View->Entry->PacketCount && View->FirstRecord[Low] <= Last;
+         Low++)
+    {
+        Packet = &View->Index.Packets[View->Entry->FirstPacket + Low];
+
+        Status = Ch10GetArincPacket(
+            View->Volume,
+            View->FileIndex,
+            Packet->Offset,
+            Packet->PacketLength,
+            &PacketBuffer,
+            &Header
+            );
+
+        if (Status)
+        {
+            free(PacketBuffer);
+            return Status;
+        }
+
+        View->PacketReads++;
+
+        Count = Ch10GetArincWords(Header, &Words);
+        Number = View->FirstRecord[Low];
+
+        //
+        // Gap times run from the word before on any bus, the first from
+        // the time of the packet
+        //
+        Rtc = Ch10GetRtc(Header);
+
+        for (Word = 0; Word < Count && Number <= Last; Word++)
+        {
+            Ch10GetArincWord(Words, Word, &IdWord, &Data);
+
+            Rtc += CH10_ARINC429_GAP(IdWord);
+
+            if (Word < Packet->FirstWord ||
+                CH10_ARINC429_BUS(IdWord) != View->Bus ||
+                CH10_ARINC429_LABEL(Data) != View->Label)
+            {
+                continue;
+            }
+
+            if (Number >= First)
+            {
+                if (Ch10RtcToTime(&View->Time, Rtc, &Time))
+                {
+                    Time = 0;
+                }
+                else
+                {
+                    Time += View->Epoch;
+                }
+
+                memset(&Record, 0, sizeof(Record));
+
+                Record.Rtc = cpu_to_le64(Rtc);
+                Record.Time = cpu_to_le64(Time);
+                Record.Word = cpu_to_le32(Data);
+                Record.Bus = View->Bus;
+                Record.Flags =
+                    (IdWord & CH10_ARINC429_PARITY_ERROR ? CH10_ARINC_RECORD_PARITY_ERROR : 0) |
+                    (IdWord & CH10_ARINC429_FORMAT_ERROR ? CH10_ARINC_RECORD_FORMAT_ERROR : 0) |
+                    (IdWord & CH10_ARINC429_HIGH_SPEED ? CH10_ARINC_RECORD_HIGH_SPEED : 0);
+
+                Position = Number * sizeof(CH10_ARINC_RECORD);
+                Start = Position > Offset ? Position : Offset;
+                End = Position + sizeof(Record) < Offset + Length ? Position + sizeof(Record) : Offset + Length;
+
+                memcpy((__u8 *) Buffer + (Start - Offset), (__u8 *) &Record + (Start - Position), End - Start);
+            }
+
+            Number++;
+        }
+    }
+
+    free(PacketBuffer);
+
+    return (ssize_t) Length;
+}
@@ -0,0 +1,435 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "ch10lib.h"
+
+//
+// Direct I/O on image files is done in units of the page size, which is
+// what the common local file systems accept
+//
+#define CH10_FILE_SECTOR_SIZE   4096
+
+//
+// Mappings are placed on a huge page boundary, so the kernel can back them
+// with huge pages where the page cache supports it
+//
+#define CH10_HUGE_PAGE_SIZE     (2 * 1024 * 1024)
+
+static size_t
+Ch10MapLength (
+    CH10_BLOCKDEV *Device
+    )
+{
+    return (size_t) ((Device->Size + CH10_HUGE_PAGE_SIZE - 1) & ~(__u64) (CH10_HUGE_PAGE_SIZE - 1));
+}
+
+//
+// Maps the whole device read only. A region one huge page larger than the
+// device is reserved first, the device is mapped at the first huge page
+// boundary in it and the rest is given back.
+//
+static int
+Ch10MapDevice (
+    CH10_BLOCKDEV *Device
+    )
+{
+    size_t      Length = Ch10MapLength(Device);
+    __u8        *Region;
+    __u8        *Aligned;
+    void        *Map;
+
+    if (Device->Size == 0 || Device->Size != (size_t) Device->Size)
+    {
+        return -EINVAL;
+    }
+
+    Region = mmap(
+        NULL,
+        Length + CH10_HUGE_PAGE_SIZE,
+        PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1,
+        0
+        );
+
+    if (Region == MAP_FAILED)
+    {
+        return -errno;
+    }
+
+    Aligned = (__u8 *) (((uintptr_t) Region + CH10_HUGE_PAGE_SIZE - 1) &
+        ~(uintptr_t) (CH10_HUGE_PAGE_SIZE - 1));
+
+    Map = mmap(
+        Aligned,
+        (size_t) Device->Size,
+        PROT_READ,
+        MAP_SHARED | MAP_FIXED,
+        Device->Fd,
+        0
+        );
+
+    if (Map == MAP_FAILED)
+    {
+        munmap(Region, Length + CH10_HUGE_PAGE_SIZE);
+        return -errno;
+    }
+
+    if (Aligned > Region)
+    {
+        munmap(Region, Aligned - Region);
+    }
+
+    munmap(Aligned + Length, Region + CH10_HUGE_PAGE_SIZE - Aligned);
+
+    //
+    // Only a hint, not every kernel and file system can do this
+    //
+    madvise(Map, Length, MADV_HUGEPAGE);
+
+    Device->Map = Map;
+
+    return 0;
+}
+
+void *
+Ch10AllocateAligned (
+    size_t Length
+    )
+{
+    void *Buffer;
+
+    if (posix_memalign(&Buffer, CH10_FILE_SECTOR_SIZE, Length ? Length : 1))
+    {
+        return NULL;
+    }
+
+    return Buffer;
+}
+
+int
+Ch10OpenBlockDevice (
+    const char      *Path,
+    int             Flags,
+    CH10_BLOCKDEV   *Device
+    )
+{
+    struct stat Stat;
+    int         SectorSize;
+    int         Status;
+
+    memset(Device, 0, sizeof(CH10_BLOCKDEV));
+
+    //
+    // A mapping is served from the page cache, direct I/O does not apply
+    //
+    if (Flags & CH10_OPEN_MMAP)
+    {
+        Flags &= ~CH10_OPEN_DIRECT;
+    }
+
+    Device->Fd = open(Path, O_RDONLY | (Flags & CH10_OPEN_DIRECT ? O_DIRECT : 0));
+
+    //
+    // Not every file system takes direct I/O, fall back to the page cache
+    //
+    if (Device->Fd < 0 && errno == EINVAL && (Flags & CH10_OPEN_DIRECT))
+    {
+        Flags &= ~CH10_OPEN_DIRECT;
+
+        Device->Fd = open(Path, O_RDONLY);
+    }
+
+    if (Device->Fd < 0)
+    {
+        return -errno;
+    }
+
+    Device->Flags = Flags;
+
+    if (fstat(Device->Fd, &Stat))
+    {
+        Status = -errno;
+        close(Device->Fd);
+        return Status;
+    }
+
+    if (S_ISBLK(Stat.st_mode))
+    {
+        if (ioctl(Device->Fd, BLKGETSIZE64, &Device->Size) ||
+            ioctl(Device->Fd, BLKSSZGET, &SectorSize))
+        {
+            Status = -errno;
+            close(Device->Fd);
+            return Status;
+        }
+
+        Device->SectorSize = (__u32) SectorSize;
+    }
+    else
+    {
+        Device->Size = (__u64) Stat.st_size;
+        Device->SectorSize =
+            Flags & CH10_OPEN_DIRECT ? CH10_FILE_SECTOR_SIZE : SECTOR_SIZE;
+    }
+
+    //
+    // Devices that cannot be mapped are read with pread
+    //
+    if (Flags & CH10_OPEN_MMAP && Ch10MapDevice(Device))
+    {
+        Device->Flags &= ~CH10_OPEN_MMAP;
+    }
+
+    return 0;
+}
+
+void
+Ch10CloseBlockDevice (
+    CH10_BLOCKDEV *Device
+    )
+{
+    if (Device->Map)
+    {
+        munmap((void *) Device->Map, Ch10MapLength(Device));
+        Device->Map = NULL;
+    }
+
+    if (Device->Fd >= 0)
+    {
+        close(Device->Fd);
+        Device->Fd = -1;
+    }
+}
+
+static ssize_t
+Ch10ReadFully (
+    int     Fd,
+    __u64   Offset,
+    size_t  Length,
+    void    *Buffer
+    )
+{
+    size_t  Done = 0;
+    ssize_t Result;
+
+    while (Done < Length)
+    {
+        Result = pread(Fd, (char *) Buffer + Done, Length - Done, Offset + Done);
+
+        if (Result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        if (Result == 0)
+        {
+            break;
+        }
+
+        Done += Result;
+    }
+
+    return Done;
+}
+
+//
+// Reads Length bytes at Offset. With CH10_OPEN_DIRECT a request that is
+// not sector aligned in offset, length or memory goes through a bounce
+// buffer, like FsdReadFileData does for unaligned reads.
+//
+ssize_t
+Ch10ReadBlockDevice (
+    CH10_BLOCKDEV   *Device,
+    __u64           Offset,
+    size_t          Length,
+    void            *Buffer
+    )
+{
+    __u64   Mask = Device->SectorSize - 1;
+    __u64   PhysicalOffset;
+    size_t  PhysicalLength;
+    char    *PhysicalBuffer;
+    ssize_t Result;
+
+    if (Offset >= Device->Size)
+    {
+        return 0;
+    }
+
+    if (Length > Device->Size - Offset)
+    {
+        Length = (size_t) (Device->Size - Offset);
+    }
+
+    if (Device->Map)
+    {
+        memcpy(Buffer, Device->Map + Offset, Length);
+        return Length;
+    }
+
+    if (!(Device->Flags & CH10_OPEN_DIRECT) ||
+        !((Offset | Length | (uintptr_t) Buffer) & Mask))
+    {
+        return Ch10ReadFully(Device->Fd, Offset, Length, Buffer);
+    }
+
+    PhysicalOffset = Offset & ~Mask;
+    PhysicalLength = (size_t) (((Offset + Length + Mask) & ~Mask) - PhysicalOffset);
+
+    PhysicalBuffer = Ch10AllocateAligned(PhysicalLength);
+
+    if (PhysicalBuffer == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    Result = Ch10ReadFully(Device->Fd, PhysicalOffset, PhysicalLength, PhysicalBuffer);
+
+    if (Result >= 0)
+    {
+        Result -= (ssize_t) (Offset - PhysicalOffset);
+
+        if (Result > (ssize_t) Length)
+        {
+            Result = Length;
+        }
+
+        if (Result > 0)
+        {
+            memcpy(Buffer, PhysicalBuffer + (Offset - PhysicalOffset), Result);
+        }
+        else
+        {
+            Result = 0;
+        }
+    }
+
+    free(PhysicalBuffer);
+
+    return Result;
+}
+
+//
+// Returns the address of the data at Offset in the mapping and the number
+// of bytes available there, or -EOPNOTSUPP when the device is not mapped
+//
+ssize_t
+Ch10MapBlockDevice (
+    CH10_BLOCKDEV   *Device,
+    __u64           Offset,
+    size_t          Length,
+    const void      **Address
+    )
+{
+    if (Device->Map == NULL)
+    {
+        return -EOPNOTSUPP;
+    }
+
+    if (Offset >= Device->Size)
+    {
+        return 0;
+    }
+
+    if (Length > Device->Size - Offset)
+    {
+        Length = (size_t) (Device->Size - Offset);
+    }
+
+    *Address = Device->Map + Offset;
+
+    return Length;
+}
+
+//
+// Passes an access pattern hint for a range of the device to the kernel,
+// as madvise for a mapped device and as posix_fadvise otherwise. A zero
+// Length means up to the end of the device.
+//
+int
+Ch10AdviseBlockDevice (
+    CH10_BLOCKDEV   *Device,
+    __u64           Offset,
+    __u64           Length,
+    int             Advice
+    )
+{
+    static const int MemoryAdvice[] = {
+        MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED, MADV_DONTNEED
+    };
+    static const int FileAdvice[] = {
+        POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM,
+        POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED
+    };
+    uintptr_t   Start;
+    uintptr_t   End;
+    int         Status;
+
+    if (Advice < CH10_ADVISE_NORMAL || Advice > CH10_ADVISE_DONTNEED)
+    {
+        return -EINVAL;
+    }
+
+    if (Offset >= Device->Size)
+    {
+        return 0;
+    }
+
+    if (Length == 0 || Length > Device->Size - Offset)
+    {
+        Length = Device->Size - Offset;
+    }
+
+    if (Device->Map)
+    {
+        Start = ((uintptr_t) Device->Map + (uintptr_t) Offset) & ~(uintptr_t) (CH10_FILE_SECTOR_SIZE - 1);
+        End = (uintptr_t) Device->Map + (uintptr_t) (Offset + Length);
+
+        if (madvise((void *) Start, End - Start, MemoryAdvice[Advice]))
+        {
+            return -errno;
+        }
+
+        //
+        // Dropping the pages from the mapping leaves them in the page cache
+        //
+        if (Advice != CH10_ADVISE_DONTNEED)
+        {
+            return 0;
+        }
+    }
+
+    Status = posix_fadvise(Device->Fd, (off_t) Offset, (off_t) Length, FileAdvice[Advice]);
+
+    return -Status;
+}
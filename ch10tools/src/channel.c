@@ -0,0 +1,224 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+//
+// Reads the packets of a set of channels without reading the packets of
+// the others. The packet table of the sidecar says where each packet is,
+// so a read covers a run of wanted packets and the gaps between them are
+// only read through when they are short. On a recording of many
+// interleaved channels this moves a small part of what a scan reads.
+//
+
+//
+// First packet at or after Offset
+//
+static __u64
+Ch10FindChannelPacket (
+    const struct ch10_index_packet  *Packets,
+    __u64                           Count,
+    __u64                           Offset
+    )
+{
+    __u64   Low = 0;
+    __u64   High = Count;
+    __u64   Middle;
+
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (le64_to_cpu(Packets[Middle].offset) < Offset)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    return Low;
+}
+
+//
+// Fills Buffer with the whole packets of the channels in ChannelSet from
+// Offset on, as many as fit. Needs the sidecar of the volume, returns
+// -ENOENT without it and -ENOSPC when the first packet does not fit.
+//
+int
+Ch10ReadChannels (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    const __u8              *ChannelSet,
+    __u64                   Offset,
+    void                    *Buffer,
+    size_t                  Length,
+    CH10_CHANNEL_READ       *Result
+    )
+{
+    const struct ch10_index_packet  *Packets;
+    const struct ch10_packet_header *Header;
+    char                            *Extent = NULL;
+    __u64                           Count;
+    __u64                           First;
+    __u64                           Last;
+    __u64                           Packet;
+    __u64                           Start;
+    __u64                           End;
+    __u64                           PacketOffset;
+    __u32                           PacketLength;
+    size_t                          Wanted;
+    ssize_t                         Read;
+    int                             Status = 0;
+
+    memset(Result, 0, sizeof(*Result));
+
+    Read = Ch10GetFilePackets(Volume, Index, &Packets);
+
+    if (Read < 0)
+    {
+        return (int) Read;
+    }
+
+    Count = (__u64) Read;
+
+    Packet = Ch10FindChannelPacket(Packets, Count, Offset);
+
+    for (;;)
+    {
+        while (Packet < Count && !Ch10HasChannel(ChannelSet, le16_to_cpu(Packets[Packet].channelId)))
+        {
+            Packet++;
+        }
+
+        if (Packet == Count ||
+            le32_to_cpu(Packets[Packet].packetLength) > Length - Result->Length)
+        {
+            break;
+        }
+
+        //
+        // The extent grows by the next wanted packet while the gap to it is
+        // short, the extent stays within CH10_SCAN_WINDOW and the packets
+        // still fit the buffer
+        //
+        First = Packet;
+        Last = Packet;
+        Start = le64_to_cpu(Packets[Packet].offset);
+        End = Start + le32_to_cpu(Packets[Packet].packetLength);
+        Wanted = le32_to_cpu(Packets[Packet].packetLength);
+
+        for (Packet++; Packet < Count; Packet++)
+        {
+            if (!Ch10HasChannel(ChannelSet, le16_to_cpu(Packets[Packet].channelId)))
+            {
+                if (le64_to_cpu(Packets[Packet].offset) - End > CH10_CHANNEL_READ_GAP)
+                {
+                    break;
+                }
+
+                continue;
+            }
+
+            PacketOffset = le64_to_cpu(Packets[Packet].offset);
+            PacketLength = le32_to_cpu(Packets[Packet].packetLength);
+
+            if (PacketOffset - End > CH10_CHANNEL_READ_GAP ||
+                PacketOffset + PacketLength - Start > CH10_SCAN_WINDOW ||
+                Wanted + PacketLength > Length - Result->Length)
+            {
+                break;
+            }
+
+            Last = Packet;
+            End = PacketOffset + PacketLength;
+            Wanted += PacketLength;
+        }
+
+        if (Extent == NULL && (Extent = Ch10AllocateAligned(CH10_SCAN_WINDOW)) == NULL)
+        {
+            Status = -ENOMEM;
+            break;
+        }
+
+        Read = Ch10ReadFileData(Volume, Index, Start, (size_t) (End - Start), Extent);
+
+        if (Read < (ssize_t) (End - Start))
+        {
+            Status = Read < 0 ? (int) Read : -EIO;
+            break;
+        }
+
+        Result->ExtentCount++;
+        Result->DeviceBytes += End - Start;
+
+        for (Packet = First; Packet <= Last; Packet++)
+        {
+            if (!Ch10HasChannel(ChannelSet, le16_to_cpu(Packets[Packet].channelId)))
+            {
+                continue;
+            }
+
+            PacketOffset = le64_to_cpu(Packets[Packet].offset);
+            PacketLength = le32_to_cpu(Packets[Packet].packetLength);
+
+            //
+            // A sidecar that no longer matches the recording
+            //
+            Header = (const struct ch10_packet_header *) (Extent + (PacketOffset - Start));
+
+            if (Ch10CheckPacketHeader(Header) ||
+                le32_to_cpu(Header->packetLength) != PacketLength)
+            {
+                Status = -EBADMSG;
+                break;
+            }
+
+            memcpy((char *) Buffer + Result->Length, Header, PacketLength);
+
+            Result->Length += PacketLength;
+            Result->PacketCount++;
+        }
+
+        if (Status)
+        {
+            break;
+        }
+    }
+
+    free(Extent);
+
+    if (!Status && Result->PacketCount == 0 && Packet < Count)
+    {
+        Status = -ENOSPC;
+    }
+
+    Result->NextOffset = Packet < Count ?
+        le64_to_cpu(Packets[Packet].offset) :
+        Volume->Files[Index].Size;
+
+    return Status;
+}
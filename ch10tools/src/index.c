@@ -0,0 +1,1589 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+//
+// CRC-32 as used by zlib and Ethernet, reflected polynomial 0xEDB88320
+//
+static const __u32 Ch10Crc32Table[256] = {
+    0x00000000U, 0x77073096U, 0xEE0E612CU, 0x990951BAU,
+    0x076DC419U, 0x706AF48FU, 0xE963A535U, 0x9E6495A3U,
+    0x0EDB8832U, 0x79DCB8A4U, 0xE0D5E91EU, 0x97D2D988U,
+    0x09B64C2BU, 0x7EB17CBDU, 0xE7B82D07U, 0x90BF1D91U,
+    0x1DB71064U, 0x6AB020F2U, 0xF3B97148U, 0x84BE41DEU,
+    0x1ADAD47DU, 0x6DDDE4EBU, 0xF4D4B551U, 0x83D385C7U,
+    0x136C9856U, 0x646BA8C0U, 0xFD62F97AU, 0x8A65C9ECU,
+    0x14015C4FU, 0x63066CD9U, 0xFA0F3D63U, 0x8D080DF5U,
+    0x3B6E20C8U, 0x4C69105EU, 0xD56041E4U, 0xA2677172U,
+    0x3C03E4D1U, 0x4B04D447U, 0xD20D85FDU, 0xA50AB56BU,
+    0x35B5A8FAU, 0x42B2986CU, 0xDBBBC9D6U, 0xACBCF940U,
+    0x32D86CE3U, 0x45DF5C75U, 0xDCD60DCFU, 0xABD13D59U,
+    0x26D930ACU, 0x51DE003AU, 0xC8D75180U, 0xBFD06116U,
+    0x21B4F4B5U, 0x56B3C423U, 0xCFBA9599U, 0xB8BDA50FU,
+    0x2802B89EU, 0x5F058808U, 0xC60CD9B2U, 0xB10BE924U,
+    0x2F6F7C87U, 0x58684C11U, 0xC1611DABU, 0xB6662D3DU,
+    0x76DC4190U, 0x01DB7106U, 0x98D220BCU, 0xEFD5102AU,
+    0x71B18589U, 0x06B6B51FU, 0x9FBFE4A5U, 0xE8B8D433U,
+    0x7807C9A2U, 0x0F00F934U, 0x9609A88EU, 0xE10E9818U,
+    0x7F6A0DBBU, 0x086D3D2DU, 0x91646C97U, 0xE6635C01U,
+    0x6B6B51F4U, 0x1C6C6162U, 0x856530D8U, 0xF262004EU,
+    0x6C0695EDU, 0x1B01A57BU, 0x8208F4C1U, 0xF50FC457U,
+    0x65B0D9C6U, 0x12B7E950U, 0x8BBEB8EAU, 0xFCB9887CU,
+    0x62DD1DDFU, 0x15DA2D49U, 0x8CD37CF3U, 0xFBD44C65U,
+    0x4DB26158U, 0x3AB551CEU, 0xA3BC0074U, 0xD4BB30E2U,
+    0x4ADFA541U, 0x3DD895D7U, 0xA4D1C46DU, 0xD3D6F4FBU,
+    0x4369E96AU, 0x346ED9FCU, 0xAD678846U, 0xDA60B8D0U,
+    0x44042D73U, 0x33031DE5U, 0xAA0A4C5FU, 0xDD0D7CC9U,
+    0x5005713CU, 0x270241AAU, 0xBE0B1010U, 0xC90C2086U,
+    0x5768B525U, 0x206F85B3U, 0xB966D409U, 0xCE61E49FU,
+    0x5EDEF90EU, 0x29D9C998U, 0xB0D09822U, 0xC7D7A8B4U,
+    0x59B33D17U, 0x2EB40D81U, 0xB7BD5C3BU, 0xC0BA6CADU,
+    0xEDB88320U, 0x9ABFB3B6U, 0x03B6E20CU, 0x74B1D29AU,
+    0xEAD54739U, 0x9DD277AFU, 0x04DB2615U, 0x73DC1683U,
+    0xE3630B12U, 0x94643B84U, 0x0D6D6A3EU, 0x7A6A5AA8U,
+    0xE40ECF0BU, 0x9309FF9DU, 0x0A00AE27U, 0x7D079EB1U,
+    0xF00F9344U, 0x8708A3D2U, 0x1E01F268U, 0x6906C2FEU,
+    0xF762575DU, 0x806567CBU, 0x196C3671U, 0x6E6B06E7U,
+    0xFED41B76U, 0x89D32BE0U, 0x10DA7A5AU, 0x67DD4ACCU,
+    0xF9B9DF6FU, 0x8EBEEFF9U, 0x17B7BE43U, 0x60B08ED5U,
+    0xD6D6A3E8U, 0xA1D1937EU, 0x38D8C2C4U, 0x4FDFF252U,
+    0xD1BB67F1U, 0xA6BC5767U, 0x3FB506DDU, 0x48B2364BU,
+    0xD80D2BDAU, 0xAF0A1B4CU, 0x36034AF6U, 0x41047A60U,
+    0xDF60EFC3U, 0xA867DF55U, 0x316E8EEFU, 0x4669BE79U,
+    0xCB61B38CU, 0xBC66831AU, 0x256FD2A0U, 0x5268E236U,
+    0xCC0C7795U, 0xBB0B4703U, 0x220216B9U, 0x5505262FU,
+    0xC5BA3BBEU, 0xB2BD0B28U, 0x2BB45A92U, 0x5CB36A04U,
+    0xC2D7FFA7U, 0xB5D0CF31U, 0x2CD99E8BU, 0x5BDEAE1DU,
+    0x9B64C2B0U, 0xEC63F226U, 0x756AA39CU, 0x026D930AU,
+    0x9C0906A9U, 0xEB0E363FU, 0x72076785U, 0x05005713U,
+    0x95BF4A82U, 0xE2B87A14U, 0x7BB12BAEU, 0x0CB61B38U,
+    0x92D28E9BU, 0xE5D5BE0DU, 0x7CDCEFB7U, 0x0BDBDF21U,
+    0x86D3D2D4U, 0xF1D4E242U, 0x68DDB3F8U, 0x1FDA836EU,
+    0x81BE16CDU, 0xF6B9265BU, 0x6FB077E1U, 0x18B74777U,
+    0x88085AE6U, 0xFF0F6A70U, 0x66063BCAU, 0x11010B5CU,
+    0x8F659EFFU, 0xF862AE69U, 0x616BFFD3U, 0x166CCF45U,
+    0xA00AE278U, 0xD70DD2EEU, 0x4E048354U, 0x3903B3C2U,
+    0xA7672661U, 0xD06016F7U, 0x4969474DU, 0x3E6E77DBU,
+    0xAED16A4AU, 0xD9D65ADCU, 0x40DF0B66U, 0x37D83BF0U,
+    0xA9BCAE53U, 0xDEBB9EC5U, 0x47B2CF7FU, 0x30B5FFE9U,
+    0xBDBDF21CU, 0xCABAC28AU, 0x53B39330U, 0x24B4A3A6U,
+    0xBAD03605U, 0xCDD70693U, 0x54DE5729U, 0x23D967BFU,
+    0xB3667A2EU, 0xC4614AB8U, 0x5D681B02U, 0x2A6F2B94U,
+    0xB40BBE37U, 0xC30C8EA1U, 0x5A05DF1BU, 0x2D02EF8DU,
+};
+
+//
+// An analog subchannel of the recording being scanned, with the finest
+// level of its pyramid and the summary being filled
+//
+typedef struct _CH10_ANALOG_BUILDER {
+    __u16                       ChannelId;
+    __u8                        Subchannel;
+    __u64                       SampleCount;
+    __u64                       FirstRtc;
+    __u64                       LastRtc;
+    __u64                       LastSample;
+    struct ch10_index_summary   *Summaries;
+    __u64                       SummaryCount;
+    __u64                       SummaryCapacity;
+    __s32                       Min;
+    __s32                       Max;
+    __s64                       Sum;
+} CH10_ANALOG_BUILDER;
+
+//
+// Records collected while an index is built
+//
+typedef struct _CH10_INDEX_BUILDER {
+    struct ch10_index_file      *Files;
+    struct ch10_index_packet    *Packets;
+    __u64                       PacketCount;
+    __u64                       PacketCapacity;
+    struct ch10_index_time      *Times;
+    __u64                       TimeCount;
+    __u64                       TimeCapacity;
+    struct ch10_index_analog    *Analog;
+    __u64                       AnalogCount;
+    __u64                       AnalogCapacity;
+    struct ch10_index_summary   *Summaries;
+    __u64                       SummaryCount;
+    __u64                       SummaryCapacity;
+    CH10_ANALOG_BUILDER         *Channels;      // of the recording being scanned
+    __u64                       ChannelCount;
+    __u64                       ChannelCapacity;
+    __s16                       *Samples;
+    __u32                       FileIndex;      // recording being scanned
+} CH10_INDEX_BUILDER;
+
+__u32
+Ch10Crc32 (
+    __u32       Crc,
+    const void  *Buffer,
+    size_t      Length
+    )
+{
+    const __u8 *Bytes = (const __u8 *) Buffer;
+
+    Crc = ~Crc;
+
+    while (Length--)
+    {
+        Crc = Ch10Crc32Table[(Crc ^ *Bytes++) & 0xff] ^ (Crc >> 8);
+    }
+
+    return ~Crc;
+}
+
+//
+// FNV-1a 64 over the directory blocks in link order. The driver computes
+// the same value from its copy of the chain to find a sidecar. The blocks
+// of the other members of a striped set follow in member order, so a set
+// and its first member mounted alone do not share a sidecar.
+//
+__u64
+Ch10VolumeFingerprint (
+    CH10_VOLUME *Volume
+    )
+{
+    const __u8  *Bytes;
+    size_t      Length;
+    __u64       Hash = CH10_FNV64_BASIS;
+    __u32       Member;
+
+    for (Member = 0; Member < Volume->MemberCount; Member++)
+    {
+        Bytes = (const __u8 *) Volume->Members[Member]->DirBlocks;
+        Length = Volume->Members[Member]->DirBlockCount * sizeof(struct ch10_dir_block);
+
+        while (Length--)
+        {
+            Hash ^= *Bytes++;
+            Hash *= CH10_FNV64_PRIME;
+        }
+    }
+
+    return Hash;
+}
+
+//
+// The sidecar of an image is the image path with CH10_INDEX_SUFFIX, that
+// of a striped set is next to the first member path given
+//
+char *
+Ch10GetIndexPath (
+    const char      *Path
+    )
+{
+    const char  *Separator = strchr(Path, CH10_MEMBER_SEPARATOR);
+    size_t      Length = Separator ? (size_t) (Separator - Path) : strlen(Path);
+    char        *IndexPath;
+
+    IndexPath = malloc(Length + sizeof(CH10_INDEX_SUFFIX));
+
+    if (IndexPath)
+    {
+        memcpy(IndexPath, Path, Length);
+        memcpy(IndexPath + Length, CH10_INDEX_SUFFIX, sizeof(CH10_INDEX_SUFFIX));
+    }
+
+    return IndexPath;
+}
+
+static int
+Ch10GrowArray (
+    void        **Array,
+    __u64       *Capacity,
+    size_t      RecordSize
+    )
+{
+    __u64   NewCapacity = *Capacity ? *Capacity * 2 : 4096;
+    void    *NewArray;
+
+    if (NewCapacity * RecordSize != (size_t) (NewCapacity * RecordSize))
+    {
+        return -ENOMEM;
+    }
+
+    NewArray = realloc(*Array, (size_t) (NewCapacity * RecordSize));
+
+    if (NewArray == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    *Array = NewArray;
+    *Capacity = NewCapacity;
+
+    return 0;
+}
+
+//
+// Samples a level 0 summary of the pyramid covers, or one of the level
+// above it two of them
+//
+static __u64
+Ch10SummarySamples (
+    __u64       SampleCount,
+    __u32       Shift,
+    __u64       Record
+    )
+{
+    __u64 First = Record << Shift;
+
+    return SampleCount - First < (1ULL << Shift) ? SampleCount - First : 1ULL << Shift;
+}
+
+static void
+Ch10MergeSummary (
+    struct ch10_index_summary       *Summary,
+    __u64                           *Samples,
+    const struct ch10_index_summary *Other,
+    __u64                           OtherSamples
+    )
+{
+    __s64 Mean;
+
+    if (*Samples == 0)
+    {
+        *Summary = *Other;
+        *Samples = OtherSamples;
+        return;
+    }
+
+    Mean = ((__s64) (__s16) le16_to_cpu(Summary->mean) * (__s64) *Samples +
+            (__s64) (__s16) le16_to_cpu(Other->mean) * (__s64) OtherSamples);
+    *Samples += OtherSamples;
+
+    if ((__s16) le16_to_cpu(Other->min) < (__s16) le16_to_cpu(Summary->min))
+    {
+        Summary->min = Other->min;
+    }
+
+    if ((__s16) le16_to_cpu(Other->max) > (__s16) le16_to_cpu(Summary->max))
+    {
+        Summary->max = Other->max;
+    }
+
+    Summary->mean = cpu_to_le16((__u16) (__s16) ((Mean + (Mean < 0 ? -1 : 1) * (__s64) (*Samples / 2)) /
+                                                 (__s64) *Samples));
+}
+
+//
+// Closes the summary being filled
+//
+static int
+Ch10FlushSummary (
+    CH10_ANALOG_BUILDER *Channel
+    )
+{
+    struct ch10_index_summary   *Summary;
+    __s64                       Count = (__s64) (Channel->SampleCount -
+                                                 (Channel->SummaryCount << CH10_INDEX_SUMMARY_SHIFT));
+    int                         Status;
+
+    if (Count == 0)
+    {
+        return 0;
+    }
+
+    if (Channel->SummaryCount == Channel->SummaryCapacity)
+    {
+        Status = Ch10GrowArray(
+            (void **) &Channel->Summaries,
+            &Channel->SummaryCapacity,
+            sizeof(struct ch10_index_summary)
+            );
+
+        if (Status)
+        {
+            return Status;
+        }
+    }
+
+    Summary = &Channel->Summaries[Channel->SummaryCount++];
+
+    Summary->min = cpu_to_le16((__u16) (__s16) Channel->Min);
+    Summary->max = cpu_to_le16((__u16) (__s16) Channel->Max);
+    Summary->mean = cpu_to_le16((__u16) (__s16) ((Channel->Sum + (Channel->Sum < 0 ? -1 : 1) * (Count / 2)) / Count));
+    Summary->reserved = 0;
+
+    Channel->Sum = 0;
+
+    return 0;
+}
+
+//
+// Adds the samples of an analog packet to the finest levels of the
+// pyramids of its subchannels. Formats Ch10DecodeAnalog does not take are
+// left out of the index.
+//
+static int
+Ch10IndexAnalog (
+    CH10_INDEX_BUILDER              *Builder,
+    const struct ch10_packet_header *Header,
+    __u64                           Rtc
+    )
+{
+    CH10_ANALOG_BUILDER *Channel;
+    __u32               Subchannels;
+    __u32               Subchannel;
+    __u64               Number;
+    int                 Count;
+    int                 Index;
+    int                 Status;
+
+    if (Builder->Samples == NULL)
+    {
+        Builder->Samples = malloc(CH10_MAX_PACKET_SIZE);
+
+        if (Builder->Samples == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    Count = Ch10DecodeAnalog(Header, Builder->Samples, CH10_MAX_PACKET_SIZE / sizeof(__s16), &Subchannels);
+
+    if (Count <= 0)
+    {
+        return 0;
+    }
+
+    for (Subchannel = 0; Subchannel < Subchannels && (int) Subchannel < Count; Subchannel++)
+    {
+        for (Number = 0; Number < Builder->ChannelCount; Number++)
+        {
+            if (Builder->Channels[Number].ChannelId == le16_to_cpu(Header->channelId) &&
+                Builder->Channels[Number].Subchannel == Subchannel)
+            {
+                break;
+            }
+        }
+
+        if (Number == Builder->ChannelCount)
+        {
+            if (Builder->ChannelCount == Builder->ChannelCapacity)
+            {
+                Status = Ch10GrowArray(
+                    (void **) &Builder->Channels,
+                    &Builder->ChannelCapacity,
+                    sizeof(CH10_ANALOG_BUILDER)
+                    );
+
+                if (Status)
+                {
+                    return Status;
+                }
+            }
+
+            Channel = &Builder->Channels[Builder->ChannelCount++];
+
+            memset(Channel, 0, sizeof(CH10_ANALOG_BUILDER));
+
+            Channel->ChannelId = le16_to_cpu(Header->channelId);
+            Channel->Subchannel = (__u8) Subchannel;
+            Channel->FirstRtc = Rtc;
+        }
+
+        Channel = &Builder->Channels[Number];
+
+        Channel->LastRtc = Rtc;
+        Channel->LastSample = Channel->SampleCount;
+
+        for (Index = (int) Subchannel; Index < Count; Index += (int) Subchannels)
+        {
+            if ((Channel->SampleCount & ((1ULL << CH10_INDEX_SUMMARY_SHIFT) - 1)) == 0)
+            {
+                Channel->Min = Builder->Samples[Index];
+                Channel->Max = Builder->Samples[Index];
+            }
+            else if (Builder->Samples[Index] < Channel->Min)
+            {
+                Channel->Min = Builder->Samples[Index];
+            }
+            else if (Builder->Samples[Index] > Channel->Max)
+            {
+                Channel->Max = Builder->Samples[Index];
+            }
+
+            Channel->Sum += Builder->Samples[Index];
+            Channel->SampleCount++;
+
+            if ((Channel->SampleCount & ((1ULL << CH10_INDEX_SUMMARY_SHIFT) - 1)) == 0)
+            {
+                Status = Ch10FlushSummary(Channel);
+
+                if (Status)
+                {
+                    return Status;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+//
+// Builds the coarser levels of the pyramids of a scanned recording and
+// moves them to the sidecar records
+//
+static int
+Ch10FinishAnalog (
+    CH10_INDEX_BUILDER  *Builder
+    )
+{
+    CH10_ANALOG_BUILDER         *Channel;
+    struct ch10_index_analog    *Analog;
+    struct ch10_index_summary   *Level;
+    __u64                       LevelCount;
+    __u64                       Total;
+    __u64                       Record;
+    __u64                       Samples;
+    __u64                       Number;
+    __u32                       Shift;
+    __u8                        Levels;
+    int                         Status = 0;
+
+    for (Number = 0; Number < Builder->ChannelCount && !Status; Number++)
+    {
+        Channel = &Builder->Channels[Number];
+
+        Status = Ch10FlushSummary(Channel);
+
+        if (Status || Channel->SummaryCount == 0)
+        {
+            continue;
+        }
+
+        //
+        // Every level has half the records of the one below, rounded up
+        //
+        for (Total = 0, Levels = 0, LevelCount = Channel->SummaryCount; ; LevelCount = (LevelCount + 1) / 2)
+        {
+            Total += LevelCount;
+            Levels++;
+
+            if (LevelCount == 1)
+            {
+                break;
+            }
+        }
+
+        while (!Status && Builder->SummaryCount + Total > Builder->SummaryCapacity)
+        {
+            Status = Ch10GrowArray(
+                (void **) &Builder->Summaries,
+                &Builder->SummaryCapacity,
+                sizeof(struct ch10_index_summary)
+                );
+        }
+
+        if (!Status && Builder->AnalogCount == Builder->AnalogCapacity)
+        {
+            Status = Ch10GrowArray(
+                (void **) &Builder->Analog,
+                &Builder->AnalogCapacity,
+                sizeof(struct ch10_index_analog)
+                );
+        }
+
+        if (Status)
+        {
+            continue;
+        }
+
+        Analog = &Builder->Analog[Builder->AnalogCount++];
+
+        memset(Analog, 0, sizeof(struct ch10_index_analog));
+
+        Analog->firstSummary = cpu_to_le64(Builder->SummaryCount);
+        Analog->sampleCount = cpu_to_le64(Channel->SampleCount);
+        Analog->firstRtc = cpu_to_le64(Channel->FirstRtc);
+        Analog->lastRtc = cpu_to_le64(Channel->LastRtc);
+        Analog->lastSample = cpu_to_le64(Channel->LastSample);
+        Analog->fileIndex = cpu_to_le32(Builder->FileIndex);
+        Analog->channelId = cpu_to_le16(Channel->ChannelId);
+        Analog->subchannel = Channel->Subchannel;
+        Analog->levelCount = Levels;
+        Analog->baseShift = CH10_INDEX_SUMMARY_SHIFT;
+
+        Level = Builder->Summaries + Builder->SummaryCount;
+
+        memcpy(Level, Channel->Summaries, (size_t) Channel->SummaryCount * sizeof(struct ch10_index_summary));
+
+        for (LevelCount = Channel->SummaryCount, Shift = CH10_INDEX_SUMMARY_SHIFT;
+             LevelCount > 1;
+             Level += LevelCount, LevelCount = (LevelCount + 1) / 2, Shift++)
+        {
+            for (Record = 0; Record < LevelCount; Record += 2)
+            {
+                Level[LevelCount + Record / 2] = Level[Record];
+                Samples = Ch10SummarySamples(Channel->SampleCount, Shift, Record);
+
+                if (Record + 1 < LevelCount)
+                {
+                    Ch10MergeSummary(
+                        &Level[LevelCount + Record / 2],
+                        &Samples,
+                        &Level[Record + 1],
+                        Ch10SummarySamples(Channel->SampleCount, Shift, Record + 1)
+                        );
+                }
+            }
+        }
+
+        Builder->SummaryCount += Total;
+    }
+
+    for (Number = 0; Number < Builder->ChannelCount; Number++)
+    {
+        free(Builder->Channels[Number].Summaries);
+    }
+
+    Builder->ChannelCount = 0;
+
+    return Status;
+}
+
+static int
+Ch10IndexPacket (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    CH10_INDEX_BUILDER          *Builder = (CH10_INDEX_BUILDER *) Context;
+    struct ch10_index_packet    *Packet;
+    struct ch10_index_time      *Time;
+    __u64                       Rtc = Ch10GetRtc(Header);
+    int                         Status;
+
+    if (Builder->PacketCount == Builder->PacketCapacity)
+    {
+        Status = Ch10GrowArray(
+            (void **) &Builder->Packets,
+            &Builder->PacketCapacity,
+            sizeof(struct ch10_index_packet)
+            );
+
+        if (Status)
+        {
+            return Status;
+        }
+    }
+
+    if (Header->dataType == CH10_DATA_TIME_F1)
+    {
+        if (Builder->TimeCount == Builder->TimeCapacity)
+        {
+            Status = Ch10GrowArray(
+                (void **) &Builder->Times,
+                &Builder->TimeCapacity,
+                sizeof(struct ch10_index_time)
+                );
+
+            if (Status)
+            {
+                return Status;
+            }
+        }
+
+        Time = &Builder->Times[Builder->TimeCount++];
+
+        Time->rtc = cpu_to_le64(Rtc);
+        Time->packet = cpu_to_le64(Builder->PacketCount);
+        Time->fileIndex = cpu_to_le32(Builder->FileIndex);
+        Time->reserved = 0;
+    }
+
+    if (Header->dataType == CH10_DATA_ANALOG_F1)
+    {
+        Status = Ch10IndexAnalog(Builder, Header, Rtc);
+
+        if (Status)
+        {
+            return Status;
+        }
+    }
+
+    Packet = &Builder->Packets[Builder->PacketCount++];
+
+    Packet->offset = cpu_to_le64(Offset);
+    Packet->rtc = cpu_to_le64(Rtc);
+    Packet->packetLength = Header->packetLength;
+    Packet->channelId = Header->channelId;
+    Packet->dataType = Header->dataType;
+    Packet->packetFlags = Header->packetFlags;
+
+    return 0;
+}
+
+//
+// Collects the packets of a recording and sums it up
+//
+static int
+Ch10IndexFile (
+    CH10_VOLUME         *Volume,
+    CH10_INDEX_BUILDER  *Builder,
+    __u32               FileIndex
+    )
+{
+    CH10_FILE                       *File = &Volume->Files[FileIndex];
+    struct ch10_index_file          *Entry = &Builder->Files[FileIndex];
+    __u64                           FirstPacket = Builder->PacketCount;
+    __u64                           Skipped = 0;
+    int                             Status;
+
+    Builder->FileIndex = FileIndex;
+
+    Status = Ch10ScanFile(Volume, FileIndex, Ch10IndexPacket, Builder, &Skipped);
+
+    if (!Status)
+    {
+        Status = Ch10FinishAnalog(Builder);
+    }
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    Entry->size = cpu_to_le64(File->Size);
+    Entry->firstPacket = cpu_to_le64(FirstPacket);
+    Entry->packetCount = cpu_to_le64(Builder->PacketCount - FirstPacket);
+    Entry->skippedBytes = cpu_to_le64(Skipped);
+    Entry->dirEntry = cpu_to_le32(File->DirEntryIndex);
+    Entry->nameHash = cpu_to_le32(Ch10HashFileName(File->Name));
+
+    if (Builder->PacketCount > FirstPacket)
+    {
+        Entry->firstRtc = Builder->Packets[FirstPacket].rtc;
+        Entry->lastRtc = Builder->Packets[Builder->PacketCount - 1].rtc;
+    }
+
+    return 0;
+}
+
+static int
+Ch10CompareTimes (
+    const void *First,
+    const void *Second
+    )
+{
+    const struct ch10_index_time *A = First;
+    const struct ch10_index_time *B = Second;
+
+    if (le64_to_cpu(A->rtc) != le64_to_cpu(B->rtc))
+    {
+        return le64_to_cpu(A->rtc) < le64_to_cpu(B->rtc) ? -1 : 1;
+    }
+
+    if (le64_to_cpu(A->packet) != le64_to_cpu(B->packet))
+    {
+        return le64_to_cpu(A->packet) < le64_to_cpu(B->packet) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int
+Ch10WriteFully (
+    int         Fd,
+    const void  *Buffer,
+    size_t      Length
+    )
+{
+    size_t  Done = 0;
+    ssize_t Result;
+
+    while (Done < Length)
+    {
+        Result = write(Fd, (const char *) Buffer + Done, Length - Done);
+
+        if (Result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -errno;
+        }
+
+        Done += Result;
+    }
+
+    return 0;
+}
+
+//
+// Adds a section after the ones already laid out
+//
+static void
+Ch10AddSection (
+    struct ch10_index_header    *Header,
+    __u64                       *End,
+    __u32                       Type,
+    const void                  *Data,
+    __u64                       Count,
+    size_t                      RecordSize
+    )
+{
+    struct ch10_index_section *Section = &Header->sections[le32_to_cpu(Header->sectionCount)];
+
+    *End = (*End + CH10_INDEX_ALIGN - 1) & ~(__u64) (CH10_INDEX_ALIGN - 1);
+
+    Section->type = cpu_to_le32(Type);
+    Section->offset = cpu_to_le64(*End);
+    Section->length = cpu_to_le64(Count * RecordSize);
+    Section->count = cpu_to_le64(Count);
+    Section->checksum = cpu_to_le32(Ch10Crc32(0, Data, (size_t) (Count * RecordSize)));
+
+    *End += Count * RecordSize;
+
+    Header->sectionCount = cpu_to_le32(le32_to_cpu(Header->sectionCount) + 1);
+}
+
+//
+// Scans every recording and writes the sidecar to Path. The file is built
+// under a temporary name and renamed over Path, so a reader never maps a
+// half written index.
+//
+int
+Ch10WriteIndex (
+    CH10_VOLUME     *Volume,
+    const char      *Path
+    )
+{
+    static const __u8           Padding[CH10_INDEX_ALIGN];
+    CH10_INDEX_BUILDER          Builder;
+    struct ch10_index_header    Header;
+    const void                  *Data[CH10_INDEX_MAX_SECTIONS];
+    char                        *TempPath;
+    __u32                       *Names;
+    __u32                       Slot;
+    __u32                       FileIndex;
+    __u32                       Index;
+    __u64                       End;
+    __u64                       Position;
+    int                         Fd = -1;
+    int                         Status = 0;
+
+    memset(&Builder, 0, sizeof(Builder));
+    memset(&Header, 0, sizeof(Header));
+
+    TempPath = malloc(strlen(Path) + sizeof(".tmp"));
+    Builder.Files = calloc(Volume->FileCount ? Volume->FileCount : 1, sizeof(struct ch10_index_file));
+    Names = calloc(Volume->NameIndexMask + 1, sizeof(__u32));
+
+    if (TempPath == NULL || Builder.Files == NULL || Names == NULL)
+    {
+        Status = -ENOMEM;
+        goto Done;
+    }
+
+    for (FileIndex = 0; FileIndex < Volume->FileCount && !Status; FileIndex++)
+    {
+        Status = Ch10IndexFile(Volume, &Builder, FileIndex);
+    }
+
+    if (Status)
+    {
+        goto Done;
+    }
+
+    qsort(Builder.Times, (size_t) Builder.TimeCount, sizeof(struct ch10_index_time), Ch10CompareTimes);
+
+    for (Slot = 0; Slot <= Volume->NameIndexMask; Slot++)
+    {
+        Names[Slot] = cpu_to_le32(Volume->NameIndex[Slot]);
+    }
+
+    memcpy(Header.magic, CH10_INDEX_MAGIC, sizeof(CH10_INDEX_MAGIC));
+    Header.version = cpu_to_le32(CH10_INDEX_VERSION);
+    Header.headerSize = cpu_to_le32(sizeof(Header));
+    Header.fingerprint = cpu_to_le64(Ch10VolumeFingerprint(Volume));
+    Header.bytesPerBlock = cpu_to_le32(Volume->BytesPerBlock);
+    Header.fileCount = cpu_to_le32(Volume->FileCount);
+
+    End = sizeof(Header);
+
+    Data[0] = Names;
+    Ch10AddSection(&Header, &End, CH10_INDEX_NAMES, Names, Volume->NameIndexMask + 1, sizeof(__u32));
+
+    Data[1] = Builder.Files;
+    Ch10AddSection(&Header, &End, CH10_INDEX_FILES, Builder.Files, Volume->FileCount, sizeof(struct ch10_index_file));
+
+    Data[2] = Builder.Packets;
+    Ch10AddSection(&Header, &End, CH10_INDEX_PACKETS, Builder.Packets, Builder.PacketCount, sizeof(struct ch10_index_packet));
+
+    Data[3] = Builder.Times;
+    Ch10AddSection(&Header, &End, CH10_INDEX_TIMES, Builder.Times, Builder.TimeCount, sizeof(struct ch10_index_time));
+
+    Data[4] = Builder.Analog;
+    Ch10AddSection(&Header, &End, CH10_INDEX_ANALOG, Builder.Analog, Builder.AnalogCount, sizeof(struct ch10_index_analog));
+
+    Data[5] = Builder.Summaries;
+    Ch10AddSection(&Header, &End, CH10_INDEX_SUMMARIES, Builder.Summaries, Builder.SummaryCount, sizeof(struct ch10_index_summary));
+
+    Header.fileSize = cpu_to_le64(End);
+    Header.headerChecksum = cpu_to_le32(Ch10Crc32(0, &Header, sizeof(Header)));
+
+    strcpy(TempPath, Path);
+    strcat(TempPath, ".tmp");
+
+    Fd = open(TempPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (Fd < 0)
+    {
+        Status = -errno;
+        goto Done;
+    }
+
+    Status = Ch10WriteFully(Fd, &Header, sizeof(Header));
+    Position = sizeof(Header);
+
+    for (Index = 0; Index < le32_to_cpu(Header.sectionCount) && !Status; Index++)
+    {
+        Status = Ch10WriteFully(
+            Fd,
+            Padding,
+            (size_t) (le64_to_cpu(Header.sections[Index].offset) - Position)
+            );
+
+        if (!Status)
+        {
+            Status = Ch10WriteFully(
+                Fd,
+                Data[Index],
+                (size_t) le64_to_cpu(Header.sections[Index].length)
+                );
+        }
+
+        Position = le64_to_cpu(Header.sections[Index].offset) +
+            le64_to_cpu(Header.sections[Index].length);
+    }
+
+    if (!Status && fsync(Fd))
+    {
+        Status = -errno;
+    }
+
+    if (close(Fd) && !Status)
+    {
+        Status = -errno;
+    }
+
+    if (!Status && rename(TempPath, Path))
+    {
+        Status = -errno;
+    }
+
+    if (Status)
+    {
+        unlink(TempPath);
+    }
+
+Done:
+    free(Names);
+    free(TempPath);
+    free(Builder.Files);
+    free(Builder.Packets);
+    free(Builder.Times);
+    free(Builder.Analog);
+    free(Builder.Summaries);
+    free(Builder.Samples);
+
+    for (Index = 0; Index < Builder.ChannelCount; Index++)
+    {
+        free(Builder.Channels[Index].Summaries);
+    }
+
+    free(Builder.Channels);
+
+    return Status;
+}
+
+static const struct ch10_index_section *
+Ch10FindSection (
+    const struct ch10_index_header  *Header,
+    __u32                           Type
+    )
+{
+    __u32 Index;
+
+    for (Index = 0; Index < le32_to_cpu(Header->sectionCount); Index++)
+    {
+        if (le32_to_cpu(Header->sections[Index].type) == Type)
+        {
+            return &Header->sections[Index];
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Checks the header, the section table and the small sections against the
+// volume. Returns -ESTALE for an index of another volume or of an earlier
+// state of this one and -EBADMSG for a damaged one.
+//
+static int
+Ch10ValidateIndex (
+    CH10_VOLUME     *Volume,
+    CH10_INDEX      *Index
+    )
+{
+    static const size_t RecordSizes[] = {
+        0,
+        sizeof(__u32),
+        sizeof(struct ch10_index_file),
+        sizeof(struct ch10_index_packet),
+        sizeof(struct ch10_index_time),
+        sizeof(struct ch10_index_analog),
+        sizeof(struct ch10_index_summary)
+    };
+    struct ch10_index_header        Header;
+    const struct ch10_index_section *Section;
+    const struct ch10_index_section *Names;
+    const struct ch10_index_section *Files;
+    const struct ch10_index_section *Packets;
+    const struct ch10_index_section *Times;
+    const struct ch10_index_section *Analog;
+    const struct ch10_index_section *Summaries;
+    const __u32                     *Slots;
+    __u64                           Offset;
+    __u64                           Length;
+    __u64                           Used = 0;
+    __u32                           Type;
+    __u32                           Slot;
+    __u32                           FileIndex;
+
+    if (Index->Length < sizeof(Header))
+    {
+        return -EBADMSG;
+    }
+
+    memcpy(&Header, Index->Map, sizeof(Header));
+
+    if (memcmp(Header.magic, CH10_INDEX_MAGIC, sizeof(CH10_INDEX_MAGIC)))
+    {
+        return -EBADMSG;
+    }
+
+    if (le32_to_cpu(Header.version) != CH10_INDEX_VERSION ||
+        le32_to_cpu(Header.headerSize) != sizeof(Header))
+    {
+        return -EPROTONOSUPPORT;
+    }
+
+    Header.headerChecksum = 0;
+
+    if (Ch10Crc32(0, &Header, sizeof(Header)) != le32_to_cpu(Index->Header->headerChecksum) ||
+        le64_to_cpu(Header.fileSize) != Index->Length ||
+        le32_to_cpu(Header.sectionCount) > CH10_INDEX_MAX_SECTIONS)
+    {
+        return -EBADMSG;
+    }
+
+    if (le64_to_cpu(Header.fingerprint) != Ch10VolumeFingerprint(Volume) ||
+        le32_to_cpu(Header.bytesPerBlock) != Volume->BytesPerBlock ||
+        le32_to_cpu(Header.fileCount) != Volume->FileCount)
+    {
+        return -ESTALE;
+    }
+
+    for (Section = Header.sections;
+         Section < Header.sections + le32_to_cpu(Header.sectionCount);
+         Section++)
+    {
+        Type = le32_to_cpu(Section->type);
+        Offset = le64_to_cpu(Section->offset);
+        Length = le64_to_cpu(Section->length);
+
+        if (Offset & (CH10_INDEX_ALIGN - 1) ||
+            Offset < sizeof(Header) ||
+            Offset > Index->Length ||
+            Length > Index->Length - Offset)
+        {
+            return -EBADMSG;
+        }
+
+        if (Type > 0 && Type < sizeof(RecordSizes) / sizeof(RecordSizes[0]) &&
+            (le64_to_cpu(Section->count) > Length ||
+             Length != le64_to_cpu(Section->count) * RecordSizes[Type]))
+        {
+            return -EBADMSG;
+        }
+    }
+
+    Names = Ch10FindSection(Index->Header, CH10_INDEX_NAMES);
+    Files = Ch10FindSection(Index->Header, CH10_INDEX_FILES);
+    Packets = Ch10FindSection(Index->Header, CH10_INDEX_PACKETS);
+    Times = Ch10FindSection(Index->Header, CH10_INDEX_TIMES);
+    Analog = Ch10FindSection(Index->Header, CH10_INDEX_ANALOG);
+    Summaries = Ch10FindSection(Index->Header, CH10_INDEX_SUMMARIES);
+
+    if (Names == NULL || Files == NULL ||
+        le64_to_cpu(Files->count) != Volume->FileCount)
+    {
+        return -EBADMSG;
+    }
+
+    //
+    // A power of two number of slots with at least one left empty, so a
+    // lookup always ends
+    //
+    Length = le64_to_cpu(Names->count);
+
+    if (Length <= Volume->FileCount || Length > 0x80000000U || (Length & (Length - 1)))
+    {
+        return -EBADMSG;
+    }
+
+    if (Ch10Crc32(0, Index->Map + le64_to_cpu(Names->offset), (size_t) le64_to_cpu(Names->length)) !=
+            le32_to_cpu(Names->checksum) ||
+        Ch10Crc32(0, Index->Map + le64_to_cpu(Files->offset), (size_t) le64_to_cpu(Files->length)) !=
+            le32_to_cpu(Files->checksum))
+    {
+        return -EBADMSG;
+    }
+
+    Slots = (const __u32 *) (Index->Map + le64_to_cpu(Names->offset));
+
+    for (Slot = 0; Slot < Length; Slot++)
+    {
+        if (le32_to_cpu(Slots[Slot]) > Volume->FileCount)
+        {
+            return -EBADMSG;
+        }
+
+        Used += Slots[Slot] != 0;
+    }
+
+    if (Used > Volume->FileCount)
+    {
+        return -EBADMSG;
+    }
+
+    Index->Files = (const struct ch10_index_file *) (Index->Map + le64_to_cpu(Files->offset));
+
+    if (Packets)
+    {
+        Index->Packets = (const struct ch10_index_packet *) (Index->Map + le64_to_cpu(Packets->offset));
+        Index->PacketCount = le64_to_cpu(Packets->count);
+    }
+
+    if (Times)
+    {
+        Index->Times = (const struct ch10_index_time *) (Index->Map + le64_to_cpu(Times->offset));
+        Index->TimeCount = le64_to_cpu(Times->count);
+    }
+
+    if (Analog && Summaries)
+    {
+        Index->Analog = (const struct ch10_index_analog *) (Index->Map + le64_to_cpu(Analog->offset));
+        Index->AnalogCount = le64_to_cpu(Analog->count);
+        Index->Summaries = (const struct ch10_index_summary *) (Index->Map + le64_to_cpu(Summaries->offset));
+        Index->SummaryCount = le64_to_cpu(Summaries->count);
+    }
+
+    for (FileIndex = 0; FileIndex < Volume->FileCount; FileIndex++)
+    {
+        if (le64_to_cpu(Index->Files[FileIndex].size) != Volume->Files[FileIndex].Size ||
+            le32_to_cpu(Index->Files[FileIndex].dirEntry) != Volume->Files[FileIndex].DirEntryIndex ||
+            le64_to_cpu(Index->Files[FileIndex].firstPacket) > Index->PacketCount ||
+            le64_to_cpu(Index->Files[FileIndex].packetCount) >
+                Index->PacketCount - le64_to_cpu(Index->Files[FileIndex].firstPacket))
+        {
+            return -EBADMSG;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Maps the sidecar at Path and, when it matches the volume, makes it the
+// volume's index: lookups go through its name table from then on. The
+// packet and time sections are used in place without being read.
+//
+int
+Ch10OpenIndex (
+    CH10_VOLUME     *Volume,
+    const char      *Path
+    )
+{
+    const struct ch10_index_section *Names;
+    CH10_INDEX                      *Index;
+    struct stat                     Stat;
+    int                             Fd;
+    int                             Status;
+
+    //
+    // The name table is used as it is mapped
+    //
+    if (cpu_to_le32(1) != 1)
+    {
+        return -EOPNOTSUPP;
+    }
+
+    if (Volume->Index)
+    {
+        return -EBUSY;
+    }
+
+    Fd = open(Path, O_RDONLY);
+
+    if (Fd < 0)
+    {
+        return -errno;
+    }
+
+    if (fstat(Fd, &Stat))
+    {
+        Status = -errno;
+        close(Fd);
+        return Status;
+    }
+
+    if (Stat.st_size < (off_t) sizeof(struct ch10_index_header) ||
+        (__u64) Stat.st_size != (size_t) Stat.st_size)
+    {
+        close(Fd);
+        return -EBADMSG;
+    }
+
+    Index = calloc(1, sizeof(CH10_INDEX));
+
+    if (Index == NULL)
+    {
+        close(Fd);
+        return -ENOMEM;
+    }
+
+    Index->Length = (size_t) Stat.st_size;
+    Index->Map = mmap(NULL, Index->Length, PROT_READ, MAP_SHARED, Fd, 0);
+
+    close(Fd);
+
+    if (Index->Map == MAP_FAILED)
+    {
+        Status = -errno;
+        free(Index);
+        return Status;
+    }
+
+    Index->Header = (const struct ch10_index_header *) Index->Map;
+
+    Status = Ch10ValidateIndex(Volume, Index);
+
+    if (Status)
+    {
+        munmap((void *) Index->Map, Index->Length);
+        free(Index);
+        return Status;
+    }
+
+    Names = Ch10FindSection(Index->Header, CH10_INDEX_NAMES);
+
+    free(Volume->NameIndex);
+
+    Volume->NameIndex = (__u32 *) (Index->Map + le64_to_cpu(Names->offset));
+    Volume->NameIndexMask = (__u32) (le64_to_cpu(Names->count) - 1);
+    Volume->Index = Index;
+
+    return 0;
+}
+
+//
+// Called by Ch10DismountVolume
+//
+void
+Ch10CloseIndex (
+    CH10_VOLUME *Volume
+    )
+{
+    if (Volume->Index == NULL)
+    {
+        return;
+    }
+
+    munmap((void *) Volume->Index->Map, Volume->Index->Length);
+    free(Volume->Index);
+
+    Volume->Index = NULL;
+    Volume->NameIndex = NULL;
+}
+
+//
+// Checks the sections not checked when the index was opened: checksums,
+// packets lying within their recordings in order, times sorted and the
+// pyramids of the analog subchannels within the summaries
+//
+int
+Ch10CheckIndex (
+    CH10_VOLUME *Volume
+    )
+{
+    CH10_INDEX                      *Index = Volume->Index;
+    const struct ch10_index_section *Section;
+    const struct ch10_index_file    *File;
+    const struct ch10_index_packet  *Packet;
+    const struct ch10_index_analog  *Analog;
+    __u64                           Offset;
+    __u64                           PacketIndex;
+    __u64                           TimeIndex;
+    __u64                           AnalogIndex;
+    __u64                           Records;
+    __u64                           Total;
+    __u32                           FileIndex;
+    __u32                           Level;
+
+    if (Index == NULL)
+    {
+        return -ENOENT;
+    }
+
+    for (Section = Index->Header->sections;
+         Section < Index->Header->sections + le32_to_cpu(Index->Header->sectionCount);
+         Section++)
+    {
+        if (Ch10Crc32(0, Index->Map + le64_to_cpu(Section->offset), (size_t) le64_to_cpu(Section->length)) !=
+            le32_to_cpu(Section->checksum))
+        {
+            return -EBADMSG;
+        }
+    }
+
+    for (FileIndex = 0; FileIndex < Volume->FileCount; FileIndex++)
+    {
+        File = &Index->Files[FileIndex];
+        Offset = 0;
+
+        for (PacketIndex = le64_to_cpu(File->firstPacket);
+             PacketIndex < le64_to_cpu(File->firstPacket) + le64_to_cpu(File->packetCount);
+             PacketIndex++)
+        {
+            Packet = &Index->Packets[PacketIndex];
+
+            if (le64_to_cpu(Packet->offset) < Offset ||
+                le64_to_cpu(Packet->offset) + le32_to_cpu(Packet->packetLength) >
+                    Volume->Files[FileIndex].Size)
+            {
+                return -EBADMSG;
+            }
+
+            Offset = le64_to_cpu(Packet->offset) + le32_to_cpu(Packet->packetLength);
+        }
+    }
+
+    for (TimeIndex = 0; TimeIndex < Index->TimeCount; TimeIndex++)
+    {
+        if (le64_to_cpu(Index->Times[TimeIndex].packet) >= Index->PacketCount ||
+            le32_to_cpu(Index->Times[TimeIndex].fileIndex) >= Volume->FileCount ||
+            (TimeIndex > 0 &&
+             le64_to_cpu(Index->Times[TimeIndex].rtc) < le64_to_cpu(Index->Times[TimeIndex - 1].rtc)))
+        {
+            return -EBADMSG;
+        }
+    }
+
+    for (AnalogIndex = 0; AnalogIndex < Index->AnalogCount; AnalogIndex++)
+    {
+        Analog = &Index->Analog[AnalogIndex];
+
+        if (le32_to_cpu(Analog->fileIndex) >= Volume->FileCount ||
+            Analog->baseShift > 32 ||
+            Analog->levelCount == 0 ||
+            le64_to_cpu(Analog->firstSummary) > Index->SummaryCount)
+        {
+            return -EBADMSG;
+        }
+
+        Records = (le64_to_cpu(Analog->sampleCount) + (1ULL << Analog->baseShift) - 1) >> Analog->baseShift;
+
+        for (Total = Records, Level = 1; Records > 1; Level++)
+        {
+            Records = (Records + 1) / 2;
+            Total += Records;
+        }
+
+        if (Level != Analog->levelCount || Total > Index->SummaryCount - le64_to_cpu(Analog->firstSummary))
+        {
+            return -EBADMSG;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Returns the number of packets of a recording and their records, which
+// are little-endian as in the sidecar
+//
+ssize_t
+Ch10GetFilePackets (
+    CH10_VOLUME                     *Volume,
+    __u32                           Index,
+    const struct ch10_index_packet  **Packets
+    )
+{
+    const struct ch10_index_file *File;
+
+    if (Volume->Index == NULL || Volume->Index->Packets == NULL)
+    {
+        return -ENOENT;
+    }
+
+    if (Index >= Volume->FileCount)
+    {
+        return -EINVAL;
+    }
+
+    File = &Volume->Index->Files[Index];
+
+    *Packets = Volume->Index->Packets + le64_to_cpu(File->firstPacket);
+
+    return (ssize_t) le64_to_cpu(File->packetCount);
+}
+
+//
+// Finds the last time packet at or before Rtc over all recordings
+//
+int
+Ch10FindTimePacket (
+    CH10_VOLUME                     *Volume,
+    __u64                           Rtc,
+    const struct ch10_index_time    **Time
+    )
+{
+    const struct ch10_index_time    *Times;
+    __u64                           Low = 0;
+    __u64                           High;
+    __u64                           Middle;
+
+    if (Volume->Index == NULL || Volume->Index->Times == NULL)
+    {
+        return -ENOENT;
+    }
+
+    Times = Volume->Index->Times;
+    High = Volume->Index->TimeCount;
+
+    //
+    // First entry later than Rtc
+    //
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (le64_to_cpu(Times[Middle].rtc) <= Rtc)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    if (Low == 0)
+    {
+        return -ENOENT;
+    }
+
+    *Time = &Times[Low - 1];
+
+    return 0;
+}
+
+//
+// Finds the pyramid of an analog subchannel of a recording
+//
+int
+Ch10FindAnalog (
+    CH10_VOLUME                     *Volume,
+    __u32                           Index,
+    __u16                           ChannelId,
+    __u32                           Subchannel,
+    const struct ch10_index_analog  **Analog
+    )
+{
+    __u64 Number;
+
+    if (Volume->Index == NULL || Volume->Index->Analog == NULL)
+    {
+        return -ENOENT;
+    }
+
+    for (Number = 0; Number < Volume->Index->AnalogCount; Number++)
+    {
+        if (le32_to_cpu(Volume->Index->Analog[Number].fileIndex) == Index &&
+            le16_to_cpu(Volume->Index->Analog[Number].channelId) == ChannelId &&
+            Volume->Index->Analog[Number].subchannel == Subchannel)
+        {
+            *Analog = &Volume->Index->Analog[Number];
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+static __u64
+Ch10AnalogSample (
+    const struct ch10_index_analog  *Analog,
+    __u64                           Rtc
+    )
+{
+    double Sample;
+
+    if (Rtc <= le64_to_cpu(Analog->firstRtc))
+    {
+        return 0;
+    }
+
+    if (le64_to_cpu(Analog->lastRtc) <= le64_to_cpu(Analog->firstRtc))
+    {
+        return le64_to_cpu(Analog->sampleCount);
+    }
+
+    Sample = (double) (Rtc - le64_to_cpu(Analog->firstRtc)) * le64_to_cpu(Analog->lastSample) /
+        (le64_to_cpu(Analog->lastRtc) - le64_to_cpu(Analog->firstRtc));
+
+    return Sample < le64_to_cpu(Analog->sampleCount) ? (__u64) Sample : le64_to_cpu(Analog->sampleCount);
+}
+
+static __u64
+Ch10AnalogRtc (
+    const struct ch10_index_analog  *Analog,
+    __u64                           Sample
+    )
+{
+    if (le64_to_cpu(Analog->lastSample) == 0)
+    {
+        return le64_to_cpu(Analog->firstRtc);
+    }
+
+    return le64_to_cpu(Analog->firstRtc) + (__u64) ((double) Sample *
+        (le64_to_cpu(Analog->lastRtc) - le64_to_cpu(Analog->firstRtc)) / le64_to_cpu(Analog->lastSample));
+}
+
+//
+// Sums up the samples from FirstRtc up to LastRtc in Width points, each
+// the min, max and mean of the samples that fall on it. The summaries come
+// from the coarsest level that still has a record for every point, so the
+// query reads at most three records a point from one run of the sidecar,
+// and the min and max of a point are those of the records it touches. A
+// range shorter than Width records of the finest level gives a point per
+// record. Returns the number of points.
+//
+int
+Ch10QueryAnalog (
+    CH10_VOLUME                     *Volume,
+    const struct ch10_index_analog  *Analog,
+    __u64                           FirstRtc,
+    __u64                           LastRtc,
+    __u32                           Width,
+    CH10_ANALOG_POINT               *Points,
+    __u32                           *Level
+    )
+{
+    const struct ch10_index_summary *Summaries;
+    struct ch10_index_summary       Summary;
+    __u64                           SampleCount = le64_to_cpu(Analog->sampleCount);
+    __u64                           First = Ch10AnalogSample(Analog, FirstRtc);
+    __u64                           Last = LastRtc == ~0ULL ? SampleCount : Ch10AnalogSample(Analog, LastRtc) + 1;
+    __u64                           Records;
+    __u64                           Start;
+    __u64                           End;
+    __u64                           Record;
+    __u64                           Samples;
+    __u32                           Shift;
+    __u32                           Point;
+
+    if (Last > SampleCount)
+    {
+        Last = SampleCount;
+    }
+
+    if (First >= Last || Width == 0)
+    {
+        return 0;
+    }
+
+    Summaries = Volume->Index->Summaries + le64_to_cpu(Analog->firstSummary);
+    Records = (SampleCount + (1ULL << Analog->baseShift) - 1) >> Analog->baseShift;
+
+    //
+    // Go up while the next level still has a record for every point
+    //
+    for (*Level = 0, Shift = Analog->baseShift;
+         *Level + 1 < Analog->levelCount &&
+             ((Last - 1) >> (Shift + 1)) - (First >> (Shift + 1)) + 1 >= Width;
+         (*Level)++, Shift++)
+    {
+        Summaries += Records;
+        Records = (Records + 1) / 2;
+    }
+
+    if (((Last - 1) >> Shift) - (First >> Shift) + 1 < Width)
+    {
+        Width = (__u32) (((Last - 1) >> Shift) - (First >> Shift) + 1);
+    }
+
+    for (Point = 0; Point < Width; Point++)
+    {
+        Start = First + (Last - First) * Point / Width;
+        End = First + (Last - First) * (Point + 1) / Width;
+
+        memset(&Summary, 0, sizeof(Summary));
+        Samples = 0;
+
+        for (Record = Start >> Shift; Record <= (End - 1) >> Shift; Record++)
+        {
+            Ch10MergeSummary(
+                &Summary,
+                &Samples,
+                &Summaries[Record],
+                Ch10SummarySamples(SampleCount, Shift, Record)
+                );
+        }
+
+        Points[Point].Rtc = Ch10AnalogRtc(Analog, Start);
+        Points[Point].Sample = Start;
+        Points[Point].Samples = End - Start;
+        Points[Point].Min = (__s16) le16_to_cpu(Summary.min);
+        Points[Point].Max = (__s16) le16_to_cpu(Summary.max);
+        Points[Point].Mean = (__s16) le16_to_cpu(Summary.mean);
+    }
+
+    return (int) Width;
+}
@@ -0,0 +1,533 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include "ch10pkt.h"
+#include "border.h"
+
+__u16
+Ch10HeaderChecksum (
+    const struct ch10_packet_header *Header
+    )
+{
+    const __u8  *Bytes = (const __u8 *) Header;
+    __u16       Sum = 0;
+    int         Index;
+
+    //
+    // Sum of all 16 bit words of the header except the checksum itself
+    //
+    for (Index = 0; Index < CH10_PACKET_HEADER_SIZE - 2; Index += 2)
+    {
+        Sum += (__u16) (Bytes[Index] | (Bytes[Index + 1] << 8));
+    }
+
+    return Sum;
+}
+
+__u32
+Ch10ChecksumSize (
+    int Type
+    )
+{
+    switch (Type)
+    {
+    case CH10_CHECKSUM_8:
+        return 1;
+    case CH10_CHECKSUM_16:
+        return 2;
+    case CH10_CHECKSUM_32:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+__u32
+Ch10DataChecksum (
+    const void  *Body,
+    __u32       Length,
+    int         Type
+    )
+{
+    const __u8  *Bytes = (const __u8 *) Body;
+    __u32       Sum = 0;
+    __u32       Index;
+    __u32       Word;
+
+    switch (Type)
+    {
+    case CH10_CHECKSUM_8:
+        for (Index = 0; Index < Length; Index++)
+        {
+            Sum += Bytes[Index];
+        }
+        return Sum & 0xff;
+
+    case CH10_CHECKSUM_16:
+        for (Index = 0; Index + 1 < Length; Index += 2)
+        {
+            Sum += (__u32) (Bytes[Index] | (Bytes[Index + 1] << 8));
+        }
+        return Sum & 0xffff;
+
+    case CH10_CHECKSUM_32:
+        for (Index = 0; Index + 3 < Length; Index += 4)
+        {
+            memcpy(&Word, Bytes + Index, sizeof(Word));
+            Sum += le32_to_cpu(Word);
+        }
+        return Sum;
+
+    default:
+        return 0;
+    }
+}
+
+__u64
+Ch10GetRtc (
+    const struct ch10_packet_header *Header
+    )
+{
+    __u64   Rtc = 0;
+    int     Index;
+
+    for (Index = 5; Index >= 0; Index--)
+    {
+        Rtc = (Rtc << 8) | Header->relativeTimeCounter[Index];
+    }
+
+    return Rtc;
+}
+
+void
+Ch10SetRtc (
+    struct ch10_packet_header   *Header,
+    __u64                       Rtc
+    )
+{
+    int Index;
+
+    for (Index = 0; Index < 6; Index++)
+    {
+        Header->relativeTimeCounter[Index] = (__u8) (Rtc >> (Index * 8));
+    }
+}
+
+//
+// Returns 0 if the header could start a valid packet, -EBADMSG otherwise
+//
+int
+Ch10CheckPacketHeader (
+    const struct ch10_packet_header *Header
+    )
+{
+    __u32 PacketLength;
+    __u32 DataLength;
+    __u32 Overhead;
+
+    if (le16_to_cpu(Header->syncPattern) != CH10_PACKET_SYNC)
+    {
+        return -EBADMSG;
+    }
+
+    if (le16_to_cpu(Header->headerChecksum) != Ch10HeaderChecksum(Header))
+    {
+        return -EBADMSG;
+    }
+
+    PacketLength = le32_to_cpu(Header->packetLength);
+    DataLength = le32_to_cpu(Header->dataLength);
+
+    Overhead = CH10_PACKET_HEADER_SIZE +
+        Ch10ChecksumSize(Header->packetFlags & CH10_FLAG_CHECKSUM_MASK);
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Overhead += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    if (PacketLength & (CH10_PACKET_ALIGN - 1) ||
+        PacketLength > CH10_MAX_PACKET_SIZE ||
+        PacketLength < Overhead ||
+        DataLength > PacketLength - Overhead)
+    {
+        return -EBADMSG;
+    }
+
+    return 0;
+}
+
+//
+// Checks the data checksum of a packet whose header passed
+// Ch10CheckPacketHeader. The checksum is the last item of the packet and
+// covers the body, after any secondary header, up to the checksum.
+//
+int
+Ch10CheckPacketData (
+    const struct ch10_packet_header *Header
+    )
+{
+    const __u8  *Packet = (const __u8 *) Header;
+    int         Type = Header->packetFlags & CH10_FLAG_CHECKSUM_MASK;
+    __u32       ChecksumSize = Ch10ChecksumSize(Type);
+    __u32       PacketLength = le32_to_cpu(Header->packetLength);
+    __u32       Start = CH10_PACKET_HEADER_SIZE;
+    __u32       Stored = 0;
+    __u32       Index;
+
+    if (ChecksumSize == 0)
+    {
+        return 0;
+    }
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Start += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    for (Index = 0; Index < ChecksumSize; Index++)
+    {
+        Stored |= (__u32) Packet[PacketLength - ChecksumSize + Index] << (Index * 8);
+    }
+
+    if (Ch10DataChecksum(Packet + Start, PacketLength - ChecksumSize - Start, Type) != Stored)
+    {
+        return -EBADMSG;
+    }
+
+    return 0;
+}
+
+//
+// Looks for the next packet header in Buffer, starting at *Offset and
+// stepping by the packet alignment. Returns 0 with *Offset at the header
+// when the whole packet is in the buffer, and -EAGAIN with *Offset at the
+// first byte still to be looked at when the buffer ends first.
+//
+int
+Ch10FindPacket (
+    const void  *Buffer,
+    size_t      Length,
+    size_t      *Offset
+    )
+{
+    const __u8                      *Bytes = (const __u8 *) Buffer;
+    const struct ch10_packet_header *Header;
+    size_t                          Position = *Offset;
+
+    for (;;)
+    {
+        if (Position > Length || Length - Position < CH10_PACKET_HEADER_SIZE)
+        {
+            *Offset = Position;
+            return -EAGAIN;
+        }
+
+        Header = (const struct ch10_packet_header *) (Bytes + Position);
+
+        if (Bytes[Position] == (CH10_PACKET_SYNC & 0xff) &&
+            Bytes[Position + 1] == (CH10_PACKET_SYNC >> 8) &&
+            !Ch10CheckPacketHeader(Header))
+        {
+            *Offset = Position;
+
+            if (le32_to_cpu(Header->packetLength) > Length - Position)
+            {
+                return -EAGAIN;
+            }
+
+            return 0;
+        }
+
+        Position += CH10_PACKET_ALIGN;
+    }
+}
+
+//
+// Value of a BCD number, -1 when a digit is not decimal
+//
+static int
+Ch10DecodeBcd (
+    unsigned    Value
+    )
+{
+    int         Result = 0;
+    int         Scale = 1;
+
+    for (; Value; Value >>= 4, Scale *= 10)
+    {
+        if ((Value & 0xf) > 9)
+        {
+            return -1;
+        }
+
+        Result += (int) (Value & 0xf) * Scale;
+    }
+
+    return Result;
+}
+
+//
+// Days from 1970-01-01 to a date of the Gregorian calendar
+//
+static __u64
+Ch10DaysFromCivil (
+    unsigned    Year,
+    unsigned    Month,
+    unsigned    Day
+    )
+{
+    unsigned    Era;
+    unsigned    YearOfEra;
+    unsigned    DayOfYear;
+
+    Year -= Month <= 2;
+    Era = Year / 400;
+    YearOfEra = Year - Era * 400;
+    DayOfYear = (153 * (Month > 2 ? Month - 3 : Month + 9) + 2) / 5 + Day - 1;
+
+    return (__u64) Era * 146097 +
+        YearOfEra * 365 + YearOfEra / 4 - YearOfEra / 100 + DayOfYear - 719468;
+}
+
+//
+// Decodes the absolute time a time data format 1 packet carries, in units
+// of the relative time counter, and its channel specific data word. A
+// time in the day format counts from the start of a year the packet does
+// not give, one in the CH10_TIME_CSDW_DMY format counts from 1970. Returns
+// -EBADMSG when the packet is not a time packet or holds no valid time.
+//
+int
+Ch10DecodeTime (
+    const struct ch10_packet_header *Header,
+    __u64                           *Time,
+    __u32                           *Csdw
+    )
+{
+    const __u8          *Body = (const __u8 *) (Header + 1);
+    __u32               DataLength = le32_to_cpu(Header->dataLength);
+    struct ch10_time_f1 Data;
+    __u64               Days;
+    int                 Hundredths;
+    int                 Seconds;
+    int                 Minutes;
+    int                 Hours;
+    int                 Day;
+    int                 Month;
+    int                 Year;
+
+    if (Header->dataType != CH10_DATA_TIME_F1)
+    {
+        return -EBADMSG;
+    }
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    memset(&Data, 0, sizeof(Data));
+    memcpy(&Data, Body, DataLength < sizeof(Data) ? DataLength : sizeof(Data));
+
+    *Csdw = le32_to_cpu(Data.csdw);
+
+    Hundredths = Ch10DecodeBcd(le16_to_cpu(Data.msec) & 0xff);
+    Seconds = Ch10DecodeBcd((le16_to_cpu(Data.msec) >> 8) & 0x7f);
+    Minutes = Ch10DecodeBcd(le16_to_cpu(Data.minHour) & 0x7f);
+    Hours = Ch10DecodeBcd((le16_to_cpu(Data.minHour) >> 8) & 0x3f);
+
+    if (DataLength < offsetof(struct ch10_time_f1, reserved) ||
+        Hundredths < 0 || Seconds < 0 || Seconds > 60 ||
+        Minutes < 0 || Minutes > 59 || Hours < 0 || Hours > 23)
+    {
+        return -EBADMSG;
+    }
+
+    if (*Csdw & CH10_TIME_CSDW_DMY)
+    {
+        Day = Ch10DecodeBcd(le16_to_cpu(Data.day) & 0xff);
+        Month = Ch10DecodeBcd((le16_to_cpu(Data.day) >> 8) & 0x1f);
+        Year = Ch10DecodeBcd(le16_to_cpu(Data.reserved) & 0x3fff);
+
+        if (DataLength < sizeof(Data) ||
+            Day < 1 || Day > 31 || Month < 1 || Month > 12 || Year < 1970)
+        {
+            return -EBADMSG;
+        }
+
+        Days = Ch10DaysFromCivil((unsigned) Year, (unsigned) Month, (unsigned) Day);
+    }
+    else
+    {
+        Day = Ch10DecodeBcd(le16_to_cpu(Data.day) & 0x3ff);
+
+        if (Day < 1 || Day > 366)
+        {
+            return -EBADMSG;
+        }
+
+        Days = (__u64) Day - 1;
+    }
+
+    *Time = (((Days * 24 + (__u64) Hours) * 60 + (__u64) Minutes) * 60 + (__u64) Seconds) *
+        CH10_RTC_HZ + (__u64) Hundredths * (CH10_RTC_HZ / 100);
+
+    return 0;
+}
+
+//
+// Samples of an analog data format 1 packet, interleaved over its
+// subchannels, as signed 16 bit values. Samples of up to 16 bits are
+// taken from unpacked packets and from packed ones with 8 or 16 bit
+// samples, and every subchannel must have the same format. Returns the
+// number of samples, -EBADMSG when the packet is not an analog packet and
+// -EOPNOTSUPP for a format that is not taken.
+//
+int
+Ch10DecodeAnalog (
+    const struct ch10_packet_header *Header,
+    __s16                           *Samples,
+    __u32                           MaxSamples,
+    __u32                           *Subchannels
+    )
+{
+    const __u8  *Body = (const __u8 *) (Header + 1);
+    __u32       DataLength = le32_to_cpu(Header->dataLength);
+    __u32       Csdw;
+    __u32       Other;
+    __u32       Words;
+    __u32       Length;
+    __u32       Mode;
+    __u32       Index;
+    __u32       Count;
+    __u16       Word;
+
+    if (Header->dataType != CH10_DATA_ANALOG_F1 || DataLength < 4)
+    {
+        return -EBADMSG;
+    }
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    memcpy(&Csdw, Body, sizeof(Csdw));
+    Csdw = le32_to_cpu(Csdw);
+
+    *Subchannels = CH10_ANALOG_TOTCHAN(Csdw);
+    Length = CH10_ANALOG_LENGTH(Csdw);
+    Mode = Csdw & CH10_ANALOG_CSDW_MODE_MASK;
+
+    //
+    // One word for all subchannels, or one per subchannel
+    //
+    Words = Csdw & CH10_ANALOG_CSDW_SAME || *Subchannels == 1 ? 1 : *Subchannels;
+
+    if (DataLength < Words * 4)
+    {
+        return -EBADMSG;
+    }
+
+    for (Index = 1; Index < Words; Index++)
+    {
+        memcpy(&Other, Body + Index * 4, sizeof(Other));
+        Other = le32_to_cpu(Other);
+
+        if (CH10_ANALOG_LENGTH(Other) != Length ||
+            (Other & CH10_ANALOG_CSDW_MODE_MASK) != Mode)
+        {
+            return -EOPNOTSUPP;
+        }
+    }
+
+    //
+    // Mode 2 is reserved
+    //
+    if (Length > 16 || Mode == 2 ||
+        (Mode == CH10_ANALOG_CSDW_PACKED && Length != 8 && Length != 16))
+    {
+        return -EOPNOTSUPP;
+    }
+
+    Body += Words * 4;
+    DataLength -= Words * 4;
+
+    if (Mode == CH10_ANALOG_CSDW_PACKED && Length == 8)
+    {
+        Count = DataLength < MaxSamples ? DataLength : MaxSamples;
+
+        for (Index = 0; Index < Count; Index++)
+        {
+            Samples[Index] = (__s8) Body[Index];
+        }
+
+        return (int) Count;
+    }
+
+    Count = DataLength / 2 < MaxSamples ? DataLength / 2 : MaxSamples;
+
+    for (Index = 0; Index < Count; Index++)
+    {
+        memcpy(&Word, Body + Index * 2, sizeof(Word));
+        Word = le16_to_cpu(Word);
+
+        if (Mode == CH10_ANALOG_CSDW_LSB_PADDED)
+        {
+            Samples[Index] = (__s16) ((__s16) Word >> (16 - Length));
+        }
+        else
+        {
+            Samples[Index] = (__s16) ((__s16) (Word << (16 - Length)) >> (16 - Length));
+        }
+    }
+
+    return (int) Count;
+}
+
+const char *
+Ch10DataTypeName (
+    int DataType
+    )
+{
+    switch (DataType)
+    {
+    case CH10_DATA_COMPUTER_F0:
+        return "computer";
+    case CH10_DATA_TMATS:
+        return "tmats";
+    case CH10_DATA_EVENT:
+        return "event";
+    case CH10_DATA_PCM_F1:
+        return "pcm";
+    case CH10_DATA_TIME_F1:
+        return "time";
+    case CH10_DATA_1553_F1:
+        return "1553";
+    case CH10_DATA_ANALOG_F1:
+        return "analog";
+    case CH10_DATA_ARINC429_F0:
+        return "arinc";
+    case CH10_DATA_ETHERNET_F0:
+        return "eth";
+    default:
+        return "unknown";
+    }
+}
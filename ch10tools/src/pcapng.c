@@ -0,0 +1,735 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// The Ethernet frames of one channel of a recording seen as a pcapng
+// capture. Opening the view walks the Ethernet packets of the channel
+// once, through the packet table of the index sidecar when there is one,
+// and keeps only where each packet is and where its frames start in the
+// capture. Reads generate the section header, the interface description
+// and the framing of every Enhanced Packet Block as they go and copy the
+// frames from the recording, straight out of the mapping when the device
+// is mapped. Timestamps are absolute times from the time correlation of
+// the recording, in the 100 ns units of the relative time counter.
+//
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+#define PCAPNG_SECTION_HEADER       0x0A0D0D0A
+#define PCAPNG_INTERFACE            0x00000001
+#define PCAPNG_ENHANCED_PACKET      0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC     0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHERNET    1
+#define PCAPNG_IF_TSRESOL           9
+
+#define PCAPNG_SECTION_HEADER_SIZE  28
+#define PCAPNG_INTERFACE_SIZE       32
+#define PCAPNG_EPB_HEADER_SIZE      28
+#define PCAPNG_EPB_SIZE(Length)     (PCAPNG_EPB_HEADER_SIZE + (((Length) + 3) & ~3) + 4)
+
+//
+// Ethernet format 0 intra-packet header, then the frame padded to 16 bits
+//
+#define CH10_ETHERNET_IPH_SIZE      sizeof(struct ch10_ethernet_iph)
+
+typedef struct _CH10_PCAPNG_BUILDER {
+    CH10_PCAPNG     *View;
+    __u32           Capacity;
+} CH10_PCAPNG_BUILDER;
+
+static void
+Ch10PutLe16 (
+    __u8    *Buffer,
+    __u16   Value
+    )
+{
+    Buffer[0] = (__u8) Value;
+    Buffer[1] = (__u8) (Value >> 8);
+}
+
+static void
+Ch10PutLe32 (
+    __u8    *Buffer,
+    __u32   Value
+    )
+{
+    Ch10PutLe16(Buffer, (__u16) Value);
+    Ch10PutLe16(Buffer + 2, (__u16) (Value >> 16));
+}
+
+//
+// The body of an Ethernet packet and the number of frames its channel
+// specific data word gives
+//
+static const __u8 *
+Ch10GetEthernetBody (
+    const struct ch10_packet_header *Header,
+    __u32                           *Length,
+    __u32                           *Frames
+    )
+{
+    const __u8  *Body = (const __u8 *) (Header + 1);
+    __u32       Csdw;
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    *Length = le32_to_cpu(Header->dataLength);
+
+    if (*Length < 4)
+    {
+        *Frames = 0;
+        return Body;
+    }
+
+    memcpy(&Csdw, Body, sizeof(Csdw));
+
+    *Frames = le32_to_cpu(Csdw) & 0xffff;
+
+    return Body;
+}
+
+//
+// Steps to the next frame of an Ethernet packet body. Returns 0 with the
+// frame at *Position and its length, -1 when the body holds no further
+// whole frame.
+//
+static int
+Ch10NextFrame (
+    const __u8  *Body,
+    __u32       Length,
+    __u32       *Position,
+    __u32       *FrameLength
+    )
+{
+    struct ch10_ethernet_iph Iph;
+
+    if (*Position > Length || Length - *Position < CH10_ETHERNET_IPH_SIZE)
+    {
+        return -1;
+    }
+
+    memcpy(&Iph, Body + *Position, sizeof(Iph));
+
+    *FrameLength = le32_to_cpu(Iph.idWord) & CH10_ETHERNET_LENGTH_MASK;
+
+    if (*FrameLength > Length - *Position - CH10_ETHERNET_IPH_SIZE)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+Ch10AddPcapngPacket (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    CH10_PCAPNG_BUILDER *Builder = (CH10_PCAPNG_BUILDER *) Context;
+    CH10_PCAPNG         *View = Builder->View;
+    CH10_PCAPNG_PACKET  *Packets;
+    CH10_PCAPNG_PACKET  *Packet;
+    const __u8          *Body;
+    __u32               Length;
+    __u32               Frames;
+    __u32               Frame;
+    __u32               Position = 4;
+    __u32               FrameLength;
+    __u64               Size = 0;
+
+    if (Header->dataType != CH10_DATA_ETHERNET_F0 ||
+        le16_to_cpu(Header->channelId) != View->ChannelId)
+    {
+        return 0;
+    }
+
+    Body = Ch10GetEthernetBody(Header, &Length, &Frames);
+
+    for (Frame = 0;
+         Frame < Frames && !Ch10NextFrame(Body, Length, &Position, &FrameLength);
+         Frame++)
+    {
+        Size += PCAPNG_EPB_SIZE(FrameLength);
+        Position += CH10_ETHERNET_IPH_SIZE + ((FrameLength + 1) & ~1);
+    }
+
+    if (Frame == 0)
+    {
+        return 0;
+    }
+
+    if (View->Count == Builder->Capacity)
+    {
+        if (Builder->Capacity > 0x7fffffff / sizeof(CH10_PCAPNG_PACKET))
+        {
+            return -ENOMEM;
+        }
+
+        Packets = realloc(
+            View->Packets,
+            (Builder->Capacity ? Builder->Capacity * 2 : 1024) * sizeof(CH10_PCAPNG_PACKET)
+            );
+
+        if (Packets == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        View->Packets = Packets;
+        Builder->Capacity = Builder->Capacity ? Builder->Capacity * 2 : 1024;
+    }
+
+    Packet = &View->Packets[View->Count++];
+
+    Packet->Offset = Offset;
+    Packet->StreamOffset = View->Size;
+    Packet->PacketLength = le32_to_cpu(Header->packetLength);
+    Packet->FrameCount = Frame;
+
+    View->Size += Size;
+    View->FrameCount += Frame;
+
+    return 0;
+}
+
+//
+// Visits only the packets of the channel listed in the sidecar
+//
+static int
+Ch10AddIndexedPackets (
+    CH10_PCAPNG                     *View,
+    const struct ch10_index_packet  *Packets,
+    __u64                           Count,
+    CH10_PCAPNG_BUILDER             *Builder
+    )
+{
+    const struct ch10_packet_header *Header;
+    __u8                            *Buffer = NULL;
+    __u64                           Packet;
+    __u64                           Offset;
+    __u32                           Length;
+    ssize_t                         Result;
+    int                             Status = 0;
+
+    for (Packet = 0; Packet < Count && !Status; Packet++)
+    {
+        if (Packets[Packet].dataType != CH10_DATA_ETHERNET_F0 ||
+            le16_to_cpu(Packets[Packet].channelId) != View->ChannelId)
+        {
+            continue;
+        }
+
+        Offset = le64_to_cpu(Packets[Packet].offset);
+        Length = le32_to_cpu(Packets[Packet].packetLength);
+
+        Result = Ch10MapFileData(View->Volume, View->FileIndex, Offset, Length, (const void **) &Header);
+
+        if (Result < (ssize_t) Length)
+        {
+            if (Buffer == NULL && (Buffer = malloc(CH10_MAX_PACKET_SIZE)) == NULL)
+            {
+                return -ENOMEM;
+            }
+
+            Result = Ch10ReadFileData(View->Volume, View->FileIndex, Offset, Length, Buffer);
+            Header = (const struct ch10_packet_header *) Buffer;
+        }
+
+        if (Result < 0)
+        {
+            Status = (int) Result;
+        }
+        else if (Result < (ssize_t) Length || Ch10CheckPacketHeader(Header))
+        {
+            Status = -EIO;
+        }
+        else
+        {
+            Status = Ch10AddPcapngPacket(Builder, Offset, Header);
+        }
+    }
+
+    free(Buffer);
+
+    return Status;
+}
+
+//
+// 100 ns units from 1970 to the start of the year a directory entry was
+// created in, given as DDMMYYYY. Time packets in the day format count
+// from the start of a year they do not give.
+//
+__u64
+Ch10GetEpoch (
+    const struct ch10_dir_entry *DirEntry
+    )
+{
+    __u64       Days;
+    unsigned    Year = 0;
+    int         Index;
+
+    for (Index = 4; Index < 8; Index++)
+    {
+        if (DirEntry->createDate[Index] < '0' || DirEntry->createDate[Index] > '9')
+        {
+            return 0;
+        }
+
+        Year = Year * 10 + (DirEntry->createDate[Index] - '0');
+    }
+
+    if (Year < 1970)
+    {
+        return 0;
+    }
+
+    Days = (__u64) (Year - 1970) * 365 +
+        (Year - 1969) / 4 - (Year - 1901) / 100 + (Year - 1601) / 400;
+
+    return Days * 86400 * CH10_RTC_HZ;
+}
+
+//
+// Builds the view of the Ethernet channel ChannelId of a recording.
+// Returns -ENOENT when the channel has no Ethernet frames.
+//
+int
+Ch10OpenPcapng (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u16           ChannelId,
+    CH10_PCAPNG     **Result
+    )
+{
+    CH10_PCAPNG                     *View;
+    CH10_PCAPNG_BUILDER             Builder;
+    const struct ch10_index_packet  *Packets;
+    ssize_t                         Count;
+    __u64                           Skipped = 0;
+    __u8                            *Header;
+    int                             Status;
+
+    if (Index >= Volume->FileCount)
+    {
+        return -EINVAL;
+    }
+
+    View = calloc(1, sizeof(CH10_PCAPNG));
+
+    if (View == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    View->Volume = Volume;
+    View->FileIndex = Index;
+    View->ChannelId = ChannelId;
+    View->Size = CH10_PCAPNG_HEADER_SIZE;
+
+    Builder.View = View;
+    Builder.Capacity = 0;
+
+    Count = Ch10GetFilePackets(Volume, Index, &Packets);
+
+    if (Count >= 0)
+    {
+        Status = Ch10AddIndexedPackets(View, Packets, (__u64) Count, &Builder);
+    }
+    else
+    {
+        Status = Ch10ScanFile(Volume, Index, Ch10AddPcapngPacket, &Builder, &Skipped);
+    }
+
+    if (!Status && View->Count == 0)
+    {
+        Status = -ENOENT;
+    }
+
+    if (!Status)
+    {
+        Status = Ch10BuildTimeTable(Volume, Index, &View->Time);
+    }
+
+    if (Status)
+    {
+        Ch10ClosePcapng(View);
+        return Status;
+    }
+
+    if (View->Time.Count && !(View->Time.Points[0].Flags & CH10_TIME_YEAR))
+    {
+        View->Epoch = Ch10GetEpoch(Volume->Files[Index].DirEntry);
+    }
+
+    //
+    // Section header with an unknown section length, and the one interface
+    // with timestamps in units of 10^-7 seconds
+    //
+    Header = View->Header;
+
+    Ch10PutLe32(Header, PCAPNG_SECTION_HEADER);
+    Ch10PutLe32(Header + 4, PCAPNG_SECTION_HEADER_SIZE);
+    Ch10PutLe32(Header + 8, PCAPNG_BYTE_ORDER_MAGIC);
+    Ch10PutLe16(Header + 12, 1);
+    Ch10PutLe16(Header + 14, 0);
+    memset(Header + 16, 0xff, 8);
+    Ch10PutLe32(Header + 24, PCAPNG_SECTION_HEADER_SIZE);
+
+    Header += PCAPNG_SECTION_HEADER_SIZE;
+
+    Ch10PutLe32(Header, PCAPNG_INTERFACE);
+    Ch10PutLe32(Header + 4, PCAPNG_INTERFACE_SIZE);
+    Ch10PutLe16(Header + 8, PCAPNG_LINKTYPE_ETHERNET);
+    Ch10PutLe16(Header + 12, 0);
+    Ch10PutLe16(Header + 16, PCAPNG_IF_TSRESOL);
+    Ch10PutLe16(Header + 18, 1);
+    Header[20] = 7;
+    Ch10PutLe32(Header + 28, PCAPNG_INTERFACE_SIZE);
+
+    *Result = View;
+
+    return 0;
+}
+
+void
+Ch10ClosePcapng (
+    CH10_PCAPNG     *View
+    )
+{
+    Ch10FreeTimeTable(&View->Time);
+    free(View->Packets);
+    free(View);
+}
+
+//
+// Copies the part of a piece of the capture at Position that falls into
+// the range being read
+//
+static void
+Ch10CopyPiece (
+    __u8        *Buffer,
+    __u64       Offset,
+    size_t      Length,
+    __u64       Position,
+    const void  *Piece,
+    size_t      PieceLength
+    )
+{
+    __u64 Start = Position > Offset ? Position : Offset;
+    __u64 End = Position + PieceLength < Offset + Length ? Position + PieceLength : Offset + Length;
+
+    if (Start < End)
+    {
+        if (Piece)
+        {
+            memcpy(Buffer + (Start - Offset), (const __u8 *) Piece + (Start - Position), End - Start);
+        }
+        else
+        {
+            memset(Buffer + (Start - Offset), 0, End - Start);
+        }
+    }
+}
+
+//
+// Generates the blocks of one Ethernet packet that fall into the range
+//
+static void
+Ch10CopyPacketBlocks (
+    CH10_PCAPNG                     *View,
+    const CH10_PCAPNG_PACKET        *Packet,
+    const struct ch10_packet_header *Header,
+    __u8                            *Buffer,
+    __u64                           Offset,
+    size_t                          Length
+    )
+{
+    const __u8                  *Body;
+    struct ch10_ethernet_iph    Iph;
+    __u8                        Block[PCAPNG_EPB_HEADER_SIZE];
+    __u8                        Trailer[4];
+    __u64                       Position = Packet->StreamOffset;
+    __u64                       Rtc;
+    __u64                       Time;
+    __u32                       BodyLength;
+    __u32                       Frames;
+    __u32                       Frame;
+    __u32                       FrameLength;
+    __u32                       BodyPosition = 4;
+    __u32                       Size;
+
+    Body = Ch10GetEthernetBody(Header, &BodyLength, &Frames);
+
+    for (Frame = 0;
+         Frame < Packet->FrameCount && Position < Offset + Length &&
+         !Ch10NextFrame(Body, BodyLength, &BodyPosition, &FrameLength);
+         Frame++)
+    {
+        Size = PCAPNG_EPB_SIZE(FrameLength);
+
+        if (Position + Size > Offset)
+        {
+            //
+            // Intra-packet time stamps are relative time unless the packet
+            // says they are in the secondary header format
+            //
+            memcpy(&Iph, Body + BodyPosition, sizeof(Iph));
+
+            if (Header->packetFlags & CH10_FLAG_IPTS_SOURCE)
+            {
+                Rtc = Ch10GetRtc(Header);
+            }
+            else
+            {
+                memcpy(&Rtc, Iph.timeStamp, sizeof(Rtc));
+                Rtc = le64_to_cpu(Rtc) & 0xffffffffffffULL;
+            }
+
+            if (Ch10RtcToTime(&View->Time, Rtc, &Time))
+            {
+                Time = Rtc;
+            }
+            else
+            {
+                Time += View->Epoch;
+            }
+
+            Ch10PutLe32(Block, PCAPNG_ENHANCED_PACKET);
+            Ch10PutLe32(Block + 4, Size);
+            Ch10PutLe32(Block + 8, 0);
+            Ch10PutLe32(Block + 12, (__u32) (Time >> 32));
+            Ch10PutLe32(Block + 16, (__u32) Time);
+            Ch10PutLe32(Block + 20, FrameLength);
+            Ch10PutLe32(Block + 24, FrameLength);
+            Ch10PutLe32(Trailer, Size);
+
+            Ch10CopyPiece(Buffer, Offset, Length, Position, Block, sizeof(Block));
+
+            Ch10CopyPiece(
+                Buffer,
+                Offset,
+                Length,
+                Position + PCAPNG_EPB_HEADER_SIZE,
+                Body + BodyPosition + CH10_ETHERNET_IPH_SIZE,
+                FrameLength
+                );
+
+            Ch10CopyPiece(
+                Buffer,
+                Offset,
+                Length,
+                Position + PCAPNG_EPB_HEADER_SIZE + FrameLength,
+                NULL,
+                Size - PCAPNG_EPB_HEADER_SIZE - FrameLength - sizeof(Trailer)
+                );
+
+            Ch10CopyPiece(Buffer, Offset, Length, Position + Size - sizeof(Trailer), Trailer, sizeof(Trailer));
+        }
+
+        Position += Size;
+        BodyPosition += CH10_ETHERNET_IPH_SIZE + ((FrameLength + 1) & ~1);
+    }
+}
+
+//
+// Reads the capture, the whole range up to its end
+//
+ssize_t
+Ch10ReadPcapng (
+    CH10_PCAPNG     *View,
+    __u64           Offset,
+    size_t          Length,
+    void            *Buffer
+    )
+{
+    const struct ch10_packet_header *Header;
+    const CH10_PCAPNG_PACKET        *Packet;
+    __u8                            *PacketBuffer = NULL;
+    __u32                           Low = 0;
+    __u32                           High = View->Count;
+    __u32                           Middle;
+    ssize_t                         Result;
+
+    if (Offset >= View->Size)
+    {
+        return 0;
+    }
+
+    if (Length > View->Size - Offset)
+    {
+        Length = (size_t) (View->Size - Offset);
+    }
+
+    Ch10CopyPiece(Buffer, Offset, Length, 0, View->Header, CH10_PCAPNG_HEADER_SIZE);
+
+    //
+    // Last packet whose blocks start at or before Offset
+    //
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (View->Packets[Middle].StreamOffset <= Offset)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    for (Packet = View->Packets + (Low ? Low - 1 : 0);
+         Packet < View->Packets + View->Count && Packet->StreamOffset < Offset + Length;
+         Packet++)
+    {
+        Result = Ch10MapFileData(
+            View->Volume,
+            View->FileIndex,
+            Packet->Offset,
+            Packet->PacketLength,
+            (const void **) &Header
+            );
+
+        if (Result < (ssize_t) Packet->PacketLength)
+        {
+            if (PacketBuffer == NULL && (PacketBuffer = malloc(CH10_MAX_PACKET_SIZE)) == NULL)
+            {
+                return -ENOMEM;
+            }
+
+            Result = Ch10ReadFileData(
+                View->Volume,
+                View->FileIndex,
+                Packet->Offset,
+                Packet->PacketLength,
+                PacketBuffer
+                );
+
+            Header = (const struct ch10_packet_header *) PacketBuffer;
+        }
+
+        if (Result < (ssize_t) Packet->PacketLength)
+        {
+            free(PacketBuffer);
+            return Result < 0 ? Result : -EIO;
+        }
+
+        Ch10CopyPacketBlocks(View, Packet, Header, Buffer, Offset, Length);
+    }
+
+    free(PacketBuffer);
+
+    return (ssize_t) Length;
+}
+
+//
+// Splits the name of a stream, <recording>:<channel> with the channel in
+// decimal and the suffix of a view, and gives its CH10_STREAM_XXX type.
+// An ARINC-429 label stream names its bus and label after the channel as
+// -<bus>-<label>, the bus in decimal and the label in octal, and gets them
+// in *Filter as bus << 8 | label. Returns the length of the recording
+// name, or -ENOENT when Name is not the name of a stream.
+//
+int
+Ch10ParseStreamName (
+    const char      *Name,
+    __u16           *ChannelId,
+    __u32           *Filter,
+    int             *Type
+    )
+{
+    const char      *Separator = strrchr(Name, CH10_STREAM_SEPARATOR);
+    const char      *Digit;
+    unsigned long   Channel = 0;
+    unsigned long   Bus = 0;
+    unsigned long   Label = 0;
+    int             Labelled = 0;
+
+    if (Separator == NULL || Separator == Name || !(Separator[1] >= '0' && Separator[1] <= '9'))
+    {
+        return -ENOENT;
+    }
+
+    for (Digit = Separator + 1; *Digit >= '0' && *Digit <= '9'; Digit++)
+    {
+        Channel = Channel * 10 + (unsigned long) (*Digit - '0');
+
+        if (Channel > 0xffff)
+        {
+            return -ENOENT;
+        }
+    }
+
+    if (*Digit == '-')
+    {
+        for (Digit++; *Digit >= '0' && *Digit <= '9' && Bus <= 0xff; Digit++)
+        {
+            Bus = Bus * 10 + (unsigned long) (*Digit - '0');
+        }
+
+        if (Digit[-1] == '-' || *Digit != '-')
+        {
+            return -ENOENT;
+        }
+
+        for (Digit++; *Digit >= '0' && *Digit <= '7' && Label <= 0xff; Digit++)
+        {
+            Label = Label * 8 + (unsigned long) (*Digit - '0');
+        }
+
+        if (Digit[-1] == '-' || Bus > 0xff || Label > 0xff)
+        {
+            return -ENOENT;
+        }
+
+        Labelled = 1;
+    }
+
+    if (!Labelled && !strcmp(Digit, CH10_PCAPNG_SUFFIX))
+    {
+        *Type = CH10_STREAM_PCAPNG;
+    }
+    else if (!Labelled && !strcmp(Digit, CH10_PCM_SUFFIX))
+    {
+        *Type = CH10_STREAM_PCM;
+    }
+    else if (Labelled && !strcmp(Digit, CH10_ARINC_SUFFIX))
+    {
+        *Type = CH10_STREAM_ARINC;
+    }
+    else
+    {
+        return -ENOENT;
+    }
+
+    *ChannelId = (__u16) Channel;
+    *Filter = (__u32) (Bus << 8 | Label);
+
+    return (int) (Separator - Name);
+}
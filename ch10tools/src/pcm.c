@@ -0,0 +1,1813 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// PCM frame synchronisation. The bit stream of a PCM channel, taken as it
+// is from throughput mode packets or rebuilt from the minor frames of
+// packed and unpacked mode ones, goes through a decoder that searches for
+// the sync pattern, checks it again one minor frame later and from then
+// on follows the frames, keeping up to Flywheel frames without a sync
+// pattern before it searches again. A locked decoder does not search at
+// all, it only checks the pattern where the next frame starts.
+//
+// The search compares whole bytes at 32 positions at a time through the
+// vector extensions of the compiler, which turn into SSE2, AVX2 or NEON
+// instructions, and only looks at single bits where the bytes match.
+//
+// A channel opened as <recording>:<channel>.pcm shows the decoded minor
+// frames as fixed size records, see CH10_PCM_RECORD.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+//
+// Bytes the search compares in one step, the widest vector the target has
+// as wider ones are split up badly, and the slack kept behind the bits of
+// a decoder so that its loads never leave the buffer
+//
+#ifdef __AVX2__
+#define CH10_PCM_VECTOR_SIZE    32
+#else
+#define CH10_PCM_VECTOR_SIZE    16
+#endif
+#define CH10_PCM_PADDING        64
+
+typedef __u8 CH10_PCM_VECTOR __attribute__ ((vector_size (CH10_PCM_VECTOR_SIZE)));
+typedef __u64 CH10_PCM_VECTOR64 __attribute__ ((vector_size (CH10_PCM_VECTOR_SIZE)));
+
+//
+// Largest TMATS setup record that is looked at
+//
+#define CH10_TMATS_MAX_SIZE     (1024 * 1024)
+
+typedef struct _CH10_PCM_BUILDER {
+    CH10_PCM        *View;
+    __u32           Capacity;
+} CH10_PCM_BUILDER;
+
+typedef struct _CH10_PCM_READER {
+    CH10_PCM        *View;
+    __u8            *Buffer;
+    __u64           Offset;
+    size_t          Length;
+    __u64           Last;
+    __u8            *Record;
+} CH10_PCM_READER;
+
+static __u64
+Ch10LoadBe64 (
+    const __u8  *Buffer
+    )
+{
+    __u64 Value;
+
+    memcpy(&Value, Buffer, sizeof(Value));
+
+    return be64_to_cpu(Value);
+}
+
+//
+// Bits bits, 1 to CH10_PCM_MAX_SYNC_BITS, from bit Bit of Buffer
+//
+static __u64
+Ch10PeekBits (
+    const __u8  *Buffer,
+    __u64       Bit,
+    __u32       Bits
+    )
+{
+    return (Ch10LoadBe64(Buffer + (Bit >> 3)) << (Bit & 7)) >> (64 - Bits);
+}
+
+int
+Ch10InitPcmSearch (
+    CH10_PCM_SEARCH *Search,
+    __u64           Pattern,
+    __u64           Mask,
+    __u32           Bits
+    )
+{
+    __u32   Lead;
+    __u32   Byte;
+    __u32   Shift;
+
+    if (Bits == 0 || Bits > CH10_PCM_MAX_SYNC_BITS)
+    {
+        return -EINVAL;
+    }
+
+    memset(Search, 0, sizeof(CH10_PCM_SEARCH));
+
+    Search->Bits = Bits;
+    Search->Mask = Mask & ((1ULL << Bits) - 1);
+    Search->Pattern = Pattern & Search->Mask;
+
+    //
+    // Two bytes need 7 + 16 bits of pattern at the worst offset, one byte
+    // needs 7 + 8
+    //
+    Search->KeyBytes = Bits >= 23 ? 2 : Bits >= 15 ? 1 : 0;
+
+    for (Lead = 0; Lead < 8; Lead++)
+    {
+        for (Byte = 0; Byte < Search->KeyBytes; Byte++)
+        {
+            Shift = Bits - Lead - Byte * 8 - 8;
+
+            Search->Key[Lead][Byte] = (__u8) (Search->Pattern >> Shift);
+            Search->KeyMask[Lead][Byte] = (__u8) (Search->Mask >> Shift);
+        }
+    }
+
+    return 0;
+}
+
+//
+// Bit by bit through a shift register, for patterns too short for the
+// byte compare and as the reference the vector search is measured against
+//
+__s64
+Ch10FindPcmSyncSerial (
+    const CH10_PCM_SEARCH   *Search,
+    const __u8              *Buffer,
+    __u64                   From,
+    __u64                   End
+    )
+{
+    __u64   Register = 0;
+    __u64   Bit;
+
+    if (End < Search->Bits || From > End - Search->Bits)
+    {
+        return -1;
+    }
+
+    for (Bit = From; Bit < End; Bit++)
+    {
+        Register = Register << 1 | ((Buffer[Bit >> 3] >> (7 - (Bit & 7))) & 1);
+
+        if (Bit + 1 - From >= Search->Bits && (Register & Search->Mask) == Search->Pattern)
+        {
+            return (__s64) (Bit + 1 - Search->Bits);
+        }
+    }
+
+    return -1;
+}
+
+//
+// First bit from From on where the whole pattern lies before End, or -1.
+// Buffer must be readable CH10_PCM_PADDING bytes past the byte of End.
+//
+__s64
+Ch10FindPcmSync (
+    const CH10_PCM_SEARCH   *Search,
+    const __u8              *Buffer,
+    __u64                   From,
+    __u64                   End
+    )
+{
+    CH10_PCM_VECTOR     Bytes0;
+    CH10_PCM_VECTOR     Bytes1;
+    CH10_PCM_VECTOR     Hits;
+    CH10_PCM_VECTOR64   Any;
+    __u64               Last;
+    __u64               Byte;
+    __u64               Position;
+    __u32               Lane;
+    __u32               Lead;
+    int                 Index;
+
+    if (End < Search->Bits || From > End - Search->Bits)
+    {
+        return -1;
+    }
+
+    if (Search->KeyBytes == 0)
+    {
+        return Ch10FindPcmSyncSerial(Search, Buffer, From, End);
+    }
+
+    Last = End - Search->Bits;
+
+    //
+    // A pattern at bit Byte * 8 - Lead covers byte Byte and the one after
+    // it whole. The candidates of a byte come in order of their position
+    // when Lead counts down, and those of the next byte all come later.
+    //
+    for (Byte = From >> 3; Byte * 8 <= Last + 7; Byte += CH10_PCM_VECTOR_SIZE)
+    {
+        memcpy(&Bytes0, Buffer + Byte, sizeof(Bytes0));
+        memcpy(&Bytes1, Buffer + Byte + 1, sizeof(Bytes1));
+
+        Hits = (CH10_PCM_VECTOR) { 0 };
+
+        for (Lead = 0; Lead < 8; Lead++)
+        {
+            Hits |= (CH10_PCM_VECTOR) (((Bytes0 & Search->KeyMask[Lead][0]) == Search->Key[Lead][0]) &
+                                       ((Bytes1 & Search->KeyMask[Lead][1]) == Search->Key[Lead][1]));
+        }
+
+        memcpy(&Any, &Hits, sizeof(Any));
+
+        for (Index = 1; Index < CH10_PCM_VECTOR_SIZE / 8; Index++)
+        {
+            Any[0] |= Any[Index];
+        }
+
+        if (!Any[0])
+        {
+            continue;
+        }
+
+        for (Lane = 0; Lane < CH10_PCM_VECTOR_SIZE; Lane++)
+        {
+            if (!Hits[Lane])
+            {
+                continue;
+            }
+
+            for (Index = 7; Index >= 0; Index--)
+            {
+                Position = (Byte + Lane) * 8 - (__u64) Index;
+
+                if ((Byte + Lane) * 8 < (__u64) Index || Position < From || Position > Last)
+                {
+                    continue;
+                }
+
+                if ((Ch10PeekBits(Buffer, Position, Search->Bits) & Search->Mask) == Search->Pattern)
+                {
+                    return (__s64) Position;
+                }
+            }
+        }
+    }
+
+    return -1;
+}
+
+//
+// Fills in what a layout leaves open and checks that the rest fits
+//
+int
+Ch10CheckPcmLayout (
+    CH10_PCM_LAYOUT *Layout
+    )
+{
+    if (Layout->SyncBits == 0 || Layout->SyncBits > CH10_PCM_MAX_SYNC_BITS ||
+        Layout->WordBits == 0 || Layout->WordBits > CH10_PCM_MAX_WORD_BITS ||
+        (Layout->WordCount == 0 && Layout->FrameBits == 0))
+    {
+        return -EINVAL;
+    }
+
+    if (Layout->SyncMask == 0)
+    {
+        Layout->SyncMask = ~0ULL;
+    }
+
+    Layout->SyncMask &= (1ULL << Layout->SyncBits) - 1;
+    Layout->SyncPattern &= Layout->SyncMask;
+
+    if (Layout->FrameBits == 0)
+    {
+        Layout->FrameBits = Layout->SyncBits + (Layout->WordCount - 1) * Layout->WordBits;
+    }
+
+    if (Layout->FrameBits <= Layout->SyncBits || Layout->FrameBits > CH10_PCM_MAX_FRAME_BITS)
+    {
+        return -EINVAL;
+    }
+
+    if (Layout->WordCount == 0)
+    {
+        Layout->WordCount = 1 + (Layout->FrameBits - Layout->SyncBits) / Layout->WordBits;
+    }
+
+    if (Layout->MinorFrames == 0)
+    {
+        Layout->MinorFrames = 1;
+    }
+
+    if (Layout->SfidWord)
+    {
+        if (Layout->SfidBits == 0 && Layout->SfidBit < Layout->WordBits)
+        {
+            Layout->SfidBits = Layout->WordBits - Layout->SfidBit;
+        }
+
+        if (Layout->SfidWord < 2 || Layout->SfidWord > Layout->WordCount ||
+            Layout->SfidBits == 0 || Layout->SfidBit + Layout->SfidBits > Layout->WordBits ||
+            Layout->SyncBits + (Layout->SfidWord - 1) * Layout->WordBits > Layout->FrameBits)
+        {
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+int
+Ch10InitPcmDecoder (
+    CH10_PCM_DECODER        *Decoder,
+    const CH10_PCM_LAYOUT   *Layout
+    )
+{
+    int Status;
+
+    memset(Decoder, 0, sizeof(CH10_PCM_DECODER));
+
+    Decoder->Layout = *Layout;
+
+    Status = Ch10CheckPcmLayout(&Decoder->Layout);
+
+    if (!Status)
+    {
+        Status = Ch10InitPcmSearch(
+            &Decoder->Search,
+            Decoder->Layout.SyncPattern,
+            Decoder->Layout.SyncMask,
+            Decoder->Layout.SyncBits
+            );
+    }
+
+    return Status;
+}
+
+void
+Ch10FreePcmDecoder (
+    CH10_PCM_DECODER    *Decoder
+    )
+{
+    free(Decoder->Buffer);
+    Decoder->Buffer = NULL;
+    Decoder->Capacity = 0;
+}
+
+//
+// Starts a decoder over in State, or searching, with no bits held and the
+// next bit appended being bit Base of the stream
+//
+void
+Ch10ResetPcmDecoder (
+    CH10_PCM_DECODER        *Decoder,
+    const CH10_PCM_STATE    *State,
+    __u64                   Base
+    )
+{
+    if (State)
+    {
+        Decoder->State = *State;
+    }
+    else
+    {
+        memset(&Decoder->State, 0, sizeof(CH10_PCM_STATE));
+        Decoder->State.Next = Base;
+        Decoder->State.Keep = Base;
+    }
+
+    Decoder->Base = Base;
+    Decoder->End = Base;
+}
+
+//
+// Appends Bits bits of Data, in CH10_PCM_XXX order. Data in 16 bit words
+// must be whole words.
+//
+int
+Ch10AppendPcmBits (
+    CH10_PCM_DECODER    *Decoder,
+    const void          *Data,
+    __u64               Bits,
+    int                 Order
+    )
+{
+    const __u8  *Source = (const __u8 *) Data;
+    __u8        *Buffer;
+    __u8        *Target;
+    __u64       Held = Decoder->End - Decoder->Base;
+    size_t      Needed;
+    size_t      Capacity;
+    size_t      Bytes = (size_t) ((Bits + 7) >> 3);
+    size_t      Index;
+    __u32       Shift = (__u32) (Held & 7);
+    __u8        Value;
+
+    if (Order == CH10_PCM_SWAP_16 && (Bits & 15))
+    {
+        return -EINVAL;
+    }
+
+    Needed = (size_t) ((Held + Bits + 7) >> 3) + CH10_PCM_PADDING;
+
+    if (Needed > Decoder->Capacity)
+    {
+        for (Capacity = Decoder->Capacity ? Decoder->Capacity : 64 * 1024;
+             Capacity < Needed;
+             Capacity *= 2)
+            ;
+
+        Buffer = realloc(Decoder->Buffer, Capacity);
+
+        if (Buffer == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        Decoder->Buffer = Buffer;
+        Decoder->Capacity = Capacity;
+    }
+
+    Target = Decoder->Buffer + (Held >> 3);
+
+    if (Shift == 0 && Order == CH10_PCM_MSB_FIRST)
+    {
+        memcpy(Target, Source, Bytes);
+    }
+    else if (Shift == 0)
+    {
+        for (Index = 0; Index < Bytes; Index += 2)
+        {
+            Target[Index] = Source[Index + 1];
+            Target[Index + 1] = Source[Index];
+        }
+    }
+    else
+    {
+        //
+        // The bits of the last byte held that are past the end are zero,
+        // and are kept so
+        //
+        for (Index = 0; Index < Bytes; Index++)
+        {
+            Value = Source[Order == CH10_PCM_SWAP_16 ? Index ^ 1 : Index];
+
+            if (Index == Bytes - 1 && (Bits & 7))
+            {
+                Value &= (__u8) (0xff00 >> (Bits & 7));
+            }
+
+            Target[Index] |= (__u8) (Value >> Shift);
+            Target[Index + 1] = (__u8) (Value << (8 - Shift));
+        }
+    }
+
+    Decoder->End += Bits;
+
+    if ((Decoder->End - Decoder->Base) & 7)
+    {
+        Decoder->Buffer[(Decoder->End - Decoder->Base) >> 3] &=
+            (__u8) (0xff00 >> ((Decoder->End - Decoder->Base) & 7));
+    }
+
+    return 0;
+}
+
+//
+// Appends the low Bits bits of Value, 1 to 64
+//
+static int
+Ch10AppendPcmWord (
+    CH10_PCM_DECODER    *Decoder,
+    __u64               Value,
+    __u32               Bits
+    )
+{
+    Value = cpu_to_be64(Value << (64 - Bits));
+
+    return Ch10AppendPcmBits(Decoder, &Value, Bits, CH10_PCM_MSB_FIRST);
+}
+
+//
+// Bits bits, 1 to 32, at bit Position of the stream, which the decoder
+// must still hold
+//
+__u32
+Ch10GetPcmBits (
+    const CH10_PCM_DECODER  *Decoder,
+    __u64                   Position,
+    __u32                   Bits
+    )
+{
+    return (__u32) Ch10PeekBits(Decoder->Buffer, Position - Decoder->Base, Bits);
+}
+
+static __u32
+Ch10PcmSyncErrors (
+    const CH10_PCM_DECODER  *Decoder,
+    __u64                   Position
+    )
+{
+    __u64 Sync = Ch10PeekBits(Decoder->Buffer, Position - Decoder->Base, Decoder->Layout.SyncBits);
+
+    return (__u32) __builtin_popcountll((Sync ^ Decoder->Layout.SyncPattern) & Decoder->Layout.SyncMask);
+}
+
+//
+// Delivers the frames the bits held allow. Returns 0 when it needs more
+// bits, or what the callback returned when that was not 0.
+//
+int
+Ch10DecodePcm (
+    CH10_PCM_DECODER    *Decoder,
+    CH10_PCM_CALLBACK   Callback,
+    void                *Context
+    )
+{
+    CH10_PCM_LAYOUT *Layout = &Decoder->Layout;
+    CH10_PCM_STATE  *State = &Decoder->State;
+    CH10_PCM_FRAME  Frame;
+    __u64           Drop;
+    __s64           Found;
+    __u32           Errors;
+    __u32           Sfid;
+    int             Status = 0;
+
+    while (!Status)
+    {
+        if (State->State == CH10_PCM_SEARCHING)
+        {
+            Found = Ch10FindPcmSync(
+                &Decoder->Search,
+                Decoder->Buffer,
+                State->Next - Decoder->Base,
+                Decoder->End - Decoder->Base
+                );
+
+            if (Found < 0)
+            {
+                //
+                // A pattern may start in the last bits
+                //
+                if (Decoder->End >= Decoder->Base + Layout->SyncBits &&
+                    State->Next < Decoder->End - Layout->SyncBits + 1)
+                {
+                    State->Next = Decoder->End - Layout->SyncBits + 1;
+                }
+
+                break;
+            }
+
+            State->Next = Decoder->Base + (__u64) Found;
+            State->State = CH10_PCM_CHECKING;
+        }
+        else if (State->State == CH10_PCM_CHECKING)
+        {
+            if (State->Next + Layout->FrameBits + Layout->SyncBits > Decoder->End)
+            {
+                break;
+            }
+
+            if (Ch10PcmSyncErrors(Decoder, State->Next + Layout->FrameBits) > Layout->SyncErrors)
+            {
+                State->Next++;
+                State->State = CH10_PCM_SEARCHING;
+                continue;
+            }
+
+            State->State = CH10_PCM_LOCKED;
+            State->Misses = 0;
+            State->Locked = 0;
+            State->Minor = 0;
+        }
+        else
+        {
+            if (State->Next + Layout->FrameBits > Decoder->End)
+            {
+                break;
+            }
+
+            Frame.Position = State->Next;
+            Frame.Flags = 0;
+
+            Errors = Ch10PcmSyncErrors(Decoder, State->Next);
+
+            if (Errors <= Layout->SyncErrors)
+            {
+                State->Misses = 0;
+
+                if (Errors)
+                {
+                    Frame.Flags |= CH10_PCM_FRAME_SYNC_ERRORS;
+                }
+            }
+            else if (++State->Misses <= Layout->Flywheel)
+            {
+                Frame.Flags |= CH10_PCM_FRAME_FLYWHEEL;
+            }
+            else
+            {
+                //
+                // Lost, look again from the end of the last sync pattern
+                // that was taken
+                //
+                State->Next = State->Locked ?
+                    State->Next - Layout->FrameBits + Layout->SyncBits :
+                    State->Next + 1;
+                State->State = CH10_PCM_SEARCHING;
+                continue;
+            }
+
+            if (State->Locked == 0)
+            {
+                Frame.Flags |= CH10_PCM_FRAME_LOCKED;
+            }
+
+            Frame.Minor = State->Minor;
+
+            if (Layout->SfidWord)
+            {
+                Sfid = Ch10GetPcmBits(
+                    Decoder,
+                    State->Next + Layout->SyncBits +
+                        (Layout->SfidWord - 2) * Layout->WordBits + Layout->SfidBit,
+                    Layout->SfidBits
+                    );
+
+                Frame.Minor = (__u32) (((__u64) Sfid + Layout->MinorFrames -
+                                        Layout->SfidFirst % Layout->MinorFrames) %
+                                       Layout->MinorFrames);
+
+                if (State->Locked && Frame.Minor != State->Minor)
+                {
+                    Frame.Flags |= CH10_PCM_FRAME_SFID_ERROR;
+                }
+            }
+
+            State->Minor = (Frame.Minor + 1) % Layout->MinorFrames;
+            State->Next += Layout->FrameBits;
+            State->Frames++;
+            State->Locked++;
+
+            Status = Callback(Context, Decoder, &Frame);
+        }
+    }
+
+    //
+    // Keep what a lost lock would search again
+    //
+    State->Keep = State->State == CH10_PCM_LOCKED && State->Locked ?
+        State->Next - Layout->FrameBits + Layout->SyncBits :
+        State->Next;
+
+    if (State->Keep > Decoder->Base + 8 * CH10_PCM_PADDING)
+    {
+        Drop = (State->Keep - Decoder->Base) >> 3;
+
+        if (Drop * 8 >= Decoder->End - Decoder->Base)
+        {
+            Drop = (Decoder->End - Decoder->Base) >> 3;
+        }
+
+        memmove(
+            Decoder->Buffer,
+            Decoder->Buffer + Drop,
+            (size_t) (((Decoder->End - Decoder->Base + 7) >> 3) - Drop)
+            );
+
+        Decoder->Base += Drop * 8;
+    }
+
+    return Status;
+}
+
+//
+// TMATS setup records are lines of CODE:VALUE; attributes
+//
+static const char *
+Ch10NextTmatsAttribute (
+    const char  *Text,
+    const char  **Code,
+    size_t      *CodeLength,
+    const char  **Value,
+    size_t      *ValueLength
+    )
+{
+    const char *Colon;
+    const char *End;
+
+    for (;;)
+    {
+        while (*Text == ' ' || *Text == '\t' || *Text == '\r' || *Text == '\n')
+        {
+            Text++;
+        }
+
+        if (*Text == 0)
+        {
+            return NULL;
+        }
+
+        End = strchr(Text, ';');
+        Colon = strchr(Text, ':');
+
+        if (End == NULL)
+        {
+            return NULL;
+        }
+
+        if (Colon == NULL || Colon > End)
+        {
+            Text = End + 1;
+            continue;
+        }
+
+        *Code = Text;
+        *CodeLength = (size_t) (Colon - Text);
+        *Value = Colon + 1;
+        *ValueLength = (size_t) (End - Colon - 1);
+
+        return End + 1;
+    }
+}
+
+//
+// Copies the value of the attribute Code, returns -ENOENT when the setup
+// record does not have it
+//
+static int
+Ch10GetTmatsValue (
+    const char  *Text,
+    const char  *Code,
+    char        *Value,
+    size_t      Size
+    )
+{
+    const char  *AttributeCode;
+    const char  *AttributeValue;
+    size_t      CodeLength;
+    size_t      ValueLength;
+
+    while ((Text = Ch10NextTmatsAttribute(Text, &AttributeCode, &CodeLength, &AttributeValue, &ValueLength)))
+    {
+        if (CodeLength == strlen(Code) && !strncasecmp(AttributeCode, Code, CodeLength))
+        {
+            if (ValueLength >= Size)
+            {
+                ValueLength = Size - 1;
+            }
+
+            memcpy(Value, AttributeValue, ValueLength);
+            Value[ValueLength] = 0;
+
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+static int
+Ch10GetTmatsNumber (
+    const char  *Text,
+    const char  *Code,
+    __u32       *Number
+    )
+{
+    char    Value[32];
+    char    *End;
+
+    if (Ch10GetTmatsValue(Text, Code, Value, sizeof(Value)))
+    {
+        return -ENOENT;
+    }
+
+    *Number = (__u32) strtoul(Value, &End, 10);
+
+    return End == Value ? -EINVAL : 0;
+}
+
+//
+// Sync pattern as TMATS writes it, 0, 1 and X for a bit that does not care
+//
+static int
+Ch10ParseSyncPattern (
+    const char      *Text,
+    CH10_PCM_LAYOUT *Layout
+    )
+{
+    __u32 Bits = 0;
+
+    Layout->SyncPattern = 0;
+    Layout->SyncMask = 0;
+
+    for (; *Text && Bits <= CH10_PCM_MAX_SYNC_BITS; Text++)
+    {
+        if (*Text != '0' && *Text != '1' && *Text != 'x' && *Text != 'X')
+        {
+            return -EINVAL;
+        }
+
+        Layout->SyncPattern = Layout->SyncPattern << 1 | (*Text == '1');
+        Layout->SyncMask = Layout->SyncMask << 1 | (*Text == '0' || *Text == '1');
+        Bits++;
+    }
+
+    if (Bits == 0 || Bits > CH10_PCM_MAX_SYNC_BITS)
+    {
+        return -EINVAL;
+    }
+
+    Layout->SyncBits = Bits;
+
+    return 0;
+}
+
+static int
+Ch10FindTmats (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    char        **Text = (char **) Context;
+    const __u8  *Body = (const __u8 *) (Header + 1);
+    __u32       Length = le32_to_cpu(Header->dataLength);
+
+    (void) Offset;
+
+    if (Header->dataType != CH10_DATA_TMATS)
+    {
+        return 0;
+    }
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    if (Length < 4 || Length > CH10_TMATS_MAX_SIZE)
+    {
+        return -EINVAL;
+    }
+
+    *Text = malloc(Length - 4 + 1);
+
+    if (*Text == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    memcpy(*Text, Body + 4, Length - 4);
+    (*Text)[Length - 4] = 0;
+
+    return 1;
+}
+
+//
+// The layout of PCM channel ChannelId from the TMATS setup record of a
+// recording. The channel is found as R-x\TK1-n, its data link as
+// R-x\PDLN-n or R-x\DSI-n and the link as the P group with that P-d\DLN.
+// Returns -ENOENT when the recording has no setup record or the record
+// does not describe the channel.
+//
+int
+Ch10GetPcmLayout (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u16           ChannelId,
+    CH10_PCM_LAYOUT *Layout
+    )
+{
+    const struct ch10_index_packet  *Packets;
+    const struct ch10_packet_header *Header;
+    const char                      *Next;
+    const char                      *Code;
+    const char                      *Value;
+    char                            *Text = NULL;
+    char                            *Buffer = NULL;
+    char                            Attribute[64];
+    char                            Link[64];
+    char                            Name[64];
+    size_t                          CodeLength;
+    size_t                          ValueLength;
+    ssize_t                         Count;
+    ssize_t                         Result;
+    __u64                           Skipped = 0;
+    __u64                           Packet;
+    unsigned                        Group;
+    unsigned                        Number;
+    unsigned                        Channel;
+    int                             Used;
+    int                             Status = -ENOENT;
+
+    Count = Ch10GetFilePackets(Volume, Index, &Packets);
+
+    if (Count >= 0)
+    {
+        for (Packet = 0; Packet < (__u64) Count; Packet++)
+        {
+            if (Packets[Packet].dataType != CH10_DATA_TMATS)
+            {
+                continue;
+            }
+
+            Buffer = malloc(le32_to_cpu(Packets[Packet].packetLength));
+
+            if (Buffer == NULL)
+            {
+                return -ENOMEM;
+            }
+
+            Result = Ch10ReadFileData(
+                Volume,
+                Index,
+                le64_to_cpu(Packets[Packet].offset),
+                le32_to_cpu(Packets[Packet].packetLength),
+                Buffer
+                );
+
+            Header = (const struct ch10_packet_header *) Buffer;
+
+            if (Result < (ssize_t) le32_to_cpu(Packets[Packet].packetLength))
+            {
+                Status = Result < 0 ? (int) Result : -EIO;
+            }
+            else
+            {
+                Status = Ch10FindTmats(&Text, 0, Header);
+            }
+
+            free(Buffer);
+            break;
+        }
+    }
+    else
+    {
+        Status = Ch10ScanFile(Volume, Index, Ch10FindTmats, &Text, &Skipped);
+    }
+
+    if (Status < 0)
+    {
+        return Status;
+    }
+
+    if (Text == NULL)
+    {
+        return -ENOENT;
+    }
+
+    //
+    // The recorder channel and the name of its data link
+    //
+    Link[0] = 0;
+
+    for (Next = Text;
+         (Next = Ch10NextTmatsAttribute(Next, &Code, &CodeLength, &Value, &ValueLength)) && !Link[0];)
+    {
+        snprintf(Attribute, sizeof(Attribute), "%.*s", (int) CodeLength, Code);
+
+        if (sscanf(Attribute, "R-%u\\TK1-%u%n", &Group, &Number, &Used) != 2 ||
+            Used != (int) CodeLength ||
+            sscanf(Value, "%u", &Channel) != 1 ||
+            Channel != ChannelId)
+        {
+            continue;
+        }
+
+        snprintf(Attribute, sizeof(Attribute), "R-%u\\PDLN-%u", Group, Number);
+
+        if (Ch10GetTmatsValue(Text, Attribute, Link, sizeof(Link)))
+        {
+            snprintf(Attribute, sizeof(Attribute), "R-%u\\DSI-%u", Group, Number);
+
+            if (Ch10GetTmatsValue(Text, Attribute, Link, sizeof(Link)))
+            {
+                Link[0] = 0;
+            }
+        }
+    }
+
+    for (Group = 1; Link[0]; Group++)
+    {
+        snprintf(Attribute, sizeof(Attribute), "P-%u\\DLN", Group);
+
+        if (Ch10GetTmatsValue(Text, Attribute, Name, sizeof(Name)))
+        {
+            Group = 0;
+            break;
+        }
+
+        if (!strcmp(Name, Link))
+        {
+            break;
+        }
+    }
+
+    if (!Link[0] || Group == 0)
+    {
+        free(Text);
+        return -ENOENT;
+    }
+
+    memset(Layout, 0, sizeof(CH10_PCM_LAYOUT));
+
+    Layout->Flywheel = CH10_PCM_FLYWHEEL;
+
+    snprintf(Attribute, sizeof(Attribute), "P-%u\\MF5", Group);
+
+    Status = Ch10GetTmatsValue(Text, Attribute, Name, sizeof(Name));
+
+    if (!Status)
+    {
+        Status = Ch10ParseSyncPattern(Name, Layout);
+    }
+
+    snprintf(Attribute, sizeof(Attribute), "P-%u\\F1", Group);
+
+    if (!Status)
+    {
+        Status = Ch10GetTmatsNumber(Text, Attribute, &Layout->WordBits);
+    }
+
+    snprintf(Attribute, sizeof(Attribute), "P-%u\\MF1", Group);
+    Ch10GetTmatsNumber(Text, Attribute, &Layout->WordCount);
+
+    snprintf(Attribute, sizeof(Attribute), "P-%u\\MF2", Group);
+    Ch10GetTmatsNumber(Text, Attribute, &Layout->FrameBits);
+
+    snprintf(Attribute, sizeof(Attribute), "P-%u\\MF\\N", Group);
+    Ch10GetTmatsNumber(Text, Attribute, &Layout->MinorFrames);
+
+    snprintf(Attribute, sizeof(Attribute), "P-%u\\D2", Group);
+    Ch10GetTmatsNumber(Text, Attribute, &Layout->BitRate);
+
+    //
+    // The first subframe ID counter, its MSB is counted from 1
+    //
+    snprintf(Attribute, sizeof(Attribute), "P-%u\\IDC1-1", Group);
+
+    if (!Status && !Ch10GetTmatsNumber(Text, Attribute, &Layout->SfidWord))
+    {
+        snprintf(Attribute, sizeof(Attribute), "P-%u\\IDC3-1", Group);
+
+        if (!Ch10GetTmatsNumber(Text, Attribute, &Layout->SfidBit) && Layout->SfidBit)
+        {
+            Layout->SfidBit--;
+        }
+
+        snprintf(Attribute, sizeof(Attribute), "P-%u\\IDC4-1", Group);
+        Ch10GetTmatsNumber(Text, Attribute, &Layout->SfidBits);
+
+        snprintf(Attribute, sizeof(Attribute), "P-%u\\IDC6-1", Group);
+        Ch10GetTmatsNumber(Text, Attribute, &Layout->SfidFirst);
+    }
+
+    free(Text);
+
+    if (Status)
+    {
+        return -EINVAL;
+    }
+
+    return Ch10CheckPcmLayout(Layout);
+}
+
+//
+// Changes a layout as key=value,... says: sync=<pattern> in TMATS form or
+// as 0x<hex>, syncbits, word, words, frame, minor, sfid=<word>, sfidbit
+// (from 0), sfidbits, sfidfirst, rate, errors and flywheel
+//
+int
+Ch10ParsePcmLayout (
+    const char      *Spec,
+    CH10_PCM_LAYOUT *Layout
+    )
+{
+    char                Item[80];
+    char                *Value;
+    const char          *End;
+    unsigned long long  Number;
+    size_t              Length;
+    __u32               Digits;
+    int                 Status = 0;
+
+    for (; *Spec && !Status; Spec = *End ? End + 1 : End)
+    {
+        End = strchr(Spec, ',');
+
+        if (End == NULL)
+        {
+            End = Spec + strlen(Spec);
+        }
+
+        Length = (size_t) (End - Spec);
+
+        if (Length >= sizeof(Item))
+        {
+            return -EINVAL;
+        }
+
+        memcpy(Item, Spec, Length);
+        Item[Length] = 0;
+
+        Value = strchr(Item, '=');
+
+        if (Value == NULL)
+        {
+            return -EINVAL;
+        }
+
+        *Value++ = 0;
+
+        if (!strcmp(Item, "sync") && strncmp(Value, "0x", 2))
+        {
+            Status = Ch10ParseSyncPattern(Value, Layout);
+            continue;
+        }
+
+        Digits = (__u32) strlen(Value);
+        Number = strtoull(Value, &Value, 0);
+
+        if (*Value || (Number > 0xffffffffULL && strcmp(Item, "sync")))
+        {
+            return -EINVAL;
+        }
+
+        //
+        // A pattern in hex is as long as its digits unless syncbits says
+        //
+        if (!strcmp(Item, "sync"))
+        {
+            Layout->SyncPattern = Number;
+            Layout->SyncMask = 0;
+            Layout->SyncBits = (Digits - 2) * 4;
+        }
+        else if (!strcmp(Item, "syncbits"))     Layout->SyncBits = (__u32) Number;
+        else if (!strcmp(Item, "word"))         Layout->WordBits = (__u32) Number;
+        else if (!strcmp(Item, "words"))        Layout->WordCount = (__u32) Number;
+        else if (!strcmp(Item, "frame"))        Layout->FrameBits = (__u32) Number;
+        else if (!strcmp(Item, "minor"))        Layout->MinorFrames = (__u32) Number;
+        else if (!strcmp(Item, "sfid"))         Layout->SfidWord = (__u32) Number;
+        else if (!strcmp(Item, "sfidbit"))      Layout->SfidBit = (__u32) Number;
+        else if (!strcmp(Item, "sfidbits"))     Layout->SfidBits = (__u32) Number;
+        else if (!strcmp(Item, "sfidfirst"))    Layout->SfidFirst = (__u32) Number;
+        else if (!strcmp(Item, "rate"))         Layout->BitRate = (__u32) Number;
+        else if (!strcmp(Item, "errors"))       Layout->SyncErrors = (__u32) Number;
+        else if (!strcmp(Item, "flywheel"))     Layout->Flywheel = (__u32) Number;
+        else                                    return -EINVAL;
+    }
+
+    return Status;
+}
+
+//
+// Appends the bit stream of a PCM packet. Throughput mode data is the bit
+// stream itself. Packed and unpacked mode data are whole minor frames,
+// each after an intra-packet header when the packet has them and padded
+// to the alignment, with every word of an unpacked frame right aligned in
+// 16 bit words of its own.
+//
+static int
+Ch10AppendPcmPacket (
+    CH10_PCM_DECODER                *Decoder,
+    const struct ch10_packet_header *Header
+    )
+{
+    const CH10_PCM_LAYOUT   *Layout = &Decoder->Layout;
+    const __u8              *Body = (const __u8 *) (Header + 1);
+    __u32                   Length = le32_to_cpu(Header->dataLength);
+    __u32                   Csdw;
+    __u32                   Iph;
+    __u32                   Align;
+    __u32                   FrameBytes;
+    __u32                   Position;
+    __u32                   Word;
+    __u32                   Bits;
+    __u32                   Done;
+    __u32                   Units;
+    __u16                   Unit;
+    __u64                   Value;
+    int                     Status = 0;
+
+    if (Header->packetFlags & CH10_FLAG_SECONDARY_HEADER)
+    {
+        Body += CH10_SECONDARY_HEADER_SIZE;
+    }
+
+    if (Length < 4)
+    {
+        return 0;
+    }
+
+    memcpy(&Csdw, Body, sizeof(Csdw));
+    Csdw = le32_to_cpu(Csdw);
+
+    Body += 4;
+    Length -= 4;
+
+    if (!(Csdw & (CH10_PCM_CSDW_PACKED | CH10_PCM_CSDW_UNPACKED)))
+    {
+        return Ch10AppendPcmBits(Decoder, Body, (__u64) (Length & ~1) * 8, CH10_PCM_SWAP_16);
+    }
+
+    Iph = Csdw & CH10_PCM_CSDW_IPH ? CH10_PCM_IPH_SIZE(Csdw) : 0;
+    Align = Csdw & CH10_PCM_CSDW_ALIGN_32 ? 32 : 16;
+
+    //
+    // Bits of a frame as it is stored
+    //
+    if (Csdw & CH10_PCM_CSDW_PACKED)
+    {
+        FrameBytes = Layout->FrameBits;
+    }
+    else
+    {
+        FrameBytes = (Layout->SyncBits + 15) & ~15;
+
+        for (Done = Layout->SyncBits; Done < Layout->FrameBits; Done += Bits)
+        {
+            Bits = Layout->FrameBits - Done < Layout->WordBits ?
+                Layout->FrameBits - Done : Layout->WordBits;
+
+            FrameBytes += (Bits + 15) & ~15;
+        }
+    }
+
+    FrameBytes = ((FrameBytes + Align - 1) & ~(Align - 1)) / 8;
+
+    for (Position = Iph;
+         Position <= Length && Length - Position >= FrameBytes && !Status;
+         Position += FrameBytes + Iph)
+    {
+        Word = Position;
+
+        if (Csdw & CH10_PCM_CSDW_PACKED)
+        {
+            for (Done = 0; Done < Layout->FrameBits && !Status; Done += Bits, Word += 2)
+            {
+                Bits = Layout->FrameBits - Done < 16 ? Layout->FrameBits - Done : 16;
+
+                memcpy(&Unit, Body + Word, sizeof(Unit));
+
+                Status = Ch10AppendPcmWord(Decoder, le16_to_cpu(Unit) >> (16 - Bits), Bits);
+            }
+
+            continue;
+        }
+
+        for (Done = 0; Done < Layout->FrameBits && !Status; Done += Bits)
+        {
+            Bits = Done == 0 ? Layout->SyncBits :
+                Layout->FrameBits - Done < Layout->WordBits ?
+                    Layout->FrameBits - Done : Layout->WordBits;
+
+            for (Value = 0, Units = (Bits + 15) / 16; Units; Units--, Word += 2)
+            {
+                memcpy(&Unit, Body + Word, sizeof(Unit));
+
+                Value = Value << 16 | le16_to_cpu(Unit);
+            }
+
+            Status = Ch10AppendPcmWord(Decoder, Value & (~0ULL >> (64 - Bits)), Bits);
+        }
+    }
+
+    return Status;
+}
+
+static int
+Ch10PushPcmPacket (
+    CH10_PCM_BUILDER    *Builder,
+    __u64               Offset,
+    __u64               Rtc,
+    __u32               PacketLength
+    )
+{
+    CH10_PCM            *View = Builder->View;
+    CH10_PCM_PACKET     *Packets;
+    CH10_PCM_PACKET     *Packet;
+
+    if (View->Count == Builder->Capacity)
+    {
+        if (Builder->Capacity > 0x7fffffff / sizeof(CH10_PCM_PACKET))
+        {
+            return -ENOMEM;
+        }
+
+        Packets = realloc(
+            View->Packets,
+            (Builder->Capacity ? Builder->Capacity * 2 : 1024) * sizeof(CH10_PCM_PACKET)
+            );
+
+        if (Packets == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        View->Packets = Packets;
+        Builder->Capacity = Builder->Capacity ? Builder->Capacity * 2 : 1024;
+    }
+
+    Packet = &View->Packets[View->Count++];
+
+    memset(Packet, 0, sizeof(CH10_PCM_PACKET));
+
+    Packet->Offset = Offset;
+    Packet->Rtc = Rtc;
+    Packet->PacketLength = PacketLength;
+
+    return 0;
+}
+
+static int
+Ch10AddPcmPacket (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    CH10_PCM_BUILDER *Builder = (CH10_PCM_BUILDER *) Context;
+
+    if (Header->dataType != CH10_DATA_PCM_F1 ||
+        le16_to_cpu(Header->channelId) != Builder->View->ChannelId)
+    {
+        return 0;
+    }
+
+    return Ch10PushPcmPacket(Builder, Offset, Ch10GetRtc(Header), le32_to_cpu(Header->packetLength));
+}
+
+//
+// Appends a packet of the view, mapped when the device is
+//
+static int
+Ch10AppendViewPacket (
+    CH10_PCM            *View,
+    CH10_PCM_DECODER    *Decoder,
+    const CH10_PCM_PACKET *Packet,
+    __u8                **Buffer
+    )
+{
+    const struct ch10_packet_header *Header;
+    ssize_t                         Result;
+
+    Result = Ch10MapFileData(
+        View->Volume,
+        View->FileIndex,
+        Packet->Offset,
+        Packet->PacketLength,
+        (const void **) &Header
+        );
+
+    if (Result < (ssize_t) Packet->PacketLength)
+    {
+        if (*Buffer == NULL && (*Buffer = malloc(CH10_MAX_PACKET_SIZE)) == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        Result = Ch10ReadFileData(
+            View->Volume,
+            View->FileIndex,
+            Packet->Offset,
+            Packet->PacketLength,
+            *Buffer
+            );
+
+        Header = (const struct ch10_packet_header *) *Buffer;
+    }
+
+    if (Result < (ssize_t) Packet->PacketLength)
+    {
+        return Result < 0 ? (int) Result : -EIO;
+    }
+
+    return Ch10AppendPcmPacket(Decoder, Header);
+}
+
+static int
+Ch10CountPcmFrame (
+    void                *Context,
+    CH10_PCM_DECODER    *Decoder,
+    const CH10_PCM_FRAME *Frame
+    )
+{
+    CH10_PCM *View = (CH10_PCM *) Context;
+
+    (void) Decoder;
+
+    if (Frame->Flags & CH10_PCM_FRAME_LOCKED)
+    {
+        View->LockCount++;
+    }
+
+    if (Frame->Flags & CH10_PCM_FRAME_FLYWHEEL)
+    {
+        View->FlywheelCount++;
+    }
+
+    return 0;
+}
+
+//
+// Decodes PCM channel ChannelId of a recording with Layout, or with the
+// layout TMATS gives when Layout is NULL. Returns -ENOENT when the channel
+// has no PCM data.
+//
+int
+Ch10OpenPcm (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    __u16                   ChannelId,
+    const CH10_PCM_LAYOUT   *Layout,
+    CH10_PCM                **Result
+    )
+{
+    CH10_PCM                        *View;
+    CH10_PCM_BUILDER                Builder;
+    CH10_PCM_DECODER                Decoder;
+    CH10_PCM_PACKET                 *First;
+    CH10_PCM_PACKET                 *Last;
+    const struct ch10_index_packet  *Packets;
+    ssize_t                         Count;
+    __u8                            *Buffer = NULL;
+    __u64                           Skipped = 0;
+    __u64                           Packet;
+    int                             Status = 0;
+
+    if (Index >= Volume->FileCount)
+    {
+        return -EINVAL;
+    }
+
+    View = calloc(1, sizeof(CH10_PCM));
+
+    if (View == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    View->Volume = Volume;
+    View->FileIndex = Index;
+    View->ChannelId = ChannelId;
+
+    if (Layout)
+    {
+        View->Layout = *Layout;
+    }
+    else
+    {
+        Status = Ch10GetPcmLayout(Volume, Index, ChannelId, &View->Layout);
+    }
+
+    if (!Status)
+    {
+        Status = Ch10InitPcmDecoder(&Decoder, &View->Layout);
+        View->Layout = Decoder.Layout;
+    }
+
+    if (Status)
+    {
+        Ch10ClosePcm(View);
+        return Status;
+    }
+
+    Builder.View = View;
+    Builder.Capacity = 0;
+
+    Count = Ch10GetFilePackets(Volume, Index, &Packets);
+
+    if (Count >= 0)
+    {
+        for (Packet = 0; Packet < (__u64) Count && !Status; Packet++)
+        {
+            if (Packets[Packet].dataType == CH10_DATA_PCM_F1 &&
+                le16_to_cpu(Packets[Packet].channelId) == ChannelId)
+            {
+                Status = Ch10PushPcmPacket(
+                    &Builder,
+                    le64_to_cpu(Packets[Packet].offset),
+                    le64_to_cpu(Packets[Packet].rtc),
+                    le32_to_cpu(Packets[Packet].packetLength)
+                    );
+            }
+        }
+    }
+    else
+    {
+        Status = Ch10ScanFile(Volume, Index, Ch10AddPcmPacket, &Builder, &Skipped);
+    }
+
+    if (!Status && View->Count == 0)
+    {
+        Status = -ENOENT;
+    }
+
+    if (!Status)
+    {
+        Status = Ch10BuildTimeTable(Volume, Index, &View->Time);
+    }
+
+    //
+    // Decode the channel once, remembering the decoder in front of every
+    // packet
+    //
+    Ch10ResetPcmDecoder(&Decoder, NULL, 0);
+
+    for (Packet = 0; Packet < View->Count && !Status; Packet++)
+    {
+        View->Packets[Packet].Position = Decoder.End;
+        View->Packets[Packet].State = Decoder.State;
+
+        Status = Ch10AppendViewPacket(View, &Decoder, &View->Packets[Packet], &Buffer);
+
+        if (!Status)
+        {
+            Status = Ch10DecodePcm(&Decoder, Ch10CountPcmFrame, View);
+        }
+    }
+
+    View->Bits = Decoder.End;
+    View->RecordCount = Decoder.State.Frames;
+
+    Ch10FreePcmDecoder(&Decoder);
+    free(Buffer);
+
+    if (Status)
+    {
+        Ch10ClosePcm(View);
+        return Status;
+    }
+
+    //
+    // Without a rate from TMATS the packet times give one
+    //
+    View->BitRate = View->Layout.BitRate;
+
+    First = &View->Packets[0];
+    Last = &View->Packets[View->Count - 1];
+
+    if (View->BitRate == 0 && Last->Rtc > First->Rtc)
+    {
+        View->BitRate = (__u32) ((Last->Position - First->Position) * CH10_RTC_HZ /
+                                 (Last->Rtc - First->Rtc));
+    }
+
+    if (View->Time.Count && !(View->Time.Points[0].Flags & CH10_TIME_YEAR))
+    {
+        View->Epoch = Ch10GetEpoch(Volume->Files[Index].DirEntry);
+    }
+
+    View->DataWords = View->Layout.WordCount - 1;
+
+    if (View->DataWords > (View->Layout.FrameBits - View->Layout.SyncBits) / View->Layout.WordBits)
+    {
+        View->DataWords = (View->Layout.FrameBits - View->Layout.SyncBits) / View->Layout.WordBits;
+    }
+
+    View->WordBytes = View->Layout.WordBits > 16 ? 4 : 2;
+    View->RecordSize = (__u32) ((sizeof(CH10_PCM_RECORD) + View->DataWords * View->WordBytes + 7) & ~7);
+    View->Size = View->RecordCount * View->RecordSize;
+
+    *Result = View;
+
+    return 0;
+}
+
+void
+Ch10ClosePcm (
+    CH10_PCM    *View
+    )
+{
+    Ch10FreeTimeTable(&View->Time);
+    free(View->Packets);
+    free(View);
+}
+
+//
+// Fills in the record of a frame and copies the part of it in the range
+//
+static int
+Ch10CopyPcmRecord (
+    void                *Context,
+    CH10_PCM_DECODER    *Decoder,
+    const CH10_PCM_FRAME *Frame
+    )
+{
+    CH10_PCM_READER         *Reader = (CH10_PCM_READER *) Context;
+    CH10_PCM                *View = Reader->View;
+    const CH10_PCM_LAYOUT   *Layout = &Decoder->Layout;
+    CH10_PCM_RECORD         Record;
+    __u8                    *Words = Reader->Record + sizeof(CH10_PCM_RECORD);
+    __u64                   Number = Decoder->State.Frames - 1;
+    __u64                   Position = Number * View->RecordSize;
+    __u64                   Start;
+    __u64                   End;
+    __u64                   Rtc;
+    __u64                   Time;
+    __u64                   Bit;
+    __u32                   Low = 0;
+    __u32                   High = View->Count;
+    __u32                   Middle;
+    __u32                   Word;
+    __u32                   Value;
+    __u16                   Value16;
+
+    Start = Position > Reader->Offset ? Position : Reader->Offset;
+    End = Position + View->RecordSize < Reader->Offset + Reader->Length ?
+        Position + View->RecordSize : Reader->Offset + Reader->Length;
+
+    if (Start < End)
+    {
+        //
+        // The time of the frame from the packet its first bit came in
+        //
+        while (Low < High)
+        {
+            Middle = Low + (High - Low) / 2;
+
+            if (View->Packets[Middle].Position <= Frame->Position)
+            {
+                Low = Middle + 1;
+            }
+            else
+            {
+                High = Middle;
+            }
+        }
+
+        Rtc = View->Packets[Low ? Low - 1 : 0].Rtc;
+
+        if (View->BitRate)
+        {
+            Rtc += (Frame->Position - View->Packets[Low ? Low - 1 : 0].Position) *
+                CH10_RTC_HZ / View->BitRate;
+        }
+
+        if (Ch10RtcToTime(&View->Time, Rtc, &Time))
+        {
+            Time = 0;
+        }
+        else
+        {
+            Time += View->Epoch;
+        }
+
+        Record.Rtc = cpu_to_le64(Rtc);
+        Record.Time = cpu_to_le64(Time);
+        Record.Minor = cpu_to_le32(Frame->Minor);
+        Record.Flags = cpu_to_le32(Frame->Flags);
+
+        memcpy(Reader->Record, &Record, sizeof(Record));
+
+        Bit = Frame->Position + Layout->SyncBits;
+
+        for (Word = 0; Word < View->DataWords; Word++, Bit += Layout->WordBits)
+        {
+            Value = Ch10GetPcmBits(Decoder, Bit, Layout->WordBits);
+
+            if (View->WordBytes == 2)
+            {
+                Value16 = cpu_to_le16((__u16) Value);
+                memcpy(Words + Word * 2, &Value16, 2);
+            }
+            else
+            {
+                Value = cpu_to_le32(Value);
+                memcpy(Words + Word * 4, &Value, 4);
+            }
+        }
+
+        memcpy(Reader->Buffer + (Start - Reader->Offset), Reader->Record + (Start - Position), End - Start);
+    }
+
+    return Number >= Reader->Last ? 1 : 0;
+}
+
+//
+// Reads the records, the whole range up to the end of the stream
+//
+ssize_t
+Ch10ReadPcm (
+    CH10_PCM    *View,
+    __u64       Offset,
+    size_t      Length,
+    void        *Buffer
+    )
+{
+    CH10_PCM_DECODER    Decoder;
+    CH10_PCM_READER     Reader;
+    CH10_PCM_PACKET     *Packet;
+    __u8                *PacketBuffer = NULL;
+    __u64               First;
+    __u32               Low = 0;
+    __u32               High = View->Count;
+    __u32               Middle;
+    __u32               Start;
+    __u32               Number;
+    int                 Status;
+
+    if (Offset >= View->Size || Length == 0)
+    {
+        return 0;
+    }
+
+    if (Length > View->Size - Offset)
+    {
+        Length = (size_t) (View->Size - Offset);
+    }
+
+    First = Offset / View->RecordSize;
+
+    Reader.View = View;
+    Reader.Buffer = (__u8 *) Buffer;
+    Reader.Offset = Offset;
+    Reader.Length = Length;
+    Reader.Last = (Offset + Length - 1) / View->RecordSize;
+    Reader.Record = calloc(1, View->RecordSize);
+
+    if (Reader.Record == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    //
+    // Last packet in front of which the first record was still to come,
+    // and the packet holding the first bit the decoder needed then
+    //
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        if (View->Packets[Middle].State.Frames <= First)
+        {
+            Low = Middle + 1;
+        }
+        else
+        {
+            High = Middle;
+        }
+    }
+
+    Packet = &View->Packets[Low ? Low - 1 : 0];
+
+    for (Start = (__u32) (Packet - View->Packets);
+         Start > 0 && View->Packets[Start].Position > Packet->State.Keep;
+         Start--)
+        ;
+
+    Status = Ch10InitPcmDecoder(&Decoder, &View->Layout);
+
+    if (!Status)
+    {
+        Ch10ResetPcmDecoder(&Decoder, &Packet->State, View->Packets[Start].Position);
+    }
+
+    for (Number = Start; Number < (__u32) (Packet - View->Packets) && !Status; Number++)
+    {
+        Status = Ch10AppendViewPacket(View, &Decoder, &View->Packets[Number], &PacketBuffer);
+    }
+
+    for (; Number < View->Count && !Status; Number++)
+    {
+        Status = Ch10AppendViewPacket(View, &Decoder, &View->Packets[Number], &PacketBuffer);
+
+        if (!Status)
+        {
+            Status = Ch10DecodePcm(&Decoder, Ch10CopyPcmRecord, &Reader);
+        }
+    }
+
+    Ch10FreePcmDecoder(&Decoder);
+    free(PacketBuffer);
+    free(Reader.Record);
+
+    if (Status < 0)
+    {
+        return Status;
+    }
+
+    //
+    // The recording changed under the view
+    //
+    if (Decoder.State.Frames <= Reader.Last)
+    {
+        return -EIO;
+    }
+
+    return (ssize_t) Length;
+}
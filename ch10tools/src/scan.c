@@ -0,0 +1,525 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+//
+// A range of a recording scanned by one of the threads of a parallel scan.
+// The window holds the range and CH10_MAX_PACKET_SIZE bytes after it, so
+// every packet starting in the range is whole. Positions are of the
+// packets the thread found by following packet lengths from the first
+// valid header in the range.
+//
+typedef struct _CH10_SCAN_RANGE {
+
+    // Range number the slot holds, and whether it is done
+    __u64                       Number;
+    int                         Done;
+    int                         Status;
+
+    __u64                       Start;
+    size_t                      Length;
+
+    const char*                 Window;
+    size_t                      WindowLength;
+    char*                       Buffer;
+
+    __u32*                      Positions;
+    size_t                      PositionCount;
+    size_t                      PositionCapacity;
+
+} CH10_SCAN_RANGE;
+
+typedef struct _CH10_SCAN_CONTEXT {
+
+    CH10_VOLUME*                Volume;
+    __u32                       Index;
+    __u64                       Size;
+
+    // Ranges are scanned into SlotCount slots in turn, range N into slot N
+    // modulo SlotCount once range N - SlotCount has been consumed
+    CH10_SCAN_RANGE*            Slots;
+    __u32                       SlotCount;
+    __u64                       RangeCount;
+    __u64                       NextRange;
+    __u64                       Consumed;
+    int                         Stop;
+
+    pthread_mutex_t             Lock;
+    pthread_cond_t              Changed;
+
+} CH10_SCAN_CONTEXT;
+
+static int
+Ch10FillScanRange (
+    CH10_SCAN_CONTEXT   *Context,
+    CH10_SCAN_RANGE     *Range
+    )
+{
+    const struct ch10_packet_header *Header;
+    __u32                           *Positions;
+    size_t                          Wanted;
+    size_t                          Position;
+    size_t                          Found;
+    ssize_t                         Result = 0;
+
+    Wanted = (size_t) (Context->Size - Range->Start);
+
+    if (Wanted > Range->Length + CH10_MAX_PACKET_SIZE)
+    {
+        Wanted = Range->Length + CH10_MAX_PACKET_SIZE;
+    }
+
+    //
+    // A mapped recording is scanned in place unless the range crosses a
+    // stripe unit
+    //
+    if (Context->Volume->Device.Map)
+    {
+        Result = Ch10MapFileData(
+            Context->Volume,
+            Context->Index,
+            Range->Start,
+            Wanted,
+            (const void **) &Range->Window
+            );
+    }
+
+    if (Result != (ssize_t) Wanted)
+    {
+        if (Range->Buffer == NULL)
+        {
+            Range->Buffer = Ch10AllocateAligned(CH10_SCAN_SPLIT + CH10_MAX_PACKET_SIZE);
+
+            if (Range->Buffer == NULL)
+            {
+                return -ENOMEM;
+            }
+        }
+
+        for (Position = 0; Position < Wanted; Position += (size_t) Result)
+        {
+            Result = Ch10ReadFileData(
+                Context->Volume,
+                Context->Index,
+                Range->Start + Position,
+                Wanted - Position,
+                Range->Buffer + Position
+                );
+
+            if (Result <= 0)
+            {
+                return Result ? (int) Result : -EIO;
+            }
+        }
+
+        Range->Window = Range->Buffer;
+    }
+
+    Range->WindowLength = Wanted;
+    Range->PositionCount = 0;
+
+    for (Position = 0;;)
+    {
+        Found = Position;
+
+        if (Ch10FindPacket(Range->Window, Range->WindowLength, &Found) ||
+            Found >= Range->Length)
+        {
+            break;
+        }
+
+        if (Range->PositionCount == Range->PositionCapacity)
+        {
+            Positions = realloc(
+                Range->Positions,
+                (Range->PositionCapacity ? Range->PositionCapacity * 2 : 4096) * sizeof(__u32)
+                );
+
+            if (Positions == NULL)
+            {
+                return -ENOMEM;
+            }
+
+            Range->Positions = Positions;
+            Range->PositionCapacity = Range->PositionCapacity ? Range->PositionCapacity * 2 : 4096;
+        }
+
+        Range->Positions[Range->PositionCount++] = (__u32) Found;
+
+        Header = (const struct ch10_packet_header *) (Range->Window + Found);
+        Position = Found + le32_to_cpu(Header->packetLength);
+    }
+
+    return 0;
+}
+
+static void *
+Ch10ScanThread (
+    void *Parameter
+    )
+{
+    CH10_SCAN_CONTEXT   *Context = (CH10_SCAN_CONTEXT *) Parameter;
+    CH10_SCAN_RANGE     *Range;
+    __u64               Number;
+    int                 Status;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&Context->Lock);
+
+        while (!Context->Stop &&
+               Context->NextRange < Context->RangeCount &&
+               Context->NextRange >= Context->Consumed + Context->SlotCount)
+        {
+            pthread_cond_wait(&Context->Changed, &Context->Lock);
+        }
+
+        if (Context->Stop || Context->NextRange == Context->RangeCount)
+        {
+            pthread_mutex_unlock(&Context->Lock);
+            break;
+        }
+
+        Number = Context->NextRange++;
+        Range = &Context->Slots[Number % Context->SlotCount];
+
+        pthread_mutex_unlock(&Context->Lock);
+
+        Range->Start = Number * CH10_SCAN_SPLIT;
+        Range->Length = CH10_SCAN_SPLIT;
+
+        if (Range->Length > Context->Size - Range->Start)
+        {
+            Range->Length = (size_t) (Context->Size - Range->Start);
+        }
+
+        Status = Ch10FillScanRange(Context, Range);
+
+        pthread_mutex_lock(&Context->Lock);
+
+        Range->Number = Number;
+        Range->Status = Status;
+        Range->Done = 1;
+
+        pthread_cond_broadcast(&Context->Changed);
+        pthread_mutex_unlock(&Context->Lock);
+    }
+
+    return NULL;
+}
+
+//
+// Ch10ScanFile split over Volume->ScanThreads threads. Each thread takes
+// the next CH10_SCAN_SPLIT byte range, reads it and finds its packets by
+// resynchronizing on the first valid header in it, which is the sync
+// pattern confirmed by the header checksum, and following the packet
+// lengths from there. The calling thread takes the ranges in order and
+// stitches them: packets before the end of the last one it passed on
+// belong to that one and are dropped, and where the chain of the range
+// does not pass through that end it resynchronizes from there the way a
+// single pass would until the two meet. The callback sees the same packets
+// in the same order as with one pass, on the calling thread.
+//
+static int
+Ch10ScanParallel (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    CH10_PACKET_CALLBACK    Callback,
+    void                    *Context,
+    __u64                   *Skipped
+    )
+{
+    CH10_SCAN_CONTEXT               Scan;
+    CH10_SCAN_RANGE                 *Range;
+    const struct ch10_packet_header *Header;
+    pthread_t                       *Threads;
+    __u32                           ThreadCount = Volume->ScanThreads;
+    __u32                           Started;
+    __u64                           Number;
+    __u64                           Next = 0;
+    size_t                          Position;
+    size_t                          Found;
+    int                             Status = 0;
+
+    memset(&Scan, 0, sizeof(Scan));
+
+    Scan.Volume = Volume;
+    Scan.Index = Index;
+    Scan.Size = Volume->Files[Index].Size;
+    Scan.RangeCount = (Scan.Size + CH10_SCAN_SPLIT - 1) / CH10_SCAN_SPLIT;
+    Scan.SlotCount = ThreadCount * 2;
+
+    Scan.Slots = calloc(Scan.SlotCount, sizeof(CH10_SCAN_RANGE));
+    Threads = calloc(ThreadCount, sizeof(pthread_t));
+
+    if (Scan.Slots == NULL || Threads == NULL)
+    {
+        free(Scan.Slots);
+        free(Threads);
+        return -ENOMEM;
+    }
+
+    pthread_mutex_init(&Scan.Lock, NULL);
+    pthread_cond_init(&Scan.Changed, NULL);
+
+    for (Started = 0; Started < ThreadCount; Started++)
+    {
+        if (pthread_create(&Threads[Started], NULL, Ch10ScanThread, &Scan))
+        {
+            break;
+        }
+    }
+
+    if (Started == 0)
+    {
+        Status = -EAGAIN;
+    }
+
+    for (Number = 0; Number < Scan.RangeCount && !Status; Number++)
+    {
+        Range = &Scan.Slots[Number % Scan.SlotCount];
+
+        pthread_mutex_lock(&Scan.Lock);
+
+        while (!Range->Done || Range->Number != Number)
+        {
+            pthread_cond_wait(&Scan.Changed, &Scan.Lock);
+        }
+
+        pthread_mutex_unlock(&Scan.Lock);
+
+        Status = Range->Status;
+        Position = 0;
+
+        while (!Status && Next < Range->Start + Range->Length)
+        {
+            while (Position < Range->PositionCount &&
+                   Range->Start + Range->Positions[Position] < Next)
+            {
+                Position++;
+            }
+
+            if (Position < Range->PositionCount &&
+                Range->Start + Range->Positions[Position] == Next)
+            {
+                Found = Range->Positions[Position++];
+            }
+            else
+            {
+                //
+                // Nothing was found before the range from Next on
+                //
+                Found = Next > Range->Start ? (size_t) (Next - Range->Start) : 0;
+
+                if (Ch10FindPacket(Range->Window, Range->WindowLength, &Found))
+                {
+                    //
+                    // A packet running past the end of the recording ends
+                    // the scan, as it does a single pass
+                    //
+                    if (Found < Range->Length && Range->Start + Range->WindowLength == Scan.Size)
+                    {
+                        *Skipped += Scan.Size - Next;
+                        Next = Scan.Size;
+                    }
+
+                    break;
+                }
+
+                if (Found >= Range->Length)
+                {
+                    break;
+                }
+            }
+
+            *Skipped += Range->Start + Found - Next;
+
+            Header = (const struct ch10_packet_header *) (Range->Window + Found);
+
+            Status = Callback(Context, Range->Start + Found, Header);
+
+            Next = Range->Start + Found + le32_to_cpu(Header->packetLength);
+        }
+
+        pthread_mutex_lock(&Scan.Lock);
+
+        Range->Done = 0;
+        Scan.Consumed++;
+
+        pthread_cond_broadcast(&Scan.Changed);
+        pthread_mutex_unlock(&Scan.Lock);
+    }
+
+    pthread_mutex_lock(&Scan.Lock);
+
+    Scan.Stop = 1;
+
+    pthread_cond_broadcast(&Scan.Changed);
+    pthread_mutex_unlock(&Scan.Lock);
+
+    while (Started)
+    {
+        pthread_join(Threads[--Started], NULL);
+    }
+
+    if (!Status && Next < Scan.Size)
+    {
+        *Skipped += Scan.Size - Next;
+    }
+
+    for (Number = 0; Number < Scan.SlotCount; Number++)
+    {
+        free(Scan.Slots[Number].Buffer);
+        free(Scan.Slots[Number].Positions);
+    }
+
+    pthread_cond_destroy(&Scan.Changed);
+    pthread_mutex_destroy(&Scan.Lock);
+
+    free(Scan.Slots);
+    free(Threads);
+
+    return Status;
+}
+
+//
+// Walks a recording packet by packet in one streaming pass, resynchronizing
+// on the next valid header after damage, and calls Callback for every
+// packet with a valid header. A mapped device is scanned in place, any
+// other one is read CH10_SCAN_WINDOW bytes at a time. Bytes that are not
+// part of a valid packet are added to *Skipped. A callback returning
+// anything but 0 stops the scan with that value. A recording of more than
+// two ranges is scanned by Ch10ScanParallel when the volume allows more
+// than one scan thread.
+//
+int
+Ch10ScanFile (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    CH10_PACKET_CALLBACK    Callback,
+    void                    *Context,
+    __u64                   *Skipped
+    )
+{
+    CH10_FILE                       *File;
+    const struct ch10_packet_header *Header;
+    const char                      *Window;
+    char                            *Buffer = NULL;
+    size_t                          WindowLength;
+    size_t                          Offset;
+    size_t                          Found;
+    __u64                           WindowOffset = 0;
+    ssize_t                         Result;
+    int                             Status = 0;
+
+    if (Index >= Volume->FileCount)
+    {
+        return -EINVAL;
+    }
+
+    File = &Volume->Files[Index];
+
+    if (Volume->ScanThreads > 1 && File->Size > 2 * (__u64) CH10_SCAN_SPLIT)
+    {
+        return Ch10ScanParallel(Volume, Index, Callback, Context, Skipped);
+    }
+
+    if (Volume->Device.Map == NULL)
+    {
+        Buffer = Ch10AllocateAligned(CH10_SCAN_WINDOW);
+
+        if (Buffer == NULL)
+        {
+            return -ENOMEM;
+        }
+    }
+
+    while (WindowOffset < File->Size)
+    {
+        if (Volume->Device.Map)
+        {
+            Result = Ch10MapFileData(
+                Volume,
+                Index,
+                WindowOffset,
+                (size_t) (File->Size - WindowOffset),
+                (const void **) &Window
+                );
+        }
+        else
+        {
+            Result = Ch10ReadFileData(Volume, Index, WindowOffset, CH10_SCAN_WINDOW, Buffer);
+            Window = Buffer;
+        }
+
+        if (Result <= 0)
+        {
+            Status = Result ? (int) Result : -EIO;
+            break;
+        }
+
+        WindowLength = (size_t) Result;
+
+        for (Offset = 0;;)
+        {
+            Found = Offset;
+            Status = Ch10FindPacket(Window, WindowLength, &Found);
+
+            *Skipped += Found - Offset;
+            Offset = Found;
+
+            if (Status)
+            {
+                break;
+            }
+
+            Header = (const struct ch10_packet_header *) (Window + Offset);
+
+            Status = Callback(Context, WindowOffset + Offset, Header);
+
+            if (Status)
+            {
+                free(Buffer);
+                return Status;
+            }
+
+            Offset += le32_to_cpu(Header->packetLength);
+        }
+
+        Status = 0;
+
+        if (Offset == 0 || WindowOffset + WindowLength >= File->Size)
+        {
+            *Skipped += WindowLength - Offset;
+            Offset = WindowLength;
+        }
+
+        WindowOffset += Offset;
+    }
+
+    free(Buffer);
+
+    return Status;
+}
@@ -0,0 +1,551 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+//
+// Time correlation. Packet headers only carry the relative time counter,
+// absolute time comes from the time packets. The table of a recording
+// holds one point per time packet, taken from the packets listed in the
+// index sidecar when there is one and from a scan of the recording
+// otherwise. Conversions interpolate between neighbouring points in
+// integer arithmetic, the same as the driver does.
+//
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+//
+// Points further apart than this are not interpolated between, the
+// counter rate is used instead. It keeps the products of the
+// interpolation within 64 bits.
+//
+#define CH10_TIME_MAX_SEGMENT   (3600 * CH10_RTC_HZ)
+
+//
+// Enough of a time packet to decode it
+//
+#define CH10_TIME_PACKET_READ   (CH10_PACKET_HEADER_SIZE + \
+                                 CH10_SECONDARY_HEADER_SIZE + \
+                                 sizeof(struct ch10_time_f1))
+
+typedef struct _CH10_TIME_BUILDER {
+    CH10_TIME_TABLE *Table;
+    __u32           Capacity;
+} CH10_TIME_BUILDER;
+
+static int
+Ch10AddTimePoint (
+    void                            *Context,
+    __u64                           Offset,
+    const struct ch10_packet_header *Header
+    )
+{
+    CH10_TIME_BUILDER   *Builder = (CH10_TIME_BUILDER *) Context;
+    CH10_TIME_TABLE     *Table = Builder->Table;
+    CH10_TIME_POINT     *Points;
+    CH10_TIME_POINT     *Point;
+    __u64               Time;
+    __u32               Csdw;
+
+    //
+    // A time packet without a valid time is left out
+    //
+    if (Header->dataType != CH10_DATA_TIME_F1 ||
+        Ch10DecodeTime(Header, &Time, &Csdw))
+    {
+        return 0;
+    }
+
+    if (Table->Count == Builder->Capacity)
+    {
+        if (Builder->Capacity > 0x7fffffff / sizeof(CH10_TIME_POINT))
+        {
+            return -ENOMEM;
+        }
+
+        Points = realloc(
+            Table->Points,
+            (Builder->Capacity ? Builder->Capacity * 2 : 1024) * sizeof(CH10_TIME_POINT)
+            );
+
+        if (Points == NULL)
+        {
+            return -ENOMEM;
+        }
+
+        Table->Points = Points;
+        Builder->Capacity = Builder->Capacity ? Builder->Capacity * 2 : 1024;
+    }
+
+    Point = &Table->Points[Table->Count++];
+
+    memset(Point, 0, sizeof(*Point));
+
+    Point->Rtc = Ch10GetRtc(Header);
+    Point->Time = Time;
+    Point->Offset = Offset;
+    Point->Format = (__u8) CH10_TIME_CSDW_FMT(Csdw);
+    Point->Source = (__u8) CH10_TIME_CSDW_SRC(Csdw);
+
+    if (Csdw & CH10_TIME_CSDW_DMY)
+    {
+        Point->Flags |= CH10_TIME_YEAR;
+    }
+
+    return 0;
+}
+
+//
+// Visits only the time packets of a recording listed in the sidecar
+//
+static int
+Ch10AddIndexedTimes (
+    CH10_VOLUME                     *Volume,
+    __u32                           Index,
+    const struct ch10_index_packet  *Packets,
+    __u64                           Count,
+    CH10_TIME_BUILDER               *Builder
+    )
+{
+    __u8                            Buffer[CH10_TIME_PACKET_READ];
+    const struct ch10_packet_header *Header = (const struct ch10_packet_header *) Buffer;
+    __u64                           Packet;
+    __u32                           Length;
+    ssize_t                         Result;
+    int                             Status;
+
+    for (Packet = 0; Packet < Count; Packet++)
+    {
+        if (Packets[Packet].dataType != CH10_DATA_TIME_F1)
+        {
+            continue;
+        }
+
+        Length = le32_to_cpu(Packets[Packet].packetLength);
+
+        if (Length > sizeof(Buffer))
+        {
+            Length = sizeof(Buffer);
+        }
+
+        Result = Ch10ReadFileData(
+            Volume,
+            Index,
+            le64_to_cpu(Packets[Packet].offset),
+            Length,
+            Buffer
+            );
+
+        if (Result < 0)
+        {
+            return (int) Result;
+        }
+
+        if ((size_t) Result < Length ||
+            Length < CH10_PACKET_HEADER_SIZE ||
+            Ch10CheckPacketHeader(Header))
+        {
+            return -EIO;
+        }
+
+        memset(Buffer + Length, 0, sizeof(Buffer) - Length);
+
+        Status = Ch10AddTimePoint(Builder, le64_to_cpu(Packets[Packet].offset), Header);
+
+        if (Status)
+        {
+            return Status;
+        }
+    }
+
+    return 0;
+}
+
+static int
+Ch10IsTimeJump (
+    const CH10_TIME_POINT   *Before,
+    const CH10_TIME_POINT   *After
+    )
+{
+    __u64 Elapsed;
+    __u64 Gap;
+    __u64 Error;
+
+    if (After->Rtc <= Before->Rtc ||
+        After->Time < Before->Time ||
+        ((Before->Flags ^ After->Flags) & CH10_TIME_YEAR))
+    {
+        return 1;
+    }
+
+    Elapsed = After->Rtc - Before->Rtc;
+    Gap = After->Time - Before->Time;
+    Error = Gap > Elapsed ? Gap - Elapsed : Elapsed - Gap;
+
+    return Error > CH10_TIME_JUMP_TOLERANCE + Elapsed / 1000000 * CH10_TIME_JUMP_PPM;
+}
+
+//
+// Builds the time correlation of a recording in one pass
+//
+int
+Ch10BuildTimeTable (
+    CH10_VOLUME             *Volume,
+    __u32                   Index,
+    CH10_TIME_TABLE         *Table
+    )
+{
+    CH10_TIME_BUILDER               Builder;
+    const struct ch10_index_packet  *Packets;
+    CH10_TIME_POINT                 *Point;
+    ssize_t                         Count;
+    __u64                           Skipped = 0;
+    __u32                           Number;
+    int                             Status;
+
+    memset(Table, 0, sizeof(*Table));
+
+    Builder.Table = Table;
+    Builder.Capacity = 0;
+
+    Count = Ch10GetFilePackets(Volume, Index, &Packets);
+
+    if (Count >= 0)
+    {
+        Status = Ch10AddIndexedTimes(Volume, Index, Packets, (__u64) Count, &Builder);
+    }
+    else
+    {
+        Status = Ch10ScanFile(Volume, Index, Ch10AddTimePoint, &Builder, &Skipped);
+    }
+
+    if (Status)
+    {
+        Ch10FreeTimeTable(Table);
+        return Status;
+    }
+
+    Table->RtcSorted = 1;
+    Table->TimeSorted = 1;
+
+    for (Number = 1; Number < Table->Count; Number++)
+    {
+        Point = &Table->Points[Number];
+
+        if (Ch10IsTimeJump(Point - 1, Point))
+        {
+            Point->Flags |= CH10_TIME_JUMP;
+            Table->JumpCount++;
+        }
+
+        if (Point->Rtc <= Point[-1].Rtc)
+        {
+            Table->RtcSorted = 0;
+        }
+
+        if (Point->Time < Point[-1].Time)
+        {
+            Table->TimeSorted = 0;
+        }
+    }
+
+    return 0;
+}
+
+void
+Ch10FreeTimeTable (
+    CH10_TIME_TABLE         *Table
+    )
+{
+    free(Table->Points);
+
+    memset(Table, 0, sizeof(*Table));
+}
+
+//
+// Delta * Numerator / Denominator, for a ratio close to one and Delta at
+// most Denominator
+//
+static __u64
+Ch10ScaleTime (
+    __u64                   Delta,
+    __u64                   Numerator,
+    __u64                   Denominator
+    )
+{
+    __s64 Drift = (__s64) (Numerator - Denominator);
+
+    return Delta + (__u64) ((__s64) Delta * Drift / (__s64) Denominator);
+}
+
+//
+// Interpolation is done between a point and the next one when the next
+// one does not jump and is close enough
+//
+static const CH10_TIME_POINT *
+Ch10GetSegmentEnd (
+    const CH10_TIME_TABLE   *Table,
+    __u32                   Number
+    )
+{
+    const CH10_TIME_POINT *Point = &Table->Points[Number];
+
+    if (Number + 1 >= Table->Count ||
+        (Point[1].Flags & CH10_TIME_JUMP) ||
+        Point[1].Rtc - Point->Rtc > CH10_TIME_MAX_SEGMENT ||
+        Point[1].Time - Point->Time > CH10_TIME_MAX_SEGMENT)
+    {
+        return NULL;
+    }
+
+    return Point + 1;
+}
+
+//
+// Number of the last point at or before Rtc plus one, 0 when there is none
+//
+static __u32
+Ch10FindRtcPoint (
+    const CH10_TIME_TABLE   *Table,
+    __u64                   Rtc
+    )
+{
+    __u32 Low = 0;
+    __u32 High = Table->Count;
+    __u32 Middle;
+    __u32 Best = 0;
+
+    if (Table->RtcSorted)
+    {
+        while (Low < High)
+        {
+            Middle = Low + (High - Low) / 2;
+
+            if (Table->Points[Middle].Rtc <= Rtc)
+            {
+                Low = Middle + 1;
+            }
+            else
+            {
+                High = Middle;
+            }
+        }
+
+        return Low;
+    }
+
+    //
+    // The counter was reset, take the closest point below Rtc
+    //
+    for (Middle = 0; Middle < Table->Count; Middle++)
+    {
+        if (Table->Points[Middle].Rtc <= Rtc &&
+            (Best == 0 || Table->Points[Middle].Rtc >= Table->Points[Best - 1].Rtc))
+        {
+            Best = Middle + 1;
+        }
+    }
+
+    return Best;
+}
+
+//
+// Number of the point that starts the segment holding Time plus one, 0
+// when Time is before all points
+//
+static __u32
+Ch10FindTimePoint (
+    const CH10_TIME_TABLE   *Table,
+    __u64                   Time
+    )
+{
+    const CH10_TIME_POINT   *End;
+    __u32                   Low = 0;
+    __u32                   High = Table->Count;
+    __u32                   Middle;
+
+    if (Table->TimeSorted)
+    {
+        while (Low < High)
+        {
+            Middle = Low + (High - Low) / 2;
+
+            if (Table->Points[Middle].Time <= Time)
+            {
+                Low = Middle + 1;
+            }
+            else
+            {
+                High = Middle;
+            }
+        }
+
+        return Low;
+    }
+
+    //
+    // Time went back, the first segment in recording order that holds
+    // Time wins
+    //
+    for (Middle = 0; Middle < Table->Count; Middle++)
+    {
+        End = Middle + 1 < Table->Count ? &Table->Points[Middle + 1] : NULL;
+
+        if (Table->Points[Middle].Time <= Time &&
+            (End == NULL || (End->Flags & CH10_TIME_JUMP) || End->Time > Time))
+        {
+            return Middle + 1;
+        }
+    }
+
+    return 0;
+}
+
+//
+// Converts relative time to absolute time
+//
+int
+Ch10RtcToTime (
+    const CH10_TIME_TABLE   *Table,
+    __u64                   Rtc,
+    __u64                   *Time
+    )
+{
+    const CH10_TIME_POINT   *Point;
+    const CH10_TIME_POINT   *End;
+    __u32                   Number;
+
+    if (Table->Count == 0)
+    {
+        return -ENOENT;
+    }
+
+    Number = Ch10FindRtcPoint(Table, Rtc);
+
+    if (Number == 0)
+    {
+        Point = &Table->Points[0];
+
+        if (Point->Rtc - Rtc > Point->Time)
+        {
+            return -ERANGE;
+        }
+
+        *Time = Point->Time - (Point->Rtc - Rtc);
+        return 0;
+    }
+
+    Point = &Table->Points[Number - 1];
+    End = Ch10GetSegmentEnd(Table, Number - 1);
+
+    if (End && Rtc < End->Rtc)
+    {
+        *Time = Point->Time + Ch10ScaleTime(
+            Rtc - Point->Rtc,
+            End->Time - Point->Time,
+            End->Rtc - Point->Rtc
+            );
+    }
+    else
+    {
+        *Time = Point->Time + (Rtc - Point->Rtc);
+    }
+
+    return 0;
+}
+
+//
+// Converts absolute time to relative time
+//
+int
+Ch10TimeToRtc (
+    const CH10_TIME_TABLE   *Table,
+    __u64                   Time,
+    __u64                   *Rtc
+    )
+{
+    const CH10_TIME_POINT   *Point;
+    const CH10_TIME_POINT   *End;
+    __u32                   Number;
+
+    if (Table->Count == 0)
+    {
+        return -ENOENT;
+    }
+
+    Number = Ch10FindTimePoint(Table, Time);
+
+    if (Number == 0)
+    {
+        Point = &Table->Points[0];
+
+        if (Point->Time - Time > Point->Rtc)
+        {
+            return -ERANGE;
+        }
+
+        *Rtc = Point->Rtc - (Point->Time - Time);
+        return 0;
+    }
+
+    Point = &Table->Points[Number - 1];
+    End = Ch10GetSegmentEnd(Table, Number - 1);
+
+    if (End && Time < End->Time)
+    {
+        *Rtc = Point->Rtc + Ch10ScaleTime(
+            Time - Point->Time,
+            End->Rtc - Point->Rtc,
+            End->Time - Point->Time
+            );
+    }
+    else
+    {
+        *Rtc = Point->Rtc + (Time - Point->Time);
+    }
+
+    return 0;
+}
+
+//
+// Returns the offset of the time packet a reader looking for Time starts
+// from, the start of the recording when Time is before all time packets
+//
+int
+Ch10SeekTime (
+    const CH10_TIME_TABLE   *Table,
+    __u64                   Time,
+    __u64                   *Offset
+    )
+{
+    __u32 Number;
+
+    if (Table->Count == 0)
+    {
+        return -ENOENT;
+    }
+
+    Number = Ch10FindTimePoint(Table, Time);
+
+    *Offset = Number ? Table->Points[Number - 1].Offset : 0;
+
+    return 0;
+}
@@ -0,0 +1,1379 @@
+/*
+    Portable user-mode tools for IRIG 106 Chapter 10 volumes.
+	Copyright (C) 2014 Arthur Walton.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "ch10lib.h"
+#include "ch10pkt.h"
+#include "border.h"
+
+//
+// Directory blocks are read this many bytes at a time while the chain is
+// contiguous, which it is on everything a recorder writes
+//
+#define CH10_DIR_READ_AHEAD     (64 * 1024)
+
+//
+// Reads of a striped recording at least this long go to the members in
+// parallel
+//
+#define CH10_STRIPE_PARALLEL_READ   (256 * 1024)
+
+//
+// Mapping the hole of a sparse recording returns at most this many zeros
+//
+#define CH10_ZERO_LENGTH            (64 * 1024)
+
+static const __u8 Ch10Zeros[CH10_ZERO_LENGTH];
+
+//
+// Set of visited directory block numbers, used to stop on link cycles
+//
+typedef struct _CH10_BLOCK_SET {
+    __u64   *Slots;
+    __u32   Mask;
+    __u32   Count;
+} CH10_BLOCK_SET;
+
+static int
+Ch10BlockSetInsert (
+    CH10_BLOCK_SET  *Set,
+    __u64           Block
+    )
+{
+    __u64   *Slots;
+    __u32   Index;
+    __u32   Old;
+    __u64   Key = Block + 1;
+
+    if (Set->Slots == NULL || (Set->Count + 1) * 2 > Set->Mask + 1)
+    {
+        Old = Set->Slots ? Set->Mask + 1 : 0;
+        Slots = Set->Slots;
+
+        Set->Mask = Old ? Old * 2 - 1 : 63;
+        Set->Slots = calloc(Set->Mask + 1, sizeof(__u64));
+        Set->Count = 0;
+
+        if (Set->Slots == NULL)
+        {
+            free(Slots);
+            return -ENOMEM;
+        }
+
+        for (Index = 0; Index < Old; Index++)
+        {
+            if (Slots[Index])
+            {
+                Ch10BlockSetInsert(Set, Slots[Index] - 1);
+            }
+        }
+
+        free(Slots);
+    }
+
+    for (Index = (__u32) (Key * 0x9E3779B97F4A7C15ULL >> 32) & Set->Mask;
+         Set->Slots[Index];
+         Index = (Index + 1) & Set->Mask)
+    {
+        if (Set->Slots[Index] == Key)
+        {
+            return -ELOOP;
+        }
+    }
+
+    Set->Slots[Index] = Key;
+    Set->Count++;
+
+    return 0;
+}
+
+static int
+Ch10IsDirBlock (
+    const struct ch10_dir_block *DirBlock
+    )
+{
+    return !memcmp(DirBlock->magicNumAscii, CH10_MAGIC, sizeof(CH10_MAGIC) - 1);
+}
+
+//
+// Locates the root directory block at block 1. Volumes with 512 byte
+// blocks have it at CH10_MAGIC_OFFSET, larger block sizes are probed.
+//
+static int
+Ch10FindRootDirBlock (
+    CH10_BLOCKDEV           *Device,
+    struct ch10_dir_block   *DirBlock,
+    __u32                   *BytesPerBlock
+    )
+{
+    __u32   Offset;
+    ssize_t Result;
+
+    for (Offset = CH10_MAGIC_OFFSET; Offset <= CH10_MAX_BLOCK_SIZE; Offset *= 2)
+    {
+        Result = Ch10ReadBlockDevice(
+            Device,
+            Offset,
+            sizeof(struct ch10_dir_block),
+            DirBlock
+            );
+
+        if (Result < 0)
+        {
+            return (int) Result;
+        }
+
+        if (Result == sizeof(struct ch10_dir_block) && Ch10IsDirBlock(DirBlock))
+        {
+            *BytesPerBlock = Offset;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+static int
+Ch10ReadDirectory (
+    CH10_VOLUME *Volume
+    )
+{
+    CH10_BLOCKDEV           *Device = &Volume->Device;
+    CH10_BLOCK_SET          Visited = { NULL, 0, 0 };
+    struct ch10_dir_block   *DirBlocks = NULL;
+    __u64                   *DirBlockNumbers = NULL;
+    struct ch10_dir_block   *NewDirBlocks;
+    __u64                   *NewDirBlockNumbers;
+    __u32                   Capacity = 0;
+    __u32                   Count = 0;
+    __u64                   Block = 1;
+    __u64                   Next;
+    __u64                   WindowStart = 0;
+    __u64                   WindowBlocks = 0;
+    __u32                   WindowSize;
+    char                    *Window;
+    ssize_t                 Result;
+    int                     Status = 0;
+
+    WindowSize = Volume->BytesPerBlock > CH10_DIR_READ_AHEAD ?
+        Volume->BytesPerBlock : CH10_DIR_READ_AHEAD;
+
+    Window = Ch10AllocateAligned(WindowSize);
+
+    if (Window == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    for (;;)
+    {
+        Status = Ch10BlockSetInsert(&Visited, Block);
+
+        if (Status)
+        {
+            break;
+        }
+
+        if (Block < WindowStart || Block >= WindowStart + WindowBlocks)
+        {
+            Result = Ch10ReadBlockDevice(
+                Device,
+                Block * Volume->BytesPerBlock,
+                WindowSize,
+                Window
+                );
+
+            if (Result < 0)
+            {
+                Status = (int) Result;
+                break;
+            }
+
+            WindowStart = Block;
+            WindowBlocks = Result / Volume->BytesPerBlock;
+
+            if (WindowBlocks == 0)
+            {
+                Status = -EIO;
+                break;
+            }
+        }
+
+        if (Count == Capacity)
+        {
+            Capacity = Capacity ? Capacity * 2 : 16;
+
+            NewDirBlocks = realloc(DirBlocks, Capacity * sizeof(struct ch10_dir_block));
+            if (NewDirBlocks == NULL)
+            {
+                Status = -ENOMEM;
+                break;
+            }
+            DirBlocks = NewDirBlocks;
+
+            NewDirBlockNumbers = realloc(DirBlockNumbers, Capacity * sizeof(__u64));
+            if (NewDirBlockNumbers == NULL)
+            {
+                Status = -ENOMEM;
+                break;
+            }
+            DirBlockNumbers = NewDirBlockNumbers;
+        }
+
+        memcpy(
+            &DirBlocks[Count],
+            Window + (Block - WindowStart) * Volume->BytesPerBlock,
+            sizeof(struct ch10_dir_block)
+            );
+
+        if (!Ch10IsDirBlock(&DirBlocks[Count]))
+        {
+            Status = -EINVAL;
+            break;
+        }
+
+        DirBlockNumbers[Count++] = Block;
+
+        //
+        // The last block in the chain links forward to itself
+        //
+        Next = be64_to_cpu(DirBlocks[Count - 1].forwardLink);
+
+        if (Next == Block || Next == 0)
+        {
+            break;
+        }
+
+        if (Next * Volume->BytesPerBlock >= Device->Size)
+        {
+            Status = -EINVAL;
+            break;
+        }
+
+        Block = Next;
+    }
+
+    free(Visited.Slots);
+    free(Window);
+
+    if (Status)
+    {
+        free(DirBlocks);
+        free(DirBlockNumbers);
+        return Status;
+    }
+
+    Volume->DirBlocks = DirBlocks;
+    Volume->DirBlockNumbers = DirBlockNumbers;
+    Volume->DirBlockCount = Count;
+
+    return 0;
+}
+
+//
+// Follows the packet lengths from the start of a recording for as long as
+// the headers are valid and the packets fit in Limit bytes, and returns
+// where the last one ends. The last packet is also checked to its data
+// checksum, as it is the one a writer stopped in the middle of.
+//
+static int
+Ch10FindPacketEnd (
+    CH10_VOLUME *Volume,
+    __u64       Base,
+    __u64       Limit,
+    __u64       *End
+    )
+{
+    const struct ch10_packet_header *Header;
+    __u8                            *Window;
+    __u64                           WindowStart = 0;
+    __u64                           WindowLength = 0;
+    __u64                           Offset = 0;
+    __u64                           Previous = ~0ULL;
+    __u32                           PacketLength;
+    ssize_t                         Result = 0;
+
+    Window = Ch10AllocateAligned(CH10_SCAN_WINDOW);
+
+    if (Window == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    while (Limit - Offset >= CH10_PACKET_HEADER_SIZE)
+    {
+        if (Offset < WindowStart || Offset + CH10_PACKET_HEADER_SIZE > WindowStart + WindowLength)
+        {
+            WindowStart = Offset & ~(__u64) (Volume->Device.SectorSize - 1);
+
+            Result = Ch10ReadBlockDevice(
+                &Volume->Device,
+                Base + WindowStart,
+                (size_t) (Limit - WindowStart < CH10_SCAN_WINDOW ? Limit - WindowStart : CH10_SCAN_WINDOW),
+                Window
+                );
+
+            if (Result < 0)
+            {
+                break;
+            }
+
+            WindowLength = (__u64) Result;
+
+            if (Offset + CH10_PACKET_HEADER_SIZE > WindowStart + WindowLength)
+            {
+                break;
+            }
+        }
+
+        Header = (const struct ch10_packet_header *) (Window + (Offset - WindowStart));
+
+        if (Ch10CheckPacketHeader(Header))
+        {
+            break;
+        }
+
+        PacketLength = le32_to_cpu(Header->packetLength);
+
+        if (PacketLength > Limit - Offset)
+        {
+            break;
+        }
+
+        Previous = Offset;
+        Offset += PacketLength;
+    }
+
+    if (Result >= 0 && Previous != ~0ULL)
+    {
+        WindowStart = Previous & ~(__u64) (Volume->Device.SectorSize - 1);
+
+        Result = Ch10ReadBlockDevice(
+            &Volume->Device,
+            Base + WindowStart,
+            (size_t) (Offset - WindowStart),
+            Window
+            );
+
+        if (Result == (ssize_t) (Offset - WindowStart) &&
+            Ch10CheckPacketData((const struct ch10_packet_header *) (Window + (Previous - WindowStart))))
+        {
+            Offset = Previous;
+        }
+    }
+
+    free(Window);
+
+    if (Result < 0)
+    {
+        return (int) Result;
+    }
+
+    *End = Offset;
+
+    return 0;
+}
+
+//
+// A directory block with the shutdown flag set was being written when the
+// recorder stopped, and the size of its last entry cannot be trusted. The
+// size is taken from the packets instead, in memory only, bounded by the
+// blocks of the entry or, without them, by the next recording. An entry
+// whose packets cannot be read keeps its size, only -ENOMEM fails.
+//
+static int
+Ch10RecoverDirectory (
+    CH10_VOLUME *Volume
+    )
+{
+    struct ch10_dir_block   *DirBlock;
+    struct ch10_dir_entry   *DirEntry;
+    struct ch10_dir_entry   *Other;
+    const struct ch10_stripe *Stripe;
+    __u64                   Start;
+    __u64                   Limit;
+    __u64                   NextStart;
+    __u64                   Size = 0;
+    __u32                   DirIndex;
+    __u32                   OtherIndex;
+    __u32                   NumEntries;
+    int                     Status;
+
+    for (DirIndex = 0; DirIndex < Volume->DirBlockCount; DirIndex++)
+    {
+        DirBlock = &Volume->DirBlocks[DirIndex];
+        NumEntries = be16_to_cpu(DirBlock->numEntries);
+
+        if (!DirBlock->shutdown || NumEntries == 0 || NumEntries > MAX_FILES_PER_DIR)
+        {
+            continue;
+        }
+
+        DirEntry = &DirBlock->dirEntries[NumEntries - 1];
+        Stripe = (const struct ch10_stripe *) DirEntry->reserved;
+
+        //
+        // A member of a striped set holds only part of the recording
+        //
+        if (Stripe->tag == CH10_STRIPE_TAG)
+        {
+            continue;
+        }
+
+        Start = be64_to_cpu(DirEntry->blockNum) * Volume->BytesPerBlock;
+
+        if (Start >= Volume->Device.Size)
+        {
+            continue;
+        }
+
+        NextStart = Volume->Device.Size;
+
+        for (OtherIndex = 0; OtherIndex < Volume->DirBlockCount * MAX_FILES_PER_DIR; OtherIndex++)
+        {
+            if (OtherIndex % MAX_FILES_PER_DIR >=
+                be16_to_cpu(Volume->DirBlocks[OtherIndex / MAX_FILES_PER_DIR].numEntries))
+            {
+                continue;
+            }
+
+            Other = &Volume->DirBlocks[OtherIndex / MAX_FILES_PER_DIR].dirEntries[OtherIndex % MAX_FILES_PER_DIR];
+
+            if (be64_to_cpu(Other->blockNum) * Volume->BytesPerBlock > Start &&
+                be64_to_cpu(Other->blockNum) * Volume->BytesPerBlock < NextStart)
+            {
+                NextStart = be64_to_cpu(Other->blockNum) * Volume->BytesPerBlock;
+            }
+        }
+
+        Limit = NextStart - Start;
+
+        if (DirEntry->numBlocks &&
+            be64_to_cpu(DirEntry->numBlocks) < Limit / Volume->BytesPerBlock)
+        {
+            Limit = be64_to_cpu(DirEntry->numBlocks) * Volume->BytesPerBlock;
+        }
+
+        Status = Ch10FindPacketEnd(Volume, Start, Limit, &Size);
+
+        if (Status == -ENOMEM)
+        {
+            return Status;
+        }
+
+        if (Status)
+        {
+            continue;
+        }
+
+        DirEntry->size = cpu_to_be64(Size);
+
+        Volume->RecoveredCount++;
+    }
+
+    return 0;
+}
+
+static int
+Ch10BuildFileTable (
+    CH10_VOLUME *Volume
+    )
+{
+    struct ch10_dir_block   *DirBlock;
+    struct ch10_dir_entry   *DirEntry;
+    CH10_FILE               *File;
+    __u32                   DirIndex;
+    __u32                   EntryIndex;
+    __u32                   NumEntries;
+    __u32                   Count = 0;
+
+    for (DirIndex = 0; DirIndex < Volume->DirBlockCount; DirIndex++)
+    {
+        NumEntries = be16_to_cpu(Volume->DirBlocks[DirIndex].numEntries);
+        Count += NumEntries < MAX_FILES_PER_DIR ? NumEntries : MAX_FILES_PER_DIR;
+    }
+
+    Volume->Files = calloc(Count ? Count : 1, sizeof(CH10_FILE));
+
+    if (Volume->Files == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    for (DirIndex = 0; DirIndex < Volume->DirBlockCount; DirIndex++)
+    {
+        DirBlock = &Volume->DirBlocks[DirIndex];
+        NumEntries = be16_to_cpu(DirBlock->numEntries);
+
+        for (EntryIndex = 0;
+             EntryIndex < NumEntries && EntryIndex < MAX_FILES_PER_DIR;
+             EntryIndex++)
+        {
+            DirEntry = &DirBlock->dirEntries[EntryIndex];
+            File = &Volume->Files[Volume->FileCount];
+
+            memcpy(File->Name, DirEntry->name, CH10_MAXFN);
+            File->Name[strnlen(File->Name, CH10_MAXFN)] = 0;
+
+            if (File->Name[0] == 0)
+            {
+                continue;
+            }
+
+            File->Offset = be64_to_cpu(DirEntry->blockNum) * Volume->BytesPerBlock;
+            File->Size = be64_to_cpu(DirEntry->size);
+            File->NumBlocks = be64_to_cpu(DirEntry->numBlocks);
+            File->Allocated = File->NumBlocks ?
+                File->NumBlocks * Volume->BytesPerBlock : File->Size;
+            File->DirEntry = DirEntry;
+            File->DirEntryIndex = DirIndex * MAX_FILES_PER_DIR + EntryIndex;
+
+            Volume->FileCount++;
+        }
+    }
+
+    return 0;
+}
+
+//
+// FNV-1a over the upper cased name, so names differing only in case hash
+// alike
+//
+__u32
+Ch10HashFileName (
+    const char *FileName
+    )
+{
+    __u32 Hash = 2166136261U;
+
+    while (*FileName)
+    {
+        Hash ^= (__u8) toupper((__u8) *FileName++);
+        Hash *= 16777619U;
+    }
+
+    return Hash;
+}
+
+//
+// Builds the name index with at most half of the slots used. The first of
+// several entries with the same name is the one found, as with a scan of
+// the directory.
+//
+static int
+Ch10BuildNameIndex (
+    CH10_VOLUME *Volume
+    )
+{
+    __u32   Slots = 16;
+    __u32   FileIndex;
+    __u32   Index;
+    __u32   Slot;
+
+    while (Slots < Volume->FileCount * 2)
+    {
+        Slots *= 2;
+    }
+
+    Volume->NameIndex = calloc(Slots, sizeof(__u32));
+
+    if (Volume->NameIndex == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    Volume->NameIndexMask = Slots - 1;
+
+    for (FileIndex = 0; FileIndex < Volume->FileCount; FileIndex++)
+    {
+        for (Index = Ch10HashFileName(Volume->Files[FileIndex].Name) & Volume->NameIndexMask;
+             (Slot = Volume->NameIndex[Index]) != 0;
+             Index = (Index + 1) & Volume->NameIndexMask)
+        {
+            if (!strcasecmp(Volume->Files[Slot - 1].Name, Volume->Files[FileIndex].Name))
+            {
+                break;
+            }
+        }
+
+        if (Slot == 0)
+        {
+            Volume->NameIndex[Index] = FileIndex + 1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+Ch10MountDevice (
+    const char      *Path,
+    int             Flags,
+    CH10_VOLUME     **Volume
+    )
+{
+    CH10_VOLUME             *NewVolume;
+    struct ch10_dir_block   RootDirBlock;
+    int                     Status;
+
+    NewVolume = calloc(1, sizeof(CH10_VOLUME));
+
+    if (NewVolume == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    NewVolume->Members[0] = NewVolume;
+    NewVolume->MemberCount = 1;
+
+    Status = Ch10OpenBlockDevice(Path, Flags, &NewVolume->Device);
+
+    if (Status)
+    {
+        free(NewVolume);
+        return Status;
+    }
+
+    Status = Ch10FindRootDirBlock(
+        &NewVolume->Device,
+        &RootDirBlock,
+        &NewVolume->BytesPerBlock
+        );
+
+    if (!Status)
+    {
+        Status = Ch10ReadDirectory(NewVolume);
+    }
+
+    if (!Status)
+    {
+        Status = Ch10RecoverDirectory(NewVolume);
+    }
+
+    if (!Status)
+    {
+        memcpy(NewVolume->VolumeName, NewVolume->DirBlocks[0].volName, 32);
+        NewVolume->VolumeName[32] = 0;
+
+        Status = Ch10BuildFileTable(NewVolume);
+    }
+
+    if (!Status)
+    {
+        Status = Ch10BuildNameIndex(NewVolume);
+    }
+
+    if (Status)
+    {
+        Ch10DismountVolume(NewVolume);
+        return Status;
+    }
+
+    *Volume = NewVolume;
+
+    return 0;
+}
+
+static const struct ch10_stripe *
+Ch10GetStripe (
+    const CH10_FILE *File
+    )
+{
+    const struct ch10_stripe *Stripe;
+
+    Stripe = (const struct ch10_stripe *) File->DirEntry->reserved;
+
+    if (Stripe->tag != CH10_STRIPE_TAG ||
+        Stripe->memberCount < 2 ||
+        Stripe->memberCount > CH10_STRIPE_MAX_MEMBERS ||
+        Stripe->memberIndex >= Stripe->memberCount)
+    {
+        return NULL;
+    }
+
+    return Stripe;
+}
+
+//
+// Finds the set and position of a member from the first striped recording
+// on it
+//
+static int
+Ch10GetMemberIndex (
+    CH10_VOLUME     *Volume,
+    __u32           *SetId,
+    __u32           *MemberCount,
+    __u32           *MemberIndex
+    )
+{
+    const struct ch10_stripe    *Stripe;
+    __u32                       Index;
+
+    for (Index = 0; Index < Volume->FileCount; Index++)
+    {
+        Stripe = Ch10GetStripe(&Volume->Files[Index]);
+
+        if (Stripe)
+        {
+            *SetId = Stripe->setId[0] << 16 | Stripe->setId[1] << 8 | Stripe->setId[2];
+            *MemberCount = Stripe->memberCount;
+            *MemberIndex = Stripe->memberIndex;
+            return 0;
+        }
+    }
+
+    return -EINVAL;
+}
+
+//
+// Resolves the striped recordings of the first member against the entries
+// of the same name on the others. Recordings that are not striped are read
+// from the first member alone.
+//
+static int
+Ch10BuildStripeTable (
+    CH10_VOLUME *Volume
+    )
+{
+    const struct ch10_stripe    *Stripe;
+    const struct ch10_stripe    *MemberStripe;
+    CH10_VOLUME                 *MemberVolume;
+    CH10_FILE                   *File;
+    CH10_FILE                   *MemberFile;
+    __u64                       Unit;
+    __u64                       Units;
+    __u32                       Index;
+    __u32                       Member;
+    __u32                       MemberFileIndex;
+
+    for (Index = 0; Index < Volume->FileCount; Index++)
+    {
+        File = &Volume->Files[Index];
+        Stripe = Ch10GetStripe(File);
+
+        if (Stripe == NULL)
+        {
+            continue;
+        }
+
+        Unit = (__u64) Volume->BytesPerBlock << Stripe->unitShift;
+
+        if (Stripe->memberCount != Volume->MemberCount ||
+            Stripe->memberIndex != 0 ||
+            Stripe->unitShift >= 32 ||
+            Unit > CH10_STRIPE_MAX_UNIT)
+        {
+            return -EINVAL;
+        }
+
+        Units = (File->Size + Unit - 1) / Unit;
+
+        for (Member = 0; Member < Volume->MemberCount; Member++)
+        {
+            MemberVolume = Volume->Members[Member];
+
+            if (Ch10LookupFileName(MemberVolume, File->Name, &MemberFileIndex))
+            {
+                return -EINVAL;
+            }
+
+            MemberFile = &MemberVolume->Files[MemberFileIndex];
+            MemberStripe = Ch10GetStripe(MemberFile);
+
+            //
+            // Every member holds the whole of its units within its blocks
+            //
+            if (MemberStripe == NULL ||
+                memcmp(MemberStripe->setId, Stripe->setId, sizeof(Stripe->setId)) ||
+                MemberStripe->memberIndex != Member ||
+                MemberStripe->unitShift != Stripe->unitShift ||
+                MemberFile->Size != File->Size ||
+                MemberFile->NumBlocks * MemberVolume->BytesPerBlock <
+                    (Units + Volume->MemberCount - 1 - Member) / Volume->MemberCount * Unit)
+            {
+                return -EINVAL;
+            }
+
+            File->StripeOffsets[Member] = MemberFile->Offset;
+        }
+
+        File->StripeCount = Volume->MemberCount;
+        File->StripeUnit = (__u32) Unit;
+        File->NumBlocks = (Units * Unit) / Volume->BytesPerBlock;
+        File->Allocated = Units * Unit;
+    }
+
+    return 0;
+}
+
+//
+// Mounts the members of a striped set from a list of paths. The order of
+// the paths does not matter, the members are put in order by the stripe
+// descriptors in their directories. Members are read with pread, a
+// recording is not contiguous in any one mapping.
+//
+static int
+Ch10MountStripeSet (
+    const char      *Path,
+    int             Flags,
+    CH10_VOLUME     **Volume
+    )
+{
+    CH10_VOLUME *Mounted[CH10_STRIPE_MAX_MEMBERS];
+    CH10_VOLUME *Members[CH10_STRIPE_MAX_MEMBERS];
+    CH10_VOLUME *Primary;
+    char        *Paths;
+    char        *MemberPath;
+    char        *Next;
+    __u32       Count = 0;
+    __u32       SetId;
+    __u32       MemberCount;
+    __u32       MemberIndex;
+    __u32       FirstSetId = 0;
+    __u32       Index;
+    int         Status = 0;
+
+    Paths = strdup(Path);
+
+    if (Paths == NULL)
+    {
+        return -ENOMEM;
+    }
+
+    memset(Members, 0, sizeof(Members));
+
+    for (MemberPath = Paths; MemberPath && !Status; MemberPath = Next)
+    {
+        Next = strchr(MemberPath, CH10_MEMBER_SEPARATOR);
+
+        if (Next)
+        {
+            *Next++ = 0;
+        }
+
+        if (Count == CH10_STRIPE_MAX_MEMBERS)
+        {
+            Status = -E2BIG;
+            break;
+        }
+
+        Status = Ch10MountDevice(
+            MemberPath,
+            Flags & ~(CH10_OPEN_MMAP | CH10_OPEN_INDEX),
+            &Mounted[Count]
+            );
+
+        if (Status)
+        {
+            break;
+        }
+
+        Count++;
+
+        Status = Ch10GetMemberIndex(Mounted[Count - 1], &SetId, &MemberCount, &MemberIndex);
+
+        if (!Status && Count == 1)
+        {
+            FirstSetId = SetId;
+        }
+
+        if (!Status &&
+            (SetId != FirstSetId ||
+             MemberIndex >= MemberCount ||
+             Members[MemberIndex] != NULL))
+        {
+            Status = -EINVAL;
+        }
+
+        if (!Status)
+        {
+            Members[MemberIndex] = Mounted[Count - 1];
+        }
+    }
+
+    free(Paths);
+
+    if (!Status && Count != MemberCount)
+    {
+        Status = -EINVAL;
+    }
+
+    if (Status)
+    {
+        for (Index = 0; Index < Count; Index++)
+        {
+            Ch10DismountVolume(Mounted[Index]);
+        }
+        return Status;
+    }
+
+    Primary = Members[0];
+
+    memcpy(Primary->Members, Members, sizeof(Members));
+    Primary->MemberCount = Count;
+
+    Status = Ch10BuildStripeTable(Primary);
+
+    if (Status)
+    {
+        Ch10DismountVolume(Primary);
+        return Status;
+    }
+
+    *Volume = Primary;
+
+    return 0;
+}
+
+//
+// Path names one device or image, or the members of a striped set joined
+// by CH10_MEMBER_SEPARATOR
+//
+int
+Ch10MountVolume (
+    const char      *Path,
+    int             Flags,
+    CH10_VOLUME     **Volume
+    )
+{
+    CH10_VOLUME *NewVolume;
+    char        *IndexPath;
+    int         Status;
+
+    if (strchr(Path, CH10_MEMBER_SEPARATOR))
+    {
+        Status = Ch10MountStripeSet(Path, Flags, &NewVolume);
+    }
+    else
+    {
+        Status = Ch10MountDevice(Path, Flags, &NewVolume);
+    }
+
+    if (Status)
+    {
+        return Status;
+    }
+
+    //
+    // A sidecar that matches the volume brings its own name index, one that
+    // is missing, stale or damaged is passed over
+    //
+    if (Flags & CH10_OPEN_INDEX)
+    {
+        IndexPath = Ch10GetIndexPath(Path);
+
+        if (IndexPath)
+        {
+            Ch10OpenIndex(NewVolume, IndexPath);
+
+            free(IndexPath);
+        }
+    }
+
+    *Volume = NewVolume;
+
+    return 0;
+}
+
+void
+Ch10DismountVolume (
+    CH10_VOLUME *Volume
+    )
+{
+    __u32 Member;
+
+    for (Member = 1; Member < Volume->MemberCount; Member++)
+    {
+        Ch10DismountVolume(Volume->Members[Member]);
+    }
+
+    Ch10CloseBlockDevice(&Volume->Device);
+
+    Ch10CloseIndex(Volume);
+
+    free(Volume->NameIndex);
+    free(Volume->Files);
+    free(Volume->DirBlocks);
+    free(Volume->DirBlockNumbers);
+    free(Volume);
+}
+
+//
+// Names are compared case insensitive, as FsdLookupFileName does, through
+// the hash built at mount time
+//
+int
+Ch10LookupFileName (
+    CH10_VOLUME     *Volume,
+    const char      *FileName,
+    __u32           *Index
+    )
+{
+    __u32 Slot;
+    __u32 Entry;
+
+    while (*FileName == '/' || *FileName == '\\')
+    {
+        FileName++;
+    }
+
+    for (Slot = Ch10HashFileName(FileName) & Volume->NameIndexMask;
+         (Entry = Volume->NameIndex[Slot]) != 0;
+         Slot = (Slot + 1) & Volume->NameIndexMask)
+    {
+        if (!strcasecmp(Volume->Files[Entry - 1].Name, FileName))
+        {
+            *Index = Entry - 1;
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+//
+// The part of a read on a striped recording that falls on one member
+//
+typedef struct _CH10_STRIPE_READ {
+    CH10_VOLUME     *Volume;
+    CH10_FILE       *File;
+    __u32           Member;
+    __u64           Offset;
+    size_t          Length;
+    char            *Buffer;
+    ssize_t         Result;
+    pthread_t       Thread;
+    int             Started;
+} CH10_STRIPE_READ;
+
+static void *
+Ch10ReadStripeMember (
+    void *Context
+    )
+{
+    CH10_STRIPE_READ    *Read = Context;
+    CH10_FILE           *File = Read->File;
+    __u64               Unit = File->StripeUnit;
+    __u64               End = Read->Offset + Read->Length;
+    __u64               Position = Read->Offset;
+    __u64               UnitNumber;
+    __u64               Within;
+    size_t              Chunk;
+    ssize_t             Result;
+
+    Read->Result = 0;
+
+    while (Position < End)
+    {
+        UnitNumber = Position / Unit;
+
+        //
+        // Skip to the next unit on this member
+        //
+        if (UnitNumber % File->StripeCount != Read->Member)
+        {
+            UnitNumber += (Read->Member + File->StripeCount -
+                UnitNumber % File->StripeCount) % File->StripeCount;
+            Position = UnitNumber * Unit;
+            continue;
+        }
+
+        Within = Position % Unit;
+
+        Chunk = (size_t) (Unit - Within < End - Position ? Unit - Within : End - Position);
+
+        Result = Ch10ReadBlockDevice(
+            &Read->Volume->Members[Read->Member]->Device,
+            File->StripeOffsets[Read->Member] +
+                UnitNumber / File->StripeCount * Unit + Within,
+            Chunk,
+            Read->Buffer + (Position - Read->Offset)
+            );
+
+        if (Result >= 0 && (size_t) Result < Chunk)
+        {
+            Result = -EIO;
+        }
+
+        if (Result < 0)
+        {
+            Read->Result = Result;
+            break;
+        }
+
+        Position += Chunk;
+    }
+
+    return NULL;
+}
+
+//
+// Reads from all members a read covers at the same time, the calling
+// thread takes the first of them. Smaller reads are not worth a thread.
+//
+static ssize_t
+Ch10ReadStriped (
+    CH10_VOLUME     *Volume,
+    CH10_FILE       *File,
+    __u64           Offset,
+    size_t          Length,
+    void            *Buffer
+    )
+{
+    CH10_STRIPE_READ    Reads[CH10_STRIPE_MAX_MEMBERS];
+    __u64               FirstUnit = Offset / File->StripeUnit;
+    __u64               Units = (Offset + Length - 1) / File->StripeUnit - FirstUnit + 1;
+    __u32               Count = Units < File->StripeCount ? (__u32) Units : File->StripeCount;
+    __u32               Index;
+    ssize_t             Result = Length;
+
+    for (Index = 0; Index < Count; Index++)
+    {
+        Reads[Index].Volume = Volume;
+        Reads[Index].File = File;
+        Reads[Index].Member = (__u32) ((FirstUnit + Index) % File->StripeCount);
+        Reads[Index].Offset = Offset;
+        Reads[Index].Length = Length;
+        Reads[Index].Buffer = Buffer;
+
+        Reads[Index].Started = Index > 0 &&
+            Length >= CH10_STRIPE_PARALLEL_READ &&
+            !pthread_create(&Reads[Index].Thread, NULL, Ch10ReadStripeMember, &Reads[Index]);
+    }
+
+    for (Index = 0; Index < Count; Index++)
+    {
+        if (Reads[Index].Started)
+        {
+            pthread_join(Reads[Index].Thread, NULL);
+        }
+        else
+        {
+            Ch10ReadStripeMember(&Reads[Index]);
+        }
+
+        if (Reads[Index].Result < 0 && Result >= 0)
+        {
+            Result = Reads[Index].Result;
+        }
+    }
+
+    return Result;
+}
+
+//
+// Reads from a recording, a read at or past the end of it returns 0 and a
+// read across the end is shortened. The hole of a sparse recording reads
+// as zeros.
+//
+ssize_t
+Ch10ReadFileData (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u64           Offset,
+    size_t          Length,
+    void            *Buffer
+    )
+{
+    CH10_FILE   *File;
+    size_t      Data;
+    ssize_t     Result;
+
+    if (Index >= Volume->FileCount)
+    {
+        return -EINVAL;
+    }
+
+    File = &Volume->Files[Index];
+
+    if (Offset >= File->Size)
+    {
+        return 0;
+    }
+
+    if (Length > File->Size - Offset)
+    {
+        Length = (size_t) (File->Size - Offset);
+    }
+
+    if (File->StripeCount)
+    {
+        return Ch10ReadStriped(Volume, File, Offset, Length, Buffer);
+    }
+
+    //
+    // A member of a striped set mounted on its own holds only part of the
+    // recording
+    //
+    if (Ch10GetStripe(File))
+    {
+        return -ENXIO;
+    }
+
+    Data = Length;
+
+    if (Offset + Length > File->Allocated)
+    {
+        Data = Offset < File->Allocated ? (size_t) (File->Allocated - Offset) : 0;
+
+        memset((__u8 *) Buffer + Data, 0, Length - Data);
+
+        if (Data == 0)
+        {
+            return (ssize_t) Length;
+        }
+    }
+
+    Result = Ch10ReadBlockDevice(
+        &Volume->Device,
+        File->Offset + Offset,
+        Data,
+        Buffer
+        );
+
+    return Result == (ssize_t) Data ? (ssize_t) Length : Result;
+}
+
+//
+// Like Ch10ReadFileData, but returns the address of the data in the mapping
+// of a device opened with CH10_OPEN_MMAP instead of copying it. On a
+// striped recording the data returned ends with the stripe unit, on a
+// sparse one it ends with the blocks and the hole is returned as zeros.
+//
+ssize_t
+Ch10MapFileData (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u64           Offset,
+    size_t          Length,
+    const void      **Address
+    )
+{
+    CH10_FILE   *File;
+    __u64       UnitNumber;
+    __u64       Within;
+
+    if (Index >= Volume->FileCount)
+    {
+        return -EINVAL;
+    }
+
+    File = &Volume->Files[Index];
+
+    if (Offset >= File->Size)
+    {
+        return 0;
+    }
+
+    if (Length > File->Size - Offset)
+    {
+        Length = (size_t) (File->Size - Offset);
+    }
+
+    if (File->StripeCount)
+    {
+        UnitNumber = Offset / File->StripeUnit;
+        Within = Offset % File->StripeUnit;
+
+        if (Length > File->StripeUnit - Within)
+        {
+            Length = (size_t) (File->StripeUnit - Within);
+        }
+
+        return Ch10MapBlockDevice(
+            &Volume->Members[UnitNumber % File->StripeCount]->Device,
+            File->StripeOffsets[UnitNumber % File->StripeCount] +
+                UnitNumber / File->StripeCount * File->StripeUnit + Within,
+            Length,
+            Address
+            );
+    }
+
+    if (Ch10GetStripe(File))
+    {
+        return -ENXIO;
+    }
+
+    if (Offset >= File->Allocated)
+    {
+        *Address = Ch10Zeros;
+
+        return (ssize_t) (Length < CH10_ZERO_LENGTH ? Length : CH10_ZERO_LENGTH);
+    }
+
+    if (Length > File->Allocated - Offset)
+    {
+        Length = (size_t) (File->Allocated - Offset);
+    }
+
+    return Ch10MapBlockDevice(
+        &Volume->Device,
+        File->Offset + Offset,
+        Length,
+        Address
+        );
+}
+
+//
+// SEEK_DATA and SEEK_HOLE on a recording, as lseek. The data of a recording
+// runs from its start to the end of its blocks or of the recording, the
+// rest is a hole, and the end of the recording counts as a hole too.
+//
+__s64
+Ch10SeekFileData (
+    CH10_VOLUME     *Volume,
+    __u32           Index,
+    __u64           Offset,
+    int             Whence
+    )
+{
+    CH10_FILE   *File;
+    __u64       DataEnd;
+
+    if (Index >= Volume->FileCount)
+    {
+        return -EINVAL;
+    }
+
+    File = &Volume->Files[Index];
+
+    if (Offset >= File->Size)
+    {
+        return -ENXIO;
+    }
+
+    DataEnd = File->Allocated < File->Size ? File->Allocated : File->Size;
+
+    switch (Whence)
+    {
+    case SEEK_DATA:
+        return Offset < DataEnd ? (__s64) Offset : -ENXIO;
+
+    case SEEK_HOLE:
+        return Offset < DataEnd ? (__s64) DataEnd : (__s64) Offset;
+
+    default:
+        return -EINVAL;
+    }
+}